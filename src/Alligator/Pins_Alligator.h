@@ -23,6 +23,7 @@ const size_t NumFirmwareUpdateModules = 1;
 #define SUPPORT_SCANNER		0					// set nonzero to support FreeLSS scanners
 #define SUPPORT_IOBITS		0					// set to support P parameter in G0/G1 commands
 #define SUPPORT_DHT_SENSOR	0					// set nonzero to support DHT temperature/humidity sensors
+#define USE_FIXED_POINT_PREPARE	1					// set nonzero to prepare Cartesian axes using integer arithmetic (for processors without an FPU)
 
 // The physical capabilities of the machine
 
@@ -33,10 +33,13 @@ constexpr float ROOM_TEMPERATURE = 21.0;				// Celsius
 // Timeouts
 constexpr uint32_t LongTime = 300000;					// Milliseconds (5 minutes)
 constexpr uint32_t FanCheckInterval = 500;				// Milliseconds
+constexpr float FanRpmControlGain = 0.3;				// Proportion of the speed error that closed-loop fan control corrects each FanCheckInterval
 constexpr uint32_t MinimumWarningInterval = 4000;		// Milliseconds, must be at least as long as FanCheckInterval
 constexpr uint32_t LogFlushInterval = 15000;			// Milliseconds
+constexpr size_t LogBufferSize = 2048;					// Bytes of RAM used to hold event log records until they are written to the log file, must be a power of 2
 constexpr uint32_t DriverCoolingTimeout = 4000;			// Milliseconds
 constexpr float DefaultMessageTimeout = 10.0;			// How long a message is displayed by default, in seconds
+constexpr uint32_t SimulationSpinTime = 20;				// Milliseconds, the longest we spend simulating a file on each call to RepRap::Spin
 
 // FanCheckInterval must be lower than MinimumWarningInterval to avoid giving driver over temperature warnings too soon when thermostatic control of electronics cooling fans is used
 static_assert(FanCheckInterval < MinimumWarningInterval, "FanCheckInterval too large");
@@ -49,6 +52,9 @@ constexpr uint32_t SERIAL_MAIN_TIMEOUT = 1000;			// timeout in ms for sending da
 
 // Heater values
 constexpr float HEAT_SAMPLE_TIME = 0.5;					// Seconds
+constexpr uint32_t MinHeatSampleInterval = 250;			// Milliseconds, the shortest sample interval we allow for an individual heater whose sensor isn't on the ADC
+constexpr uint32_t MinFastHeatSampleInterval = 50;		// Milliseconds, the shortest sample interval we allow for an individual heater with a thermistor or PT1000 sensor
+constexpr uint32_t MaxHeatSampleInterval = 2000;		// Milliseconds, the longest sample interval we allow for an individual heater
 constexpr float HEAT_PWM_AVERAGE_TIME = 5.0;			// Seconds
 
 constexpr float TEMPERATURE_CLOSE_ENOUGH = 1.0;			// Celsius
@@ -149,9 +155,19 @@ constexpr unsigned int DefaultPinWritePwmFreq = 500;	// default PWM frequency fo
 //     Using single-precision maths and up to 9-factor calibration: (9 + 5) * 4 bytes per point
 //     Using double-precision maths and up to 9-factor calibration: (9 + 5) * 8 bytes per point
 //   So 32 points using double precision arithmetic need 3584 bytes of stack space.
+// - Each grid probe point uses 4 bytes, or 2 bytes if we store quantised heights.
+#ifndef USE_QUANTISED_HEIGHT_MAP
+# define USE_QUANTISED_HEIGHT_MAP	(SAM4E || SAM4S || SAME70)	// store grid heights as 16-bit multiples of HeightMapQuantum so that we can have twice as many points
+#endif
+
 #if SAM4E || SAM4S || SAME70
+# if USE_QUANTISED_HEIGHT_MAP
+constexpr size_t MaxGridProbePoints = 882;				// 882 allows us to probe e.g. 400x400 at 14mm intervals
+constexpr size_t MaxXGridPoints = 49;					// Maximum number of grid points in one X row
+# else
 constexpr size_t MaxGridProbePoints = 441;				// 441 allows us to probe e.g. 400x400 at 20mm intervals
 constexpr size_t MaxXGridPoints = 41;					// Maximum number of grid points in one X row
+# endif
 constexpr size_t MaxProbePoints = 32;					// Maximum number of G30 probe points
 constexpr size_t MaxCalibrationPoints = 32;				// Should a power of 2 for speed
 #elif SAM3XA
@@ -164,6 +180,8 @@ constexpr size_t MaxCalibrationPoints = 32;				// Should a power of 2 for speed
 #endif
 
 const float DefaultGridSpacing = 20.0;					// Default bed probing grid spacing in mm
+const float HeightMapQuantum = 0.001;					// Resolution of quantised grid heights in mm, the same as we use in the height map file
+constexpr size_t MaxMeshCellCrossings = 64;				// Maximum number of grid lines a move can cross before we revert to equal length mesh segments
 
 static_assert(MaxCalibrationPoints <= MaxProbePoints, "MaxCalibrationPoints must be <= MaxProbePoints");
 
@@ -181,6 +199,8 @@ constexpr size_t MaxZProbeProgramBytes = 8;				// Maximum number of bytes in a Z
 constexpr uint32_t ProbingSpeedReductionFactor = 3;		// The factor by which we reduce the Z probing speed when we get a 'near' indication
 constexpr float DefaultZProbeTolerance = 0.03;			// How close the Z probe trigger height from consecutive taps must be
 constexpr uint8_t DefaultZProbeTaps = 1;				// The maximum number of times we probe each point
+constexpr size_t MaxStatisticalZProbeTaps = 10;			// The maximum number of taps per point when the number of taps is decided statistically
+constexpr float ZProbeOutlierFactor = 3.0;				// Readings further than this many times the standard deviation limit from the median are rejected as outliers
 constexpr int DefaultZProbeADValue = 500;				// Default trigger threshold
 
 constexpr float TRIANGLE_ZERO = -0.001;					// Millimetres
@@ -216,18 +236,34 @@ constexpr size_t MaxFanNameLength = 20;					// Maximum number of characters in a
 // A note on reserved buffers: the worst case is when a GCode with a long response is processed. After string the response, there must be enough buffer space
 // for the HTTP responder to return a status response. Otherwise DWC never gets to know that it needs to make a rr_reply call and the system deadlocks.
 #if SAM4E || SAM4S || SAME70
-constexpr size_t OUTPUT_BUFFER_SIZE = 256;				// How many bytes does each OutputBuffer hold?
-constexpr size_t OUTPUT_BUFFER_COUNT = 20;				// How many OutputBuffer instances do we have?
+constexpr size_t OUTPUT_BUFFER_SIZE = 256;				// Nominal size of an OutputBuffer, used to size the arena and the reserve
+constexpr size_t OUTPUT_BUFFER_COUNT = 20;				// How many nominal-sized OutputBuffers the arena can hold
 constexpr size_t RESERVED_OUTPUT_BUFFERS = 4;			// Number of reserved output buffers after long responses, enough to hold a status response
 #elif SAM3XA
-constexpr size_t OUTPUT_BUFFER_SIZE = 256;				// How many bytes does each OutputBuffer hold?
-constexpr size_t OUTPUT_BUFFER_COUNT = 16;				// How many OutputBuffer instances do we have?
+constexpr size_t OUTPUT_BUFFER_SIZE = 256;				// Nominal size of an OutputBuffer, used to size the arena and the reserve
+constexpr size_t OUTPUT_BUFFER_COUNT = 16;				// How many nominal-sized OutputBuffers the arena can hold
 constexpr size_t RESERVED_OUTPUT_BUFFERS = 2;			// Number of reserved output buffers after long responses
 #else
 # error
 #endif
 
+// The data in output buffers is held in a shared arena. Each OutputBuffer gets a contiguous chunk of the arena that grows to fit the data written to it,
+// so short messages use less memory than a nominal-sized buffer and long ones need fewer buffers.
+constexpr size_t OUTPUT_BUFFER_ARENA_SIZE = OUTPUT_BUFFER_SIZE * OUTPUT_BUFFER_COUNT;	// How many bytes of data can all the OutputBuffers hold?
+constexpr size_t OUTPUT_BUFFER_GRANULE = 32;			// Unit of allocation from the arena, in bytes
+constexpr size_t OUTPUT_BUFFER_MAX_CHUNK = 4 * OUTPUT_BUFFER_SIZE;	// Maximum number of bytes that one OutputBuffer instance may hold
+constexpr size_t OUTPUT_BUFFER_HEADERS = 2 * OUTPUT_BUFFER_COUNT;	// How many OutputBuffer instances do we have?
+constexpr size_t MIN_SHARED_MESSAGE_LENGTH = 64;			// Messages at least this long that go to several destinations are held in one shared OutputBuffer
+
+static_assert(OUTPUT_BUFFER_ARENA_SIZE % OUTPUT_BUFFER_GRANULE == 0 && OUTPUT_BUFFER_MAX_CHUNK % OUTPUT_BUFFER_GRANULE == 0, "Bad output buffer granule size");
+
+#if SAM4E || SAM4S || SAME70
+const size_t maxQueuedCodes = 48;						// How many codes can be queued? Enough for a fan or laser change on every move in the DDA ring, several times over
+const size_t maxQueuedFanChanges = 64;					// How many fan speed changes can be queued in addition to the codes?
+#else
 const size_t maxQueuedCodes = 16;						// How many codes can be queued?
+const size_t maxQueuedFanChanges = 16;					// How many fan speed changes can be queued in addition to the codes?
+#endif
 
 // Move system
 constexpr float DefaultFeedRate = 3000.0;				// The initial requested feed rate after resetting the printer, in mm/min
@@ -236,7 +272,8 @@ constexpr float DefaultRetractSpeed = 1000.0;			// The default firmware retracti
 constexpr float DefaultRetractLength = 2.0;
 constexpr float MinimumMovementSpeed = 0.5;				// The minimum movement speed (extruding moves will go slower than this if the extrusion rate demands it)
 
-constexpr float DefaultArcSegmentLength = 0.2;			// G2 and G3 arc movement commands get split into segments this long
+constexpr float DefaultArcSegmentLength = 0.2;			// G2 and G3 arc movement commands get split into segments at least this long
+constexpr float DefaultArcTolerance = 0.002;			// the maximum deviation of arc segments from the true arc, used to lengthen the segments of large arcs
 
 constexpr uint32_t DefaultIdleTimeout = 30000;			// Milliseconds
 constexpr float DefaultIdleCurrentFactor = 0.3;			// Proportion of normal motor current that we use for idle hold
@@ -252,6 +289,11 @@ constexpr float NOZZLE_DIAMETER = 0.5;					// Millimetres
 constexpr float FILAMENT_WIDTH = 1.75;					// Millimetres
 
 constexpr unsigned int MaxStackDepth = 5;				// Maximum depth of stack
+#if SAM4E || SAM4S || SAME70
+constexpr unsigned int PreallocatedStackDepth = MaxStackDepth;	// Number of stack records that each input channel allocates at startup
+#else
+constexpr unsigned int PreallocatedStackDepth = 2;		// Number of stack records that each input channel allocates at startup, more are allocated when needed
+#endif
 
 // CNC and laser support
 constexpr size_t MaxSpindles = 4;						// Maximum number of configurable spindles
@@ -261,6 +303,20 @@ constexpr float DefaultMaxLaserPower = 255.0;			// Power setting in M3 command f
 // File handling
 constexpr size_t MAX_FILES = 10;						// Must be large enough to handle the max number of simultaneous web requests + files being printed
 constexpr size_t FILE_BUFFER_SIZE = 128;
+constexpr size_t MacroCacheSize = 4096;				// Bytes of RAM used to cache macro files, including their path names
+constexpr size_t MaxCachedMacros = 16;					// Maximum number of macro files in the cache
+constexpr size_t MaxCachedMacroSize = 1024;			// We don't cache macro files bigger than this
+constexpr size_t DefaultMaxCachedWebFiles = 32;		// Default maximum number of web interface files in the web file cache
+constexpr size_t DefaultMaxCachedWebFileSize = 32 * 1024;	// By default we don't cache web interface files bigger than this
+constexpr size_t MaxWebFileTableEntries = 32;			// Number of web interface files whose existence we remember
+constexpr size_t FileInfoIndexSlots = 512;				// Number of file entries in each directory's index of G-code file information
+constexpr size_t FileInfoIndexProbes = 8;				// Number of index entries we look at when searching for a file
+
+#if SAME70
+constexpr size_t SectorCacheSectors = 32;				// Number of FAT and directory sectors cached in RAM by the disk layer, shared between all SD cards
+#else
+constexpr size_t SectorCacheSectors = 8;
+#endif
 
 // Webserver stuff
 #define DEFAULT_PASSWORD		"reprap"				// Default machine password
@@ -282,7 +338,11 @@ constexpr size_t FILE_BUFFER_SIZE = 128;
 
 #define CONFIG_FILE "config.g"
 #define CONFIG_BACKUP_FILE "config.g.bak"
+#define COMPILED_CONFIG_FILE "config.gc"			// compact copy of config.g, run at startup instead of config.g if it is up to date
+#define FILE_INFO_INDEX_FILE ".fileinfo"			// index of parsed G-code file information, kept in each directory whose files have been parsed
 #define DEFAULT_LOG_FILE "eventlog.txt"
+#define DHCP_LEASE_FILE ".dhcplease"				// the IP address we were last given by DHCP, which we ask for again at startup
+#define DEFAULT_LAYER_PROFILE_FILE "layerprofile.csv"	// per-layer print profile written when enabled by M930
 
 #define EOF_STRING "<!-- **EoF** -->"
 
@@ -278,7 +278,9 @@ void Menu::Reload()
 
 	lcd.SetRightMargin(NumCols - currentMargin);
 	const char * const fname = filenames[numNestedMenus - 1].c_str();
-	FileStore * const file = reprap.GetPlatform().OpenFile(MENU_DIR, fname, OpenMode::read);
+	// Menu files are read every time a menu is entered, so let the macro cache keep them in RAM. That way navigating the menus doesn't compete
+	// for the SD card with the file being printed, and the cache already forgets a file when it is written, deleted or renamed.
+	FileStore * const file = reprap.GetPlatform().OpenFile(MENU_DIR, fname, OpenMode::read, true);
 	if (file == nullptr)
 	{
 		LoadError("Can't open menu file", 0);
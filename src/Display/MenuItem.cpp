@@ -13,7 +13,7 @@
 #include "Display.h"
 
 MenuItem::MenuItem(PixelNumber r, PixelNumber c, FontNumber fn)
-	: row(r), column(c), fontNumber(fn), next(nullptr)
+	: row(r), column(c), fontNumber(fn), drawn(false), drawnHighlighted(false), next(nullptr)
 {
 }
 
@@ -36,23 +36,23 @@ ButtonMenuItem::ButtonMenuItem(PixelNumber r, PixelNumber c, FontNumber fn, cons
 
 void ButtonMenuItem::Draw(Lcd7920& lcd, PixelNumber rightMargin, bool highlight)
 {
-	lcd.SetCursor(row, column);
-	lcd.SetRightMargin(rightMargin);
-	lcd.TextInvert(highlight);
-	lcd.print(text);
+	if (NeedsDraw(highlight))
+	{
+		lcd.SetCursor(row, column);
+		lcd.SetRightMargin(rightMargin);
+		lcd.TextInvert(highlight);
+		lcd.print(text);
+		SetDrawn(highlight);
+	}
 }
 
 ValueMenuItem::ValueMenuItem(PixelNumber r, PixelNumber c, FontNumber fn, PixelNumber w, unsigned int v, unsigned int d)
-	: MenuItem(r, c, fn), valIndex(v), currentValue(0.0), width(w), decimals(d), adjusting(false)
+	: MenuItem(r, c, fn), valIndex(v), currentValue(0.0), drawnValue(0), width(w), decimals(d), adjusting(false)
 {
 }
 
 void ValueMenuItem::Draw(Lcd7920& lcd, PixelNumber rightMargin, bool highlight)
 {
-	lcd.SetCursor(row, column);
-	lcd.SetRightMargin(min<PixelNumber>(column + width, rightMargin));
-	lcd.TextInvert(highlight);
-
 	bool error = false;
 	if (!adjusting)
 	{
@@ -100,15 +100,27 @@ void ValueMenuItem::Draw(Lcd7920& lcd, PixelNumber rightMargin, bool highlight)
 		}
 	}
 
-	if (error)
+	// Temperatures and the like are read on every refresh, but they seldom change in the digits that we display.
+	// So only render the value again if what we would display has changed.
+	static const float powersOfTen[] = { 1.0, 10.0, 100.0, 1000.0, 10000.0 };
+	const int32_t valueToDraw = (error) ? INT32_MIN : lrintf(currentValue * powersOfTen[min<size_t>(decimals, ARRAY_SIZE(powersOfTen) - 1)]);
+	if (NeedsDraw(highlight) || valueToDraw != drawnValue)
 	{
-		lcd.print("***");
-	}
-	else
-	{
-		lcd.print(currentValue, decimals);
+		lcd.SetCursor(row, column);
+		lcd.SetRightMargin(min<PixelNumber>(column + width, rightMargin));
+		lcd.TextInvert(highlight);
+		if (error)
+		{
+			lcd.print("***");
+		}
+		else
+		{
+			lcd.print(currentValue, decimals);
+		}
+		lcd.ClearToMargin();
+		drawnValue = valueToDraw;
+		SetDrawn(highlight);
 	}
-	lcd.ClearToMargin();
 }
 
 const char* ValueMenuItem::Select()
@@ -187,10 +199,14 @@ FilesMenuItem::FilesMenuItem(PixelNumber r, PixelNumber c, FontNumber fn, const
 
 void FilesMenuItem::Draw(Lcd7920& lcd, PixelNumber rightMargin, bool highlight)
 {
-	lcd.SetCursor(row, column);
-	lcd.SetRightMargin(rightMargin);
-	lcd.print("File list here...");
-	//TODO
+	if (NeedsDraw(highlight))
+	{
+		lcd.SetCursor(row, column);
+		lcd.SetRightMargin(rightMargin);
+		lcd.print("File list here...");
+		//TODO
+		SetDrawn(highlight);
+	}
 }
 
 // End
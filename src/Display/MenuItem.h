@@ -18,7 +18,8 @@ class MenuItem
 public:
 	typedef uint8_t FontNumber;
 
-	// Draw this element on the LCD respecting 'maxWidth' and 'highlight'
+	// Draw this element on the LCD respecting 'maxWidth' and 'highlight'.
+	// Menu::Refresh calls this on every pass, so elements skip drawing when what they would draw is unchanged.
 	virtual void Draw(Lcd7920& lcd, PixelNumber maxWidth, bool highlight) = 0;
 
 	// Select this element with a push of the encoder.
@@ -40,8 +41,14 @@ public:
 protected:
 	MenuItem(PixelNumber r, PixelNumber c, FontNumber fn);
 
+	// Return true if we haven't drawn this item yet or its highlighting has changed since we did
+	bool NeedsDraw(bool highlight) const { return !drawn || highlight != drawnHighlighted; }
+	void SetDrawn(bool highlight) { drawn = true; drawnHighlighted = highlight; }
+
 	PixelNumber row, column;
 	FontNumber fontNumber;
+	bool drawn;
+	bool drawnHighlighted;
 
 private:
 	MenuItem *next;
@@ -78,6 +85,7 @@ public:
 private:
 	unsigned int valIndex;
 	float currentValue;
+	int32_t drawnValue;					// the value we last drew, scaled by 10^decimals and rounded, or INT32_MIN if we drew the error marker
 	PixelNumber width;
 	uint8_t decimals;
 	bool adjusting;
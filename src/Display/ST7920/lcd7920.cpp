@@ -30,6 +30,9 @@ const unsigned int LcdCommandDelayMicros = 72 - 24; // 72us required, less 24us
 const unsigned int LcdDataDelayMicros = 10;			// delay between sending data bytes
 const unsigned int LcdDisplayClearDelayMillis = 3;	// 1.6ms should be enough
 
+const unsigned int WordsPerRow = NumCols/16;		// the GDRAM is written in 16-pixel words
+static_assert(WordsPerRow <= 8, "dirtyWords entries are too small");
+
 Lcd7920::Lcd7920(uint8_t csPin)
 	: currentFont(nullptr), numContinuationBytesLeft(0), textInverted(false)
 {
@@ -43,7 +46,8 @@ void Lcd7920::Init()
 {
 	sspi_master_init(&device, 8);
 	numContinuationBytesLeft = 0;
-	startRow = startCol =  endRow = endCol = nextFlushRow = 0;
+	nextFlushRow = 0;
+	memset(dirtyWords, 0xFF, sizeof(dirtyWords));	// we don't know what is in the display RAM, so send the whole image
 
 	sendLcdCommand(LcdFunctionSetBasicAlpha);
 	delay(1);
@@ -66,6 +70,18 @@ void Lcd7920::SetFont(const LcdFont *newFont)
 	currentFont = newFont;
 }
 
+// Store a byte in the image buffer. If it has changed, flag the 16-pixel word containing it as needing to be sent to the display.
+// Redrawing something that hasn't changed therefore costs no display traffic.
+inline void Lcd7920::setImageByte(uint8_t *p, uint8_t val)
+{
+	if (*p != val)
+	{
+		*p = val;
+		const size_t offset = p - image;
+		dirtyWords[offset/(NumCols/8)] |= 1u << ((offset % (NumCols/8))/2);
+	}
+}
+
 // Write a UTF8 byte.
 // If textYpos is off the end of the display, then don't write anything, just update textXpos and lastCharColData
 size_t Lcd7920::write(uint8_t c)
@@ -170,15 +186,6 @@ size_t Lcd7920::writeNative(uint16_t ch)
 
 		uint8_t nCols = *fontPtr++;
 
-		// Update dirty rectangle coordinates, except for endCol which we do at the end
-		{
-			if (startRow > row) { startRow = row; }
-			if (startCol > column) { startCol = column; }
-			uint8_t nextRow = row + ySize;
-			if (nextRow > NumRows) { nextRow = NumRows; }
-			if (endRow < nextRow) { endRow = nextRow; }
-		}
-
 		if (lastCharColData != 0)	// if we have written anything other than spaces
 		{
 			uint8_t numSpaces = currentFont->numSpaces;
@@ -208,14 +215,7 @@ size_t Lcd7920::writeNative(uint16_t ch)
 					uint8_t *p = image + ((row * (NumCols/8)) + (column/8));
 					for (uint8_t i = 0; i < ySize && p < (image + sizeof(image)); ++i)
 					{
-						if (textInverted)
-						{
-							*p |= mask;
-						}
-						else
-						{
-							*p &= ~mask;
-						}
+						setImageByte(p, (textInverted) ? *p | mask : *p & ~mask);
 						p += (NumCols/8);
 					}
 				}
@@ -237,14 +237,7 @@ size_t Lcd7920::writeNative(uint16_t ch)
 			const uint16_t setPixelVal = (textInverted) ? 0 : 1;
 			for (uint8_t i = 0; i < ySize && p < (image + sizeof(image)); ++i)
 			{
-				if ((colData & 1u) == setPixelVal)
-				{
-					*p |= mask1;      // set pixel
-				}
-				else
-				{
-					*p &= mask2;     // clear pixel
-				}
+				setImageByte(p, ((colData & 1u) == setPixelVal) ? *p | mask1 : *p & mask2);	// set or clear pixel
 				colData >>= 1;
 				p += (NumCols/8);
 			}
@@ -252,10 +245,6 @@ size_t Lcd7920::writeNative(uint16_t ch)
 			++column;
 		}
 
-		if (column > endCol)
-		{
-			endCol = min<uint8_t>(column, NumCols);
-		}
 		justSetCursor = false;
 	}
 	return 1;
@@ -281,16 +270,6 @@ void Lcd7920::ClearToMargin()
 		if (column < rightMargin)
 		{
 			const uint8_t fontHeight = currentFont->height;
-			// Update dirty rectangle coordinates
-			{
-			  if (startRow > row) { startRow = row; }
-			  if (startCol > column) { startCol = column; }
-			  uint8_t nextRow = row + fontHeight;
-			  if (nextRow > NumRows) { nextRow = NumRows; }
-			  if (endRow < nextRow) { endRow = nextRow; }
-			  if (endCol < rightMargin) { endCol = rightMargin; }
-			}
-
 			while (column < rightMargin)
 			{
 				uint8_t *p = image + ((row * (NumCols/8)) + (column/8));
@@ -306,14 +285,7 @@ void Lcd7920::ClearToMargin()
 				}
 				for (uint8_t i = 0; i < fontHeight && p < (image + sizeof(image)); ++i)
 				{
-					if (textInverted)
-					{
-						*p |= mask;
-					}
-					else
-					{
-						*p &= ~mask;
-					}
+					setImageByte(p, (textInverted) ? *p | mask : *p & ~mask);
 					p += (NumCols/8);
 				}
 			}
@@ -339,26 +311,21 @@ void Lcd7920::Clear(PixelNumber sRow, PixelNumber sCol, PixelNumber eRow, PixelN
 		if ((col & 7) != 0)
 		{
 			uint8_t * const p = image + ((row * (NumCols/8)) + (col/8));
-			*p &= ~(0xFF >> (col & 7));
+			setImageByte(p, *p & ~(0xFF >> (col & 7)));
 			col = (col & ~7) + 1;
 		}
 		while (col < eCol)
 		{
-			image[(row * (NumCols/8)) + (col/8)] = 0;
+			setImageByte(image + (row * (NumCols/8)) + (col/8), 0);
 			col += 8;
 		}
 		if ((eCol & 7) != 0)
 		{
 			uint8_t * const p = image + ((row * (NumCols/8)) + (col/8));
-			*p &= (0xFF >> (col & 7));
+			setImageByte(p, *p & (0xFF >> (col & 7)));
 		}
 	}
 
-	// Flag cleared part as dirty
-	startRow = sRow;
-	endRow = eRow;
-	startCol = sCol;
-	endCol = eCol;
 	SetCursor(sRow, sCol);
 	textInverted = false;
 	leftMargin = sCol;
@@ -440,13 +407,9 @@ void Lcd7920::Bitmap(PixelNumber x0, PixelNumber y0, PixelNumber width, PixelNum
 		uint16_t bitMapOffset = r * (width/8);
 		for (PixelNumber c = 0; c < (width/8) && c + (x0/8) < NumCols/8; ++c)
 		{
-			*p++ = data[bitMapOffset++];
+			setImageByte(p++, data[bitMapOffset++]);
 		}
 	}
-	if (x0 < startCol) startCol = x0;
-	if (x0 + width > endCol) endCol = x0 + width;
-	if (y0 < startRow) startRow = y0;
-	if (y0 + height > endRow) endRow = y0 + height;
 }
 
 // Flush all of the dirty part of the image to the lcd
@@ -455,42 +418,21 @@ void Lcd7920::FlushAll()
 	while (FlushSome()) { }
 }
 
-// Flush some of the dirty part of the image to the LCD, returning true if there is more to do
+// Flush the next row that has changed to the LCD, returning true if we found one so that there may be more to do.
+// We look at the rows in turn starting from the one after the last one we flushed, so that no row gets starved.
 bool Lcd7920::FlushSome()
 {
-	// See if there is anything to flush
-	if (endCol > startCol && endRow > startRow)
+	for (PixelNumber rowsChecked = 0; rowsChecked < NumRows; ++rowsChecked)
 	{
-		// Decide which row to flush next
-		if (nextFlushRow < startRow || nextFlushRow >= endRow)
-		{
-			nextFlushRow = startRow;
-			++startRow;				// flag this row as flushed because it will be soon
-		}
-
-		// Flush that row
-		const uint8_t startColNum = startCol/16;
-		const uint8_t endColNum = (endCol + 15)/16;
-		setGraphicsAddress(nextFlushRow, startColNum);
-		uint8_t *ptr = image + ((16 * nextFlushRow) + (2 * startColNum));
-		for (uint8_t i = startColNum; i < endColNum; ++i)
+		const PixelNumber r = nextFlushRow;
+		nextFlushRow = (nextFlushRow + 1) % NumRows;
+		const unsigned int dirty = dirtyWords[r];
+		if (dirty != 0)
 		{
-			sendLcdData(*ptr++);
-			//commandDelay();		// don't seem to need a delay here
-			sendLcdData(*ptr++);
-			//commandDelay();  	 	// don't seem to need as long a delay as this
-			delayMicroseconds(LcdDataDelayMicros);
-		}
-
-		if (startRow != endRow)
-		{
-			++nextFlushRow;
+			dirtyWords[r] = 0;				// flag this row as flushed before we send it, in case it gets changed again while we are sending it
+			sendLcdRow(r, __builtin_ctz(dirty), 32 - __builtin_clz(dirty));
 			return true;
 		}
-
-		startRow = NumRows;
-		startCol = NumCols;
-		endCol = endRow = nextFlushRow = 0;
 	}
 	return false;
 }
@@ -513,21 +455,15 @@ void Lcd7920::SetPixel(PixelNumber y, PixelNumber x, PixelMode mode)
 		switch(mode)
 		{
 		case PixelMode::PixelClear:
-			*p &= ~mask;
+			setImageByte(p, *p & ~mask);
 			break;
 		case PixelMode::PixelSet:
-			*p |= mask;
+			setImageByte(p, *p | mask);
 			break;
 		case PixelMode::PixelFlip:
-			*p ^= mask;
+			setImageByte(p, *p ^ mask);
 			break;
 		}
-
-		// Change the dirty rectangle to account for a pixel being dirty (we assume it was changed)
-		if (startRow > y) { startRow = y; }
-		if (endRow <= y)  { endRow = y + 1; }
-		if (startCol > x) { startCol = x; }
-		if (endCol <= x)  { endCol = x + 1; }
 	}
 }
 
@@ -541,15 +477,6 @@ bool Lcd7920::ReadPixel(PixelNumber x, PixelNumber y) const
 	return false;
 }
 
-// Set the address to write to. The column address is in 16-bit words, so it ranges from 0 to 7.
-void Lcd7920::setGraphicsAddress(unsigned int r, unsigned int c)
-{
-	sendLcdCommand(LcdSetGdramAddress | (r & 31));
-	//commandDelay();  // don't seem to need this one
-	sendLcdCommand(LcdSetGdramAddress | c | ((r & 32) >> 2));
-	commandDelay();    // we definitely need this one
-}
-
 void Lcd7920::commandDelay()
 {
 	delayMicroseconds(LcdCommandDelayMicros);
@@ -585,6 +512,43 @@ void Lcd7920::sendLcd(uint8_t data1, uint8_t data2)
 	delayMicroseconds(1);
 }
 
+// Send the words from startWord up to but not including endWord of row 'r' to the LCD.
+// We keep the SPI bus and the chip select for the whole row instead of claiming them for every byte, which is where most of the time used to go.
+// Each byte is still sent as a complete instruction with its own synchronising byte, and we keep the delays that the LCD needs.
+void Lcd7920::sendLcdRow(PixelNumber r, unsigned int startWord, unsigned int endWord)
+{
+	MutexLocker lock(Tasks::GetSpiMutex());
+	sspi_master_setup_device(&device);
+	delayMicroseconds(1);
+	sspi_select_device(&device);
+	delayMicroseconds(1);
+
+	// Set the address. The column address is in 16-bit words, so it ranges from 0 to 7.
+	const uint8_t rowAddress = LcdSetGdramAddress | (r & 31);
+	const uint8_t colAddress = LcdSetGdramAddress | startWord | ((r & 32) >> 2);
+	uint8_t data[6] = { 0xF8, (uint8_t)(rowAddress & 0xF0), (uint8_t)(rowAddress << 4), 0xF8, (uint8_t)(colAddress & 0xF0), (uint8_t)(colAddress << 4) };
+	sspi_transceive_packet(data, nullptr, sizeof(data));
+	commandDelay();
+
+	const uint8_t *ptr = image + ((NumCols/8) * r) + (2 * startWord);
+	for (unsigned int i = startWord; i < endWord; ++i)
+	{
+		const uint8_t hi = *ptr++;
+		const uint8_t lo = *ptr++;
+		data[0] = data[3] = 0xFA;
+		data[1] = hi & 0xF0;
+		data[2] = hi << 4;
+		data[4] = lo & 0xF0;
+		data[5] = lo << 4;
+		sspi_transceive_packet(data, nullptr, sizeof(data));
+		delayMicroseconds(LcdDataDelayMicros);
+	}
+
+	delayMicroseconds(1);
+	sspi_deselect_device(&device);
+	delayMicroseconds(1);
+}
+
 #endif
 
 // End
@@ -82,7 +82,7 @@ public:
 	// Flush the display buffer to the display. Data will not be committed to the display until this is called.
 	void FlushAll();
 
-	// Flush just some data, returning true if this needs to be called again
+	// Flush one row that has changed, returning true if we flushed anything so that this may need to be called again
 	bool FlushSome();
 
 	// Set, clear or invert a pixel
@@ -125,18 +125,19 @@ private:
 	uint16_t lastCharColData;						// data for the last non-space column, used for kerning
 	uint8_t numContinuationBytesLeft;
 	PixelNumber row, column;
-	PixelNumber startRow, startCol, endRow, endCol;	// coordinates of the dirty rectangle
-	PixelNumber nextFlushRow;						// which row we need to flush next
+	PixelNumber nextFlushRow;						// which row we look at first when we next flush
 	PixelNumber leftMargin, rightMargin;
 	uint8_t image[(NumRows * NumCols)/8];			// image buffer, 1K in size
+	uint8_t dirtyWords[NumRows];					// for each row, a bitmap of the 16-pixel words that have changed since we last sent them
 	bool textInverted;
 	bool justSetCursor;
 
 	void sendLcdCommand(uint8_t command);
 	void sendLcdData(uint8_t data);
 	void sendLcd(uint8_t data1, uint8_t data2);
+	void sendLcdRow(PixelNumber r, unsigned int startWord, unsigned int endWord);
+	void setImageByte(uint8_t *p, uint8_t val);		// store a byte in the image and flag it dirty if it changed
 	void commandDelay();
-	void setGraphicsAddress(unsigned int r, unsigned int c);
 	size_t writeNative(uint16_t c);					// write a decoded character
 
 };
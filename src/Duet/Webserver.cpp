@@ -90,6 +90,7 @@
 #include "RepRap.h"
 #include "GCodes/GCodes.h"
 #include "PrintMonitor.h"
+#include "PerfCounters.h"
 
 //***************************************************************************************************
 
@@ -141,99 +142,117 @@ void Webserver::Spin()
 		ftpInterpreter->Spin();
 		telnetInterpreter->Spin();
 
-		// See if we have new data to process
-		currentTransaction = network->GetTransaction(readingConnection);
-		if (currentTransaction != nullptr)
+		// See if we have new data to process. Browsers open several connections at once to fetch the files of the web interface,
+		// so we process several transactions in each call rather than leave them waiting for the main loop to come round again.
+		for (size_t numProcessed = 0; numProcessed < maxTransactionsPerSpin; ++numProcessed)
 		{
-			// Take care of different protocol types here
-			ProtocolInterpreter *interpreter;
-			const uint16_t localPort = currentTransaction->GetLocalPort();
-			if (localPort == Network::GetHttpPort())
+			currentTransaction = network->GetTransaction(readingConnection);
+			if (currentTransaction == nullptr)
 			{
-				interpreter = httpInterpreter;
-			}
-			else if (localPort == Network::GetTelnetPort())
-			{
-				interpreter = telnetInterpreter;
-			}
-			else
-			{
-				interpreter = ftpInterpreter;
+				if (readingConnection != NoConnection)
+				{
+					// We failed to find a transaction for a reading connection.
+					// This should never happen, but if it does, terminate this connection instantly
+					platform->Message(UsbMessage, "Error: Transaction for reading connection not found\n");
+					Network::Terminate(readingConnection);
+				}
+				break;
 			}
 
-			// See if we have to print some debug info
-			if (reprap.Debug(moduleWebserver))
-			{
-				const char *type;
-				switch (currentTransaction->GetStatus())
+				// Take care of different protocol types here
+				ProtocolInterpreter *interpreter;
+				const uint16_t localPort = currentTransaction->GetLocalPort();
+				if (localPort == Network::GetHttpPort())
 				{
-					case TransactionStatus::released: type = "released"; break;
-					case TransactionStatus::connected: type = "connected"; break;
-					case TransactionStatus::receiving: type = "receiving"; break;
-					case TransactionStatus::sending: type = "sending"; break;
-					case TransactionStatus::disconnected: type = "disconnected"; break;
-					case TransactionStatus::deferred: type = "deferred"; break;
-					case TransactionStatus::acquired: type = "acquired"; break;
-					default: type = "unknown"; break;
+					interpreter = httpInterpreter;
+				}
+				else if (localPort == Network::GetTelnetPort())
+				{
+					interpreter = telnetInterpreter;
+				}
+				else
+				{
+					interpreter = ftpInterpreter;
 				}
-				platform->MessageF(UsbMessage, "Incoming transaction: Type %s at local port %d (remote port %d)\n",
-						type, localPort, currentTransaction->GetRemotePort());
-			}
 
-			// For protocols other than HTTP it is important to send a HELO message
-			TransactionStatus status = currentTransaction->GetStatus();
-			if (status == TransactionStatus::connected)
-			{
-				interpreter->ConnectionEstablished();
-			}
-			// Graceful disconnects are handled here, because prior NetworkTransactions might still contain valid
-			// data. That's why it's a bad idea to close these connections immediately in the Network class.
-			else if (status == TransactionStatus::disconnected)
-			{
-				// This will call the disconnect events and effectively close the connection
-				currentTransaction->Discard();
-			}
-			// Check for fast uploads via this connection
-			else if (interpreter->DoingFastUpload())
-			{
-				interpreter->DoFastUpload();
-			}
-			// Process other messages (if we can)
-			else if (interpreter->CanParseData())
-			{
-				readingConnection = currentTransaction->GetConnection();
-				for(size_t i = 0; i < TCP_MSS / 3; i++)
+				// See if we have to print some debug info
+				if (reprap.Debug(moduleWebserver))
 				{
-					char c;
-					if (currentTransaction->Read(c))
+					const char *type;
+					switch (currentTransaction->GetStatus())
 					{
-						// Each ProtocolInterpreter must take care of the current NetworkTransaction by
-						// calling either Commit(), Discard() or Defer()
-						if (interpreter->CharFromClient(c))
+						case TransactionStatus::released: type = "released"; break;
+						case TransactionStatus::connected: type = "connected"; break;
+						case TransactionStatus::receiving: type = "receiving"; break;
+						case TransactionStatus::sending: type = "sending"; break;
+						case TransactionStatus::disconnected: type = "disconnected"; break;
+						case TransactionStatus::deferred: type = "deferred"; break;
+						case TransactionStatus::acquired: type = "acquired"; break;
+						default: type = "unknown"; break;
+					}
+					platform->MessageF(UsbMessage, "Incoming transaction: Type %s at local port %d (remote port %d)\n",
+							type, localPort, currentTransaction->GetRemotePort());
+				}
+
+				// For protocols other than HTTP it is important to send a HELO message
+				TransactionStatus status = currentTransaction->GetStatus();
+				if (status == TransactionStatus::connected)
+				{
+					interpreter->ConnectionEstablished();
+				}
+				// Graceful disconnects are handled here, because prior NetworkTransactions might still contain valid
+				// data. That's why it's a bad idea to close these connections immediately in the Network class.
+				else if (status == TransactionStatus::disconnected)
+				{
+					// This will call the disconnect events and effectively close the connection
+					currentTransaction->Discard();
+				}
+				// Check for fast uploads via this connection
+				else if (interpreter->DoingFastUpload())
+				{
+					interpreter->DoFastUpload();
+					break;								// writing the upload data to the SD card may take a while
+				}
+				// Process other messages (if we can)
+				else if (interpreter->CanParseData())
+				{
+					readingConnection = currentTransaction->GetConnection();
+					for(size_t i = 0; i < TCP_MSS / 3; i++)
+					{
+						char c;
+						if (currentTransaction->Read(c))
+						{
+							// Each ProtocolInterpreter must take care of the current NetworkTransaction by
+							// calling either Commit(), Discard() or Defer()
+							if (interpreter->CharFromClient(c))
+							{
+								readingConnection = NoConnection;
+								break;
+							}
+						}
+						else
 						{
+							// We ran out of data before finding a complete request. This happens when the incoming
+							// message length exceeds the TCP MSS. Notify the current ProtocolInterpreter about this,
+							// which will remove the current transaction too
+							interpreter->NoMoreDataAvailable();
 							readingConnection = NoConnection;
 							break;
 						}
 					}
-					else
-					{
-						// We ran out of data before finding a complete request. This happens when the incoming
-						// message length exceeds the TCP MSS. Notify the current ProtocolInterpreter about this,
-						// which will remove the current transaction too
-						interpreter->NoMoreDataAvailable();
-						readingConnection = NoConnection;
-						break;
-					}
 				}
+				else
+				{
+					// The interpreter is still busy with an earlier request, so this transaction will still be first in the queue
+					break;
+				}
+
+			// Leave the remaining transactions until next time if we have run out of buffers for the responses
+			if (OutputBuffer::GetBytesLeft(nullptr) == 0)
+			{
+				break;
 			}
 		}
-		else if (readingConnection != NoConnection)
-		{
-			// We failed to find a transaction for a reading connection.
-			// This should never happen, but if it does, terminate this connection instantly
-			platform->Message(UsbMessage, "Error: Transaction for reading connection not found\n");
-			Network::Terminate(readingConnection);
-		}
 		network->Unlock();		// unlock LWIP again
 	}
 }
@@ -613,6 +632,7 @@ void Webserver::HttpInterpreter::SendFile(const char* nameOfFileToSend, bool isW
 	NetworkTransaction *transaction = webserver->currentTransaction;
 	FileStore *fileToSend = nullptr;
 	bool zip = false;
+	char nameOfFileOpened[MaxFilenameLength + 1];
 
 	if (isWebFile)
 	{
@@ -635,6 +655,7 @@ void Webserver::HttpInterpreter::SendFile(const char* nameOfFileToSend, bool isW
 			if (fileToSend != nullptr)
 			{
 				zip = true;
+				SafeStrncpy(nameOfFileOpened, nameBuf, ARRAY_SIZE(nameOfFileOpened));
 			}
 		}
 
@@ -656,7 +677,33 @@ void Webserver::HttpInterpreter::SendFile(const char* nameOfFileToSend, bool isW
 			RejectMessage("not found", 404);
 			return;
 		}
+		if (!zip)
+		{
+			SafeStrncpy(nameOfFileOpened, nameOfFileToSend, ARRAY_SIZE(nameOfFileOpened));
+		}
+
+		// Web files change rarely, so let the browser cache them and check that its copy is still current using the ETag or the modification time.
+		// The ETag is derived from the size and modification time of the file.
+		const time_t lastModified = platform->GetMassStorage()->GetLastModifiedTime(platform->GetWebDir(), nameOfFileOpened);
+		String<eTagLength> eTag;
+		eTag.printf("\"%" PRIx32 "-%" PRIx32 "\"", (uint32_t)fileToSend->Length(), (uint32_t)lastModified);
+		if (lastModified != 0 && !CheckModified(eTag.c_str(), lastModified))
+		{
+			fileToSend->Close();
+			const char * const connection = GetHeaderValue("Connection");
+			const bool keepOpen = connection != nullptr && StringEquals(connection, "keep-alive");
+			transaction->Printf("HTTP/1.1 304 Not Modified\nETag: %s\nCache-Control: no-cache\nConnection: %s\n\n", eTag.c_str(), (keepOpen) ? "keep-alive" : "close");
+			transaction->Commit(keepOpen);
+			return;
+		}
+
 		transaction->SetFileToWrite(fileToSend);
+		transaction->Write("HTTP/1.1 200 OK\n");
+		if (lastModified != 0)
+		{
+			transaction->Printf("Cache-Control: no-cache\nETag: %s\nLast-Modified: ", eTag.c_str());
+			WriteHttpDate(lastModified);
+		}
 	}
 	else
 	{
@@ -667,13 +714,9 @@ void Webserver::HttpInterpreter::SendFile(const char* nameOfFileToSend, bool isW
 			return;
 		}
 		transaction->SetFileToWrite(fileToSend);
-	}
 
-	transaction->Write("HTTP/1.1 200 OK\n");
-
-	// Don't cache files served by rr_download
-	if (!isWebFile)
-	{
+		// Don't cache files served by rr_download
+		transaction->Write("HTTP/1.1 200 OK\n");
 		transaction->Write("Cache-Control: no-cache, no-store, must-revalidate\n");
 		transaction->Write("Pragma: no-cache\n");
 		transaction->Write("Expires: 0\n");
@@ -834,15 +877,8 @@ void Webserver::HttpInterpreter::SendJsonResponse(const char* command)
 	if (mayKeepOpen)
 	{
 		// Check that the browser wants to persist the connection too
-		for (size_t i = 0; i < numHeaderKeys; ++i)
-		{
-			if (StringEquals(headers[i].key, "Connection"))
-			{
-				// Comment out the following line to disable persistent connections
-				keepOpen = StringEquals(headers[i].value, "keep-alive");
-				break;
-			}
-		}
+		const char * const connection = GetHeaderValue("Connection");
+		keepOpen = connection != nullptr && StringEquals(connection, "keep-alive");		// comment out this line to disable persistent connections
 	}
 
 	transaction->Write("HTTP/1.1 200 OK\n");
@@ -1026,6 +1062,17 @@ void Webserver::HttpInterpreter::GetJsonResponse(const char* request, OutputBuff
 		OutputBuffer::Release(response);
 		response = reprap.GetConfigResponse();
 	}
+	else if (StringEquals(request, "perf"))
+	{
+		// rr_perf?reset=1 returns the counters and then starts new totals
+		OutputBuffer::Release(response);
+		response = PerfCounters::GetJsonResponse();
+		const char* const resetVal = GetKeyValue("reset");
+		if (resetVal != nullptr && SafeStrtol(resetVal) == 1)
+		{
+			PerfCounters::Reset();
+		}
+	}
 	else
 	{
 		RejectMessage("Unknown request", 500);
@@ -1044,6 +1091,52 @@ const char* Webserver::HttpInterpreter::GetKeyValue(const char *key) const
 	return nullptr;
 }
 
+// Get the value of a header. Header names are not case sensitive.
+const char* Webserver::HttpInterpreter::GetHeaderValue(const char *key) const
+{
+	for (size_t i = 0; i < numHeaderKeys; ++i)
+	{
+		if (StringEquals(headers[i].key, key))
+		{
+			return headers[i].value;
+		}
+	}
+	return nullptr;
+}
+
+// Return true if the client doesn't have an up-to-date copy of a web file, according to the If-None-Match or If-Modified-Since request headers
+bool Webserver::HttpInterpreter::CheckModified(const char *eTag, time_t lastModified) const
+{
+	const char * const ifNoneMatch = GetHeaderValue("If-None-Match");
+	if (ifNoneMatch != nullptr)
+	{
+		return strstr(ifNoneMatch, eTag) == nullptr;		// the header may hold a list of ETags, possibly marked as weak
+	}
+
+	const char * const ifModifiedSince = GetHeaderValue("If-Modified-Since");
+	if (ifModifiedSince != nullptr)
+	{
+		struct tm timeInfo;
+		memset(&timeInfo, 0, sizeof(timeInfo));
+		if (strptime(ifModifiedSince, "%a, %d %b %Y %H:%M:%S", &timeInfo) != nullptr)
+		{
+			return lastModified > mktime(&timeInfo);
+		}
+	}
+	return true;
+}
+
+// Write a time to the current transaction in the format used by HTTP headers, followed by newline. We treat file times as GMT.
+void Webserver::HttpInterpreter::WriteHttpDate(time_t time)
+{
+	static const char * const DayNames[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char * const MonthNames[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	const struct tm * const timeInfo = gmtime(&time);
+	webserver->currentTransaction->Printf("%s, %02d %s %04d %02d:%02d:%02d GMT\n",
+											DayNames[timeInfo->tm_wday], timeInfo->tm_mday, MonthNames[timeInfo->tm_mon], timeInfo->tm_year + 1900,
+											timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
+}
+
 void Webserver::HttpInterpreter::ResetState()
 {
 	clientPointer = 0;
@@ -53,6 +53,8 @@ const size_t maxHeaders = 30;					// max number of key/value pairs in the header
 
 const size_t  maxHttpSessions = 8;				// maximum number of simultaneous HTTP sessions
 const uint32_t httpSessionTimeout = 8000;		// HTTP session timeout in milliseconds
+const size_t maxTransactionsPerSpin = 4;		// maximum number of network transactions we process in each call to Spin
+const size_t eTagLength = 20;					// enough for two 32-bit hex numbers separated by a dash, in quotes
 
 /* FTP */
 
@@ -225,6 +227,9 @@ protected:
 		void UpdateAuthentication();
 		bool RemoveAuthentication();
 		const char* GetKeyValue(const char *key) const;	// return the value of the specified key, or nullptr if not present
+		const char* GetHeaderValue(const char *key) const;	// return the value of the specified header, or nullptr if not present
+		bool CheckModified(const char *eTag, time_t lastModified) const;
+		void WriteHttpDate(time_t time);
 
 		// Responses from GCodes class
 		uint32_t seq;									// Sequence number for G-Code replies
@@ -33,7 +33,11 @@ constexpr size_t NumFirmwareUpdateModules = 1;		// 1 module
 #define SUPPORT_IOBITS		0						// set to support P parameter in G0/G1 commands
 #define SUPPORT_DHT_SENSOR	1						// set nonzero to support DHT temperature/humidity sensors (requires RTOS)
 #define SUPPORT_WORKPLACE_COORDINATES	1			// set nonzero to support G10 L2 and G53..59
+#define SUPPORT_INPUT_SHAPING	1					// set nonzero to support input shaping (needs an FPU)
 #define SUPPORT_12864_LCD	1						// set nonzero to support 12864 LCD and rotary encoder
+#define SUPPORT_MACRO_CACHE	1						// set nonzero to keep copies of small macro and menu files in RAM
+#define SUPPORT_USB_STREAMING	1					// set nonzero to buffer USB input in a large ring so that a host can stream G-codes (M575 P0 S4)
+#define SUPPORT_MICROSTEP_SWITCHING	1				// set nonzero to support reducing the microstepping during long travel moves (M936, needs smart drivers)
 
 // The physical capabilities of the machine
 
@@ -165,6 +169,7 @@ constexpr uint32_t IAP_FLASH_END = 0x0047FFFF;								// we allow a full 64K on
 
 // Duet pin numbers to control the W5500 interface
 constexpr Pin W5500ResetPin = 100;											// Low on this in holds the W5500 module in reset (ESP_RESET)
+constexpr Pin W5500InterruptPin = NoPin;									// the W5500 interrupt output is not connected
 constexpr Pin W5500SsPin = 11;												// SPI NPCS pin, input from W5500 module
 
 // Timer allocation
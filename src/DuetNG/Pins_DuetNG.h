@@ -26,9 +26,33 @@ constexpr size_t NumFirmwareUpdateModules = 4;		// 3 modules, plus one for manua
 #define SUPPORT_ROLAND		0						// set nonzero to support Roland mill
 #define SUPPORT_SCANNER		1						// set zero to disable support for FreeLSS scanners
 #define SUPPORT_LASER		1						// support laser cutters and engravers using G1 S parameter
+#define SUPPORT_LASER_RASTER	1					// support per-pixel laser power in G1 D parameter (needs SUPPORT_LASER)
 #define SUPPORT_IOBITS		1						// set to support P parameter in G0/G1 commands
 #define SUPPORT_DHT_SENSOR	1						// set nonzero to support DHT temperature/humidity sensors
 #define SUPPORT_WORKPLACE_COORDINATES	1			// set nonzero to support G10 L2 and G53..59
+#define SUPPORT_INPUT_SHAPING	1					// set nonzero to support input shaping (needs an FPU)
+#define SUPPORT_STEP_TABLES	1						// set nonzero to precompute step times outside the step ISR
+#define SUPPORT_STEP_TRACE	1						// set nonzero to support tracing step interrupt latency (M597)
+#define SUPPORT_MOVE_TRACE	1						// set nonzero to support recording a timeline of executed moves (M931)
+#define SUPPORT_MOVE_MERGING	1					// set nonzero to support merging runs of short collinear moves (M933)
+#define SUPPORT_HEATER_TRACE	1					// set nonzero to support recording heater temperature and PWM traces (M594)
+#define SUPPORT_TOOL_PREHEAT	1					// set nonzero to support heating the next tool before a tool change in a file being printed (M599)
+#define SUPPORT_ENDSTOP_INTERRUPTS	1				// set nonzero to support pin change interrupts on endstop and Z probe inputs (M574 Q1)
+#define SUPPORT_KINEMATICS_BENCHMARK	1			// set nonzero to support measuring the execution time of each kinematics (M942)
+#define SUPPORT_MACRO_CACHE	1						// set nonzero to keep copies of small macro files in RAM
+#define SUPPORT_WEB_FILE_CACHE	1					// set nonzero to support keeping copies of small web interface files in RAM (M940)
+#define SUPPORT_WEB_FILE_TABLE	1					// set nonzero to remember which web interface files and gzipped versions exist
+#define SUPPORT_USB_STREAMING	1					// set nonzero to buffer USB input in a large ring so that a host can stream G-codes (M575 P0 S4)
+#define SUPPORT_HTTP_GZIP	1						// set nonzero to gzip large JSON and G-code reply responses for HTTP clients that accept it
+#define SUPPORT_COMPILED_CONFIG	1					// set nonzero to run a compact copy of config.g at startup once it has run without errors
+#define SUPPORT_FILE_INFO_INDEX	1					// set nonzero to keep the parsed information about G-code files in an index file in each directory
+#define SUPPORT_RECENT_FILES	1					// set nonzero to keep a list of the newest files in the G-code files directory (rr_recent, M20 S4)
+#define SUPPORT_SECTOR_CACHE	1					// set nonzero to cache FAT and directory sectors in RAM
+#define SUPPORT_STORAGE_TASK	1					// set nonzero to read ahead in files being printed using a separate task (needs RTOS)
+#define SUPPORT_RESUME_CHECKPOINT	1				// set nonzero to save the resume state in a preallocated file instead of writing resurrect.g when the power fails
+#define SUPPORT_AUX_PDC		1						// set nonzero to send aux output buffers to the UART using the PDC instead of through the serial driver
+#define USE_DM_HEAP			1						// set nonzero to keep the active drives in a binary heap instead of a sorted list
+#define SUPPORT_MICROSTEP_SWITCHING	1				// set nonzero to support reducing the microstepping during long travel moves (M936, needs smart drivers)
 
 #define USE_CACHE			0						// set nonzero to enable the cache. Disabled this at 1.21RC1 because of doubts about its safety.
 
@@ -53,6 +77,7 @@ constexpr size_t MaxDriversPerAxis = 5;				// The maximum number of stepper driv
 constexpr size_t NUM_SERIAL_CHANNELS = 2;			// The number of serial IO channels (USB and one auxiliary UART)
 #define SERIAL_MAIN_DEVICE SerialUSB
 #define SERIAL_AUX_DEVICE Serial
+Uart * const AuxUart = UART0;						// The UART used by SERIAL_AUX_DEVICE, needed when SUPPORT_AUX_PDC is set
 
 #define I2C_IFACE	Wire							// Which TWI interface we use
 #define I2C_IRQn	WIRE_ISR_ID						// The interrupt number it uses
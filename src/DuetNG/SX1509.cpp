@@ -27,7 +27,7 @@ Distributed as-is; no warranty is given.
 #include "SX1509Registers.h"
 #include "RTOSIface.h"
 
-SX1509::SX1509() : _clkX(0), errorCount(0)
+SX1509::SX1509() : _clkX(0), errorCount(0), dirtyRegisters(0), iOnValid(0)
 {
 }
 
@@ -46,7 +46,7 @@ bool SX1509::begin(uint8_t address)
 	TaskCriticalSectionLocker lock;
 
 	const uint16_t testRegisters = readWord(REG_INTERRUPT_MASK_A);	// this should return 0xFF00
-	const bool ok = (testRegisters == 0xFF00);
+	const bool ok = (testRegisters == 0xFF00) && readBytes(REG_INPUT_DISABLE_B, shadowRegisters, NumShadowedRegisters);
 	if (ok)
 	{
 		clock(DefaultOscDivider);
@@ -64,23 +64,69 @@ void SX1509::reset()
 	// Software reset command sequence:
 	writeByte(REG_RESET, 0x12);
 	writeByte(REG_RESET, 0x34);
+	dirtyRegisters = 0;
+	iOnValid = 0;
 }
 
+// Set a register pair in the shadow copy, marking any bytes that change as needing to be written
+void SX1509::setShadowWord(uint8_t registerAddress, uint16_t value)
+{
+	const uint8_t msb = (uint8_t)(value >> 8), lsb = (uint8_t)value;
+	if (shadowRegisters[registerAddress] != msb)
+	{
+		shadowRegisters[registerAddress] = msb;
+		dirtyRegisters |= 1u << registerAddress;
+	}
+	if (shadowRegisters[registerAddress + 1] != lsb)
+	{
+		shadowRegisters[registerAddress + 1] = lsb;
+		dirtyRegisters |= 1u << (registerAddress + 1);
+	}
+}
+
+// Write any changed shadowed registers to the device in a single auto-incrementing transaction
+void SX1509::flushRegisters()
+{
+	if (dirtyRegisters != 0)
+	{
+		const unsigned int first = __builtin_ctz(dirtyRegisters);
+		const unsigned int last = 31 - __builtin_clz(dirtyRegisters);
+		writeBytes(first, shadowRegisters + first, last + 1 - first);
+		dirtyRegisters = 0;
+	}
+}
+
+// Set bits in a register pair. If the register is shadowed then the change is not written until flushRegisters is called.
 void SX1509::setBitsInWord(uint8_t registerAddress, uint16_t bits)
 {
 	if (bits != 0)
 	{
-		const uint16_t regVal = readWord(registerAddress);
-		writeWord(registerAddress, regVal | bits);
+		if (registerAddress < NumShadowedRegisters)
+		{
+			setShadowWord(registerAddress, (((uint16_t)shadowRegisters[registerAddress] << 8) | shadowRegisters[registerAddress + 1]) | bits);
+		}
+		else
+		{
+			const uint16_t regVal = readWord(registerAddress);
+			writeWord(registerAddress, regVal | bits);
+		}
 	}
 }
 
+// Clear bits in a register pair. If the register is shadowed then the change is not written until flushRegisters is called.
 void SX1509::clearBitsInWord(uint8_t registerAddress, uint16_t bits)
 {
 	if (bits != 0)
 	{
-		const uint16_t regVal = readWord(registerAddress);
-		writeWord(registerAddress, regVal & (~bits));
+		if (registerAddress < NumShadowedRegisters)
+		{
+			setShadowWord(registerAddress, (((uint16_t)shadowRegisters[registerAddress] << 8) | shadowRegisters[registerAddress + 1]) & (~bits));
+		}
+		else
+		{
+			const uint16_t regVal = readWord(registerAddress);
+			writeWord(registerAddress, regVal & (~bits));
+		}
 	}
 }
 
@@ -115,6 +161,7 @@ void SX1509::pinModeMultiple(uint16_t pins, PinMode inOut)
 		setBitsInWord(REG_DIR_B, pins);
 		clearBitsInWord(REG_PULL_UP_B, pins);
 		clearBitsInWord(REG_PULL_DOWN_B, pins);
+		flushRegisters();
 		break;
 
 	case INPUT_PULLUP:
@@ -122,6 +169,7 @@ void SX1509::pinModeMultiple(uint16_t pins, PinMode inOut)
 		setBitsInWord(REG_DIR_B, pins);
 		clearBitsInWord(REG_PULL_DOWN_B, pins);
 		setBitsInWord(REG_PULL_UP_B, pins);
+		flushRegisters();
 		break;
 
 	case INPUT_PULLDOWN:
@@ -129,14 +177,17 @@ void SX1509::pinModeMultiple(uint16_t pins, PinMode inOut)
 		setBitsInWord(REG_DIR_B, pins);
 		clearBitsInWord(REG_PULL_UP_B, pins);
 		setBitsInWord(REG_PULL_DOWN_B, pins);
+		flushRegisters();
 		break;
 
 	case OUTPUT_LOW:
 		clearBitsInWord(REG_PULL_UP_B, pins);
 		clearBitsInWord(REG_PULL_DOWN_B, pins);
 		clearBitsInWord(REG_DATA_B, pins & ~pwmPins);
+		flushRegisters();							// make sure the output data is set up before we enable the outputs
 		clearBitsInWord(REG_OPEN_DRAIN_B, pins);
 		clearBitsInWord(REG_DIR_B, pins);
+		flushRegisters();
 		analogWriteMultiple(pins & pwmPins, 0);
 		break;
 
@@ -144,8 +195,10 @@ void SX1509::pinModeMultiple(uint16_t pins, PinMode inOut)
 		clearBitsInWord(REG_PULL_UP_B, pins);
 		clearBitsInWord(REG_PULL_DOWN_B, pins);
 		setBitsInWord(REG_DATA_B, pins & ~pwmPins);
+		flushRegisters();							// make sure the output data is set up before we enable the outputs
 		clearBitsInWord(REG_OPEN_DRAIN_B, pins);
 		clearBitsInWord(REG_DIR_B, pins);
+		flushRegisters();
 		analogWriteMultiple(pins & pwmPins, 255);
 		break;
 
@@ -153,8 +206,10 @@ void SX1509::pinModeMultiple(uint16_t pins, PinMode inOut)
 		clearBitsInWord(REG_PULL_UP_B, pins);
 		clearBitsInWord(REG_PULL_DOWN_B, pins);
 		clearBitsInWord(REG_DATA_B, pins & ~pwmPins);
+		flushRegisters();							// make sure the output data is set up before we enable the outputs
 		setBitsInWord(REG_OPEN_DRAIN_B, pins);
 		clearBitsInWord(REG_DIR_B, pins);
+		flushRegisters();
 		analogWriteMultiple(pins & pwmPins, 0);
 		break;
 
@@ -162,8 +217,10 @@ void SX1509::pinModeMultiple(uint16_t pins, PinMode inOut)
 		clearBitsInWord(REG_PULL_UP_B, pins);
 		clearBitsInWord(REG_PULL_DOWN_B, pins);
 		setBitsInWord(REG_DATA_B, pins & ~pwmPins);
+		flushRegisters();							// make sure the output data is set up before we enable the outputs
 		setBitsInWord(REG_OPEN_DRAIN_B, pins);
 		clearBitsInWord(REG_DIR_B, pins);
+		flushRegisters();
 		analogWriteMultiple(pins & pwmPins, 255);
 		break;
 
@@ -189,13 +246,17 @@ void SX1509::digitalWrite(uint8_t pin, bool highLow)
 	{
 		analogWrite(pin, (highLow) ? 255 : 0);
 	}
-	else if (highLow)
-	{
-		setBitsInWord(REG_DATA_B, 1u << pin);
-	}
 	else
 	{
-		clearBitsInWord(REG_DATA_B, 1u << pin);
+		if (highLow)
+		{
+			setBitsInWord(REG_DATA_B, 1u << pin);
+		}
+		else
+		{
+			clearBitsInWord(REG_DATA_B, 1u << pin);
+		}
+		flushRegisters();
 	}
 }
 
@@ -243,6 +304,7 @@ void SX1509::ledDriverInitMultiple(uint16_t pins, bool log, bool openDrain)
 	clearBitsInWord(REG_PULL_UP_B, pins);		// disable pullup
 	clearBitsInWord(REG_PULL_DOWN_B, pins);		// disable pulldown
 	clearBitsInWord(REG_DIR_B, pins);			// set as an output
+	flushRegisters();
 
 	// Configure LED driver clock and mode (REG_MISC)
 	uint8_t tempByte = readByte(REG_MISC);
@@ -261,6 +323,7 @@ void SX1509::ledDriverInitMultiple(uint16_t pins, bool log, bool openDrain)
 	
 	// Set REG_DATA bit low ~ LED driver started
 	clearBitsInWord(REG_DATA_B, pins);
+	flushRegisters();
 
 	pwmPins |= pins;							// record which pins are in LED driver mode
 }
@@ -274,7 +337,13 @@ void SX1509::analogWrite(uint8_t pin, uint8_t iOn)
 	// Log mode: Ion = f(iOn)
 	// We use the pins as active-high outputs to drive the fan mosfets, not to sink LED current directly.
 	// This means that we need to invert the intensity, and log mode doesn't make sense.
-	writeByte(REG_I_ON[pin], ~iOn);
+	const uint16_t pinBit = 1u << pin;
+	if ((iOnValid & pinBit) == 0 || iOnShadow[pin] != iOn)
+	{
+		writeByte(REG_I_ON[pin], ~iOn);
+		iOnShadow[pin] = iOn;
+		iOnValid |= pinBit;
+	}
 }
 
 void SX1509::enableInterrupt(uint8_t pin, uint8_t riseFall)
@@ -321,6 +390,7 @@ void SX1509::enableInterruptMultiple(uint16_t pins, uint8_t riseFall)
 	writeDword(REG_SENSE_HIGH_B, pinMask);
 
 	clearBitsInWord(REG_INTERRUPT_MASK_B, pins);
+	flushRegisters();
 }
 
 uint16_t SX1509::interruptSource(bool clear)
@@ -504,6 +574,40 @@ uint32_t SX1509::readDword(uint8_t registerAddress)
 	return rslt;
 }
 
+// readBytes(uint8_t registerAddress, uint8_t *values, size_t numValues)
+//	This function reads numValues consecutive registers starting at registerAddress
+//	- Returns true if successful, false if communication failed
+bool SX1509::readBytes(uint8_t registerAddress, uint8_t *values, size_t numValues)
+{
+	unsigned int timeout = ReceiveTimeout * numValues;
+
+	I2C_IFACE.beginTransmission(deviceAddress);
+	I2C_IFACE.write(registerAddress);
+	if (I2C_IFACE.endTransmission() != 0)
+	{
+		++errorCount;
+		return false;
+	}
+	I2C_IFACE.requestFrom(deviceAddress, (uint8_t)numValues);
+
+	while ((I2C_IFACE.available() < (int)numValues) && (timeout != 0))
+	{
+		timeout--;
+	}
+
+	if (timeout == 0)
+	{
+		++errorCount;
+		return false;
+	}
+
+	for (size_t i = 0; i < numValues; ++i)
+	{
+		values[i] = (uint8_t)I2C_IFACE.read();
+	}
+	return true;
+}
+
 // writeByte(uint8_t registerAddress, uint8_t writeValue)
 //	This function writes a single uint8_t to a single register on the SX509.
 //	- writeValue is written to registerAddress
@@ -554,4 +658,21 @@ void SX1509::writeDword(uint8_t registerAddress, uint32_t writeValue)
 	}
 }
 
+// writeBytes(uint8_t registerAddress, const uint8_t *values, size_t numValues)
+//	This function writes numValues consecutive registers starting at registerAddress in a single transaction
+//	- No return value.
+void SX1509::writeBytes(uint8_t registerAddress, const uint8_t *values, size_t numValues)
+{
+	I2C_IFACE.beginTransmission(deviceAddress);
+	I2C_IFACE.write(registerAddress);
+	for (size_t i = 0; i < numValues; ++i)
+	{
+		I2C_IFACE.write(values[i]);
+	}
+	if (I2C_IFACE.endTransmission() != 0)
+	{
+		++errorCount;
+	}
+}
+
 // End
@@ -39,6 +39,13 @@ private:
 	uint16_t pwmPins;						// bitmap of pins configured as PWM output pins
 	uint32_t errorCount;
 
+	// Shadow copies of the configuration and output registers, so that we don't need to read them back before changing them
+	static constexpr unsigned int NumShadowedRegisters = 0x14;	// registers REG_INPUT_DISABLE_B to REG_INTERRUPT_MASK_A
+	uint8_t shadowRegisters[NumShadowedRegisters];
+	uint32_t dirtyRegisters;				// bitmap of shadowed registers that have been changed but not yet written
+	uint8_t iOnShadow[16];					// the last intensity written to each pin
+	uint16_t iOnValid;						// bitmap of pins whose entry in iOnShadow is valid
+
 	// Read Functions:
 	uint8_t readByte(uint8_t registerAddress);
 	uint16_t readWord(uint8_t registerAddress);
@@ -48,6 +55,11 @@ private:
 	void writeByte(uint8_t registerAddress, uint8_t writeValue);
 	void writeWord(uint8_t registerAddress, uint16_t writeValue);
 	void writeDword(uint8_t registerAddress, uint32_t writeValue);
+	void writeBytes(uint8_t registerAddress, const uint8_t *values, size_t numValues);
+	bool readBytes(uint8_t registerAddress, uint8_t *values, size_t numValues);
+
+	void setShadowWord(uint8_t registerAddress, uint16_t value);
+	void flushRegisters();
 
 	void setBitsInWord(uint8_t registerAddress, uint16_t bits);
 	void clearBitsInWord(uint8_t registerAddress, uint16_t bits);
@@ -16,12 +16,13 @@
 namespace DotStarLed
 {
 	const unsigned int MaxChunkSize = 30;					// maximum number of LEDs we DMA to in one go (most strips have 30 LEDs/metre)
+	const unsigned int NumChunkBuffers = 2;					// we fill one buffer while the PDC is sending the other
 
 	static unsigned int numRemaining = 0;					// how much of the current request remains after the current transfer
 	static unsigned int totalSent = 0;						// total amount of data sent since the start frame
 	static bool needStartFrame = true;						// true if we need to send a start frame with the next command
-	static bool busy = false;
-	static uint32_t chunkBuffer[MaxChunkSize];
+	static unsigned int nextBuffer = 0;						// which buffer we fill next
+	static uint32_t chunkBuffers[NumChunkBuffers][MaxChunkSize];
 
 	void Init()
 	{
@@ -48,18 +49,17 @@ namespace DotStarLed
 		// Initialise variables
 		numRemaining = totalSent = 0;
 		needStartFrame = true;
-		busy = false;
+		nextBuffer = 0;
 	}
 
 	GCodeResult SetColours(GCodeBuffer& gb, const StringRef& reply)
 	{
-		if (busy)											// if we sent something
+		// The PDC has a current and a next transfer. If the next one is still queued then both buffers are in use.
+		// Otherwise the buffer we are about to fill is free, because the one in use (if any) is the one we queued last.
+		Pdc * const usartPdc = usart_get_pdc_base(DotStarUsart);
+		if (usartPdc->PERIPH_TNCR != 0)
 		{
-			if ((DotStarUsart->US_CSR & US_CSR_ENDTX) == 0)	// if we are still sending
-			{
-				return GCodeResult::notFinished;
-			}
-			busy = false;									// we finished the last transfer
+			return GCodeResult::notFinished;
 		}
 
 		bool seen = false;
@@ -88,6 +88,7 @@ namespace DotStarLed
 		// white LED at the end if we don't provide data for all the LEDs. So instead we send 32 or more bits of zeros.
 		// See https://cpldcpu.wordpress.com/2014/11/30/understanding-the-apa102-superled/ for more.
 		unsigned int spaceLeft = MaxChunkSize;
+		uint32_t * const chunkBuffer = chunkBuffers[nextBuffer];
 		uint32_t *p = chunkBuffer;
 		if (needStartFrame)
 		{
@@ -124,17 +125,27 @@ namespace DotStarLed
 			*p++ = 0;															// append some stop bits
 		}
 
-		// DMA the data
-		DotStarUsart->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_TXDIS;			// reset transmitter and receiver, disable transmitter
-		Pdc * const usartPdc = usart_get_pdc_base(DotStarUsart);
-		usartPdc->PERIPH_PTCR = PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS;		// disable the PDC
-		usartPdc->PERIPH_TPR = reinterpret_cast<uint32_t>(&chunkBuffer);
-		usartPdc->PERIPH_TCR = 4 * (p - chunkBuffer);							// number of bytes to transfer
-		usartPdc->PERIPH_PTCR = PERIPH_PTCR_TXTEN;								// enable the PDC to send data
-
-		DotStarUsart->US_CR = US_CR_TXEN;										// enable transmitter
+		// DMA the data. If a transfer is already in progress then queue this one as the next transfer, so that the data is sent without a break.
+		const irqflags_t flags = cpu_irq_save();
+		if (usartPdc->PERIPH_TCR != 0)
+		{
+			usartPdc->PERIPH_TNPR = reinterpret_cast<uint32_t>(chunkBuffer);
+			usartPdc->PERIPH_TNCR = 4 * (p - chunkBuffer);						// number of bytes to transfer
+			cpu_irq_restore(flags);
+		}
+		else
+		{
+			cpu_irq_restore(flags);
+			DotStarUsart->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_TXDIS;		// reset transmitter and receiver, disable transmitter
+			usartPdc->PERIPH_PTCR = PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS;	// disable the PDC
+			usartPdc->PERIPH_TPR = reinterpret_cast<uint32_t>(chunkBuffer);
+			usartPdc->PERIPH_TCR = 4 * (p - chunkBuffer);						// number of bytes to transfer
+			usartPdc->PERIPH_PTCR = PERIPH_PTCR_TXTEN;							// enable the PDC to send data
+
+			DotStarUsart->US_CR = US_CR_TXEN;									// enable transmitter
+		}
 
-		busy = true;
+		nextBuffer = (nextBuffer + 1) % NumChunkBuffers;
 		return (numRemaining == 0) ? GCodeResult::ok : GCodeResult::notFinished;
 	}
 };
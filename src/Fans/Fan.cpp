@@ -24,6 +24,9 @@ void Fan::Init(Pin p_pin, LogicalPin lp, bool hwInverted, PwmFrequency p_freq)
 	hardwareInverted = hwInverted;
 	inverted = blipping = false;
 	heatersMonitored = 0;
+	tachoNumber = -1;
+	maxRpm = 0;
+	rpmCorrection = 0.0;
 	triggerTemperatures[0] = triggerTemperatures[1] = HOT_END_FAN_TEMPERATURE;
 	lastPwm = -1.0;				// force a refresh
 	Refresh();
@@ -159,6 +162,27 @@ bool Fan::Configure(unsigned int mcode, int fanNum, GCodeBuffer& gb, const Strin
 			seen = true;
 		}
 
+		if (gb.Seen('K'))		// Set the tacho that measures this fan
+		{
+			seen = true;
+			const int tacho = gb.GetIValue();
+			if (tacho >= (int)NumTachos)
+			{
+				reply.printf("Invalid tacho number %d", tacho);
+				error = true;
+				return true;
+			}
+			tachoNumber = max<int>(tacho, -1);
+			rpmCorrection = 0.0;
+		}
+
+		if (gb.Seen('U'))		// Set the RPM at full speed, enabling closed-loop speed control if nonzero
+		{
+			seen = true;
+			maxRpm = gb.GetUIValue();
+			rpmCorrection = 0.0;
+		}
+
 		// We only act on the 'S' parameter here if we have processed other parameters
 		if (seen && gb.Seen('S'))		// Set new fan value - process this after processing 'H' or it may not be acted on
 		{
@@ -188,6 +212,14 @@ bool Fan::Configure(unsigned int mcode, int fanNum, GCodeBuffer& gb, const Strin
 						(int)(maxVal * 100.0),
 						(double)(blipTime * MillisToSeconds),
 						(inverted) ? "yes" : "no");
+			if (tachoNumber >= 0)
+			{
+				reply.catf(", tacho: %d, RPM: %" PRIu32, tachoNumber, reprap.GetPlatform().GetFanRPM(tachoNumber));
+				if (maxRpm != 0)
+				{
+					reply.catf(", closed loop, max RPM: %" PRIu32, maxRpm);
+				}
+			}
 			if (heatersMonitored != 0)
 			{
 				reply.catf(", temperature: %.1f:%.1fC, heaters:", (double)triggerTemperatures[0], (double)triggerTemperatures[1]);
@@ -340,13 +372,41 @@ void Fan::Refresh()
 		}
 	}
 
-	SetHardwarePwm(reqVal);
+	// In closed-loop mode the requested value is a proportion of the maximum RPM, so correct the PWM for the difference between the fan and its nominal characteristic.
+	// We don't correct the PWM while blipping, because the fan is meant to run flat out then.
+	if (IsClosedLoop() && reqVal > 0.0 && !blipping)
+	{
+		SetHardwarePwm(constrain<float>(reqVal + rpmCorrection, minVal, maxVal));
+	}
+	else
+	{
+		SetHardwarePwm(reqVal);
+	}
 	lastVal = reqVal;
 }
 
+// Update the correction to the PWM in closed-loop mode from the measured speed. Called every FanCheckInterval.
+void Fan::UpdateRpmCorrection()
+{
+	if (lastVal == 0.0 || blipping)
+	{
+		rpmCorrection = 0.0;
+	}
+	else
+	{
+		const float error = lastVal - (float)reprap.GetPlatform().GetFanRPM(tachoNumber)/(float)maxRpm;
+		rpmCorrection = constrain<float>(rpmCorrection + FanRpmControlGain * error, -1.0, 1.0);
+	}
+}
+
 bool Fan::Check()
 {
-	if (heatersMonitored != 0 || blipping)
+	if (IsClosedLoop())
+	{
+		UpdateRpmCorrection();
+		Refresh();
+	}
+	else if (heatersMonitored != 0 || blipping)
 	{
 		Refresh();
 	}
@@ -365,18 +425,4 @@ void Fan::Disable()
 	logicalPin = NoLogicalPin;
 }
 
-// Save the settings of this fan if it isn't thermostatic
-bool Fan::WriteSettings(FileStore *f, size_t fanNum) const
-{
-	if (heatersMonitored == 0)
-	{
-		char bufSpace[50];
-		StringRef buf(bufSpace, ARRAY_SIZE(bufSpace));
-		buf.printf("M106 P%u S%.2f\n", fanNum, (double)val);
-		return f->Write(buf.c_str());
-	}
-
-	return true;
-}
-
 // End
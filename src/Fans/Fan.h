@@ -38,7 +38,6 @@ public:
 
 	bool Check();											// update the fan PWM returning true if it is a thermostatic fan that is on
 	void Disable();
-	bool WriteSettings(FileStore *f, size_t fanNum) const;	// save the settings of this fan if it isn't thermostatic
 
 private:
 
@@ -55,6 +54,9 @@ private:
 	LogicalPin logicalPin;
 	Pin pin;
 	String<MaxFanNameLength> name;
+	int tachoNumber;						// the tacho that measures the speed of this fan, or -1 if none
+	uint32_t maxRpm;						// if nonzero and we have a tacho, we control the fan speed in closed loop and this is the RPM at full speed
+	float rpmCorrection;					// the amount we add to the PWM to get the requested RPM in closed-loop mode
 	bool isConfigured;
 	bool inverted;
 	bool hardwareInverted;
@@ -62,6 +64,8 @@ private:
 
 	void Refresh();
 	void SetHardwarePwm(float pwmVal);
+	bool IsClosedLoop() const { return tachoNumber >= 0 && maxRpm != 0; }
+	void UpdateRpmCorrection();
 };
 
 #endif /* SRC_FAN_H_ */
@@ -13,7 +13,7 @@ void FanInterrupt(CallbackParameter cb)
 	static_cast<Tacho *>(cb.vp)->Interrupt();
 }
 
-Tacho::Tacho() : fanInterruptCount(0), fanLastResetTime(0), fanInterval(0), pin(NoPin)
+Tacho::Tacho() : fanInterruptCount(0), fanMeasurementStartTime(0), fanLastResetTime(0), fanInterval(0), armed(false), pin(NoPin)
 {
 }
 
@@ -23,7 +23,28 @@ void Tacho::Init(Pin p_pin)
 	if (pin != NoPin)
 	{
 		pinModeDuet(pin, INPUT_PULLUP, 1500);		// enable pullup and 1500Hz debounce filter (500Hz only worked up to 7000RPM)
-		attachInterrupt(pin, FanInterrupt, INTERRUPT_MODE_FALLING, this);
+		Arm();
+	}
+}
+
+// Start a measurement. We only take interrupts until we have timed fanMaxInterruptCount tacho pulses, then the ISR detaches itself.
+// This limits the interrupt rate to a few tens per second per fan however fast the fan is running, so that tacho pulses don't delay step generation.
+void Tacho::Arm()
+{
+	fanInterruptCount = 0;
+	armed = true;
+	if (!attachInterrupt(pin, FanInterrupt, INTERRUPT_MODE_FALLING, this))
+	{
+		armed = false;
+	}
+}
+
+// Start a new measurement if the last one has finished. Called from Platform::Spin every FanCheckInterval.
+void Tacho::Spin()
+{
+	if (pin != NoPin && !armed)
+	{
+		Arm();
 	}
 }
 
@@ -38,16 +59,23 @@ uint32_t Tacho::GetRPM() const
 			: 0;																// else assume fan is off or tacho not connected
 }
 
+// Tacho pin interrupt. We time fanMaxInterruptCount periods starting from the first interrupt after we were armed.
 void Tacho::Interrupt()
 {
-	++fanInterruptCount;
-	if (fanInterruptCount == fanMaxInterruptCount)
+	const uint32_t now = Platform::GetInterruptClocks();
+	if (fanInterruptCount == 0)
 	{
-		const uint32_t now = Platform::GetInterruptClocks();
-		fanInterval = now - fanLastResetTime;
+		fanMeasurementStartTime = now;
+	}
+	else if (fanInterruptCount == fanMaxInterruptCount)
+	{
+		fanInterval = now - fanMeasurementStartTime;
 		fanLastResetTime = now;
-		fanInterruptCount = 0;
+		detachInterrupt(pin);
+		armed = false;
+		return;
 	}
+	++fanInterruptCount;
 }
 
 // End
@@ -15,6 +15,7 @@ class Tacho
 public:
 	Tacho();
 	void Init(Pin p_pin);
+	void Spin();									// start a new measurement if the last one has finished
 	uint32_t GetRPM() const;
 
 	void Interrupt();
@@ -22,9 +23,13 @@ public:
 private:
 	static constexpr uint32_t fanMaxInterruptCount = 32;	// number of fan interrupts that we average over
 
+	void Arm();
+
 	uint32_t fanInterruptCount;						// accessed only in ISR, so no need to declare it volatile
-	volatile uint32_t fanLastResetTime;				// time (microseconds) at which we last reset the interrupt count, accessed inside and outside ISR
+	uint32_t fanMeasurementStartTime;				// time (step clocks) of the first interrupt in the current measurement, accessed only in the ISR
+	volatile uint32_t fanLastResetTime;				// time (step clocks) at which we last completed a measurement, accessed inside and outside ISR
 	volatile uint32_t fanInterval;					// written by ISR, read outside the ISR
+	volatile bool armed;							// true if the interrupt is attached and we are measuring
 
 	Pin pin;
 };
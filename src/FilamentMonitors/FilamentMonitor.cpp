@@ -15,14 +15,65 @@
 #include "GCodes/GCodeBuffer.h"
 #include "Movement/Move.h"
 #include "PrintMonitor.h"
+#include "Movement/StageTimer.h"
 
 // Static data
 Mutex FilamentMonitor::filamentSensorsMutex;
 FilamentMonitor *FilamentMonitor::filamentSensors[MaxExtruders] = { 0 };
+float FilamentMonitor::extrusionCompensation[MaxExtruders];
+
+FilamentMonitor::FilamentMonitor(unsigned int extruder, int t)
+	: compensationLimit(0.0), filteredMovementRatio(1.0), compensationExtrusion(0.0), numInterrupts(0), maxInterruptCycles(0), extruderNumber(extruder), type(t), pin(NoPin)
+{
+}
 
 // Default destructor
 FilamentMonitor::~FilamentMonitor()
 {
+	extrusionCompensation[extruderNumber] = 1.0;		// we can't measure the extrusion any more, so stop correcting it
+}
+
+// Feed a comparison between commanded and measured extrusion into the extrusion compensation.
+// The commanded extrusion already includes any correction that we applied, so the ratio of measured to commanded extrusion tells us directly how much the filament slips,
+// and the correction we need is its reciprocal. We average the ratio over the last few tens of mm of extrusion so that we follow gradual changes without reacting to noise,
+// and we don't apply any correction until we have measured that much extrusion.
+void FilamentMonitor::UpdateExtrusionCompensation(float extrusionCommanded, float extrusionMeasured)
+{
+	if (compensationLimit <= 0.0 || extrusionCommanded <= 0.0 || extrusionMeasured <= 0.0)
+	{
+		return;											// compensation disabled, or a retraction, or the sensor didn't see the filament move
+	}
+
+	const float ratio = extrusionMeasured/extrusionCommanded;
+	const float weight = min<float>(extrusionCommanded/CompensationFilterLength, 1.0);
+	if (compensationExtrusion == 0.0)
+	{
+		filteredMovementRatio = ratio;
+	}
+	else
+	{
+		filteredMovementRatio += (ratio - filteredMovementRatio) * weight;
+	}
+
+	compensationExtrusion += extrusionCommanded;
+	if (compensationExtrusion >= CompensationFilterLength)
+	{
+		compensationExtrusion = CompensationFilterLength;	// stop it growing without limit
+		extrusionCompensation[extruderNumber] = constrain<float>(1.0/filteredMovementRatio, 1.0 - compensationLimit, 1.0 + compensationLimit);
+	}
+}
+
+void FilamentMonitor::AppendCompensationStatus(const StringRef& reply) const
+{
+	if (compensationLimit <= 0.0)
+	{
+		reply.cat(", extrusion compensation disabled");
+	}
+	else
+	{
+		reply.catf(", extrusion compensation up to %ld%%, current correction %.1f%%",
+					lrintf(compensationLimit * 100.0), (double)((extrusionCompensation[extruderNumber] - 1.0) * 100.0));
+	}
 }
 
 // Call this to disable the interrupt before deleting or re-configuring a filament monitor
@@ -52,7 +103,7 @@ bool FilamentMonitor::ConfigurePin(GCodeBuffer& gb, const StringRef& reply, Inte
 		}
 		endstopNumber = endstop;
 		pin = p;
-		haveIsrStepsCommanded = false;
+		isrRecords.Clear();
 		if (interruptMode != INTERRUPT_MODE_NONE && !attachInterrupt(pin, InterruptEntry, interruptMode, this))
 		{
 			reply.copy("unsuitable endstop number");
@@ -72,6 +123,10 @@ bool FilamentMonitor::ConfigurePin(GCodeBuffer& gb, const StringRef& reply, Inte
 /*static*/ void FilamentMonitor::InitStatic()
 {
 	filamentSensorsMutex.Create("FilamentSensors");
+	for (float& f : extrusionCompensation)
+	{
+		f = 1.0;
+	}
 }
 
 // Handle M591
@@ -104,6 +159,15 @@ bool FilamentMonitor::ConfigurePin(GCodeBuffer& gb, const StringRef& reply, Inte
 
 	if (sensor != nullptr)
 	{
+		// Configure extrusion compensation, which works the same way for all sensors that measure filament movement
+		if (gb.Seen('A'))
+		{
+			seen = true;
+			sensor->compensationLimit = constrain<float>(gb.GetFValue() * 0.01, 0.0, MaxCompensationLimit);
+			sensor->compensationExtrusion = 0.0;
+			extrusionCompensation[extruder] = 1.0;
+		}
+
 		// Configure the sensor
 		const bool error = sensor->Configure(gb, reply, seen);
 		if (error)
@@ -112,6 +176,10 @@ bool FilamentMonitor::ConfigurePin(GCodeBuffer& gb, const StringRef& reply, Inte
 			delete sensor;
 			sensor = nullptr;
 		}
+		else if (!seen)
+		{
+			sensor->AppendCompensationStatus(reply);
+		}
 		return GetGCodeResultFromError(error);
 	}
 	else if (!seen)
@@ -165,11 +233,22 @@ bool FilamentMonitor::ConfigurePin(GCodeBuffer& gb, const StringRef& reply, Inte
 // ISR
 /*static*/ void FilamentMonitor::InterruptEntry(CallbackParameter param)
 {
+	const uint32_t startCycles = StageTimer::GetCycles();
 	FilamentMonitor * const fm = static_cast<FilamentMonitor*>(param.vp);
-	if (fm->Interrupt())
+	// If the queue is full then the extrusion stays accumulated in Move and is included in the next record we queue
+	if (fm->Interrupt() && !fm->isrRecords.IsFull())
 	{
-		fm->isrExtruderStepsCommanded = reprap.GetMove().GetAccumulatedExtrusion(fm->extruderNumber, fm->isrWasNonPrinting);
-		fm->haveIsrStepsCommanded = true;
+		IsrRecord rec;
+		rec.extruderStepsCommanded = reprap.GetMove().GetAccumulatedExtrusion(fm->extruderNumber, rec.wasNonPrinting);
+		(void)fm->isrRecords.Put(rec);
+	}
+
+	// Keep track of the interrupt load, because these interrupts have a higher priority than the step interrupt
+	++fm->numInterrupts;
+	const uint32_t cycles = StageTimer::GetCycles() - startCycles;
+	if (cycles > fm->maxInterruptCycles)
+	{
+		fm->maxInterruptCycles = cycles;
 	}
 }
 
@@ -184,23 +263,20 @@ bool FilamentMonitor::ConfigurePin(GCodeBuffer& gb, const StringRef& reply, Inte
 		{
 			FilamentMonitor& fs = *filamentSensors[extruder];
 			GCodes& gCodes = reprap.GetGCodes();
-			bool wasNonPrinting;
-			bool fromIsr;
-			int32_t extruderStepsCommanded;
-			cpu_irq_disable();
-			if (fs.haveIsrStepsCommanded)
+			bool wasNonPrinting = false;
+			bool fromIsr = false;
+			int32_t extruderStepsCommanded = 0;
+			IsrRecord rec;
+			while (fs.isrRecords.Get(rec))
 			{
-				extruderStepsCommanded = fs.isrExtruderStepsCommanded;
-				wasNonPrinting = fs.isrWasNonPrinting;
-				fs.haveIsrStepsCommanded = false;
-				cpu_irq_enable();
+				// Combine all the records, because the sensor measurement that the ISR captured covers the extrusion in all of them
+				extruderStepsCommanded += rec.extruderStepsCommanded;
+				wasNonPrinting = wasNonPrinting || rec.wasNonPrinting;
 				fromIsr = true;
 			}
-			else
+			if (!fromIsr)
 			{
-				cpu_irq_enable();
 				extruderStepsCommanded = reprap.GetMove().GetAccumulatedExtrusion(extruder, wasNonPrinting);		// get and clear the net extrusion commanded
-				fromIsr = false;
 			}
 			if (gCodes.IsReallyPrinting() && !gCodes.IsSimulating())
 			{
@@ -239,7 +315,14 @@ bool FilamentMonitor::ConfigurePin(GCodeBuffer& gb, const StringRef& reply, Inte
 				reprap.GetPlatform().Message(mtype, "=== Filament sensors ===\n");
 				first = false;
 			}
-			filamentSensors[i]->Diagnostics(mtype, i);
+			FilamentMonitor& fs = *filamentSensors[i];
+			fs.Diagnostics(mtype, i);
+			if (fs.pin != NoPin)
+			{
+				reprap.GetPlatform().MessageF(mtype, "Extruder %u sensor interrupts: %" PRIu32 ", longest %.1fus\n",
+												i, fs.numInterrupts, (double)((float)fs.maxInterruptCycles * (1000000.0/VARIANT_MCK)));
+				fs.numInterrupts = fs.maxInterruptCycles = 0;
+			}
 		}
 	}
 }
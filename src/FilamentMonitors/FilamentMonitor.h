@@ -12,6 +12,7 @@
 #include "MessageType.h"
 #include "GCodes/GCodeResult.h"
 #include "RTOSIface.h"
+#include "Libraries/General/FreelistManager.h"
 
 enum class FilamentSensorStatus : uint8_t
 {
@@ -44,6 +45,10 @@ public:
 	// Call this to disable the interrupt before deleting a filament monitor
 	virtual void Disable();
 
+	// Allocate filament monitors from the size-class pools, so that we reuse the memory when they are reconfigured
+	void* operator new(size_t sz) { return PoolAllocate(sz); }
+	void operator delete(void* p, size_t sz) { PoolRelease(p, sz); }
+
 	// Override the virtual destructor if your derived class allocates any dynamic memory
 	virtual ~FilamentMonitor();
 
@@ -66,11 +71,17 @@ public:
 	// Send diagnostics info
 	static void Diagnostics(MessageType mtype);
 
+	// Return the factor by which we are correcting the extrusion of an extruder to make the measured filament movement match the commanded movement
+	static float GetExtrusionCompensation(size_t extruder) pre(extruder < MaxExtruders) { return extrusionCompensation[extruder]; }
+
 protected:
-	FilamentMonitor(unsigned int extruder, int t) : extruderNumber(extruder), type(t), pin(NoPin) { }
+	FilamentMonitor(unsigned int extruder, int t);
 
 	bool ConfigurePin(GCodeBuffer& gb, const StringRef& reply, InterruptMode interruptMode, bool& seen);
 
+	// Feed a comparison between commanded and measured extrusion into the extrusion compensation. Call this only for comparisons that passed the error checks.
+	void UpdateExtrusionCompensation(float extrusionCommanded, float extrusionMeasured);
+
 	int GetEndstopNumber() const { return endstopNumber; }
 
 	Pin GetPin() const { return pin; }
@@ -81,16 +92,35 @@ private:
 
 	static void InterruptEntry(CallbackParameter param);
 
+	void AppendCompensationStatus(const StringRef& reply) const;
+
+	static constexpr float CompensationFilterLength = 50.0;		// the amount of extrusion (mm) over which we average the measured/commanded ratio
+	static constexpr float MaxCompensationLimit = 0.25;			// the largest correction that we allow the user to configure
+
+	// The extrusion commanded up to the time of a sensor interrupt, passed from the ISR to Spin
+	struct IsrRecord
+	{
+		int32_t extruderStepsCommanded;
+		bool wasNonPrinting;
+	};
+
+	static constexpr size_t IsrQueueLength = 4;				// must be a power of 2
+
 	static Mutex filamentSensorsMutex;
 	static FilamentMonitor *filamentSensors[MaxExtruders];
+	static float extrusionCompensation[MaxExtruders];
+
+	float compensationLimit;								// the largest fractional correction we may apply, or zero if compensation is disabled
+	float filteredMovementRatio;							// the measured/commanded extrusion ratio, averaged over the last CompensationFilterLength of extrusion
+	float compensationExtrusion;							// how much extrusion we have compared since compensation was configured, up to CompensationFilterLength
 
-	int32_t isrExtruderStepsCommanded;
+	SpscQueue<IsrRecord, IsrQueueLength> isrRecords;
+	uint32_t numInterrupts;									// how many pin change interrupts we had since the diagnostics were last reported
+	uint32_t maxInterruptCycles;							// the longest time we spent in the ISR, in CPU cycles
 	unsigned int extruderNumber;
 	int type;
 	int endstopNumber;
 	Pin pin;
-	bool isrWasNonPrinting;
-	bool haveIsrStepsCommanded;
 };
 
 #endif /* SRC_FILAMENTSENSORS_FILAMENTMONITOR_H_ */
@@ -323,6 +323,10 @@ FilamentSensorStatus LaserFilamentMonitor::CheckFilament(float amountCommanded,
 					ret = FilamentSensorStatus::tooMuchMovement;
 				}
 			}
+			if (ret == FilamentSensorStatus::ok)
+			{
+				UpdateExtrusionCompensation(amountCommanded, amountMeasured);
+			}
 		}
 		break;
 	}
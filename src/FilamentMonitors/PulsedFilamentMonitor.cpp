@@ -21,7 +21,7 @@ PulsedFilamentMonitor::PulsedFilamentMonitor(unsigned int extruder, int type)
 
 void PulsedFilamentMonitor::Init()
 {
-	sensorValue = 0;
+	sensorValue = lastSensorValue = 0;
 	calibrationStarted = false;
 	samplesReceived = 0;
 	lastMeasurementTime = 0;
@@ -124,11 +124,9 @@ bool PulsedFilamentMonitor::Interrupt()
 // Call the following regularly to keep the status up to date
 void PulsedFilamentMonitor::Poll()
 {
-	cpu_irq_disable();
-	const uint32_t locSensorVal = sensorValue;
-	sensorValue = 0;
-	cpu_irq_enable();
-	movementMeasuredSinceLastSync += (float)locSensorVal;
+	const uint32_t locSensorVal = sensorValue;			// the ISR only ever increments this, so we can read it without disabling interrupts
+	movementMeasuredSinceLastSync += (float)(locSensorVal - lastSensorValue);
+	lastSensorValue = locSensorVal;
 
 	if (haveInterruptData)					// if we have a synchronised value for the amount of extrusion commanded
 	{
@@ -145,7 +143,7 @@ void PulsedFilamentMonitor::Poll()
 // Return the current wheel angle
 float PulsedFilamentMonitor::GetCurrentPosition() const
 {
-	return (float)sensorValue;
+	return (float)(sensorValue - lastSensorValue);
 }
 
 // Call the following at intervals to check the status. This is only called when extrusion is in progress or imminent.
@@ -40,7 +40,8 @@ private:
 	bool comparisonEnabled;
 
 	// Other data
-	uint32_t sensorValue;									// how many pulses received
+	volatile uint32_t sensorValue;							// how many pulses received, free-running
+	uint32_t lastSensorValue;								// the value of sensorValue when we last polled it
 	uint32_t lastMeasurementTime;							// the last time we received a value
 
 	float extrusionCommandedAtInterrupt;					// the amount of extrusion commanded (mm) when we received the interrupt since the last sync
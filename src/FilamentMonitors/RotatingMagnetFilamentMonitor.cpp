@@ -241,25 +241,33 @@ FilamentSensorStatus RotatingMagnetFilamentMonitor::CheckFilament(float amountCo
 		comparisonStarted = true;
 		calibrationStarted = false;
 	}
-	else if (comparisonEnabled)
+	else
 	{
-		const float minExtrusionExpected = (amountCommanded >= 0.0)
-											 ? amountCommanded * minMovementAllowed
-												: amountCommanded * maxMovementAllowed;
-		if (extrusionMeasured < minExtrusionExpected)
-		{
-			ret = FilamentSensorStatus::tooLittleMovement;
-		}
-		else
+		if (comparisonEnabled)
 		{
-			const float maxExtrusionExpected = (amountCommanded >= 0.0)
-												 ? amountCommanded * maxMovementAllowed
-													: amountCommanded * minMovementAllowed;
-			if (extrusionMeasured > maxExtrusionExpected)
+			const float minExtrusionExpected = (amountCommanded >= 0.0)
+												 ? amountCommanded * minMovementAllowed
+													: amountCommanded * maxMovementAllowed;
+			if (extrusionMeasured < minExtrusionExpected)
+			{
+				ret = FilamentSensorStatus::tooLittleMovement;
+			}
+			else
 			{
-				ret = FilamentSensorStatus::tooMuchMovement;
+				const float maxExtrusionExpected = (amountCommanded >= 0.0)
+													 ? amountCommanded * maxMovementAllowed
+														: amountCommanded * minMovementAllowed;
+				if (extrusionMeasured > maxExtrusionExpected)
+				{
+					ret = FilamentSensorStatus::tooMuchMovement;
+				}
 			}
 		}
+
+		if (ret == FilamentSensorStatus::ok)
+		{
+			UpdateExtrusionCompensation(amountCommanded, extrusionMeasured);
+		}
 	}
 
 	// Update the calibration accumulators, even if the user hasn't asked to do calibration
@@ -0,0 +1,44 @@
+/*
+ * BinaryGCode.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Compact binary format for G-code files, so that the moves in dense toolpaths can be executed without parsing ASCII.
+ *
+ *  A binary file starts with the 4 bytes "RRB1". The rest of the file is a sequence of move records and ASCII lines:
+ *  - A move record starts with a byte that has the top bit set. The low 7 bits are the G command number, which must be 0, 1, 2 or 3.
+ *    The next byte is a bitmap of the parameters present: bit 0 X, bit 1 Y, bit 2 Z, bit 3 E, bit 4 F, bit 5 I, bit 6 J. Bit 7 must be zero.
+ *    The values of the parameters that are present follow in bit order, each as a 4-byte little-endian IEEE float.
+ *    The values have the same meanings and units as the corresponding parameters of an ASCII G-code command.
+ *  - Anything else is a line of 7-bit ASCII G-code ending in newline, which is processed in the same way as in an ordinary G-code file.
+ */
+
+#ifndef SRC_GCODES_BINARYGCODE_H_
+#define SRC_GCODES_BINARYGCODE_H_
+
+#include "RepRapFirmware.h"
+
+namespace BinaryGCode
+{
+	constexpr char FileSignature[] = "RRB1";
+	constexpr size_t SignatureLength = 4;
+
+	constexpr uint8_t RecordFlag = 0x80;						// the top bit of the first byte of a move record
+	constexpr uint8_t MaxCommandNumber = 3;						// G0 to G3
+	constexpr char ParameterLetters[] = "XYZEFIJ";				// the parameters corresponding to the bits of the parameter bitmap
+	constexpr size_t NumParameters = ARRAY_SIZE(ParameterLetters) - 1;
+	constexpr size_t RecordHeaderLength = 2;
+	constexpr size_t MaxRecordLength = RecordHeaderLength + NumParameters * sizeof(float);
+
+	inline bool IsValidRecordHeader(uint8_t command, uint8_t parameters)
+	{
+		return (command & ~RecordFlag) <= MaxCommandNumber && (parameters >> NumParameters) == 0;
+	}
+
+	inline size_t RecordLength(uint8_t parameters)
+	{
+		return RecordHeaderLength + __builtin_popcount(parameters) * sizeof(float);
+	}
+}
+
+#endif /* SRC_GCODES_BINARYGCODE_H_ */
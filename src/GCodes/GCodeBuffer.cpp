@@ -17,9 +17,10 @@ static constexpr char eofString[] = EOF_STRING;		// What's at the end of an HTML
 
 // Create a default GCodeBuffer
 GCodeBuffer::GCodeBuffer(const char* id, MessageType mt, bool usesCodeQueue)
-	: machineState(new GCodeMachineState()), identity(id), fileBeingWritten(nullptr), writingFileSize(0), eofStringCounter(0),
-	  toolNumberAdjust(0), responseMessageType(mt), checksumRequired(false), queueCodes(usesCodeQueue), binaryWriting(false)
+	: machineState(new GCodeMachineState()), freeStates(nullptr), stackDepth(0), maxStackDepthUsed(0), identity(id), fileBeingWritten(nullptr), writingFileSize(0),
+	  eofStringCounter(0), toolNumberAdjust(0), responseMessageType(mt), checksumRequired(false), queueCodes(usesCodeQueue), binaryWriting(false)
 {
+	GCodeMachineState::Preallocate(freeStates, PreallocatedStackDepth);
 	Init();
 }
 
@@ -34,6 +35,7 @@ void GCodeBuffer::Init()
 	gcodeLineEnd = 0;
 	commandLength = 0;
 	readPointer = -1;
+	parametersIndexed = isBinary = false;
 	hadLineNumber = hadChecksum = timerRunning = false;
 	computedChecksum = 0;
 	bufferState = GCodeBufferState::parseNotStarted;
@@ -68,7 +70,7 @@ void GCodeBuffer::Diagnostics(MessageType mtype)
 		ms = ms->previous;
 	}
 	while (ms != nullptr);
-	scratchString.cat('\n');
+	scratchString.catf(", max stack depth %u\n", maxStackDepthUsed);
 	reprap.GetPlatform().Message(mtype, scratchString.c_str());
 }
 
@@ -234,6 +236,95 @@ bool GCodeBuffer::Put(char c)
 	return false;
 }
 
+// Return a pointer to the first null, CR or LF character in the data, or nullptr if there isn't one.
+// Most of the data is checked a word at a time, using the usual test for a zero byte in a word.
+static inline const char *FindLineEnd(const char *data, size_t length)
+{
+	const char * const end = data + length;
+	const char *p = data;
+	while (p != end && (reinterpret_cast<uint32_t>(p) & 3) != 0)
+	{
+		const char c = *p;
+		if (c == '\n' || c == '\r' || c == 0)
+		{
+			return p;
+		}
+		++p;
+	}
+
+	while (end - p >= 4)
+	{
+		const uint32_t w = *reinterpret_cast<const uint32_t*>(p);
+		const uint32_t wLF = w ^ 0x0A0A0A0Au, wCR = w ^ 0x0D0D0D0Du;
+		if ((((w - 0x01010101u) & ~w) | ((wLF - 0x01010101u) & ~wLF) | ((wCR - 0x01010101u) & ~wCR)) & 0x80808080u)
+		{
+			break;						// one of the next 4 characters ends the line
+		}
+		p += 4;
+	}
+
+	while (p != end)
+	{
+		const char c = *p;
+		if (c == '\n' || c == '\r' || c == 0)
+		{
+			return p;
+		}
+		++p;
+	}
+	return nullptr;
+}
+
+// Add a block of characters to the code being assembled, stopping after the first end-of-line character.
+// On return, 'length' is the number of characters used. Return true if there is a complete command ready, the same as for Put(char).
+// If the line is complete within this block and has no checksum, runs of ordinary characters are copied without calculating the checksum.
+bool GCodeBuffer::PutBlock(const char *data, size_t& length)
+{
+	const char * const eol = FindLineEnd(data, length);
+	if (eol == nullptr || memchr(data, '*', eol - data) != nullptr)
+	{
+		// We can't tell yet whether the checksum is needed, so process the characters one at a time
+		const size_t lineLength = (eol == nullptr) ? length : eol - data + 1;
+		for (size_t i = 0; i < lineLength; ++i)
+		{
+			if (Put(data[i]))
+			{
+				length = i + 1;
+				return true;
+			}
+		}
+		length = lineLength;
+		return false;
+	}
+
+	const char *p = data;
+	while (p != eol)
+	{
+		if (bufferState == GCodeBufferState::parsingGCode)
+		{
+			const char * const runStart = p;
+			char c;
+			while (p != eol && (c = *p) != '(' && c != '"' && c != ';' && c != 0x7F)
+			{
+				++p;
+			}
+			const size_t runLength = p - runStart;
+			const size_t numToStore = min<size_t>(runLength, ARRAY_SIZE(gcodeBuffer) - gcodeLineEnd);
+			memcpy(gcodeBuffer + gcodeLineEnd, runStart, numToStore);
+			gcodeLineEnd += numToStore;
+			commandLength += runLength;
+			if (p == eol)
+			{
+				break;
+			}
+		}
+		(void)Put(*p++);				// this can't complete the command because it isn't an end-of-line character
+	}
+
+	length = eol - data + 1;
+	return Put(*eol);
+}
+
 // This is called when we are fed a null, CR or LF character.
 // Return true if there is a completed command ready to be executed.
 bool GCodeBuffer::LineFinished()
@@ -287,8 +378,27 @@ bool GCodeBuffer::LineFinished()
 // Decode this command command and find the start of the next one on the same line.
 // On entry, 'commandStart' has already been set to the address the start of where the command should be.
 // On return, the state must be set to 'ready' to indicate that a command is available and we should stop adding characters.
+// Record the position of a parameter letter in the index if it is the first occurrence of that letter in the command
+inline void GCodeBuffer::IndexParameter(unsigned int pos, char c)
+{
+	const unsigned int letter = (unsigned int)toupper(c) - 'A';
+	if (letter < ARRAY_SIZE(parameterIndex) && parameterIndex[letter] == 0)
+	{
+		parameterIndex[letter] = (uint8_t)(pos + 1);
+		parametersPresent |= 1u << letter;
+	}
+}
+
+// Decode the command starting at commandStart. We build an index of the parameter letters in the same pass that finds the end of the command,
+// so that Seen doesn't need to scan the command each time it is called.
 void GCodeBuffer::DecodeCommand()
 {
+	static_assert(GCODE_LENGTH < 256, "parameterIndex entries are too small for GCODE_LENGTH");
+	memset(parameterIndex, 0, sizeof(parameterIndex));
+	parametersPresent = 0;
+	parametersIndexed = true;
+	isBinary = false;
+
 	// Check for a valid command letter at the start
 	commandLetter = toupper(gcodeBuffer[commandStart]);
 	hasCommandNumber = false;
@@ -348,6 +458,7 @@ void GCodeBuffer::DecodeCommand()
 				{
 					break;
 				}
+				IndexParameter(commandEnd, c);
 				primed = (c == ' ' || c == '\t');
 			}
 		}
@@ -356,6 +467,19 @@ void GCodeBuffer::DecodeCommand()
 	{
 		parameterStart = commandStart;
 		commandEnd = gcodeLineEnd;
+		bool inQuotes = false;
+		for (unsigned int i = parameterStart; i < commandEnd; ++i)
+		{
+			const char c = gcodeBuffer[i];
+			if (c == '"')
+			{
+				inQuotes = !inQuotes;
+			}
+			else if (!inQuotes)
+			{
+				IndexParameter(i, c);
+			}
+		}
 	}
 	bufferState = GCodeBufferState::ready;
 }
@@ -381,6 +505,35 @@ void GCodeBuffer::Put(const char *str)
 	Put(str, strlen(str));
 }
 
+// Set up a G0, G1, G2 or G3 command from a binary move record, which the caller has already checked is valid and complete.
+// The parameter values are kept in binary form and returned by GetFValue etc., so there is no ASCII to parse.
+void GCodeBuffer::PutBinaryMove(const uint8_t *record, size_t length)
+{
+	Init();
+	commandLetter = 'G';
+	commandNumber = record[0] & ~BinaryGCode::RecordFlag;
+	hasCommandNumber = true;
+	commandFraction = -1;
+	commandStart = parameterStart = commandEnd = gcodeLineEnd = 0;
+	commandLength = length;
+	SafeSnprintf(gcodeBuffer, ARRAY_SIZE(gcodeBuffer), "G%d", commandNumber);	// for error messages that quote the command
+
+	binaryParameters = record[1];
+	parametersPresent = 0;
+	const uint8_t *p = record + BinaryGCode::RecordHeaderLength;
+	for (size_t i = 0; i < BinaryGCode::NumParameters; ++i)
+	{
+		if (binaryParameters & (1u << i))
+		{
+			parametersPresent |= ParameterBit(BinaryGCode::ParameterLetters[i]);
+			memcpy(&binaryValues[i], p, sizeof(float));		// the record is little-endian, the same as the processor
+			p += sizeof(float);
+		}
+	}
+	parametersIndexed = isBinary = true;
+	bufferState = GCodeBufferState::ready;
+}
+
 void GCodeBuffer::SetFinished(bool f)
 {
 	if (f)
@@ -417,6 +570,22 @@ FilePosition GCodeBuffer::GetFilePosition(size_t bytesCached) const
 // Leave the pointer there for a subsequent read.
 bool GCodeBuffer::Seen(char c)
 {
+	if (isBinary)
+	{
+		// In a binary command, readPointer is the index of the parameter in binaryValues
+		const char * const p = (c == 0) ? nullptr : strchr(BinaryGCode::ParameterLetters, c);
+		readPointer = (p != nullptr && (binaryParameters & (1u << (p - BinaryGCode::ParameterLetters))) != 0)
+						? p - BinaryGCode::ParameterLetters : -1;
+		return readPointer >= 0;
+	}
+
+	const unsigned int letter = (unsigned int)c - 'A';
+	if (parametersIndexed && letter < ARRAY_SIZE(parameterIndex))
+	{
+		readPointer = (int)parameterIndex[letter] - 1;
+		return readPointer >= 0;
+	}
+
 	bool inQuotes = false;
 	for (readPointer = parameterStart; (unsigned int)readPointer < commandEnd; ++readPointer)
 	{
@@ -439,7 +608,7 @@ float GCodeBuffer::GetFValue()
 {
 	if (readPointer >= 0)
 	{
-		const float result = SafeStrtof(&gcodeBuffer[readPointer + 1], 0);
+		const float result = (isBinary) ? binaryValues[readPointer] : SafeStrtof(&gcodeBuffer[readPointer + 1], 0);
 		readPointer = -1;
 		return result;
 	}
@@ -465,6 +634,11 @@ const void GCodeBuffer::GetFloatArray(float arr[], size_t& returnedLength, bool
 				returnedLength = 0;
 				return;
 			}
+			if (isBinary)
+			{
+				arr[length++] = binaryValues[readPointer];		// a binary move record holds a single value for each parameter
+				break;
+			}
 			const char *q;
 			arr[length] = SafeStrtof(p, &q);
 			length++;
@@ -665,6 +839,7 @@ bool GCodeBuffer::InternalGetPossiblyQuotedString(const StringRef& str)
 	}
 
 	commandEnd = gcodeLineEnd;				// the string is the remainder of the line of gcode
+	parametersIndexed = false;				// so the parameter index no longer covers the whole command
 	for (;;)
 	{
 		const char c = gcodeBuffer[readPointer++];
@@ -699,7 +874,7 @@ int32_t GCodeBuffer::GetIValue()
 {
 	if (readPointer >= 0)
 	{
-		const int32_t result = SafeStrtol(&gcodeBuffer[readPointer + 1]);
+		const int32_t result = (isBinary) ? lrintf(binaryValues[readPointer]) : SafeStrtol(&gcodeBuffer[readPointer + 1]);
 		readPointer = -1;
 		return result;
 	}
@@ -713,7 +888,7 @@ uint32_t GCodeBuffer::GetUIValue()
 {
 	if (readPointer >= 0)
 	{
-		const uint32_t result = SafeStrtoul(&gcodeBuffer[readPointer + 1]);
+		const uint32_t result = (isBinary) ? (uint32_t)max<long>(lrintf(binaryValues[readPointer]), 0) : SafeStrtoul(&gcodeBuffer[readPointer + 1]);
 		readPointer = -1;
 		return result;
 	}
@@ -938,18 +1113,17 @@ GCodeMachineState& GCodeBuffer::OriginalMachineState() const
 // Push state returning true if successful (i.e. stack not overflowed)
 bool GCodeBuffer::PushState()
 {
-	// Check the current stack depth
-	unsigned int depth = 0;
-	for (const GCodeMachineState *m1 = machineState; m1 != nullptr; m1 = m1->previous)
-	{
-		++depth;
-	}
-	if (depth >= MaxStackDepth + 1)				// the +1 is to allow for the initial state record
+	if (stackDepth >= MaxStackDepth)
 	{
 		return false;
 	}
 
-	GCodeMachineState * const ms = GCodeMachineState::Allocate();
+	GCodeMachineState * const ms = GCodeMachineState::Allocate(freeStates);
+	++stackDepth;
+	if (stackDepth > maxStackDepthUsed)
+	{
+		maxStackDepthUsed = stackDepth;
+	}
 	ms->previous = machineState;
 	ms->feedRate = machineState->feedRate;
 	ms->fileState.CopyFrom(machineState->fileState);
@@ -981,7 +1155,8 @@ bool GCodeBuffer::PopState()
 	}
 
 	machineState = ms->previous;
-	GCodeMachineState::Release(ms);
+	GCodeMachineState::Release(ms, freeStates);
+	--stackDepth;
 	return true;
 }
 
@@ -1050,6 +1225,10 @@ bool GCodeBuffer::OpenFileToWrite(const char* directory, const char* fileName, c
 		return false;
 	}
 
+	if (size != 0)
+	{
+		(void)fileBeingWritten->Preallocate(size);
+	}
 	crc32 = fileCRC32;
 	binaryWriting = binaryWrite;
 	return true;
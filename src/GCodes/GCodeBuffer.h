@@ -11,6 +11,7 @@
 #include "RepRapFirmware.h"
 #include "GCodeMachineState.h"
 #include "MessageType.h"
+#include "BinaryGCode.h"
 
 // Class to hold an individual GCode and provide functions to allow it to be parsed
 class GCodeBuffer
@@ -21,8 +22,10 @@ public:
 	void Init(); 										// Set it up to parse another G-code
 	void Diagnostics(MessageType mtype);				// Write some debug info
 	bool Put(char c) __attribute__((hot));				// Add a character to the end
+	bool PutBlock(const char *data, size_t& length) __attribute__((hot));	// Add characters up to the end of a line, returning the number used in 'length'
 	void Put(const char *str, size_t len);				// Add an entire string, overwriting any existing content
 	void Put(const char *str);							// Add a null-terminated string, overwriting any existing content
+	void PutBinaryMove(const uint8_t *record, size_t length);	// Set up a G0-G3 command from a binary move record
 	void FileEnded();									// Called when we reach the end of the file we are reading from
 	bool Seen(char c) __attribute__((hot));				// Is a character present?
 
@@ -30,6 +33,10 @@ public:
 	bool HasCommandNumber() const { return hasCommandNumber; }
 	int GetCommandNumber() const { return commandNumber; }
 	int8_t GetCommandFraction() const { return commandFraction; }
+	bool IsPlainMove() const;
+	bool IsAtLineStart() const { return bufferState == GCodeBufferState::parseNotStarted && commandLength == 0; }	// True if no characters of a new line have been received							// Return true if this is a G0 or G1 command with no parameters other than X, Y, Z, E and F
+
+	static constexpr uint32_t ParameterBit(char c) { return 1u << (c - 'A'); }
 
 	float GetFValue() __attribute__((hot));				// Get a float after a key letter
 	int32_t GetIValue() __attribute__((hot));			// Get an integer after a key letter
@@ -115,12 +122,16 @@ private:
 	void StoreAndAddToChecksum(char c);
 	bool LineFinished();								// Deal with receiving end-of-line and return true if we have a command
 	void DecodeCommand();
+	void IndexParameter(unsigned int pos, char c);
 	bool InternalGetQuotedString(const StringRef& str)
 		pre (gcodeBuffer[readPointer] == '"'; str.IsEmpty());
 	bool InternalGetPossiblyQuotedString(const StringRef& str)
 		pre (readPointer >= 0);
 
 	GCodeMachineState *machineState;					// Machine state for this gcode source
+	GCodeMachineState *freeStates;						// State records that we have allocated and are not using, so that PushState doesn't share a free list with other sources
+	unsigned int stackDepth;							// How many state records we have pushed
+	unsigned int maxStackDepthUsed;						// The highest value of stackDepth, for diagnostics
 	const char* const identity;							// Where we are from (web, file, serial line etc)
 	unsigned int commandStart;							// Index in the buffer of the command letter of this command
 	unsigned int parameterStart;
@@ -148,6 +159,12 @@ private:
 	char commandLetter;
 
 	char gcodeBuffer[GCODE_LENGTH];						// The G Code
+	uint8_t parameterIndex[26];							// For each letter A-Z, one more than the index in the buffer of its first occurrence in the command, or zero if absent
+	bool parametersIndexed;								// True if parameterIndex is valid for the current command
+	uint32_t parametersPresent;							// Bitmap of the letters A-Z that are present in parameterIndex
+	bool isBinary;										// True if the current command came from a binary move record
+	uint8_t binaryParameters;							// Bitmap of the parameters present in the binary move record
+	float binaryValues[BinaryGCode::NumParameters];		// The parameter values from the binary move record
 	bool checksumRequired;								// True if we only accept commands with a valid checksum
 	int8_t commandFraction;
 
@@ -160,6 +177,13 @@ inline const char* GCodeBuffer::Buffer() const
 	return gcodeBuffer;
 }
 
+inline bool GCodeBuffer::IsPlainMove() const
+{
+	constexpr uint32_t PlainMoveParameters = ParameterBit('X') | ParameterBit('Y') | ParameterBit('Z') | ParameterBit('E') | ParameterBit('F');
+	return commandLetter == 'G' && (commandNumber == 0 || commandNumber == 1) && commandFraction < 0
+		&& parametersIndexed && (parametersPresent & ~PlainMoveParameters) == 0;
+}
+
 inline bool GCodeBuffer::IsIdle() const
 {
 	return bufferState != GCodeBufferState::ready && bufferState != GCodeBufferState::executing;
@@ -10,6 +10,7 @@
 #include "RepRap.h"
 #include "GCodes.h"
 #include "GCodeBuffer.h"
+#include "Tasks.h"
 
 bool GCodeInput::FillBuffer(GCodeBuffer *gb)
 {
@@ -60,8 +61,8 @@ size_t StreamGCodeInput::BytesCached() const
 
 // Dynamic G-code input class for caching codes from software-defined sources
 
-RegularGCodeInput::RegularGCodeInput()
-	: state(GCodeInputState::idle), writingPointer(0), readingPointer(0)
+RegularGCodeInput::RegularGCodeInput(char *buf, size_t size)
+	: state(GCodeInputState::idle), writingPointer(0), readingPointer(0), buffer(buf), bufferSize(size)
 {
 }
 
@@ -71,10 +72,41 @@ void RegularGCodeInput::Reset()
 	writingPointer = readingPointer = 0;
 }
 
+// Fill a GCodeBuffer with the next command. We pass the characters to the GCodeBuffer in blocks rather than one at a time,
+// except when it is writing a binary file.
+bool RegularGCodeInput::FillBuffer(GCodeBuffer *gb)
+{
+	if (gb->IsWritingBinary())
+	{
+		return GCodeInput::FillBuffer(gb);
+	}
+
+	size_t bytesToPass = min<size_t>(BytesCached(), GCODE_LENGTH);
+	while (bytesToPass != 0)
+	{
+		size_t length = min<size_t>(bytesToPass, bufferSize - readingPointer);				// the characters up to the end of the buffer are contiguous
+		const bool complete = gb->PutBlock(buffer + readingPointer, length);
+		readingPointer = (readingPointer + length) % bufferSize;
+		bytesToPass -= length;
+		if (complete)
+		{
+			if (gb->IsWritingFile())
+			{
+				gb->WriteToFile();
+			}
+
+			// Code is complete or has been written to file, so stop here
+			return true;
+		}
+	}
+
+	return false;
+}
+
 char RegularGCodeInput::ReadByte()
 {
 	char c = buffer[readingPointer++];
-	if (readingPointer == GCodeInputBufferSize)
+	if (readingPointer == bufferSize)
 	{
 		readingPointer = 0;
 	}
@@ -88,15 +120,15 @@ size_t RegularGCodeInput::BytesCached() const
 	{
 		return writingPointer - readingPointer;
 	}
-	return GCodeInputBufferSize - readingPointer + writingPointer;
+	return bufferSize - readingPointer + writingPointer;
 }
 
 size_t RegularGCodeInput::BufferSpaceLeft() const
 {
-	return (readingPointer - writingPointer - 1u) % GCodeInputBufferSize;
+	return (readingPointer - writingPointer - 1u) % bufferSize;		// bufferSize must be a power of 2 for this to work
 }
 
-void NetworkGCodeInput::Put(MessageType mtype, char c)
+void RegularGCodeInput::Put(MessageType mtype, char c)
 {
 	if (BufferSpaceLeft() == 0)
 	{
@@ -174,7 +206,7 @@ void NetworkGCodeInput::Put(MessageType mtype, char c)
 
 	// Feed another character into the buffer
 	buffer[writingPointer++] = c;
-	if (writingPointer == GCodeInputBufferSize)
+	if (writingPointer == bufferSize)
 	{
 		writingPointer = 0;
 	}
@@ -197,7 +229,22 @@ void NetworkGCodeInput::Put(MessageType mtype, const char *buf)
 	}
 }
 
-NetworkGCodeInput::NetworkGCodeInput() : RegularGCodeInput()
+// Append several null-terminated strings at once, so that we only need to take the mutex once
+bool NetworkGCodeInput::Put(MessageType mtype, const char *buf, size_t len)
+{
+	MutexLocker lock(bufMutex, 200);
+	if (lock && len <= BufferSpaceLeft())
+	{
+		for (size_t i = 0; i < len; i++)
+		{
+			Put(mtype, buf[i]);
+		}
+		return true;
+	}
+	return false;
+}
+
+NetworkGCodeInput::NetworkGCodeInput() : RegularGCodeInput(networkBuffer, GCodeInputBufferSize)
 {
 	bufMutex.Create("NetworkGCodeInput");
 }
@@ -209,13 +256,87 @@ bool NetworkGCodeInput::FillBuffer(GCodeBuffer *gb) /*override*/
 	return lock && RegularGCodeInput::FillBuffer(gb);
 }
 
+#if SUPPORT_USB_STREAMING
+
+// Serial G-code input source for streaming from a host
+
+void SerialGCodeInput::Reset()
+{
+	RegularGCodeInput::Reset();
+	while (device.available() > 0)
+	{
+		device.read();
+	}
+}
+
+// Move data from the device into the ring buffer. The device buffers incoming data in its own interrupt handler, so we only need to keep it from filling up.
+void SerialGCodeInput::ReadFromDevice()
+{
+	size_t bytesToRead = min<size_t>(device.available(), BufferSpaceLeft());
+	while (bytesToRead != 0)
+	{
+		char chunk[64];
+		const size_t chunkLength = device.readBytes(chunk, min<size_t>(bytesToRead, sizeof(chunk)));
+		if (chunkLength == 0)
+		{
+			break;
+		}
+		for (size_t i = 0; i < chunkLength; ++i)
+		{
+			Put(mtype, chunk[i]);
+		}
+		bytesToRead -= chunkLength;
+	}
+}
+
+#endif
+
 // File-based G-code input source
 
 // Reset this input. Should be called when the associated file is being closed
 void FileGCodeInput::Reset()
 {
+#if SUPPORT_STORAGE_TASK
+	CancelReadAhead();
+#endif
 	lastFile = nullptr;
+	binaryMode = fileEnded = false;
 	RegularGCodeInput::Reset();
+
+	if (newBlockSize != blockSize)
+	{
+		// We aren't reading a file, so we can change to a larger buffer. We only free the old buffer if it is one we allocated.
+		char * const newBuffer = new char[2 * newBlockSize];
+		if (buffer != fileBuffer)
+		{
+			delete[] buffer;
+		}
+		buffer = newBuffer;
+		bufferSize = 2 * newBlockSize;
+		blockSize = newBlockSize;
+	}
+}
+
+// Set the size of the blocks we read from the file. We may be reading config.g when this is called, so we change the buffer when we are next reset.
+GCodeResult FileGCodeInput::SetBlockSize(size_t size, const StringRef& reply)
+{
+	constexpr uint32_t MinRamToLeaveFree = 8 * 1024;			// a margin for network buffers and task stacks that are allocated later
+
+	if (size < newBlockSize || size > MaxFileReadBlockSize || (size & (size - 1)) != 0)
+	{
+		reply.printf("Block size must be a power of 2 between %u and %u", newBlockSize, MaxFileReadBlockSize);
+		return GCodeResult::error;
+	}
+	if (size != newBlockSize)
+	{
+		if (2 * size + MinRamToLeaveFree > Tasks::GetNeverUsedRam())
+		{
+			reply.printf("Not enough free RAM, %" PRIu32 " bytes needed", (uint32_t)(2 * size) + MinRamToLeaveFree);
+			return GCodeResult::error;
+		}
+		newBlockSize = size;
+	}
+	return GCodeResult::ok;
 }
 
 // Reset this input. Should be called when a specific G-code or macro file is closed outside of the reading context
@@ -230,11 +351,13 @@ void FileGCodeInput::Reset(const FileData &file)
 // Read another chunk of G-codes from the file and return true if more data is available
 GCodeInputReadResult FileGCodeInput::ReadFromFile(FileData &file)
 {
-	const size_t bytesCached = BytesCached();
-
 	// Keep track of the last file we read from
 	if (lastFile != nullptr && lastFile != file.f)
 	{
+#if SUPPORT_STORAGE_TASK
+		CancelReadAhead();
+#endif
+		const size_t bytesCached = BytesCached();
 		if (bytesCached > 0)
 		{
 			// Rewind back to the right position so we can resume at the right position later.
@@ -244,33 +367,161 @@ GCodeInputReadResult FileGCodeInput::ReadFromFile(FileData &file)
 
 		RegularGCodeInput::Reset();
 	}
+	if (lastFile != file.f)
+	{
+		binaryMode = IsBinaryFile(file);
+		fileEnded = false;
+	}
 	lastFile = file.f;
 
-	// Read more from the file
-	if (bytesCached < GCodeInputFileReadThreshold)
+#if SUPPORT_STORAGE_TASK
+	// If the storage task is reading the next block for us then carry on with what we have, else add the new data to the buffer
+	if (readRequest.IsBusy())
+	{
+		return (BytesCached() > 0) ? GCodeInputReadResult::haveData : GCodeInputReadResult::pending;
+	}
+	if (readRequest.IsDone() && !CollectReadAhead())
+	{
+		return GCodeInputReadResult::error;
+	}
+#endif
+
+	// Read more from the file if there is room for the rest of the current block
+	const FilePosition filePos = file.GetPosition();
+	if (BytesCached() == 0)
+	{
+		// Keep the buffer offset the same as the offset in the block, so that reads of whole blocks don't wrap round the end of the buffer
+		readingPointer = writingPointer = filePos % blockSize;
+	}
+
+	const size_t bytesToRead = min<size_t>(blockSize - (filePos % blockSize), bufferSize - writingPointer);
+#if SUPPORT_STORAGE_TASK
+	if (!fileEnded && BufferSpaceLeft() >= bytesToRead)
 	{
-		// Reset the read+write pointers for better performance if possible
-		if (readingPointer == writingPointer)
+		// Ask the storage task to read the block. It has a higher priority than us, so if the data doesn't need to come from the SD card it may already be done.
+		file.f->BeginReadAhead();
+		StorageService::Read(readRequest, file.f, buffer + writingPointer, bytesToRead, StorageRequestPriority::readAhead);
+		if (readRequest.IsDone() && !CollectReadAhead())
 		{
-			readingPointer = writingPointer = 0;
+			return GCodeInputReadResult::error;
 		}
+	}
 
-		// The code here used to read into a local buffer in blocks that are multiples of 4 bytes.
-		// However, unless we can use a buffer of at least 512 bytes then that is redundant,
-		// because the data will be copied via the sector buffer in FatFS anyway. So we don't do that any more.
-		const int bytesRead = file.Read(buffer + writingPointer, min<size_t>(BufferSpaceLeft(), GCodeInputBufferSize - writingPointer));
+	return (BytesCached() > 0) ? GCodeInputReadResult::haveData
+			: (readRequest.IsBusy()) ? GCodeInputReadResult::pending
+				: GCodeInputReadResult::noData;
+#else
+	if (BufferSpaceLeft() >= bytesToRead)
+	{
+		const int bytesRead = file.Read(buffer + writingPointer, bytesToRead);
 		if (bytesRead < 0)
 		{
 			return GCodeInputReadResult::error;
 		}
 		if (bytesRead > 0)
 		{
-			writingPointer = (writingPointer + (size_t)bytesRead) % GCodeInputBufferSize;
+			writingPointer = (writingPointer + (size_t)bytesRead) % bufferSize;
 			return GCodeInputReadResult::haveData;
 		}
+		fileEnded = true;
+	}
+
+	return (BytesCached() > 0) ? GCodeInputReadResult::haveData : GCodeInputReadResult::noData;
+#endif
+}
+
+#if SUPPORT_STORAGE_TASK
+
+// Add the data from a finished read to the buffer, returning false if the read failed
+bool FileGCodeInput::CollectReadAhead()
+{
+	lastFile->EndReadAhead();
+	const int bytesRead = StorageService::Collect(readRequest);
+	if (bytesRead < 0)
+	{
+		return false;
+	}
+	if (bytesRead == 0)
+	{
+		fileEnded = true;
+	}
+	else
+	{
+		writingPointer = (writingPointer + (size_t)bytesRead) % bufferSize;
+	}
+	return true;
+}
+
+// Abandon any read that we asked the storage task to do, and put the file position back to where the read started
+void FileGCodeInput::CancelReadAhead()
+{
+	if (readRequest.IsBusy() || readRequest.IsDone())
+	{
+		StorageService::Cancel(readRequest);
+		const FilePosition readStart = lastFile->Position();
+		lastFile->EndReadAhead();
+		(void)lastFile->Seek(readStart);
+	}
+}
+
+#endif
+
+// Return true if the file starts with the binary G-code signature. If we are at the start of the file, skip the signature.
+/*static*/ bool FileGCodeInput::IsBinaryFile(FileData &file)
+{
+	const FilePosition pos = file.GetPosition();
+	char signature[BinaryGCode::SignatureLength];
+	const bool isBinary = file.Seek(0)
+						&& file.Read(signature, BinaryGCode::SignatureLength) == (int)BinaryGCode::SignatureLength
+						&& memcmp(signature, BinaryGCode::FileSignature, BinaryGCode::SignatureLength) == 0;
+	file.Seek((isBinary && pos == 0) ? BinaryGCode::SignatureLength : pos);
+	return isBinary;
+}
+
+// Fill a GCodeBuffer with the next command. In a binary file, a move record at the start of a line is passed to the GCodeBuffer
+// in one go once we have all of it, so that it doesn't need to be parsed.
+bool FileGCodeInput::FillBuffer(GCodeBuffer *gb)
+{
+	if (binaryMode && !gb->IsWritingFile() && gb->IsAtLineStart() && BytesCached() != 0
+		&& ((uint8_t)buffer[readingPointer] & BinaryGCode::RecordFlag) != 0)
+	{
+		const size_t bytesCached = BytesCached();
+		if (bytesCached >= BinaryGCode::RecordHeaderLength)
+		{
+			const uint8_t command = (uint8_t)buffer[readingPointer];
+			const uint8_t parameters = (uint8_t)buffer[(readingPointer + 1) % bufferSize];
+			if (!BinaryGCode::IsValidRecordHeader(command, parameters))
+			{
+				// Skip the header and hope that what follows is a line of ASCII G-code
+				(void)ReadByte();
+				(void)ReadByte();
+				reprap.GetPlatform().MessageF(ErrorMessage, "Invalid binary G-code move record %02x %02x\n", command, parameters);
+				return false;
+			}
+
+			const size_t recordLength = BinaryGCode::RecordLength(parameters);
+			if (bytesCached >= recordLength)
+			{
+				uint8_t record[BinaryGCode::MaxRecordLength];
+				for (size_t i = 0; i < recordLength; ++i)
+				{
+					record[i] = (uint8_t)ReadByte();
+				}
+				gb->PutBinaryMove(record, recordLength);
+				return true;
+			}
+		}
+
+		if (fileEnded)
+		{
+			// The file ends part way through a record, so throw the incomplete record away
+			reprap.GetPlatform().Message(ErrorMessage, "Binary G-code file ends with an incomplete move record\n");
+			RegularGCodeInput::Reset();
+		}
+		return false;											// wait until we have read the whole record
 	}
 
-	return (bytesCached > 0) ? GCodeInputReadResult::haveData : GCodeInputReadResult::noData;
+	return RegularGCodeInput::FillBuffer(gb);
 }
 
 // End
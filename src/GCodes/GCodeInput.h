@@ -12,9 +12,14 @@
 #include "Storage/FileData.h"
 #include "MessageType.h"
 #include "RTOSIface.h"
+#include "Storage/StorageService.h"
+#include "GCodeResult.h"
 
-const size_t GCodeInputBufferSize = 256;				// How many bytes can we cache per input source?
-const size_t GCodeInputFileReadThreshold = 128;			// How many free bytes must be available before data is read from the SD card?
+const size_t GCodeInputBufferSize = 256;				// How many bytes can we cache per network input source?
+const size_t SerialGCodeInputBufferSize = 2048;			// How many bytes can we cache from the USB port when streaming? Must be a power of 2.
+const size_t FileReadBlockSize = 512;					// By default we read files in blocks of this size, aligned to multiples of it in the file. Same as the sector size.
+const size_t MaxFileReadBlockSize = 8192;				// The largest block size that M939 may set
+const size_t FileGCodeInputBufferSize = 2 * FileReadBlockSize;	// How many bytes can we cache from a file by default? Must be a multiple of the block size.
 
 
 // This base class is intended to provide incoming G-codes for the GCodeBuffer class
@@ -69,37 +74,61 @@ enum class GCodeInputState
 class RegularGCodeInput : public GCodeInput
 {
 public:
-	RegularGCodeInput();
+	RegularGCodeInput(char *buf, size_t size);
 
 	void Reset() override;
+	bool FillBuffer(GCodeBuffer *gb) override;			// Fill a GCodeBuffer, passing it whole lines where possible
 	size_t BytesCached() const override;				// How many bytes have been cached?
 	size_t BufferSpaceLeft() const;						// How much space do we have left?
 
 protected:
 	char ReadByte() override;
+	void Put(MessageType mtype, char c);				// Append a single character, checking for M112 and M122
 
 	GCodeInputState state;
 	size_t writingPointer, readingPointer;
-	char buffer[GCodeInputBufferSize];
+	char *buffer;										// The ring buffer, which the derived class provides
+	size_t bufferSize;
 };
 
-enum class GCodeInputReadResult : uint8_t { haveData, noData, error };
+enum class GCodeInputReadResult : uint8_t { haveData, noData, pending, error };		// 'pending' means we are waiting for data to be read from the file
 
 // This class is an expansion of the RegularGCodeInput class to buffer G-codes and to rewind file positions when
 // nested G-code files are started. However buffered codes are not explicitly checked for M112.
+// The buffer holds two blocks. We read a whole block from the file when the one before it has been used, so that most of the time one block
+// is being parsed while the other is full, and FatFs can transfer whole sectors straight into our buffer. M939 can set a larger block size,
+// so that FatFs reads several sectors at a time from the SD card.
+// If we have a storage task then it reads the blocks for us, so that we can parse one block while the other is being read.
 class FileGCodeInput : public RegularGCodeInput
 {
 public:
 
-	FileGCodeInput() : RegularGCodeInput(), lastFile(nullptr) { }
+	FileGCodeInput() : RegularGCodeInput(fileBuffer, FileGCodeInputBufferSize), lastFile(nullptr), blockSize(FileReadBlockSize), newBlockSize(FileReadBlockSize),
+		binaryMode(false), fileEnded(false) { }
 
 	void Reset() override;								// This should be called when the associated file is being closed
 	void Reset(const FileData &file);					// Should be called when a specific G-code or macro file is closed or re-opened outside the reading context
 
 	GCodeInputReadResult ReadFromFile(FileData &file);	// Read another chunk of G-codes from the file and return true if more data is available
+	bool FillBuffer(GCodeBuffer *gb) override;			// Fill a GCodeBuffer with the next G-code, which may be a binary move record
+	GCodeResult SetBlockSize(size_t size, const StringRef& reply);	// Set the size of the blocks we read, taking effect when we are next reset
+	size_t GetBlockSize() const { return newBlockSize; }
 
 private:
+	static bool IsBinaryFile(FileData &file);
+
+#if SUPPORT_STORAGE_TASK
+	bool CollectReadAhead();							// Add the data from a finished read to the buffer, returning false if the read failed
+	void CancelReadAhead();								// Abandon any read in progress and put the file position back to where it started
+
+	StorageRequest readRequest;
+#endif
 	FileStore *lastFile;
+	size_t blockSize;									// the size of the blocks we read from the file, half the buffer size
+	size_t newBlockSize;								// the block size to use after the next reset
+	bool binaryMode;									// True if the file we are reading from is in the binary format described in BinaryGCode.h
+	bool fileEnded;										// True if the last read found no more data in the file
+	char fileBuffer[FileGCodeInputBufferSize];
 };
 
 // This class receives its data from the network task
@@ -110,11 +139,31 @@ public:
 
 	bool FillBuffer(GCodeBuffer *gb) override;			// Fill a GCodeBuffer with the last available G-code
 	void Put(MessageType mtype, const char *buf);		// Append a null-terminated string to the buffer
+	bool Put(MessageType mtype, const char *buf, size_t len);	// Append a block of null-terminated strings to the buffer, returning false if there wasn't room
 
 private:
-	void Put(MessageType mtype, char c);				// Append a single character
-
 	Mutex bufMutex;
+	char networkBuffer[GCodeInputBufferSize];
+};
+
+#if SUPPORT_USB_STREAMING
+
+// This class moves data from a Stream device into a large ring buffer on every call to GCodes::Spin, not just when the associated GCodeBuffer is idle.
+// This lets a host stream G-codes ahead of the ones being executed, and lets us act on M112 and M122 as soon as they arrive.
+class SerialGCodeInput : public RegularGCodeInput
+{
+public:
+	SerialGCodeInput(Stream &dev, MessageType mt) : RegularGCodeInput(serialBuffer, SerialGCodeInputBufferSize), device(dev), mtype(mt) { }
+
+	void Reset() override;
+	void ReadFromDevice();								// Move as much data as we have room for from the device into the buffer
+
+private:
+	Stream &device;
+	const MessageType mtype;
+	char serialBuffer[SerialGCodeInputBufferSize];
 };
 
 #endif
+
+#endif
@@ -7,8 +7,8 @@
 
 #include "GCodeMachineState.h"
 
-GCodeMachineState *GCodeMachineState::freeList = nullptr;
 unsigned int GCodeMachineState::numAllocated = 0;
+unsigned int GCodeMachineState::numInUse = 0;
 
 // Create a default initialised GCodeMachineState
 GCodeMachineState::GCodeMachineState()
@@ -18,8 +18,21 @@ GCodeMachineState::GCodeMachineState()
 {
 }
 
-// Allocate a new GCodeMachineState
-/*static*/ GCodeMachineState *GCodeMachineState::Allocate()
+// Add some new state records to a free list. Each GCodeBuffer has its own free list, so that the records it needs for macros are normally allocated at startup.
+/*static*/ void GCodeMachineState::Preallocate(GCodeMachineState *&freeList, unsigned int num)
+{
+	while (num != 0)
+	{
+		GCodeMachineState * const ms = new GCodeMachineState();
+		++numAllocated;
+		ms->previous = freeList;
+		freeList = ms;
+		--num;
+	}
+}
+
+// Allocate a GCodeMachineState from a free list, or from the heap if the free list is empty
+/*static*/ GCodeMachineState *GCodeMachineState::Allocate(GCodeMachineState *&freeList)
 {
 	GCodeMachineState *ms = freeList;
 	if (ms != nullptr)
@@ -34,24 +47,17 @@ GCodeMachineState::GCodeMachineState()
 		ms = new GCodeMachineState();
 		++numAllocated;
 	}
+	++numInUse;
 	return ms;
 }
 
-/*static*/ void GCodeMachineState::Release(GCodeMachineState *ms)
+// Return a GCodeMachineState to the free list it was allocated from
+/*static*/ void GCodeMachineState::Release(GCodeMachineState *ms, GCodeMachineState *&freeList)
 {
 	ms->fileState.Close();
 	ms->previous = freeList;
 	freeList = ms;
-}
-
-/*static*/ unsigned int GCodeMachineState::GetNumInUse()
-{
-	unsigned int inUse = numAllocated;
-	for (GCodeMachineState *ms = freeList; ms != nullptr; ms = ms->previous)
-	{
-		--inUse;
-	}
-	return inUse;
+	--numInUse;
 }
 
 // End
@@ -73,8 +73,11 @@ enum class GCodeState : uint8_t
 	probingAtPoint6,
 	probingAtPoint7,
 
+	levelling,											// running bed.g repeatedly until the calibration converges
+
 	doingFirmwareRetraction,
 	doingFirmwareUnRetraction,
+	blendingTravel,										// doing the first part of a travel move that has a firmware retraction blended into it
 	loadingFilament,
 	unloadingFilament,
 
@@ -113,7 +116,8 @@ public:
 		messageAcknowledged : 1,
 		messageCancelled : 1;
 
-	static GCodeMachineState *Allocate()
+	static void Preallocate(GCodeMachineState *&freeList, unsigned int num);
+	static GCodeMachineState *Allocate(GCodeMachineState *&freeList)
 	post(!result.IsLive(); result.state == GCodeState::normal);
 
 	// Copy values that may have been altered by config.g into this state record
@@ -124,13 +128,13 @@ public:
 		feedRate = other.feedRate;
 	}
 
-	static void Release(GCodeMachineState *ms);
+	static void Release(GCodeMachineState *ms, GCodeMachineState *&freeList);
 	static unsigned int GetNumAllocated() { return numAllocated; }
-	static unsigned int GetNumInUse();
+	static unsigned int GetNumInUse() { return numInUse; }
 
 private:
-	static GCodeMachineState *freeList;
 	static unsigned int numAllocated;
+	static unsigned int numInUse;
 };
 
 #endif /* SRC_GCODES_GCODEMACHINESTATE_H_ */
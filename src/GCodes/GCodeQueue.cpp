@@ -13,16 +13,19 @@
 
 // GCodeQueue class
 
-GCodeQueue::GCodeQueue() : freeItems(nullptr), queuedItems(nullptr)
+GCodeQueue::GCodeQueue() : freeItems(nullptr), queuedItems(nullptr), lastQueuedItem(nullptr), queuedCodeStats("queued codes"),
+	fanChangesHead(0), numFanChanges(0), maxNumFanChanges(0)
 {
 	for (size_t i = 0; i < maxQueuedCodes; i++)
 	{
 		freeItems = new QueuedCode(freeItems);
 	}
+	queuedCodeStats.Created(maxQueuedCodes);
 }
 
-// Return true if the move in the GCodeBuffer should be queued
-/*static*/ bool GCodeQueue::ShouldQueueCode(GCodeBuffer &gb)
+// Return true if the move in the GCodeBuffer should be queued.
+// 'segmentsPending' is the number of move segments that GCodes has not yet passed to Move.
+/*static*/ bool GCodeQueue::ShouldQueueCode(GCodeBuffer &gb, unsigned int segmentsPending)
 {
 #if SUPPORT_ROLAND
 	// Don't queue codes if the Roland module is active
@@ -32,9 +35,9 @@ GCodeQueue::GCodeQueue() : freeItems(nullptr), queuedItems(nullptr)
 	}
 #endif
 
-	// Don't queue anything if no moves are being performed
+	// Don't queue anything if no moves are being performed or waiting to be performed
 	const uint32_t scheduledMoves = reprap.GetMove().GetScheduledMoves();
-	if (scheduledMoves != reprap.GetMove().GetCompletedMoves())
+	if (scheduledMoves != reprap.GetMove().GetCompletedMoves() || segmentsPending != 0)
 	{
 		switch (gb.GetCommandLetter())
 		{
@@ -86,13 +89,82 @@ GCodeQueue::GCodeQueue() : freeItems(nullptr), queuedItems(nullptr)
 	return false;
 }
 
-// Try to queue the command in the passed GCodeBuffer.
+// Return true if the command in the GCodeBuffer is M106 with just an S parameter and possibly a P parameter, or M107, and get the fan speed change it requests.
+// Slicers generate these on many layers or even many moves, so we queue them in binary form instead of as text.
+/*static*/ bool GCodeQueue::GetFanChange(GCodeBuffer &gb, FanChange& fc)
+{
+	if (gb.GetCommandLetter() != 'M')
+	{
+		return false;
+	}
+
+	switch (gb.GetCommandNumber())
+	{
+	case 106:
+		// Any parameters other than P and S mean that the command configures the fan or reports its configuration
+		if (gb.Seen('A') || gb.Seen('I') || gb.Seen('F') || gb.Seen('T') || gb.Seen('B') || gb.Seen('L') || gb.Seen('X') || gb.Seen('H')
+			|| gb.Seen('C') || gb.Seen('K') || gb.Seen('U') || gb.Seen('R') || !gb.Seen('S'))
+		{
+			return false;
+		}
+		fc.pwm = constrain<float>(gb.GetFValue(), 0.0, 255.0);
+		if (gb.Seen('P'))
+		{
+			const int fanNumber = gb.GetIValue();
+			if (fanNumber < 0 || fanNumber >= (int)NUM_FANS)
+			{
+				return false;									// let M106 report the error
+			}
+			fc.fanNumber = fanNumber;
+		}
+		else
+		{
+			fc.fanNumber = -1;
+		}
+		return true;
+
+	case 107:
+		fc.pwm = 0.0;
+		fc.fanNumber = -1;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// Try to queue a fan speed change, to be made when the moves already scheduled and the segments still pending have completed.
+// If successful, return true to indicate it has been queued.
+bool GCodeQueue::QueueFanChange(const FanChange& fc, unsigned int segmentsPending)
+{
+	if (numFanChanges == maxQueuedFanChanges)
+	{
+		return false;
+	}
+
+	QueuedFanChange& qfc = fanChanges[(fanChangesHead + numFanChanges) % maxQueuedFanChanges];
+	qfc.change = fc;
+	qfc.executeAtMove = reprap.GetMove().GetScheduledMoves() + segmentsPending;
+	++numFanChanges;
+	if (numFanChanges > maxNumFanChanges)
+	{
+		maxNumFanChanges = numFanChanges;
+	}
+	return true;
+}
+
+// Try to queue the command in the passed GCodeBuffer, to be executed when the moves already scheduled and the segments still pending have completed.
 // If successful, return true to indicate it has been queued.
 // If the queue is full or the command is too long to be queued, return false.
-bool GCodeQueue::QueueCode(GCodeBuffer &gb)
+bool GCodeQueue::QueueCode(GCodeBuffer &gb, unsigned int segmentsPending)
 {
 	// Can we queue this code somewhere?
-	if (freeItems == nullptr || gb.CommandLength() > SHORT_GCODE_LENGTH - 1)
+	if (freeItems == nullptr)
+	{
+		queuedCodeStats.Failed();
+		return false;
+	}
+	if (gb.CommandLength() > SHORT_GCODE_LENGTH - 1)
 	{
 		return false;
 	}
@@ -101,7 +173,7 @@ bool GCodeQueue::QueueCode(GCodeBuffer &gb)
 	QueuedCode * const code = freeItems;
 	freeItems = code->next;
 	code->AssignFrom(gb);
-	code->executeAtMove = reprap.GetMove().GetScheduledMoves();
+	code->executeAtMove = reprap.GetMove().GetScheduledMoves() + segmentsPending;
 	code->next = nullptr;
 
 	// Append it to the list of queued codes
@@ -111,14 +183,11 @@ bool GCodeQueue::QueueCode(GCodeBuffer &gb)
 	}
 	else
 	{
-		QueuedCode *last = queuedItems;
-		while (last->Next() != nullptr)
-		{
-			last = last->Next();
-		}
-		last->next = code;
+		lastQueuedItem->next = code;
 	}
+	lastQueuedItem = code;
 
+	queuedCodeStats.Allocated();
 	return true;
 }
 
@@ -137,15 +206,56 @@ bool GCodeQueue::FillBuffer(GCodeBuffer *gb)
 
 	// Release this item again
 	queuedItems = queuedItems->next;
+	if (queuedItems == nullptr)
+	{
+		lastQueuedItem = nullptr;
+	}
 	code->next = freeItems;
 	freeItems = code;
+	queuedCodeStats.Released();
+	return true;
+}
+
+// If the oldest fan speed change is due, remove it from the queue and return true
+bool GCodeQueue::TakeFanChange(FanChange& fc)
+{
+	if (numFanChanges == 0 || fanChanges[fanChangesHead].executeAtMove > reprap.GetMove().GetCompletedMoves())
+	{
+		return false;
+	}
+
+	fc = fanChanges[fanChangesHead].change;
+	fanChangesHead = (fanChangesHead + 1) % maxQueuedFanChanges;
+	--numFanChanges;
 	return true;
 }
 
 // Return true if there is nothing to do
 bool GCodeQueue::IsIdle() const
 {
-	return queuedItems == nullptr || queuedItems->executeAtMove > reprap.GetMove().GetCompletedMoves();
+	const uint32_t completedMoves = reprap.GetMove().GetCompletedMoves();
+	return (queuedItems == nullptr || queuedItems->executeAtMove > completedMoves)
+		&& (numFanChanges == 0 || fanChanges[fanChangesHead].executeAtMove > completedMoves);
+}
+
+// Return true if any codes or fan speed changes are queued to execute when the specified number of moves have completed
+bool GCodeQueue::HasCodesForMove(uint32_t moveNumber) const
+{
+	for (const QueuedCode *item = queuedItems; item != nullptr; item = item->Next())
+	{
+		if (item->executeAtMove == moveNumber)
+		{
+			return true;
+		}
+	}
+	for (size_t i = 0; i < numFanChanges; ++i)
+	{
+		if (fanChanges[(fanChangesHead + i) % maxQueuedFanChanges].executeAtMove == moveNumber)
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 // Because some moves may end before the print is actually paused, we need a method to
@@ -171,6 +281,11 @@ void GCodeQueue::PurgeEntries()
 			{
 				lastItem->next = nextItem;
 			}
+			if (nextItem == nullptr)
+			{
+				lastQueuedItem = lastItem;
+			}
+			queuedCodeStats.Released();
 			item = nextItem;
 		}
 		else
@@ -179,6 +294,12 @@ void GCodeQueue::PurgeEntries()
 			item = item->Next();
 		}
 	}
+
+	// The fan speed changes are in order of execution, so we can remove them from the newest end
+	while (numFanChanges != 0 && fanChanges[(fanChangesHead + numFanChanges - 1) % maxQueuedFanChanges].executeAtMove > reprap.GetMove().GetScheduledMoves())
+	{
+		--numFanChanges;
+	}
 }
 
 void GCodeQueue::Clear()
@@ -189,6 +310,31 @@ void GCodeQueue::Clear()
 		queuedItems = item->Next();
 		item->next = freeItems;
 		freeItems = item;
+		queuedCodeStats.Released();
+	}
+	lastQueuedItem = nullptr;
+	numFanChanges = 0;
+}
+
+// Some moves or segments that were counted when codes were queued have been discarded, e.g. because they were too short to schedule.
+// So the codes queued behind them must be executed that number of moves earlier.
+void GCodeQueue::MovesDiscarded(unsigned int numDiscarded)
+{
+	const uint32_t scheduledMoves = reprap.GetMove().GetScheduledMoves();
+	for (QueuedCode *item = queuedItems; item != nullptr; item = item->Next())
+	{
+		if (item->executeAtMove > scheduledMoves)
+		{
+			item->executeAtMove = max<uint32_t>(item->executeAtMove - numDiscarded, scheduledMoves);
+		}
+	}
+	for (size_t i = 0; i < numFanChanges; ++i)
+	{
+		QueuedFanChange& qfc = fanChanges[(fanChangesHead + i) % maxQueuedFanChanges];
+		if (qfc.executeAtMove > scheduledMoves)
+		{
+			qfc.executeAtMove = max<uint32_t>(qfc.executeAtMove - numDiscarded, scheduledMoves);
+		}
 	}
 }
 
@@ -206,6 +352,9 @@ void GCodeQueue::Diagnostics(MessageType mtype)
 		} while ((item = item->Next()) != nullptr);
 		reprap.GetPlatform().MessageF(mtype, "%d of %d codes have been queued.\n", queueLength, maxQueuedCodes);
 	}
+	reprap.GetPlatform().MessageF(mtype, "Max codes queued %" PRIu32 ", fan changes queued %u, max %u\n", queuedCodeStats.GetMaxInUse(), numFanChanges, maxNumFanChanges);
+	queuedCodeStats.ResetMaxInUse();
+	maxNumFanChanges = numFanChanges;
 }
 
 // QueuedCode class
@@ -9,26 +9,52 @@
 
 #include "RepRapFirmware.h"
 #include "GCodeBuffer.h"
+#include "Libraries/General/PoolStats.h"
 
 class QueuedCode;
 
 class GCodeQueue
 {
 public:
+	// A fan speed change that is queued in binary form, so that it needs neither a slot in the code queue nor parsing again when it is executed
+	struct FanChange
+	{
+		float pwm;												// the S parameter, either 0..1 or 0..255
+		int fanNumber;											// the P parameter, or -1 for the fans mapped to the current tool
+	};
+
 	GCodeQueue();
 
-	static bool ShouldQueueCode(GCodeBuffer &gb);				// Return true if this code should be queued
-	bool QueueCode(GCodeBuffer &gb);							// Queue a G-code
+	static bool ShouldQueueCode(GCodeBuffer &gb, unsigned int segmentsPending);	// Return true if this code should be queued
+	static bool GetFanChange(GCodeBuffer &gb, FanChange& fc);	// Return true if this code is a plain fan speed change, and get the change
+	bool QueueCode(GCodeBuffer &gb, unsigned int segmentsPending);	// Queue a G-code to be executed after the moves scheduled so far and the segments pending
+	bool QueueFanChange(const FanChange& fc, unsigned int segmentsPending);	// Queue a fan speed change to be made after the moves scheduled so far and the segments pending
 	bool FillBuffer(GCodeBuffer *gb);							// If there is another move to execute at this time, fill a buffer
+	bool TakeFanChange(FanChange& fc);							// If there is a fan speed change due now, remove it from the queue and return true
 	void PurgeEntries();										// Remove stored codes when a print is being paused
 	void Clear();												// Clean up all the stored codes
+	void MovesDiscarded(unsigned int numDiscarded);				// Called when moves that codes were queued behind were not scheduled after all
 	bool IsIdle() const;										// Return true if there is nothing to do
+	bool HasCodesForMove(uint32_t moveNumber) const;			// Return true if any codes are queued to execute when the specified number of moves have completed
 
 	void Diagnostics(MessageType mtype);
 
 private:
 	QueuedCode *freeItems;
 	QueuedCode *queuedItems;
+	QueuedCode *lastQueuedItem;									// The end of the queue, so that we can append codes quickly
+	PoolStats queuedCodeStats;									// The number of codes queued and the highest number, for diagnostics
+
+	struct QueuedFanChange
+	{
+		FanChange change;
+		uint32_t executeAtMove;
+	};
+
+	QueuedFanChange fanChanges[maxQueuedFanChanges];			// A ring of fan speed changes, in order of execution
+	size_t fanChangesHead;										// The index of the oldest fan speed change
+	size_t numFanChanges;
+	size_t maxNumFanChanges;									// The highest number of fan speed changes queued, for diagnostics
 };
 
 class QueuedCode
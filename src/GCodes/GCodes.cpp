@@ -27,6 +27,7 @@
 
 #include "GCodeBuffer.h"
 #include "GCodeQueue.h"
+#include "ToolPreheater.h"
 #include "Heating/Heat.h"
 #include "Heating/HeaterProtection.h"
 #include "Platform.h"
@@ -35,6 +36,10 @@
 #include "PrintMonitor.h"
 #include "RepRap.h"
 #include "Tools/Tool.h"
+#include "FilamentMonitors/FilamentMonitor.h"
+#include "Version.h"
+#include "StatusDelta.h"
+#include "PerfCounters.h"
 
 #if HAS_WIFI_NETWORKING
 # include "FirmwareUpdater.h"
@@ -44,6 +49,10 @@
 # include "Fans/DotStarLed.h"
 #endif
 
+#if SUPPORT_LASER_RASTER
+# include "Movement/LaserRaster.h"
+#endif
+
 const size_t gcodeReplyLength = 2048;			// long enough to pass back a reasonable number of files in response to M20
 
 // Set up some default values for special moves, e.g. for Z probing and firmware retraction
@@ -55,6 +64,7 @@ void GCodes::RawMove::SetDefaults()
 	usePressureAdvance = false;
 	endStopsToCheck = 0;
 	filePos = noFilePosition;
+	maxExtrusionRate = 0.0;
 	xAxes = DefaultXAxisMapping;
 	yAxes = DefaultYAxisMapping;
 }
@@ -64,10 +74,15 @@ GCodes::GCodes(Platform& p) :
 #if HAS_VOLTAGE_MONITOR
 	powerFailScript(nullptr),
 #endif
-	isFlashing(false), fileBeingHashed(nullptr), lastWarningMillis(0)
+	isFlashing(false), fileBeingHashed(nullptr), lastWarningMillis(0),
+	fileReadTimer("File read"), parseTimer("Parse"), executeTimer("Execute")
 {
 	fileInput = new FileGCodeInput();
+#if SUPPORT_USB_STREAMING
+	serialInput = new SerialGCodeInput(SERIAL_MAIN_DEVICE, UsbMessage);
+#else
 	serialInput = new StreamGCodeInput(SERIAL_MAIN_DEVICE);
+#endif
 #ifdef SERIAL_AUX_DEVICE
 	auxInput = new StreamGCodeInput(SERIAL_AUX_DEVICE);
 #endif
@@ -95,6 +110,13 @@ GCodes::GCodes(Platform& p) :
 	queuedGCode = new GCodeBuffer("queue", GenericMessage, false);
 	autoPauseGCode = new GCodeBuffer("autopause", GenericMessage, false);
 	codeQueue = new GCodeQueue();
+	auxStatusDelta = nullptr;
+#if SUPPORT_TOOL_PREHEAT
+	toolPreheater = new ToolPreheater();
+#endif
+#if SUPPORT_RESUME_CHECKPOINT
+	resumeCheckpoint = new ResumeCheckpoint();
+#endif
 }
 
 void GCodes::Exit()
@@ -105,6 +127,7 @@ void GCodes::Exit()
 void GCodes::Init()
 {
 	numVisibleAxes = numTotalAxes = XYZ_AXES;			// must set this up before calling Reset()
+	continuousRotationAxes = 0;
 	memset(axisLetters, 0, sizeof(axisLetters));
 	axisLetters[0] = 'X';
 	axisLetters[1] = 'Y';
@@ -120,6 +143,7 @@ void GCodes::Init()
 
 	distanceScale = 1.0;
 	arcSegmentLength = DefaultArcSegmentLength;
+	arcTolerance = DefaultArcTolerance;
 	virtualExtruderPosition = rawExtruderTotal = 0.0;
 	for (size_t extruder = 0; extruder < MaxExtruders; extruder++)
 	{
@@ -127,6 +151,13 @@ void GCodes::Init()
 	}
 
 	runningConfigFile = false;
+#if SUPPORT_RESUME_CHECKPOINT
+	checkedResumeCheckpoint = false;
+	checkpointLayer = 0;
+#endif
+#if SUPPORT_COMPILED_CONFIG
+	compileConfigFile = configFileHadError = false;
+#endif
 	m501SeenInConfigFile = false;
 	doingToolChange = false;
 	active = true;
@@ -143,10 +174,12 @@ void GCodes::Init()
 	retractExtra = 0.0;
 	retractHop = 0.0;
 	retractSpeed = unRetractSpeed = DefaultRetractSpeed * SecondsToMinutes;
-	isRetracted = false;
+	isRetracted = blendRetraction = retractionPending = travelTailPending = false;
 	lastAuxStatusReportType = -1;						// no status reports requested yet
+	auxStatusPushInterval = 0;							// PanelDue polls for status until it asks us to push it
 
 	laserMaxPower = DefaultMaxLaserPower;
+	laserPowerFollowsSpeed = false;
 
 	heaterFaultState = HeaterFaultState::noFault;
 	heaterFaultTime = 0;
@@ -215,6 +248,7 @@ void GCodes::Reset()
 	ClearMove();
 	ClearBabyStepping();								// clear this before calling ToolOffsetInverseTransform
 	currentZHop = 0.0;									// clear this before calling ToolOffsetInverseTransform
+	retractionPending = travelTailPending = false;
 	moveBuffer.xAxes = DefaultXAxisMapping;
 	moveBuffer.yAxes = DefaultYAxisMapping;
 	moveBuffer.virtualExtruderPosition = 0.0;
@@ -222,6 +256,9 @@ void GCodes::Reset()
 #if SUPPORT_LASER || SUPPORT_IOBITS
 	moveBuffer.laserPwmOrIoBits.Clear();
 #endif
+#if SUPPORT_LASER_RASTER
+	moveBuffer.laserRaster = nullptr;
+#endif
 
 	reprap.GetMove().GetKinematics().GetAssumedInitialPosition(numVisibleAxes, moveBuffer.coords);
 	ToolOffsetInverseTransform(moveBuffer.coords, currentUserPosition);
@@ -238,7 +275,7 @@ void GCodes::Reset()
 	triggersPending = 0;
 
 	simulationMode = 0;
-	exitSimulationWhenFileComplete = updateFileWhenSimulationComplete = false;
+	exitSimulationWhenFileComplete = updateFileWhenSimulationComplete = parseBenchmarking = false;
 	simulationTime = 0.0;
 	isPaused = false;
 #if HAS_VOLTAGE_MONITOR
@@ -248,6 +285,7 @@ void GCodes::Reset()
 	doingManualBedProbe = false;
 	pausePending = false;
 	probeIsDeployed = false;
+	skippingCalibrationPoints = false;
 	moveBuffer.filePos = noFilePosition;
 	lastEndstopStates = platform.GetAllEndstopStates();
 	firmwareUpdateModuleMap = 0;
@@ -255,6 +293,8 @@ void GCodes::Reset()
 
 	codeQueue->Clear();
 	cancelWait = isWaiting = displayNoToolWarning = false;
+	deferredHeaterWaits = 0;
+	deferredWaitForAllHeaters = false;
 
 	for (size_t i = 0; i < NumResources; ++i)
 	{
@@ -309,10 +349,121 @@ FilePosition GCodes::GetFilePosition() const
 // We use triggerCGode as the source to prevent any triggers being executed until we have finished
 bool GCodes::RunConfigFile(const char* fileName)
 {
+#if SUPPORT_COMPILED_CONFIG
+	// If config.g has already run without errors, run the compiled copy of it that we wrote then, because it is quicker to read and parse
+	configFileHadError = false;
+	compileConfigFile = false;
+	if (StringEquals(fileName, CONFIG_FILE))
+	{
+		if (CompiledConfigIsUpToDate())
+		{
+			fileName = COMPILED_CONFIG_FILE;
+		}
+		else
+		{
+			compileConfigFile = true;
+		}
+	}
+#endif
 	runningConfigFile = DoFileMacro(*daemonGCode, fileName, false);
 	return runningConfigFile;
 }
 
+#if SUPPORT_COMPILED_CONFIG
+
+// Get the first line that the compiled copy of config.g must have. It identifies the version of config.g and of the firmware it was compiled by.
+void GCodes::GetCompiledConfigHeader(const StringRef& header) const
+{
+	const time_t configTime = platform.GetMassStorage()->GetLastModifiedTime(platform.GetSysDir(), CONFIG_FILE);
+	header.printf("; compiled from " CONFIG_FILE " dated %lu by firmware " VERSION, (unsigned long)configTime);
+}
+
+bool GCodes::CompiledConfigIsUpToDate()
+{
+	FileStore * const f = platform.OpenFile(platform.GetSysDir(), COMPILED_CONFIG_FILE, OpenMode::read);
+	if (f == nullptr)
+	{
+		return false;
+	}
+
+	String<MaxFilenameLength> expectedHeader;
+	GetCompiledConfigHeader(expectedHeader.GetRef());
+	char header[MaxFilenameLength + 1];
+	const bool upToDate = f->ReadLine(header, sizeof(header)) > 0 && strcmp(header, expectedHeader.c_str()) == 0;
+	f->Close();
+	return upToDate;
+}
+
+// Write a compiled copy of config.g. We leave out comments, blank lines and leading and trailing white space, which is most of a typical config.g.
+void GCodes::CompileConfigFile()
+{
+	FileStore * const in = platform.OpenFile(platform.GetSysDir(), CONFIG_FILE, OpenMode::read);
+	if (in == nullptr)
+	{
+		return;
+	}
+	FileStore * const out = platform.OpenFile(platform.GetSysDir(), COMPILED_CONFIG_FILE, OpenMode::write);
+	if (out == nullptr)
+	{
+		in->Close();
+		return;
+	}
+
+	String<MaxFilenameLength> header;
+	GetCompiledConfigHeader(header.GetRef());
+	bool ok = out->Write(header.c_str()) && out->Write('\n');
+
+	char line[GCODE_LENGTH + 1];
+	int len;
+	while (ok && (len = in->ReadLine(line, sizeof(line))) >= 0)
+	{
+		if (len == 0 && in->Position() >= in->Length())
+		{
+			break;
+		}
+		if (len == (int)sizeof(line) - 1)
+		{
+			ok = false;									// the line is too long for a GCodeBuffer, so it must have been reported as an error anyway
+			break;
+		}
+
+		// Cut off any end-of-line comment that isn't in a quoted string
+		bool inQuotes = false;
+		int end = 0;
+		while (end < len && (inQuotes || line[end] != ';'))
+		{
+			if (line[end] == '"')
+			{
+				inQuotes = !inQuotes;
+			}
+			++end;
+		}
+		while (end != 0 && (line[end - 1] == ' ' || line[end - 1] == '\t'))
+		{
+			--end;
+		}
+		int start = 0;
+		while (start < end && (line[start] == ' ' || line[start] == '\t'))
+		{
+			++start;
+		}
+
+		if (start < end)
+		{
+			line[end] = '\n';
+			ok = out->Write(line + start, end - start + 1);
+		}
+	}
+	in->Close();
+
+	if (!out->Close() || !ok)
+	{
+		platform.GetMassStorage()->Delete(platform.GetSysDir(), COMPILED_CONFIG_FILE, true);
+	}
+}
+
+#endif
+
 // Return true if the daemon is busy running config.g or a trigger file
 bool GCodes::IsDaemonBusy() const
 {
@@ -339,6 +490,62 @@ void GCodes::InitialiseTaps()
 	g30zHeightErrorLowestDiff = 1000.0;
 }
 
+// Record the height error from the latest tap when the number of taps is decided statistically, and return true if we can stop tapping.
+// Readings that differ from the median by more than ZProbeOutlierFactor times the standard deviation limit are rejected as outliers.
+// We can stop when at least two readings remain and their standard deviation is within the limit. Either way, g30zHeightError is set to the mean of the remaining readings.
+bool GCodes::UpdateTapStatistics(float maxStdDev)
+{
+	if (tapsDone <= MaxStatisticalZProbeTaps)
+	{
+		g30TapHeightErrors[tapsDone - 1] = g30zHeightError;
+	}
+	const size_t numTaps = min<size_t>(tapsDone, MaxStatisticalZProbeTaps);
+
+	// Sort the readings so that we can find the median
+	float sorted[MaxStatisticalZProbeTaps];
+	for (size_t i = 0; i < numTaps; ++i)
+	{
+		const float h = g30TapHeightErrors[i];
+		size_t j = i;
+		while (j != 0 && sorted[j - 1] > h)
+		{
+			sorted[j] = sorted[j - 1];
+			--j;
+		}
+		sorted[j] = h;
+	}
+	const float median = (numTaps & 1) ? sorted[numTaps/2] : (sorted[numTaps/2 - 1] + sorted[numTaps/2]) * 0.5;
+
+	const float outlierLimit = ZProbeOutlierFactor * maxStdDev;
+	float sum = 0.0;
+	size_t numUsed = 0;
+	for (size_t i = 0; i < numTaps; ++i)
+	{
+		if (fabsf(sorted[i] - median) <= outlierLimit)
+		{
+			sum += sorted[i];
+			++numUsed;
+		}
+	}
+	if (numUsed == 0)
+	{
+		g30zHeightError = median;				// two readings that are too far apart to tell which one is the outlier
+		return false;
+	}
+
+	const float mean = sum/numUsed;
+	float sumOfSquares = 0.0;
+	for (size_t i = 0; i < numTaps; ++i)
+	{
+		if (fabsf(sorted[i] - median) <= outlierLimit)
+		{
+			sumOfSquares += fsquare(sorted[i] - mean);
+		}
+	}
+	g30zHeightError = mean;
+	return numUsed >= 2 && sumOfSquares <= fsquare(maxStdDev) * (numUsed - 1);
+}
+
 void GCodes::Spin()
 {
 	if (!active)
@@ -349,6 +556,20 @@ void GCodes::Spin()
 	CheckTriggers();
 	CheckHeaterFault();
 	CheckFilament();
+	DoQueuedFanChanges();
+#ifdef SERIAL_AUX_DEVICE
+	PushAuxStatus();
+#endif
+
+#if SUPPORT_USB_STREAMING
+	// Keep reading from USB even while the serial channel is busy, so that the host doesn't have to wait for buffer space in the USB driver
+# if SUPPORT_SCANNER
+	if (!reprap.GetScanner().IsRegistered())
+# endif
+	{
+		serialInput->ReadFromDevice();
+	}
+#endif
 
 	// Get the GCodeBuffer that we want to process a command from. Give priority to auto-pause.
 	GCodeBuffer *gbp = autoPauseGCode;
@@ -363,9 +584,80 @@ void GCodes::Spin()
 				nextGcodeSource = 0;
 			}
 		} while (gbp == nullptr);									// we must have at least one GCode source, so this can't loop indefinitely
+		SpinGCodeBuffer(*gbp);
+
+		// The file and code queue channels keep the planner fed and the queued codes in step with the moves, so they get a turn on every call
+		// instead of waiting for all the other channels to have theirs. Commands from other channels still interleave with them at command boundaries,
+		// and the heater, fan and movement resources stop channels interfering with each other.
+		if (autoPauseGCode->IsCompletelyIdle())						// in case the command we just ran started an automatic pause
+		{
+			if (gbp != fileGCode)
+			{
+				SpinGCodeBuffer(*fileGCode);
+			}
+			if (gbp != queuedGCode)
+			{
+				SpinGCodeBuffer(*queuedGCode);
+			}
+		}
+	}
+	else
+	{
+		SpinGCodeBuffer(*gbp);
+	}
+
+#if SUPPORT_TOOL_PREHEAT
+	if (simulationMode == 0 && IsReallyPrinting())
+	{
+		toolPreheater->Spin(*fileGCode, GetFilePosition());
+	}
+#endif
+
+#if SUPPORT_RESUME_CHECKPOINT
+	if (!checkedResumeCheckpoint)
+	{
+		// If the power failed while we were printing, generate resurrect.g from the saved state once config.g has set up the axes
+		if (!runningConfigFile)
+		{
+			checkedResumeCheckpoint = true;
+			RecoverResumeCheckpoint();
+		}
+	}
+	else if (resumeCheckpoint->IsOpen() && simulationMode == 0 && IsReallyPrinting() && reprap.GetPrintMonitor().GetCurrentLayer() != checkpointLayer)
+	{
+		checkpointLayer = reprap.GetPrintMonitor().GetCurrentLayer();
+		UpdateResumeCheckpoint();
+	}
+#endif
+
+	// Check if we need to display a warning
+	const uint32_t now = millis();
+	if (now - lastWarningMillis >= MinimumWarningInterval)
+	{
+		if (displayNoToolWarning)
+		{
+			platform.Message(ErrorMessage, "Attempting to extrude with no tool selected.\n");
+			displayNoToolWarning = false;
+			lastWarningMillis = now;
+		}
+	}
+}
+
+// Process more commands from the file being simulated. Called repeatedly from RepRap::Spin while simulating a file, so that the moves don't
+// have to wait for the rest of the main loop. Only the file and code queue channels produce work in this state, the others get their turns from Spin.
+void GCodes::SpinSimulation()
+{
+	if (autoPauseGCode->IsCompletelyIdle())
+	{
+		DoQueuedFanChanges();
+		SpinGCodeBuffer(*fileGCode);
+		SpinGCodeBuffer(*queuedGCode);
 	}
-	GCodeBuffer& gb = *gbp;
+}
 
+// Process the next step of the command from one input channel
+void GCodes::SpinGCodeBuffer(GCodeBuffer& gb)
+{
 	// Set up a buffer for the reply
 	String<gcodeReplyLength> reply;
 
@@ -397,18 +689,6 @@ void GCodes::Spin()
 	{
 		RunStateMachine(gb, reply.GetRef());			// Execute the state machine
 	}
-
-	// Check if we need to display a warning
-	const uint32_t now = millis();
-	if (now - lastWarningMillis >= MinimumWarningInterval)
-	{
-		if (displayNoToolWarning)
-		{
-			platform.Message(ErrorMessage, "Attempting to extrude with no tool selected.\n");
-			displayNoToolWarning = false;
-			lastWarningMillis = now;
-		}
-	}
 }
 
 // Execute a step of the state machine
@@ -861,6 +1141,7 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 			else
 			{
 				zProbeTriggered = false;
+				zProbeOvershoot = 0.0;
 				platform.SetProbing(true);
 				moveBuffer.SetDefaults();
 				moveBuffer.endStopsToCheck = ZProbeActive;
@@ -897,8 +1178,17 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 					break;
 				}
 
-				g30zHeightError = moveBuffer.coords[Z_AXIS] - platform.ZProbeStopHeight();
+				g30zHeightError = moveBuffer.coords[Z_AXIS] - zProbeOvershoot - platform.ZProbeStopHeight();
 				g30zHeightErrorSum += g30zHeightError;
+
+				// In fast mode, if we are only doing one tap per point then we can accept the reading now.
+				// The move to the next point in state gridProbing1 raises the probe to the dive height as well, so we don't need a separate move to raise it.
+				if (fastGridProbing && platform.GetCurrentZProbeParameters().maxTaps < 2 && platform.GetZProbeType() != ZProbeType::blTouch)
+				{
+					reprap.GetMove().AccessHeightMap().SetGridHeight(gridXindex, gridYindex, g30zHeightError);
+					gb.SetState(GCodeState::gridProbing6);
+					break;
+				}
 			}
 
 			gb.AdvanceState();
@@ -923,17 +1213,27 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 		{
 			// See whether we need to do any more taps
 			const ZProbe& params = platform.GetCurrentZProbeParameters();
-			if (tapsDone >= 2)
+			size_t maxTaps = params.maxTaps;
+			bool acceptReading;
+			if (params.maxStdDev > 0.0)
+			{
+				acceptReading = (params.maxTaps < 2 || UpdateTapStatistics(params.maxStdDev));
+				maxTaps = min<size_t>(maxTaps, MaxStatisticalZProbeTaps);
+			}
+			else
 			{
-				g30zHeightErrorLowestDiff = min<float>(g30zHeightErrorLowestDiff, fabsf(g30zHeightError - g30PrevHeightError));
+				if (tapsDone >= 2)
+				{
+					g30zHeightErrorLowestDiff = min<float>(g30zHeightErrorLowestDiff, fabsf(g30zHeightError - g30PrevHeightError));
+				}
+				acceptReading = (params.maxTaps < 2 || (tapsDone >= 2 && g30zHeightErrorLowestDiff <= params.tolerance));
 			}
-			const bool acceptReading = (params.maxTaps < 2 || (tapsDone >= 2 && g30zHeightErrorLowestDiff <= params.tolerance));
 			if (acceptReading)
 			{
 				reprap.GetMove().AccessHeightMap().SetGridHeight(gridXindex, gridYindex, g30zHeightError);
 				gb.AdvanceState();
 			}
-			else if (tapsDone < params.maxTaps)
+			else if (tapsDone < maxTaps)
 			{
 				// Tap again
 				lastProbedTime = millis();
@@ -982,6 +1282,14 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 			if (gridYindex == hm.GetGrid().NumYpoints())
 			{
 				// Done all the points
+				if (fastGridProbing)
+				{
+					// The probe may not have been raised after the last point
+					moveBuffer.SetDefaults();
+					moveBuffer.coords[Z_AXIS] = platform.GetZProbeStartingHeight();
+					moveBuffer.feedRate = platform.GetZProbeTravelSpeed();
+					NewMoveAvailable(1);
+				}
 				gb.AdvanceState();
 				if (platform.GetZProbeType() != ZProbeType::none && !probeIsDeployed)
 				{
@@ -1101,6 +1409,7 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 			else
 			{
 				zProbeTriggered = false;
+				zProbeOvershoot = 0.0;
 				platform.SetProbing(true);
 				moveBuffer.SetDefaults();
 				moveBuffer.endStopsToCheck = ZProbeActive;
@@ -1145,7 +1454,7 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 					gb.TryGetFValue('H', heightAdjust, dummy);
 					float m[MaxAxes];
 					reprap.GetMove().GetCurrentMachinePosition(m, false);		// get height without bed compensation
-					g30zStoppedHeight = m[Z_AXIS] - heightAdjust;				// save for later
+					g30zStoppedHeight = m[Z_AXIS] - zProbeOvershoot - heightAdjust;	// save for later
 					g30zHeightError = g30zStoppedHeight - platform.ZProbeStopHeight();
 					g30zHeightErrorSum += g30zHeightError;
 				}
@@ -1199,12 +1508,23 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 		{
 			// See whether we need to do any more taps
 			const ZProbe& params = platform.GetCurrentZProbeParameters();
-			if (tapsDone >= 2)
+			const bool statistical = (params.maxStdDev > 0.0 && !hadProbingError);
+			size_t maxTaps = params.maxTaps;
+			bool acceptReading;
+			if (statistical)
 			{
-				g30zHeightErrorLowestDiff = min<float>(g30zHeightErrorLowestDiff, fabsf(g30zHeightError - g30PrevHeightError));
+				acceptReading = (params.maxTaps < 2 || UpdateTapStatistics(params.maxStdDev));		// this sets g30zHeightError to the mean of the readings that are not outliers
+				maxTaps = min<size_t>(maxTaps, MaxStatisticalZProbeTaps);
+			}
+			else
+			{
+				if (tapsDone >= 2)
+				{
+					g30zHeightErrorLowestDiff = min<float>(g30zHeightErrorLowestDiff, fabsf(g30zHeightError - g30PrevHeightError));
+				}
+				acceptReading = (hadProbingError || params.maxTaps < 2 || (tapsDone >= 2 && g30zHeightErrorLowestDiff <= params.tolerance));
 			}
-			const bool acceptReading = (hadProbingError || params.maxTaps < 2 || (tapsDone >= 2 && g30zHeightErrorLowestDiff <= params.tolerance));
-			if (!acceptReading && tapsDone < params.maxTaps)
+			if (!acceptReading && tapsDone < maxTaps)
 			{
 				// Tap again
 				g30PrevHeightError = g30zHeightError;
@@ -1215,7 +1535,7 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 			{
 				if (acceptReading)
 				{
-					if (tapsDone >= 2)
+					if (tapsDone >= 2 && !statistical)
 					{
 						g30zHeightError = (g30zHeightError + g30PrevHeightError)/2;		// take the average of the two readings
 					}
@@ -1224,7 +1544,10 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 				{
 					// We no longer flag this as a probing error, instead we take the average and issue a warning
 					platform.Message(WarningMessage, "Z probe readings not consistent\n");
-					g30zHeightError = g30zHeightErrorSum/tapsDone;
+					if (!statistical)
+					{
+						g30zHeightError = g30zHeightErrorSum/tapsDone;
+					}
 				}
 
 				if (g30ProbePointIndex >= 0)
@@ -1262,7 +1585,7 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 			}
 			else if (g30SValue >= -1)
 			{
-				error = reprap.GetMove().FinishedBedProbing(g30SValue, reply);
+				error = FinishedProbePoint(reply);
 			}
 			gb.SetState(GCodeState::normal);
 		}
@@ -1292,6 +1615,34 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 		gb.SetState(GCodeState::normal);
 		break;
 
+	case GCodeState::levelling:
+		// Here when bed.g has finished during an iterative G32
+		if (LockMovementAndWaitForStandstill(gb))
+		{
+			const Move& move = reprap.GetMove();
+			gb.SetState(GCodeState::normal);
+			if (move.GetNumCalibrationsDone() == levellingCalibrationsDone)
+			{
+				reply.copy("Levelling stopped because bed.g did not calibrate");
+				error = true;
+			}
+			else if (move.GetLastCalibrationDeviation() <= levellingTolerance)
+			{
+				reply.printf("Levelling converged after %u runs, deviation %.3fmm", levellingRunsDone, (double)move.GetLastCalibrationDeviation());
+			}
+			else if (levellingRunsLeft == 0)
+			{
+				reply.printf("Levelling did not converge after %u runs, deviation %.3fmm", levellingRunsDone, (double)move.GetLastCalibrationDeviation());
+				error = true;
+			}
+			else
+			{
+				UnlockAll(gb);
+				StartLevellingRun(gb);
+			}
+		}
+		break;
+
 	// Firmware retraction/un-retraction states
 	case GCodeState::doingFirmwareRetraction:
 		// We just did the retraction part of a firmware retraction, now we need to do the Z hop
@@ -1344,6 +1695,23 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 		}
 		break;
 
+	case GCodeState::blendingTravel:
+		// We just did the part of a travel move during which we retracted, now do the rest of it except for the part during which we may un-retract
+		if (segmentsLeft == 0)
+		{
+			memcpy(moveBuffer.initialCoords, moveBuffer.coords, numVisibleAxes * sizeof(moveBuffer.initialCoords[0]));
+			memcpy(moveBuffer.coords, blendedTravelTailStart, numVisibleAxes * sizeof(moveBuffer.coords[0]));
+			for (size_t i = numTotalAxes; i < DRIVES; ++i)
+			{
+				moveBuffer.coords[i] = 0.0;
+			}
+			moveBuffer.canPauseAfter = true;
+			NewMoveAvailable(1);
+			travelTailPending = true;
+			gb.SetState(GCodeState::normal);
+		}
+		break;
+
 	case GCodeState::loadingFilament:
 		// We just returned from the filament load macro
 		if (reprap.GetCurrentTool() != nullptr)
@@ -1376,7 +1744,7 @@ void GCodes::RunStateMachine(GCodeBuffer& gb, const StringRef& reply)
 		{
 			gb.SetFinished(ActOnCode(gb, reply));							// execute the pause script
 		}
-		else
+		else if (reprap.GetMove().AllMovesAreFinished())					// don't use the SD card until the motors have stopped, so that they get the remaining power
 		{
 			SaveResumeInfo(true);											// create the resume file so that we can resume after power down
 			platform.Message(LoggedGenericMessage, "Print auto-paused due to low voltage\n");
@@ -1417,7 +1785,16 @@ void GCodes::StartNextGCode(GCodeBuffer& gb, const StringRef& reply)
 	}
 	else if (gb.IsReady() || gb.IsExecuting())
 	{
-		gb.SetFinished(ActOnCode(gb, reply));
+		if (parseBenchmarking && &gb == fileGCode)
+		{
+			const uint32_t startCycles = StageTimer::GetCycles();
+			gb.SetFinished(ActOnCode(gb, reply));
+			executeTimer.Record(StageTimer::GetCycles() - startCycles);
+		}
+		else
+		{
+			gb.SetFinished(ActOnCode(gb, reply));
+		}
 	}
 	else if (gb.MachineState().fileState.IsLive())
 	{
@@ -1466,6 +1843,25 @@ void GCodes::DoFilePrint(GCodeBuffer& gb, const StringRef& reply)
 {
 	FileData& fd = gb.MachineState().fileState;
 
+	if (parseBenchmarking && &gb == fileGCode)
+	{
+		// Time the file reading and parsing separately. Executing the code is timed when we get here next time, in StartNextGCode.
+		uint32_t startCycles = StageTimer::GetCycles();
+		const GCodeInputReadResult readResult = fileInput->ReadFromFile(fd);
+		fileReadTimer.Record(StageTimer::GetCycles() - startCycles);
+		if (readResult == GCodeInputReadResult::haveData)
+		{
+			startCycles = StageTimer::GetCycles();
+			const bool haveLine = fileInput->FillBuffer(&gb);
+			parseTimer.Record(StageTimer::GetCycles() - startCycles);
+			if (haveLine)
+			{
+				++parseBenchmarkLines;
+			}
+			return;
+		}
+	}
+
 	// Do we have more data to process?
 	switch (fileInput->ReadFromFile(fd))
 	{
@@ -1481,6 +1877,10 @@ void GCodes::DoFilePrint(GCodeBuffer& gb, const StringRef& reply)
 		}
 		break;
 
+	case GCodeInputReadResult::pending:
+		// We are waiting for the next block of the file to be read
+		break;
+
 	case GCodeInputReadResult::error:
 		AbortPrint(gb);
 		break;
@@ -1518,6 +1918,13 @@ void GCodes::DoFilePrint(GCodeBuffer& gb, const StringRef& reply)
 			{
 				CopyConfigFinalValues(gb);
 				runningConfigFile = false;
+#if SUPPORT_COMPILED_CONFIG
+				if (compileConfigFile && !configFileHadError)
+				{
+					CompileConfigFile();
+				}
+				compileConfigFile = false;
+#endif
 			}
 			Pop(gb);
 			gb.Init();
@@ -1536,6 +1943,24 @@ void GCodes::DoFilePrint(GCodeBuffer& gb, const StringRef& reply)
 	}
 }
 
+// Report the G-code processing speed at the end of a parse benchmark. Call this before leaving simulation mode.
+void GCodes::ReportParseBenchmark(MessageType mtype) const
+{
+	if (parseBenchmarking)
+	{
+		const float elapsedSeconds = (float)(millis() - parseBenchmarkStartMillis) * 0.001;
+		const float cyclesToMicrosecondsPerLine = (parseBenchmarkLines == 0) ? 0.0 : 1000000.0/((float)VARIANT_MCK * parseBenchmarkLines);
+		platform.MessageF(mtype, "Parse benchmark: %" PRIu32 " lines in %.1f sec (%.0f lines/sec), per line: read %.1fus, parse %.1fus, execute %.1fus\n",
+							parseBenchmarkLines, (double)elapsedSeconds, (double)((elapsedSeconds > 0.0) ? parseBenchmarkLines/elapsedSeconds : 0.0),
+							(double)(fileReadTimer.GetTotalCycles() * cyclesToMicrosecondsPerLine),
+							(double)(parseTimer.GetTotalCycles() * cyclesToMicrosecondsPerLine),
+							(double)(executeTimer.GetTotalCycles() * cyclesToMicrosecondsPerLine));
+		fileReadTimer.Diagnostics(mtype);
+		parseTimer.Diagnostics(mtype);
+		executeTimer.Diagnostics(mtype);
+	}
+}
+
 // Restore positions etc. when exiting simulation mode
 void GCodes::EndSimulation(GCodeBuffer *gb)
 {
@@ -1641,6 +2066,7 @@ void GCodes::DoEmergencyStop()
 // Pause the print. Before calling this, check that we are doing a file print that isn't already paused and get the movement lock.
 void GCodes::DoPause(GCodeBuffer& gb, PauseReason reason, const char *msg)
 {
+	CancelBlendedRetraction();
 	if (&gb == fileGCode)
 	{
 		// Pausing a file print because of a command in the file itself
@@ -1859,10 +2285,13 @@ bool GCodes::LowVoltagePause()
 	}
 
 	reprap.GetHeat().SuspendHeaters(true);			// turn the heaters off to conserve power for the motors to execute the pause
+
+	// The tick ISR may have stopped the current move already. If we are not going to do an emergency pause, let it finish.
 	if (IsResuming())
 	{
 		// This is an unlucky situation, because the resume macro is probably being run, which will probably lower the head back on to the print.
 		// It may well be that the power loss will prevent the resume macro being completed. If not, try again when the print has been resumed.
+		reprap.GetMove().PowerFailUnfreeze();
 		return false;
 	}
 
@@ -1870,12 +2299,14 @@ bool GCodes::LowVoltagePause()
 	{
 		// We are in the process of pausing already, so the resume info has already been saved.
 		// With luck the retraction and lifting of the head in the pause.g file has been done already.
+		reprap.GetMove().PowerFailUnfreeze();
 		return true;
 	}
 
 	if (IsPaused())
 	{
 		// Resume info has already been saved, and resuming will be prevented while the power is low
+		reprap.GetMove().PowerFailUnfreeze();
 		return true;
 	}
 
@@ -1896,6 +2327,10 @@ bool GCodes::LowVoltagePause()
 
 		// Don't do any more here, we want the auto pause thread to run as soon as possible
 	}
+	else
+	{
+		reprap.GetMove().PowerFailUnfreeze();
+	}
 
 	return true;
 }
@@ -1967,134 +2402,243 @@ void GCodes::SaveResumeInfo(bool wasPowerFailure)
 	const char* const printingFilename = reprap.GetPrintMonitor().GetPrintingFilename();
 	if (printingFilename != nullptr)
 	{
-		FileStore * const f = platform.OpenFile(platform.GetSysDir(), RESUME_AFTER_POWER_FAIL_G, OpenMode::write);
-		if (f == nullptr)
-		{
-			platform.MessageF(ErrorMessage, "Failed to create file %s", RESUME_AFTER_POWER_FAIL_G);
-		}
-		else
+		ResumeState rs;
+		CaptureResumeState(rs, wasPowerFailure, printingFilename);
+#if SUPPORT_RESUME_CHECKPOINT
+		if (resumeCheckpoint->IsOpen())
 		{
-			String<200> bufferSpace;
-			const StringRef buf = bufferSpace.GetRef();
-
-			// Write the header comment
-			buf.printf("; File \"%s\" resume print after %s", printingFilename, (wasPowerFailure) ? "power failure" : "print paused");
-			if (platform.IsDateTimeSet())
-			{
-				time_t timeNow = platform.GetDateTime();
-				const struct tm * const timeInfo = gmtime(&timeNow);
-				buf.catf(" at %04u-%02u-%02u %02u:%02u",
-								timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday, timeInfo->tm_hour, timeInfo->tm_min);
-			}
-			buf.cat('\n');
-			bool ok = f->Write(buf.c_str())
-					&& reprap.GetHeat().WriteBedAndChamberTempSettings(f)	// turn on bed and chamber heaters
-					&& reprap.WriteToolSettings(f)							// set tool temperatures, tool mix ratios etc.
-					&& reprap.GetMove().WriteResumeSettings(f);				// load grid, if we are using one
-			if (ok)
-			{
-				// Write a G92 command to say where the head is. This is useful if we can't Z-home the printer with a print on the bed and the Z steps/mm is high.
-				buf.copy("G92");
-				for (size_t axis = 0; axis < numVisibleAxes; ++axis)
-				{
-					buf.catf(" %c%.3f", axisLetters[axis], (double)pauseRestorePoint.moveCoords[axis]);
-				}
-				buf.cat('\n');
-				ok = f->Write(buf.c_str());
-			}
-			if (ok)
-			{
-				buf.printf("M98 P%s\n", RESUME_PROLOGUE_G);					// call the prologue - must contain at least M116
-				ok = f->Write(buf.c_str())
-					&& platform.WriteFanSettings(f);						// set the speeds of non-thermostatic fans
-			}
-			if (ok)
-			{
-				buf.printf("M106 S%.2f\n", (double)lastDefaultFanSpeed);
-				ok = f->Write(buf.c_str());
-			}
-			if (ok)
-			{
-				buf.printf("M116\nM290 S%.3f\n", (double)currentBabyStepZOffset);
-				ok = f->Write(buf.c_str());								// write baby stepping offset
-			}
-			if (ok && fileGCode->OriginalMachineState().volumetricExtrusion)
+			if (wasPowerFailure)
 			{
-				buf.copy("M200 ");
-				char c = 'D';
-				for (size_t i = 0; i < numExtruders; ++i)
+				// The settings are already in the checkpoint, so saving the state takes just one sector write. We generate resurrect.g when we next start up.
+				if (resumeCheckpoint->SaveState(rs))
 				{
-					buf.catf("%c%.03f", c, (double)volumetricExtrusionFactors[i]);
-					c = ':';
+					platform.Message(LoggedGenericMessage, "Resume-after-power-fail state saved\n");
+					return;
 				}
-				buf.cat('\n');
-				ok = f->Write(buf.c_str());								// write volumetric extrusion factors
-			}
-			if (ok)
-			{
-				buf.printf("G92 E%.5f\n%s\n", (double)virtualExtruderPosition, (fileGCode->OriginalMachineState().drivesRelative) ? "M83" : "M82");
-				ok = f->Write(buf.c_str());								// write virtual extruder position and absolute/relative extrusion flag
 			}
-			if (ok)
+			else
 			{
-				buf.printf("M23 %s\nM26 S%" PRIu32 " P%.3f\n", printingFilename, pauseRestorePoint.filePos, (double)pauseRestorePoint.proportionDone);
-				ok = f->Write(buf.c_str());								// write filename and file position
+				// We are not short of time, so bring the settings up to date in case the power fails while we are paused, then write resurrect.g as usual
+				UpdateResumeCheckpoint();
 			}
-			if (ok)
-			{
-				// Build the commands to restore the head position. These assume that we are working in mm.
-				// Start with a vertical move to 2mm above the final Z position
-				buf.printf("G0 F6000 Z%.3f\n", (double)(pauseRestorePoint.moveCoords[Z_AXIS] + 2.0));
+		}
+#endif
+		(void)WriteResumeFile(rs, false);
+	}
+}
 
-				// Now set all the other axes
-				buf.cat("G0 F6000");
-				for (size_t axis = 0; axis < numVisibleAxes; ++axis)
-				{
-					if (axis != Z_AXIS)
-					{
-						buf.catf(" %c%.3f", axisLetters[axis], (double)pauseRestorePoint.moveCoords[axis]);
-					}
-				}
+void GCodes::CaptureResumeState(ResumeState& rs, bool wasPowerFailure, const char *printingFilename) const
+{
+	SafeStrncpy(rs.fileName, printingFilename, ARRAY_SIZE(rs.fileName));
+	rs.saveTime = (platform.IsDateTimeSet()) ? platform.GetDateTime() : 0;
+	rs.filePos = pauseRestorePoint.filePos;
+	rs.proportionDone = pauseRestorePoint.proportionDone;
+	for (size_t axis = 0; axis < MaxAxes; ++axis)
+	{
+		rs.moveCoords[axis] = pauseRestorePoint.moveCoords[axis];
+	}
+	rs.feedRate = pauseRestorePoint.feedRate;
+	rs.virtualExtruderPosition = virtualExtruderPosition;
+	rs.babyStepOffset = currentBabyStepZOffset;
+	rs.defaultFanSpeed = lastDefaultFanSpeed;
+	rs.fansToRestore = 0;
+	for (size_t fan = 0; fan < NUM_FANS; ++fan)
+	{
+		rs.fanSpeeds[fan] = platform.GetFanValue(fan);
+		if (!platform.IsFanThermostatic(fan))
+		{
+			SetBit(rs.fansToRestore, fan);
+		}
+	}
+	for (size_t i = 0; i < MaxExtruders; ++i)
+	{
+		rs.volumetricExtrusionFactors[i] = volumetricExtrusionFactors[i];
+	}
+#if SUPPORT_LASER || SUPPORT_IOBITS
+	rs.laserPwmOrIoBits = pauseRestorePoint.laserPwmOrIoBits;
+#endif
+	rs.numAxes = numVisibleAxes;
+	rs.numExtruders = numExtruders;
+	rs.wasPowerFailure = wasPowerFailure;
+	rs.volumetricExtrusion = fileGCode->OriginalMachineState().volumetricExtrusion;
+	rs.drivesRelative = fileGCode->OriginalMachineState().drivesRelative;
+	rs.isLaser = (machineType == MachineType::laser);
+}
+
+bool GCodes::WriteResumeSettings(FileStore *f) const
+{
+	return reprap.GetHeat().WriteBedAndChamberTempSettings(f)	// turn on bed and chamber heaters
+		&& reprap.WriteToolSettings(f)							// set tool temperatures, tool mix ratios etc.
+		&& reprap.GetMove().WriteResumeSettings(f);				// load grid, if we are using one
+}
+
+// Write resurrect.g. If 'settingsFromCheckpoint' is true then we copy the settings from the resume checkpoint, else we write the current settings.
+bool GCodes::WriteResumeFile(const ResumeState& rs, bool settingsFromCheckpoint)
+{
+	FileStore * const f = platform.OpenFile(platform.GetSysDir(), RESUME_AFTER_POWER_FAIL_G, OpenMode::write);
+	if (f == nullptr)
+	{
+		platform.MessageF(ErrorMessage, "Failed to create file %s", RESUME_AFTER_POWER_FAIL_G);
+		return false;
+	}
 
-				// Now move down to the correct Z height
-				buf.catf("\nG0 F6000 Z%.3f\n", (double)pauseRestorePoint.moveCoords[Z_AXIS]);
+	String<200> bufferSpace;
+	const StringRef buf = bufferSpace.GetRef();
 
-				// Set the feed rate
-				buf.catf("G1 F%.1f", (double)(pauseRestorePoint.feedRate * MinutesToSeconds));
+	// Write the header comment
+	buf.printf("; File \"%s\" resume print after %s", rs.fileName, (rs.wasPowerFailure) ? "power failure" : "print paused");
+	if (rs.saveTime != 0)
+	{
+		const struct tm * const timeInfo = gmtime(&rs.saveTime);
+		buf.catf(" at %04u-%02u-%02u %02u:%02u",
+						timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday, timeInfo->tm_hour, timeInfo->tm_min);
+	}
+	buf.cat('\n');
+	bool ok = f->Write(buf.c_str())
+#if SUPPORT_RESUME_CHECKPOINT
+			&& ((settingsFromCheckpoint) ? resumeCheckpoint->CopySettings(f) : WriteResumeSettings(f));
+#else
+			&& WriteResumeSettings(f);
+#endif
+	if (ok)
+	{
+		// Write a G92 command to say where the head is. This is useful if we can't Z-home the printer with a print on the bed and the Z steps/mm is high.
+		buf.copy("G92");
+		for (size_t axis = 0; axis < rs.numAxes; ++axis)
+		{
+			buf.catf(" %c%.3f", axisLetters[axis], (double)rs.moveCoords[axis]);
+		}
+		buf.cat('\n');
+		ok = f->Write(buf.c_str());
+	}
+	if (ok)
+	{
+		buf.printf("M98 P%s\n", RESUME_PROLOGUE_G);					// call the prologue - must contain at least M116
+		ok = f->Write(buf.c_str());
+	}
+	for (size_t fan = 0; ok && fan < NUM_FANS; ++fan)
+	{
+		if (IsBitSet(rs.fansToRestore, fan))
+		{
+			buf.printf("M106 P%u S%.2f\n", fan, (double)rs.fanSpeeds[fan]);
+			ok = f->Write(buf.c_str());								// set the speeds of non-thermostatic fans
+		}
+	}
+	if (ok)
+	{
+		buf.printf("M106 S%.2f\n", (double)rs.defaultFanSpeed);
+		ok = f->Write(buf.c_str());
+	}
+	if (ok)
+	{
+		buf.printf("M116\nM290 S%.3f\n", (double)rs.babyStepOffset);
+		ok = f->Write(buf.c_str());								// write baby stepping offset
+	}
+	if (ok && rs.volumetricExtrusion)
+	{
+		buf.copy("M200 ");
+		char c = 'D';
+		for (size_t i = 0; i < rs.numExtruders; ++i)
+		{
+			buf.catf("%c%.03f", c, (double)rs.volumetricExtrusionFactors[i]);
+			c = ':';
+		}
+		buf.cat('\n');
+		ok = f->Write(buf.c_str());								// write volumetric extrusion factors
+	}
+	if (ok)
+	{
+		buf.printf("G92 E%.5f\n%s\n", (double)rs.virtualExtruderPosition, (rs.drivesRelative) ? "M83" : "M82");
+		ok = f->Write(buf.c_str());								// write virtual extruder position and absolute/relative extrusion flag
+	}
+	if (ok)
+	{
+		buf.printf("M23 %s\nM26 S%" PRIu32 " P%.3f\n", rs.fileName, rs.filePos, (double)rs.proportionDone);
+		ok = f->Write(buf.c_str());								// write filename and file position
+	}
+	if (ok)
+	{
+		// Build the commands to restore the head position. These assume that we are working in mm.
+		// Start with a vertical move to 2mm above the final Z position
+		buf.printf("G0 F6000 Z%.3f\n", (double)(rs.moveCoords[Z_AXIS] + 2.0));
+
+		// Now set all the other axes
+		buf.cat("G0 F6000");
+		for (size_t axis = 0; axis < rs.numAxes; ++axis)
+		{
+			if (axis != Z_AXIS)
+			{
+				buf.catf(" %c%.3f", axisLetters[axis], (double)rs.moveCoords[axis]);
+			}
+		}
+
+		// Now move down to the correct Z height
+		buf.catf("\nG0 F6000 Z%.3f\n", (double)rs.moveCoords[Z_AXIS]);
+
+		// Set the feed rate
+		buf.catf("G1 F%.1f", (double)(rs.feedRate * MinutesToSeconds));
 #if SUPPORT_LASER
-				if (machineType == MachineType::laser)
-				{
-					buf.catf(" S%u", (unsigned int)pauseRestorePoint.laserPwmOrIoBits.laserPwm);
-				}
-				else
-				{
+		if (rs.isLaser)
+		{
+			buf.catf(" S%u", (unsigned int)rs.laserPwmOrIoBits.laserPwm);
+		}
+		else
+		{
 #endif
 #if SUPPORT_IOBITS
-					buf.catf(" P%u", (unsigned int)pauseRestorePoint.laserPwmOrIoBits.ioBits);
+			buf.catf(" P%u", (unsigned int)rs.laserPwmOrIoBits.ioBits);
 #endif
 #if SUPPORT_LASER
-				}
+		}
 #endif
-				buf.cat("\nM24\n");
-				ok = f->Write(buf.c_str());								// restore feed rate and output bits
-			}
-			if (!f->Close())
-			{
-				ok = false;
-			}
-			if (ok)
-			{
-				platform.Message(LoggedGenericMessage, "Resume-after-power-fail state saved\n");
-			}
-			else
-			{
-				platform.GetMassStorage()->Delete(platform.GetSysDir(), RESUME_AFTER_POWER_FAIL_G, true);
-				platform.MessageF(ErrorMessage, "Failed to write or close file %s\n", RESUME_AFTER_POWER_FAIL_G);
-			}
+		buf.cat("\nM24\n");
+		ok = f->Write(buf.c_str());								// restore feed rate and output bits
+	}
+	if (!f->Close())
+	{
+		ok = false;
+	}
+	if (ok)
+	{
+		platform.Message(LoggedGenericMessage, "Resume-after-power-fail state saved\n");
+	}
+	else
+	{
+		platform.GetMassStorage()->Delete(platform.GetSysDir(), RESUME_AFTER_POWER_FAIL_G, true);
+		platform.MessageF(ErrorMessage, "Failed to write or close file %s\n", RESUME_AFTER_POWER_FAIL_G);
+	}
+	return ok;
+}
+
+#if SUPPORT_RESUME_CHECKPOINT
+
+void GCodes::UpdateResumeCheckpoint()
+{
+	FileStore * const f = resumeCheckpoint->BeginSettings();
+	if (f != nullptr)
+	{
+		(void)resumeCheckpoint->EndSettings(WriteResumeSettings(f));
+	}
+}
+
+void GCodes::RecoverResumeCheckpoint()
+{
+	ResumeState rs;
+	if (resumeCheckpoint->Recover(rs))
+	{
+		if (WriteResumeFile(rs, true))
+		{
+			resumeCheckpoint->Recovered();
+		}
+		else
+		{
+			resumeCheckpoint->Close(false);						// keep the state so that we can try again when we next start up
 		}
 	}
 }
 
+#endif
+
 void GCodes::Diagnostics(MessageType mtype)
 {
 	platform.Message(mtype, "=== GCodes ===\n");
@@ -2112,6 +2656,9 @@ void GCodes::Diagnostics(MessageType mtype)
 	}
 
 	codeQueue->Diagnostics(mtype);
+#if SUPPORT_TOOL_PREHEAT
+	toolPreheater->Diagnostics(mtype);
+#endif
 }
 
 // Lock movement and wait for pending moves to finish.
@@ -2193,6 +2740,7 @@ bool GCodes::LoadExtrusionAndFeedrateFromGCode(GCodeBuffer& gb)
 		moveBuffer.coords[drive] = 0.0;
 	}
 	moveBuffer.hasExtrusion = false;
+	moveBuffer.maxExtrusionRate = 0.0;
 	moveBuffer.virtualExtruderPosition = virtualExtruderPosition;	// save this before we update it
 
 	// Check if we are extruding
@@ -2207,6 +2755,7 @@ bool GCodes::LoadExtrusionAndFeedrateFromGCode(GCodeBuffer& gb)
 		}
 
 		moveBuffer.hasExtrusion = true;
+		moveBuffer.maxExtrusionRate = tool->GetMaxExtrusionRate();
 		const size_t eMoveCount = tool->DriveCount();
 		if (eMoveCount != 0)
 		{
@@ -2245,7 +2794,7 @@ bool GCodes::LoadExtrusionAndFeedrateFromGCode(GCodeBuffer& gb)
 						{
 							rawExtruderTotal += extrusionAmount;
 						}
-						moveBuffer.coords[drive + numTotalAxes] = extrusionAmount * extrusionFactors[drive];
+						moveBuffer.coords[drive + numTotalAxes] = extrusionAmount * extrusionFactors[drive] * FilamentMonitor::GetExtrusionCompensation(drive);
 #if HAS_SMART_DRIVERS
 						if (moveBuffer.moveType == 1)
 						{
@@ -2275,7 +2824,7 @@ bool GCodes::LoadExtrusionAndFeedrateFromGCode(GCodeBuffer& gb)
 							{
 								rawExtruderTotal += extrusionAmount;
 							}
-							moveBuffer.coords[drive + numTotalAxes] = extrusionAmount * extrusionFactors[drive] * volumetricExtrusionFactors[drive];
+							moveBuffer.coords[drive + numTotalAxes] = extrusionAmount * extrusionFactors[drive] * volumetricExtrusionFactors[drive] * FilamentMonitor::GetExtrusionCompensation(drive);
 #if HAS_SMART_DRIVERS
 							if (moveBuffer.moveType == 1)
 							{
@@ -2438,6 +2987,76 @@ const char* GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 		// So we no longer do that, and the user must mention any axes that he wants restored e.g. G1 R2 X0 Y0.
 	}
 
+	return CompleteStraightMove(gb, axesMentioned, initialX, initialY);
+}
+
+// Execute a G0 or G1 command that has no parameters other than X, Y, Z, E and F, which is what slicers generate for nearly all moves.
+// This is the same as DoStraightMove with no H, S, R or P parameter, without the checks for them.
+const char* GCodes::DoPlainStraightMove(GCodeBuffer& gb, bool isCoordinated)
+{
+	moveBuffer.isCoordinated = isCoordinated;
+	moveBuffer.endStopsToCheck = 0;
+	moveBuffer.moveType = 0;
+	moveBuffer.xAxes = reprap.GetCurrentXAxes();
+	moveBuffer.yAxes = reprap.GetCurrentYAxes();
+	moveBuffer.usePressureAdvance = false;
+	axesToSenseLength = 0;
+#if SUPPORT_LASER
+	if (machineType == MachineType::laser)
+	{
+		moveBuffer.laserPwmOrIoBits.laserPwm = 0;
+	}
+#endif
+
+	memcpy(moveBuffer.initialCoords, moveBuffer.coords, numVisibleAxes * sizeof(moveBuffer.initialCoords[0]));
+
+	const float initialX = currentUserPosition[X_AXIS];
+	const float initialY = currentUserPosition[Y_AXIS];
+	AxesBitmap axesMentioned = 0;
+	for (size_t axis = 0; axis < XYZ_AXES; axis++)
+	{
+		if (gb.Seen(axisLetters[axis]))
+		{
+			SetBit(axesMentioned, axis);
+			const float moveArg = gb.GetFValue() * distanceScale;
+			if (gb.MachineState().axesRelative)
+			{
+				currentUserPosition[axis] += moveArg;
+			}
+#if SUPPORT_WORKPLACE_COORDINATES
+			else if (gb.MachineState().useMachineCoordinates || gb.MachineState().useMachineCoordinatesSticky)
+			{
+				currentUserPosition[axis] = moveArg - workplaceCoordinates[currentCoordinateSystem][axis];
+			}
+#endif
+			else
+			{
+				currentUserPosition[axis] = moveArg;
+			}
+		}
+	}
+
+	return CompleteStraightMove(gb, axesMentioned, initialX, initialY);
+}
+
+// Finish setting up a straight move after the axis parameters have been processed
+const char* GCodes::CompleteStraightMove(GCodeBuffer& gb, AxesBitmap axesMentioned, float initialX, float initialY)
+{
+	// Keep the positions of continuous rotation axes between 0 and 360 degrees. The DDA moves them the shortest way to the new position.
+	if (moveBuffer.moveType == 0)
+	{
+		for (AxesBitmap rotationAxes = axesMentioned & continuousRotationAxes; rotationAxes != 0; rotationAxes &= rotationAxes - 1)
+		{
+			const size_t axis = __builtin_ctz(rotationAxes);
+			float angle = fmodf(currentUserPosition[axis], 360.0);
+			if (angle < 0.0)
+			{
+				angle += 360.0;
+			}
+			currentUserPosition[axis] = angle;
+		}
+	}
+
 	// Check enough axes have been homed
 	if (moveBuffer.moveType == 0)
 	{
@@ -2463,6 +3082,7 @@ const char* GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 
 	// Set up the move. We must assign segmentsLeft last, so that when Move runs as a separate task the move won't be picked up by the Move process before it is complete.
 	// Note that if this is an extruder-only move, we don't do axis movements to allow for tool offset changes, we defer those until an axis moves.
+	doingMeshMove = false;
 	if (moveBuffer.moveType != 0)
 	{
 		// It's a raw motor move, so do it in a single segment and wait for it to complete
@@ -2502,18 +3122,31 @@ const char* GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 		// Apply segmentation if necessary. To speed up simulation on SCARA printers, we don't apply kinematics segmentation when simulating.
 		// Note for when we use RTOS: as soon as we set segmentsLeft nonzero, the Move process will assume that the move is ready to take, so this must be the last thing we do.
 		const Kinematics& kin = reprap.GetMove().GetKinematics();
-		if (kin.UseSegmentation() && simulationMode != 1 && (moveBuffer.hasExtrusion || isCoordinated || !kin.UseRawG0()))
+		if (kin.UseSegmentation() && simulationMode != 1 && (moveBuffer.hasExtrusion || moveBuffer.isCoordinated || !kin.UseRawG0()))
 		{
 			// This kinematics approximates linear motion by means of segmentation.
 			// We assume that the segments will be smaller than the mesh spacing.
 			const float xyLength = sqrtf(fsquare(currentUserPosition[X_AXIS] - initialX) + fsquare(currentUserPosition[Y_AXIS] - initialY));
 			const float moveTime = xyLength/moveBuffer.feedRate;			// this is a best-case time, often the move will take longer
-			totalSegments = (unsigned int)max<int>(1, min<int>(rintf(xyLength/kin.GetMinSegmentLength()), rintf(moveTime * kin.GetSegmentsPerSecond())));
+			const unsigned int maxSegments = (unsigned int)max<int>(1, min<int>(rintf(xyLength/kin.GetMinSegmentLength()), rintf(moveTime * kin.GetSegmentsPerSecond())));
+			totalSegments = kin.GetAdaptiveSegments(moveBuffer.initialCoords, moveBuffer.coords, numVisibleAxes, numVisibleAxes, maxSegments);
 		}
 		else if (reprap.GetMove().IsUsingMesh())
 		{
+			// If possible, end the segments where the move crosses mesh cell boundaries, so that the Z correction is exact at each segment end
 			const HeightMap& heightMap = reprap.GetMove().AccessHeightMap();
-			totalSegments = max<unsigned int>(1, heightMap.GetMinimumSegments(currentUserPosition[X_AXIS] - initialX, currentUserPosition[Y_AXIS] - initialY));
+			size_t numCrossings;
+			if (heightMap.GetCellBoundaryCrossings(moveBuffer.initialCoords[X_AXIS], moveBuffer.initialCoords[Y_AXIS], moveBuffer.coords[X_AXIS], moveBuffer.coords[Y_AXIS],
+													meshSegmentEnds, MaxMeshCellCrossings, numCrossings))
+			{
+				meshSegmentEnds[numCrossings] = 1.0;
+				totalSegments = numCrossings + 1;
+				doingMeshMove = (numCrossings != 0);
+			}
+			else
+			{
+				totalSegments = max<unsigned int>(1, heightMap.GetMinimumSegments(currentUserPosition[X_AXIS] - initialX, currentUserPosition[Y_AXIS] - initialY));
+			}
 		}
 		else
 		{
@@ -2521,7 +3154,41 @@ const char* GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 		}
 	}
 
+#if SUPPORT_LASER_RASTER
+	// A raster move carries its per-pixel laser power in the D parameter. We don't segment raster moves, because the pixels are spread over the whole move.
+	// HandleGcode has already waited for a free raster buffer.
+	if (machineType == MachineType::laser && moveBuffer.moveType == 0 && moveBuffer.isCoordinated && gb.Seen('D'))
+	{
+		String<GCODE_LENGTH> encoded;
+		if (!gb.GetQuotedString(encoded.GetRef()))
+		{
+			return "G1: expected quoted raster data after D";
+		}
+		LaserRaster * const raster = LaserRaster::Allocate();
+		if (raster == nullptr)
+		{
+			return "G1: no raster buffer available";
+		}
+		if (raster->SetPixels(encoded.c_str()))
+		{
+			LaserRaster::Release(raster);
+			return "G1: bad raster data";
+		}
+		moveBuffer.laserRaster = raster;
+		totalSegments = 1;
+		doingMeshMove = false;
+	}
+#endif
+
 	doingArcMove = false;
+	if (retractionPending && &gb == fileGCode)
+	{
+		// HandlePendingBlend has checked that this is a plain travel move that we can blend the retraction into
+		if (SetUpBlendedTravel())
+		{
+			gb.SetState(GCodeState::blendingTravel);
+		}
+	}
 	FinaliseMove(gb);
 	UnlockAll(gb);			// allow pause
 	return nullptr;
@@ -2654,12 +3321,14 @@ const char* GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise)
 
 	// Set up the arc centre coordinates and record which axes behave like an X axis.
 	// The I and J parameters are always relative to present position.
-	// For X and Y we need to set up the arc centre for each axis that X or Y is mapped to.
+	// For X and Y we need to set up the arc centre for each axis that X or Y is mapped to. A mirrored X axis goes round the arc the other way.
+	const Tool * const currentTool = reprap.GetCurrentTool();
+	arcMirroredAxes = (currentTool == nullptr) ? 0 : currentTool->GetMirroredXAxes();
 	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
 	{
 		if (IsBitSet(moveBuffer.xAxes, axis))
 		{
-			arcCentre[axis] = moveBuffer.initialCoords[axis] + iParam;
+			arcCentre[axis] = (IsBitSet(arcMirroredAxes, axis)) ? moveBuffer.initialCoords[axis] - iParam : moveBuffer.initialCoords[axis] + iParam;
 		}
 		else if (IsBitSet(moveBuffer.yAxes, axis))
 		{
@@ -2681,8 +3350,25 @@ const char* GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise)
 		totalArc += TwoPi;
 	}
 
-	// Compute how many segments we need to move, but don't store it yet
-	totalSegments = max<unsigned int>((unsigned int)((arcRadius * totalArc)/arcSegmentLength + 0.8), 1u);
+	// Limit the speed so that the centripetal acceleration doesn't exceed the acceleration limits.
+	// The lookahead only sees the junctions between the segments, so it can't do this for us.
+	{
+		const Move& move = reprap.GetMove();
+		const float maxAcceleration = min<float>(min<float>(platform.Accelerations()[X_AXIS], platform.Accelerations()[Y_AXIS]),
+													(moveBuffer.hasExtrusion) ? move.GetMaxPrintingAcceleration() : move.GetMaxTravelAcceleration());
+		const float maxArcSpeed = max<float>(sqrtf(maxAcceleration * arcRadius), MinimumMovementSpeed);
+		if (moveBuffer.feedRate > maxArcSpeed)
+		{
+			moveBuffer.feedRate = maxArcSpeed;
+		}
+	}
+
+	// Compute how many segments we need to move, but don't store it yet.
+	// Use the longest segments that keep within the arc tolerance, but don't make them shorter than the minimum segment length.
+	// A chord of length L deviates from an arc of radius R by R - sqrt(R^2 - L^2/4), so L = 2 * sqrt(2 * R * tolerance - tolerance^2).
+	const float toleranceSegmentLength = (arcRadius > arcTolerance) ? 2.0 * sqrtf((2.0 * arcRadius - arcTolerance) * arcTolerance) : 0.0;
+	const float segmentLength = max<float>(toleranceSegmentLength, arcSegmentLength);
+	totalSegments = max<unsigned int>((unsigned int)((arcRadius * totalArc)/segmentLength + 0.8), 1u);
 	arcAngleIncrement = totalArc/totalSegments;
 	if (clockwise)
 	{
@@ -2690,6 +3376,7 @@ const char* GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise)
 	}
 
 	doingArcMove = true;
+	doingMeshMove = false;
 	FinaliseMove(gb);
 	UnlockAll(gb);			// allow pause
 //	debugPrintf("Radius %.2f, initial angle %.1f, increment %.1f, segments %u\n",
@@ -2742,10 +3429,22 @@ bool GCodes::ReadMove(RawMove& m)
 	}
 
 	m = moveBuffer;
+#if SUPPORT_LASER_RASTER
+	moveBuffer.laserRaster = nullptr;			// the raster goes with the move, and raster moves are never segmented
+#endif
 
 	if (segmentsLeft == 1)
 	{
 		// If there is just 1 segment left, it doesn't matter if it is an arc move or not, just move to the end position
+		if (doingMeshMove)
+		{
+			// The extrusion in moveBuffer is the average per segment, so scale it to the length of this segment
+			const float extrusionFactor = (1.0 - meshSegmentEnds[totalSegments - 2]) * totalSegments;
+			for (size_t drive = numTotalAxes; drive < DRIVES; ++drive)
+			{
+				m.coords[drive] *= extrusionFactor;
+			}
+		}
 		if (segmentsLeftToStartAt == 1 && firstSegmentFractionToSkip != 0.0)	// if this is the segment we are starting at and we need to skip some of it
 		{
 			// Reduce the extrusion by the amount to be skipped
@@ -2770,6 +3469,13 @@ bool GCodes::ReadMove(RawMove& m)
 			arcCurrentAngle += arcAngleIncrement;
 		}
 
+		// If we are splitting the move at mesh cell boundaries, find how much of the remaining movement this segment does
+		const size_t segmentNumber = totalSegments - segmentsLeft;
+		const float segmentStartFraction = (doingMeshMove && segmentNumber != 0) ? meshSegmentEnds[segmentNumber - 1] : 0.0;
+		const float fractionOfRemainder = (doingMeshMove)
+											? (meshSegmentEnds[segmentNumber] - segmentStartFraction)/(1.0 - segmentStartFraction)
+											: 1.0/segmentsLeft;
+
 		for (size_t drive = 0; drive < numVisibleAxes; ++drive)
 		{
 			if (doingArcMove && drive != Z_AXIS && IsBitSet(moveBuffer.yAxes, drive))
@@ -2780,11 +3486,12 @@ bool GCodes::ReadMove(RawMove& m)
 			else if (doingArcMove && drive != Z_AXIS && IsBitSet(moveBuffer.xAxes, drive))
 			{
 				// X axis or a substitute X axis
-				moveBuffer.initialCoords[drive] = arcCentre[drive] + arcRadius * cosf(arcCurrentAngle);
+				const float xOffset = arcRadius * cosf(arcCurrentAngle);
+				moveBuffer.initialCoords[drive] = (IsBitSet(arcMirroredAxes, drive)) ? arcCentre[drive] - xOffset : arcCentre[drive] + xOffset;
 			}
 			else
 			{
-				const float movementToDo = (moveBuffer.coords[drive] - moveBuffer.initialCoords[drive])/segmentsLeft;
+				const float movementToDo = (moveBuffer.coords[drive] - moveBuffer.initialCoords[drive]) * fractionOfRemainder;
 				moveBuffer.initialCoords[drive] += movementToDo;
 			}
 			m.coords[drive] = moveBuffer.initialCoords[drive];
@@ -2794,6 +3501,7 @@ bool GCodes::ReadMove(RawMove& m)
 		{
 			// We are resuming a print part way through a move and we printed this segment already
 			--segmentsLeft;
+			codeQueue->MovesDiscarded(1);
 			return false;
 		}
 
@@ -2801,11 +3509,20 @@ bool GCodes::ReadMove(RawMove& m)
 		if (limitAxes && reprap.GetMove().GetKinematics().LimitPosition(m.coords, numVisibleAxes, axesHomed, true))
 		{
 			segMoveState = SegmentedMoveState::aborted;
-			doingArcMove = false;
+			doingArcMove = doingMeshMove = false;
+			codeQueue->MovesDiscarded(segmentsLeft);
 			segmentsLeft = 0;
 			return false;
 		}
 
+		if (doingMeshMove)
+		{
+			const float extrusionFactor = (meshSegmentEnds[segmentNumber] - segmentStartFraction) * totalSegments;
+			for (size_t drive = numTotalAxes; drive < DRIVES; ++drive)
+			{
+				m.coords[drive] *= extrusionFactor;
+			}
+		}
 		if (segmentsLeftToStartAt == segmentsLeft && firstSegmentFractionToSkip != 0.0)	// if this is the segment we are starting at and we need to skip some of it
 		{
 			// Reduce the extrusion by the amount to be skipped
@@ -2816,7 +3533,7 @@ bool GCodes::ReadMove(RawMove& m)
 		}
 		--segmentsLeft;
 
-		m.proportionLeft = (float)segmentsLeft/(float)totalSegments;
+		m.proportionLeft = (doingMeshMove) ? 1.0 - meshSegmentEnds[segmentNumber] : (float)segmentsLeft/(float)totalSegments;
 	}
 
 	return true;
@@ -2826,12 +3543,20 @@ void GCodes::ClearMove()
 {
 	TaskCriticalSectionLocker lock;				// make sure that other tasks sees a consistent memory state
 
+	codeQueue->MovesDiscarded(segmentsLeft);
 	segmentsLeft = 0;
 	segMoveState = SegmentedMoveState::inactive;
-	doingArcMove = false;
+	doingArcMove = doingMeshMove = false;
 	moveBuffer.endStopsToCheck = 0;
 	moveBuffer.moveType = 0;
 	moveBuffer.isFirmwareRetraction = false;
+#if SUPPORT_LASER_RASTER
+	if (moveBuffer.laserRaster != nullptr)
+	{
+		LaserRaster::Release(moveBuffer.laserRaster);
+		moveBuffer.laserRaster = nullptr;
+	}
+#endif
 	moveFractionToSkip = 0.0;
 }
 
@@ -2866,7 +3591,7 @@ void GCodes::EmergencyStop()
 // 0 = running a system macro automatically
 bool GCodes::DoFileMacro(GCodeBuffer& gb, const char* fileName, bool reportMissing, int codeRunning)
 {
-	FileStore * const f = platform.OpenFile(platform.GetSysDir(), fileName, OpenMode::read);
+	FileStore * const f = platform.OpenFile(platform.GetSysDir(), fileName, OpenMode::read, true);
 	if (f == nullptr)
 	{
 		if (reportMissing)
@@ -2960,10 +3685,13 @@ GCodeResult GCodes::DoHome(GCodeBuffer& gb, const StringRef& reply)
 // If X or Y are specified, use those; otherwise use the machine's coordinates.  If no Z is specified use the machine's coordinates.
 // If it is specified and is greater than SILLY_Z_VALUE (i.e. greater than -9999.0) then that value is used.
 // If it's less than SILLY_Z_VALUE the bed is probed and that value is used.
+// If D is specified as well as S, we only calibrate if the points probed so far are expected to calibrate the machine to within that deviation.
+// In that case we skip the rest of the G30 P commands, up to and including the next one that has an S parameter but no D parameter.
 // We already own the movement lock before this is called.
 GCodeResult GCodes::ExecuteG30(GCodeBuffer& gb, const StringRef& reply)
 {
 	g30SValue = (gb.Seen('S')) ? gb.GetIValue() : -3;		// S-3 is equivalent to having no S parameter
+	g30MaxDeviation = (gb.Seen('D')) ? gb.GetFValue() : 0.0;
 	g30ProbePointIndex = -1;
 	bool seenP = false;
 	gb.TryGetIValue('P', g30ProbePointIndex, seenP);
@@ -2974,9 +3702,18 @@ GCodeResult GCodes::ExecuteG30(GCodeBuffer& gb, const StringRef& reply)
 			reply.copy("Z probe point index out of range");
 			return GCodeResult::error;
 		}
+		else if (g30ProbePointIndex != 0 && skippingCalibrationPoints)
+		{
+			// Calibration has already been done using the earlier points in this set
+			if (g30SValue >= -1 && g30MaxDeviation <= 0.0)
+			{
+				skippingCalibrationPoints = false;
+			}
+		}
 		else
 		{
 			// Set the specified probe point index to the specified coordinates
+			skippingCalibrationPoints = false;
 			const float x = (gb.Seen(axisLetters[X_AXIS])) ? gb.GetFValue() : currentUserPosition[X_AXIS];
 			const float y = (gb.Seen(axisLetters[Y_AXIS])) ? gb.GetFValue() : currentUserPosition[Y_AXIS];
 			const float z = (gb.Seen(axisLetters[Z_AXIS])) ? gb.GetFValue() : currentUserPosition[Z_AXIS];
@@ -2988,7 +3725,7 @@ GCodeResult GCodes::ExecuteG30(GCodeBuffer& gb, const StringRef& reply)
 				reprap.GetMove().SetZBedProbePoint((size_t)g30ProbePointIndex, z, false, false);
 				if (g30SValue >= -1)
 				{
-					return GetGCodeResultFromError(reprap.GetMove().FinishedBedProbing(g30SValue, reply));
+					return GetGCodeResultFromError(FinishedProbePoint(reply));
 				}
 			}
 			else
@@ -3016,6 +3753,35 @@ GCodeResult GCodes::ExecuteG30(GCodeBuffer& gb, const StringRef& reply)
 	return GCodeResult::ok;
 }
 
+// Called when a G30 P command with an S parameter has finished setting the height of its probe point. Return true if an error occurred.
+// If the command also had a D parameter, only calibrate if we expect that doing so now would get the deviation down to that value.
+bool GCodes::FinishedProbePoint(const StringRef& reply)
+{
+	if (g30MaxDeviation > 0.0)
+	{
+		float expectedDeviation;
+		if (g30SValue <= 0 || !reprap.GetMove().GetExpectedCalibrationDeviation(g30SValue, expectedDeviation) || expectedDeviation > g30MaxDeviation)
+		{
+			return false;									// carry on probing
+		}
+		skippingCalibrationPoints = true;
+	}
+	return reprap.GetMove().FinishedBedProbing(g30SValue, reply);
+}
+
+// Start a run of bed.g as part of an iterative G32. The state machine checks the result when the macro finishes.
+void GCodes::StartLevellingRun(GCodeBuffer& gb)
+{
+	--levellingRunsLeft;
+	++levellingRunsDone;
+	levellingCalibrationsDone = reprap.GetMove().GetNumCalibrationsDone();
+	gb.SetState(GCodeState::levelling);
+	if (!DoFileMacro(gb, BED_EQUATION_G, true))
+	{
+		gb.SetState(GCodeState::normal);
+	}
+}
+
 // Decide which device to display a message box on
 MessageType GCodes::GetMessageBoxDevice(GCodeBuffer& gb) const
 {
@@ -3059,6 +3825,7 @@ GCodeResult GCodes::ProbeGrid(GCodeBuffer& gb, const StringRef& reply)
 	reprap.GetMove().AccessHeightMap().SetGrid(defaultGrid);
 	ClearBedMapping();
 	gridXindex = gridYindex = 0;
+	fastGridProbing = gb.Seen('Q') && gb.GetIValue() > 0;
 	gb.SetState(GCodeState::gridProbing1);
 
 	if (platform.GetZProbeType() != ZProbeType::none && platform.GetZProbeType() != ZProbeType::blTouch && !probeIsDeployed)
@@ -3196,6 +3963,7 @@ bool GCodes::QueueFileToPrint(const char* fileName, const StringRef& reply)
 	FileStore * const f = platform.OpenFile(platform.GetGCodeDir(), fileName, OpenMode::read);
 	if (f != nullptr)
 	{
+		(void)f->EnableFastSeek();										// so that resuming or restarting part way through a large file doesn't take long
 		fileGCode->SetToolNumberAdjust(0);								// clear tool number adjustment
 		fileGCode->MachineState().volumetricExtrusion = false;			// default to non-volumetric extrusion
 
@@ -3228,6 +3996,13 @@ void GCodes::StartPrinting(bool fromStart)
 	platform.MessageF(LogMessage,
 						(simulationMode == 0) ? "Started printing file %s\n" : "Started simulating printing file %s\n",
 							reprap.GetPrintMonitor().GetPrintingFilename());
+#if SUPPORT_RESUME_CHECKPOINT
+	if (simulationMode == 0 && resumeCheckpoint->Open())
+	{
+		checkpointLayer = reprap.GetPrintMonitor().GetCurrentLayer();
+		UpdateResumeCheckpoint();
+	}
+#endif
 	if (fromStart)
 	{
 		// Get the fileGCode to execute the start macro so that any M82/M83 codes will be executed in the correct context
@@ -3496,6 +4271,22 @@ bool GCodes::ManageTool(GCodeBuffer& gb, const StringRef& reply)
 		return true;
 	}
 
+	// Check for X axes that move in the opposite direction to X, for mirrored printing on IDEX machines
+	AxesBitmap mirrorMap = 0;
+	if (gb.Seen('R'))
+	{
+		uint32_t mirrorMapping[MaxAxes];
+		size_t mirrorCount = numVisibleAxes;
+		gb.GetUnsignedArray(mirrorMapping, mirrorCount, false);
+		mirrorMap = UnsignedArrayToBitMap<AxesBitmap>(mirrorMapping, mirrorCount) & LowestNBits<AxesBitmap>(numVisibleAxes);
+		if ((mirrorMap & ~xMap) != 0)
+		{
+			reply.copy("Mirrored axes must be mapped to X");
+			return true;
+		}
+		seen = true;
+	}
+
 	// Check for fan mapping
 	FansBitmap fanMap;
 	if (gb.Seen('F'))
@@ -3523,7 +4314,7 @@ bool GCodes::ManageTool(GCodeBuffer& gb, const StringRef& reply)
 		}
 		else
 		{
-			Tool* const tool = Tool::Create(toolNumber, name.c_str(), drives, dCount, heaters, hCount, xMap, yMap, fanMap, reply);
+			Tool* const tool = Tool::Create(toolNumber, name.c_str(), drives, dCount, heaters, hCount, xMap, yMap, mirrorMap, fanMap, reply);
 			if (tool == nullptr)
 			{
 				return true;
@@ -3588,6 +4379,23 @@ void GCodes::SetMappedFanSpeed(float f)
 	SetMappedFanSpeed();
 }
 
+// Make any queued fan speed changes that are now due. These are M106 and M107 commands that the code queue holds in binary form.
+void GCodes::DoQueuedFanChanges()
+{
+	GCodeQueue::FanChange fc;
+	while (codeQueue->TakeFanChange(fc))
+	{
+		if (fc.fanNumber < 0)
+		{
+			SetMappedFanSpeed(fc.pwm);
+		}
+		else
+		{
+			platform.SetFanValue(fc.fanNumber, fc.pwm);
+		}
+	}
+}
+
 // Save the speeds of all fans
 void GCodes::SaveFanSpeeds()
 {
@@ -3602,6 +4410,13 @@ void GCodes::SaveFanSpeeds()
 // Note that 'reply' may be empty. If it isn't, then we need to append newline when sending it.
 void GCodes::HandleReply(GCodeBuffer& gb, GCodeResult rslt, const char* reply)
 {
+#if SUPPORT_COMPILED_CONFIG
+	if (runningConfigFile && rslt == GCodeResult::error)
+	{
+		configFileHadError = true;					// don't make a compiled copy of a config file that has errors in it
+	}
+#endif
+
 	// Don't report "ok" responses if a (macro) file is being processed
 	// Also check that this response was triggered by a gcode
 	if ((gb.MachineState().doingFileMacro || &gb == fileGCode) && reply[0] == 0)
@@ -3618,7 +4433,8 @@ void GCodes::HandleReply(GCodeBuffer& gb, GCodeResult rslt, const char* reply)
 
 	const Compatibility c = (&gb == serialGCode || &gb == telnetGCode) ? platform.Emulating() : Compatibility::me;
 	const MessageType type = gb.GetResponseMessageType();
-	const char* const response = (gb.GetCommandLetter() == 'M' && gb.GetCommandNumber() == 998) ? "rs " : "ok";
+	String<ShortScratchStringLength> okResponse;
+	const char* const response = GetOkResponse(gb, okResponse.GetRef());
 	const char* emulationType = nullptr;
 
 	switch (c)
@@ -3676,6 +4492,26 @@ void GCodes::HandleReply(GCodeBuffer& gb, GCodeResult rslt, const char* reply)
 	}
 }
 
+// Get the acknowledgement for a command in Marlin mode. When the USB port is in streaming mode (M575 P0 S4) we append the number of free
+// move slots and the free space in the input buffer, in the same format as Marlin's ADVANCED_OK, so that the host can keep the buffers full.
+const char *GCodes::GetOkResponse(const GCodeBuffer& gb, const StringRef& buf) const
+{
+	if (gb.GetCommandLetter() == 'M' && gb.GetCommandNumber() == 998)
+	{
+		return "rs ";
+	}
+
+#if SUPPORT_USB_STREAMING
+	if (&gb == serialGCode && (platform.GetCommsProperties(0) & 4) != 0)
+	{
+		buf.printf("ok P%u B%u", reprap.GetMove().GetNumberOfFreeMoveSlots(), serialInput->BufferSpaceLeft());
+		return buf.c_str();
+	}
+#endif
+
+	return "ok";
+}
+
 void GCodes::HandleReply(GCodeBuffer& gb, bool error, OutputBuffer *reply)
 {
 	// Although unlikely, it's possible that we get a nullptr reply. Don't proceed if this is the case
@@ -3693,7 +4529,8 @@ void GCodes::HandleReply(GCodeBuffer& gb, bool error, OutputBuffer *reply)
 
 	const Compatibility c = (&gb == serialGCode || &gb == telnetGCode) ? platform.Emulating() : Compatibility::me;
 	const MessageType type = gb.GetResponseMessageType();
-	const char* const response = (gb.GetCommandLetter() == 'M' && gb.GetCommandNumber() == 998) ? "rs " : "ok";
+	String<ShortScratchStringLength> okResponse;
+	const char* const response = GetOkResponse(gb, okResponse.GetRef());
 	const char* emulationType = nullptr;
 
 	switch (c)
@@ -4020,6 +4857,23 @@ GCodeResult GCodes::RetractFilament(GCodeBuffer& gb, bool retract)
 			return GCodeResult::notFinished;
 		}
 
+		if (blendRetraction && &gb == fileGCode)
+		{
+			if (retract)
+			{
+				// Don't retract until we see whether the next command is a travel move that we can blend the retraction into
+				retractionPending = true;
+				isRetracted = true;
+				return GCodeResult::ok;
+			}
+			if (travelTailPending)
+			{
+				// Un-retract and undo the Z hop during the end of the travel move
+				QueueBlendedTravelTail(true);
+				return GCodeResult::ok;
+			}
+		}
+
 		// New code does the retraction and the Z hop as separate moves
 		// Get ready to generate a move
 		const uint32_t xAxes = reprap.GetCurrentXAxes();
@@ -4084,6 +4938,164 @@ GCodeResult GCodes::RetractFilament(GCodeBuffer& gb, bool retract)
 	return GCodeResult::ok;
 }
 
+// This is called before executing a code from the file when a retraction or the end of a travel move is waiting to be blended with it.
+// If the code can't be blended, queue the pending movement without blending and return false so that the code is executed later. Otherwise return true.
+bool GCodes::HandlePendingBlend(GCodeBuffer& gb)
+{
+	if (travelTailPending && gb.GetCommandLetter() == 'G' && gb.HasCommandNumber() && gb.GetCommandNumber() == 11)
+	{
+		return true;											// RetractFilament will un-retract during the end of the travel move
+	}
+
+	if (retractionPending && !travelTailPending && gb.IsPlainMove() && !gb.Seen(extrudeLetter) && (gb.Seen(axisLetters[X_AXIS]) || gb.Seen(axisLetters[Y_AXIS]))
+		&& !reprap.GetMove().IsUsingMesh() && !reprap.GetMove().GetKinematics().UseSegmentation()
+	   )
+	{
+		return true;											// CompleteStraightMove will blend the retraction into this travel move
+	}
+
+	if (segmentsLeft != 0 || !LockMovement(gb))
+	{
+		return false;
+	}
+
+	if (travelTailPending)
+	{
+		// Finish the travel move, staying retracted
+		QueueBlendedTravelTail(false);
+	}
+	else
+	{
+		// Do the retraction and Z hop as a single move
+		const AxesBitmap xAxes = reprap.GetCurrentXAxes();
+		const AxesBitmap yAxes = reprap.GetCurrentYAxes();
+		reprap.GetMove().GetCurrentUserPosition(moveBuffer.coords, 0, xAxes, yAxes);
+		for (size_t i = numTotalAxes; i < DRIVES; ++i)
+		{
+			moveBuffer.coords[i] = 0.0;
+		}
+		moveBuffer.SetDefaults();
+		moveBuffer.isFirmwareRetraction = true;
+		moveBuffer.xAxes = xAxes;
+		moveBuffer.yAxes = yAxes;
+		moveBuffer.filePos = gb.GetFilePosition(fileInput->BytesCached());
+		moveBuffer.coords[Z_AXIS] += retractHop;
+		currentZHop = retractHop;
+		const Tool * const tool = reprap.GetCurrentTool();
+		if (tool != nullptr)
+		{
+			for (size_t i = 0; i < tool->DriveCount(); ++i)
+			{
+				moveBuffer.coords[numTotalAxes + tool->Drive(i)] = -retractLength;
+			}
+		}
+		moveBuffer.feedRate = retractSpeed;
+		moveBuffer.canPauseAfter = false;						// don't pause after a retraction because that could cause too much retraction
+		NewMoveAvailable(1);
+		retractionPending = false;
+	}
+	return false;
+}
+
+// Split the travel move that has been set up in moveBuffer so that the pending retraction and Z hop happen during the first part of it.
+// The first part is left in moveBuffer. If the move is long enough, also set up the end of it, during which we will un-retract if the next command asks us to,
+// and return true. The caller must then set up the state machine to do the middle part when the first part has been taken.
+bool GCodes::SetUpBlendedTravel()
+{
+	retractionPending = false;
+	currentZHop = retractHop;
+
+	const float travelLength = sqrtf(fsquare(moveBuffer.coords[X_AXIS] - moveBuffer.initialCoords[X_AXIS]) + fsquare(moveBuffer.coords[Y_AXIS] - moveBuffer.initialCoords[Y_AXIS]));
+	const float travelTime = (moveBuffer.feedRate > 0.0) ? travelLength/moveBuffer.feedRate : 0.0;
+	const float retractTime = retractLength/retractSpeed;
+	const float unRetractTime = (retractLength + retractExtra)/unRetractSpeed;
+
+	// Use up to one third of the travel move for each of the retraction and the un-retraction. If the move is too short to do that, retract during all of it.
+	float retractFraction = 1.0, unRetractFraction = 0.0;
+	if (travelTime > 0.0 && retractTime < travelTime && unRetractTime < travelTime)
+	{
+		retractFraction = min<float>(retractTime/travelTime, 1.0/3.0);
+		unRetractFraction = min<float>(unRetractTime/travelTime, 1.0/3.0);
+	}
+
+	memcpy(blendedTravelEnd, moveBuffer.coords, numVisibleAxes * sizeof(blendedTravelEnd[0]));
+	blendedTravelFeedRate = moveBuffer.feedRate;
+	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+	{
+		const float distance = blendedTravelEnd[axis] - moveBuffer.initialCoords[axis];
+		moveBuffer.coords[axis] = moveBuffer.initialCoords[axis] + distance * retractFraction;
+		blendedTravelTailStart[axis] = blendedTravelEnd[axis] - distance * unRetractFraction;
+	}
+	moveBuffer.coords[Z_AXIS] += retractHop;
+	blendedTravelTailStart[Z_AXIS] += retractHop;
+
+	const Tool * const tool = reprap.GetCurrentTool();
+	if (tool != nullptr)
+	{
+		for (size_t i = 0; i < tool->DriveCount(); ++i)
+		{
+			moveBuffer.coords[numTotalAxes + tool->Drive(i)] = -retractLength;
+		}
+	}
+	moveBuffer.isFirmwareRetraction = true;
+	return unRetractFraction != 0.0;
+}
+
+// Queue the end of a blended travel move. If unRetract is true, un-retract and undo the Z hop during it, otherwise stay retracted.
+// The caller must have checked that segmentsLeft is zero and that we own the movement lock.
+void GCodes::QueueBlendedTravelTail(bool unRetract)
+{
+	memcpy(moveBuffer.initialCoords, blendedTravelTailStart, numVisibleAxes * sizeof(moveBuffer.initialCoords[0]));
+	memcpy(moveBuffer.coords, blendedTravelEnd, numVisibleAxes * sizeof(moveBuffer.coords[0]));
+	for (size_t i = numTotalAxes; i < DRIVES; ++i)
+	{
+		moveBuffer.coords[i] = 0.0;
+	}
+	moveBuffer.SetDefaults();
+	moveBuffer.isCoordinated = true;
+	moveBuffer.xAxes = reprap.GetCurrentXAxes();
+	moveBuffer.yAxes = reprap.GetCurrentYAxes();
+	moveBuffer.feedRate = blendedTravelFeedRate;
+	moveBuffer.filePos = fileGCode->GetFilePosition(fileInput->BytesCached());
+	moveBuffer.canPauseAfter = true;
+	if (unRetract)
+	{
+		const Tool * const tool = reprap.GetCurrentTool();
+		if (tool != nullptr)
+		{
+			for (size_t i = 0; i < tool->DriveCount(); ++i)
+			{
+				moveBuffer.coords[numTotalAxes + tool->Drive(i)] = retractLength + retractExtra;
+			}
+		}
+		moveBuffer.isFirmwareRetraction = true;
+		currentZHop = 0.0;
+		isRetracted = false;
+	}
+	else
+	{
+		moveBuffer.coords[Z_AXIS] += retractHop;
+	}
+	travelTailPending = false;
+	NewMoveAvailable(1);
+}
+
+// Forget any pending blended retraction. If we had deferred a retraction, we didn't do it, so we are not retracted.
+// If we had deferred the end of a travel move, the machine stopped short of the end of it, so correct the user position.
+void GCodes::CancelBlendedRetraction()
+{
+	if (retractionPending)
+	{
+		retractionPending = false;
+		isRetracted = false;
+	}
+	if (travelTailPending)
+	{
+		travelTailPending = false;
+		ToolOffsetInverseTransform(blendedTravelTailStart, currentUserPosition);
+	}
+}
+
 // Load the specified filament into a tool
 GCodeResult GCodes::LoadFilament(GCodeBuffer& gb, const StringRef& reply)
 {
@@ -4193,6 +5205,18 @@ float GCodes::GetRawExtruderTotalByDrive(size_t extruder) const
 	return (extruder < numExtruders) ? rawExtruderTotalByDrive[extruder] : 0.0;
 }
 
+// Called by the Move class when a move we passed to it was not scheduled, so that queued codes stay synchronised with the moves
+void GCodes::MovesDiscarded(unsigned int numDiscarded)
+{
+	codeQueue->MovesDiscarded(numDiscarded);
+}
+
+// Called by the Move class to find out whether codes are queued between a move that it is holding back and the next one
+bool GCodes::HasQueuedCodesForMove(uint32_t moveNumber) const
+{
+	return codeQueue->HasCodesForMove(moveNumber);
+}
+
 // Return true if the code queue is idle
 bool GCodes::IsCodeQueueIdle() const
 {
@@ -4204,6 +5228,7 @@ bool GCodes::IsCodeQueueIdle() const
 void GCodes::StopPrint(StopPrintReason reason)
 {
 	segmentsLeft = 0;
+	CancelBlendedRetraction();
 	isPaused = pausePending = false;
 
 	FileData& fileBeingPrinted = fileGCode->OriginalMachineState().fileState;
@@ -4218,6 +5243,12 @@ void GCodes::StopPrint(StopPrintReason reason)
 
 	reprap.GetMove().ResetMoveCounters();
 	codeQueue->Clear();
+#if SUPPORT_TOOL_PREHEAT
+	toolPreheater->Stop();
+#endif
+#if SUPPORT_RESUME_CHECKPOINT
+	resumeCheckpoint->Close(true);
+#endif
 
 	UnlockAll(*fileGCode);
 
@@ -4236,12 +5267,20 @@ void GCodes::StopPrint(StopPrintReason reason)
 		}
 
 		exitSimulationWhenFileComplete = false;
+		reprap.GetMove().ReportBenchmark(LoggedGenericMessage);
+		ReportParseBenchmark(LoggedGenericMessage);
+		const bool wasParseBenchmarking = parseBenchmarking;
+		parseBenchmarking = false;
 		simulationMode = 0;							// do this after we append the simulation info to the file so that DWC doesn't try to reload the file info too soon
 		reprap.GetMove().Simulate(simulationMode);
 		EndSimulation(nullptr);
 
 		const uint32_t simMinutes = lrintf(simSeconds/60.0);
-		if (reason == StopPrintReason::normalCompletion)
+		if (wasParseBenchmarking)
+		{
+			// The moves were discarded, so there is no simulated time to report
+		}
+		else if (reason == StopPrintReason::normalCompletion)
 		{
 			platform.MessageF(LoggedGenericMessage, "File %s will print in %" PRIu32 "h %" PRIu32 "m plus heating time\n",
 									printingFilename, simMinutes/60u, simMinutes % 60u);
@@ -4310,6 +5349,96 @@ bool GCodes::ToolHeatersAtSetTemperatures(const Tool *tool, bool waitWhenCooling
 	return true;
 }
 
+// Record the heaters that an M116 in a tool change macro asks us to wait for. We don't wait now, so that the rest of the tool change
+// (e.g. moving the new tool over the print) can be planned and executed while the heaters settle. The next extruding move waits instead.
+void GCodes::DeferHeaterWait(GCodeBuffer& gb)
+{
+	bool seen = false;
+	if (gb.Seen('P'))
+	{
+		const Tool * const tool = reprap.GetTool(gb.GetIValue() + gb.GetToolNumberAdjust());
+		if (tool != nullptr)
+		{
+			for (size_t i = 0; i < tool->HeaterCount(); ++i)
+			{
+				SetBit(deferredHeaterWaits, tool->Heater(i));
+			}
+		}
+		seen = true;
+	}
+
+	if (gb.Seen('H'))
+	{
+		uint32_t heaters[Heaters];
+		size_t heaterCount = Heaters;
+		gb.GetUnsignedArray(heaters, heaterCount, false);
+		for (size_t i = 0; i < heaterCount; ++i)
+		{
+			if (heaters[i] < Heaters)
+			{
+				SetBit(deferredHeaterWaits, heaters[i]);
+			}
+		}
+		seen = true;
+	}
+
+	if (gb.Seen('C'))
+	{
+		uint32_t chamberIndices[NumChamberHeaters];
+		size_t chamberCount = NumChamberHeaters;
+		gb.GetUnsignedArray(chamberIndices, chamberCount, false);
+		for (size_t i = 0; i < NumChamberHeaters; ++i)
+		{
+			bool wanted = (chamberCount == 0);						// if no values are specified, wait for all chamber heaters
+			for (size_t j = 0; !wanted && j < chamberCount; ++j)
+			{
+				wanted = (chamberIndices[j] == i);
+			}
+			const int8_t heater = reprap.GetHeat().GetChamberHeater(i);
+			if (wanted && heater >= 0)
+			{
+				SetBit(deferredHeaterWaits, heater);
+			}
+		}
+		seen = true;
+	}
+
+	if (!seen)
+	{
+		deferredWaitForAllHeaters = true;
+	}
+}
+
+// Check whether an extruding move must wait for heaters that an M116 in a tool change macro asked to wait for.
+// Return true if it can go ahead, else report the temperatures if due and return false so that the caller tries again later.
+bool GCodes::DeferredHeaterWaitDone(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (deferredHeaterWaits == 0 && !deferredWaitForAllHeaters)
+	{
+		return true;
+	}
+
+	if (!cancelWait && simulationMode == 0)
+	{
+		bool atTemperature = !deferredWaitForAllHeaters || reprap.GetHeat().AllHeatersAtSetTemperatures(true);
+		for (unsigned int heater = 0; atTemperature && heater < Heaters; ++heater)
+		{
+			atTemperature = !IsBitSet(deferredHeaterWaits, heater) || reprap.GetHeat().HeaterAtSetTemperature(heater, true);
+		}
+		if (!atTemperature)
+		{
+			CheckReportDue(gb, reply);
+			isWaiting = true;
+			return false;
+		}
+	}
+
+	deferredHeaterWaits = 0;
+	deferredWaitForAllHeaters = false;
+	cancelWait = isWaiting = false;
+	return true;
+}
+
 // Set the current position, optionally applying bed and axis compensation
 void GCodes::SetMachinePosition(const float positionNow[DRIVES], bool doBedCompensation)
 {
@@ -4398,7 +5527,9 @@ void GCodes::ToolOffsetTransform(const float coordsIn[MaxAxes], float coordsOut[
 										: (IsBitSet(xAxes, axis)) ? X_AXIS
 											: (IsBitSet(yAxes, axis)) ? Y_AXIS
 												: axis;
-				coordsOut[axis] = (coordsIn[inputAxis] * axisScaleFactors[axis]) + totalOffset;
+				coordsOut[axis] = (inputAxis == X_AXIS && IsBitSet(currentTool->GetMirroredXAxes(), axis))
+									? totalOffset - (coordsIn[inputAxis] * axisScaleFactors[axis])	// a mirrored axis moves in the opposite direction, so its tool offset is the mirror position
+										: (coordsIn[inputAxis] * axisScaleFactors[axis]) + totalOffset;
 			}
 		}
 	}
@@ -4441,7 +5572,9 @@ void GCodes::ToolOffsetInverseTransform(const float coordsIn[MaxAxes], float coo
 			coordsOut[axis] = coordsIn[axis] + currentTool->GetOffset(axis);
 			if (IsBitSet(xAxes, axis))
 			{
-				xCoord += coordsIn[axis]/axisScaleFactors[axis] - totalOffset;
+				xCoord += (IsBitSet(currentTool->GetMirroredXAxes(), axis))
+							? totalOffset - coordsIn[axis]/axisScaleFactors[axis]
+								: coordsIn[axis]/axisScaleFactors[axis] - totalOffset;
 				++numXAxes;
 			}
 			if (IsBitSet(yAxes, axis))
@@ -4642,8 +5775,8 @@ void GCodes::ReportToolTemperatures(const StringRef& reply, const Tool *tool, bo
 		char sep = ':';
 		for (size_t i = 0; i < tool->HeaterCount(); ++i)
 		{
-			const int heater = tool->Heater(i);
-			reply.catf("%c%.1f /%.1f", sep, (double)heat.GetTemperature(heater), (double)heat.GetTargetTemperature(heater));
+			const Heat::HeaterReport report = heat.GetHeaterReport(tool->Heater(i));
+			reply.catf("%c%.1f /%.1f", sep, (double)report.current, (double)report.Target());
 			sep = ' ';
 		}
 	}
@@ -4677,7 +5810,8 @@ void GCodes::GenerateTemperatureReport(const StringRef& reply) const
 			reply.catf(" B%u:", hn);
 		}
 		const int8_t heater = heat.GetBedHeater(hn);
-		reply.catf("%.1f /%.1f", (double)heat.GetTemperature(heater), (double)heat.GetTargetTemperature(heater));
+		const Heat::HeaterReport report = heat.GetHeaterReport(heater);
+		reply.catf("%.1f /%.1f", (double)report.current, (double)report.Target());
 	}
 
 	for (size_t hn = 0; hn < NumChamberHeaters && heat.GetChamberHeater(hn) >= 0; ++hn)
@@ -4695,7 +5829,8 @@ void GCodes::GenerateTemperatureReport(const StringRef& reply) const
 			reply.catf(" C%u:", hn);
 		}
 		const int8_t heater = heat.GetChamberHeater(hn);
-		reply.catf("%.1f /%.1f", (double)heat.GetTemperature(heater), (double)heat.GetTargetTemperature(heater));
+		const Heat::HeaterReport report = heat.GetHeaterReport(heater);
+		reply.catf("%.1f /%.1f", (double)report.current, (double)report.Target());
 	}
 }
 
@@ -4715,9 +5850,9 @@ void GCodes::CheckReportDue(GCodeBuffer& gb, const StringRef& reply) const
 				reply.cat('\n');
 				platform.Message(UsbMessage, reply.c_str());
 			}
-			if (lastAuxStatusReportType >= 0)
+			if (lastAuxStatusReportType >= 0 && auxStatusPushInterval == 0)
 			{
-				// Send a standard status response for PanelDue
+				// Send a standard status response for PanelDue, unless it is already being sent status updates
 				OutputBuffer * const statusBuf = GenerateJsonStatusResponse(lastAuxStatusReportType, -1, ResponseSource::AUX);
 				if (statusBuf != nullptr)
 				{
@@ -4734,9 +5869,95 @@ void GCodes::CheckReportDue(GCodeBuffer& gb, const StringRef& reply) const
 	}
 }
 
+// Start or stop pushing status updates to PanelDue, which it asks for using M408 P
+void GCodes::SetAuxStatusPush(int type, uint32_t interval)
+{
+	if (interval != 0)
+	{
+		if (auxStatusDelta == nullptr)
+		{
+			auxStatusDelta = new StatusDelta;
+		}
+		lastAuxStatusReportType = type;
+		interval = max<uint32_t>(interval, MinAuxStatusPushInterval);
+		lastAuxStatusPushTime = millis() - interval;				// send the first update straight away
+	}
+	auxStatusPushInterval = interval;
+	auxStatusPushSeq = 0;											// PanelDue needs the whole status first
+}
+
+// If PanelDue asked us to push status updates and one is due, send it the top-level members of the status response that have changed since the last one.
+// This saves generating a response to M408 on the aux channel, and sending the whole response over the serial link each time.
+void GCodes::PushAuxStatus()
+{
+	const uint32_t now = millis();
+	if (auxStatusPushInterval == 0 || now - lastAuxStatusPushTime < auxStatusPushInterval || !platform.HaveAux() || platform.AuxOutputPending())
+	{
+		return;
+	}
+	lastAuxStatusPushTime = now;
+
+	OutputBuffer *statusResponse = GenerateJsonStatusObject(lastAuxStatusReportType, -1, ResponseSource::AUX);
+	if (statusResponse == nullptr || statusResponse->HadOverflow())
+	{
+		OutputBuffer::ReleaseAll(statusResponse);
+		return;														// we ran out of buffers, so try again next time
+	}
+
+	OutputBuffer *reply = nullptr;
+	if (auxStatusDelta->Update(statusResponse))
+	{
+		if (auxStatusDelta->GetSeq() != auxStatusPushSeq)			// don't send anything if nothing has changed
+		{
+			reply = auxStatusDelta->MakeResponse(statusResponse, auxStatusPushSeq);
+			if (reply != nullptr)
+			{
+				auxStatusPushSeq = auxStatusDelta->GetSeq();
+			}
+		}
+		OutputBuffer::ReleaseAll(statusResponse);					// release the full response first, so that we have buffers to add the newline
+	}
+	else
+	{
+		reply = statusResponse;										// the delta generator can't handle this response, so send all of it
+		auxStatusPushSeq = 0;
+	}
+
+	if (reply != nullptr)
+	{
+		reply->cat('\n');
+		if (reply->HadOverflow())
+		{
+			OutputBuffer::ReleaseAll(reply);
+			auxStatusPushSeq = 0;
+		}
+		else
+		{
+			platform.AppendAuxReply(reply, true);
+		}
+	}
+}
+
 // Generate a M408 response
 // Return the output buffer containing the response, or nullptr if we failed
 OutputBuffer *GCodes::GenerateJsonStatusResponse(int type, int seq, ResponseSource source) const
+{
+	OutputBuffer *statusResponse = GenerateJsonStatusObject(type, seq, source);
+	if (statusResponse != nullptr)
+	{
+		statusResponse->cat('\n');
+		if (statusResponse->HadOverflow())
+		{
+			OutputBuffer::ReleaseAll(statusResponse);
+			return nullptr;
+		}
+	}
+	return statusResponse;
+}
+
+// Generate the JSON object for a M408 response without the trailing newline
+// Return the output buffer containing the response, or nullptr if we failed. The caller must check for overflow.
+OutputBuffer *GCodes::GenerateJsonStatusObject(int type, int seq, ResponseSource source) const
 {
 	OutputBuffer *statusResponse = nullptr;
 	switch (type)
@@ -4755,14 +5976,14 @@ OutputBuffer *GCodes::GenerateJsonStatusResponse(int type, int seq, ResponseSour
 		case 5:
 			statusResponse = reprap.GetConfigResponse();
 			break;
-	}
-	if (statusResponse != nullptr)
-	{
-		statusResponse->cat('\n');
-		if (statusResponse->HadOverflow())
-		{
-			OutputBuffer::ReleaseAll(statusResponse);
-		}
+
+		case 6:
+			statusResponse = reprap.GetCpuUsageResponse();
+			break;
+
+		case 7:
+			statusResponse = PerfCounters::GetJsonResponse();
+			break;
 	}
 	return statusResponse;
 }
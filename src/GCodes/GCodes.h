@@ -31,7 +31,9 @@ Licence: GPL
 #include "Tools/Filament.h"
 #include "FilamentMonitors/FilamentMonitor.h"
 #include "RestorePoint.h"
+#include "ResumeCheckpoint.h"
 #include "Movement/BedProbing/Grid.h"
+#include "Movement/StageTimer.h"
 
 const char feedrateLetter = 'F';						// GCode feedrate
 const char extrudeLetter = 'E'; 						// GCode extrude
@@ -43,6 +45,8 @@ const EndstopChecks HomeAxes = 1 << 30;					// must be distinct from 1 << (any d
 const EndstopChecks LogProbeChanges = 1 << 29;			// must be distinct from 1 << (any drive number)
 const EndstopChecks UseSpecialEndstop = 1 << 28;		// must be distinct from 1 << (any drive number)
 
+class StatusDelta;
+
 typedef uint32_t TriggerInputsBitmap;					// Bitmap of input pins that a single trigger number responds to
 typedef uint32_t TriggerNumbersBitmap;					// Bitmap of trigger numbers
 
@@ -115,11 +119,15 @@ public:
 		float virtualExtruderPosition;									// the virtual extruder position at the start of this move
 		FilePosition filePos;											// offset in the file being printed at the start of reading this move
 		float proportionLeft;											// what proportion of the entire move remains after this segment
+		float maxExtrusionRate;											// the filament feed rate limit from the tool's volumetric flow limit, or zero
 		AxesBitmap xAxes;												// axes that X is mapped to
 		AxesBitmap yAxes;												// axes that Y is mapped to
 		EndstopChecks endStopsToCheck;									// endstops to check
 #if SUPPORT_LASER || SUPPORT_IOBITS
 		LaserPwmOrIoBits laserPwmOrIoBits;								// the laser PWM or port bit settings required
+#endif
+#if SUPPORT_LASER_RASTER
+		LaserRaster *laserRaster;										// the per-pixel laser power, or nullptr. Whoever holds the RawMove must pass it on or release it.
 #endif
 		uint8_t moveType;												// the S parameter from the G0 or G1 command, 0 for a normal move
 
@@ -140,6 +148,8 @@ public:
 	void Reset();														// Reset some parameter to defaults
 	bool ReadMove(RawMove& m);											// Called by the Move class to get a movement set by the last G Code
 	void ClearMove();
+	void MovesDiscarded(unsigned int numDiscarded);						// Called by the Move class when it discards a move that we passed to it
+	bool HasQueuedCodesForMove(uint32_t moveNumber) const;				// Return true if any codes are queued to execute after the specified move
 	bool QueueFileToPrint(const char* fileName, const StringRef& reply);	// Open a file of G Codes to run
 	void StartPrinting(bool fromStart);									// Start printing the file already selected
 	void GetCurrentCoordinates(const StringRef& s) const;				// Write where we are into a string
@@ -183,6 +193,8 @@ public:
 	bool IsRunning() const;
 	bool IsReallyPrinting() const;										// Return true if we are printing from SD card and not pausing, paused or resuming
 	bool IsSimulating() const { return simulationMode != 0; }
+	bool IsSimulatingFile() const { return simulationMode != 0 && exitSimulationWhenFileComplete; }	// Return true if M37 is simulating a whole file
+	void SpinSimulation();												// Process more commands from the file being simulated
 	bool IsDoingToolChange() const { return doingToolChange; }
 	bool IsHeatingUp() const;											// Return true if the SD card print is waiting for a heater to reach temperature
 
@@ -190,10 +202,11 @@ public:
 
 	void StopPrint(StopPrintReason reason);								// Stop the current print
 
-	void MoveStoppedByZProbe() { zProbeTriggered = true; }				// Called from the step ISR when the Z probe is triggered, causing the move to be aborted
+	void MoveStoppedByZProbe(float zOvershoot) { zProbeOvershoot = zOvershoot; zProbeTriggered = true; }	// Called from the step ISR when the Z probe is triggered, causing the move to be aborted
 
 	size_t GetTotalAxes() const { return numTotalAxes; }
 	size_t GetVisibleAxes() const { return numVisibleAxes; }
+	AxesBitmap GetContinuousRotationAxes() const { return continuousRotationAxes; }	// Get the rotary axes that take the shortest path (M584 R1)
 	size_t GetNumExtruders() const { return numExtruders; }
 
 	void FilamentError(size_t extruder, FilamentSensorStatus fstat);
@@ -211,6 +224,9 @@ public:
 
 	const char *GetAxisLetters() const { return axisLetters; }			// Return a null-terminated string of axis letters indexed by drive
 	MachineType GetMachineType() const { return machineType; }
+#if SUPPORT_LASER
+	bool LaserPowerFollowsSpeed() const { return laserPowerFollowsSpeed; }
+#endif
 
 #if SUPPORT_12864_LCD
 	bool ProcessCommandFromLcd(const char *cmd);						// Process a GCode command from the 12864 LCD returning true if the command was accepted
@@ -253,6 +269,7 @@ private:
 	void UnlockAll(const GCodeBuffer& gb);								// Release all locks
 
 	void StartNextGCode(GCodeBuffer& gb, const StringRef& reply);		// Fetch a new or old GCode and process it
+	void SpinGCodeBuffer(GCodeBuffer& gb);								// Process the next step of the command from one input channel
 	void RunStateMachine(GCodeBuffer& gb, const StringRef& reply);		// Execute a step of the state machine
 	void DoFilePrint(GCodeBuffer& gb, const StringRef& reply);			// Get G Codes from a file and print them
 	bool DoFileMacro(GCodeBuffer& gb, const char* fileName, bool reportMissing, int codeRunning = 0);
@@ -265,8 +282,11 @@ private:
 	bool HandleTcode(GCodeBuffer& gb, const StringRef& reply);			// Do a T code
 	bool HandleResult(GCodeBuffer& gb, GCodeResult rslt, const StringRef& reply);
 	void HandleReply(GCodeBuffer& gb, bool error, OutputBuffer *reply);
+	const char *GetOkResponse(const GCodeBuffer& gb, const StringRef& buf) const;	// Get the acknowledgement to send in Marlin mode
 
 	const char* DoStraightMove(GCodeBuffer& gb, bool isCoordinated) __attribute__((hot));	// Execute a straight move returning any error message
+	const char* DoPlainStraightMove(GCodeBuffer& gb, bool isCoordinated) __attribute__((hot));	// Execute a G0/G1 move with only X, Y, Z, E and F parameters
+	const char* CompleteStraightMove(GCodeBuffer& gb, AxesBitmap axesMentioned, float initialX, float initialY) __attribute__((hot));
 	const char* DoArcMove(GCodeBuffer& gb, bool clockwise)						// Execute an arc move returning any error message
 		pre(segmentsLeft == 0; resourceOwners[MoveResource] == &gb);
 	void FinaliseMove(GCodeBuffer& gb);											// Adjust the move parameters to account for segmentation and/or part of the move having been done already
@@ -277,7 +297,10 @@ private:
 	GCodeResult DoDwellTime(GCodeBuffer& gb, uint32_t dwellMillis);				// Really wait for a bit
 	GCodeResult DoHome(GCodeBuffer& gb, const StringRef& reply);				// Home some axes
 	GCodeResult ExecuteG30(GCodeBuffer& gb, const StringRef& reply);			// Probes at a given position - see the comment at the head of the function itself
+	bool FinishedProbePoint(const StringRef& reply);							// Calibrate if required after a G30 P command with an S parameter
+	void StartLevellingRun(GCodeBuffer& gb);									// Run bed.g again as part of an iterative G32
 	void InitialiseTaps();														// Set up to do the first of a possibly multi-tap probe
+	bool UpdateTapStatistics(float maxStdDev);									// Record a tap and return true if the readings have converged
 	void SetBedEquationWithProbe(int sParam, const StringRef& reply);			// Probes a series of points and sets the bed equation
 	GCodeResult SetPrintZProbe(GCodeBuffer& gb, const StringRef& reply);		// Either return the probe value, or set its threshold
 	GCodeResult SetOrReportOffsets(GCodeBuffer& gb, const StringRef& reply);	// Deal with a G10
@@ -307,9 +330,14 @@ private:
 	bool ManageTool(GCodeBuffer& gb, const StringRef& reply);					// Create a new tool definition, returning true if an error was reported
 	void SetToolHeaters(Tool *tool, float temperature, bool both);				// Set all a tool's heaters to the temperature, for M104/M109
 	bool ToolHeatersAtSetTemperatures(const Tool *tool, bool waitWhenCooling) const; // Wait for the heaters associated with the specified tool to reach their set temperatures
+	void DeferHeaterWait(GCodeBuffer& gb);										// Record what an M116 in a tool change macro should wait for
+	bool DeferredHeaterWaitDone(GCodeBuffer& gb, const StringRef& reply);		// Return true if there is no deferred heater wait or its heaters are at temperature
 	void ReportToolTemperatures(const StringRef& reply, const Tool *tool, bool includeNumber) const;
 	void GenerateTemperatureReport(const StringRef& reply) const;				// Store a standard-format temperature report in reply
 	OutputBuffer *GenerateJsonStatusResponse(int type, int seq, ResponseSource source) const;	// Generate a M408 response
+	OutputBuffer *GenerateJsonStatusObject(int type, int seq, ResponseSource source) const;	// Generate a M408 response without the trailing newline
+	void SetAuxStatusPush(int type, uint32_t interval);						// Start or stop pushing status updates to PanelDue (M408 P)
+	void PushAuxStatus();														// Send PanelDue the status fields that have changed, if it is time to
 	void CheckReportDue(GCodeBuffer& gb, const StringRef& reply) const;			// Check whether we need to report temperatures or status
 
 	void SavePosition(RestorePoint& rp, const GCodeBuffer& gb) const;			// Save position to a restore point
@@ -321,6 +349,10 @@ private:
 	void ToolOffsetInverseTransform(const float coordsIn[MaxAxes], float coordsOut[MaxAxes]);	// Convert head reference point coordinates to user coordinates
 	const char *TranslateEndStopResult(EndStopHit es);							// Translate end stop result to text
 	GCodeResult RetractFilament(GCodeBuffer& gb, bool retract);					// Retract or un-retract filaments
+	bool HandlePendingBlend(GCodeBuffer& gb);									// Deal with a retraction or travel move end waiting to be blended, returning true if the current code can proceed
+	bool SetUpBlendedTravel();													// Split the travel move in moveBuffer so that the retraction happens during its first part
+	void QueueBlendedTravelTail(bool unRetract);								// Queue the end of a blended travel move, un-retracting during it if requested
+	void CancelBlendedRetraction();												// Forget any pending blended retraction, e.g. because the print has been paused
 	GCodeResult LoadFilament(GCodeBuffer& gb, const StringRef& reply);			// Load the specified filament into a tool
 	GCodeResult UnloadFilament(GCodeBuffer& gb, const StringRef& reply);		// Unload the current filament from a tool
 	bool ChangeMicrostepping(size_t drive, unsigned int microsteps, bool interp) const; // Change microstepping on the specified drive
@@ -338,6 +370,7 @@ private:
 #endif
 
 	void SetMappedFanSpeed();													// Set the speeds of fans mapped for the current tool
+	void DoQueuedFanChanges();													// Make any queued fan speed changes that are now due
 	void SaveFanSpeeds();														// Save the speeds of all fans
 
 	GCodeResult SetOrReportZProbe(GCodeBuffer& gb, const StringRef &reply);		// Handle M558
@@ -350,11 +383,16 @@ private:
 	GCodeResult UpdateFirmware(GCodeBuffer& gb, const StringRef &reply);		// Handle M997
 	GCodeResult SendI2c(GCodeBuffer& gb, const StringRef &reply);				// Handle M260
 	GCodeResult ReceiveI2c(GCodeBuffer& gb, const StringRef &reply);			// Handle M261
-	GCodeResult SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile);	// Handle M37 to simulate a whole file
+	GCodeResult SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile, uint32_t benchmark);	// Handle M37 to simulate a whole file
 	GCodeResult ChangeSimulationMode(GCodeBuffer& gb, const StringRef &reply, uint32_t newSimulationMode);		// Handle M37 to change the simulation mode
 
 	GCodeResult WriteConfigOverrideFile(GCodeBuffer& gb, const StringRef& reply) const; // Write the config-override file
 	void CopyConfigFinalValues(GCodeBuffer& gb);							// Copy the feed rate etc. from the daemon to the input channels
+#if SUPPORT_COMPILED_CONFIG
+	void GetCompiledConfigHeader(const StringRef& header) const;			// Get the first line that a compiled copy of config.g must have to be up to date
+	bool CompiledConfigIsUpToDate();										// Return true if the compiled copy of config.g exists and matches config.g
+	void CompileConfigFile();												// Write a compiled copy of config.g
+#endif
 
 	void ClearBabyStepping() { currentBabyStepZOffset = 0.0; }
 
@@ -364,9 +402,17 @@ private:
 	void AppendAxes(const StringRef& reply, AxesBitmap axes) const;			// Append a list of axes to a string
 
 	void EndSimulation(GCodeBuffer *gb);								// Restore positions etc. when exiting simulation mode
+	void ReportParseBenchmark(MessageType mtype) const;					// Report the G-code processing speed at the end of a parse benchmark
 	bool IsCodeQueueIdle() const;										// Return true if the code queue is idle
 
 	void SaveResumeInfo(bool wasPowerFailure);
+	void CaptureResumeState(ResumeState& rs, bool wasPowerFailure, const char *printingFilename) const;	// Get the state that we need to resume the print
+	bool WriteResumeSettings(FileStore *f) const;						// Write the heater, tool and height map settings that we need to resume the print
+	bool WriteResumeFile(const ResumeState& rs, bool settingsFromCheckpoint);	// Write resurrect.g
+#if SUPPORT_RESUME_CHECKPOINT
+	void UpdateResumeCheckpoint();										// Bring the settings in the resume checkpoint up to date
+	void RecoverResumeCheckpoint();										// Generate resurrect.g from the resume checkpoint if the power failed
+#endif
 
 	const char* GetMachineModeString() const;							// Get the name of the current machine mode
 
@@ -381,7 +427,11 @@ private:
 	Platform& platform;													// The RepRap machine
 
 	FileGCodeInput* fileInput;											// ...
+#if SUPPORT_USB_STREAMING
+	SerialGCodeInput* serialInput;										// ...
+#else
 	StreamGCodeInput* serialInput;										// ...
+#endif
 
 #if HAS_NETWORKING
 	NetworkGCodeInput* httpInput;										// These cache incoming G-codes...
@@ -412,6 +462,10 @@ private:
 	bool isPaused;								// true if the print has been paused manually or automatically
 	bool pausePending;							// true if we have been asked to pause but we are running a macro
 	bool runningConfigFile;						// We are running config.g during the startup process
+#if SUPPORT_COMPILED_CONFIG
+	bool compileConfigFile;						// We are running config.g at startup and should write a compiled copy of it if it runs without errors
+	bool configFileHadError;					// A command in the config file reported an error
+#endif
 	bool doingToolChange;						// We are running tool change macros
 
 #if HAS_VOLTAGE_MONITOR
@@ -437,8 +491,12 @@ private:
 	float arcRadius;
 	float arcCurrentAngle;
 	float arcAngleIncrement;
+	AxesBitmap arcMirroredAxes;					// the X axes that move in the opposite direction to X during the arc move
 	bool doingArcMove;
 
+	float meshSegmentEnds[MaxMeshCellCrossings + 1];	// The fraction of the move completed at the end of each segment, when splitting a move at the mesh cell boundaries
+	bool doingMeshMove;							// True if the segments of the current move end at mesh cell boundaries instead of being equal
+
 	enum class SegmentedMoveState : uint8_t
 	{
 		inactive = 0,
@@ -462,7 +520,8 @@ private:
 	float rawExtruderTotalByDrive[MaxExtruders]; // Extrusion amount in the last G1 command with an E parameter when in absolute extrusion mode
 	float rawExtruderTotal;						// Total extrusion amount fed to Move class since starting print, before applying extrusion factor, summed over all drives
 	float distanceScale;						// MM or inches
-	float arcSegmentLength;						// Length of segments that we split arc moves into
+	float arcSegmentLength;						// Minimum length of segments that we split arc moves into
+	float arcTolerance;							// Maximum distance between an arc segment and the true arc
 
 #if SUPPORT_WORKPLACE_COORDINATES
 	static const size_t NumCoordinateSystems = 9;
@@ -481,6 +540,7 @@ private:
 
 	AxesBitmap toBeHomed;						// Bitmap of axes still to be homed
 	AxesBitmap axesHomed;						// Bitmap of which axes have been homed
+	AxesBitmap continuousRotationAxes;			// Rotary axes whose positions are kept within 0 to 360 degrees, so that moves take the shortest way round
 
 	float pausedFanSpeeds[NUM_FANS];			// Fan speeds when the print was paused or a tool change started
 	float lastDefaultFanSpeed;					// Last speed given in a M106 command with on fan number
@@ -494,14 +554,25 @@ private:
 	GridDefinition defaultGrid;					// The grid defined by the M557 command in config.g
 	int32_t g30ProbePointIndex;					// the index of the point we are probing (G30 P parameter), or -1 if none
 	int g30SValue;								// S parameter in the G30 command, or -2 if there wasn't one
+	float g30MaxDeviation;						// D parameter in the G30 command, or 0 if there wasn't one
+	bool skippingCalibrationPoints;				// true if calibration finished early and we are skipping the rest of the G30 P commands
+	float levellingTolerance;					// G32 T parameter: keep running bed.g until the deviation before calibrating is no more than this
+	unsigned int levellingRunsLeft;				// how many more times G32 may run bed.g
+	unsigned int levellingRunsDone;				// how many times G32 has run bed.g
+	unsigned int levellingCalibrationsDone;		// the number of calibrations that Move had done when bed.g was last started
+	static constexpr unsigned int DefaultMaxLevellingRuns = 5;	// how many times G32 T runs bed.g if there is no P parameter
+	static constexpr uint32_t MinAuxStatusPushInterval = 100;	// the shortest interval between status updates pushed to PanelDue, in milliseconds
 	float g30zStoppedHeight;					// the height to report after running G30 S-1
 	float g30zHeightError;						// the height error last time we probed
 	float g30PrevHeightError;					// the height error the previous time we probed
 	float g30zHeightErrorSum;					// the sum of the height errors for the current probe point
 	float g30zHeightErrorLowestDiff;			// the lowest difference we have seen between consecutive readings
+	float g30TapHeightErrors[MaxStatisticalZProbeTaps];	// the height errors from the taps at the current probe point, when the number of taps is decided statistically
 	uint32_t lastProbedTime;					// time in milliseconds that the probe was last triggered
 	volatile bool zProbeTriggered;				// Set by the step ISR when a move is aborted because the Z probe is triggered
+	float zProbeOvershoot;						// How far Z moved between the Z probe triggering and the move being stopped, if the probe interpolates its trigger position
 	size_t gridXindex, gridYindex;				// Which grid probe point is next
+	bool fastGridProbing;						// True if we raise the probe while moving to the next grid point instead of before it
 	bool doingManualBedProbe;					// true if we are waiting for the user to jog the nozzle until it touches the bed
 	bool probeIsDeployed;						// true if M401 has been used to deploy the probe and M402 has not yet been used t0 retract it
 	bool hadProbingError;						// true if there was an error probing the last point
@@ -511,6 +582,12 @@ private:
 	uint8_t simulationMode;						// 0 = not simulating, 1 = simulating, >1 are simulation modes for debugging
 	bool exitSimulationWhenFileComplete;		// true if simulating a file
 	bool updateFileWhenSimulationComplete;		// true if simulated time should be appended to the file
+	bool parseBenchmarking;						// true if we are processing a file with the moves discarded, to measure G-code processing speed
+	uint32_t parseBenchmarkStartMillis;			// when the parse benchmark started
+	uint32_t parseBenchmarkLines;				// how many lines of the file we have processed in the parse benchmark
+	StageTimer fileReadTimer;					// Execution time of reading the file when parse benchmarking
+	StageTimer parseTimer;						// Execution time of passing each line to the GCodeBuffer, which parses it
+	StageTimer executeTimer;					// Execution time of acting on each command, including setting up moves
 
 	// Firmware retraction settings
 	float retractLength, retractExtra;			// retraction length and extra length to un-retract
@@ -518,6 +595,12 @@ private:
 	float unRetractSpeed;						// un=retract speed in mm/min
 	float retractHop;							// Z hop when retracting
 	bool isRetracted;							// true if filament has been firmware-retracted
+	bool blendRetraction;						// true to blend retraction and Z hop into the following travel move, and un-retraction into the end of it
+	bool retractionPending;						// true if a retraction from the file is waiting to be blended into the next travel move
+	bool travelTailPending;						// true if the end of a blended travel move is waiting to see if the next command is an un-retraction
+	float blendedTravelTailStart[MaxAxes];		// where the pending end of the blended travel move starts, including any Z hop
+	float blendedTravelEnd[MaxAxes];			// where the blended travel move ends, excluding any Z hop
+	float blendedTravelFeedRate;				// the feed rate of the blended travel move
 
 	// Triggers
 	Trigger triggers[MaxTriggers];				// Trigger conditions
@@ -532,6 +615,16 @@ private:
 	// Code queue
 	GCodeQueue *codeQueue;						// Stores certain codes for deferred execution
 
+#if SUPPORT_TOOL_PREHEAT
+	ToolPreheater *toolPreheater;				// Heats the next tool before a tool change in the file being printed
+#endif
+
+#if SUPPORT_RESUME_CHECKPOINT
+	ResumeCheckpoint *resumeCheckpoint;			// Holds the resume state of the file being printed
+	unsigned int checkpointLayer;				// The layer at which we last updated the resume checkpoint
+	bool checkedResumeCheckpoint;				// True when we have checked for a resume state that was saved when the power failed
+#endif
+
 	// SHA1 hashing
 	FileStore *fileBeingHashed;
 	SHA1Context hash;
@@ -544,6 +637,7 @@ private:
 
 	// Laser
 	float laserMaxPower;
+	bool laserPowerFollowsSpeed;				// true if the laser power is scaled by the speed during acceleration and deceleration (M452 V1)
 
 	// Heater fault handler
 	HeaterFaultState heaterFaultState;			// whether there is a heater fault and what we have done about it so far
@@ -554,8 +648,15 @@ private:
 	uint32_t lastWarningMillis;					// When we last sent a warning message for things that can happen very often
 	AxesBitmap axesToSenseLength;				// The axes on which we are performing axis length sensing
 	int8_t lastAuxStatusReportType;				// The type of the last status report requested by PanelDue
+	uint32_t auxStatusPushInterval;				// How often we push status updates to PanelDue in milliseconds, or 0 if it polls using M408
+	uint32_t lastAuxStatusPushTime;				// When we last pushed a status update to PanelDue
+	uint32_t auxStatusPushSeq;					// The delta sequence number of the last status update that PanelDue was sent
+	StatusDelta *auxStatusDelta;				// Record of the status fields that PanelDue has been sent, allocated when push mode is first used
 	bool isWaiting;								// True if waiting to reach temperature
 	bool cancelWait;							// Set true to cancel waiting
+	uint32_t deferredHeaterWaits;				// Heaters that an M116 in a tool change macro asked to wait for, which the next extruding move must wait for
+	bool deferredWaitForAllHeaters;				// True if an M116 in a tool change macro asked to wait for all heaters
+	static_assert(Heaters <= 32, "Too many heaters for deferredHeaterWaits");
 	bool displayNoToolWarning;					// True if we need to display a 'no tool selected' warning
 	bool m501SeenInConfigFile;					// true if M501 was executed form config.g
 	char filamentToLoad[FilamentNameLength];	// Name of the filament being loaded
@@ -11,8 +11,13 @@
 
 #include "GCodeBuffer.h"
 #include "GCodeQueue.h"
+#include "ToolPreheater.h"
 #include "Heating/Heat.h"
+#include "Heating/HeaterTracer.h"
 #include "Movement/Move.h"
+#include "Movement/StepTracer.h"
+#include "Movement/MoveTracer.h"
+#include "Movement/Kinematics/KinematicsBenchmark.h"
 #include "Network.h"
 #include "Scanner.h"
 #include "PrintMonitor.h"
@@ -46,23 +51,54 @@
 # include "Fans/DotStarLed.h"
 #endif
 
+#if SUPPORT_LASER_RASTER
+# include "Movement/LaserRaster.h"
+#endif
+
 #include <utility>			// for std::swap
 
 // If the code to act on is completed, this returns true, otherwise false.
 // It is called repeatedly for a given code until it returns true for that code.
 bool GCodes::ActOnCode(GCodeBuffer& gb, const StringRef& reply)
 {
-	// Can we queue this code?
-	if (gb.CanQueueCodes() && codeQueue->ShouldQueueCode(gb))
+	// If a firmware retraction or the end of a travel move is waiting to be blended with the next command from the file, deal with it first
+	if (&gb == fileGCode && (retractionPending || travelTailPending) && !HandlePendingBlend(gb))
+	{
+		return false;
+	}
+
+	// Plain G0 and G1 commands are by far the most common, so handle them without going through the general dispatcher. They are never queued.
+	if (gb.IsPlainMove())
 	{
-		// Don't queue any GCodes if there are segments not yet picked up by Move, because in the event that a segment corresponds to no movement,
-		// the move gets discarded, which throws out the count of scheduled moves and hence the synchronisation
-		if (segmentsLeft != 0)
+		if (segmentsLeft != 0 || !LockMovement(gb))
 		{
 			return false;
 		}
+		const char* const err = DoPlainStraightMove(gb, gb.GetCommandNumber() == 1);
+		if (err != nullptr)
+		{
+			AbortPrint(gb);
+			gb.SetState(GCodeState::waitingForSpecialMoveToComplete, err);	// force the user position to be restored
+		}
+		return HandleResult(gb, GCodeResult::ok, reply);
+	}
+
+#if SUPPORT_MOVE_MERGING
+	// If Move is holding back a move from the file so that it can merge the following ones into it, let it add that move to the ring
+	// before we execute anything else from the file, so that the move uses the settings that were in force when it was read
+	if (&gb == fileGCode && reprap.GetMove().IsHoldingMove())
+	{
+		return false;
+	}
+#endif
 
-		if (codeQueue->QueueCode(gb))
+	// Can we queue this code?
+	if (gb.CanQueueCodes() && codeQueue->ShouldQueueCode(gb, segmentsLeft))
+	{
+		// We count the segments not yet picked up by Move as moves to wait for. If a segment corresponds to no movement and Move discards it,
+		// Move calls MovesDiscarded so that the code still executes at the right time.
+		GCodeQueue::FanChange fc;
+		if ((GCodeQueue::GetFanChange(gb, fc)) ? codeQueue->QueueFanChange(fc, segmentsLeft) : codeQueue->QueueCode(gb, segmentsLeft))
 		{
 			HandleReply(gb, GCodeResult::ok, "");
 			return true;
@@ -116,6 +152,16 @@ bool GCodes::HandleGcode(GCodeBuffer& gb, const StringRef& reply)
 		{
 			return false;
 		}
+		if (gb.Seen(extrudeLetter) && !DeferredHeaterWaitDone(gb, reply))
+		{
+			return false;				// a tool change asked us to wait for the heaters before extruding
+		}
+#if SUPPORT_LASER_RASTER
+		if (machineType == MachineType::laser && LaserRaster::NumFree() == 0 && gb.Seen('D'))
+		{
+			return false;				// wait for a raster move to finish so that we can have its buffer
+		}
+#endif
 		if (!LockMovement(gb))
 		{
 			return false;
@@ -199,6 +245,10 @@ bool GCodes::HandleGcode(GCodeBuffer& gb, const StringRef& reply)
 				}
 				else
 				{
+					if (!DeferredHeaterWaitDone(gb, reply))
+					{
+						return false;
+					}
 					result = RetractFilament(gb, true);
 				}
 			}
@@ -206,6 +256,10 @@ bool GCodes::HandleGcode(GCodeBuffer& gb, const StringRef& reply)
 		break;
 
 	case 11: // Un-retract
+		if (!DeferredHeaterWaitDone(gb, reply))
+		{
+			return false;
+		}
 		result = RetractFilament(gb, false);
 		break;
 
@@ -282,7 +336,18 @@ bool GCodes::HandleGcode(GCodeBuffer& gb, const StringRef& reply)
 		// which means that no gcode source other than the one that executed G32 is allowed to jog the Z axis.
 		UnlockAll(gb);
 
-		DoFileMacro(gb, BED_EQUATION_G, true);	// Try to execute bed.g
+		if (gb.Seen('T'))
+		{
+			// Iterative mode: keep running bed.g until the probed deviation is within tolerance
+			levellingTolerance = gb.GetFValue();
+			levellingRunsLeft = (gb.Seen('P')) ? max<int>(gb.GetIValue(), 1) : DefaultMaxLevellingRuns;
+			levellingRunsDone = 0;
+			StartLevellingRun(gb);
+		}
+		else
+		{
+			DoFileMacro(gb, BED_EQUATION_G, true);	// Try to execute bed.g
+		}
 		break;
 
 #if SUPPORT_WORKPLACE_COORDINATES
@@ -606,6 +671,17 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				}
 				fileResponse->cat('\n');
 			}
+#if SUPPORT_RECENT_FILES
+			else if (sparam == 4)
+			{
+				fileResponse = reprap.GetRecentFilesResponse((rparam == 0) ? RecentFiles::MaxFiles : rparam);	// send the newest G-code files in JSON format, R is the number wanted
+				if (fileResponse == nullptr)
+				{
+					return false;
+				}
+				fileResponse->cat('\n');
+			}
+#endif
 			else
 			{
 				if (!OutputBuffer::Allocate(fileResponse))
@@ -931,7 +1007,8 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 			if (seen)
 			{
 				const bool updateFile = !gb.Seen('F') || gb.GetUIValue() == 1;
-				result = SimulateFile(gb, reply, simFileName.GetRef(), updateFile);
+				const uint32_t benchmark = (gb.Seen('B')) ? gb.GetUIValue() : 0;	// B1 prepares the moves fully and reports the planner and step generation performance, B2 discards the moves and reports the G-code processing speed
+				result = SimulateFile(gb, reply, simFileName.GetRef(), updateFile, benchmark);
 			}
 			else
 			{
@@ -1432,6 +1509,12 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		break;
 
 	case 116: // Wait for set temperatures
+		if (doingToolChange && !cancelWait)
+		{
+			// Don't hold up the tool change. The first extruding move after it waits instead, so the parking and pickup moves overlap the heating.
+			DeferHeaterWait(gb);
+			break;
+		}
 		if (   !LockMovementAndWaitForStandstill(gb)		// wait until movement has finished
 			|| !IsCodeQueueIdle()							// also wait until deferred command queue has caught up to avoid out-of-order execution
 		   )
@@ -1610,7 +1693,25 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		break;
 
 	case 135: // Set PID sample interval
-		if (gb.Seen('S'))
+		if (gb.Seen('H'))
+		{
+			// Set or report the sample interval of a single heater
+			const unsigned int heater = gb.GetUIValue();
+			if (heater >= Heaters)
+			{
+				reply.copy("Invalid heater number");
+				result = GCodeResult::error;
+			}
+			else if (gb.Seen('S'))
+			{
+				result = reprap.GetHeat().SetSampleInterval(heater, gb.GetUIValue(), reply);
+			}
+			else
+			{
+				reply.printf("Heater %u sample interval is %" PRIu32 "ms", heater, reprap.GetHeat().GetSampleInterval(heater));
+			}
+		}
+		else if (gb.Seen('S'))
 		{
 			platform.SetHeatSampleTime(gb.GetFValue() * 0.001);  // Value is in milliseconds; we want seconds
 		}
@@ -1964,10 +2065,16 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				retractHop = max<float>(gb.GetFValue(), 0.0);
 				seen = true;
 			}
+			if (gb.Seen('B'))
+			{
+				blendRetraction = (gb.GetIValue() > 0);
+				seen = true;
+			}
 			if (!seen)
 			{
-				reply.printf("Retraction/un-retraction settings: length %.2f/%.2fmm, speed %d/%dmm/min, Z hop %.2fmm",
-					(double)retractLength, (double)(retractLength + retractExtra), (int)(retractSpeed * MinutesToSeconds), (int)(unRetractSpeed * MinutesToSeconds), (double)retractHop);
+				reply.printf("Retraction/un-retraction settings: length %.2f/%.2fmm, speed %d/%dmm/min, Z hop %.2fmm%s",
+					(double)retractLength, (double)(retractLength + retractExtra), (int)(retractSpeed * MinutesToSeconds), (int)(unRetractSpeed * MinutesToSeconds), (double)retractHop,
+					(blendRetraction) ? ", blended with travel moves" : "");
 			}
 		}
 		break;
@@ -2035,6 +2142,7 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				{
 					moveBuffer.feedRate *= speedFactorRatio;
 				}
+				reprap.GetMove().ChangeSpeedFactor(speedFactorRatio);	// and the moves that are queued but not yet frozen
 				speedFactor = newSpeedFactor;
 			}
 			else
@@ -2148,11 +2256,10 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 			float difference = (absolute) ? fval - currentBabyStepZOffset : fval;
 			difference = constrain<float>(difference, -1.0, 1.0);
 			currentBabyStepZOffset += difference;
-			const float amountPushed = reprap.GetMove().PushBabyStepping(difference);
-			moveBuffer.initialCoords[Z_AXIS] += amountPushed;
+			reprap.GetMove().PushBabyStepping(difference);
 
-			// The following causes all the remaining baby stepping that we didn't manage to push to be added to the [remainder of the] currently-executing move, if there is one.
-			// This could result in an abrupt Z movement, however the move will be processed as normal so the jerk limit will be honoured.
+			// The babystepping has been applied to the moves already queued, so offset the remainder of the move we are segmenting, if there is one
+			moveBuffer.initialCoords[Z_AXIS] += difference;
 			moveBuffer.coords[Z_AXIS] += difference;
 		}
 		else
@@ -2303,7 +2410,8 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 			}
 			else
 			{
-				reprap.GetHeat().StartAutoTune(heater, temperature, maxPwm, reply);
+				const bool useRelay = gb.Seen('R') && gb.GetIValue() == 1;
+				reprap.GetHeat().StartAutoTune(heater, temperature, maxPwm, useRelay, reply);
 			}
 		}
 		else
@@ -2395,6 +2503,44 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		}
 		break;
 
+	case 309: // Configure model predictive heater control
+		if (gb.Seen('H'))
+		{
+			const unsigned int heater = gb.GetUIValue();
+			if (heater < Heaters)
+			{
+				Heat& heat = reprap.GetHeat();
+				bool seen = false;
+				float feedForward = heat.GetFeedForward(heater);
+				uint32_t usePredictor = (heat.UsingPredictor(heater)) ? 1 : 0;
+				gb.TryGetFValue('S', feedForward, seen);
+				gb.TryGetUIValue('P', usePredictor, seen);
+				if (seen)
+				{
+					if (feedForward < 0.0 || feedForward > 1.0)
+					{
+						reply.copy("Feed-forward must be between 0 and 1");
+						result = GCodeResult::error;
+					}
+					else
+					{
+						heat.SetPredictiveControl(heater, feedForward, usePredictor != 0);
+					}
+				}
+				else
+				{
+					reply.printf("Heater %u extrusion feed-forward %.3f per mm/sec, dead time predictor %s",
+									heater, (double)feedForward, (usePredictor != 0) ? "on" : "off");
+				}
+			}
+			else
+			{
+				reply.copy("Invalid heater number");
+				result = GCodeResult::error;
+			}
+		}
+		break;
+
 	case 350: // Set/report microstepping
 		{
 			bool interp = (gb.Seen('I') && gb.GetIValue() > 0);
@@ -2545,6 +2691,21 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				lastAuxStatusReportType = type;
 			}
 
+			// M408 P<interval> on the aux channel asks us to push the changes in the status to PanelDue instead of it polling, P0 turns this off again
+			if (&gb == auxGCode && gb.Seen('P'))
+			{
+				if (type < 0 || type > 4)
+				{
+					reply.copy("Status updates can only be pushed for response types 0 to 4");
+					result = GCodeResult::error;
+				}
+				else
+				{
+					SetAuxStatusPush(type, gb.GetUIValue());
+				}
+				break;
+			}
+
 			OutputBuffer * const statusResponse = GenerateJsonStatusResponse(type, seq, (&gb == auxGCode) ? ResponseSource::AUX : ResponseSource::Generic);
 
 			if (statusResponse != nullptr)
@@ -2601,6 +2762,10 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		{
 			laserMaxPower = max<float>(1.0, gb.GetFValue());
 		}
+		if (result == GCodeResult::ok && gb.Seen('V'))
+		{
+			laserPowerFollowsSpeed = (gb.GetIValue() > 0);
+		}
 		break;
 
 	case 453: // Select CNC mode
@@ -3082,6 +3247,12 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 					platform.SetInstantDv(numTotalAxes + e, eVals[e] * distanceScale * SecondsToMinutes);
 				}
 			}
+
+			if (gb.Seen('J'))
+			{
+				seen = true;
+				reprap.GetMove().SetJunctionDeviation(gb.GetFValue() * distanceScale);
+			}
 			else if (!seen)
 			{
 				reply.copy("Maximum jerk rates: ");
@@ -3096,6 +3267,11 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 					reply.catf("%c%.1f", sep, (double)(platform.GetInstantDv(extruder + numTotalAxes) / (distanceScale * SecondsToMinutes)));
 					sep = ':';
 				}
+				const float junctionDeviation = reprap.GetMove().GetJunctionDeviation();
+				if (junctionDeviation > 0.0)
+				{
+					reply.catf(", junction deviation %.3f", (double)(junctionDeviation/distanceScale));
+				}
 			}
 		}
 		break;
@@ -3308,6 +3484,10 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		break;
 
 	case 572: // Set/report pressure advance
+		if (gb.Seen('T'))
+		{
+			platform.SetPressureAdvanceSmoothingTime(gb.GetFValue());
+		}
 		if (gb.Seen('S'))
 		{
 			const float advance = gb.GetFValue();
@@ -3337,6 +3517,10 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				reply.catf("%c %.3f", c, (double)platform.GetPressureAdvance(i));
 				c = ',';
 			}
+			if (platform.GetPressureAdvanceSmoothingTime() > 0.0)
+			{
+				reply.catf(", smoothing time %.3f sec", (double)platform.GetPressureAdvanceSmoothingTime());
+			}
 		}
 		break;
 
@@ -3354,6 +3538,13 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 	case 574: // Set endstop configuration
 		{
 			bool seen = false;
+#if SUPPORT_ENDSTOP_INTERRUPTS
+			if (gb.Seen('Q'))
+			{
+				platform.SetUseEndstopInterrupts(gb.GetIValue() > 0);
+				seen = true;
+			}
+#endif
 			const uint8_t inputType = (gb.Seen('S')) ? gb.GetUIValue() : 1;
 			for (size_t axis = 0; axis < numTotalAxes; ++axis)
 			{
@@ -3394,6 +3585,9 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 									);
 					}
 				}
+#if SUPPORT_ENDSTOP_INTERRUPTS
+				reply.catf(" inputs %s", (platform.GetUseEndstopInterrupts()) ? "use pin change interrupts" : "are polled");
+#endif
 			}
 		}
 		break;
@@ -3435,11 +3629,21 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				{
 					uint32_t cp = platform.GetCommsProperties(chan);
 					reply.printf("Channel %d: baud rate %" PRIu32 ", %s checksum", chan, platform.GetBaudRate(chan), (cp & 1) ? "requires" : "does not require");
+#if SUPPORT_USB_STREAMING
+					if (chan == 0 && (cp & 4) != 0)
+					{
+						reply.cat(", streaming mode");
+					}
+#endif
 				}
 			}
 		}
 		break;
 
+	case 576: // Configure pausing
+		result = reprap.GetMove().ConfigurePause(gb, reply);
+		break;
+
 	case 577: // Wait until endstop input is triggered
 		if (gb.Seen('S'))
 		{
@@ -3647,6 +3851,75 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		result = reprap.GetMove().ConfigureDynamicAcceleration(gb, reply);
 		break;
 
+#if SUPPORT_HEATER_TRACE
+	case 594: // Trace heater temperature, setpoint and PWM
+		result = HeaterTracer::Configure(gb, reply);
+		break;
+#endif
+
+	case 595: // Set heater power budget
+		{
+			Heat& heat = reprap.GetHeat();
+			bool seen = false;
+			if (gb.Seen('P'))
+			{
+				seen = true;
+				heat.SetPowerBudget(gb.GetFValue());
+			}
+			if (gb.Seen('H'))
+			{
+				// Set or report the power of a single heater
+				const unsigned int heater = gb.GetUIValue();
+				if (heater >= Heaters)
+				{
+					reply.copy("Invalid heater number");
+					result = GCodeResult::error;
+				}
+				else if (gb.Seen('W'))
+				{
+					result = heat.SetHeaterPower(heater, gb.GetFValue(), reply);
+				}
+				else
+				{
+					reply.printf("Heater %u power is %.0fW", heater, (double)heat.GetHeaterPower(heater));
+				}
+			}
+			else if (!seen)
+			{
+				if (heat.GetPowerBudget() <= 0.0)
+				{
+					reply.copy("No heater power budget");
+				}
+				else
+				{
+					reply.printf("Heater power budget %.0fW, using %.0fW", (double)heat.GetPowerBudget(), (double)heat.GetTotalHeaterPower());
+				}
+			}
+		}
+		break;
+
+	case 596: // Configure step merging
+		result = reprap.GetMove().ConfigureStepMerging(gb, reply);
+		break;
+
+#if SUPPORT_STEP_TRACE
+	case 597: // Trace step interrupt latency
+		result = StepTracer::Configure(gb, reply);
+		break;
+#endif
+
+#if HAS_LWIP_NETWORKING || HAS_WIFI_NETWORKING || HAS_W5500_NETWORKING
+	case 598: // Configure network responders and buffers
+		result = reprap.GetNetwork().ConfigureResources(gb, reply);
+		break;
+#endif
+
+#if SUPPORT_TOOL_PREHEAT
+	case 599: // Configure tool preheating
+		result = toolPreheater->Configure(gb, reply);
+		break;
+#endif
+
 	case 665: // Set delta configuration
 		if (!LockMovementAndWaitForStandstill(gb))
 		{
@@ -4210,10 +4483,166 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		break;
 #endif
 
+#if HAS_STALL_DETECT
+	case 919: // Configure dynamic motor current control
+		result = GetGCodeResultFromError(platform.ConfigureDynamicCurrent(gb, reply));
+		break;
+#endif
+
 	case 929: // Start/stop event logging
 		result = GetGCodeResultFromError(platform.ConfigureLogging(gb, reply));
 		break;
 
+	case 930: // Configure per-layer print profiling
+		result = GetGCodeResultFromError(reprap.GetPrintMonitor().ConfigureLayerProfiling(gb, reply));
+		break;
+
+#if SUPPORT_MOVE_TRACE
+	case 931: // Trace executed moves
+		result = MoveTracer::Configure(gb, reply);
+		break;
+#endif
+
+	case 932: // Set main loop module spin time budget
+		result = reprap.ConfigureSpinBudget(gb, reply);
+		break;
+
+#if SUPPORT_MOVE_MERGING
+	case 933: // Configure merging of collinear moves
+		result = reprap.GetMove().GetMerger().Configure(gb, reply);
+		break;
+#endif
+
+	case 934: // Configure minimum move duration
+		result = reprap.GetMove().ConfigureMinSegmentTime(gb, reply);
+		break;
+
+	case 935: // Set/report tool volumetric flow limit
+		if (gb.Seen('P'))
+		{
+			const int toolNumber = gb.GetIValue();
+			Tool * const tool = reprap.GetTool(toolNumber);
+			if (tool == nullptr)
+			{
+				reply.copy("Invalid tool number");
+				result = GCodeResult::error;
+			}
+			else if (gb.Seen('S'))
+			{
+				const float flow = max<float>(gb.GetFValue(), 0.0);
+				float diameter;
+				if (gb.Seen('D'))
+				{
+					diameter = gb.GetFValue();
+				}
+				else if (tool->GetFilamentDiameter() > 0.0)
+				{
+					diameter = tool->GetFilamentDiameter();
+				}
+				else
+				{
+					// Use the filament diameter from M200 if one has been set for the tool's first drive
+					const float vef = (tool->DriveCount() != 0) ? volumetricExtrusionFactors[tool->Drive(0)] : 1.0;
+					diameter = (vef == 1.0) ? FILAMENT_WIDTH : 2.0/sqrtf(vef * Pi);
+				}
+				if (diameter <= 0.0)
+				{
+					reply.copy("Filament diameter must be greater than zero");
+					result = GCodeResult::error;
+				}
+				else
+				{
+					tool->SetMaxVolumetricFlow(flow, diameter);
+				}
+			}
+			else if (tool->GetMaxVolumetricFlow() > 0.0)
+			{
+				reply.printf("Tool %d volumetric flow limit %.1fmm^3/sec with %.2fmm filament, maximum filament feed rate %.1fmm/sec",
+								toolNumber, (double)tool->GetMaxVolumetricFlow(), (double)tool->GetFilamentDiameter(), (double)tool->GetMaxExtrusionRate());
+			}
+			else
+			{
+				reply.printf("Tool %d has no volumetric flow limit", toolNumber);
+			}
+		}
+		break;
+
+#if SUPPORT_MICROSTEP_SWITCHING
+	case 936: // Configure reduced microstepping in long travel moves
+		if (!LockMovementAndWaitForStandstill(gb))				// the moves already prepared were set up using the old values
+		{
+			return false;
+		}
+		result = reprap.GetMove().ConfigureMicrostepReduction(gb, reply);
+		break;
+#endif
+
+	case 937: // Configure the movement queue length
+		if (gb.Seen('P') || gb.Seen('S'))
+		{
+			if (!LockMovementAndWaitForStandstill(gb))			// we can only add DDAs to the ring when it is empty
+			{
+				return false;
+			}
+		}
+		result = reprap.GetMove().ConfigureMovementQueue(gb, reply);
+		break;
+
+	case 938: // Select the SD card for log, trace and profile files
+		result = platform.ConfigureLogVolume(gb, reply);
+		break;
+
+	case 939: // Configure the number of files that can be open and the block size for reading G-code files
+		{
+			bool seen = false;
+			if (gb.Seen('F'))
+			{
+				seen = true;
+				result = platform.GetMassStorage()->SetNumFiles(gb.GetUIValue(), reply);
+			}
+			if (result == GCodeResult::ok && gb.Seen('B'))
+			{
+				seen = true;
+				result = fileInput->SetBlockSize(gb.GetUIValue(), reply);
+			}
+			if (!seen)
+			{
+				reply.printf("%u files of which %u free, G-code file read block size %u bytes",
+								platform.GetMassStorage()->GetNumFiles(), platform.GetMassStorage()->GetNumFreeFiles(), fileInput->GetBlockSize());
+			}
+		}
+		break;
+
+#if SUPPORT_WEB_FILE_CACHE
+	case 940: // Configure the web file cache
+		{
+			MassStorage * const massStorage = platform.GetMassStorage();
+			FileCache& cache = massStorage->GetWebFileCache();
+			if (gb.Seen('S'))
+			{
+				const size_t size = gb.GetUIValue();
+				const size_t maxFiles = (gb.Seen('N')) ? gb.GetUIValue() : DefaultMaxCachedWebFiles;
+				const size_t maxFileSize = (gb.Seen('L')) ? gb.GetUIValue() : DefaultMaxCachedWebFileSize;
+				result = massStorage->AllocateWebFileCache(size, maxFiles, maxFileSize, reply);
+			}
+			else if (cache.IsAllocated())
+			{
+				reply.printf("Web file cache size %u bytes, max file size %u bytes", cache.GetSize(), cache.GetMaxFileSize());
+			}
+			else
+			{
+				reply.copy("Web file cache is not in use");
+			}
+		}
+		break;
+#endif
+
+#if SUPPORT_KINEMATICS_BENCHMARK
+	case 942: // Benchmark the kinematics
+		result = KinematicsBenchmark::Run(gb, reply);
+		break;
+#endif
+
 	case 997: // Perform firmware update
 		result = UpdateFirmware(gb, reply);
 		break;
@@ -294,17 +294,30 @@ GCodeResult GCodes::DefineGrid(GCodeBuffer& gb, const StringRef &reply)
 	float radius = -1.0;
 	gb.TryGetFValue('R', radius, seenR);
 
+	// The I parameter selects bilinear (I0) or bicubic (I1) interpolation of the height map
+	HeightMap& heightMap = reprap.GetMove().AccessHeightMap();
+	bool seenI = false;
+	if (gb.Seen('I'))
+	{
+		seenI = true;
+		heightMap.UseBicubicInterpolation(gb.GetIValue() > 0);
+	}
+
 	if (!seenX && !seenY && !seenR && !seenS)
 	{
-		// Just print the existing grid parameters
-		if (defaultGrid.IsValid())
+		if (!seenI)
 		{
-			reply.copy("Grid: ");
-			defaultGrid.PrintParameters(reply);
-		}
-		else
-		{
-			reply.copy("Grid is not defined");
+			// Just print the existing grid parameters
+			if (defaultGrid.IsValid())
+			{
+				reply.copy("Grid: ");
+				defaultGrid.PrintParameters(reply);
+			}
+			else
+			{
+				reply.copy("Grid is not defined");
+			}
+			reply.catf(", %s interpolation", (heightMap.UsingBicubicInterpolation()) ? "bicubic" : "bilinear");
 		}
 		return GCodeResult::ok;
 	}
@@ -354,7 +367,7 @@ GCodeResult GCodes::DefineGrid(GCodeBuffer& gb, const StringRef &reply)
 }
 
 // Handle M37 to simulate a whole file
-GCodeResult GCodes::SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile)
+GCodeResult GCodes::SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile, uint32_t benchmark)
 {
 	if (reprap.GetPrintMonitor().IsPrinting())
 	{
@@ -373,12 +386,28 @@ GCodeResult GCodes::SimulateFile(GCodeBuffer& gb, const StringRef &reply, const
 		}
 		simulationTime = 0.0;
 		exitSimulationWhenFileComplete = true;
-		updateFileWhenSimulationComplete = updateFile;
-		simulationMode = 1;
-		reprap.GetMove().Simulate(simulationMode);
+		parseBenchmarking = (benchmark == 2);
+		if (parseBenchmarking)
+		{
+			// Simulation mode 2 discards the moves once we have set them up, so that we measure how fast we can process the file
+			updateFileWhenSimulationComplete = false;
+			simulationMode = 2;
+			parseBenchmarkLines = 0;
+			parseBenchmarkStartMillis = millis();
+			fileReadTimer.Reset();
+			parseTimer.Reset();
+			executeTimer.Reset();
+			StageTimer::EnableCycleCounter();
+		}
+		else
+		{
+			updateFileWhenSimulationComplete = updateFile;
+			simulationMode = 1;
+		}
+		reprap.GetMove().Simulate(simulationMode, benchmark == 1);
 		reprap.GetPrintMonitor().StartingPrint(file.c_str());
 		StartPrinting(true);
-		reply.printf("Simulating print of file %s", file.c_str());
+		reply.printf((benchmark != 0) ? "Benchmarking print of file %s" : "Simulating print of file %s", file.c_str());
 		return GCodeResult::ok;
 	}
 
@@ -411,7 +440,7 @@ GCodeResult GCodes::ChangeSimulationMode(GCodeBuffer& gb, const StringRef &reply
 			}
 			simulationTime = 0.0;
 		}
-		exitSimulationWhenFileComplete = updateFileWhenSimulationComplete = false;
+		exitSimulationWhenFileComplete = updateFileWhenSimulationComplete = parseBenchmarking = false;
 		simulationMode = (uint8_t)newSimulationMode;
 		reprap.GetMove().Simulate(simulationMode);
 	}
@@ -460,6 +489,7 @@ GCodeResult GCodes::SetOrReportZProbe(GCodeBuffer& gb, const StringRef &reply)
 
 	gb.TryGetFValue('R', params.recoveryTime, seenParam);	// Z probe recovery time
 	gb.TryGetFValue('S', params.tolerance, seenParam);		// tolerance when multi-tapping
+	gb.TryGetFValue('V', params.maxStdDev, seenParam);		// standard deviation limit when multi-tapping statistically
 
 	if (gb.Seen('A'))
 	{
@@ -467,6 +497,12 @@ GCodeResult GCodes::SetOrReportZProbe(GCodeBuffer& gb, const StringRef &reply)
 		seenParam = true;
 	}
 
+	if (gb.Seen('J'))
+	{
+		params.interpolateTrigger = (gb.GetIValue() != 0);
+		seenParam = true;
+	}
+
 	if (seenParam)
 	{
 		platform.SetZProbeParameters(platform.GetZProbeType(), params);
@@ -474,12 +510,12 @@ GCodeResult GCodes::SetOrReportZProbe(GCodeBuffer& gb, const StringRef &reply)
 
 	if (!(seenType || seenParam))
 	{
-		reply.printf("Z Probe type %u, invert %s, dive height %.1fmm, probe speed %dmm/min, travel speed %dmm/min, recovery time %.2f sec, heaters %s, max taps %u, max diff %.2f",
+		reply.printf("Z Probe type %u, invert %s, dive height %.1fmm, probe speed %dmm/min, travel speed %dmm/min, recovery time %.2f sec, heaters %s, max taps %u, max diff %.2f, max std dev %.3f, interpolate trigger %s",
 						(unsigned int)platform.GetZProbeType(), (params.invertReading) ? "yes" : "no", (double)params.diveHeight,
 						(int)(params.probeSpeed * MinutesToSeconds), (int)(params.travelSpeed * MinutesToSeconds),
 						(double)params.recoveryTime,
 						(params.turnHeatersOff) ? "suspended" : "normal",
-						params.maxTaps, (double)params.tolerance);
+						params.maxTaps, (double)params.tolerance, (double)params.maxStdDev, (params.interpolateTrigger) ? "yes" : "no");
 	}
 	return GCodeResult::ok;
 }
@@ -598,6 +634,7 @@ GCodeResult GCodes::DoDriveMapping(GCodeBuffer& gb, const StringRef& reply)
 	}
 
 	bool seen = false, badDrive = false;
+	const int rotationParam = (gb.Seen('R')) ? gb.GetIValue() : -1;		// R1 makes the axes in this command continuous rotation axes, R0 makes them normal axes
 	const char *lettersToTry = "XYZUVWABC";
 	char c;
 	while ((c = *lettersToTry) != 0)
@@ -648,6 +685,14 @@ GCodeResult GCodes::DoDriveMapping(GCodeBuffer& gb, const StringRef& reply)
 				}
 				reprap.GetMove().SetNewPosition(moveBuffer.coords, true);	// tell the Move system where any new axes are
 				platform.SetAxisDriversConfig(drive, config);
+				if (rotationParam == 1)
+				{
+					SetBit(continuousRotationAxes, drive);
+				}
+				else if (rotationParam == 0)
+				{
+					ClearBit(continuousRotationAxes, drive);
+				}
 				if (numTotalAxes + numExtruders > DRIVES)
 				{
 					numExtruders = DRIVES - numTotalAxes;		// if we added axes, we may have fewer extruders now
@@ -712,6 +757,10 @@ GCodeResult GCodes::DoDriveMapping(GCodeBuffer& gb, const StringRef& reply)
 					reply.catf("%c%u", c, axisConfig.driverNumbers[i]);
 					c = ':';
 				}
+				if (IsBitSet(continuousRotationAxes, drive))
+				{
+					reply.cat("(continuous)");
+				}
 			}
 			reply.cat(' ');
 			char c = extrudeLetter;
@@ -872,6 +921,12 @@ GCodeResult GCodes::SetDateTime(GCodeBuffer& gb, const StringRef& reply)
 // Handle M997
 GCodeResult GCodes::UpdateFirmware(GCodeBuffer& gb, const StringRef &reply)
 {
+	if (gb.Seen('V'))
+	{
+		// Just verify the main firmware binary, which we can do while printing
+		return platform.StageFirmwareUpdate(gb, reply);
+	}
+
 	if (!LockMovementAndWaitForStandstill(gb))
 	{
 		return GCodeResult::notFinished;
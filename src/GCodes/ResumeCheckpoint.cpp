@@ -0,0 +1,211 @@
+/*
+ * ResumeCheckpoint.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "ResumeCheckpoint.h"
+
+#if SUPPORT_RESUME_CHECKPOINT
+
+#include "CRC32.h"
+#include "FileStore.h"
+#include "MassStorage.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+ResumeCheckpoint::ResumeCheckpoint() : file(nullptr), settingsAreaBeingWritten(0)
+{
+	memset(&header, 0, sizeof(header));
+}
+
+// Open the checkpoint file at the start of a print, creating it and extending it to its full size if necessary.
+// Any state that it holds is discarded, because it belongs to a previous print.
+bool ResumeCheckpoint::Open()
+{
+	if (file != nullptr)
+	{
+		return true;
+	}
+
+	Platform& platform = reprap.GetPlatform();
+	file = platform.OpenFile(platform.GetSysDir(), CheckpointFileName, OpenMode::append);		// open for random access, creating the file if necessary
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	// Allocate all the space now, so that updating the checkpoint never needs to allocate clusters or update the directory entry
+	bool ok = true;
+	if (file->Length() < FileSize)
+	{
+		char zeros[CopyBufferSize];
+		memset(zeros, 0, sizeof(zeros));
+		ok = file->Seek(file->Length());
+		while (ok && file->Length() < FileSize)
+		{
+			ok = file->Write(zeros, min<size_t>(sizeof(zeros), FileSize - file->Length()));
+		}
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = Magic;
+	header.version = Version;
+	if (!ok || !WriteHeader())
+	{
+		file->Close();
+		file = nullptr;
+		return false;
+	}
+	return true;
+}
+
+// Close the checkpoint file. If 'discardState' is true then any state that we saved will not be recovered when we next start up.
+void ResumeCheckpoint::Close(bool discardState)
+{
+	if (file != nullptr)
+	{
+		if (discardState && header.stateValid)
+		{
+			header.stateValid = false;
+			(void)WriteHeader();
+		}
+		file->Close();
+		file = nullptr;
+	}
+}
+
+// Get ready to write the settings text. We write it to the area that is not current, so that the current settings survive if the power fails first.
+FileStore *ResumeCheckpoint::BeginSettings()
+{
+	if (file == nullptr)
+	{
+		return nullptr;
+	}
+	settingsAreaBeingWritten = (header.settingsValid) ? 1 - header.settingsArea : header.settingsArea;
+	return (file->Seek(SettingsAreaOffset(settingsAreaBeingWritten))) ? file : nullptr;
+}
+
+// Finish writing the settings text. If it was written successfully and fits in its area, make it current.
+// We only write the settings while the print is running, so any state that we saved earlier is out of date and we discard it.
+// Return true if the checkpoint holds valid settings afterwards.
+bool ResumeCheckpoint::EndSettings(bool ok)
+{
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	const FilePosition length = file->Position() - SettingsAreaOffset(settingsAreaBeingWritten);
+	if (ok && length <= SettingsAreaSize)
+	{
+		header.settingsArea = settingsAreaBeingWritten;
+		header.settingsLength = length;
+		header.settingsValid = true;
+		header.stateValid = false;
+	}
+	else if (settingsAreaBeingWritten == 0 && length > SettingsAreaSize)
+	{
+		header.settingsValid = header.stateValid = false;				// we have overwritten the start of the other area
+	}
+	else
+	{
+		return header.settingsValid;									// the current settings are untouched
+	}
+	return WriteHeader() && header.settingsValid;
+}
+
+// Save the state of the print so that it is recovered when we next start up. This just rewrites the header sector.
+bool ResumeCheckpoint::SaveState(const ResumeState& rs)
+{
+	if (file == nullptr || !header.settingsValid)
+	{
+		return false;
+	}
+	header.state = rs;
+	header.stateValid = true;
+	return WriteHeader();
+}
+
+// If the checkpoint holds a state that has not been recovered, leave the file open and return the state
+bool ResumeCheckpoint::Recover(ResumeState& rs)
+{
+	Platform& platform = reprap.GetPlatform();
+
+	// Check that the file exists before we open it, because opening it for writing would create it
+	if (file != nullptr || !platform.GetMassStorage()->FileExists(platform.GetSysDir(), CheckpointFileName))
+	{
+		return false;
+	}
+
+	file = platform.OpenFile(platform.GetSysDir(), CheckpointFileName, OpenMode::append);
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	if (   file->Seek(0)
+		&& file->Read(reinterpret_cast<char *>(&header), sizeof(Header)) == (int)sizeof(Header)
+		&& header.magic == Magic
+		&& header.version == Version
+		&& header.crc == CalcCrc(header)
+		&& header.stateValid
+		&& header.settingsValid
+		&& header.settingsLength <= SettingsAreaSize
+	   )
+	{
+		rs = header.state;
+		return true;
+	}
+
+	file->Close();
+	file = nullptr;
+	return false;
+}
+
+// Copy the current settings text to another file
+bool ResumeCheckpoint::CopySettings(FileStore *dst)
+{
+	if (file == nullptr || !header.settingsValid || !file->Seek(SettingsAreaOffset(header.settingsArea)))
+	{
+		return false;
+	}
+
+	char buf[CopyBufferSize];
+	size_t remaining = header.settingsLength;
+	while (remaining != 0)
+	{
+		const size_t len = min<size_t>(remaining, sizeof(buf));
+		if (file->Read(buf, len) != (int)len || !dst->Write(buf, len))
+		{
+			return false;
+		}
+		remaining -= len;
+	}
+	return true;
+}
+
+// Mark the state as recovered, so that we don't recover it again, and close the file
+void ResumeCheckpoint::Recovered()
+{
+	Close(true);
+}
+
+/*static*/ uint32_t ResumeCheckpoint::CalcCrc(const Header& h)
+{
+	CRC32 crc;
+	crc.Update(reinterpret_cast<const char *>(&h), offsetof(Header, crc));
+	return crc.Get();
+}
+
+// Write the header and make sure that it reaches the card
+bool ResumeCheckpoint::WriteHeader()
+{
+	++header.sequence;
+	header.crc = CalcCrc(header);
+	return file->Seek(0) && file->Write(reinterpret_cast<const char *>(&header), sizeof(Header)) && file->Flush();
+}
+
+#endif
+
+// End
@@ -0,0 +1,99 @@
+/*
+ * ResumeCheckpoint.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  A fixed-layout file that holds the information needed to resume a print, so that when the power fails we only need to overwrite one sector
+ *  instead of creating and writing resurrect.g. The settings that rarely change during a print (heater temperatures, tool settings and the height map)
+ *  are kept as text in one of two areas, which we update alternately at layer changes and when the print is paused. The rest of the state is kept
+ *  in binary in the header. If the power fails, resurrect.g is generated from the checkpoint when we next start up.
+ */
+
+#ifndef SRC_GCODES_RESUMECHECKPOINT_H_
+#define SRC_GCODES_RESUMECHECKPOINT_H_
+
+#include "RepRapFirmware.h"
+
+class FileStore;
+
+// The state that we need to resume a print, apart from the settings that we write as text
+struct ResumeState
+{
+	char fileName[MaxFilenameLength];
+	time_t saveTime;										// the time at which the state was saved, or 0 if the date and time were not set
+	FilePosition filePos;
+	float proportionDone;
+	float moveCoords[MaxAxes];
+	float feedRate;
+	float virtualExtruderPosition;
+	float babyStepOffset;
+	float defaultFanSpeed;
+	float fanSpeeds[NUM_FANS];
+	uint32_t fansToRestore;									// bitmap of the fans that are not thermostatic
+	float volumetricExtrusionFactors[MaxExtruders];
+#if SUPPORT_LASER || SUPPORT_IOBITS
+	LaserPwmOrIoBits laserPwmOrIoBits;
+#endif
+	uint8_t numAxes;
+	uint8_t numExtruders;
+	bool wasPowerFailure;
+	bool volumetricExtrusion;
+	bool drivesRelative;
+	bool isLaser;
+};
+
+#if SUPPORT_RESUME_CHECKPOINT
+
+class ResumeCheckpoint
+{
+public:
+	ResumeCheckpoint();
+
+	bool Open();											// open or create the checkpoint file at the start of a print
+	void Close(bool discardState);							// close the checkpoint file at the end of a print
+	bool IsOpen() const { return file != nullptr; }
+
+	FileStore *BeginSettings();								// get ready to write the settings text, returning the file to write it to
+	bool EndSettings(bool ok);								// finish writing the settings text, and make it current if successful
+	bool SaveState(const ResumeState& rs);					// save the state of the print, returning true if the checkpoint is complete
+
+	bool Recover(ResumeState& rs);							// if the checkpoint holds a state that we have not recovered, open it and return the state
+	bool CopySettings(FileStore *dst);						// copy the current settings text to another file
+	void Recovered();										// mark the state as recovered and close the file
+
+private:
+	static constexpr const char *CheckpointFileName = "resurrect.bin";
+	static constexpr uint32_t Magic = 0x4B435052;			// "RPCK"
+	static constexpr uint16_t Version = 1;					// change this if the layout of the header or the state changes
+	static constexpr FilePosition HeaderSize = 512;			// the header occupies a sector, so that saving the state needs just one sector write
+	static constexpr FilePosition SettingsAreaSize = 2048;
+	static constexpr FilePosition FileSize = HeaderSize + 2 * SettingsAreaSize;
+	static constexpr size_t CopyBufferSize = 256;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint8_t settingsArea;								// which settings area is current
+		bool settingsValid;									// true if the current settings area holds complete settings
+		bool stateValid;									// true if we have saved a state that has not been recovered
+		uint32_t settingsLength;
+		uint32_t sequence;									// incremented each time we write the header
+		ResumeState state;
+		uint32_t crc;										// CRC of everything above
+	};
+
+	static_assert(sizeof(Header) <= HeaderSize, "Resume checkpoint header too large");
+
+	static FilePosition SettingsAreaOffset(unsigned int area) { return HeaderSize + area * SettingsAreaSize; }
+	static uint32_t CalcCrc(const Header& h);
+	bool WriteHeader();
+
+	FileStore *file;
+	Header header;
+	uint8_t settingsAreaBeingWritten;
+};
+
+#endif
+
+#endif /* SRC_GCODES_RESUMECHECKPOINT_H_ */
@@ -0,0 +1,540 @@
+/*
+ * ToolPreheater.cpp
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  We estimate how long the print will take to reach the next tool change by adding up the durations of the moves before it at their requested feed rates.
+ *  This ignores acceleration, treats arcs as straight lines, and measures from the command being executed instead of the move being made. All of these
+ *  make the estimate shorter than the real time, so preheating starts a little early, which is better than late. Speed factor changes are not allowed for.
+ */
+
+#include "ToolPreheater.h"
+
+#if SUPPORT_TOOL_PREHEAT
+
+#include "GCodeBuffer.h"
+#include "Heating/Heat.h"
+#include "Platform.h"
+#include "PrintMonitor.h"
+#include "RepRap.h"
+#include "Storage/FileStore.h"
+#include "Tools/Tool.h"
+
+ToolPreheater::ToolPreheater()
+	: file(nullptr), enabled(false), extraLeadTime(DefaultExtraLeadTime), maxLookahead(DefaultMaxLookahead), numPreheats(0)
+{
+	Stop();
+}
+
+// Process M599. M599 S1 enables preheating and S0 disables it, R sets the extra lead time in seconds, L sets how far ahead we scan in seconds.
+GCodeResult ToolPreheater::Configure(GCodeBuffer& gb, const StringRef& reply)
+{
+	bool seen = false;
+	if (gb.Seen('R'))
+	{
+		seen = true;
+		extraLeadTime = max<float>(gb.GetFValue(), 0.0);
+	}
+	if (gb.Seen('L'))
+	{
+		seen = true;
+		maxLookahead = constrain<float>(gb.GetFValue(), CheckpointInterval, (NumCheckpoints - 1) * CheckpointInterval);
+	}
+	if (gb.Seen('S'))
+	{
+		seen = true;
+		enabled = (gb.GetIValue() > 0);
+		if (!enabled)
+		{
+			Stop();
+		}
+	}
+
+	if (!seen)
+	{
+		reply.printf("Tool preheating is %s, extra lead time %.1fs, lookahead %.0fs",
+						(enabled) ? "enabled" : "disabled", (double)extraLeadTime, (double)maxLookahead);
+	}
+	return GCodeResult::ok;
+}
+
+// Stop scanning and forget what we found
+void ToolPreheater::Stop()
+{
+	if (file != nullptr)
+	{
+		file->Close();
+		file = nullptr;
+	}
+	fileEnded = false;
+	toolChangeFound = false;
+	numCheckpoints = 0;
+}
+
+// Scan some more of the file if we need to and start heating the next tool when it is time to
+void ToolPreheater::Spin(const GCodeBuffer& gb, FilePosition printPos)
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	if (file == nullptr)
+	{
+		if (fileEnded || !Restart(gb, printPos))
+		{
+			fileEnded = true;								// don't keep trying to open the file if we couldn't open it
+			return;
+		}
+	}
+
+	if (toolChangeFound && printPos >= toolChangeEndPos)
+	{
+		// The print has passed the tool change, so look for the next one
+		toolChangeFound = false;
+		scanTool = nextTool;
+	}
+
+	// If the print has moved outside the part of the file that we have scanned, start again from where it is now
+	if (printPos < checkpoints[firstCheckpoint].filePos || printPos > scanPos)
+	{
+		if (!Restart(gb, printPos))
+		{
+			return;
+		}
+	}
+
+	// Discard the checkpoints that the print has passed, except for the last one
+	while (numCheckpoints > 1 && checkpoints[(firstCheckpoint + 1) % NumCheckpoints].filePos <= printPos)
+	{
+		firstCheckpoint = (firstCheckpoint + 1) % NumCheckpoints;
+		--numCheckpoints;
+	}
+
+	if (toolChangeFound)
+	{
+		if (!preheated)
+		{
+			const Tool * const tool = reprap.GetTool(nextTool);
+			if (tool == nullptr)
+			{
+				preheated = true;							// the tool doesn't exist, so GCodes will report an error when it gets there
+			}
+			else if (toolChangeTime - GetPrintTime(printPos) <= GetLeadTime(*tool))
+			{
+				Preheat(*tool);
+				preheated = true;
+			}
+		}
+	}
+	else if (!fileEnded && numCheckpoints < NumCheckpoints && scanTime - GetPrintTime(printPos) < maxLookahead)
+	{
+		ScanChunk(gb.GetToolNumberAdjust());
+	}
+}
+
+void ToolPreheater::Diagnostics(MessageType mtype)
+{
+	if (enabled)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Tool preheats: %u\n", numPreheats);
+		numPreheats = 0;
+	}
+}
+
+// Start scanning from the current print position, opening our own handle on the file if we haven't already. Return false if we can't read the file.
+bool ToolPreheater::Restart(const GCodeBuffer& gb, FilePosition printPos)
+{
+	if (file == nullptr)
+	{
+		const char * const fileName = reprap.GetPrintMonitor().GetPrintingFilename();
+		if (fileName == nullptr)
+		{
+			return false;
+		}
+		Platform& platform = reprap.GetPlatform();
+		file = platform.OpenFile(platform.GetGCodeDir(), fileName, OpenMode::read);
+		if (file == nullptr)
+		{
+			return false;
+		}
+		char signature[BinaryGCode::SignatureLength];
+		binaryFile = file->Read(signature, sizeof(signature)) == (int)sizeof(signature) && memcmp(signature, BinaryGCode::FileSignature, sizeof(signature)) == 0;
+	}
+
+	if (!file->Seek(printPos))
+	{
+		Stop();
+		return false;
+	}
+
+	scanPos = printPos;
+	scanTime = 0.0;
+	firstCheckpoint = 0;
+	numCheckpoints = 1;
+	checkpoints[0].filePos = printPos;
+	checkpoints[0].time = 0.0;
+
+	const GCodeMachineState& ms = gb.OriginalMachineState();
+	axesRelative = ms.axesRelative;
+	drivesRelative = ms.drivesRelative;
+	coordsKnown = 0;
+	feedRate = DefaultFeedRate;
+	fileEnded = inComment = false;
+	lineLength = recordLength = 0;
+
+	scanTool = reprap.GetCurrentToolNumber();
+	toolChangeFound = false;
+	return true;
+}
+
+// Scan the next chunk of the file
+void ToolPreheater::ScanChunk(int toolNumberAdjust)
+{
+	char buf[ReadChunkSize];
+	const int nRead = file->Read(buf, ReadChunkSize);
+	if (nRead <= 0)
+	{
+		fileEnded = true;
+		return;
+	}
+
+	for (int i = 0; i < nRead; ++i)
+	{
+		++scanPos;
+		if (ProcessByte(buf[i], toolNumberAdjust))
+		{
+			// Put the file position back to just after the tool change, so that we scan the rest of this chunk when we continue
+			if (i + 1 < nRead && !file->Seek(scanPos))
+			{
+				fileEnded = true;
+			}
+			return;
+		}
+	}
+}
+
+// Process the next byte of the file, returning true if it completed a tool change command
+bool ToolPreheater::ProcessByte(char c, int toolNumberAdjust)
+{
+	if (recordLength != 0)
+	{
+		recordBuffer[recordLength++] = (uint8_t)c;
+		if (recordLength == BinaryGCode::RecordHeaderLength)
+		{
+			if (!BinaryGCode::IsValidRecordHeader(recordBuffer[0], recordBuffer[1]))
+			{
+				recordLength = 0;							// FileGCodeInput will report the bad record when it gets there
+				return false;
+			}
+			recordTotal = BinaryGCode::RecordLength(recordBuffer[1]);
+		}
+		if (recordLength == recordTotal)
+		{
+			ProcessBinaryRecord();
+			recordLength = 0;
+			AddCheckpoint();
+		}
+		return false;
+	}
+
+	if (binaryFile && lineLength == 0 && !inComment && ((uint8_t)c & BinaryGCode::RecordFlag) != 0)
+	{
+		recordBuffer[0] = (uint8_t)c;
+		recordLength = 1;
+		recordTotal = BinaryGCode::RecordHeaderLength;
+		return false;
+	}
+
+	if (c == '\n' || c == '\r')
+	{
+		bool foundToolChange = false;
+		if (lineLength != 0)
+		{
+			lineBuffer[lineLength] = 0;
+			foundToolChange = ProcessLine(toolNumberAdjust);
+			lineLength = 0;
+		}
+		inComment = false;
+		AddCheckpoint();
+		return foundToolChange;
+	}
+
+	if (c == ';')
+	{
+		inComment = true;
+	}
+	else if (!inComment && lineLength < MaxLineLength)
+	{
+		lineBuffer[lineLength++] = c;
+	}
+	return false;
+}
+
+// Process a line of ASCII G-code, returning true if it is a tool change
+bool ToolPreheater::ProcessLine(int toolNumberAdjust)
+{
+	const char *p = lineBuffer;
+	while (*p == ' ' || *p == '\t')
+	{
+		++p;
+	}
+	if (toupper(*p) == 'N')
+	{
+		do
+		{
+			++p;
+		} while (isdigit(*p) || *p == ' ' || *p == '\t');
+	}
+
+	const char letter = toupper(*p);
+	const char *q;
+	const long code = SafeStrtol(p + 1, &q);
+	if (q == p + 1)
+	{
+		return false;
+	}
+
+	switch (letter)
+	{
+	case 'G':
+		switch (code)
+		{
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+		case 92:
+			{
+				float values[paramF + 1];
+				uint8_t params = 0;
+				for (size_t i = 0; i < ARRAY_SIZE(values); ++i)
+				{
+					if (GetParameter(q, BinaryGCode::ParameterLetters[i], values[i]))
+					{
+						params |= 1u << i;
+					}
+				}
+				AddMove(params, values, code == 92);
+			}
+			break;
+
+		case 4:
+			{
+				float dwell;
+				if (GetParameter(q, 'S', dwell))
+				{
+					scanTime += max<float>(dwell, 0.0);
+				}
+				else if (GetParameter(q, 'P', dwell))
+				{
+					scanTime += max<float>(dwell * MillisToSeconds, 0.0);
+				}
+			}
+			break;
+
+		case 90:
+		case 91:
+			axesRelative = (code == 91);
+			break;
+
+		default:
+			break;
+		}
+		break;
+
+	case 'M':
+		if (code == 82 || code == 83)
+		{
+			drivesRelative = (code == 83);
+		}
+		break;
+
+	case 'T':
+		{
+			const int tool = (code < 0) ? -1 : (int)code + toolNumberAdjust;
+			if (tool != scanTool)
+			{
+				if (tool < 0)
+				{
+					scanTool = tool;						// deselecting the tool, so there is nothing to preheat
+				}
+				else
+				{
+					nextTool = tool;
+					toolChangeEndPos = scanPos;
+					toolChangeTime = scanTime;
+					toolChangeFound = true;
+					preheated = false;
+					return true;
+				}
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+	return false;
+}
+
+// Process a binary move record
+void ToolPreheater::ProcessBinaryRecord()
+{
+	float values[BinaryGCode::NumParameters];
+	const uint8_t params = recordBuffer[1];
+	const uint8_t *p = recordBuffer + BinaryGCode::RecordHeaderLength;
+	for (size_t i = 0; i < BinaryGCode::NumParameters; ++i)
+	{
+		if ((params & (1u << i)) != 0)
+		{
+			memcpy(&values[i], p, sizeof(float));
+			p += sizeof(float);
+		}
+	}
+	AddMove(params & ((1u << (paramF + 1)) - 1), values, false);
+}
+
+// Add the time that a move takes to the estimated print time, or just record the new position if it is a G92 command
+void ToolPreheater::AddMove(uint8_t params, const float values[], bool setPosition)
+{
+	if (!setPosition && (params & (1u << paramF)) != 0 && values[paramF] > 0.0)
+	{
+		feedRate = values[paramF] * SecondsToMinutes;
+	}
+
+	float distanceSquared = 0.0, extrusion = 0.0;
+	for (size_t i = paramX; i <= paramE; ++i)
+	{
+		if ((params & (1u << i)) != 0)
+		{
+			const bool relative = !setPosition && ((i == paramE) ? drivesRelative : axesRelative);
+			if (!setPosition)
+			{
+				const float delta = (relative) ? values[i]
+									: ((coordsKnown & (1u << i)) != 0) ? values[i] - coords[i]
+										: 0.0;								// we don't know where the last move went, so we can't tell how far this one goes
+				if (i == paramE)
+				{
+					extrusion = fabsf(delta);
+				}
+				else
+				{
+					distanceSquared += fsquare(delta);
+				}
+			}
+			if (relative)
+			{
+				coords[i] += values[i];
+			}
+			else
+			{
+				coords[i] = values[i];
+				coordsKnown |= 1u << i;
+			}
+		}
+	}
+
+	if (!setPosition)
+	{
+		const float distance = (distanceSquared > 0.0) ? sqrtf(distanceSquared) : extrusion;
+		scanTime += distance/feedRate;
+	}
+}
+
+// Record the estimated print time at the current scan position if it is time for another checkpoint
+void ToolPreheater::AddCheckpoint()
+{
+	const Checkpoint& last = checkpoints[(firstCheckpoint + numCheckpoints - 1) % NumCheckpoints];
+	if (numCheckpoints < NumCheckpoints && scanTime - last.time >= CheckpointInterval)
+	{
+		Checkpoint& cp = checkpoints[(firstCheckpoint + numCheckpoints) % NumCheckpoints];
+		cp.filePos = scanPos;
+		cp.time = scanTime;
+		++numCheckpoints;
+	}
+}
+
+// Estimate the print time at a file position by interpolating between the checkpoints either side of it
+float ToolPreheater::GetPrintTime(FilePosition printPos) const
+{
+	const Checkpoint& from = checkpoints[firstCheckpoint];
+	FilePosition toPos;
+	float toTime;
+	if (numCheckpoints > 1)
+	{
+		const Checkpoint& to = checkpoints[(firstCheckpoint + 1) % NumCheckpoints];
+		toPos = to.filePos;
+		toTime = to.time;
+	}
+	else
+	{
+		toPos = scanPos;
+		toTime = scanTime;
+	}
+	return (toPos > from.filePos)
+			? from.time + (toTime - from.time) * (float)(printPos - from.filePos)/(float)(toPos - from.filePos)
+				: from.time;
+}
+
+// Get how long before the tool change we need to start heating a tool, which is how long its slowest heater takes to reach its active temperature
+float ToolPreheater::GetLeadTime(const Tool& tool) const
+{
+	const Heat& heat = reprap.GetHeat();
+	float leadTime = 0.0;
+	for (size_t i = 0; i < tool.HeaterCount(); ++i)
+	{
+		const int heater = tool.Heater(i);
+		if (heater >= 0 && heater < (int)Heaters)
+		{
+			leadTime = max<float>(leadTime, heat.EstimateHeatingTime(heater, tool.GetToolHeaterActiveTemperature(i)));
+		}
+	}
+	return leadTime + extraLeadTime;
+}
+
+// Set the heaters of a tool to their active temperatures, except for any that the current tool also uses
+void ToolPreheater::Preheat(const Tool& tool)
+{
+	const Tool * const currentTool = reprap.GetCurrentTool();
+	Heat& heat = reprap.GetHeat();
+	for (size_t i = 0; i < tool.HeaterCount(); ++i)
+	{
+		const int heater = tool.Heater(i);
+		bool sharedWithCurrentTool = false;
+		if (currentTool != nullptr)
+		{
+			for (size_t j = 0; j < currentTool->HeaterCount(); ++j)
+			{
+				if (currentTool->Heater(j) == heater)
+				{
+					sharedWithCurrentTool = true;
+				}
+			}
+		}
+		if (!sharedWithCurrentTool)
+		{
+			heat.SetActiveTemperature(heater, tool.GetToolHeaterActiveTemperature(i));
+			heat.Activate(heater);
+		}
+	}
+	++numPreheats;
+}
+
+// Look for a parameter in the rest of a command line and get its value
+/*static*/ bool ToolPreheater::GetParameter(const char *p, char letter, float& value)
+{
+	for (; *p != 0; ++p)
+	{
+		if (toupper(*p) == letter)
+		{
+			value = SafeStrtof(p + 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif
+
+// End
@@ -0,0 +1,99 @@
+/*
+ * ToolPreheater.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Scans ahead in the file being printed for the next tool change, and starts heating the next tool to its active temperature
+ *  early enough for it to be ready when the tool change is reached, according to the process models of its heaters.
+ */
+
+#ifndef SRC_GCODES_TOOLPREHEATER_H_
+#define SRC_GCODES_TOOLPREHEATER_H_
+
+#include "RepRapFirmware.h"
+#include "GCodeResult.h"
+#include "MessageType.h"
+#include "BinaryGCode.h"
+
+#if SUPPORT_TOOL_PREHEAT
+
+class ToolPreheater
+{
+public:
+	ToolPreheater();
+
+	GCodeResult Configure(GCodeBuffer& gb, const StringRef& reply);		// process M599
+	void Spin(const GCodeBuffer& gb, FilePosition printPos);			// called from GCodes::Spin while printing from SD card
+	void Stop();														// called when a print is stopped
+	void Diagnostics(MessageType mtype);
+
+private:
+	static constexpr size_t NumCheckpoints = 32;
+	static constexpr float CheckpointInterval = 2.0;				// the estimated print time between checkpoints, in seconds
+	static constexpr float DefaultMaxLookahead = 120.0;				// how far ahead we scan by default, in seconds of estimated print time
+	static constexpr float DefaultExtraLeadTime = 5.0;				// how much longer than the heating time we allow by default, in seconds
+	static constexpr float DefaultFeedRate = 50.0;					// the feed rate we assume until we see an F parameter, in mm/sec
+	static constexpr size_t ReadChunkSize = 256;					// how much of the file we scan on each call to Spin
+	static constexpr size_t MaxLineLength = 100;					// longer lines are truncated, which doesn't matter for the commands we look at
+
+	// A checkpoint records the estimated print time at which the print reaches a file position, measured from when we started scanning
+	struct Checkpoint
+	{
+		FilePosition filePos;
+		float time;
+	};
+
+	// The parameters of a move that we use to estimate its duration, in the same order as the parameter bitmap of a binary move record
+	enum MoveParameter : uint8_t { paramX = 0, paramY, paramZ, paramE, paramF };
+
+	bool Restart(const GCodeBuffer& gb, FilePosition printPos);
+	void ScanChunk(int toolNumberAdjust);
+	bool ProcessByte(char c, int toolNumberAdjust);				// returns true if we found a tool change
+	bool ProcessLine(int toolNumberAdjust);
+	void ProcessBinaryRecord();
+	void AddMove(uint8_t params, const float values[], bool setPosition);
+	void AddCheckpoint();
+	float GetPrintTime(FilePosition printPos) const;
+	float GetLeadTime(const Tool& tool) const;
+	void Preheat(const Tool& tool);
+
+	static bool GetParameter(const char *p, char letter, float& value);
+
+	FileStore *file;												// our own handle on the file being printed
+	FilePosition scanPos;											// the file position of the next byte to scan
+	float scanTime;													// the estimated print time at scanPos
+	Checkpoint checkpoints[NumCheckpoints];
+	size_t firstCheckpoint;
+	size_t numCheckpoints;
+
+	float coords[paramE + 1];										// the positions that the file has moved to at scanPos
+	uint8_t coordsKnown;											// bitmap of the coordinates we know
+	float feedRate;													// in mm/sec
+	bool axesRelative;
+	bool drivesRelative;
+	bool binaryFile;
+	bool fileEnded;
+	bool inComment;
+
+	int scanTool;													// the tool that will be selected at scanPos
+	int nextTool;													// the tool that the next tool change selects
+	FilePosition toolChangeEndPos;									// the file position just after the tool change command
+	float toolChangeTime;											// the estimated print time at the tool change
+	bool toolChangeFound;
+	bool preheated;													// true if we have started heating the next tool
+
+	bool enabled;
+	float extraLeadTime;
+	float maxLookahead;
+	unsigned int numPreheats;
+
+	size_t lineLength;
+	size_t recordLength;											// the number of bytes of the current binary move record that we have collected, or 0
+	size_t recordTotal;												// the length of the current binary move record, or the header length if we don't know it yet
+	char lineBuffer[MaxLineLength + 1];
+	uint8_t recordBuffer[BinaryGCode::MaxRecordLength];
+};
+
+#endif
+
+#endif /* SRC_GCODES_TOOLPREHEATER_H_ */
@@ -23,6 +23,7 @@ Licence: GPL
 #include "Platform.h"
 #include "RepRap.h"
 #include "Sensors/TemperatureSensor.h"
+#include "Sensors/SpiTemperatureSensor.h"
 
 #if SUPPORT_DHT_SENSOR
 # include "Sensors/DhtSensor.h"
@@ -47,7 +48,7 @@ Heat::Heat(Platform& p)
 #ifndef RTOS
 	  active(false),
 #endif
-	  coldExtrude(false), heaterBeingTuned(-1), lastHeaterTuned(-1)
+	  powerBudget(0.0), reportSequence(0), coldExtrude(false), heaterBeingTuned(-1), lastHeaterTuned(-1)
 {
 	ARRAY_INIT(bedHeaters, DefaultBedHeaters);
 	ARRAY_INIT(chamberHeaters, DefaultChamberHeaters);
@@ -60,6 +61,7 @@ Heat::Heat(Platform& p)
 	for (size_t heater : ARRAY_INDICES(pids))
 	{
 		pids[heater] = new PID(platform, heater);
+		heaterPowers[heater] = 0.0;
 	}
 }
 
@@ -153,10 +155,16 @@ void Heat::Init()
 	retractionMinTemp = HOT_ENOUGH_TO_RETRACT;
 	coldExtrude = false;
 
+	const uint32_t now = millis();
+	for (size_t heater = 0; heater < Heaters; ++heater)
+	{
+		lastSpinTimes[heater] = now - MaxHeatSampleInterval;	// flag the PIDs as due for spinning
+	}
+	PublishReports();											// so that status reports have something sensible to report until the heater task starts
+
 #ifdef RTOS
 	heaterTask.Create(HeaterTask, "HEAT", nullptr, TaskBase::HeatPriority);
 #else
-	lastTime = millis() - platform.HeatSampleInterval();		// flag the PIDS as due for spinning
 	active = true;
 #endif
 }
@@ -179,25 +187,18 @@ void Heat::Exit()
 
 void Heat::Task()
 {
-	lastWakeTime = xTaskGetTickCount();
 	for (;;)
 	{
-		for (size_t heater = 0; heater < Heaters; heater++)
-		{
-			pids[heater]->Spin();
-		}
-
-		// See if we have finished tuning a PID
-		if (heaterBeingTuned != -1 && !pids[heaterBeingTuned]->IsTuning())
-		{
-			lastHeaterTuned = heaterBeingTuned;
-			heaterBeingTuned = -1;
-		}
-
+		SpiTemperatureSensor::ReadAll();
+#if SUPPORT_DHT_SENSOR
+		const uint32_t waitTime = min<uint32_t>(SpinDuePids(millis()), DhtSensorHardwareInterface::Spin());
+#else
+		const uint32_t waitTime = SpinDuePids(millis());
+#endif
 		reprap.KickHeatTaskWatchdog();
 
-		// Delay until it is time again
-		vTaskDelayUntil(&lastWakeTime, platform.HeatSampleInterval());
+		// Delay until the next PID is due
+		vTaskDelay(max<uint32_t>(waitTime, 1));
 	}
 }
 
@@ -207,32 +208,167 @@ void Heat::Spin()
 {
 	if (active)
 	{
-		// See if it is time to spin the PIDs
-		const uint32_t now = millis();
-		if (now - lastTime >= platform.HeatSampleInterval())
+		// Spin any PIDs that are due
+		SpiTemperatureSensor::ReadAll();
+		(void)SpinDuePids(millis());
+
+#if SUPPORT_DHT_SENSOR
+		// If the DHT temperature sensor is active, it needs to be spinned too
+		(void)DhtSensorHardwareInterface::Spin();
+#endif
+	}
+}
+
+#endif
+
+// Spin each PID that is due, then return the number of milliseconds until the next one is due.
+// Each heater has its own sample interval, so that heaters with fast sensors can be controlled more tightly.
+uint32_t Heat::SpinDuePids(uint32_t now)
+{
+	uint32_t waitTime = MaxHeatSampleInterval;
+	bool spunAny = false;
+	for (size_t heater = 0; heater < Heaters; heater++)
+	{
+		const uint32_t interval = GetSampleInterval(heater);
+		uint32_t elapsed = now - lastSpinTimes[heater];
+		if (elapsed >= interval)
 		{
-			lastTime = now;
-			for (size_t heater = 0; heater < Heaters; heater++)
-			{
-				pids[heater]->Spin();
-			}
+			spunAny = true;
+			pids[heater]->SetSampleInterval(interval);
+			pids[heater]->SetPowerLimit(GetPowerLimit(heater));
+			pids[heater]->Spin();
+
+			// Keep to the schedule unless we have fallen a whole interval behind, in which case start again from now
+			lastSpinTimes[heater] = (elapsed < 2 * interval) ? lastSpinTimes[heater] + interval : now;
+			elapsed = now - lastSpinTimes[heater];
+		}
+		waitTime = min<uint32_t>(waitTime, interval - elapsed);
+	}
+
+	// See if we have finished tuning a PID
+	if (heaterBeingTuned != -1 && !pids[heaterBeingTuned]->IsTuning())
+	{
+		lastHeaterTuned = heaterBeingTuned;
+		heaterBeingTuned = -1;
+	}
+
+	if (spunAny)
+	{
+		PublishReports();
+	}
+	return waitTime;
+}
 
-			// See if we have finished tuning a PID
-			if (heaterBeingTuned != -1 && !pids[heaterBeingTuned]->IsTuning())
+// Publish the temperatures and states of all the heaters, so that status reports can read them without locking and without reading the sensors themselves
+void Heat::PublishReports()
+{
+	const uint32_t nextSequence = reportSequence + 1;
+	HeaterReport * const reports = heaterReports[nextSequence & 1];
+	for (size_t heater : ARRAY_INDICES(pids))
+	{
+		HeaterReport& report = reports[heater];
+		report.current = pids[heater]->GetTemperature();
+		report.active = pids[heater]->GetActiveTemperature();
+		report.standby = pids[heater]->GetStandbyTemperature();
+		report.status = GetStatus(heater);
+	}
+
+	float * const extraReports = extraTemperatureReports[nextSequence & 1];
+	for (size_t i = 0; i < MaxVirtualHeaters; ++i)
+	{
+		TemperatureError err;
+		extraReports[i] = GetTemperature(FirstVirtualHeater + i, err);
+	}
+
+	__DMB();													// make sure that the reports have been written before we publish them
+	reportSequence = nextSequence;
+}
+
+// Get the last published temperatures and state of a heater
+Heat::HeaterReport Heat::GetHeaterReport(size_t heater) const
+{
+	HeaterReport report;
+	uint32_t sequence;
+	do
+	{
+		sequence = reportSequence;
+		report = heaterReports[sequence & 1][heater];
+		__DMB();
+	} while (sequence != reportSequence);						// if the heater task published another set of reports meanwhile, it may have overwritten the one we read
+	return report;
+}
+
+// Get the last published temperature of a virtual heater
+float Heat::GetExtraTemperatureReport(size_t heater) const
+{
+	float t;
+	uint32_t sequence;
+	do
+	{
+		sequence = reportSequence;
+		t = extraTemperatureReports[sequence & 1][heater - FirstVirtualHeater];
+		__DMB();
+	} while (sequence != reportSequence);
+	return t;
+}
+
+// Get the maximum PWM that a heater may use without the heaters in the power budget drawing more than the budget allows.
+// Each heater may use whatever power the others leave free, except for extra power that heaters with higher priority are waiting for.
+// The limit is applied each time the heater is spun, and each heater only uses power that was free when it was last spun, so the total stays within the budget
+// as the heaters change their PWM one at a time. Heaters that are being tuned or that drive coolers can't be limited, but we allow for the power they use.
+float Heat::GetPowerLimit(size_t heater) const
+{
+	if (powerBudget <= 0.0 || heaterPowers[heater] <= 0.0)
+	{
+		return 1.0;
+	}
+
+	const float priority = pids[heater]->GetPowerPriority();
+	float available = powerBudget;
+	for (size_t other : ARRAY_INDICES(pids))
+	{
+		if (other != heater && heaterPowers[other] > 0.0)
+		{
+			const PID * const pid = pids[other];
+			const float used = pid->GetPwm() * heaterPowers[other];
+			available -= used;
+			const float otherPriority = pid->GetPowerPriority();
+			if (otherPriority > priority || (otherPriority == priority && other < heater))
 			{
-				lastHeaterTuned = heaterBeingTuned;
-				heaterBeingTuned = -1;
+				available -= max<float>(pid->GetRequestedPwm() * heaterPowers[other] - used, 0.0);
 			}
 		}
+	}
+	return constrain<float>(available/heaterPowers[heater], 0.0, 1.0);
+}
 
-#if SUPPORT_DHT_SENSOR
-		// If the DHT temperature sensor is active, it needs to be spinned too
-		DhtSensor::Spin();
-#endif
+// Get the power that the heaters in the power budget are using now
+float Heat::GetTotalHeaterPower() const
+{
+	float total = 0.0;
+	for (size_t heater : ARRAY_INDICES(pids))
+	{
+		total += pids[heater]->GetPwm() * heaterPowers[heater];
 	}
+	return total;
 }
 
-#endif
+// Set the power of a heater at full PWM. A heater with zero power is not included in the power budget.
+GCodeResult Heat::SetHeaterPower(size_t heater, float watts, const StringRef& reply)
+{
+	if (heater >= Heaters)
+	{
+		reply.copy("Invalid heater number");
+		return GCodeResult::error;
+	}
+	if (watts < 0.0)
+	{
+		reply.copy("Heater power must not be negative");
+		return GCodeResult::error;
+	}
+	heaterPowers[heater] = watts;
+	return GCodeResult::ok;
+}
 
 void Heat::Diagnostics(MessageType mtype)
 {
@@ -255,6 +391,11 @@ void Heat::Diagnostics(MessageType mtype)
 			platform.MessageF(mtype, "Heater %d is on, I-accum = %.1f\n", heater, (double)(pids[heater]->GetAccumulator()));
 		}
 	}
+
+	if (powerBudget > 0.0)
+	{
+		platform.MessageF(mtype, "Heater power budget %.0fW, using %.0fW\n", (double)powerBudget, (double)GetTotalHeaterPower());
+	}
 }
 
 bool Heat::AllHeatersAtSetTemperatures(bool includingBed) const
@@ -485,12 +626,12 @@ bool Heat::IsBedOrChamberHeater(int8_t heater) const
 }
 
 // Auto tune a PID
-void Heat::StartAutoTune(size_t heater, float temperature, float maxPwm, const StringRef& reply)
+void Heat::StartAutoTune(size_t heater, float temperature, float maxPwm, bool useRelay, const StringRef& reply)
 {
 	if (heaterBeingTuned == -1)
 	{
 		heaterBeingTuned = (int8_t)heater;
-		pids[heater]->StartAutoTune(temperature, maxPwm, reply);
+		pids[heater]->StartAutoTune(temperature, maxPwm, useRelay, reply);
 	}
 	else
 	{
@@ -596,6 +737,38 @@ GCodeResult Heat::ConfigureHeaterSensor(unsigned int mcode, size_t heater, GCode
 	return (*spp)->Configure(mcode, heater, gb, reply);
 }
 
+// Return the interval at which we sample a heater's temperature.
+// A heater that has no sample interval of its own uses the global one. Sensors that are read over a bus take a while to read, so they have a higher minimum
+// than thermistors and PT1000s, which are read from ADC filters that the tick interrupt keeps up to date.
+uint32_t Heat::GetSampleInterval(size_t heater) const
+{
+	const uint32_t requested = pids[heater]->GetRequestedSampleInterval();
+	if (requested == 0)
+	{
+		return platform.HeatSampleInterval();
+	}
+	const TemperatureSensor * const sensor = heaterSensors[heater];
+	const uint32_t minInterval = (sensor != nullptr && sensor->IsReadFromAdcFilter()) ? MinFastHeatSampleInterval : MinHeatSampleInterval;
+	return max<uint32_t>(requested, minInterval);
+}
+
+// Set the sample interval for one heater. An interval of zero means use the global sample interval.
+GCodeResult Heat::SetSampleInterval(size_t heater, uint32_t interval, const StringRef& reply)
+{
+	if (heater >= Heaters)
+	{
+		reply.copy("Invalid heater number");
+		return GCodeResult::error;
+	}
+	if (interval != 0 && (interval < MinFastHeatSampleInterval || interval > MaxHeatSampleInterval))
+	{
+		reply.printf("Sample interval must be between %" PRIu32 " and %" PRIu32 "ms", MinFastHeatSampleInterval, MaxHeatSampleInterval);
+		return GCodeResult::error;
+	}
+	pids[heater]->SetRequestedSampleInterval(interval);
+	return GCodeResult::ok;
+}
+
 // Get a pointer to the temperature sensor entry, or nullptr if the heater number is bad
 TemperatureSensor **Heat::GetSensor(size_t heater)
 {
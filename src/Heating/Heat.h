@@ -40,6 +40,17 @@ public:
 	// Enumeration to describe the status of a heater. Note that the web interface returns the numerical values, so don't change them.
 	enum HeaterStatus { HS_off = 0, HS_standby = 1, HS_active = 2, HS_fault = 3, HS_tuning = 4 };
 
+	// The temperatures and state of a heater as last published by the heater task, for status reports
+	struct HeaterReport
+	{
+		float current;
+		float active;
+		float standby;
+		HeaterStatus status;
+
+		float Target() const { return (status == HS_active) ? active : (status == HS_standby) ? standby : 0.0; }
+	};
+
 	Heat(Platform& p);
 #ifdef RTOS
 	void Task();
@@ -87,6 +98,11 @@ public:
 	bool HeaterAtSetTemperature(int8_t heater, bool waitWhenCooling) const;	// Is a specific heater at temperature within tolerance?
 	void Diagnostics(MessageType mtype);						// Output useful information
 
+	HeaterReport GetHeaterReport(size_t heater) const			// Get the last published temperatures and state of a heater, without locking
+	pre(heater < Heaters);
+	float GetExtraTemperatureReport(size_t heater) const		// Get the last published temperature of a virtual heater, without locking
+	pre(heater >= FirstVirtualHeater; heater < FirstVirtualHeater + MaxVirtualHeaters);
+
 	float GetAveragePWM(size_t heater) const					// Return the running average PWM to the heater as a fraction in [0, 1].
 	pre(heater < Heaters);
 
@@ -95,7 +111,7 @@ public:
 	uint32_t GetLastSampleTime(size_t heater) const
 	pre(heater < Heaters);
 
-	void StartAutoTune(size_t heater, float temperature, float maxPwm, const StringRef& reply) // Auto tune a PID
+	void StartAutoTune(size_t heater, float temperature, float maxPwm, bool useRelay, const StringRef& reply) // Auto tune a PID
 	pre(heater < Heaters);
 
 	bool IsTuning(size_t heater) const							// Return true if the specified heater is auto tuning
@@ -112,6 +128,15 @@ public:
 	bool IsHeaterSignalInverted(size_t heater)					// Set PWM signal inversion
 	pre(heater < Heaters);
 
+	float GetFeedForward(size_t heater) const					// Get the extra PWM per mm/sec of extrusion
+		{ return pids[heater]->GetFeedForward(); }
+	bool UsingPredictor(size_t heater) const					// Is the heater controlling the predicted temperature?
+		{ return pids[heater]->UsingPredictor(); }
+	void SetPredictiveControl(size_t heater, float feedForward, bool usePredictor)	// Configure model predictive control
+		{ pids[heater]->SetPredictiveControl(feedForward, usePredictor); }
+	void SetExtrusionRate(size_t heater, float rate)			// Set the extrusion rate to feed forward, called by Move
+		{ pids[heater]->SetExtrusionRate(rate); }
+
 	void SetHeaterSignalInverted(size_t heater, bool IsInverted)	// Set PWM signal inversion
 	pre(heater < Heaters);
 
@@ -132,6 +157,18 @@ public:
 	bool WriteModelParameters(FileStore *f) const;				// Write heater model parameters to file returning true if no error
 
 	int GetHeaterChannel(size_t heater) const;					// Return the channel used by a particular heater, or -1 if not configured
+	uint32_t GetSampleInterval(size_t heater) const;			// Return the interval in milliseconds at which we sample a heater's temperature
+	GCodeResult SetSampleInterval(size_t heater, uint32_t interval, const StringRef& reply);	// Set the sample interval for one heater, 0 means use the default
+	float GetPowerBudget() const { return powerBudget; }		// Get the total heater power in watts that we may use, 0 means no limit
+	void SetPowerBudget(float watts) { powerBudget = max<float>(watts, 0.0); }
+	float GetHeaterPower(size_t heater) const					// Get the power of a heater at full PWM in watts, 0 means not included in the power budget
+	pre(heater < Heaters)
+		{ return heaterPowers[heater]; }
+	GCodeResult SetHeaterPower(size_t heater, float watts, const StringRef& reply);	// Set the power of a heater at full PWM
+	float GetTotalHeaterPower() const;							// Get the power that the heaters in the power budget are using now
+	float EstimateHeatingTime(size_t heater, float targetTemp) const	// Estimate how many seconds a heater would take to reach a temperature at full power
+	pre(heater < Heaters)
+		{ return pids[heater]->EstimateHeatingTime(targetTemp); }
 	bool SetHeaterChannel(size_t heater, int channel);			// Set the channel used by a heater, returning true if bad heater or channel number
 	GCodeResult ConfigureHeaterSensor(size_t heater, unsigned int mcode, GCodeBuffer& gb, const StringRef& reply);	// Configure the temperature sensor for a channel
 	const char *GetHeaterName(size_t heater) const;				// Get the name of a heater, or nullptr if it hasn't been named
@@ -157,6 +194,10 @@ public:
 private:
 	Heat(const Heat&);											// Private copy constructor to prevent copying
 
+	uint32_t SpinDuePids(uint32_t now);							// Spin the PIDs that are due and return how long until the next one is due
+	float GetPowerLimit(size_t heater) const;					// Get the maximum PWM that a heater may use without exceeding the power budget
+	void PublishReports();										// Publish the temperatures and states of all the heaters for status reports
+
 	TemperatureSensor **GetSensor(size_t heater);				// Get a pointer to the temperature sensor entry
 	TemperatureSensor * const *GetSensor(size_t heater) const;	// Get a pointer to the temperature sensor entry
 
@@ -170,10 +211,16 @@ private:
 	TemperatureSensor *heaterSensors[Heaters];					// The sensor used by the real heaters
 	TemperatureSensor *virtualHeaterSensors[MaxVirtualHeaters];	// Sensors for virtual heaters
 
-#ifdef RTOS
-	uint32_t lastWakeTime;
-#else
-	uint32_t lastTime;											// The last time our Spin() was called
+	uint32_t lastSpinTimes[Heaters];							// When we last spun each PID
+	float heaterPowers[Heaters];								// The power of each heater at full PWM in watts, or 0 if it is not in the power budget
+	float powerBudget;											// The total power the heaters may use in watts, or 0 for no limit
+
+	// Double-buffered heater reports. The heater task fills in the buffer that readers are not using and then increments the sequence number.
+	// Readers use the buffer selected by the bottom bit of the sequence number, and read it again if the sequence number changed meanwhile.
+	HeaterReport heaterReports[2][Heaters];
+	float extraTemperatureReports[2][MaxVirtualHeaters];
+	volatile uint32_t reportSequence;
+#ifndef RTOS
 	bool active;												// Are we active?
 #endif
 
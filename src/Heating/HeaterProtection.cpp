@@ -49,19 +49,38 @@ bool HeaterProtection::Check()
 		else
 		{
 			badTemperatureCount = 0;
-			switch (trigger)
-			{
-			case HeaterProtectionTrigger::TemperatureExceeded:
-				return (temperature <= limit);
-
-			case HeaterProtectionTrigger::TemperatureTooLow:
-				return (temperature >= limit);
-			}
+			return CheckTemperature(temperature);
 		}
 	}
 	return true;
 }
 
+// Check if any action needs to be taken, given that the caller has just had a good temperature reading from heater 'readHeater'.
+// The heater's own PID reads its sensor on each cycle, so when we supervise that heater we use the same reading instead of reading the sensor again.
+bool HeaterProtection::Check(int8_t readHeater, float readTemperature)
+{
+	if (supervisedHeater != readHeater)
+	{
+		return Check();
+	}
+	badTemperatureCount = 0;
+	return CheckTemperature(readTemperature);
+}
+
+// Return true if the temperature is within the limit
+bool HeaterProtection::CheckTemperature(float temperature) const
+{
+	switch (trigger)
+	{
+	case HeaterProtectionTrigger::TemperatureExceeded:
+		return (temperature <= limit);
+
+	case HeaterProtectionTrigger::TemperatureTooLow:
+		return (temperature >= limit);
+	}
+	return true;
+}
+
 void HeaterProtection::SetHeater(int8_t newHeater)
 {
 	heater = newHeater;
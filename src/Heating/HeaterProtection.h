@@ -45,6 +45,7 @@ public:
 	void SetNext(HeaterProtection *n) { next = n; }
 
 	bool Check();													// Check if any action needs to be taken
+	bool Check(int8_t readHeater, float readTemperature);			// As Check(), using a temperature the caller has just read if it is for the supervised heater
 
 	int8_t GetHeater() const { return heater; }
 	void SetHeater(int8_t newHeater);								// Set the heater to control
@@ -62,6 +63,8 @@ public:
 	void SetTrigger(HeaterProtectionTrigger newTrigger);			// Set the condition for a temperature event
 
 private:
+	bool CheckTemperature(float temperature) const;
+
 	HeaterProtection *next;
 
 	float limit;
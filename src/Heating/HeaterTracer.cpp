@@ -0,0 +1,158 @@
+/*
+ * HeaterTracer.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "HeaterTracer.h"
+
+#if SUPPORT_HEATER_TRACE
+
+#include "GCodes/GCodeBuffer.h"
+#include "OutputMemory.h"
+#include "Platform.h"
+#include "RepRap.h"
+#include "Storage/FileStore.h"
+
+HeaterTracer::Trace *HeaterTracer::traces[Heaters] = { 0 };
+
+// Process M594.
+// M594 H<heater> S1 clears the trace of that heater and starts tracing it, S0 stops tracing, P"filename" writes the trace to a CSV file in the log directory (see M938).
+// With no S or P parameter, report the state of the trace. The trace can also be fetched in binary form using rr_heatertrace?heater=<heater>.
+/*static*/ GCodeResult HeaterTracer::Configure(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (!gb.Seen('H'))
+	{
+		reply.copy("Missing H parameter");
+		return GCodeResult::error;
+	}
+	const unsigned int heater = gb.GetUIValue();
+	if (heater >= Heaters)
+	{
+		reply.copy("Invalid heater number");
+		return GCodeResult::error;
+	}
+
+	bool seen = false;
+	if (gb.Seen('S'))
+	{
+		seen = true;
+		if (gb.GetIValue() > 0)
+		{
+			if (traces[heater] == nullptr)
+			{
+				// We don't normally allow dynamic memory allocation when running, but tracing is rarely used so we make an exception here.
+				// Once allocated, the trace stays allocated so that it can be fetched after tracing has stopped.
+				Trace * const tr = new Trace;
+				tr->tracing = false;
+				traces[heater] = tr;
+			}
+			traces[heater]->tracing = false;
+			traces[heater]->putIndex = 0;
+			traces[heater]->tracing = true;
+		}
+		else if (traces[heater] != nullptr)
+		{
+			traces[heater]->tracing = false;
+		}
+	}
+
+	String<MaxFilenameLength> fileName;
+	bool seenFile = false;
+	gb.TryGetQuotedString('P', fileName.GetRef(), seenFile);
+	if (seenFile)
+	{
+		return (Dump(heater, fileName.c_str(), reply)) ? GCodeResult::error : GCodeResult::ok;
+	}
+
+	if (!seen)
+	{
+		Report(heater, reply);
+	}
+	return GCodeResult::ok;
+}
+
+/*static*/ void HeaterTracer::Report(size_t heater, const StringRef& reply)
+{
+	const Trace * const tr = traces[heater];
+	if (tr == nullptr)
+	{
+		reply.printf("Heater %u is not being traced", heater);
+	}
+	else
+	{
+		reply.printf("Heater %u trace %s, %" PRIu32 " samples recorded, last %u kept",
+						heater, (tr->tracing) ? "running" : "stopped", tr->putIndex, min<uint32_t>(tr->putIndex, TraceLength));
+	}
+}
+
+// Append the trace of a heater to an output buffer in binary form, oldest entry first
+/*static*/ bool HeaterTracer::GetBinaryTrace(size_t heater, OutputBuffer *buf)
+{
+	Trace * const tr = traces[heater];
+	if (tr == nullptr)
+	{
+		return false;
+	}
+
+	// The heater task has a higher priority than the tasks that call this, so once we have stopped tracing it can't be part way through recording a sample
+	const bool wasTracing = tr->tracing;
+	tr->tracing = false;
+	const uint32_t numEntries = min<uint32_t>(tr->putIndex, TraceLength);
+	const uint32_t first = tr->putIndex - numEntries;
+	const size_t firstSlot = first & (TraceLength - 1);
+	const size_t firstPart = min<size_t>(numEntries, TraceLength - firstSlot);
+	buf->cat(reinterpret_cast<const char *>(&tr->entries[firstSlot]), firstPart * sizeof(TraceEntry));
+	buf->cat(reinterpret_cast<const char *>(&tr->entries[0]), (numEntries - firstPart) * sizeof(TraceEntry));
+	tr->tracing = wasTracing;
+	return true;
+}
+
+// Write the trace of a heater to a CSV file, oldest entry first. Return true if there was an error.
+/*static*/ bool HeaterTracer::Dump(size_t heater, const char *fileName, const StringRef& reply)
+{
+	Trace * const tr = traces[heater];
+	if (tr == nullptr)
+	{
+		reply.printf("Heater %u is not being traced", heater);
+		return true;
+	}
+
+	Platform& platform = reprap.GetPlatform();
+	FileStore * const f = platform.OpenFile(platform.GetLogDir(), fileName, OpenMode::write);
+	if (f == nullptr)
+	{
+		reply.printf("Failed to create heater trace file %s", fileName);
+		return true;
+	}
+
+	const bool wasTracing = tr->tracing;
+	tr->tracing = false;										// stop the heater task changing the entries while we write them
+	const uint32_t numEntries = min<uint32_t>(tr->putIndex, TraceLength);
+	String<ShortScratchStringLength> line;
+	bool ok = f->Write("time,temperature,setpoint,pwm,mode\n");
+	for (uint32_t i = tr->putIndex - numEntries; ok && i != tr->putIndex; ++i)
+	{
+		const TraceEntry& e = tr->entries[i & (TraceLength - 1)];
+		line.printf("%" PRIu32 ",%.1f,%.1f,%.3f,%u\n", e.time, (double)(e.temperature * 0.1), (double)(e.setpoint * 0.1), (double)(e.pwm * (1.0/255.0)), e.mode);
+		ok = f->Write(line.c_str());
+	}
+	tr->tracing = wasTracing;
+
+	if (!f->Close())
+	{
+		ok = false;
+	}
+	if (!ok)
+	{
+		platform.GetMassStorage()->Delete(platform.GetSysDir(), fileName);
+		reply.printf("Failed to write heater trace file %s", fileName);
+		return true;
+	}
+	reply.printf("%" PRIu32 " heater trace entries written to file %s", numEntries, fileName);
+	return false;
+}
+
+#endif
+
+// End
@@ -0,0 +1,72 @@
+/*
+ * HeaterTracer.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Records the temperature, setpoint and PWM of selected heaters at the control rate, so that heater behaviour can be examined afterwards.
+ */
+
+#ifndef SRC_HEATING_HEATERTRACER_H_
+#define SRC_HEATING_HEATERTRACER_H_
+
+#include "RepRapFirmware.h"
+#include "GCodes/GCodeResult.h"
+
+#if SUPPORT_HEATER_TRACE
+
+class OutputBuffer;
+
+class HeaterTracer
+{
+public:
+	static constexpr size_t TraceLength = 256;				// number of samples we keep per heater, must be a power of 2
+
+	static GCodeResult Configure(GCodeBuffer& gb, const StringRef& reply);		// process M594
+	static bool GetBinaryTrace(size_t heater, OutputBuffer *buf);				// append the trace of a heater in binary form, returning false if there isn't one
+
+	// This is called by PID::Spin in the heater task
+	static void Record(size_t heater, float temperature, float setpoint, float pwm, uint8_t mode);
+
+private:
+	// Binary trace format, little endian with no padding: time in milliseconds, temperature and setpoint in units of 0.1C, PWM scaled to 0..255, heater mode
+	struct TraceEntry
+	{
+		uint32_t time;
+		int16_t temperature;
+		int16_t setpoint;
+		uint8_t pwm;
+		uint8_t mode;
+	} __attribute__((packed));
+
+	struct Trace
+	{
+		TraceEntry entries[TraceLength];
+		uint32_t putIndex;									// free-running index of the next entry to write
+		volatile bool tracing;
+	};
+
+	static void Report(size_t heater, const StringRef& reply);
+	static bool Dump(size_t heater, const char *fileName, const StringRef& reply);
+
+	static Trace *traces[Heaters];
+};
+
+// Record a heater sample if we are tracing that heater
+inline void HeaterTracer::Record(size_t heater, float temperature, float setpoint, float pwm, uint8_t mode)
+{
+	Trace * const tr = traces[heater];
+	if (tr != nullptr && tr->tracing)
+	{
+		TraceEntry& e = tr->entries[tr->putIndex & (TraceLength - 1)];
+		e.time = millis();
+		e.temperature = (int16_t)constrain<float>(temperature * 10.0, -32768.0, 32767.0);
+		e.setpoint = (int16_t)constrain<float>(setpoint * 10.0, -32768.0, 32767.0);
+		e.pwm = (uint8_t)constrain<float>(pwm * 255.0, 0.0, 255.0);
+		e.mode = mode;
+		++tr->putIndex;
+	}
+}
+
+#endif
+
+#endif /* SRC_HEATING_HEATERTRACER_H_ */
@@ -9,6 +9,7 @@
 #include "GCodes/GCodes.h"
 #include "Heat.h"
 #include "HeaterProtection.h"
+#include "HeaterTracer.h"
 #include "Platform.h"
 #include "RepRap.h"
 
@@ -32,6 +33,17 @@ float PID::tuningPeakTemperature;			// the peak temperature reached, averaged ov
 uint32_t PID::tuningHeatingTime;			// how long we had the heating on for
 uint32_t PID::tuningPeakDelay;				// how many milliseconds the temperature continues to rise after turning the heater off
 
+bool PID::tuningUseRelay;
+bool PID::relayHeaterOn;
+bool PID::relayCycleStarted;
+uint32_t PID::relayOnTime;
+uint32_t PID::relayOffTime;
+float PID::relayMaxTemp;
+float PID::relayMinTemp;
+unsigned int PID::relayCyclesDone;
+unsigned int PID::relayCyclesAgreed;
+float PID::relayGain, PID::relayTc, PID::relayTd;
+
 #if HAS_VOLTAGE_MONITOR
 unsigned int voltageSamplesTaken;			// how many readings we accumulated
 float tuningVoltageAccumulator;				// sum of the voltage readings we take during the heating phase
@@ -41,6 +53,9 @@ float tuningVoltageAccumulator;				// sum of the voltage readings we take during
 
 PID::PID(Platform& p, int8_t h) : platform(p), heaterProtection(nullptr), heater(h), mode(HeaterMode::off), invertPwmSignal(false)
 {
+	sampleInterval = platform.HeatSampleInterval();
+	requestedSampleInterval = 0;
+	powerLimit = 1.0;
 }
 
 inline void PID::SetHeater(float power) const
@@ -52,7 +67,11 @@ void PID::Init(float pGain, float pTc, float pTd, bool usePid, bool inverted)
 {
 	maxTempExcursion = DefaultMaxTempExcursion;
 	maxHeatingFaultTime = DefaultMaxHeatingFaultTime;
+	feedForward = 0.0;
+	extrusionRate = 0.0;
+	usePredictor = false;
 	model.SetParameters(pGain, pTc, pTd, 1.0, GetHighestTemperatureLimit(), 0.0, usePid, inverted, 0);
+	UpdateSampleFactors();
 	Reset();
 
 	SetHeater(0.0);							// set up the pin even if the heater is not enabled (for PCCB)
@@ -62,6 +81,27 @@ void PID::Init(float pGain, float pTc, float pTd, bool usePid, bool inverted)
 	lastSampleTime = millis();
 }
 
+// Set the interval between temperature samples
+void PID::SetSampleInterval(uint32_t interval)
+{
+	if (interval != sampleInterval)
+	{
+		sampleInterval = interval;
+		previousTemperaturesGood = 0;			// the previous readings were taken at the old interval, so don't use them to calculate the derivative
+		UpdateSampleFactors();
+	}
+}
+
+// Recalculate the values that depend on the sample interval and the maximum heating fault time, so that Spin doesn't have to divide by them
+void PID::UpdateSampleFactors()
+{
+	const uint32_t historyInterval = sampleInterval * NumPreviousTemperatures;
+	derivativeFactor = SecondsToMillis/(TemperatureHistoryScale * (float)historyInterval);
+	maxTemperatureChange = lrintf(MaxTemperatureDerivative * TemperatureHistoryScale * (float)historyInterval * MillisToSeconds);
+	pwmAverageFactor = (float)sampleInterval/(HEAT_PWM_AVERAGE_TIME * SecondsToMillis);
+	maxHeatingFaultCount = (uint32_t)(maxHeatingFaultTime * SecondsToMillis/(float)sampleInterval);
+}
+
 void PID::Reset()
 {
 	mode = HeaterMode::off;
@@ -73,9 +113,63 @@ void PID::Reset()
 	badTemperatureCount = 0;
 	active = false; 						// default to standby temperature
 	tuned = false;
-	averagePWM = lastPwm = 0.0;
+	averagePWM = lastPwm = requestedPwm = 0.0;
 	heatingFaultCount = 0;
 	temperature = BAD_ERROR_TEMPERATURE;
+	predictorValid = false;
+}
+
+// Configure feed-forward from the planned extrusion rate and the dead time predictor
+void PID::SetPredictiveControl(float pFeedForward, bool pUsePredictor)
+{
+	feedForward = pFeedForward;
+	if (pUsePredictor != usePredictor)
+	{
+		usePredictor = pUsePredictor;
+		predictorValid = false;
+	}
+}
+
+// Start predicting from the current temperature. We assume that the temperature has been steady for the last dead time.
+void PID::ResetPredictor()
+{
+	modelTemperature = temperature;
+	for (float& t : modelHistory)
+	{
+		t = temperature;
+	}
+	modelHistoryIndex = 0;
+	lastModelHistoryTime = millis();
+	predictorValid = true;
+}
+
+// Update the model temperature, which is what the model says the sensor will read one dead time from now, given the PWM we have just set.
+// The history of model temperatures tells us what the model says it should read now, so the difference between the two is how much
+// the temperature will change because of PWM changes that the sensor can't see yet.
+void PID::UpdatePredictor(float pwm)
+{
+	modelTemperature += (model.GetGain() * pwm + NormalAmbientTemperature - modelTemperature) * (sampleInterval * MillisToSeconds)/model.GetTimeConstant();
+
+	const uint32_t now = millis();
+	if (now - lastModelHistoryTime >= GetModelHistoryInterval())
+	{
+		modelHistory[modelHistoryIndex] = modelTemperature;
+		modelHistoryIndex = (modelHistoryIndex + 1) % NumModelHistory;
+		lastModelHistoryTime = now;
+	}
+}
+
+// Return the interval between entries in the model history. If the dead time is short compared with the sample interval, this is the sample interval.
+uint32_t PID::GetModelHistoryInterval() const
+{
+	return max<uint32_t>((uint32_t)(model.GetDeadTime() * SecondsToMillis)/NumModelHistory, sampleInterval);
+}
+
+// Return the model temperature from one dead time ago, which is what the model says the sensor should be reading now
+float PID::GetDelayedModelTemperature() const
+{
+	const size_t slotsBack = constrain<size_t>(lrintf(model.GetDeadTime() * SecondsToMillis/GetModelHistoryInterval()), 1, NumModelHistory);
+	return modelHistory[(modelHistoryIndex + NumModelHistory - slotsBack) % NumModelHistory];
 }
 
 // Set the process model
@@ -229,18 +323,18 @@ void PID::Spin()
 			float derivative = 0.0;
 			bool gotDerivative = false;
 			badTemperatureCount = 0;
+			const int32_t scaledTemperature = lrintf(temperature * TemperatureHistoryScale);
 			if ((previousTemperaturesGood & (1 << (NumPreviousTemperatures - 1))) != 0)
 			{
-				const float tentativeDerivative = SecondsToMillis * (temperature - previousTemperatures[previousTemperatureIndex])
-								/ (float)(platform.HeatSampleInterval() * NumPreviousTemperatures);
-				// Some sensors give occasional temperature spikes. We don't expect the temperature to increase by more than 10C/second.
-				if (fabsf(tentativeDerivative) <= 10.0)
+				const int32_t temperatureChange = scaledTemperature - previousTemperatures[previousTemperatureIndex];
+				// Some sensors give occasional temperature spikes. We don't expect the temperature to change by more than 10C/second.
+				if (labs(temperatureChange) <= maxTemperatureChange)
 				{
-					derivative = tentativeDerivative;
+					derivative = (float)temperatureChange * derivativeFactor;
 					gotDerivative = true;
 				}
 			}
-			previousTemperatures[previousTemperatureIndex] = temperature;
+			previousTemperatures[previousTemperatureIndex] = scaledTemperature;
 			previousTemperaturesGood = (previousTemperaturesGood << 1) | 1;
 
 			// Get the target temperature and the error
@@ -264,7 +358,7 @@ void PID::Spin()
 							&& (float)(millis() - timeSetHeating) > model.GetDeadTime() * SecondsToMillis * 2)
 						{
 							++heatingFaultCount;
-							if (heatingFaultCount * platform.HeatSampleInterval() > maxHeatingFaultTime * SecondsToMillis)
+							if (heatingFaultCount > maxHeatingFaultCount)
 							{
 								SetHeater(0.0);					// do this here just to be sure
 								mode = HeaterMode::fault;
@@ -291,7 +385,7 @@ void PID::Spin()
 				if (fabsf(error) > maxTempExcursion && temperature > MaxAmbientTemperature)
 				{
 					++heatingFaultCount;
-					if (heatingFaultCount * platform.HeatSampleInterval() > maxHeatingFaultTime * SecondsToMillis)
+					if (heatingFaultCount > maxHeatingFaultCount)
 					{
 						SetHeater(0.0);					// do this here just to be sure
 						mode = HeaterMode::fault;
@@ -328,6 +422,7 @@ void PID::Spin()
 			if (mode <= HeaterMode::suspended)
 			{
 				lastPwm = 0.0;
+				predictorValid = false;
 			}
 			else if (mode < HeaterMode::tuning0)
 			{
@@ -338,11 +433,22 @@ void PID::Spin()
 					const bool inLoadMode = (mode == HeaterMode::stable) || fabsf(error) < 3.0;		// use standard PID when maintaining temperature
 					const PidParameters& params = model.GetPidParameters(inLoadMode);
 
+					// If we are using the predictor, control the temperature that we expect to measure once the sensor has seen the effect of the PWM changes we have already made
+					const bool predicting = usePredictor && !model.IsInverted();
+					if (predicting && !predictorValid)
+					{
+						ResetPredictor();
+					}
+					const float controlError = (predicting) ? targetTemperature - (temperature + modelTemperature - GetDelayedModelTemperature()) : error;
+
+					// Add the power needed to melt the filament that we expect to be extruding when the heat reaches the nozzle
+					const float extrusionPwm = feedForward * extrusionRate;
+
 					// If the P and D terms together demand that the heater is full on or full off, disregard the I term
-					const float errorMinusDterm = error - (params.tD * derivative);
+					const float errorMinusDterm = controlError - (params.tD * derivative);
 					const float pPlusD = params.kP * errorMinusDterm;
 					const float expectedPwm = constrain<float>((temperature - NormalAmbientTemperature)/model.GetGain(), 0.0, model.GetMaxPwm());
-					if (pPlusD + expectedPwm > model.GetMaxPwm())
+					if (pPlusD + expectedPwm + extrusionPwm > model.GetMaxPwm())
 					{
 						lastPwm = model.GetMaxPwm();
 						// If we are heating up, preset the I term to the expected PWM at this temperature, ready for the switch over to PID
@@ -351,17 +457,26 @@ void PID::Spin()
 							iAccumulator = expectedPwm;
 						}
 					}
-					else if (pPlusD + expectedPwm < 0.0)
+					else if (pPlusD + expectedPwm + extrusionPwm < 0.0)
 					{
 						lastPwm = 0.0;
 					}
 					else
 					{
-						const float errorToUse = error;
+						const float errorToUse = controlError;
 						iAccumulator = constrain<float>
-										(iAccumulator + (errorToUse * params.kP * params.recipTi * platform.HeatSampleInterval() * MillisToSeconds),
+										(iAccumulator + (errorToUse * params.kP * params.recipTi * sampleInterval * MillisToSeconds),
 											0.0, model.GetMaxPwm());
-						lastPwm = constrain<float>(pPlusD + iAccumulator, 0.0, model.GetMaxPwm());
+						lastPwm = constrain<float>(pPlusD + iAccumulator + extrusionPwm, 0.0, model.GetMaxPwm());
+					}
+
+					if (predicting)
+					{
+						UpdatePredictor(lastPwm);
+					}
+					else
+					{
+						predictorValid = false;
 					}
 #if HAS_VOLTAGE_MONITOR
 					// Scale the PID based on the current voltage vs. the calibration voltage
@@ -382,6 +497,7 @@ void PID::Spin()
 				{
 					// Using bang-bang mode
 					lastPwm = (error > 0.0) ? model.GetMaxPwm() : 0.0;
+					predictorValid = false;
 				}
 
 				// Check if the generated PWM signal needs to be inverted for inverse temperature control
@@ -390,10 +506,17 @@ void PID::Spin()
 					lastPwm = model.GetMaxPwm() - lastPwm;
 				}
 
+				// Keep within our share of the power budget
+				requestedPwm = lastPwm;
+				if (CanBePowerLimited() && lastPwm > powerLimit)
+				{
+					lastPwm = powerLimit;
+				}
+
 				// Verify that everything is operating in the required temperature range
 				for (HeaterProtection *prot = heaterProtection; prot != nullptr; prot = prot->Next())
 				{
-					if (!prot->Check())
+					if (!prot->Check(heater, temperature))
 					{
 						lastPwm = 0.0;
 						switch (prot->GetAction())
@@ -418,14 +541,19 @@ void PID::Spin()
 			else
 			{
 				DoTuningStep();
+				predictorValid = false;
 			}
 		}
 
 		// Set the heater power and update the average PWM
 		SetHeater(lastPwm);
-		averagePWM = averagePWM * (1.0 - platform.HeatSampleInterval()/(HEAT_PWM_AVERAGE_TIME * SecondsToMillis)) + lastPwm;
+		averagePWM = averagePWM * (1.0 - pwmAverageFactor) + lastPwm;
 		previousTemperatureIndex = (previousTemperatureIndex + 1) % NumPreviousTemperatures;
 
+#if SUPPORT_HEATER_TRACE
+		HeaterTracer::Record(heater, temperature, (mode > HeaterMode::suspended) ? ((active) ? activeTemperature : standbyTemperature) : 0.0, lastPwm, (uint8_t)mode);
+#endif
+
 		// For temperature sensors which do not require frequent sampling and averaging,
 		// their temperature is read here and error/safety handling performed.  However,
 		// unlike the Tick ISR, this code is not executed at interrupt level and consequently
@@ -527,7 +655,41 @@ void PID::ResetFault()
 
 float PID::GetAveragePWM() const
 {
-	return averagePWM * platform.HeatSampleInterval()/(HEAT_PWM_AVERAGE_TIME * SecondsToMillis);
+	return averagePWM * pwmAverageFactor;
+}
+
+// Get the PWM we would be using if the power budget didn't limit us
+float PID::GetRequestedPwm() const
+{
+	return (mode <= HeaterMode::suspended) ? 0.0
+			: (CanBePowerLimited()) ? requestedPwm
+				: lastPwm;
+}
+
+// Get our priority when the heaters share a limited power budget. Heaters that have reached their target temperature come first,
+// so that heaters that are already in use keep their temperatures. Of the heaters that are heating up, the one that the process model
+// says will take longest to reach its target at full power comes next, because that heater determines how soon all of them are ready.
+float PID::GetPowerPriority() const
+{
+	if (mode != HeaterMode::heating)
+	{
+		return FLT_MAX;
+	}
+
+	return EstimateHeatingTime((active) ? activeTemperature : standbyTemperature);
+}
+
+// Estimate how long it would take to heat from the current temperature to the target temperature at full power, using the process model.
+// If the model says that full power can't reach the target, this returns the time to get within 1C of the highest temperature we can reach.
+float PID::EstimateHeatingTime(float targetTemp) const
+{
+	if (temperature >= targetTemp)
+	{
+		return 0.0;
+	}
+	const float maxTemperature = NormalAmbientTemperature + model.GetGain() * model.GetMaxPwm();		// the temperature that full power would take us to eventually
+	return model.GetDeadTime()
+			+ model.GetTimeConstant() * logf(max<float>(maxTemperature - temperature, 1.0)/max<float>(maxTemperature - targetTemp, 1.0));
 }
 
 // Get a conservative estimate of the expected heating rate at the current temperature and average PWM. The result may be negative.
@@ -542,7 +704,7 @@ float PID::GetExpectedHeatingRate() const
 }
 
 // Auto tune this PID
-void PID::StartAutoTune(float targetTemp, float maxPwm, const StringRef& reply)
+void PID::StartAutoTune(float targetTemp, float maxPwm, bool useRelay, const StringRef& reply)
 {
 	// Starting an auto tune
 	if (!model.IsEnabled())
@@ -570,10 +732,12 @@ void PID::StartAutoTune(float targetTemp, float maxPwm, const StringRef& reply)
 			// would be wasteful to allocate a permanent array just in case we are going to run it, so we make an exception here.
 			tuningTempReadings = new float[MaxTuningTempReadings];
 			tuningTempReadings[0] = temperature;
-			tuningReadingInterval = platform.HeatSampleInterval();
+			tuningReadingInterval = sampleInterval;
 			tuningPwm = maxPwm;
 			tuningTargetTemp = targetTemp;
-			reply.printf("Auto tuning heater %d using target temperature %.1f" DEGREE_SYMBOL "C and PWM %.2f - do not leave printer unattended", heater, (double)targetTemp, (double)maxPwm);
+			tuningUseRelay = useRelay;
+			reply.printf("Auto tuning heater %d using %s, target temperature %.1f" DEGREE_SYMBOL "C and PWM %.2f - do not leave printer unattended",
+							heater, (useRelay) ? "relay method" : "step response", (double)targetTemp, (double)maxPwm);
 		}
 	}
 }
@@ -585,7 +749,11 @@ void PID::GetAutoTuneStatus(const StringRef& reply)	// Get the auto tune status
 		reply.printf("Heater %d is being tuned, phase %u of %u",
 						heater,
 						(unsigned int)mode - (unsigned int)HeaterMode::tuning0 + 1,
-						(unsigned int)HeaterMode::lastTuningMode - (unsigned int)HeaterMode::tuning0 + 1);
+						(tuningUseRelay) ? 3 : (unsigned int)HeaterMode::lastTuningMode - (unsigned int)HeaterMode::tuning0 + 1);
+		if (mode == HeaterMode::tuning2 && tuningUseRelay)
+		{
+			reply.catf(", %u relay cycles done", relayCyclesDone);
+		}
 	}
 	else if (tuned)
 	{
@@ -640,6 +808,18 @@ void PID::GetAutoTuneStatus(const StringRef& reply)	// Get the auto tune status
  *     Kc = (1.086/G) * (td/tc)^-0.869
  *     Ti = tc/(0.74 - 0.13 * td/tc)
  *     Td = 0.348 * tc * (td/tc)^0.914
+ *
+ * M303 R1 selects the relay method instead. Steps 1 and 2 are the same, then:
+ * 3. Heat at the specified power until the temperature reaches the target.
+ * 4. Switch the heater off when the temperature rises more than the hysteresis above the target and on when it falls more than the hysteresis below it,
+ *    so that the temperature oscillates about the target.
+ * 5. At the end of each cycle, estimate the model from the cycle:
+ *     G from the average PWM needed to hold the mean temperature of the cycle above the starting temperature
+ *     the ultimate gain Ku = 4 * d/(pi * a) where d is half the PWM and a is half the peak to peak temperature swing, and the ultimate angular frequency w = 2 * pi/period
+ *     tc = sqrt((G * Ku)^2 - 1)/w, from the FOPDT gain at w being 1/Ku
+ *     td = (pi - asin(hysteresis/a) - atan(w * tc))/w, from the FOPDT phase lag at w, corrected for the lag that the hysteresis adds
+ *    The first cycle starts from the overshoot of the initial heat-up, so we ignore it.
+ * 6. Stop as soon as the estimates from successive cycles agree, which typically takes 4 or 5 cycles.
  */
 
 // This is called on each temperature sample when auto tuning
@@ -679,7 +859,7 @@ void PID::DoTuningStep()
 	{
 	case HeaterMode::tuning0:
 		// Waiting for initial temperature to settle after any thermostatic fans have turned on
-		if (ReadingsStable(6000/platform.HeatSampleInterval(), 2.0))	// expect temperature to be stable within a 2C band for 6 seconds
+		if (ReadingsStable(min<size_t>(6000/sampleInterval, MaxTuningTempReadings), 2.0))	// expect temperature to be stable within a 2C band for 6 seconds
 		{
 			// Starting temperature is stable, so move on
 			tuningReadingsTaken = 1;
@@ -690,7 +870,7 @@ void PID::DoTuningStep()
 			tuningTempReadings[0] = tuningStartTemp = temperature;
 			timeSetHeating = tuningPhaseStartTime = millis();
 			lastPwm = tuningPwm;										// turn on heater at specified power
-			tuningReadingInterval = platform.HeatSampleInterval();		// reset sampling interval
+			tuningReadingInterval = sampleInterval;		// reset sampling interval
 			mode = HeaterMode::tuning1;
 			platform.Message(GenericMessage, "Auto tune phase 1, heater on\n");
 			return;
@@ -726,7 +906,19 @@ void PID::DoTuningStep()
 			tuningVoltageAccumulator += platform.GetCurrentPowerVoltage();
 			++voltageSamplesTaken;
 #endif
-			if (temperature >= tuningTargetTemp)							// if reached target
+			if (temperature >= tuningTargetTemp && tuningUseRelay)
+			{
+				// Start the relay cycles with the heater off
+				relayHeaterOn = relayCycleStarted = false;
+				relayOffTime = tuningPhaseStartTime = millis();
+				relayMaxTemp = relayMinTemp = temperature;
+				relayCyclesDone = relayCyclesAgreed = 0;
+				mode = HeaterMode::tuning2;
+				lastPwm = 0.0;
+				SetHeater(0.0);
+				platform.Message(GenericMessage, "Auto tune phase 3, relay cycles\n");
+			}
+			else if (temperature >= tuningTargetTemp)						// if reached target
 			{
 				tuningHeatingTime = heatingTime;
 
@@ -734,7 +926,7 @@ void PID::DoTuningStep()
 				tuningReadingsTaken = 1;
 				tuningHeaterOffTemp = tuningTempReadings[0] = temperature;
 				tuningPhaseStartTime = millis();
-				tuningReadingInterval = platform.HeatSampleInterval();		// reset sampling interval
+				tuningReadingInterval = sampleInterval;		// reset sampling interval
 				mode = HeaterMode::tuning2;
 				lastPwm = 0.0;
 				SetHeater(0.0);
@@ -744,6 +936,15 @@ void PID::DoTuningStep()
 		return;
 
 	case HeaterMode::tuning2:
+		if (tuningUseRelay)
+		{
+			if (!DoRelayStep())
+			{
+				return;
+			}
+			break;
+		}
+
 		// Heater turned off, looking for peak temperature
 		{
 			const int peakIndex = GetPeakTempIndex();
@@ -772,7 +973,7 @@ void PID::DoTuningStep()
 				tuningReadingsTaken = 1;
 				tuningTempReadings[0] = temperature;
 				tuningPhaseStartTime = millis();
-				tuningReadingInterval = platform.HeatSampleInterval();		// reset sampling interval
+				tuningReadingInterval = sampleInterval;		// reset sampling interval
 				mode = HeaterMode::tuning3;
 				platform.MessageF(GenericMessage, "Auto tune phase 3, peak temperature was %.1f\n", (double)tuningPeakTemperature);
 				return;
@@ -909,6 +1110,12 @@ void PID::CalculateModel()
 	//const float td = (float)(tuningPeakDelay + 500) * 0.00065;		// take the dead time as 65% of the delay to peak rounded up to a half second
 	const float td = tc * logf((gain + tuningStartTemp - tuningHeaterOffTemp)/(gain + tuningStartTemp - tuningPeakTemperature)) * 1.3;
 
+	SetTunedModel(gain, tc, td);
+}
+
+// Store the model we found by tuning and report the result
+void PID::SetTunedModel(float gain, float tc, float td)
+{
 	tuned = SetModel(gain, tc, td, tuningPwm,
 #if HAS_VOLTAGE_MONITOR
 						tuningVoltageAccumulator/voltageSamplesTaken,
@@ -929,6 +1136,111 @@ void PID::CalculateModel()
 	}
 }
 
+// Do one step of relay tuning. Return true if tuning has finished, either because the model estimates have converged or because we failed.
+bool PID::DoRelayStep()
+{
+	const uint32_t now = millis();
+#if HAS_VOLTAGE_MONITOR
+	tuningVoltageAccumulator += platform.GetCurrentPowerVoltage();
+	++voltageSamplesTaken;
+#endif
+	relayMaxTemp = max<float>(relayMaxTemp, temperature);
+	relayMinTemp = min<float>(relayMinTemp, temperature);
+
+	if (relayHeaterOn)
+	{
+		if (temperature >= tuningTargetTemp + RelayHysteresis)
+		{
+			relayHeaterOn = false;
+			relayOffTime = now;
+			lastPwm = 0.0;
+		}
+	}
+	else if (temperature <= tuningTargetTemp - RelayHysteresis)
+	{
+		// The heater is turning on again, so this is the end of a cycle unless this is the first time
+		if (relayCycleStarted)
+		{
+			float gain, tc, td;
+			const bool estimated = relayCyclesDone != 0 && EstimateRelayModel(now - relayOnTime, gain, tc, td);		// ignore the first cycle
+			if (estimated
+				&& fabsf(gain - relayGain) <= RelayConvergence * gain
+				&& fabsf(tc - relayTc) <= RelayConvergence * tc
+				&& fabsf(td - relayTd) <= RelayConvergence * td
+			   )
+			{
+				++relayCyclesAgreed;
+			}
+			else
+			{
+				relayCyclesAgreed = 0;
+			}
+			++relayCyclesDone;
+
+			if (reprap.Debug(moduleHeat) && estimated)
+			{
+				platform.MessageF(UsbMessage, "Relay cycle %u: G=%.1f, tc=%.1f, td=%.2f\n", relayCyclesDone, (double)gain, (double)tc, (double)td);
+			}
+
+			if (estimated)
+			{
+				relayGain = gain;
+				relayTc = tc;
+				relayTd = td;
+				if (relayCyclesAgreed != 0 && relayCyclesDone >= MinRelayCycles)
+				{
+					SetTunedModel(gain, tc, td);
+					return true;
+				}
+			}
+			if (relayCyclesDone == MaxRelayCycles)
+			{
+				platform.Message(GenericMessage, "Auto tune cancelled because the model estimates did not converge\n");
+				return true;
+			}
+		}
+		relayHeaterOn = true;
+		relayCycleStarted = true;
+		relayOnTime = now;
+		relayMaxTemp = relayMinTemp = temperature;
+		lastPwm = tuningPwm;
+	}
+
+	// Give up if the heater has been switched the same way for too long
+	const uint32_t timeoutMinutes = (reprap.GetHeat().IsBedOrChamberHeater(heater)) ? 20 : 5;
+	if (now - ((relayHeaterOn) ? relayOnTime : relayOffTime) >= timeoutMinutes * 60 * (uint32_t)SecondsToMillis)
+	{
+		platform.Message(GenericMessage, "Auto tune cancelled because the temperature did not cross the target\n");
+		return true;
+	}
+	return false;
+}
+
+// Estimate the model parameters from a relay cycle that took 'cycleTime' milliseconds, returning false if the cycle doesn't give a sensible estimate
+bool PID::EstimateRelayModel(uint32_t cycleTime, float& gain, float& tc, float& td) const
+{
+	const float amplitude = (relayMaxTemp - relayMinTemp) * 0.5;
+	const float duty = (float)(relayOffTime - relayOnTime)/(float)cycleTime;
+	if (amplitude <= RelayHysteresis || duty <= 0.0)
+	{
+		return false;
+	}
+
+	gain = ((relayMaxTemp + relayMinTemp) * 0.5 - tuningStartTemp)/(duty * tuningPwm);
+	const float ultimateGain = (2.0 * tuningPwm)/(Pi * amplitude);			// 4 * d/(pi * a) with d = tuningPwm/2
+	const float gainProduct = gain * ultimateGain;
+	if (gainProduct <= 1.0)
+	{
+		return false;
+	}
+
+	const float w = (2.0 * Pi * SecondsToMillis)/(float)cycleTime;
+	tc = sqrtf(fsquare(gainProduct) - 1.0)/w;
+	td = (Pi - asinf(RelayHysteresis/amplitude) - atanf(w * tc))/w
+			- 0.5 * sampleInterval * MillisToSeconds;						// on average we switch the relay half a sample interval late
+	return td > 0.0;
+}
+
 void PID::DisplayBuffer(const char *intro)
 {
 	OutputBuffer *buf;
@@ -39,6 +39,8 @@ class PID
 	};
 
 	static const size_t NumPreviousTemperatures = 4; // How many samples we average the temperature derivative over
+	static constexpr float TemperatureHistoryScale = 1000.0;	// We keep the previous temperatures in millidegrees, so that the spike check is an integer comparison
+	static constexpr float MaxTemperatureDerivative = 10.0;	// Some sensors give occasional spikes, so we ignore derivatives greater than this in C/sec
 
 public:
 
@@ -64,8 +66,15 @@ public:
 	float GetTemperature() const;					// Get the current temperature
 	float GetAveragePWM() const;					// Return the running average PWM to the heater. Answer is a fraction in [0, 1].
 	uint32_t GetLastSampleTime() const;				// Return when the temp sensor was last sampled
+	uint32_t GetSampleInterval() const				// Return the interval between temperature samples in milliseconds
+		{ return sampleInterval; }
+	void SetSampleInterval(uint32_t interval);		// Set the interval between temperature samples, called by Heat before each call to Spin
+	uint32_t GetRequestedSampleInterval() const		// Return the sample interval set by M135 for this heater, or 0 if it uses the default
+		{ return requestedSampleInterval; }
+	void SetRequestedSampleInterval(uint32_t interval)
+		{ requestedSampleInterval = interval; }
 	float GetAccumulator() const;					// Return the integral accumulator
-	void StartAutoTune(float targetTemp, float maxPwm, const StringRef& reply);	// Start an auto tune cycle for this PID
+	void StartAutoTune(float targetTemp, float maxPwm, bool useRelay, const StringRef& reply);	// Start an auto tune cycle for this PID
 	bool IsTuning() const;
 	void GetAutoTuneStatus(const StringRef& reply);	// Get the auto tune status or last result
 
@@ -86,13 +95,31 @@ public:
 		{ pMaxTempExcursion = maxTempExcursion; pMaxFaultTime = maxHeatingFaultTime; }
 
 	void SetFaultDetectionParameters(float pMaxTempExcursion, float pMaxFaultTime)
-		{ maxTempExcursion = pMaxTempExcursion; maxHeatingFaultTime = pMaxFaultTime; }
+		{ maxTempExcursion = pMaxTempExcursion; maxHeatingFaultTime = pMaxFaultTime; UpdateSampleFactors(); }
 
 	void SetM301PidParameters(const M301PidParameters& params)
 		{ model.SetM301PidParameters(params); }
 
 	void Suspend(bool sus);							// Suspend the heater to conserve power or while doing Z probing
 
+	float GetFeedForward() const					// Get the extra PWM per mm/sec of filament extruded
+		{ return feedForward; }
+	bool UsingPredictor() const						// Are we controlling the predicted temperature instead of the measured temperature?
+		{ return usePredictor; }
+	void SetPredictiveControl(float pFeedForward, bool pUsePredictor);	// Configure feed-forward from extrusion and the dead time predictor
+	void SetExtrusionRate(float rate)				// Set the filament extrusion rate in mm/sec that we expect when heat applied now reaches the sensor
+		{ extrusionRate = rate; }
+
+	float GetPwm() const							// Get the PWM we are outputting now
+		{ return lastPwm; }
+	float GetRequestedPwm() const;					// Get the PWM we would output if we were not limited by the power budget
+	float GetPowerPriority() const;					// Get our priority when sharing the power budget, higher values first
+	float EstimateHeatingTime(float targetTemp) const;	// Estimate how many seconds it would take to reach a temperature at full power
+	bool CanBePowerLimited() const					// Can Heat limit our power to stay within the power budget?
+		{ return mode > HeaterMode::suspended && mode < HeaterMode::tuning0 && !model.IsInverted(); }
+	void SetPowerLimit(float limit)					// Set the maximum PWM that the power budget allows us, called by Heat before each call to Spin
+		{ powerLimit = limit; }
+
 private:
 
 	void SwitchOn();								// Turn the heater on and set the mode
@@ -104,8 +131,16 @@ private:
 	static int GetPeakTempIndex();					// Auto tune helper function
 	static int IdentifyPeak(size_t numToAverage);	// Auto tune helper function
 	void CalculateModel();							// Calculate G, td and tc from the accumulated readings
+	bool DoRelayStep();								// Called on each temperature sample during relay tuning, returns true if tuning has finished
+	bool EstimateRelayModel(uint32_t cycleTime, float& gain, float& tc, float& td) const;	// Estimate G, tc and td from one relay cycle
+	void SetTunedModel(float gain, float tc, float td);	// Store the model we found by tuning and report the result
 	void DisplayBuffer(const char *intro);			// Debug helper
 	float GetExpectedHeatingRate() const;			// Get the minimum heating rate we expect
+	void UpdateSampleFactors();						// Recalculate the values that depend on the sample interval and fault time
+	void ResetPredictor();							// Start predicting from the current temperature
+	void UpdatePredictor(float pwm);				// Update the undelayed model temperature after setting the PWM
+	uint32_t GetModelHistoryInterval() const;		// Get the interval between entries in the model history
+	float GetDelayedModelTemperature() const;		// Get the model temperature from one dead time ago
 
 	Platform& platform;								// The instance of the class that is the RepRap hardware
 	HeaterProtection *heaterProtection;				// The first element of assigned heater protection items
@@ -114,14 +149,33 @@ private:
 	float maxTempExcursion;							// The maximum temperature excursion permitted while maintaining the setpoint
 	float maxHeatingFaultTime;						// How long a heater fault is permitted to persist before a heater fault is raised
 	float temperature;								// The current temperature
-	float previousTemperatures[NumPreviousTemperatures]; // The temperatures of the previous NumDerivativeSamples measurements, used for calculating the derivative
+	int32_t previousTemperatures[NumPreviousTemperatures]; // The temperatures of the previous NumPreviousTemperatures measurements in millidegrees, used for calculating the derivative
+	int32_t maxTemperatureChange;					// The largest change in millidegrees over NumPreviousTemperatures samples that we accept as genuine
+	float derivativeFactor;							// Converts a change in millidegrees over NumPreviousTemperatures samples to C/sec
+	float pwmAverageFactor;							// The weight of each sample in the running average of the PWM
+	uint32_t maxHeatingFaultCount;					// A heating fault is raised when heatingFaultCount exceeds this
 	size_t previousTemperatureIndex;				// Which slot in previousTemperature we fill in next
 	FopDt model;									// The process model and PID parameters
 	float iAccumulator;								// The integral PID component
 	float lastPwm;									// The last PWM value we output, before scaling by kS
+	float requestedPwm;								// The PWM we wanted last time, before applying the power limit
+	float powerLimit;								// The maximum PWM that the power budget allows us
 	float averagePWM;								// The running average of the PWM, after scaling.
 	uint32_t timeSetHeating;						// When we turned on the heater
 	uint32_t lastSampleTime;						// Time when the temperature was last sampled by Spin()
+	uint32_t sampleInterval;						// The interval between calls to Spin in milliseconds
+	uint32_t requestedSampleInterval;				// The sample interval requested for this heater, or 0 to use the default
+
+	// Variables used for model predictive control
+	static const size_t NumModelHistory = 16;		// The number of past model temperatures we keep to cover the dead time
+	float feedForward;								// Extra PWM per mm/sec of filament extruded
+	volatile float extrusionRate;					// The extrusion rate to feed forward, set by the Move task
+	float modelTemperature;							// The temperature the model predicts we will measure one dead time from now
+	float modelHistory[NumModelHistory];			// The model temperatures over the last dead time or more
+	uint32_t lastModelHistoryTime;					// When we last stored a model temperature in the history
+	size_t modelHistoryIndex;						// Which slot in modelHistory we fill in next
+	bool usePredictor;								// True to control the predicted temperature (a Smith predictor)
+	bool predictorValid;							// True if the model temperatures have been initialised
 
 	uint16_t heatingFaultCount;						// Count of questionable heating behaviours
 
@@ -150,6 +204,23 @@ private:
 	static float tuningPeakTemperature;				// the peak temperature reached, averaged over 3 readings (so slightly less than the true peak)
 	static uint32_t tuningHeatingTime;				// how long we had the heating on for
 	static uint32_t tuningPeakDelay;				// how many milliseconds the temperature continues to rise after turning the heater off
+
+	// Variables used during relay tuning
+	static constexpr float RelayHysteresis = 1.0;		// How far the temperature must go past the target before we switch the heater over
+	static constexpr unsigned int MinRelayCycles = 3;	// The minimum number of complete cycles, including the first one which we ignore
+	static constexpr unsigned int MaxRelayCycles = 20;	// The number of cycles after which we give up if the estimates haven't converged
+	static constexpr float RelayConvergence = 0.05;		// Successive estimates must agree within this fraction for the model to have converged
+
+	static bool tuningUseRelay;						// true if we are doing relay tuning instead of the step response
+	static bool relayHeaterOn;						// true if the relay has the heater on
+	static bool relayCycleStarted;					// true if the heater has turned on since the relay cycles began
+	static uint32_t relayOnTime;					// when the current relay cycle started with the heater turning on
+	static uint32_t relayOffTime;					// when the heater turned off in the current relay cycle
+	static float relayMaxTemp;						// the highest temperature in the current relay cycle
+	static float relayMinTemp;						// the lowest temperature in the current relay cycle
+	static unsigned int relayCyclesDone;			// how many relay cycles we have completed
+	static unsigned int relayCyclesAgreed;			// how many successive cycles have given consistent estimates
+	static float relayGain, relayTc, relayTd;		// the estimates from the last relay cycle
 };
 
 
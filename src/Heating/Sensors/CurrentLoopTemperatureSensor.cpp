@@ -15,9 +15,6 @@ const uint32_t MCP3204_Frequency = 1000000;		// maximum for MCP3204 is 1MHz @ 2.
 // The MCP3204 samples input data on the rising edge and changes the output data on the rising edge.
 const uint8_t MCP3204_SpiMode = SPI_MODE_0;
 
-// Define the minimum interval between readings
-const uint32_t MinimumReadInterval = 100;		// minimum interval between reads, in milliseconds
-
 CurrentLoopTemperatureSensor::CurrentLoopTemperatureSensor(unsigned int channel)
 	: SpiTemperatureSensor(channel, "Current Loop", channel - FirstLinearAdcChannel, MCP3204_SpiMode, MCP3204_Frequency),
 	  tempAt4mA(DefaultTempAt4mA), tempAt20mA(DefaultTempAt20mA)
@@ -71,15 +68,14 @@ GCodeResult CurrentLoopTemperatureSensor::Configure(unsigned int mCode, unsigned
 	return GCodeResult::ok;
 }
 
-TemperatureError CurrentLoopTemperatureSensor::GetTemperature(float& t)
+// Read the ADC. Called with the SPI mutex held.
+void CurrentLoopTemperatureSensor::ReadSensor()
 {
-	if (!inInterrupt() && millis() - lastReadingTime >= MinimumReadInterval)
+	TryGetLinearAdcTemperature();
+	if (lastResult == TemperatureError::success)
 	{
-		TryGetLinearAdcTemperature();
+		lastReadingTime = millis();
 	}
-
-	t = lastTemperature;
-	return lastResult;
 }
 
 void CurrentLoopTemperatureSensor::CalcDerivedParameters()
@@ -13,21 +13,17 @@
 #if SUPPORT_DHT_SENSOR
 
 constexpr uint32_t MinimumReadInterval = 2000;		// ms
+constexpr uint32_t SlotInterval = MinimumReadInterval/MaxSpiTempSensors;	// ms
+constexpr uint32_t StartSignalLength = 20;			// ms
 constexpr uint32_t MaximumReadTime = 20;			// ms
-constexpr uint32_t MinimumOneBitLength = 50;		// microseconds
+constexpr uint32_t MinimumOneBitLength = 100;		// microseconds between falling edges. A 0 bit takes about 78us and a 1 bit about 120us.
 constexpr uint32_t MinimumOneBitStepClocks = (StepClockRate * MinimumOneBitLength)/1000000;
 
-# include "Tasks.h"
-
 // Static data members of class DhtSensorHardwareInterface
 Mutex DhtSensorHardwareInterface::dhtMutex;
-Task<DhtSensorHardwareInterface::DhtTaskStackWords> *DhtSensorHardwareInterface::dhtTask = nullptr;
 DhtSensorHardwareInterface *DhtSensorHardwareInterface::activeSensors[MaxSpiTempSensors] = { 0 };
-
-extern "C" void DhtTask(void * pvParameters)
-{
-	DhtSensorHardwareInterface::SensorTask();
-}
+size_t DhtSensorHardwareInterface::currentSlot = 0;
+uint32_t DhtSensorHardwareInterface::slotStartTime = 0;
 
 // Pulse ISR
 extern "C" void DhtDataTransition(CallbackParameter cp)
@@ -35,9 +31,16 @@ extern "C" void DhtDataTransition(CallbackParameter cp)
 	static_cast<DhtSensorHardwareInterface*>(cp.vp)->Interrupt();
 }
 
+// Software timer callback at the end of the start signal
+static bool DhtStartSignalDone(void *param, uint32_t& when)
+{
+	static_cast<DhtSensorHardwareInterface*>(param)->EndStartSignal();
+	return false;
+}
+
 DhtSensorHardwareInterface::DhtSensorHardwareInterface(Pin p_pin)
 	: sensorPin(p_pin), type(DhtSensorType::none), lastResult(TemperatureError::notInitialised),
-	  lastTemperature(BAD_ERROR_TEMPERATURE), lastHumidity(BAD_ERROR_TEMPERATURE), badTemperatureCount(0)
+	  lastTemperature(BAD_ERROR_TEMPERATURE), lastHumidity(BAD_ERROR_TEMPERATURE), badTemperatureCount(0), state(DhtState::idle), numEdges(0)
 {
 	IoPort::SetPinMode(sensorPin, INPUT_PULLUP);
 }
@@ -133,12 +136,6 @@ DhtSensorHardwareInterface *DhtSensorHardwareInterface::Create(unsigned int rela
 		activeSensors[relativeChannel] = new DhtSensorHardwareInterface(SpiTempSensorCsPins[relativeChannel]);
 	}
 
-	if (dhtTask == nullptr)
-	{
-		dhtTask = new Task<DhtTaskStackWords>;
-		dhtTask->Create(DhtTask, "DHTSENSOR", nullptr, TaskBase::HeatPriority);
-	}
-
 	return activeSensors[relativeChannel];
 }
 
@@ -166,116 +163,131 @@ DhtSensorHardwareInterface *DhtSensorHardwareInterface::Create(unsigned int rela
 	return activeSensors[relativeChannel]->GetTemperatureOrHumidity(t, wantHumidity);
 }
 
+// Record the time of a falling edge on the data line
 void DhtSensorHardwareInterface::Interrupt()
 {
-	if (numPulses < ARRAY_SIZE(pulses))
+	if (numEdges < ARRAY_SIZE(edgeTimes))
 	{
-		const uint16_t now = Platform::GetInterruptClocks16();
-		if (IoPort::ReadPin(sensorPin))
-		{
-			lastPulseTime = now;
-		}
-		else if (lastPulseTime != 0)
-		{
-			pulses[numPulses++] = now - lastPulseTime;
-		}
+		edgeTimes[numEdges++] = Platform::GetInterruptClocks16();
 	}
 }
 
-void DhtSensorHardwareInterface::TakeReading()
+void DhtSensorHardwareInterface::StartReading()
 {
 	if (type != DhtSensorType::none)			// if sensor has been configured
 	{
 		// Send the start bit. This must be at least 18ms for the DHT11, 0.8ms for the DHT21, and 1ms long for the DHT22.
+		// The software timer ends it, so that we don't hold up the Heat task.
 		IoPort::SetPinMode(sensorPin, OUTPUT_LOW);
-		delay(20);
-
+		state = DhtState::starting;
+		if (timer.ScheduleCallback(SoftTimer::GetTimerTicksNow() + (StartSignalLength * SoftTimer::GetTickRate())/1000, DhtStartSignalDone, this))
 		{
-			TaskCriticalSectionLocker lock;		// make sure the Heat task doesn't interrupt the sequence
-
-			// End the start signal by setting data line high. the sensor will respond with the start bit in 20 to 40us.
-			// We need only force the data line high long enough to charge the line capacitance, after that the pullup resistor keeps it high.
-			IoPort::WriteDigital(sensorPin, HIGH);		// this will generate an interrupt, but we will ignore it
-			delayMicroseconds(3);
-
-			// Now start reading the data line to get the value from the DHT sensor
-			IoPort::SetPinMode(sensorPin, INPUT_PULLUP);
-
-			// It appears that switching the pin to an output disables the interrupt, so we need to call attachInterrupt here
-			// We are likely to get an immediate interrupt at this point corresponding to the low-to-high transition. We must ignore this.
-			numPulses = ARRAY_SIZE(pulses);		// tell the ISR not to collect data yet
-			attachInterrupt(sensorPin, DhtDataTransition, INTERRUPT_MODE_CHANGE, this);
-			lastPulseTime = 0;
-			numPulses = 0;						// tell the ISR to collect data
+			TaskCriticalSectionLocker lock;
+			EndStartSignal();
 		}
+	}
+}
 
-		// Wait for the incoming signal to be read by the ISR (1 start bit + 40 data bits), or until timeout.
-		// We don't have the ISR wake the process up, because that would require the priority of the pin change interrupt to be reduced.
-		// So we just delay for long enough for the data to have been sent. It takes typically 4 to 5ms.
-		delay(MaximumReadTime);
+// End the start signal and start capturing the response. This is called from the software timer interrupt, so nothing can interrupt the sequence.
+void DhtSensorHardwareInterface::EndStartSignal()
+{
+	// End the start signal by setting data line high. the sensor will respond with the start bit in 20 to 40us.
+	// We need only force the data line high long enough to charge the line capacitance, after that the pullup resistor keeps it high.
+	IoPort::WriteDigital(sensorPin, HIGH);
+	delayMicroseconds(3);
 
-		detachInterrupt(sensorPin);
+	// Now start reading the data line to get the value from the DHT sensor
+	IoPort::SetPinMode(sensorPin, INPUT_PULLUP);
 
-		// Attempt to convert the signal into temp+RH values
-		const TemperatureError rslt = ProcessReadings();
-		if (rslt == TemperatureError::success)
-		{
-			lastResult = rslt;
-			badTemperatureCount = 0;
-		}
-		else if (badTemperatureCount < MAX_BAD_TEMPERATURE_COUNT)
+	// It appears that switching the pin to an output disables the interrupt, so we need to call attachInterrupt here.
+	// We only need the falling edges, because the time between them tells us whether each bit is 0 or 1.
+	numEdges = 0;
+	state = DhtState::receiving;
+	attachInterrupt(sensorPin, DhtDataTransition, INTERRUPT_MODE_FALLING, this);
+}
+
+// Stop capturing the data and decode it. The sensor takes typically 4 to 5ms to send the data.
+void DhtSensorHardwareInterface::FinishReading()
+{
+	detachInterrupt(sensorPin);
+	state = DhtState::idle;
+
+	// Attempt to convert the signal into temp+RH values
+	const TemperatureError rslt = ProcessReadings();
+	if (rslt == TemperatureError::success)
+	{
+		lastResult = rslt;
+		badTemperatureCount = 0;
+	}
+	else if (badTemperatureCount < MAX_BAD_TEMPERATURE_COUNT)
+	{
+		badTemperatureCount++;
+	}
+	else
+	{
+		lastResult = rslt;
+		lastTemperature = BAD_ERROR_TEMPERATURE;
+		lastHumidity = BAD_ERROR_TEMPERATURE;
+	}
+}
+
+// This is called by the Heat task each time it runs. We read one sensor in each slot, so each sensor is read every MinimumReadInterval.
+// Return the number of milliseconds until we next need to be called.
+/*static*/ uint32_t DhtSensorHardwareInterface::Spin()
+{
+	MutexLocker lock(dhtMutex);
+
+	const uint32_t now = millis();
+	DhtSensorHardwareInterface * const sensor = activeSensors[currentSlot];
+	if (sensor != nullptr && sensor->state != DhtState::idle)
+	{
+		// We are reading this sensor, so see whether it has had time to send the data
+		const uint32_t elapsed = now - slotStartTime;
+		if (elapsed < StartSignalLength + MaximumReadTime)
 		{
-			badTemperatureCount++;
+			return StartSignalLength + MaximumReadTime - elapsed;
 		}
-		else
+		if (sensor->state == DhtState::starting)
 		{
-			lastResult = rslt;
-			lastTemperature = BAD_ERROR_TEMPERATURE;
-			lastHumidity = BAD_ERROR_TEMPERATURE;
+			return 1;							// the software timer hasn't ended the start signal yet, which should not happen
 		}
+		sensor->FinishReading();
 	}
-}
-
-// Code executed by the DHT sensor task.
-// This is run at the same priority as the Heat task, so it must not sit in any spin loops.
-/*static*/ void DhtSensorHardwareInterface::SensorTask()
-{
-	for (;;)
+	else if (now - slotStartTime >= SlotInterval)
 	{
-		for (DhtSensorHardwareInterface *&sensor : activeSensors)
+		currentSlot = (currentSlot + 1) % MaxSpiTempSensors;
+		slotStartTime = now;
+		if (activeSensors[currentSlot] != nullptr)
 		{
+			activeSensors[currentSlot]->StartReading();
+			if (activeSensors[currentSlot]->state != DhtState::idle)
 			{
-				MutexLocker lock(dhtMutex);
-
-				if (sensor != nullptr)
-				{
-					sensor->TakeReading();
-				}
+				return StartSignalLength + MaximumReadTime;
 			}
-			delay(MinimumReadInterval/MaxSpiTempSensors);
 		}
 	}
+	return SlotInterval - min<uint32_t>(millis() - slotStartTime, SlotInterval);
 }
 
 // Process a reading. If success then update the temperature and humidity and return TemperatureError::success.
 // Else return the TemperatureError code but do not update the readings.
 TemperatureError DhtSensorHardwareInterface::ProcessReadings()
 {
-	// Check enough bits received and check start bit
-	if (numPulses != ARRAY_SIZE(pulses) || pulses[0] < MinimumOneBitStepClocks)
+	// Check enough edges received and check the start bit, which is 80us low and 80us high
+	if (numEdges != ARRAY_SIZE(edgeTimes) || (uint16_t)(edgeTimes[1] - edgeTimes[0]) < MinimumOneBitStepClocks)
 	{
-//		debugPrintf("pulses %u p0 %u\n", numPulses, (unsigned int)pulses[0]);
+//		debugPrintf("edges %u p0 %u\n", numEdges, (unsigned int)(uint16_t)(edgeTimes[1] - edgeTimes[0]));
 		return TemperatureError::ioError;
 	}
 
 	// Reset 40 bits of received data to zero
 	uint8_t data[5] = { 0, 0, 0, 0, 0 };
 
-	// Inspect each high pulse and determine which ones are 0 (less than 50us) or 1 (more than 50us). Ignore the start bit.
+	// Each bit is a 50us low pulse followed by a high pulse of about 27us for a 0 or 70us for a 1, so the time between falling edges tells us the bit value
 	for (size_t i = 0; i < 40; ++i)
 	{
 		data[i / 8] <<= 1;
-		if (pulses[i + 1] >= MinimumOneBitStepClocks)
+		if ((uint16_t)(edgeTimes[i + 2] - edgeTimes[i + 1]) >= MinimumOneBitStepClocks)
 		{
 			data[i / 8] |= 1;
 		}
@@ -18,6 +18,7 @@
 
 # include "TemperatureSensor.h"
 # include "RTOSIface.h"
+# include "SoftTimer.h"
 
 enum class DhtSensorType
 {
@@ -27,31 +28,42 @@ enum class DhtSensorType
 	Dht22
 };
 
-// This class represents a DHT sensor attached to a particular SPI CS pin
+// This class represents a DHT sensor attached to a particular SPI CS pin.
+// The Heat task starts each reading and decodes it later. A software timer ends the start signal, and the data is captured by recording
+// the time of each falling edge on the data line, so we don't need a task of our own and we only get one interrupt per bit.
 class DhtSensorHardwareInterface
 {
 public:
 
 	static GCodeResult Configure(TemperatureSensor *ts, unsigned int relativeChannel, unsigned int mCode, unsigned int heater, GCodeBuffer& gb, const StringRef& reply);
 	void Interrupt();
+	void EndStartSignal();
 
 	static DhtSensorHardwareInterface *Create(unsigned int relativeChannel);
 	static TemperatureError GetTemperatureOrHumidity(unsigned int relativeChannel, float& t, bool wantHumidity);
 	static void InitStatic();
-	static void SensorTask();
+	static uint32_t Spin();									// called by the Heat task to start and finish readings, returns how soon to call it again
 
 private:
+	enum class DhtState : uint8_t
+	{
+		idle,
+		starting,											// sending the start signal
+		receiving											// capturing the data from the sensor
+	};
+
 	DhtSensorHardwareInterface(Pin p_pin);
 
 	GCodeResult Configure(TemperatureSensor *ts, unsigned int mCode, unsigned int heater, GCodeBuffer& gb, const StringRef& reply);
 	TemperatureError GetTemperatureOrHumidity(float& t, bool wantHumidity) const;
-	void TakeReading();
+	void StartReading();
+	void FinishReading();
 	TemperatureError ProcessReadings();
 
-	static constexpr uint32_t DhtTaskStackWords = 100;		// task stack size in dwords. 80 was not enough. Use 300 if debugging is enabled.
 	static Mutex dhtMutex;
-	static Task<DhtTaskStackWords> *dhtTask;
 	static DhtSensorHardwareInterface *activeSensors[MaxSpiTempSensors];
+	static size_t currentSlot;								// the index into activeSensors of the sensor we are reading or last read
+	static uint32_t slotStartTime;							// when we started the current slot
 
 	Pin sensorPin;
 	DhtSensorType type;
@@ -59,9 +71,10 @@ private:
 	float lastTemperature, lastHumidity;
 	size_t badTemperatureCount;
 
-	volatile uint16_t lastPulseTime;
-	volatile size_t numPulses;
-	uint16_t pulses[41];			// 1 start bit + 40 data bits
+	SoftTimer timer;										// used to end the start signal
+	volatile DhtState state;
+	volatile size_t numEdges;
+	uint16_t edgeTimes[42];									// the response, 40 data bits and the end of the data each start with a falling edge
 };
 
 // This class represents a DHT temperature sensor
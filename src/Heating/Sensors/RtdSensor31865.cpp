@@ -19,8 +19,6 @@ const uint32_t MAX31865_Frequency = 4000000;	// maximum for MAX31865 is also 5MH
 const uint8_t MAX31865_SpiMode = SPI_MODE_1;
 
 // Define the minimum interval between readings. The MAX31865 needs 62.5ms in 50Hz filter mode.
-const uint32_t MinimumReadInterval = 100;		// minimum interval between reads, in milliseconds
-
 // Default configuration register
 // Note that to get the MAX31865 to do continuous conversions, we need to set the bias bit as well as the continuous-conversion bit
 //  Vbias=1
@@ -137,52 +135,44 @@ TemperatureError RtdSensor31865::TryInitRtd() const
 	return sts;
 }
 
-TemperatureError RtdSensor31865::GetTemperature(float& t)
+// Read the RTD. Called with the SPI mutex held.
+void RtdSensor31865::ReadSensor()
 {
-	if (inInterrupt() || millis() - lastReadingTime < MinimumReadInterval)
+	static const uint8_t dataOut[4] = {0, 0x55, 0x55, 0x55};			// read registers 0 (control), 1 (MSB) and 2 (LSB)
+	uint32_t rawVal;
+	const TemperatureError sts = DoSpiTransaction(dataOut, ARRAY_SIZE(dataOut), rawVal);
+
+	if (sts != TemperatureError::success)
 	{
-		t = lastTemperature;
+		lastResult = sts;
 	}
 	else
 	{
-		static const uint8_t dataOut[4] = {0, 0x55, 0x55, 0x55};			// read registers 0 (control), 1 (MSB) and 2 (LSB)
-		uint32_t rawVal;
-		const TemperatureError sts = DoSpiTransaction(dataOut, ARRAY_SIZE(dataOut), rawVal);
-
-		if (sts != TemperatureError::success)
-		{
-			lastResult = sts;
-		}
-		else
+		lastReadingTime = millis();
+		if (   (((rawVal >> 16) & Cr0ReadMask) != (cr0 & Cr0ReadMask))	// if control register not as expected
+			|| (rawVal & 1) != 0										// or fault bit set
+		   )
 		{
-			lastReadingTime = millis();
-			if (   (((rawVal >> 16) & Cr0ReadMask) != (cr0 & Cr0ReadMask))	// if control register not as expected
-				|| (rawVal & 1) != 0										// or fault bit set
-			   )
+			static const uint8_t faultDataOut[2] = {0x07, 0x55};
+			if (DoSpiTransaction(faultDataOut, ARRAY_SIZE(faultDataOut), rawVal)== TemperatureError::success)	// read the fault register
 			{
-				static const uint8_t faultDataOut[2] = {0x07, 0x55};
-				if (DoSpiTransaction(faultDataOut, ARRAY_SIZE(faultDataOut), rawVal)== TemperatureError::success)	// read the fault register
-				{
-					lastResult = (rawVal & 0x04) ? TemperatureError::overOrUnderVoltage
-								: (rawVal & 0x18) ? TemperatureError::openCircuit
-									: TemperatureError::hardwareError;
-				}
-				else
-				{
-					lastResult = TemperatureError::hardwareError;
-				}
-				delayMicroseconds(1);										// MAX31865 requires CS to be high for 400ns minimum
-				TryInitRtd();												// clear the fault and hope for better luck next time
+				lastResult = (rawVal & 0x04) ? TemperatureError::overOrUnderVoltage
+							: (rawVal & 0x18) ? TemperatureError::openCircuit
+								: TemperatureError::hardwareError;
 			}
 			else
 			{
-				const uint16_t ohmsx100 = (uint16_t)((((rawVal >> 1) & 0x7FFF) * rref * 100) >> 15);
-				lastResult = GetPT100Temperature(lastTemperature, ohmsx100);
-				t = lastTemperature;
+				lastResult = TemperatureError::hardwareError;
 			}
+			delayMicroseconds(1);										// MAX31865 requires CS to be high for 400ns minimum
+			TryInitRtd();												// clear the fault and hope for better luck next time
+		}
+		else
+		{
+			const uint16_t ohmsx100 = (uint16_t)((((rawVal >> 1) & 0x7FFF) * rref * 100) >> 15);
+			lastResult = GetPT100Temperature(lastTemperature, ohmsx100);
 		}
 	}
-	return lastResult;
 }
 
 // End
@@ -16,7 +16,9 @@ public:
 	RtdSensor31865(unsigned int channel);
 	GCodeResult Configure(unsigned int mCode, unsigned int heater, GCodeBuffer& gb, const StringRef& reply) override;
 	void Init() override;
-	TemperatureError GetTemperature(float& t) override;
+
+protected:
+	void ReadSensor() override;
 
 private:
 	TemperatureError TryInitRtd() const;
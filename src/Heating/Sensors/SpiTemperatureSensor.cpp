@@ -8,8 +8,10 @@
 #include "SpiTemperatureSensor.h"
 #include "Tasks.h"
 
+SpiTemperatureSensor *SpiTemperatureSensor::spiSensorList = nullptr;
+
 SpiTemperatureSensor::SpiTemperatureSensor(unsigned int channel, const char *name, unsigned int relativeChannel, uint8_t spiMode, uint32_t clockFrequency)
-	: TemperatureSensor(channel, name)
+	: TemperatureSensor(channel, name), nextSpiSensor(nullptr), inSensorList(false)
 {
 	device.csPin = SpiTempSensorCsPins[relativeChannel];
 	device.csPolarity = false;						// active low chip select
@@ -19,10 +21,93 @@ SpiTemperatureSensor::SpiTemperatureSensor(unsigned int channel, const char *nam
 	lastResult = TemperatureError::notInitialised;
 }
 
+// Take this sensor out of the list. We hold the SPI mutex while we change the list, so that ReadAll can't be using us.
+SpiTemperatureSensor::~SpiTemperatureSensor()
+{
+	if (inSensorList)
+	{
+		MutexLocker lock(Tasks::GetSpiMutex());
+		TaskCriticalSectionLocker lock2;
+		SpiTemperatureSensor **pp = &spiSensorList;
+		while (*pp != this)
+		{
+			pp = &((*pp)->nextSpiSensor);
+		}
+		*pp = nextSpiSensor;
+	}
+}
+
 void SpiTemperatureSensor::InitSpi()
 {
 	sspi_master_init(&device, 8);
 	lastReadingTime = millis();
+
+	if (!inSensorList)
+	{
+		MutexLocker lock(Tasks::GetSpiMutex());
+		TaskCriticalSectionLocker lock2;
+		nextSpiSensor = spiSensorList;
+		spiSensorList = this;
+		inSensorList = true;
+	}
+}
+
+// Return the last reading. Normally the heater task calls ReadAll to keep it up to date, but if it hasn't done so for a while then read the sensor now.
+TemperatureError SpiTemperatureSensor::GetTemperature(float& t)
+{
+	if (!inInterrupt() && millis() - lastReadingTime >= MaxReadingAge)
+	{
+		MutexLocker lock(Tasks::GetSpiMutex(), 50);
+		if (lock)
+		{
+			ReadSensor();
+		}
+		else
+		{
+			lastResult = TemperatureError::busBusy;
+		}
+	}
+	t = lastTemperature;
+	return lastResult;
+}
+
+// Read all the SPI temperature sensors that are due to be read. This is called by the heater task before it spins the PIDs.
+// We take the SPI mutex just once for the whole batch, instead of once per sensor, so that the other users of the SPI bus
+// get fewer, longer gaps between our transfers. The transfers are only a few bytes each, so we don't use DMA.
+/*static*/ void SpiTemperatureSensor::ReadAll()
+{
+	// Don't take the mutex unless we have something to read, because the SD card may be holding it
+	bool anyDue = false;
+	{
+		TaskCriticalSectionLocker lock;
+		for (const SpiTemperatureSensor *s = spiSensorList; s != nullptr; s = s->nextSpiSensor)
+		{
+			if (s->IsReadingDue())
+			{
+				anyDue = true;
+				break;
+			}
+		}
+	}
+
+	if (anyDue)
+	{
+		MutexLocker lock(Tasks::GetSpiMutex(), 50);
+		for (SpiTemperatureSensor *s = spiSensorList; s != nullptr; s = s->nextSpiSensor)
+		{
+			if (s->IsReadingDue())
+			{
+				if (lock)
+				{
+					s->ReadSensor();
+				}
+				else
+				{
+					s->lastResult = TemperatureError::busBusy;
+				}
+			}
+		}
+	}
 }
 
 // Send and receive 1 to 8 bytes of data and return the result as a single 32-bit word
@@ -31,7 +116,7 @@ TemperatureError SpiTemperatureSensor::DoSpiTransaction(const uint8_t dataOut[],
 	uint8_t rawBytes[8];
 	spi_status_t sts;
 	{
-		MutexLocker lock(Tasks::GetSpiMutex(), 50);
+		MutexLocker lock(Tasks::GetSpiMutex(), 50);			// the mutex is recursive, so this is cheap when we are called from ReadAll
 		if (!lock)
 		{
 			return TemperatureError::busBusy;
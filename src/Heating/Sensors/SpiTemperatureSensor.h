@@ -13,16 +13,36 @@
 
 class SpiTemperatureSensor : public TemperatureSensor
 {
+public:
+	~SpiTemperatureSensor();
+	TemperatureError GetTemperature(float& t) override;
+
+	static void ReadAll();							// Read all the SPI sensors that are due, taking the SPI mutex just once
+
 protected:
 	SpiTemperatureSensor(unsigned int channel, const char *name, unsigned int relativeChannel, uint8_t spiMode, uint32_t clockFrequency);
 	void InitSpi();
 	TemperatureError DoSpiTransaction(const uint8_t dataOut[], size_t nbytes, uint32_t& rslt) const
 		pre(nbytes <= 8);
 
+	// Read the sensor and update lastTemperature and lastResult, and lastReadingTime if successful. Called with the SPI mutex held.
+	virtual void ReadSensor() = 0;
+
+	static constexpr uint32_t MinimumReadInterval = 100;	// minimum interval between reads, in milliseconds
+	static constexpr uint32_t MaxReadingAge = 1000;			// if the heater task hasn't read us for this long, GetTemperature reads the sensor itself
+
 	sspi_device device;
 	uint32_t lastReadingTime;
 	float lastTemperature;
 	TemperatureError lastResult;
+
+private:
+	bool IsReadingDue() const { return millis() - lastReadingTime >= MinimumReadInterval; }
+
+	SpiTemperatureSensor *nextSpiSensor;			// Next sensor in the list of initialised SPI sensors
+	bool inSensorList;
+
+	static SpiTemperatureSensor *spiSensorList;		// The SPI sensors that ReadAll reads
 };
 
 #endif /* SRC_HEATING_SPITEMPERATURESENSOR_H_ */
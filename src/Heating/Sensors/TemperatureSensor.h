@@ -4,6 +4,7 @@
 #include "RepRapFirmware.h"
 #include "Heating/TemperatureError.h"		// for result codes
 #include "GCodes/GCodeResult.h"
+#include "Libraries/General/FreelistManager.h"
 
 class GCodeBuffer;
 
@@ -23,6 +24,9 @@ public:
 	// Try to get a temperature reading
 	virtual TemperatureError GetTemperature(float& t) = 0;
 
+	// Return true if the reading comes from an ADC filter that the tick interrupt keeps up to date, so that it can be sampled often
+	virtual bool IsReadFromAdcFilter() const { return false; }
+
 	// Return the channel number
 	unsigned int GetSensorChannel() const { return sensorChannel; }
 
@@ -32,6 +36,10 @@ public:
 	// Configure then heater name, if it is provided
 	void TryConfigureHeaterName(GCodeBuffer& gb, bool& seen);
 
+	// Allocate sensors from the size-class pools, so that we reuse the memory when they are reconfigured
+	void* operator new(size_t sz) { return PoolAllocate(sz); }
+	void operator delete(void* p, size_t sz) { PoolRelease(p, sz); }
+
 	// Virtual destructor
 	virtual ~TemperatureSensor();
 
@@ -142,9 +142,10 @@ TemperatureError Thermistor::GetTemperature(float& t)
 			return TemperatureError::openCircuit;
 		}
 
-		const float resistance = seriesR * ((float)(averagedTempReading - averagedVssaReading) + 0.5)/denom;
+		const float numer = (float)(averagedTempReading - averagedVssaReading) + 0.5;
 		if (isPT1000)
 		{
+			const float resistance = seriesR * numer/denom;
 			// We want 100 * the equivalent PT100 resistance, which is 10 * the actual PT1000 resistance
 			uint16_t ohmsx100 = (uint16_t)rintf(constrain<float>(resistance * 10, 0.0, 65535.0));
 #ifdef DUET_NG
@@ -154,10 +155,23 @@ TemperatureError Thermistor::GetTemperature(float& t)
 			return GetPT100Temperature(t, ohmsx100);
 		}
 
-		// Else it's a thermistor
-		const float logResistance = log(resistance);
-		const float recipT = shA + shB * logResistance + shC * logResistance * logResistance * logResistance;
-		const float temp =  (recipT > 0.0) ? (1.0/recipT) + ABS_ZERO : BAD_ERROR_TEMPERATURE;
+		// Else it's a thermistor, so interpolate in the lookup table. R/(R + seriesR) is the same as numer/(numer + denom).
+		const float adcFraction = numer/(numer + denom);
+		float pos = (adcFraction < FineSectionWidth)
+						? adcFraction * (TableSectionEntries/FineSectionWidth)
+					: (adcFraction < 1.0 - FineSectionWidth)
+						? (adcFraction - FineSectionWidth) * (TableSectionEntries/(1.0 - 2 * FineSectionWidth)) + TableSectionEntries
+							: (adcFraction - (1.0 - FineSectionWidth)) * (TableSectionEntries/FineSectionWidth) + 2 * TableSectionEntries;
+		pos = constrain<float>(pos, 0.0, (float)(TableLength - 1));
+		size_t index = (size_t)pos;
+		if (index == TableLength - 1)
+		{
+			--index;
+		}
+		const uint16_t low = lookupTable[index], high = lookupTable[index + 1];
+		const float temp = (low == BadTableEntry || high == BadTableEntry)
+							? BAD_ERROR_TEMPERATURE
+								: ((float)low + (pos - (float)index) * ((float)high - (float)low)) * (1.0/TableUnitsPerKelvin) + ABS_ZERO;
 
 		if (temp < MinimumConnectedTemperature)
 		{
@@ -175,12 +189,41 @@ TemperatureError Thermistor::GetTemperature(float& t)
 	return TemperatureError::busBusy;
 }
 
-// Calculate shA and shB from the other parameters
+// Calculate shA and shB from the other parameters, then build the lookup table
 void Thermistor::CalcDerivedParameters()
 {
 	shB = 1.0/beta;
 	const float lnR25 = logf(r25);
 	shA = 1.0/(25.0 - ABS_ZERO) - shB * lnR25 - shC * lnR25 * lnR25 * lnR25;
+
+	for (size_t i = 0; i < TableLength; ++i)
+	{
+		const float adcFraction = (i <= TableSectionEntries)
+									? (float)i * (FineSectionWidth/TableSectionEntries)
+								: (i <= 2 * TableSectionEntries)
+									? FineSectionWidth + (float)(i - TableSectionEntries) * ((1.0 - 2 * FineSectionWidth)/TableSectionEntries)
+										: (1.0 - FineSectionWidth) + (float)(i - 2 * TableSectionEntries) * (FineSectionWidth/TableSectionEntries);
+		const float kelvin = CalcKelvin(adcFraction);
+		lookupTable[i] = (kelvin < 0.0 || kelvin * TableUnitsPerKelvin >= (float)BadTableEntry)
+							? BadTableEntry
+								: (uint16_t)lrintf(kelvin * TableUnitsPerKelvin);
+	}
+}
+
+// Calculate the absolute temperature when the thermistor reading is the specified fraction of the ADC range, returning a negative value if there isn't one
+float Thermistor::CalcKelvin(float adcFraction) const
+{
+	if (adcFraction <= 0.0)
+	{
+		return -1.0;						// zero resistance
+	}
+	if (adcFraction >= 1.0)
+	{
+		return 0.0;							// infinite resistance
+	}
+	const float logResistance = logf(seriesR * adcFraction/(1.0 - adcFraction));
+	const float recipT = shA + shB * logResistance + shC * logResistance * logResistance * logResistance;
+	return (recipT > 0.0) ? 1.0/recipT : -1.0;
 }
 
 // End
@@ -25,12 +25,14 @@ public:
 	GCodeResult Configure(unsigned int mCode, unsigned int heater, GCodeBuffer& gb, const StringRef& reply) override; // configure the sensor from M305 parameters
 	void Init() override;
 	TemperatureError GetTemperature(float& t) override;
+	bool IsReadFromAdcFilter() const override { return true; }
 
 private:
 	// For the theory behind ADC oversampling, see http://www.atmel.com/Images/doc8003.pdf
 	static constexpr unsigned int AdcOversampleBits = 2;					// we use 2-bit oversampling
 
-	void CalcDerivedParameters();											// calculate shA and shB
+	void CalcDerivedParameters();											// calculate shA and shB and build the lookup table
+	float CalcKelvin(float adcFraction) const;								// calculate the temperature from the Steinhart-Hart equation
 
 	// The following are configurable parameters
 	unsigned int thermistorInputChannel;
@@ -44,6 +46,18 @@ private:
 	// The following are derived from the configurable parameters
 	float shA, shB;															// derived parameters
 
+	// Lookup table of temperature against the fraction R/(R + seriesR) of the ADC range, so that we don't need to calculate a logarithm for each reading.
+	// The curve is steepest near the ends of the range, so the table has three sections with the same number of intervals. The first covers fractions
+	// below 1/16 (hot), the last covers fractions above 15/16 (cold) and the middle one covers the rest. Adjacent sections share their boundary entry.
+	// This keeps the interpolation error below 0.15C from -10C to 400C with a typical 100K thermistor.
+	static constexpr size_t TableSectionEntries = 128;
+	static constexpr size_t TableLength = 3 * TableSectionEntries + 1;
+	static constexpr float FineSectionWidth = 1.0/16.0;
+	static constexpr float TableUnitsPerKelvin = 64.0;						// the entries are absolute temperatures in units of 1/64K
+	static constexpr uint16_t BadTableEntry = 0xFFFF;						// the equation doesn't give a temperature at this point
+
+	uint16_t lookupTable[TableLength];
+
 	static constexpr unsigned int AdcBits = 12;								// the ADCs in the SAM processors are 12-bit
 	static constexpr int32_t AdcRange = 1 << (AdcBits + AdcOversampleBits);	// The readings we pass in should be in range 0..(AdcRange - 1)
 };
@@ -27,6 +27,16 @@ void IoPort::Clear()
 	invert = false;
 }
 
+// Return true if this port can be written from within an ISR, i.e. it is not on an I2C expansion board
+bool IoPort::CanWriteFromInterrupt() const
+{
+#ifdef DUET_NG
+	return pin == NoPin || pin < DueXnExpansionStart;
+#else
+	return true;
+#endif
+}
+
 bool IoPort::Set(LogicalPin lp, PinAccess access, bool pInvert)
 {
 	const bool ret = reprap.GetPlatform().GetFirmwarePin(lp, access, pin, invert);
@@ -30,6 +30,7 @@ public:
 	LogicalPin GetLogicalPin() const { return logicalPort; }
 	LogicalPin GetLogicalPin(bool& pInvert) const { pInvert = invert; return logicalPort; }
 	void WriteDigital(bool high) const { if (pin != NoPin) { WriteDigital(pin, (invert) ? !high : high); } }
+	bool CanWriteFromInterrupt() const;
 
 	// Low level port access
 	static void SetPinMode(Pin p, PinMode mode);
@@ -61,6 +61,78 @@ unsigned int DiskioGetAndClearMaxRetryCount()
 	return ret;
 }
 
+#if SUPPORT_SECTOR_CACHE
+
+// Cache of recently used FAT and directory sectors, with least-recently-used replacement.
+// Writes are passed straight through to the card and update any cached copy, so the cache never holds dirty data.
+// FatFs only allows one task to access each volume at a time, but the cache is shared between volumes, so we use a task critical section to protect it.
+struct CachedSector
+{
+	uint32_t data[512/sizeof(uint32_t)];			// word aligned so that the copies are fast
+	DWORD sector;
+	uint32_t lastUsed;
+	BYTE drive;
+	bool valid;
+};
+
+static CachedSector sectorCache[SectorCacheSectors];
+static uint32_t sectorCacheUseCount = 0;
+static unsigned int sectorCacheHits = 0, sectorCacheMisses = 0;
+
+void DiskioGetAndClearCacheStats(unsigned int& hits, unsigned int& misses)
+{
+	hits = sectorCacheHits;
+	misses = sectorCacheMisses;
+	sectorCacheHits = sectorCacheMisses = 0;
+}
+
+static CachedSector *FindCachedSector(BYTE drv, DWORD sector)
+{
+	for (CachedSector& cs : sectorCache)
+	{
+		if (cs.valid && cs.sector == sector && cs.drive == drv)
+		{
+			return &cs;
+		}
+	}
+	return nullptr;
+}
+
+// Forget all the sectors cached for a drive, because the card may have been changed
+static void InvalidateCachedSectors(BYTE drv)
+{
+	TaskCriticalSectionLocker lock;
+	for (CachedSector& cs : sectorCache)
+	{
+		if (cs.drive == drv)
+		{
+			cs.valid = false;
+		}
+	}
+}
+
+// Update any cached copies of sectors that have just been written. If the write failed then we don't know what the card holds, so we discard them instead.
+static void UpdateCachedSectors(BYTE drv, const BYTE *buff, DWORD sector, BYTE count, bool ok)
+{
+	TaskCriticalSectionLocker lock;
+	for (CachedSector& cs : sectorCache)
+	{
+		if (cs.valid && cs.drive == drv && cs.sector - sector < count)
+		{
+			if (ok)
+			{
+				memcpy(cs.data, buff + (cs.sector - sector) * 512, 512);
+			}
+			else
+			{
+				cs.valid = false;
+			}
+		}
+	}
+}
+
+#endif
+
 //void debugPrintf(const char*, ...);
 
 //#if (SAM3S || SAM3U || SAM3N || SAM3XA_SERIES || SAM4S)
@@ -108,6 +180,10 @@ DSTATUS disk_initialize(BYTE drv)
 	}
 #endif
 
+#if SUPPORT_SECTOR_CACHE
+	InvalidateCachedSectors(drv);
+#endif
+
 	MutexLocker lock((drv >= SD_MMC_HSMCI_MEM_CNT) ? Tasks::GetSpiMutex() : nullptr);
 
 	Ctrl_status mem_status;
@@ -208,6 +284,62 @@ DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, BYTE count)
 #endif
 }
 
+/**
+ * \brief  Read a single FAT or directory sector, using the sector cache if it is enabled.
+ *
+ * \param drv Physical drive number (0..).
+ * \param buff Data buffer to store read data.
+ * \param sector Sector address (LBA).
+ *
+ * \return RES_OK for success, otherwise DRESULT error code.
+ */
+DRESULT disk_read_cached(BYTE drv, BYTE *buff, DWORD sector)
+{
+#if SUPPORT_SECTOR_CACHE
+	{
+		TaskCriticalSectionLocker lock;
+		CachedSector * const cs = FindCachedSector(drv, sector);
+		if (cs != nullptr)
+		{
+			memcpy(buff, cs->data, 512);
+			cs->lastUsed = ++sectorCacheUseCount;
+			++sectorCacheHits;
+			return RES_OK;
+		}
+	}
+
+	const DRESULT res = disk_read(drv, buff, sector, 1);
+	if (res == RES_OK && mem_sector_size(drv) == SECTOR_SIZE_512)
+	{
+		TaskCriticalSectionLocker lock;
+		++sectorCacheMisses;
+
+		// Replace an unused entry if there is one, else the least recently used one
+		CachedSector *victim = &sectorCache[0];
+		for (CachedSector& cs : sectorCache)
+		{
+			if (!cs.valid)
+			{
+				victim = &cs;
+				break;
+			}
+			if (cs.lastUsed - victim->lastUsed > (uint32_t)INT32_MAX)		// if cs was used less recently than victim, allowing for wraparound
+			{
+				victim = &cs;
+			}
+		}
+		memcpy(victim->data, buff, 512);
+		victim->sector = sector;
+		victim->drive = drv;
+		victim->lastUsed = ++sectorCacheUseCount;
+		victim->valid = true;
+	}
+	return res;
+#else
+	return disk_read(drv, buff, sector, 1);
+#endif
+}
+
 /**
  * \brief  Write sector(s).
  *
@@ -252,11 +384,18 @@ DRESULT disk_write(BYTE drv, BYTE const *buff, DWORD sector, BYTE count)
 		++retryNumber;
 		if (retryNumber == MaxSdCardTries)
 		{
+#if SUPPORT_SECTOR_CACHE
+			UpdateCachedSectors(drv, buff, sector, count, false);
+#endif
 			return RES_ERROR;
 		}
 		delay(SdCardRetryDelay);
 	}
 
+#if SUPPORT_SECTOR_CACHE
+	UpdateCachedSectors(drv, buff, sector, count, true);
+#endif
+
 	if (retryNumber > highestSdRetriesDone)
 	{
 		highestSdRetriesDone = retryNumber;
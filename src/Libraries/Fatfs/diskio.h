@@ -6,6 +6,7 @@
 
 #ifdef __cplusplus
 unsigned int DiskioGetAndClearMaxRetryCount();
+void DiskioGetAndClearCacheStats(unsigned int& hits, unsigned int& misses);
 extern "C" {
 #endif
 
@@ -35,6 +36,7 @@ int assign_drives (int, int);
 DSTATUS disk_initialize (BYTE);
 DSTATUS disk_status (BYTE);
 DRESULT disk_read (BYTE, BYTE*, DWORD, BYTE);
+DRESULT disk_read_cached (BYTE, BYTE*, DWORD);
 #if	_READONLY == 0
 DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
 #endif
@@ -739,9 +739,10 @@ void clear_lock (	/* Clear lock entries of the volume */
 /*-----------------------------------------------------------------------*/
 
 static
-FRESULT move_window (
+FRESULT move_window_ex (
 	FATFS *fs,		/* File system object */
-	DWORD sector	/* Sector number to make appearance in the fs->win[] */
+	DWORD sector,	/* Sector number to make appearance in the fs->win[] */
+	BYTE cacheable	/* Nonzero if the sector holds FAT or directory data that the disk layer may cache */
 )					/* Move to zero only writes back dirty window */
 {
 	DWORD wsect;
@@ -764,7 +765,7 @@ FRESULT move_window (
 		}
 #endif
 		if (sector) {
-			if (disk_read(fs->drv, fs->win, sector, 1) != RES_OK)
+			if ((cacheable ? disk_read_cached(fs->drv, fs->win, sector) : disk_read(fs->drv, fs->win, sector, 1)) != RES_OK)
 				return FR_DISK_ERR;
 			fs->winsect = sector;
 		}
@@ -773,6 +774,15 @@ FRESULT move_window (
 	return FR_OK;
 }
 
+static
+FRESULT move_window (
+	FATFS *fs,		/* File system object */
+	DWORD sector	/* Sector number of the FAT or directory sector to make appearance in the fs->win[] */
+)
+{
+	return move_window_ex(fs, sector, 1);
+}
+
 
 
 
@@ -2478,7 +2488,7 @@ FRESULT f_read (
 		rcnt = SS(fp->fs) - (fp->fptr % SS(fp->fs));	/* Get partial sector data from sector buffer */
 		if (rcnt > btr) rcnt = btr;
 #if _FS_TINY
-		if (move_window(fp->fs, fp->dsect))		/* Move sector window */
+		if (move_window_ex(fp->fs, fp->dsect, 0))		/* Move sector window */
 			ABORT(fp->fs, FR_DISK_ERR);
 		mem_cpy(rbuff, &fp->fs->win[fp->fptr % SS(fp->fs)], rcnt);	/* Pick partial sector */
 #else
@@ -2593,7 +2603,7 @@ FRESULT f_write (
 		wcnt = SS(fp->fs) - (fp->fptr % SS(fp->fs));/* Put partial sector into file I/O buffer */
 		if (wcnt > btw) wcnt = btw;
 #if _FS_TINY
-		if (move_window(fp->fs, fp->dsect))	/* Move sector window */
+		if (move_window_ex(fp->fs, fp->dsect, 0))	/* Move sector window */
 			ABORT(fp->fs, FR_DISK_ERR);
 		mem_cpy(&fp->fs->win[fp->fptr % SS(fp->fs)], wbuff, wcnt);	/* Fit partial sector */
 		fp->fs->wflag = 1;
@@ -3208,6 +3218,79 @@ FRESULT f_truncate (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Cluster Chain to an Empty File                  */
+/*-----------------------------------------------------------------------*/
+/* The file size is set to fsz, so the caller must truncate the file at  */
+/* the end of the data it writes. Returns FR_DENIED if there is not a    */
+/* large enough block of free clusters, leaving the file unchanged.      */
+
+FRESULT f_expand (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD fsz		/* File size to be expanded to */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD n, clst, stcl, scl, ncl, tcl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res == FR_OK) {
+		if (fp->flag & FA__ERROR) {			/* Check abort flag */
+			res = FR_INT_ERR;
+		} else {
+			if (!(fp->flag & FA_WRITE) || fsz == 0 || fp->sclust != 0)	/* Check access mode, and that the file is empty */
+				res = FR_DENIED;
+		}
+	}
+	if (res == FR_OK) {
+		fs = fp->fs;
+		n = (DWORD)fs->csize * SS(fs);		/* Cluster size in bytes */
+		tcl = (fsz - 1) / n + 1;			/* Number of clusters required */
+		stcl = fs->last_clust;				/* Start the search at the suggested start point */
+		if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+		scl = clst = stcl; ncl = 0;
+		for (;;) {							/* Find a block of tcl free clusters */
+			n = get_fat(fs, clst);
+			if (n == 1) { res = FR_INT_ERR; break; }
+			if (n == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+			if (++clst >= fs->n_fatent) clst = 2;
+			if (n == 0) {					/* Free cluster */
+				if (++ncl == tcl) break;	/* Found a large enough block */
+				if (clst == 2) { scl = 2; ncl = 0; }	/* A block can't wrap around the end of the FAT */
+			} else {
+				scl = clst; ncl = 0;		/* Start again after the cluster in use */
+			}
+			if (clst == stcl) { res = FR_DENIED; break; }	/* Searched the whole FAT without success */
+		}
+		if (res == FR_OK) {					/* Link the block into a chain */
+			for (clst = scl, n = tcl; n; clst++, n--) {
+				res = put_fat(fs, clst, (n == 1) ? 0x0FFFFFFF : clst + 1);
+				if (res != FR_OK) break;
+			}
+			if (res == FR_OK) {
+				fs->last_clust = scl + tcl - 1;	/* Update FSINFO */
+				if (fs->free_clust != 0xFFFFFFFF) {
+					fs->free_clust -= tcl;
+					fs->fsi_flag = 1;
+				}
+				fp->sclust = scl;			/* Update the file object */
+				fp->fsize = fsz;
+				fp->flag |= FA__WRITTEN;
+			} else {
+				remove_chain(fs, scl);		/* Release any clusters we linked, which are terminated by the first unlinked one */
+				fp->flag |= FA__ERROR;
+			}
+		}
+	}
+
+	LEAVE_FF(fp->fs, res);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
@@ -3555,7 +3638,7 @@ FRESULT f_forward (
 		sect = clust2sect(fp->fs, fp->clust);		/* Get current data sector */
 		if (!sect) ABORT(fp->fs, FR_INT_ERR);
 		sect += csect;
-		if (move_window(fp->fs, sect))				/* Move sector window */
+		if (move_window_ex(fp->fs, sect, 0))				/* Move sector window */
 			ABORT(fp->fs, FR_DISK_ERR);
 		fp->dsect = sect;
 		rcnt = SS(fp->fs) - (WORD)(fp->fptr % SS(fp->fs));	/* Forward data from sector window */
@@ -0,0 +1,52 @@
+/*
+ * FreelistManager.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "FreelistManager.h"
+
+FreelistStats *FreelistManagerBase::statsList = nullptr;
+
+// Add a free list to the list of those that have been used. Called with the scheduler suspended.
+/*static*/ void FreelistManagerBase::Register(FreelistStats& stats)
+{
+	stats.next = statsList;
+	statsList = &stats;
+}
+
+// The size classes grow by about 1.5 each time, so that no more than a third of an object's allocation is wasted
+void *PoolAllocate(size_t sz)
+{
+	return (sz <= 16) ? FreelistManager<16>::Allocate()
+			: (sz <= 24) ? FreelistManager<24>::Allocate()
+			: (sz <= 32) ? FreelistManager<32>::Allocate()
+			: (sz <= 48) ? FreelistManager<48>::Allocate()
+			: (sz <= 64) ? FreelistManager<64>::Allocate()
+			: (sz <= 96) ? FreelistManager<96>::Allocate()
+			: (sz <= 128) ? FreelistManager<128>::Allocate()
+			: (sz <= 192) ? FreelistManager<192>::Allocate()
+			: (sz <= 256) ? FreelistManager<256>::Allocate()
+			: (sz <= 384) ? FreelistManager<384>::Allocate()
+			: (sz <= MaxPoolObjectSize) ? FreelistManager<MaxPoolObjectSize>::Allocate()
+			: ::operator new(sz);
+}
+
+// Release an object allocated by PoolAllocate. 'sz' must be the size that was passed to PoolAllocate.
+void PoolRelease(void *p, size_t sz)
+{
+	if (sz <= 16) { FreelistManager<16>::Release(p); }
+	else if (sz <= 24) { FreelistManager<24>::Release(p); }
+	else if (sz <= 32) { FreelistManager<32>::Release(p); }
+	else if (sz <= 48) { FreelistManager<48>::Release(p); }
+	else if (sz <= 64) { FreelistManager<64>::Release(p); }
+	else if (sz <= 96) { FreelistManager<96>::Release(p); }
+	else if (sz <= 128) { FreelistManager<128>::Release(p); }
+	else if (sz <= 192) { FreelistManager<192>::Release(p); }
+	else if (sz <= 256) { FreelistManager<256>::Release(p); }
+	else if (sz <= 384) { FreelistManager<384>::Release(p); }
+	else if (sz <= MaxPoolObjectSize) { FreelistManager<MaxPoolObjectSize>::Release(p); }
+	else { ::operator delete(p); }
+}
+
+// End
@@ -11,9 +11,36 @@
 #define SRC_LIBRARIES_GENERAL_FREELISTMANAGER_H_
 
 #include <cstddef>
+#include <cstdint>
+#include "RTOSIface.h"
+
+// Statistics for one free list
+struct FreelistStats
+{
+	FreelistStats *next;				// the next free list in the list of those that have been used
+	size_t objectSize;
+	uint32_t numInUse;					// the number of objects allocated from the free list and not yet released
+	uint32_t numFree;					// the number of objects on the free list
+	uint32_t maxInUse;					// the highest value of numInUse
+	uint32_t numHeapAllocations;		// the number of times we allocated from the heap because the free list was empty
+};
+
+// Base class of every free list manager, which keeps the list of statistics for the free lists that have been used.
+// The free lists are shared between tasks, so we suspend the scheduler while updating them. That is much cheaper than the malloc mutex.
+class FreelistManagerBase
+{
+public:
+	static const FreelistStats *GetStatsList() { return statsList; }
+
+protected:
+	static void Register(FreelistStats& stats);
+
+private:
+	static FreelistStats *statsList;
+};
 
 // Free list manager
-template<size_t Sz> class FreelistManager
+template<size_t Sz> class FreelistManager : public FreelistManagerBase
 {
 public:
 	static void *Allocate();
@@ -21,25 +48,43 @@ public:
 
 private:
 	static void *freelist;
+	static FreelistStats stats;
 };
 
 template<size_t Sz> void *FreelistManager<Sz>::freelist = nullptr;
+template<size_t Sz> FreelistStats FreelistManager<Sz>::stats = { nullptr, Sz, 0, 0, 0, 0 };
 
 template<size_t Sz> void *FreelistManager<Sz>::Allocate()
 {
-	if (freelist != nullptr)
 	{
-		void * const p = freelist;
-		freelist = *static_cast<void **>(p);
-		return p;
+		TaskCriticalSectionLocker lock;
+		++stats.numInUse;
+		if (stats.numInUse > stats.maxInUse)
+		{
+			stats.maxInUse = stats.numInUse;
+		}
+		if (freelist != nullptr)
+		{
+			void * const p = freelist;
+			freelist = *static_cast<void **>(p);
+			--stats.numFree;
+			return p;
+		}
+		if (stats.numHeapAllocations++ == 0)
+		{
+			Register(stats);
+		}
 	}
 	return ::operator new(Sz);
 }
 
 template<size_t Sz> void FreelistManager<Sz>::Release(void *p)
 {
+	TaskCriticalSectionLocker lock;
 	*static_cast<void **>(p) = freelist;
 	freelist = p;
+	--stats.numInUse;
+	++stats.numFree;
 }
 
 // Macro to return the size of objects of a given type rounded up to a multiple of 8 bytes.
@@ -57,4 +102,13 @@ template<class T> inline void Release(void *p)
 	FreelistManager<ROUNDED_UP_SIZE(T)>::Release(p);
 }
 
+// Size-class pools for base classes whose derived classes have different sizes. The base class should have a virtual destructor and declare:
+//	void* operator new(size_t sz) { return PoolAllocate(sz); }
+//	void operator delete(void* p, size_t sz) { PoolRelease(p, sz); }
+// Objects larger than the largest size class are allocated from the heap.
+constexpr size_t MaxPoolObjectSize = 512;
+
+void *PoolAllocate(size_t sz);
+void PoolRelease(void *p, size_t sz);
+
 #endif /* SRC_LIBRARIES_GENERAL_FREELISTMANAGER_H_ */
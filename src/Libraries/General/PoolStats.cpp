@@ -0,0 +1,22 @@
+/*
+ * PoolStats.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "PoolStats.h"
+
+PoolStats *PoolStats::statsList = nullptr;
+
+// Record that objects have been added to the pool. Pools are created during initialisation, so no locking is needed.
+void PoolStats::Created(unsigned int num)
+{
+	if (capacity == 0)
+	{
+		next = statsList;
+		statsList = this;
+	}
+	capacity += num;
+}
+
+// End
@@ -0,0 +1,48 @@
+/*
+ * PoolStats.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  Usage statistics for the fixed-size object pools that are allocated at startup, so that we can report them all in one place
+ */
+
+#ifndef SRC_LIBRARIES_GENERAL_POOLSTATS_H_
+#define SRC_LIBRARIES_GENERAL_POOLSTATS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Statistics for one pool. The pool that owns them is responsible for any locking needed when it updates them.
+// The constructor is constexpr so that static instances are initialised before any constructors run that might add objects to the pool.
+class PoolStats
+{
+public:
+	explicit constexpr PoolStats(const char *pName) : next(nullptr), name(pName), capacity(0), numInUse(0), maxInUse(0), numFailures(0) { }
+
+	void Created(unsigned int num);						// record that 'num' objects have been added to the pool, registering it if it is new
+	void Allocated() { ++numInUse; if (numInUse > maxInUse) { maxInUse = numInUse; } }
+	void Released() { --numInUse; }
+	void Failed() { ++numFailures; }
+	void ResetMaxInUse() { maxInUse = numInUse; }
+
+	const PoolStats *GetNext() const { return next; }
+	const char *GetName() const { return name; }
+	uint32_t GetCapacity() const { return capacity; }
+	uint32_t GetNumInUse() const { return numInUse; }
+	uint32_t GetMaxInUse() const { return maxInUse; }
+	uint32_t GetNumFailures() const { return numFailures; }
+
+	static const PoolStats *GetStatsList() { return statsList; }
+
+private:
+	PoolStats *next;									// the next pool in the list of registered pools
+	const char *name;
+	uint32_t capacity;									// the number of objects in the pool
+	volatile uint32_t numInUse;							// the number of objects allocated and not yet released
+	volatile uint32_t maxInUse;							// the highest value of numInUse
+	volatile uint32_t numFailures;						// the number of allocation requests that failed because the pool was empty
+
+	static PoolStats *statsList;
+};
+
+#endif /* SRC_LIBRARIES_GENERAL_POOLSTATS_H_ */
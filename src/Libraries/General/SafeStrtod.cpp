@@ -17,6 +17,7 @@
 #include <cmath>
 #include <climits>
 #include <cstdlib>
+#include <cstdint>
 
 #include "SafeStrtod.h"
 #undef strtoul		// Undo the macro definition of strtoul in SafeStrtod.h so that we can call it in this file
@@ -130,9 +131,71 @@ double SafeStrtod(const char *s, const char **p)
 	return (negative) ? -retvalue : retvalue;
 }
 
+// Convert a string to float. G-code numbers are nearly always short decimals such as "123.456" with no exponent,
+// so we handle numbers with up to MaxFastDigits digits using an integer mantissa and a table of powers of 10, and use SafeStrtod for anything else.
 float SafeStrtof(const char *s, const char **p)
 {
-	return (float)SafeStrtod(s, p);
+	constexpr unsigned int MaxFastDigits = 9;					// so that the mantissa fits in 32 bits
+	constexpr uint32_t MaxExactFloatMantissa = 1ul << 24;		// mantissas below this are exactly representable as a float
+	static const float PowersOfTen[MaxFastDigits + 1] = { 1.0, 10.0, 100.0, 1.0e3, 1.0e4, 1.0e5, 1.0e6, 1.0e7, 1.0e8, 1.0e9 };
+
+	const char *q = s;
+	while (*q == ' ' || *q == '\t')
+	{
+		++q;
+	}
+	const bool negative = (*q == '-');
+	if (negative || *q == '+')
+	{
+		++q;
+	}
+
+	uint32_t mantissa = 0;
+	unsigned int numDigits = 0;
+	unsigned int digitsAfterPoint = 0;
+	bool seenPoint = false;
+	for (;;)
+	{
+		const char c = *q;
+		if (isdigit(c))
+		{
+			if (numDigits == MaxFastDigits)
+			{
+				return (float)SafeStrtod(s, p);					// too many digits for the fast path
+			}
+			mantissa = (mantissa * 10) + (c - '0');
+			++numDigits;
+			if (seenPoint)
+			{
+				++digitsAfterPoint;
+			}
+		}
+		else if (c == '.' && !seenPoint)
+		{
+			seenPoint = true;
+		}
+		else
+		{
+			break;
+		}
+		++q;
+	}
+
+	if (numDigits == 0 || toupper(*q) == 'E')
+	{
+		return (float)SafeStrtod(s, p);							// no digits, or there is an exponent
+	}
+
+	// The mantissa and the power of 10 are both exact, so a single division gives the correctly-rounded result.
+	// For mantissas too large to be exact as a float we divide in double precision instead.
+	const float result = (mantissa < MaxExactFloatMantissa)
+							? (float)mantissa/PowersOfTen[digitsAfterPoint]
+								: (float)((double)mantissa/(double)PowersOfTen[digitsAfterPoint]);
+	if (p != nullptr)
+	{
+		*p = q;
+	}
+	return (negative) ? -result : result;
 }
 
 unsigned long SafeStrtoul(const char *s, const char **endptr, int base)
@@ -31,6 +31,7 @@
 #include <cmath>
 
 #include "Strnlen.h"
+#include "SafeVsnprintf.h"
 
 // The following should be enough for 32-bit int/long and 64-bit long long
 constexpr size_t MaxLongDigits = 10;	// to print 4294967296
@@ -274,7 +275,6 @@ static bool printi(SStringBuf& apBuf, int i)
 		break;
 
 	case 8:
-	case 10:
 		// GCC compiles very efficient
 		while (u != 0)
 		{
@@ -283,6 +283,10 @@ static bool printi(SStringBuf& apBuf, int i)
 			u /= base;
 		}
 		break;
+
+	case 10:
+		s = FormatUnsigned(s, u);					// dividing by a constant lets the compiler use a multiply instead
+		break;
 #if 0
 	// The generic case, not yet in use
 	default:
@@ -321,6 +325,70 @@ static bool printi(SStringBuf& apBuf, int i)
 
 /*-----------------------------------------------------------*/
 
+// Write the decimal digits of a number backwards, padding with leading zeros to at least minDigits digits
+char *FormatUnsigned(char *end, uint32_t val, unsigned int minDigits)
+{
+	do
+	{
+		*--end = '0' + (char)(val % 10);
+		val /= 10;
+		if (minDigits != 0)
+		{
+			--minDigits;
+		}
+	} while (val != 0 || minDigits != 0);
+	return end;
+}
+
+// Write a float in fixed point format with up to MaxFastFloatDecimals decimal places, without using double precision arithmetic.
+// The result is the same as printf gives for the exact value of the float, including rounding exact halves to even.
+char *FormatFloatFixed(char *end, float val, unsigned int decimals)
+{
+	static constexpr uint32_t Powers[MaxFastFloatDecimals + 1] = { 1, 10, 100, 1000, 10000 };
+	const float absVal = fabsf(val);
+	if (decimals > MaxFastFloatDecimals || !(absVal < 4.0e9))		// the second test also catches NaNs and infinities
+	{
+		return nullptr;
+	}
+
+	// Take the integer part first, then the fractional part is exact. Use a fused multiply-add to find how far the scaled fraction is above
+	// the half way point, so that we round values close to half way correctly.
+	uint32_t intPart = (uint32_t)absVal;
+	const float frac = absVal - (float)intPart;
+	const float scale = (float)Powers[decimals];
+	float scaledFrac = floorf(frac * scale);
+	float excess = fmaf(frac, scale, -(scaledFrac + 0.5));
+	if (excess < -0.5)						// the product was rounded up to an integer
+	{
+		scaledFrac -= 1.0;
+		excess += 1.0;
+	}
+	uint32_t fracPart = (uint32_t)scaledFrac;
+	if (excess > 0.0 || (excess == 0.0 && (((decimals == 0) ? intPart : fracPart) & 1u) != 0))
+	{
+		++fracPart;
+	}
+	if (fracPart >= Powers[decimals])
+	{
+		++intPart;
+		fracPart -= Powers[decimals];
+	}
+
+	if (decimals != 0)
+	{
+		end = FormatUnsigned(end, fracPart, decimals);
+		*--end = '.';
+	}
+	end = FormatUnsigned(end, intPart);
+	if (val < 0.0 && (intPart | fracPart) != 0)
+	{
+		*--end = '-';
+	}
+	return end;
+}
+
+/*-----------------------------------------------------------*/
+
 // Print a number in scientific format
 // apBuf.flags.printLimit is the number of decimal digits required
 static bool printFloat(SStringBuf& apBuf, double d, char formatLetter)
@@ -334,6 +402,27 @@ static bool printFloat(SStringBuf& apBuf, double d, char formatLetter)
 		return prints(apBuf, "inf");
 	}
 
+	// Most of the values we print are floats promoted to double with a few decimal places, so use the fast single precision method for them
+	if ((formatLetter == 'f' || formatLetter == 'F') && apBuf.flags.printLimit > 0 && apBuf.flags.printLimit <= (int)MaxFastFloatDecimals && (double)(float)d == d)
+	{
+		char print_buf[FastFloatBufferSize + 1];
+		print_buf[FastFloatBufferSize] = '\0';
+		const char *s = FormatFloatFixed(print_buf + FastFloatBufferSize, (float)d, (unsigned int)apBuf.flags.printLimit);
+		if (s != nullptr)
+		{
+			if (*s == '-' && apBuf.flags.width != 0 && apBuf.flags.padZero)
+			{
+				if (!strbuf_printchar(apBuf, '-'))
+				{
+					return false;
+				}
+				--apBuf.flags.width;
+				++s;
+			}
+			return prints(apBuf, s);
+		}
+	}
+
 	double ud = fabs(d);
 	if (ud > (double)LONG_LONG_MAX && (formatLetter == 'f' || formatLetter == 'F'))
 	{
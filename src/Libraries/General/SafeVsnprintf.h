@@ -10,10 +10,18 @@
 
 #include <cstdarg>
 #include <cstddef>
+#include <cstdint>
 
 int SafeVsnprintf(char *buffer, size_t maxLen, const char *format, va_list args);
 int SafeSnprintf(char* buffer, size_t maxLen, const char* format, ...) __attribute__ ((format (printf, 3, 4)));
 
+// Fast formatting of numbers in decimal. These write the text backwards so that it ends just before 'end', and return a pointer to the first character.
+constexpr unsigned int MaxFastFloatDecimals = 4;
+constexpr size_t FastFloatBufferSize = 16;		// enough for sign, 10 integer digits, decimal point and MaxFastFloatDecimals decimal places
+
+char *FormatUnsigned(char *end, uint32_t val, unsigned int minDigits = 1);
+char *FormatFloatFixed(char *end, float val, unsigned int decimals);		// returns nullptr if the value is not finite or is too large
+
 #define vsnprintf(b, m, f, a) static_assert(false, "Do not use vsnprintf, use SafeVsnprintf instead")
 #define snprintf(b, m, f, ...) static_assert(false, "Do not use snprintf, use SafeSnprintf instead")
 
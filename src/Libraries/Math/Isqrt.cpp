@@ -1,7 +1,8 @@
 #include "RepRapFirmware.h"
+#include "Isqrt.h"
 
 // Fast 62-bit integer square root function (thanks dmould)
-uint32_t isqrt64(uint64_t num)
+uint32_t isqrt64_bitwise(uint64_t num)
 {
 	uint32_t numHigh = (uint32_t)(num >> 32);
 	if (numHigh == 0)
@@ -86,4 +87,39 @@ uint32_t isqrt64(uint64_t num)
 	}
 }
 
+#if ISQRT_HAS_FPU_VERSION
+
+// 62-bit integer square root using the hardware single precision square root to get an approximation, followed by one Newton-Raphson step and an exact correction.
+// The float approximation is accurate to about 1 part in 2^23 so it is within a few hundred of the true result. After the Newton-Raphson step it is within 1.
+uint32_t isqrt64_fpu(uint64_t num)
+{
+	const uint32_t numHigh = (uint32_t)(num >> 32);
+	if ((numHigh & (3u << 30)) != 0)
+	{
+		// Input out of range - probably negative, so return -1
+		return 0xFFFFFFFF;
+	}
+
+	// Convert to float in two halves to avoid calling the library 64-bit conversion function
+	uint32_t res = (uint32_t)sqrtf((float)numHigh * 4294967296.0f + (float)(uint32_t)num);
+	if (res != 0)
+	{
+		const int64_t remainder = (int64_t)(num - (uint64_t)res * res);
+		res += (int32_t)((float)remainder/(2.0f * (float)res));
+	}
+
+	// Correct the result so that it is exactly the floor of the square root
+	while ((uint64_t)res * res > num)
+	{
+		--res;
+	}
+	while ((uint64_t)(res + 1) * (res + 1) <= num)
+	{
+		++res;
+	}
+	return res;
+}
+
+#endif
+
 // End
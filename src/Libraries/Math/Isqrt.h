@@ -8,6 +8,24 @@
 #ifndef SRC_LIBRARIES_MATH_ISQRT_H_
 #define SRC_LIBRARIES_MATH_ISQRT_H_
 
-extern uint32_t isqrt64(uint64_t num);		// This is defined in its own file, Isqrt.cpp or Isqrt.asm
+// The individual implementations are defined in Isqrt.cpp. They are all exact, so isqrt64 selects the fastest one for the processor.
+// They are exposed separately so that they can be compared by the M122 P102 timing test.
+extern uint32_t isqrt64_bitwise(uint64_t num);
+
+#if SAM4E || SAME70
+# define ISQRT_HAS_FPU_VERSION	1			// processor has a FPU, so seeding the result from the hardware square root is faster
+extern uint32_t isqrt64_fpu(uint64_t num);
+#else
+# define ISQRT_HAS_FPU_VERSION	0
+#endif
+
+inline uint32_t isqrt64(uint64_t num)
+{
+#if ISQRT_HAS_FPU_VERSION
+	return isqrt64_fpu(num);
+#else
+	return isqrt64_bitwise(num);
+#endif
+}
 
 #endif /* SRC_LIBRARIES_MATH_ISQRT_H_ */
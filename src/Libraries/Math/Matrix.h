@@ -50,6 +50,10 @@ public:
 	pre(numRows <= ROWS; numRows + 1 <= COLS)
 	;
 
+	bool Cholesky(T *solution, size_t numRows, T damping)
+	pre(numRows <= ROWS; numRows + 1 <= COLS)
+	;
+
 	// Return a pointer to a specified row, non-const version
 	T* GetRow(size_t r)
 	pre(r < ROWS)
@@ -129,4 +133,60 @@ template<class T, size_t ROWS, size_t COLS> void FixedMatrix<T, ROWS, COLS>::Gau
 	}
 }
 
+// Solve a N x (N+1) matrix holding symmetric positive definite normal equations by Cholesky decomposition.
+// If damping is nonzero then each diagonal element is first multiplied by (1 + damping), as in the Levenberg-Marquardt method.
+// Only the lower triangle and the last column are used, and they are overwritten. Returns false if the matrix is not positive definite.
+template<class T, size_t ROWS, size_t COLS> bool FixedMatrix<T, ROWS, COLS>::Cholesky(T *solution, size_t numRows, T damping)
+{
+	// Decompose the matrix into L * L^T, storing L in the lower triangle
+	for (size_t j = 0; j < numRows; ++j)
+	{
+		T diag = (*this)(j, j) * (1.0 + damping);
+		for (size_t k = 0; k < j; ++k)
+		{
+			diag -= (*this)(j, k) * (*this)(j, k);
+		}
+		if (!(diag > 0.0))
+		{
+			return false;
+		}
+		diag = sqrt(diag);
+		(*this)(j, j) = diag;
+
+		for (size_t i = j + 1; i < numRows; ++i)
+		{
+			T v = (*this)(i, j);
+			for (size_t k = 0; k < j; ++k)
+			{
+				v -= (*this)(i, k) * (*this)(j, k);
+			}
+			(*this)(i, j) = v/diag;
+		}
+	}
+
+	// Solve L * y = b by forward substitution, storing y in the last column
+	for (size_t i = 0; i < numRows; ++i)
+	{
+		T v = (*this)(i, numRows);
+		for (size_t k = 0; k < i; ++k)
+		{
+			v -= (*this)(i, k) * (*this)(k, numRows);
+		}
+		(*this)(i, numRows) = v/(*this)(i, i);
+	}
+
+	// Solve L^T * x = y by back substitution
+	for (size_t i = numRows; i != 0; )
+	{
+		--i;
+		T v = (*this)(i, numRows);
+		for (size_t k = i + 1; k < numRows; ++k)
+		{
+			v -= (*this)(k, i) * solution[k];
+		}
+		solution[i] = v/(*this)(i, i);
+	}
+	return true;
+}
+
 #endif /* MATRIX_H_ */
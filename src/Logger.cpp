@@ -10,6 +10,7 @@
 #include "OutputMemory.h"
 #include "RepRap.h"
 #include "Platform.h"
+#include "RTOSIface.h"
 
 // Simple lock class that sets a variable true when it is created and makes sure it gets set false when it falls out of scope
 class Lock
@@ -22,7 +23,7 @@ private:
 	bool& b;
 };
 
-Logger::Logger() : logFile(), lastFlushTime(0), lastFlushFileSize(0), dirty(false), inLogger(false)
+Logger::Logger() : logFile(), lastFlushTime(0), lastFlushFileSize(0), putIndex(0), getIndex(0), recordPutIndex(0), messagesLost(0), dirty(false), inLogger(false)
 {
 }
 
@@ -31,122 +32,201 @@ void Logger::Start(time_t time, const StringRef& filename)
 	if (!inLogger)
 	{
 		Lock loggerLock(inLogger);
-		FileStore * const f = reprap.GetPlatform().OpenFile(SYS_DIR, filename.c_str(), OpenMode::append);
+		FileStore * const f = reprap.GetPlatform().OpenFile(reprap.GetPlatform().GetLogDir(), filename.c_str(), OpenMode::append);
 		if (f != nullptr)
 		{
+			getIndex = putIndex = 0;
+			messagesLost = 0;
 			logFile.Set(f);
 			lastFlushFileSize = logFile.Length();
 			logFile.Seek(lastFlushFileSize);
-			InternalLogMessage(time, "Event logging started\n");
+			lastFlushTime = millis();
 		}
 	}
+	LogMessage(time, "Event logging started\n");
 }
 
 void Logger::Stop(time_t time)
 {
 	if (logFile.IsLive() && !inLogger)
 	{
+		LogMessage(time, "Event logging stopped\n");
 		Lock loggerLock(inLogger);
-		InternalLogMessage(time, "Event logging stopped\n");
-		logFile.Close();
+		if (WriteRecords())
+		{
+			logFile.Close();
+		}
 	}
 }
 
+// Log a message. This may be called by any task, so it just stores the message in the buffer.
 void Logger::LogMessage(time_t time, const char *message)
 {
-	if (logFile.IsLive() && !inLogger)
+	if (logFile.IsLive())
 	{
-		Lock loggerLock(inLogger);
-		InternalLogMessage(time, message);
+		const size_t len = min<size_t>(strlen(message), MaxRecordTextLength);
+		TaskCriticalSectionLocker lock;
+		if (BeginRecord(time, len))
+		{
+			CopyToBuffer(message, len);
+			EndRecord();
+		}
 	}
 }
 
 void Logger::LogMessage(time_t time, OutputBuffer *buf)
 {
-	if (logFile.IsLive() && !inLogger)
+	if (logFile.IsLive())
 	{
-		Lock loggerLock(inLogger);
-		bool ok = WriteDateTime(time);
-		if (ok)
+		size_t len = 0;
+		for (const OutputBuffer *current = buf; current != nullptr; current = current->Next())
 		{
-			ok = buf->WriteToFile(logFile);
+			len += current->DataLength();
 		}
+		len = min<size_t>(len, MaxRecordTextLength);
 
-		if (ok)
+		TaskCriticalSectionLocker lock;
+		if (BeginRecord(time, len))
 		{
-			dirty = true;
-		}
-		else
-		{
-			logFile.Close();
+			for (const OutputBuffer *current = buf; current != nullptr && len != 0; current = current->Next())
+			{
+				const size_t chunkLength = min<size_t>(current->DataLength(), len);
+				CopyToBuffer(current->Data(), chunkLength);
+				len -= chunkLength;
+			}
+			EndRecord();
 		}
 	}
 }
 
-// Version of LogMessage for when we already know we want to proceed and we have already set inLogger
-void Logger::InternalLogMessage(time_t time, const char *message)
+// Start a record. Caller must have suspended other tasks.
+bool Logger::BeginRecord(time_t time, size_t textLength)
 {
-	bool ok = WriteDateTime(time);
-	if (ok)
+	const size_t recordLength = sizeof(RecordHeader) + ((textLength + 3) & ~3);
+	if (LogBufferSize - (putIndex - getIndex) < recordLength)
 	{
-		const size_t len = strlen(message);
-		if (len != 0)
+		++messagesLost;
+		return false;
+	}
+
+	RecordHeader hdr;
+	hdr.time = time;
+	hdr.secondsSincePowerUp = (uint32_t)(millis64()/1000u);
+	hdr.length = (uint16_t)textLength;
+	hdr.spare = 0;
+	recordPutIndex = putIndex;
+	CopyToBuffer(&hdr, sizeof(hdr));
+	return true;
+}
+
+// Append data to the record being created, wrapping round the end of the buffer if necessary
+void Logger::CopyToBuffer(const void *data, size_t length)
+{
+	const size_t offset = recordPutIndex & (LogBufferSize - 1);
+	const size_t firstPart = min<size_t>(length, LogBufferSize - offset);
+	memcpy(buffer + offset, data, firstPart);
+	memcpy(buffer, reinterpret_cast<const char *>(data) + firstPart, length - firstPart);
+	recordPutIndex += length;
+}
+
+// Make the record we have just finished creating visible to Flush
+void Logger::EndRecord()
+{
+	putIndex = (recordPutIndex + 3) & ~3;
+}
+
+// This is called regularly by Platform to give the logger an opportunity to write the records in the buffer to the file and flush the file
+void Logger::Flush(bool forced)
+{
+	if (logFile.IsLive() && !inLogger)
+	{
+		// To avoid frequent small SD card writes, we only write the records when the buffer is getting full or it is time to flush the file.
+		// We flush the file if one of the following is true:
+		// 1. We have possibly allocated a new cluster since the last flush. To avoid lost clusters if we power down before flushing, we should flush early in this case.
+		// 2. If it hasn't been flushed for LogFlushInterval milliseconds.
+		const uint32_t now = millis();
+		const bool timeToFlush = forced || now - lastFlushTime >= LogFlushInterval;
+		if (timeToFlush || putIndex - getIndex >= LogBufferSize/4)
 		{
-			ok = logFile.Write(message, len);
+			Lock loggerLock(inLogger);
+			if (WriteRecords())
+			{
+				const FilePosition currentPos = logFile.GetPosition();
+				const uint32_t clusterSize = logFile.ClusterSize();
+				if (dirty && (timeToFlush || currentPos/clusterSize != lastFlushFileSize/clusterSize))
+				{
+					logFile.Flush();
+					lastFlushTime = millis();
+					lastFlushFileSize = currentPos;
+					dirty = false;
+				}
+			}
 		}
-		if (ok && (len == 0 || message[len - 1] != '\n'))
+	}
+}
+
+// Convert the records in the buffer to text and write them to the file. If we fail then close the file and return false.
+// Caller must already have checked and set inLogger.
+bool Logger::WriteRecords()
+{
+	bool ok = true;
+	const uint32_t endIndex = putIndex;					// any records added while we are doing this will be written next time
+	while (ok && getIndex != endIndex)
+	{
+		RecordHeader hdr;
+		const size_t offset = getIndex & (LogBufferSize - 1);
+		const size_t firstPart = min<size_t>(sizeof(hdr), LogBufferSize - offset);
+		memcpy(&hdr, buffer + offset, firstPart);
+		memcpy(reinterpret_cast<char *>(&hdr) + firstPart, buffer, sizeof(hdr) - firstPart);
+
+		ok = WriteDateTime(hdr) && WriteFromBuffer(getIndex + sizeof(hdr), hdr.length);
+		if (ok && (hdr.length == 0 || buffer[(getIndex + sizeof(hdr) + hdr.length - 1) & (LogBufferSize - 1)] != '\n'))
 		{
 			ok = logFile.Write('\n');
 		}
-	}
+		getIndex += sizeof(hdr) + ((hdr.length + 3) & ~3);
 
-	if (ok)
-	{
+		if (ok && messagesLost != 0)
+		{
+			String<ShortScratchStringLength> msg;
+			msg.printf("%" PRIu32 " event log messages lost because the log buffer was full\n", messagesLost);
+			messagesLost = 0;
+			ok = WriteDateTime(hdr) && logFile.Write(msg.c_str());
+		}
 		dirty = true;
 	}
-	else
+
+	if (!ok)
 	{
 		logFile.Close();
+		getIndex = putIndex;
 	}
+	return ok;
 }
 
-// This is called regularly by Platform to give the logger an opportunity to flush the file buffer
-void Logger::Flush(bool forced)
+// Write message text from the buffer to the file
+bool Logger::WriteFromBuffer(uint32_t index, size_t length)
 {
-	if (logFile.IsLive() && dirty && !inLogger)
-	{
-		// Log file is dirty and can be flushed.
-		// To avoid excessive disk write operations, flush it only if one of the following is true:
-		// 1. We have possibly allocated a new cluster since the last flush. To avoid lost clusters if we power down before flushing,
-		//    we should flush early in this case. Rather than determine the cluster size, we flush if we have started a new 512-byte sector.
-		// 2. If it hasn't been flushed for LogFlushInterval milliseconds.
-		const FilePosition currentPos = logFile.GetPosition();
-		const uint32_t now = millis();
-		if (forced || now - lastFlushTime >= LogFlushInterval || currentPos/512 != lastFlushFileSize/512)
-		{
-			Lock loggerLock(inLogger);
-			logFile.Flush();
-			lastFlushTime = millis();
-			lastFlushFileSize = currentPos;
-			dirty = false;
-		}
-	}
+	const size_t offset = index & (LogBufferSize - 1);
+	const size_t firstPart = min<size_t>(length, LogBufferSize - offset);
+	return (firstPart == 0 || logFile.Write(buffer + offset, firstPart))
+		&& (firstPart == length || logFile.Write(buffer, length - firstPart));
 }
 
 // Write the data and time to the file followed by a space.
 // Caller must already have checked and set inLogger.
-bool Logger::WriteDateTime(time_t time)
+bool Logger::WriteDateTime(const RecordHeader& hdr)
 {
 	String<30> bufferSpace;
 	const StringRef buf = bufferSpace.GetRef();
-	if (time == 0)
+	if (hdr.time == 0)
 	{
-		const uint32_t timeSincePowerUp = (uint32_t)(millis64()/1000u);
+		const uint32_t timeSincePowerUp = hdr.secondsSincePowerUp;
 		buf.printf("power up + %02" PRIu32 ":%02" PRIu32 ":%02" PRIu32 " ", timeSincePowerUp/3600u, (timeSincePowerUp % 3600u)/60u, timeSincePowerUp % 60u);
 	}
 	else
 	{
-		const struct tm * const timeInfo = gmtime(&time);
+		const struct tm * const timeInfo = gmtime(&hdr.time);
 		buf.printf("%04u-%02u-%02u %02u:%02u:%02u ",
 						timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday, timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
 	}
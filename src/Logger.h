@@ -8,11 +8,14 @@
 #ifndef SRC_LOGGER_H_
 #define SRC_LOGGER_H_
 
+#include "RepRapFirmware.h"
 #include <ctime>
 #include "Storage/FileData.h"
 
 class OutputBuffer;
 
+// The event logger. Messages are stored as binary records in a ring buffer, so that logging a message doesn't involve any SD card access.
+// The records are converted to text and written to the log file when Platform calls Flush.
 class Logger
 {
 public:
@@ -26,14 +29,35 @@ public:
 	bool IsActive() const { return logFile.IsLive(); }
 
 private:
-	bool WriteDateTime(time_t time);
-	void InternalLogMessage(time_t time, const char *message);
+	struct RecordHeader
+	{
+		time_t time;							// the real time when the message was logged, or 0 if it wasn't known
+		uint32_t secondsSincePowerUp;			// used instead of the real time if the real time wasn't known
+		uint16_t length;						// the length of the message text that follows the header
+		uint16_t spare;
+	};
+
+	static_assert((LogBufferSize & (LogBufferSize - 1)) == 0, "LogBufferSize must be a power of 2");
+	static_assert(sizeof(RecordHeader) % 4 == 0, "Log record headers must be a whole number of words");
+	static constexpr size_t MaxRecordTextLength = LogBufferSize/4;
+
+	bool BeginRecord(time_t time, size_t textLength);
+	void CopyToBuffer(const void *data, size_t length);
+	void EndRecord();
+	bool WriteRecords();
+	bool WriteFromBuffer(uint32_t index, size_t length);
+	bool WriteDateTime(const RecordHeader& hdr);
 
 	FileData logFile;
 	uint32_t lastFlushTime;
 	FilePosition lastFlushFileSize;
+	volatile uint32_t putIndex;					// free-running index of the end of the last complete record
+	volatile uint32_t getIndex;					// free-running index of the first record not yet written to the file
+	uint32_t recordPutIndex;					// where the next byte of the record being created goes
+	uint32_t messagesLost;						// how many messages we discarded because the buffer was full
 	bool dirty;
 	bool inLogger;
+	alignas(4) char buffer[LogBufferSize];
 };
 
 #endif /* SRC_LOGGER_H_ */
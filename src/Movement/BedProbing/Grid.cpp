@@ -215,7 +215,7 @@ void GridDefinition::PrintError(float originalXrange, float originalYrange, cons
 // Increase the version number in the following string whenever we change the format of the height map file.
 const char * const HeightMap::HeightMapComment = "RepRapFirmware height map file v2";
 
-HeightMap::HeightMap() : useMap(false) { }
+HeightMap::HeightMap() : useMap(false), useBicubic(false), cachedCellX(-1), cachedCellY(-1) { }
 
 void HeightMap::SetGrid(const GridDefinition& gd)
 {
@@ -226,6 +226,7 @@ void HeightMap::SetGrid(const GridDefinition& gd)
 
 void HeightMap::ClearGridHeights()
 {
+	InvalidateCellCache();
 	for (size_t i = 0; i < ARRAY_SIZE(gridHeightSet); ++i)
 	{
 		gridHeightSet[i] = 0;
@@ -238,8 +239,9 @@ void HeightMap::SetGridHeight(size_t xIndex, size_t yIndex, float height)
 	size_t index = yIndex * def.numX + xIndex;
 	if (index < MaxGridProbePoints)
 	{
-		gridHeights[index] = height;
+		StoreHeight(index, height);
 		gridHeightSet[index/32] |= 1u << (index & 31u);
+		InvalidateCellCache();
 	}
 }
 
@@ -256,6 +258,79 @@ unsigned int HeightMap::GetMinimumSegments(float deltaX, float deltaY) const
 	return max<unsigned int>(xSegments, ySegments);
 }
 
+// Find the fractions of a straight XY move at which it crosses the grid lines, in increasing order, excluding the start and end of the move.
+// Within a grid cell the height error varies smoothly, so if the move is split at these points the Z correction at every segment end is exact
+// and we need no more segments than there are cells crossed.
+// Return false if there are more than maxCrossings crossings, in which case the caller should fall back to fixed segmentation.
+bool HeightMap::GetCellBoundaryCrossings(float x0, float y0, float x1, float y1, float fractions[], size_t maxCrossings, size_t& numCrossings) const
+{
+	numCrossings = 0;
+	const float dx = x1 - x0, dy = y1 - y0;
+	const float xyLength = sqrtf(fsquare(dx) + fsquare(dy));
+	if (!useMap || xyLength < MinCellSegmentLength)
+	{
+		return true;
+	}
+
+	// Find the range of grid line indices crossed in each direction, in the order in which we cross them.
+	// Outside the grid the height error is clamped, so we include the edges of the grid as well as the interior lines.
+	int32_t xIndex = 0, xStep = 1, xCount = 0;
+	if (dx != 0.0)
+	{
+		const int32_t lo = max<int32_t>((int32_t)ceilf((min<float>(x0, x1) - def.xMin) * def.recipXspacing), 0);
+		const int32_t hi = min<int32_t>((int32_t)floorf((max<float>(x0, x1) - def.xMin) * def.recipXspacing), (int32_t)def.numX - 1);
+		xCount = max<int32_t>(hi - lo + 1, 0);
+		xStep = (dx > 0.0) ? 1 : -1;
+		xIndex = (dx > 0.0) ? lo : hi;
+	}
+	int32_t yIndex = 0, yStep = 1, yCount = 0;
+	if (dy != 0.0)
+	{
+		const int32_t lo = max<int32_t>((int32_t)ceilf((min<float>(y0, y1) - def.yMin) * def.recipYspacing), 0);
+		const int32_t hi = min<int32_t>((int32_t)floorf((max<float>(y0, y1) - def.yMin) * def.recipYspacing), (int32_t)def.numY - 1);
+		yCount = max<int32_t>(hi - lo + 1, 0);
+		yStep = (dy > 0.0) ? 1 : -1;
+		yIndex = (dy > 0.0) ? lo : hi;
+	}
+
+	// Merge the X and Y crossings, dropping any that would make a segment too short
+	const float minFraction = MinCellSegmentLength/xyLength;
+	float lastFraction = 0.0;
+	while (xCount != 0 || yCount != 0)
+	{
+		const float xFraction = (xCount != 0) ? (def.xMin + xIndex * def.xSpacing - x0)/dx : 2.0;
+		const float yFraction = (yCount != 0) ? (def.yMin + yIndex * def.ySpacing - y0)/dy : 2.0;
+		float fraction;
+		if (xFraction <= yFraction)
+		{
+			fraction = xFraction;
+			xIndex += xStep;
+			--xCount;
+		}
+		else
+		{
+			fraction = yFraction;
+			yIndex += yStep;
+			--yCount;
+		}
+
+		if (fraction >= 1.0 - minFraction)
+		{
+			break;
+		}
+		if (fraction - lastFraction >= minFraction)
+		{
+			if (numCrossings == maxCrossings)
+			{
+				return false;
+			}
+			fractions[numCrossings++] = fraction;
+			lastFraction = fraction;
+		}
+	}
+	return true;
+}
+
 // Save the grid to file returning true if an error occurred
 bool HeightMap::SaveToFile(FileStore *f, float zOffset) const
 {
@@ -299,7 +374,7 @@ bool HeightMap::SaveToFile(FileStore *f, float zOffset) const
 			}
 			if (IsHeightSet(index))
 			{
-				buf.catf("%7.3f", (double)(gridHeights[index] + zOffset));
+				buf.catf("%7.3f", (double)(GetStoredHeight(index) + zOffset));
 			}
 			else
 			{
@@ -413,7 +488,7 @@ unsigned int HeightMap::GetStatistics(float& mean, float& deviation) const
 		if (IsHeightSet(i))
 		{
 			++numProbed;
-			const double heightError = (double)gridHeights[i];
+			const double heightError = (double)GetStoredHeight(i);
 			heightSum += heightError;
 			heightSquaredSum += dsquare(heightError);
 		}
@@ -464,7 +539,7 @@ float HeightMap::GetInterpolatedHeightError(float x, float y) const
 	const float yFloor = floor(yf);
 	const int32_t yIndex = (int32_t)yFloor;
 
-	return InterpolateXY(xIndex, yIndex, xf - xFloor, yf - yFloor);
+	return (useBicubic) ? InterpolateBicubic(xIndex, yIndex, xf - xFloor, yf - yFloor) : InterpolateXY(xIndex, yIndex, xf - xFloor, yf - yFloor);
 }
 
 float HeightMap::InterpolateXY(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const
@@ -475,10 +550,73 @@ float HeightMap::InterpolateXY(uint32_t xIndex, uint32_t yIndex, float xFrac, fl
 	const uint32_t indexX1Y1 = indexX0Y1 + 1;						// (X1,Y1)
 
 	const float xyFrac = xFrac * yFrac;
-	return (gridHeights[indexX0Y0] * (1.0 - xFrac - yFrac + xyFrac))
-			+ (gridHeights[indexX1Y0] * (xFrac - xyFrac))
-			+ (gridHeights[indexX0Y1] * (yFrac - xyFrac))
-			+ (gridHeights[indexX1Y1] * xyFrac);
+	return (GetStoredHeight(indexX0Y0) * (1.0 - xFrac - yFrac + xyFrac))
+			+ (GetStoredHeight(indexX1Y0) * (xFrac - xyFrac))
+			+ (GetStoredHeight(indexX0Y1) * (yFrac - xyFrac))
+			+ (GetStoredHeight(indexX1Y1) * xyFrac);
+}
+
+// Evaluate the bicubic patch for the specified cell
+float HeightMap::InterpolateBicubic(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const
+{
+	if ((int32_t)xIndex != cachedCellX || (int32_t)yIndex != cachedCellY)
+	{
+		CalculateCellCoefficients(xIndex, yIndex);
+	}
+
+	float result = 0.0;
+	for (int m = 3; m >= 0; --m)
+	{
+		const float * const c = cellCoefficients[m];
+		result = result * xFrac + (((c[3] * yFrac + c[2]) * yFrac + c[1]) * yFrac + c[0]);
+	}
+	return result;
+}
+
+// Calculate the coefficients of the Catmull-Rom bicubic patch for the cell whose lowest corner is grid point (xIndex, yIndex).
+// The patch passes through the four corner points and has the same slopes along its edges as its neighbours, so the surface is smooth.
+// Where the cell is on the edge of the grid we repeat the edge points.
+void HeightMap::CalculateCellCoefficients(uint32_t xIndex, uint32_t yIndex) const
+{
+	// Catmull-Rom basis matrix. Row m gives the weights of the 4 points for the coefficient of t^m.
+	static const float Basis[4][4] =
+	{
+		{  0.0,  1.0,  0.0,  0.0 },
+		{ -0.5,  0.0,  0.5,  0.0 },
+		{  1.0, -2.5,  2.0, -0.5 },
+		{ -0.5,  1.5, -1.5,  0.5 }
+	};
+
+	// Fetch the 4x4 patch of heights around the cell
+	float heights[4][4];											// heights[k][l] is at X index xIndex + k - 1, Y index yIndex + l - 1
+	for (int k = 0; k < 4; ++k)
+	{
+		const uint32_t xi = (uint32_t)constrain<int32_t>((int32_t)xIndex + k - 1, 0, (int32_t)def.numX - 1);
+		for (int l = 0; l < 4; ++l)
+		{
+			const uint32_t yi = (uint32_t)constrain<int32_t>((int32_t)yIndex + l - 1, 0, (int32_t)def.numY - 1);
+			heights[k][l] = GetStoredHeight(GetMapIndex(xi, yi));
+		}
+	}
+
+	// Coefficients = Basis * heights * Basis^T
+	float temp[4][4];
+	for (int m = 0; m < 4; ++m)
+	{
+		for (int l = 0; l < 4; ++l)
+		{
+			temp[m][l] = (Basis[m][0] * heights[0][l]) + (Basis[m][1] * heights[1][l]) + (Basis[m][2] * heights[2][l]) + (Basis[m][3] * heights[3][l]);
+		}
+	}
+	for (int m = 0; m < 4; ++m)
+	{
+		for (int n = 0; n < 4; ++n)
+		{
+			cellCoefficients[m][n] = (temp[m][0] * Basis[n][0]) + (temp[m][1] * Basis[n][1]) + (temp[m][2] * Basis[n][2]) + (temp[m][3] * Basis[n][3]);
+		}
+	}
+	cachedCellX = (int32_t)xIndex;
+	cachedCellY = (int32_t)yIndex;
 }
 
 void HeightMap::ExtrapolateMissing()
@@ -498,7 +636,7 @@ void HeightMap::ExtrapolateMissing()
 			{
 				const float fX = (def.xSpacing * iX) + def.xMin;
 				const float fY = (def.ySpacing * iY) + def.yMin;
-				const float fZ = gridHeights[index];
+				const float fZ = GetStoredHeight(index);
 
 				n++;
 				sumX += fX; sumY += fY; sumZ += fZ;
@@ -522,7 +660,7 @@ void HeightMap::ExtrapolateMissing()
 			{
 				const float fX = (def.xSpacing * iX) + def.xMin;
 				const float fY = (def.ySpacing * iY) + def.yMin;
-				const float fZ = gridHeights[index];
+				const float fZ = GetStoredHeight(index);
 
 				const float rX = fX - centX;
 				const float rY = fY - centY;
@@ -556,6 +694,7 @@ void HeightMap::ExtrapolateMissing()
 	const float d = centX*a + centY*b + centZ*c;
 
 	// Fill in the blanks
+	InvalidateCellCache();
 	for (uint32_t iY = 0; iY < def.numY; iY++)
 	{
 		for (uint32_t iX = 0; iX < def.numX; iX++)
@@ -566,7 +705,7 @@ void HeightMap::ExtrapolateMissing()
 				const float fX = (def.xSpacing * iX) + def.xMin;
 				const float fY = (def.ySpacing * iY) + def.yMin;
 				const float fZ = (d - (a * fX + b * fY)) * invC;
-				gridHeights[index] = fZ;	// fill in Z but don't mark it as set so we can always differentiate between measured and extrapolated
+				StoreHeight(index, fZ);		// fill in Z but don't mark it as set so we can always differentiate between measured and extrapolated
 			}
 		}
 	}
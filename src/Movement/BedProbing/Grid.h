@@ -73,26 +73,74 @@ public:
 	bool LoadFromFile(FileStore *f, const StringRef& r);			// Load the grid from file returning true if an error occurred
 
 	unsigned int GetMinimumSegments(float deltaX, float deltaY) const;	// Return the minimum number of segments for a move by this X or Y amount
+	bool GetCellBoundaryCrossings(float x0, float y0, float x1, float y1, float fractions[], size_t maxCrossings, size_t& numCrossings) const;
+																	// Find where a straight move crosses the grid lines
 
 	bool UseHeightMap(bool b);
 	bool UsingHeightMap() const { return useMap; }
 
+	void UseBicubicInterpolation(bool b) { useBicubic = b; InvalidateCellCache(); }
+	bool UsingBicubicInterpolation() const { return useBicubic; }
+
 	unsigned int GetStatistics(float& mean, float& deviation) const; // Return number of points probed, mean and RMS deviation
 
 	void ExtrapolateMissing();										// Extrapolate missing points to ensure consistency
 
 private:
 	static const char * const HeightMapComment;						// The start of the comment we write at the start of the height map file
+	static constexpr float MinCellSegmentLength = 0.1;				// Grid line crossings closer together than this in mm are merged
 
 	GridDefinition def;
+#if USE_QUANTISED_HEIGHT_MAP
+	int16_t gridHeights[MaxGridProbePoints];						// The Z coordinates of the points on the bed that were probed, in units of HeightMapQuantum
+#else
 	float gridHeights[MaxGridProbePoints];							// The Z coordinates of the points on the bed that were probed
+#endif
 	uint32_t gridHeightSet[(MaxGridProbePoints + 31)/32];			// Bitmap of which heights are set
 	bool useMap;													// True to do bed compensation
+	bool useBicubic;												// True to use Catmull-Rom bicubic interpolation instead of bilinear
+
+	// Bicubic interpolation coefficients of the cell we used most recently. Consecutive lookups are usually in the same cell, so this saves recalculating them.
+	mutable int32_t cachedCellX, cachedCellY;						// the indices of the cell whose coefficients we hold, or -1 if none
+	mutable float cellCoefficients[4][4];							// coefficient of x^m * y^n within the cached cell is cellCoefficients[m][n]
 
 	uint32_t GetMapIndex(uint32_t xIndex, uint32_t yIndex) const { return (yIndex * def.NumXpoints()) + xIndex; }
 	bool IsHeightSet(uint32_t index) const { return (gridHeightSet[index/32] & (1 << (index & 31))) != 0; }
+	float GetStoredHeight(uint32_t index) const;
+	void StoreHeight(uint32_t index, float height);
 
 	float InterpolateXY(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const;
+	float InterpolateBicubic(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const;
+	void CalculateCellCoefficients(uint32_t xIndex, uint32_t yIndex) const;
+	void InvalidateCellCache() { cachedCellX = cachedCellY = -1; }
 };
 
+#if USE_QUANTISED_HEIGHT_MAP
+
+inline float HeightMap::GetStoredHeight(uint32_t index) const
+{
+	return (float)gridHeights[index] * HeightMapQuantum;
+}
+
+// Store a height, saturating it if it is out of range. The range is +/-32mm, far more than any bed should need.
+inline void HeightMap::StoreHeight(uint32_t index, float height)
+{
+	const int32_t h = lrintf(height * (1.0/HeightMapQuantum));
+	gridHeights[index] = (int16_t)constrain<int32_t>(h, INT16_MIN, INT16_MAX);
+}
+
+#else
+
+inline float HeightMap::GetStoredHeight(uint32_t index) const
+{
+	return gridHeights[index];
+}
+
+inline void HeightMap::StoreHeight(uint32_t index, float height)
+{
+	gridHeights[index] = height;
+}
+
+#endif
+
 #endif /* SRC_MOVEMENT_GRID_H_ */
@@ -178,6 +178,26 @@ float RandomProbePointSet::GetInterpolatedHeightError(float x, float y) const
 	}
 }
 
+// If the height error is a linear function of X and Y, get the coefficients and return true
+bool RandomProbePointSet::GetPlaneEquation(float& x, float& y, float& c) const
+{
+	switch(numBedCompensationPoints)
+	{
+	case 0:
+		x = y = c = 0.0;
+		return true;
+
+	case 3:
+		x = aX;
+		y = aY;
+		c = aC;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
 // Check whether the specified set of points has been successfully defined and probed
 bool RandomProbePointSet::GoodProbePoints(size_t numPoints) const
 {
@@ -39,6 +39,7 @@ public:
 	void SetIdentity() { numBedCompensationPoints = 0; }				// Set identity transform
 
 	float GetInterpolatedHeightError(float x, float y) const;			// Compute the interpolated height error at the specified point
+	bool GetPlaneEquation(float& x, float& y, float& c) const;			// If the height error is linear in X and Y, get its coefficients and return true
 
 	bool GoodProbePoints(size_t numPoints) const;						// Check whether the specified set of points has been successfully defined and probed
 	void ReportProbeHeights(size_t numPoints, const StringRef& reply) const;	// Print out the probe heights and any errors
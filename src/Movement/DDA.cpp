@@ -10,6 +10,10 @@
 #include "Platform.h"
 #include "Move.h"
 #include "Kinematics/LinearDeltaKinematics.h"		// for DELTA_AXES
+#include "InputShaper.h"
+#if SUPPORT_LASER_RASTER
+# include "LaserRaster.h"
+#endif
 
 #ifdef DUET_NG
 # define DDA_MOVE_DEBUG	(0)
@@ -108,8 +112,14 @@ void DDA::LogProbePosition()
 
 #endif
 
-DDA::DDA(DDA* n) : next(n), prev(nullptr), state(empty)
+DDA::DDA(DDA* n) : next(n), prev(nullptr), state(empty), dmBlock(nullptr)
 {
+#if SUPPORT_INPUT_SHAPING
+	shapedProfile = nullptr;
+#endif
+#if SUPPORT_LASER_RASTER
+	laserRaster = nullptr;
+#endif
 	for (DriveMovement*& p : pddm)
 	{
 		p = nullptr;
@@ -122,10 +132,22 @@ void DDA::ReleaseDMs()
 	{
 		if (p != nullptr)
 		{
-			DriveMovement::Release(p);
+			if (dmBlock != nullptr && dmBlock->Contains(p))
+			{
+				p->ReleaseStepTable();
+			}
+			else
+			{
+				DriveMovement::Release(p);
+			}
 			p = nullptr;
 		}
 	}
+	if (dmBlock != nullptr)
+	{
+		DriveMovementBlock::Release(dmBlock);
+		dmBlock = nullptr;
+	}
 }
 
 // Return the number of clocks this DDA still needs to execute.
@@ -138,6 +160,97 @@ pre(state == executing || state == frozen || state == completed)
 			: (int32_t)clocksNeeded;
 }
 
+#if USE_DM_HEAP
+
+// The active DMs are kept in a binary heap ordered by step time, so that inserting a DM takes O(log n) time instead of O(n).
+// The heap holds indices into pddm. Leadscrew adjustment moves store their DMs at the index of the drive number minus DRIVES.
+
+// Move the heap entry at 'pos' towards the root until its parent is due no later than it is
+inline void DDA::HeapSiftUp(size_t pos)
+{
+	const uint8_t entry = activeDrives[pos];
+	const uint32_t stepTime = pddm[entry]->nextStepTime;
+	while (pos != 0)
+	{
+		const size_t parent = (pos - 1)/2;
+		if (HeapStepTime(parent) <= stepTime)
+		{
+			break;
+		}
+		activeDrives[pos] = activeDrives[parent];
+		pos = parent;
+	}
+	activeDrives[pos] = entry;
+}
+
+// Move the heap entry at 'pos' away from the root until both its children are due no earlier than it is
+inline void DDA::HeapSiftDown(size_t pos)
+{
+	const uint8_t entry = activeDrives[pos];
+	const uint32_t stepTime = pddm[entry]->nextStepTime;
+	for (;;)
+	{
+		size_t child = 2 * pos + 1;
+		if (child >= numActiveDrives)
+		{
+			break;
+		}
+		if (child + 1 < numActiveDrives && HeapStepTime(child + 1) < HeapStepTime(child))
+		{
+			++child;
+		}
+		if (stepTime <= HeapStepTime(child))
+		{
+			break;
+		}
+		activeDrives[pos] = activeDrives[child];
+		pos = child;
+	}
+	activeDrives[pos] = entry;
+}
+
+// Insert the specified drive into the heap of drives with steps due
+inline void DDA::InsertDM(DriveMovement *dm)
+{
+	activeDrives[numActiveDrives] = (dm->drive >= DRIVES) ? dm->drive - DRIVES : dm->drive;
+	HeapSiftUp(numActiveDrives++);
+}
+
+// Remove and return the drive with the earliest step due. The heap must not be empty.
+inline DriveMovement *DDA::PopFirstDM()
+{
+	DriveMovement * const dm = pddm[activeDrives[0]];
+	--numActiveDrives;
+	if (numActiveDrives != 0)
+	{
+		activeDrives[0] = activeDrives[numActiveDrives];
+		HeapSiftDown(0);
+	}
+	return dm;
+}
+
+// Remove this drive from the heap of drives with steps due
+// Called from the step ISR only.
+void DDA::RemoveDM(size_t drive)
+{
+	for (size_t pos = 0; pos < numActiveDrives; ++pos)
+	{
+		if (pddm[activeDrives[pos]]->drive == drive)
+		{
+			--numActiveDrives;
+			if (pos != numActiveDrives)
+			{
+				activeDrives[pos] = activeDrives[numActiveDrives];
+				HeapSiftDown(pos);
+				HeapSiftUp(pos);
+			}
+			break;
+		}
+	}
+}
+
+#else
+
 // Insert the specified drive into the step list, in step time order.
 // We insert the drive before any existing entries with the same step time for best performance. Now that we generate step pulses
 // for multiple motors simultaneously, there is no need to preserve round-robin order.
@@ -169,6 +282,8 @@ void DDA::RemoveDM(size_t drive)
 	}
 }
 
+#endif
+
 void DDA::DebugPrintVector(const char *name, const float *vec, size_t len) const
 {
 	debugPrintf("%s=", name);
@@ -242,6 +357,13 @@ void DDA::Init()
 #if SUPPORT_LASER || SUPPORT_IOBITS
 	laserPwmOrIoBits.Clear();
 #endif
+#if SUPPORT_LASER_RASTER
+	if (laserRaster != nullptr)
+	{
+		LaserRaster::Release(laserRaster);
+		laserRaster = nullptr;
+	}
+#endif
 }
 
 // Set up a real move. Return true if it represents real movement, else false.
@@ -259,8 +381,20 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 	}
 
 	// 1. Compute the new endpoints and the movement vector
+	// Retractions, filament loading and other extruder-only moves are common, so if no axis coordinate has changed since the previous move
+	// we keep the previous motor endpoints and skip the kinematics transform. The comparison is exact because GCodes passes the same coordinates again.
+	bool extruderOnly = doMotorMapping && prev->endCoordinatesValid;
+	for (size_t axis = 0; extruderOnly && axis < numTotalAxes; ++axis)
+	{
+		extruderOnly = (nextMove.coords[axis] == prev->endCoordinates[axis]);
+	}
+
 	const Move& move = reprap.GetMove();
-	if (doMotorMapping)
+	if (extruderOnly)
+	{
+		isDeltaMovement = false;
+	}
+	else if (doMotorMapping)
 	{
 		if (!move.CartesianToMotorSteps(nextMove.coords, endPoint, nextMove.isCoordinated))		// transform the axis coordinates if on a delta or CoreXY printer
 		{
@@ -281,8 +415,24 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 	float accelerations[DRIVES];
 	const float * const normalAccelerations = reprap.GetPlatform().Accelerations();
 	const Kinematics& k = move.GetKinematics();
+	const AxesBitmap userRotationAxes = (nextMove.moveType == 1 || nextMove.moveType == 2) ? 0 : reprap.GetGCodes().GetContinuousRotationAxes();
+	const AxesBitmap continuousRotationAxes = (nextMove.moveType == 1 || nextMove.moveType == 2) ? 0 : k.GetContinuousRotationAxes() | userRotationAxes;
 
-	for (size_t drive = 0; drive < DRIVES; drive++)
+	size_t firstDrive = 0;
+	if (extruderOnly)
+	{
+		for (size_t axis = 0; axis < numTotalAxes; ++axis)
+		{
+			accelerations[axis] = normalAccelerations[axis];
+			endPoint[axis] = positionNow[axis];
+			endCoordinates[axis] = nextMove.coords[axis];
+			directionVector[axis] = 0.0;
+			netSteps[axis] = 0;
+		}
+		firstDrive = numTotalAxes;
+	}
+
+	for (size_t drive = firstDrive; drive < DRIVES; drive++)
 	{
 		accelerations[drive] = normalAccelerations[drive];
 		if (drive >= numTotalAxes || (!doMotorMapping && drive < numVisibleAxes))
@@ -295,7 +445,7 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 		if (drive < numTotalAxes)
 		{
 			delta = endPoint[drive] - positionNow[drive];
-			if (k.IsContinuousRotationAxis(drive) && nextMove.moveType != 1 && nextMove.moveType != 2)
+			if (IsBitSet(continuousRotationAxes, drive))
 			{
 				const int32_t stepsPerRotation = lrintf(360.0 * reprap.GetPlatform().DriveStepsPerUnit(drive));
 				if (delta > stepsPerRotation/2)
@@ -315,7 +465,19 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 
 		if (drive < numTotalAxes && doMotorMapping)
 		{
-			const float positionDelta = nextMove.coords[drive] - prev->GetEndCoordinate(drive, false);
+			float positionDelta = nextMove.coords[drive] - prev->GetEndCoordinate(drive, false);
+			if (IsBitSet(userRotationAxes, drive))
+			{
+				// GCodes keeps the position of this axis between 0 and 360 degrees, so go the shortest way round
+				if (positionDelta > 180.0)
+				{
+					positionDelta -= 360.0;
+				}
+				else if (positionDelta < -180.0)
+				{
+					positionDelta += 360.0;
+				}
+			}
 			directionVector[drive] = positionDelta;
 			if (positionDelta != 0.0 && (IsBitSet(nextMove.yAxes, drive) || IsBitSet(nextMove.xAxes, drive)))
 			{
@@ -331,20 +493,16 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 			}
 		}
 
+		netSteps[drive] = delta;
 		if (delta != 0)
 		{
 			realMove = true;
-			DriveMovement*& pdm = pddm[drive];
-			pdm = DriveMovement::Allocate(drive, DMState::moving);
-			pdm->totalSteps = labs(delta);				// for now this is the number of net steps, but gets adjusted later if there is a reverse in direction
-			pdm->direction = (delta >= 0);				// for now this is the direction of net movement, but gets adjusted later if it is a delta movement
-
 			if (drive >= numTotalAxes)
 			{
 				// It's an extruder movement
 				nextMove.coords[drive] -= directionVector[drive];
 														// subtract the amount of extrusion we actually did to leave the residue outstanding
-				if (xyMoving && nextMove.usePressureAdvance)
+				if (xyMoving && nextMove.usePressureAdvance && reprap.GetPlatform().GetPressureAdvanceSmoothingTime() <= 0.0)
 				{
 					const float compensationTime = reprap.GetPlatform().GetPressureAdvance(drive - numTotalAxes);
 					if (compensationTime > 0.0)
@@ -375,21 +533,6 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 		return false;
 	}
 
-	// 2a. If it's a delta move, we need a DM for each tower even if its carriage has no net movement
-	if (isDeltaMovement)
-	{
-		for (size_t drive = 0; drive < DELTA_AXES; ++drive)
-		{
-			DriveMovement*& pdm = pddm[drive];
-			if (pdm == nullptr)
-			{
-				pdm = DriveMovement::Allocate(drive, DMState::moving);
-				pdm->totalSteps = 0;
-				pdm->direction = true;
-			}
-		}
-	}
-
 	// 3. Store some values
 	xAxes = nextMove.xAxes;
 	yAxes = nextMove.yAxes;
@@ -400,11 +543,13 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 
 	canPauseAfter = nextMove.canPauseAfter;
 	usingStandardFeedrate = nextMove.usingStandardFeedrate;
-	isPrintingMove = xyMoving && extruding;
+	usesSpeedFactor = nextMove.usingStandardFeedrate && nextMove.moveType == 0 && !nextMove.isFirmwareRetraction;
+	isPrintingMove = xyMoving && extruding && !nextMove.isFirmwareRetraction;		// an un-retraction blended into a travel move is not a printing move
 	usePressureAdvance = nextMove.usePressureAdvance;
 	hadLookaheadUnderrun = false;
 	hadHiccup = false;
 	isLeadscrewAdjustmentMove = false;
+	isExtruderOnlyMove = extruderOnly;
 	goingSlow = false;
 
 	// The end coordinates will be valid at the end of this move if it does not involve endstop checks and is not a raw motor move
@@ -413,6 +558,10 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 #if SUPPORT_IOBITS
 	laserPwmOrIoBits = nextMove.laserPwmOrIoBits;
 #endif
+#if SUPPORT_LASER_RASTER
+	laserRaster = nextMove.laserRaster;							// take ownership of the raster, if there is one
+	nextMove.laserRaster = nullptr;
+#endif
 
 	// If it's a Z probing move, limit the Z acceleration to better handle nozzle-contact probes
 	if ((endStopsToCheck & ZProbeActive) != 0 && accelerations[Z_AXIS] > ZProbeMaxAcceleration)
@@ -485,6 +634,35 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 	// speed lower than MinimumMovementSpeed. We must apply the minimum speed first and then limit it if necessary after that.
 	requestedSpeed = min<float>(max<float>(reqSpeed, MinimumMovementSpeed), VectorBoxIntersection(normalisedDirectionVector, reprap.GetPlatform().MaxFeedrates(), DRIVES));
 
+	// If the tool has a volumetric flow limit, don't let the extruders feed filament faster than it allows
+	if (nextMove.maxExtrusionRate > 0.0 && xyMoving)
+	{
+		float extrusionPerMm = 0.0;
+		for (size_t drive = numTotalAxes; drive < DRIVES; ++drive)
+		{
+			if (directionVector[drive] > 0.0)
+			{
+				extrusionPerMm += directionVector[drive];
+			}
+		}
+		if (extrusionPerMm > 0.0)
+		{
+			requestedSpeed = min<float>(requestedSpeed, max<float>(nextMove.maxExtrusionRate/extrusionPerMm, MinimumMovementSpeed));
+		}
+	}
+
+	// If the ring is draining because short moves are arriving too slowly, slow this move down so that it doesn't finish before the next one is likely to arrive
+	const uint32_t minClocks = move.GetMinSegmentClocks();
+	if (minClocks != 0 && nextMove.moveType == 0)
+	{
+		const float maxSpeed = max<float>((totalDistance * StepClockRate)/minClocks, MinimumMovementSpeed);
+		if (maxSpeed < requestedSpeed)
+		{
+			requestedSpeed = maxSpeed;
+			reprap.GetMove().RecordSegmentSlowed();
+		}
+	}
+
 	// On a Cartesian printer, it is OK to limit the X and Y speeds and accelerations independently, and in consequence to allow greater values
 	// for diagonal moves. On other architectures, this is not OK and any movement in the XY plane should be limited to the X/Y axis values, which we assume to be equal.
 	if (doMotorMapping)
@@ -505,7 +683,9 @@ bool DDA::Init(GCodes::RawMove &nextMove, bool doMotorMapping)
 		// Try to meld this move to the previous move to avoid stop/start
 		// Assuming that this move ends with zero speed, calculate the maximum possible starting speed: u^2 = v^2 - 2as
 		prev->targetNextSpeed = min<float>(sqrtf(deceleration * totalDistance * 2.0), requestedSpeed);
+		const uint32_t lookaheadStartCycles = StageTimer::GetCycles();
 		DoLookahead(prev);
+		reprap.GetMove().RecordLookaheadTime(StageTimer::GetCycles() - lookaheadStartCycles);
 		startSpeed = prev->endSpeed;
 	}
 
@@ -534,13 +714,9 @@ bool DDA::Init(const float_t adjustments[DRIVES])
 
 		directionVector[drive] = adjustments[drive];
 		const int32_t delta = lrintf(directionVector[drive] * reprap.GetPlatform().DriveStepsPerUnit(Z_AXIS));
-
+		netSteps[drive] = delta;
 		if (delta != 0)
 		{
-			DriveMovement*& pdm = pddm[drive];
-			pdm = DriveMovement::Allocate(drive + DRIVES, DMState::moving);
-			pdm->totalSteps = labs(delta);
-			pdm->direction = (delta >= 0);
 			realMove = true;
 		}
 	}
@@ -548,17 +724,18 @@ bool DDA::Init(const float_t adjustments[DRIVES])
 	// 2. Throw it away if there's no real movement.
 	if (!realMove)
 	{
-		ReleaseDMs();
 		return false;
 	}
 
 	// 3. Store some values
 	isLeadscrewAdjustmentMove = true;
+	isExtruderOnlyMove = false;
 	isDeltaMovement = false;
 	isPrintingMove = false;
 	xyMoving = false;
 	canPauseAfter = true;
 	usingStandardFeedrate = false;
+	usesSpeedFactor = false;
 	usePressureAdvance = false;
 	hadLookaheadUnderrun = false;
 	hadHiccup = false;
@@ -748,120 +925,15 @@ LA_DEBUG;
 	}
 }
 
-// Try to push babystepping earlier in the move queue, returning the amount we pushed
-float DDA::AdvanceBabyStepping(float amount)
+// Add a babystepping offset to the end position of this move.
+// The move itself is not changed, because the babysteps are made by the step ISR separately from the steps of the moves.
+void DDA::AddBabyStepOffset(float zAmount, const int32_t motorSteps[], const uint8_t motors[], size_t numMotors)
 {
-	DDA *cdda = this;
-	while (cdda->prev->state == DDAState::provisional)
-	{
-		cdda = cdda->prev;
-	}
-
-	// cdda addresses the earliest un-prepared move, which is the first one we can apply babystepping to
-	// Allow babystepping Z speed up to 10% of the move top speed or up to half the Z jerk rate, whichever is lower
-	float babySteppingDone = 0.0;
-	while(cdda != this)
+	endCoordinates[Z_AXIS] += zAmount;
+	for (size_t i = 0; i < numMotors; ++i)
 	{
-		float babySteppingToDo = 0.0;
-		if (amount != 0.0 && cdda->xyMoving)
-		{
-			// If not on a delta printer, check that we have a DM for the Z axis
-			bool ok = (cdda->isDeltaMovement || cdda->pddm[Z_AXIS] != nullptr);
-			if (!ok)
-			{
-				cdda->pddm[Z_AXIS] = DriveMovement::Allocate(Z_AXIS, DMState::idle);
-				ok = (cdda->pddm[Z_AXIS] != nullptr);
-			}
-
-			if (ok)
-			{
-				// Limit the babystepping Z speed to the lower of 0.1 times the original XYZ speed and 0.5 times the Z jerk
-				const float maxBabySteppingAmount = cdda->totalDistance * min<float>(0.1, 0.5 * reprap.GetPlatform().GetInstantDv(Z_AXIS)/cdda->topSpeed);
-				babySteppingToDo = constrain<float>(amount, -maxBabySteppingAmount, maxBabySteppingAmount);
-				cdda->directionVector[Z_AXIS] += babySteppingToDo/cdda->totalDistance;
-				cdda->totalDistance *= cdda->NormaliseXYZ();
-				cdda->RecalculateMove();
-				babySteppingDone += babySteppingToDo;
-				amount -= babySteppingToDo;
-			}
-		}
-
-		// Even if there is no babystepping to do this move, we may need to adjust the end coordinates
-		cdda->endCoordinates[Z_AXIS] += babySteppingDone;
-		if (cdda->isDeltaMovement)
-		{
-			for (size_t tower = 0; tower < DELTA_AXES; ++tower)
-			{
-				cdda->endPoint[tower] += (int32_t)(babySteppingDone * reprap.GetPlatform().DriveStepsPerUnit(tower));
-				if (babySteppingToDo != 0.0)
-				{
-					int32_t steps = (int32_t)(babySteppingToDo * reprap.GetPlatform().DriveStepsPerUnit(tower));
-					DriveMovement* const pdm = cdda->pddm[tower];
-					if (pdm != nullptr)
-					{
-						if (pdm->direction)		// if moving up
-						{
-							steps += (int32_t)pdm->totalSteps;
-						}
-						else
-						{
-							steps -= (int32_t)pdm->totalSteps;
-						}
-						if (steps >= 0)
-						{
-							pdm->direction = true;
-							pdm->totalSteps = (uint32_t)steps;
-						}
-						else
-						{
-							pdm->direction = false;
-							pdm->totalSteps = (uint32_t)(-steps);
-						}
-					}
-				}
-			}
-		}
-		else
-		{
-			cdda->endPoint[Z_AXIS] += (int32_t)(babySteppingDone * reprap.GetPlatform().DriveStepsPerUnit(Z_AXIS));
-			if (babySteppingToDo != 0.0)
-			{
-				int32_t steps = (int32_t)(babySteppingToDo * reprap.GetPlatform().DriveStepsPerUnit(Z_AXIS));
-				DriveMovement* const pdm = cdda->pddm[Z_AXIS];			// must be non-null because we allocated one earlier if necessary
-				if (pdm->state == DMState::moving)
-				{
-					if (pdm->direction)		// if moving up
-					{
-						steps += (int32_t)pdm->totalSteps;
-					}
-					else
-					{
-						steps -= (int32_t)pdm->totalSteps;
-					}
-				}
-				else
-				{
-					pdm->state = DMState::moving;
-				}
-
-				if (steps >= 0)
-				{
-					pdm->direction = true;
-					pdm->totalSteps = (uint32_t)steps;
-				}
-				else
-				{
-					pdm->direction = false;
-					pdm->totalSteps = (uint32_t)(-steps);
-				}
-			}
-		}
-
-		// Now do the next move
-		cdda = cdda->next;
+		endPoint[motors[i]] += motorSteps[i];
 	}
-
-	return babySteppingDone;
 }
 
 // Recalculate the top speed, acceleration distance and deceleration distance, and whether we can pause after this move
@@ -939,7 +1011,7 @@ void DDA::RecalculateMove()
 		const Platform& p = reprap.GetPlatform();
 		for (size_t drive = 0; drive < DRIVES; ++drive)
 		{
-			if (pddm[drive] != nullptr && pddm[drive]->state == DMState::moving && endSpeed * fabsf(directionVector[drive]) > p.GetInstantDv(drive))
+			if (IsDriveMoving(drive) && endSpeed * fabsf(directionVector[drive]) > p.GetInstantDv(drive))
 			{
 				canPauseAfter = false;
 				break;
@@ -969,10 +1041,33 @@ void DDA::MatchSpeeds()
 		return;
 	}
 
+	// If junction deviation is configured, it replaces the jerk limits of the XYZ axes when both moves are XY moves
+	const float junctionDeviation = reprap.GetMove().GetJunctionDeviation();
+	const bool useJunctionDeviation = junctionDeviation > 0.0 && xyMoving && next->xyMoving;
+	if (useJunctionDeviation)
+	{
+		const float maxJunctionSpeed = GetJunctionSpeedLimit(junctionDeviation);
+		if (targetNextSpeed > maxJunctionSpeed)
+		{
+			targetNextSpeed = maxJunctionSpeed;
+			if (targetNextSpeed < endSpeed)
+			{
+				reprap.GetMove().RecordLookaheadError();
+				if (reprap.Debug(moduleMove))
+				{
+					debugPrintf("DDA.cpp(%d) tn=%.3f ", __LINE__, (double)targetNextSpeed);
+					DebugPrint();
+				}
+				return;
+			}
+		}
+	}
+
+	const AxesBitmap junctionAxes = (useJunctionDeviation) ? xAxes | yAxes | next->xAxes | next->yAxes | MakeBitmap<AxesBitmap>(Z_AXIS) : 0;
 	for (size_t drive = 0; drive < DRIVES; ++drive)
 	{
-		if (   (pddm[drive] != nullptr && pddm[drive]->state == DMState::moving)
-			|| (next->pddm[drive] != nullptr && next->pddm[drive]->state == DMState::moving)
+		if (   !IsBitSet(junctionAxes, drive)
+			&& (IsDriveMoving(drive) || next->IsDriveMoving(drive))
 		   )
 		{
 			const float totalFraction = fabsf(directionVector[drive] - next->directionVector[drive]);
@@ -1169,10 +1264,182 @@ inline void DDA::AdjustAcceleration()
 	}
 }
 
+// Return true if this un-prepared move uses the specified drive.
+// A delta move uses all the towers, even if some of them have no net movement.
+bool DDA::IsDriveMoving(size_t drive) const
+{
+	return netSteps[drive] != 0 || (isDeltaMovement && drive < DELTA_AXES);
+}
+
+// Return the DM already allocated to an extruder drive that will step identically to the specified extruder drive, or nullptr if there isn't one.
+// Mixing hot ends often drive several inputs with equal mix ratios, so this saves both DMs and step calculations in the ISR.
+DriveMovement *DDA::FindLockstepExtruderDM(size_t drive, size_t numAxes) const
+{
+	const Platform& platform = reprap.GetPlatform();
+	for (size_t other = numAxes; other < drive; ++other)
+	{
+		DriveMovement * const pdm = pddm[other];
+		if (pdm != nullptr && netSteps[other] == netSteps[drive] && platform.ExtrudersStepAlike(other - numAxes, drive - numAxes))
+		{
+			return pdm;
+		}
+	}
+	return nullptr;
+}
+
+// Find the DM that steps a drive. This is either the drive's own DM, or the DM of the extruder drive that steps it as a follower.
+DriveMovement *DDA::FindSteppingDM(size_t drive) const
+{
+	DriveMovement * const pdm = FindDM(drive);
+	if (pdm == nullptr)
+	{
+		for (DriveMovement *p : pddm)
+		{
+			if (p != nullptr && IsBitSet(p->followerDrives, drive))
+			{
+				return p;
+			}
+		}
+	}
+	return pdm;
+}
+
+// Allocate the DMs for the drives that this move uses. Called from Prepare, before the values that are needed only before Prepare is called are overwritten.
+// The first few DMs come from a DM block if one is available, the rest from the DM free list.
+// An extruder drive that will step identically to one that already has a DM doesn't get a DM of its own. Instead it is stepped by that DM as a follower.
+// Move::Spin checks that there are enough free DMs before it prepares a move.
+void DDA::AllocateDMs()
+{
+	const Platform& platform = reprap.GetPlatform();
+	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+	const bool canUseFollowers = !isLeadscrewAdjustmentMove && endStopsToCheck == 0;	// followers can't be stopped individually
+	dmBlock = DriveMovementBlock::Allocate();
+	size_t numBlockDmsUsed = 0;
+	for (size_t drive = (isExtruderOnlyMove) ? numAxes : 0; drive < DRIVES; ++drive)
+	{
+		if (IsDriveMoving(drive))
+		{
+			const int32_t delta = netSteps[drive];
+			if (canUseFollowers && drive >= numAxes)
+			{
+				DriveMovement * const leader = FindLockstepExtruderDM(drive, numAxes);
+				if (leader != nullptr)
+				{
+					leader->followerDrives |= 1u << drive;
+					leader->driversBitmap |= platform.GetDriversBitmap(drive);
+					continue;
+				}
+			}
+
+			const size_t dmDrive = (isLeadscrewAdjustmentMove) ? drive + DRIVES : drive;
+			DriveMovement* pdm;
+			if (dmBlock != nullptr && numBlockDmsUsed < DriveMovementBlock::DMsPerBlock)
+			{
+				pdm = dmBlock->GetDM(numBlockDmsUsed++);
+				pdm->SetUp(dmDrive, DMState::moving);
+			}
+			else
+			{
+				pdm = DriveMovement::Allocate(dmDrive, DMState::moving);
+			}
+			pdm->totalSteps = labs(delta);				// for now this is the number of net steps, but gets adjusted later if there is a reverse in direction
+			pdm->direction = (delta >= 0);				// for now this is the direction of net movement, but gets adjusted later if it is a delta movement
+			pdm->driversBitmap = platform.GetDriversBitmap(dmDrive);
+			pdm->followerDrives = 0;
+			pdm->microstepShift = 0;
+#if SUPPORT_MICROSTEP_SWITCHING
+			pdm->microstepRemainder = 0;
+#endif
+			pddm[drive] = pdm;
+		}
+	}
+}
+
+#if SUPPORT_MICROSTEP_SWITCHING
+
+// Decide which axes this move steps with reduced microstepping, and reduce the steps of their DMs to suit. Called from Prepare after the DMs have been allocated.
+// Move can only change the microstepping of the drivers between moves and while the motors are stopped, so we only do this for long moves that start and end at rest.
+// The steps that are left over when we divide the number of steps by the reduction factor are made at normal microstepping before the move starts.
+void DDA::ReduceMicrostepping()
+{
+	const Move& move = reprap.GetMove();
+	if (   isPrintingMove || endStopsToCheck != 0 || isLeadscrewAdjustmentMove || isDeltaMovement
+		|| startSpeed != 0.0 || endSpeed != 0.0 || clocksNeeded < move.GetMinReducedMicrostepClocks()
+	   )
+	{
+		return;
+	}
+
+	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t axis = 0; axis < numAxes; ++axis)
+	{
+		DriveMovement * const pdm = pddm[axis];
+		if (pdm != nullptr)
+		{
+			const unsigned int shift = move.GetMicrostepReduction(axis);
+			if (shift != 0 && (pdm->totalSteps >> shift) != 0)
+			{
+				pdm->microstepShift = shift;
+				pdm->microstepRemainder = (uint8_t)(pdm->totalSteps & ((1u << shift) - 1));
+				pdm->totalSteps >>= shift;
+				SetBit(reducedMicrostepAxes, axis);
+				if (pdm->microstepRemainder != 0)
+				{
+					SetBit(microstepRemainderAxes, axis);
+				}
+			}
+		}
+	}
+}
+
+// Make the steps at normal microstepping that the reduced axes of this move need in addition to their reduced steps.
+// Called by Move before it starts this move, with the step interrupt disabled and all the drivers of these axes set to normal microstepping.
+void DDA::MakeMicrostepRemainderSteps()
+{
+	constexpr uint32_t RemainderStepClocks = (100 * StepClockRate)/1000000;		// make the steps slowly enough to start and stop without ramping (100us)
+
+	Platform& platform = reprap.GetPlatform();
+	uint32_t driversStepping[(1u << MaxMicrostepReductionShift) - 1];			// the drivers to step at each of the remainder steps
+	for (uint32_t& d : driversStepping)
+	{
+		d = 0;
+	}
+	for (AxesBitmap axes = microstepRemainderAxes; axes != 0; axes &= axes - 1)
+	{
+		const DriveMovement * const pdm = pddm[__builtin_ctz(axes)];
+		pdm->SetDirectionPins();
+		for (unsigned int i = 0; i < pdm->microstepRemainder; ++i)
+		{
+			driversStepping[i] |= pdm->driversBitmap;
+		}
+	}
+
+	for (uint32_t d : driversStepping)
+	{
+		if (d == 0)
+		{
+			break;
+		}
+		uint32_t stepTime = Platform::GetInterruptClocks();
+		while (Platform::GetInterruptClocks() - stepTime < RemainderStepClocks) {}
+		const irqflags_t flags = cpu_irq_save();
+		Platform::StepDriversHigh(d);
+		const uint32_t stepHighClocks = ((d & platform.GetSlowDriversBitmap()) != 0) ? platform.GetSlowDriverStepHighClocks() : 2;
+		stepTime = Platform::GetInterruptClocks();
+		while (Platform::GetInterruptClocks() - stepTime < stepHighClocks) {}
+		Platform::StepDriversLow();
+		cpu_irq_restore(flags);
+	}
+	microstepRemainderAxes = 0;
+}
+
+#endif
+
 // Prepare this DDA for execution.
 // This must not be called with interrupts disabled, because it calls Platform::EnableDrive.
-void DDA::Prepare(uint8_t simMode)
+void DDA::Prepare(uint8_t simMode, bool prepareDMs)
 {
+	const uint32_t prepareStartCycles = StageTimer::GetCycles();
 	if (   xyMoving
 		&& reprap.GetMove().IsDRCenabled()
 		&& topSpeed > startSpeed && topSpeed > endSpeed
@@ -1183,18 +1450,37 @@ void DDA::Prepare(uint8_t simMode)
 	}
 
 #if SUPPORT_LASER
-	if (topSpeed < requestedSpeed && reprap.GetGCodes().GetMachineType() == MachineType::laser)
+	scaleLaserPower = false;
+	if (reprap.GetGCodes().GetMachineType() == MachineType::laser)
 	{
-		// Scale back the laser power according to the actual speed
-		laserPwmOrIoBits.laserPwm = (laserPwmOrIoBits.laserPwm * topSpeed)/requestedSpeed;
+		if (topSpeed < requestedSpeed)
+		{
+			// Scale back the laser power according to the actual speed
+			laserPwmOrIoBits.laserPwm = (laserPwmOrIoBits.laserPwm * topSpeed)/requestedSpeed;
+		}
+
+		// If asked to, have the step ISR reduce the power further while we are going slower than the top speed
+		scaleLaserPower = reprap.GetGCodes().LaserPowerFollowsSpeed() && laserPwmOrIoBits.laserPwm != 0 && (startSpeed < topSpeed || endSpeed < topSpeed);
 	}
 #endif
 
 	PrepParams params;
 	params.decelStartDistance = totalDistance - decelDistance;
+#if SUPPORT_MICROSTEP_SWITCHING
+	reducedMicrostepAxes = microstepRemainderAxes = 0;
+#endif
 
-	if (simMode == 0)
+	// When simulating we only need the move time, which lookahead has already calculated, so we don't allocate or prepare any DMs unless we are benchmarking
+	if (prepareDMs)
 	{
+		AllocateDMs();
+#if SUPPORT_MICROSTEP_SWITCHING
+		if (simMode == 0)
+		{
+			ReduceMicrostepping();
+		}
+#endif
+
 		if (isDeltaMovement)
 		{
 			// This code assumes that the previous move in the DDA ring is the previously-executed move, because it fetches the X and Y end coordinates from that move.
@@ -1217,19 +1503,67 @@ void DDA::Prepare(uint8_t simMode)
 		params.topSpeedTimesCdivD = (uint32_t)roundU32((topSpeed * StepClockRate)/deceleration);
 		topSpeedTimesCdivDPlusDecelStartClocks = params.topSpeedTimesCdivD + (uint32_t)roundU32(decelStartTime * StepClockRate);
 		extraAccelerationClocks = roundS32((accelStopTime - (accelDistance/topSpeed)) * StepClockRate);
+		accelStopClocks = roundU32(accelStopTime * StepClockRate);
+		decelStartClocks = roundU32(decelStartTime * StepClockRate);
 		params.compFactor = (topSpeed - startSpeed)/topSpeed;
 
-		firstDM = nullptr;
+#if USE_FIXED_POINT_PREPARE
+		// Calculate the parameters that PrepareCartesianAxis needs once per move, so that it can use integer arithmetic
+		{
+			const float recipTotalDistance = 1.0/totalDistance;
+			params.twoCsquaredTimesTotalDistanceDivA = roundU64(((float)(StepClockRateSquared * 2) * totalDistance)/acceleration);
+			params.twoCsquaredTimesTotalDistanceDivD = roundU64(((float)(StepClockRateSquared * 2) * totalDistance)/deceleration);
+			params.totalDistanceTimesCKdivTopSpeed = roundU64(((float)((uint64_t)StepClockRate * DriveMovement::K1) * totalDistance)/topSpeed);
+			params.twoDistanceToStopTimesCsquaredDivD = isquare64(params.topSpeedTimesCdivD)
+														+ roundU64((params.decelStartDistance * (float)(StepClockRateSquared * 2))/deceleration);
+			params.accelFraction = fractionToQ31(accelDistance * recipTotalDistance);
+			params.decelFraction = fractionToQ31(decelDistance * recipTotalDistance);
+			params.decelStartFraction = fractionToQ31(params.decelStartDistance * recipTotalDistance);
+		}
+#endif
+
+#if SUPPORT_INPUT_SHAPING
+		if (xyMoving && endStopsToCheck == 0 && !isLeadscrewAdjustmentMove && reprap.GetMove().GetShaper().IsShaping())
+		{
+			PlanShapedProfile();
+		}
+#endif
+
+		// With smoothed pressure advance, the extruder is advanced by K times the speed averaged over the smoothing time, instead of K times the instantaneous speed.
+		// We apply the change in the advance during this move by scaling the extrusion, so the extruder never has to jump in speed at
+		// acceleration changes and we don't need to limit the acceleration to keep those jumps within the extruder jerk limit.
+		// We never reduce the extrusion to zero, because the extruder DM needs a nonzero step rate.
+		constexpr float MinSmoothedExtrusionFactor = 0.1;
+		const float smoothingTime = reprap.GetPlatform().GetPressureAdvanceSmoothingTime();
+		const bool smoothedPressureAdvance = usePressureAdvance && smoothingTime > 0.0;
+		float prevSmoothedSpeed = 0.0;
+		if (smoothedPressureAdvance)
+		{
+			prevSmoothedSpeed = (prev->usePressureAdvance) ? prev->smoothedSpeed : 0.0;
+			const float moveTime = (float)clocksNeeded * (1.0/StepClockRate);
+			smoothedSpeed = (endSpeed <= 0.0)
+							? 0.0											// we are stopping, so let the pressure fall
+							: prevSmoothedSpeed + ((totalDistance/moveTime) - prevSmoothedSpeed) * (1.0 - expf(-moveTime/smoothingTime));
+		}
+		else
+		{
+			smoothedSpeed = 0.0;
+		}
+
+		ClearActiveDMs();
 
 		const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
-		for (size_t drive = 0; drive < DRIVES; ++drive)
+		for (size_t drive = (isExtruderOnlyMove) ? numAxes : 0; drive < DRIVES; ++drive)
 		{
 			DriveMovement* const pdm = FindDM(drive);
 			if (pdm != nullptr && pdm->state == DMState::moving)
 			{
 				if (isLeadscrewAdjustmentMove)
 				{
-					reprap.GetPlatform().EnableDrive(Z_AXIS);			// ensure all Z motors are enabled
+					if (simMode == 0)
+					{
+						reprap.GetPlatform().EnableDrive(Z_AXIS);		// ensure all Z motors are enabled
+					}
 					pdm->PrepareCartesianAxis(*this, params);
 
 					// Check for sensible values, print them if they look dubious
@@ -1240,7 +1574,14 @@ void DDA::Prepare(uint8_t simMode)
 				}
 				else
 				{
-					reprap.GetPlatform().EnableDrive(drive);
+					if (simMode == 0)
+					{
+						reprap.GetPlatform().EnableDrive(drive);
+						for (uint32_t followers = pdm->followerDrives; followers != 0; followers &= followers - 1)
+						{
+							reprap.GetPlatform().EnableDrive(__builtin_ctz(followers));
+						}
+					}
 					if (drive >= numAxes)
 					{
 						// If there is any extruder jerk in this move, in theory that means we need to instantly extrude or retract some amount of filament.
@@ -1255,7 +1596,16 @@ void DDA::Prepare(uint8_t simMode)
 						{
 							speedChange = 0.0;
 						}
-						pdm->PrepareExtruder(*this, params, speedChange, usePressureAdvance);
+						if (smoothedPressureAdvance && directionVector[drive] > 0.0)
+						{
+							// The extra extrusion is K * (change in smoothed speed) * directionVector[drive], relative to an extrusion of totalDistance * directionVector[drive]
+							const float advanceChange = reprap.GetPlatform().GetPressureAdvance(drive - numAxes) * (smoothedSpeed - prevSmoothedSpeed);
+							pdm->PrepareExtruder(*this, params, 0.0, false, max<float>(1.0 + advanceChange/totalDistance, MinSmoothedExtrusionFactor));
+						}
+						else
+						{
+							pdm->PrepareExtruder(*this, params, speedChange, usePressureAdvance && !smoothedPressureAdvance, 1.0);
+						}
 
 						// Check for sensible values, print them if they look dubious
 						if (reprap.Debug(moduleDda)
@@ -1303,6 +1653,14 @@ void DDA::Prepare(uint8_t simMode)
 				if (stepsToDo)
 				{
 					InsertDM(pdm);
+#if SUPPORT_STEP_TABLES
+					// If this drive will step fast enough to need multiple stepping, precompute the step times so that the ISR doesn't have to.
+					// Don't do this if we are checking endstops, because the ISR may change the speed or stop the drive.
+					if (endStopsToCheck == 0 && clocksNeeded < pdm->totalSteps * MinCalcIntervalCartesian)
+					{
+						(void)pdm->AttachStepTable(*this, isDeltaMovement && drive < DELTA_AXES);
+					}
+#endif
 				}
 				else
 				{
@@ -1332,9 +1690,60 @@ void DDA::Prepare(uint8_t simMode)
 #endif
 	}
 
+	reprap.GetMove().RecordPrepareTime(StageTimer::GetCycles() - prepareStartCycles);
 	state = frozen;					// must do this last so that the ISR doesn't start executing it before we have finished setting it up
 }
 
+#if SUPPORT_INPUT_SHAPING
+
+// Try to give this move a shaped motion profile. Called from Prepare.
+void DDA::PlanShapedProfile()
+{
+	shapedProfile = reprap.GetMove().GetShaper().PlanMove(startSpeed, topSpeed, endSpeed, acceleration, deceleration, accelDistance, decelDistance, totalDistance);
+	if (shapedProfile != nullptr)
+	{
+		// The DMs can't do a reverse phase for extruders when following a shaped profile, so check that pressure advance won't need one.
+		// Smoothed pressure advance never needs a reverse phase.
+		if (usePressureAdvance && reprap.GetPlatform().GetPressureAdvanceSmoothingTime() <= 0.0)
+		{
+			const Platform& platform = reprap.GetPlatform();
+			const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+			for (size_t drive = numAxes; drive < DRIVES; ++drive)
+			{
+				const DriveMovement * const pdm = FindDM(drive);
+				if (   pdm != nullptr && pdm->state == DMState::moving && directionVector[drive] > 0.0
+					&& !shapedProfile->AllowsPressureAdvance(platform.GetPressureAdvance(drive - numAxes) * (float)StepClockRate)
+				   )
+				{
+					ShapedProfile::Release(shapedProfile);
+					shapedProfile = nullptr;
+					return;
+				}
+			}
+		}
+		clocksNeeded = (uint32_t)shapedProfile->GetEndTime() + 1;
+	}
+}
+
+#endif
+
+#if SUPPORT_STEP_TABLES
+
+// Top up the step tables of this DDA. Called from Move::Spin while the DDA is executing.
+void DDA::RefillStepTables()
+{
+	for (size_t drive = 0; drive < DRIVES; ++drive)
+	{
+		DriveMovement* const pdm = pddm[drive];
+		if (pdm != nullptr && pdm->HasStepTable())
+		{
+			pdm->RefillStepTable(*this, isDeltaMovement && drive < DELTA_AXES);
+		}
+	}
+}
+
+#endif
+
 // Take a unit positive-hyperquadrant vector, and return the factor needed to obtain
 // length of the vector as projected to touch box[].
 /*static*/ float DDA::VectorBoxIntersection(const float v[], const float box[], size_t dimensions)
@@ -1406,6 +1815,57 @@ float DDA::NormaliseXYZ()
 	return magnitude;
 }
 
+// Get the XYZ direction of an XY move whose direction vector has been normalised by NormaliseXYZ.
+// If there is more than one X or Y axis, take an average of their movements (they should be equal).
+void DDA::GetXYZDirection(float dir[3]) const
+{
+	float x = 0.0, y = 0.0;
+	unsigned int numXaxes = 0, numYaxes = 0;
+	for (size_t d = 0; d < MaxAxes; ++d)
+	{
+		if (IsBitSet(xAxes, d))
+		{
+			x += directionVector[d];
+			++numXaxes;
+		}
+		if (IsBitSet(yAxes, d))
+		{
+			y += directionVector[d];
+			++numYaxes;
+		}
+	}
+	dir[0] = (numXaxes > 1) ? x/numXaxes : x;
+	dir[1] = (numYaxes > 1) ? y/numYaxes : y;
+	dir[2] = directionVector[Z_AXIS];
+}
+
+// Return the maximum speed at which we can pass through the junction between this move and the next one, using the junction deviation model.
+// The path is assumed to follow a circular arc that is tangent to both moves and passes within junctionDeviation of the corner, and the speed
+// is limited so that the centripetal acceleration on that arc doesn't exceed the acceleration of the moves: v^2 = a * r where
+// r = junctionDeviation * sin(theta/2)/(1 - sin(theta/2)). On finely tessellated curves this gives a speed that depends on the curvature
+// instead of on the number of segments per unit length.
+float DDA::GetJunctionSpeedLimit(float junctionDeviation) const
+{
+	float thisDir[3], nextDir[3];
+	GetXYZDirection(thisDir);
+	next->GetXYZDirection(nextDir);
+
+	// theta is the angle between the reversed direction of this move and the direction of the next one, so it is Pi for a straight line
+	const float cosTheta = -(thisDir[0] * nextDir[0] + thisDir[1] * nextDir[1] + thisDir[2] * nextDir[2]);
+	if (cosTheta <= -0.999999)
+	{
+		return requestedSpeed;							// the moves are in a straight line
+	}
+	if (cosTheta >= 0.999999)
+	{
+		return 0.0;										// full reversal
+	}
+
+	const float sinHalfTheta = sqrtf(0.5 * (1.0 - cosTheta));
+	const float junctionAcceleration = min<float>(deceleration, next->acceleration);
+	return sqrtf(junctionAcceleration * junctionDeviation * sinHalfTheta/(1.0 - sinHalfTheta));
+}
+
 // Return the magnitude of a vector
 /*static*/ float DDA::Magnitude(const float v[], size_t dimensions)
 {
@@ -1444,8 +1904,11 @@ void DDA::CheckEndstops(Platform& platform)
 		switch (platform.GetZProbeResult())
 		{
 		case EndStopHit::lowHit:
-			MoveAborted();											// set the state to completed and recalculate the endpoints
-			reprap.GetGCodes().MoveStoppedByZProbe();
+			{
+				const float zOvershoot = GetZProbeOvershoot(platform);	// must do this before we abort the move
+				MoveAborted();										// set the state to completed and recalculate the endpoints
+				reprap.GetGCodes().MoveStoppedByZProbe(zOvershoot);
+			}
 			return;
 
 		case EndStopHit::nearStop:
@@ -1558,6 +2021,24 @@ pre(state == frozen)
 	moveStartTime = tim;
 	state = executing;
 
+#if SUPPORT_ENDSTOP_INTERRUPTS
+	if (endStopsToCheck != 0)
+	{
+		Platform& platform = reprap.GetPlatform();
+		pollEndstops = !platform.GetUseEndstopInterrupts()
+						|| (endStopsToCheck & (UseSpecialEndstop | LogProbeChanges)) != 0
+						|| ((endStopsToCheck & ZProbeActive) != 0 && !platform.ZProbeHasInterrupt());
+		for (size_t drive = 0; drive < DRIVES && !pollEndstops; ++drive)
+		{
+			if (IsBitSet(endStopsToCheck, drive) && !platform.EndstopHasInterrupt(drive))
+			{
+				pollEndstops = true;
+			}
+		}
+		platform.SetEndstopChanged();								// make sure we check the endstops once before we step, in case one is already triggered
+	}
+#endif
+
 #if DDA_LOG_PROBE_CHANGES
 	if ((endStopsToCheck & LogProbeChanges) != 0)
 	{
@@ -1566,15 +2047,21 @@ pre(state == frozen)
 	}
 #endif
 
-	if (firstDM != nullptr)
+	if (FirstDM() != nullptr)
 	{
 
 #if SUPPORT_LASER
 		// Deal with laser power
 		if (reprap.GetGCodes().GetMachineType() == MachineType::laser)
 		{
-			// Ideally we should ramp up the laser power as the machine accelerates, but for now we don't.
-			reprap.GetPlatform().SetLaserPwm(laserPwmOrIoBits.laserPwm);
+#if SUPPORT_LASER_RASTER
+			if (laserRaster != nullptr)
+			{
+				StartRaster();
+			}
+#endif
+			nextLaserUpdateClocks = LaserPowerUpdateInterval;
+			SetLaserPower(0);
 		}
 #endif
 
@@ -1586,16 +2073,17 @@ pre(state == frozen)
 			if (pdm != nullptr && pdm->state == DMState::moving)
 			{
 				const size_t drive = pdm->drive;
-				reprap.GetPlatform().SetDirection(drive, pdm->direction);
+				pdm->SetDirectionPins();
 				if (drive >= numAxes)
 				{
+					const unsigned int extruders = ((1u << i) | pdm->followerDrives) >> numAxes;
 					if (pdm->direction == FORWARDS)
 					{
-						extrusions |= (1 << (i - numAxes));
+						extrusions |= extruders;
 					}
 					else
 					{
-						retractions |= (1 << (i - numAxes));
+						retractions |= extruders;
 					}
 				}
 			}
@@ -1605,6 +2093,39 @@ pre(state == frozen)
 		if (extrusions != 0 || retractions != 0)
 		{
 			const unsigned int prohibitedMovements = reprap.GetProhibitedExtruderMovements(extrusions, retractions);
+
+			// Follower drives are not in the DM list, so stop any prohibited ones by removing their step bits from their leader's DM
+			for (size_t i = numAxes; i < DRIVES; ++i)
+			{
+				DriveMovement* const pdm = FindDM(i);
+				if (pdm != nullptr)
+				{
+					for (uint32_t followers = pdm->followerDrives; followers != 0; followers &= followers - 1)
+					{
+						const size_t follower = __builtin_ctz(followers);
+						if ((prohibitedMovements & (1 << (follower - numAxes))) != 0)
+						{
+							pdm->driversBitmap &= ~reprap.GetPlatform().GetDriversBitmap(follower);
+						}
+					}
+				}
+			}
+#if USE_DM_HEAP
+			for (size_t pos = 0; pos < numActiveDrives; )
+			{
+				const size_t drive = pddm[activeDrives[pos]]->drive;
+				const bool thisDriveExtruding = drive >= numAxes && drive < DRIVES;
+				if (thisDriveExtruding && (prohibitedMovements & (1 << (drive - numAxes))) != 0)
+				{
+					RemoveDM(drive);								// this moves another entry into this position, or one that we have already checked
+				}
+				else
+				{
+					extruding = extruding || thisDriveExtruding;
+					++pos;
+				}
+			}
+#else
 			for (DriveMovement **dmpp = &firstDM; *dmpp != nullptr; )
 			{
 				const size_t drive = (*dmpp)->drive;
@@ -1619,6 +2140,7 @@ pre(state == frozen)
 					dmpp = &((*dmpp)->nextDM);
 				}
 			}
+#endif
 		}
 
 		Platform& platform = reprap.GetPlatform();
@@ -1631,9 +2153,10 @@ pre(state == frozen)
 			platform.ExtrudeOff();
 		}
 
-		if (firstDM != nullptr)
+		const DriveMovement * const dm = FirstDM();
+		if (dm != nullptr)
 		{
-			return platform.ScheduleStepInterrupt(firstDM->nextStepTime + moveStartTime);
+			return platform.ScheduleStepInterrupt(dm->nextStepTime + moveStartTime);
 		}
 	}
 
@@ -1642,7 +2165,14 @@ pre(state == frozen)
 }
 
 unsigned int DDA::numHiccups = 0;
+uint32_t DDA::totalHiccups = 0;
+uint32_t DDA::stepMergeWindow = DDA::MinInterruptInterval;
+uint32_t DDA::numStepEvents = 0;
+uint32_t DDA::numStepsGenerated = 0;
 uint32_t DDA::lastStepLowTime = 0;
+#if SUPPORT_LASER
+uint32_t DDA::nextLaserUpdateClocks = 0;
+#endif
 uint32_t DDA::lastDirChangeTime = 0;
 
 // This is called by the interrupt service routine to execute steps.
@@ -1660,7 +2190,11 @@ bool DDA::Step()
 		// Keep this loop as fast as possible, in the case that there are no endstops to check!
 
 		// 1. Check endstop switches and Z probe if asked. This is not speed critical because fast moves do not use endstops or the Z probe.
-		if (endStopsToCheck != 0)										// if any homing switches or the Z probe is enabled in this move
+		if (endStopsToCheck != 0										// if any homing switches or the Z probe is enabled in this move
+#if SUPPORT_ENDSTOP_INTERRUPTS
+			&& (pollEndstops || platform.CheckEndstopChanged())			// and the inputs need polling or one of them has changed
+#endif
+		   )
 		{
 			CheckEndstops(platform);	// Call out to a separate function because this may help cache usage in the more common case where we don't call it
 			if (state == completed)		// we may have completed the move due to triggering an endstop switch or Z probe
@@ -1675,19 +2209,41 @@ bool DDA::Step()
 		{
 			isrStartTime = iClocks;		// first time through, so make a note of the ISR start time
 		}
-		const uint32_t elapsedTime = (iClocks - moveStartTime) + MinInterruptInterval;
-		DriveMovement* dm = firstDM;
+		//    All drives whose steps are due within the merge window are stepped together, so that near-coincident steps don't need separate interrupts.
+		const uint32_t elapsedTime = (iClocks - moveStartTime) + stepMergeWindow;
 		uint32_t driversStepping = 0;
+#if USE_DM_HEAP
+		DriveMovement *dueDMs[DRIVES];
+		size_t numDue = 0;
+		while (numActiveDrives != 0 && elapsedTime >= HeapStepTime(0))	// if the next step is due
+		{
+			DriveMovement * const dm = PopFirstDM();
+			driversStepping |= dm->driversBitmap;
+			dueDMs[numDue++] = dm;
+			++numStepsGenerated;
+		}
+#else
+		DriveMovement* dm = firstDM;
 		while (dm != nullptr && elapsedTime >= dm->nextStepTime)		// if the next step is due
 		{
-			driversStepping |= platform.GetDriversBitmap(dm->drive);
+			driversStepping |= dm->driversBitmap;
 			dm = dm->nextDM;
+			++numStepsGenerated;
 
 //uint32_t t3 = Platform::GetInterruptClocks() - t2;
 //if (t3 > maxCalcTime) maxCalcTime = t3;
 //if (t3 < minCalcTime) minCalcTime = t3;
 		}
+#endif
 
+		// 2a. Add or remove babysteps on the Z motors
+		Move& move = reprap.GetMove();
+		if (move.HasBabyStepsPending() && CanBabyStep())
+		{
+			driversStepping = move.AddBabySteps(this, driversStepping, Platform::GetInterruptClocks());
+		}
+
+		++numStepEvents;
 		if ((driversStepping & platform.GetSlowDriversBitmap()) == 0)	// if not using any external drivers
 		{
 			// 3. Step the drivers
@@ -1714,6 +2270,19 @@ bool DDA::Step()
 		// 4. Remove those drives from the list, calculate the next step times, update the direction pins where necessary,
 		//    and re-insert them so as to keep the list in step-time order.
 		//    Note that the call to CalcNextStepTime may change the state of Direction pin.
+#if USE_DM_HEAP
+		for (size_t i = 0; i < numDue; ++i)
+		{
+			DriveMovement * const dmToInsert = dueDMs[i];
+			const bool hasMoreSteps = (isDeltaMovement && dmToInsert->drive < DELTA_AXES)
+					? dmToInsert->CalcNextStepTimeDelta(*this, true)
+					: dmToInsert->CalcNextStepTimeCartesian(*this, true);
+			if (hasMoreSteps)
+			{
+				InsertDM(dmToInsert);
+			}
+		}
+#else
 		DriveMovement *dmToInsert = firstDM;							// head of the chain we need to re-insert
 		firstDM = dm;													// remove the chain from the list
 		while (dmToInsert != dm)										// note that both of these may be nullptr
@@ -1728,19 +2297,36 @@ bool DDA::Step()
 			}
 			dmToInsert = nextToInsert;
 		}
+#endif
+
+#if SUPPORT_LASER
+		// 4a. Update the laser power if we have moved into the next pixel of a raster move, or it is time to scale it to the speed again
+# if SUPPORT_LASER_RASTER
+		if (laserRaster != nullptr)
+		{
+			UpdateRasterPower(iClocks - moveStartTime);
+		}
+		else
+# endif
+		if (scaleLaserPower && iClocks - moveStartTime >= nextLaserUpdateClocks)
+		{
+			SetLaserPower(iClocks - moveStartTime);
+		}
+#endif
 
 		// 5. Reset all step pins low. We already did this if we are using any external drivers, but doing it again does no harm.
 		Platform::StepDriversLow();										// set all step pins low
 
 		// 6. Check for move completed
-		if (firstDM == nullptr)
+		const DriveMovement * const firstDue = FirstDM();
+		if (firstDue == nullptr)
 		{
 			state = completed;
 			break;
 		}
 
 		// 7. Check whether we have been in this ISR for too long already and need to take a break
-		uint32_t nextStepDue = firstDM->nextStepTime + moveStartTime;
+		uint32_t nextStepDue = firstDue->nextStepTime + moveStartTime;
 		const uint32_t clocksTaken = (Platform::GetInterruptClocks16() - isrStartTime) & 0x0000FFFF;
 		if (clocksTaken >= DDA::MaxStepInterruptTime && (nextStepDue - isrStartTime) < (clocksTaken + DDA::MinInterruptInterval))
 		{
@@ -1749,6 +2335,7 @@ bool DDA::Step()
 			moveStartTime += delayClocks;
 			nextStepDue += delayClocks;
 			++numHiccups;
+			++totalHiccups;
 			hadHiccup = true;
 		}
 
@@ -1769,6 +2356,141 @@ bool DDA::Step()
 	return false;
 }
 
+// Calculate the times of all the steps of a prepared move in turn, as the step ISR would but without stepping the motors, and record the execution time of each calculation.
+// Also compare the calculated step times with the exact times for the motion profile, to measure the error introduced by the fixed point calculations,
+// the rounding mode and the way we spread out the steps when we calculate several at a time. We can only do that for drives that move in proportion to
+// the distance along the move, so we don't check delta towers, extruders or moves that use input shaping.
+// This is called when benchmarking a simulation (M37 B1), just before the move is treated as complete.
+void DDA::MeasureStepGeneration(StageTimer& timer, uint32_t& numStepsChecked, uint64_t& totalError, uint32_t& maxError)
+{
+	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t drive = 0; drive < DRIVES; ++drive)
+	{
+		DriveMovement * const dm = FindDM(drive);
+		if (dm == nullptr || dm->state != DMState::moving)
+		{
+			continue;
+		}
+
+		const bool isDeltaDrive = isDeltaMovement && drive < DELTA_AXES;
+		bool checkError = !isDeltaDrive && drive < numAxes && dm->totalSteps != 0 && dm->reverseStartStep > dm->totalSteps;
+#if SUPPORT_INPUT_SHAPING
+		if (shapedProfile != nullptr)
+		{
+			checkError = false;
+		}
+#endif
+		const float distancePerStep = (checkError) ? totalDistance/(float)dm->totalSteps : 0.0;
+		bool moreSteps;
+		do
+		{
+			if (checkError)
+			{
+				const int32_t error = (int32_t)dm->nextStepTime - lrintf(IdealClocksToDistance(distancePerStep * (float)dm->nextStep));
+				const uint32_t absError = (uint32_t)labs(error);
+				totalError += absError;
+				maxError = max<uint32_t>(maxError, absError);
+				++numStepsChecked;
+			}
+			const uint32_t startCycles = StageTimer::GetCycles();
+			moreSteps = (isDeltaDrive) ? dm->CalcNextStepTimeDelta(*this, false) : dm->CalcNextStepTimeCartesian(*this, false);
+			timer.Record(StageTimer::GetCycles() - startCycles);
+		} while (moreSteps);
+	}
+}
+
+// Return the time in step clocks from the start of the move at which the specified distance along it is reached, calculated from the speeds and distances
+float DDA::IdealClocksToDistance(float distance) const
+{
+	float seconds;
+	if (distance <= accelDistance)
+	{
+		seconds = (accelDistance == 0.0) ? 0.0 : (sqrtf(fsquare(startSpeed) + 2 * acceleration * distance) - startSpeed)/acceleration;
+	}
+	else
+	{
+		seconds = (accelDistance == 0.0) ? 0.0 : (topSpeed - startSpeed)/acceleration;
+		const float decelStartDistance = totalDistance - decelDistance;
+		if (distance <= decelStartDistance)
+		{
+			seconds += (distance - accelDistance)/topSpeed;
+		}
+		else
+		{
+			seconds += (decelStartDistance - accelDistance)/topSpeed
+						+ (topSpeed - sqrtf(max<float>(fsquare(topSpeed) - 2 * deceleration * (distance - decelStartDistance), 0.0)))/deceleration;
+		}
+	}
+	return seconds * StepClockRate;
+}
+
+#if SUPPORT_LASER_RASTER
+
+// Start a raster move. We track progress along the move using the axis motor that makes the most steps, so the pixels are equally spaced
+// whatever the speed profile is. Called from DDA::Start, which runs in the step ISR.
+void DDA::StartRaster()
+{
+	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+	uint32_t maxSteps = 0;
+	for (size_t drive = 0; drive < numAxes; ++drive)
+	{
+		const DriveMovement * const pdm = FindDM(drive);
+		if (pdm != nullptr && pdm->totalSteps > maxSteps)
+		{
+			maxSteps = pdm->totalSteps;
+			laserRaster->SetDrive(drive);
+		}
+	}
+	laserRaster->SetCurrentPixel(0);
+}
+
+// Set the laser power for the pixel we are in now. Called from the step ISR.
+void DDA::UpdateRasterPower(uint32_t clocksSinceStart)
+{
+	const DriveMovement * const pdm = FindDM(laserRaster->GetDrive());
+	if (pdm != nullptr && pdm->totalSteps != 0)
+	{
+		const uint32_t stepsDone = min<uint32_t>((pdm->nextStep == 0) ? 0 : pdm->nextStep - 1, pdm->totalSteps);
+		const size_t numPixels = laserRaster->NumPixels();
+		const size_t pixel = min<size_t>((stepsDone * numPixels)/pdm->totalSteps, numPixels - 1);
+		if (pixel != laserRaster->GetCurrentPixel())
+		{
+			laserRaster->SetCurrentPixel(pixel);
+			SetLaserPower(clocksSinceStart);
+		}
+		else if (scaleLaserPower && clocksSinceStart >= nextLaserUpdateClocks)
+		{
+			SetLaserPower(clocksSinceStart);
+		}
+	}
+}
+
+#endif
+
+#if SUPPORT_LASER
+
+// Set the laser power for the current pixel of a raster move, if it is one, scaled by the planned speed at this point in the move if we were asked to.
+// Called from DDA::Start and the step ISR.
+void DDA::SetLaserPower(uint32_t clocksSinceStart)
+{
+	uint32_t pwm = laserPwmOrIoBits.laserPwm;
+#if SUPPORT_LASER_RASTER
+	if (laserRaster != nullptr)
+	{
+		pwm = (pwm * laserRaster->GetPixel(laserRaster->GetCurrentPixel()))/255;
+	}
+#endif
+	if (scaleLaserPower)
+	{
+		const float speedFraction = min<float>(GetSpeedAt(clocksSinceStart)/topSpeed, 1.0);
+		pwm = (uint32_t)(pwm * speedFraction);
+		nextLaserUpdateClocks = clocksSinceStart + LaserPowerUpdateInterval;
+	}
+	reprap.GetPlatform().SetLaserPwm((Pwm_t)pwm);
+}
+
+#endif
+
 // Stop a drive and re-calculate the corresponding endpoint.
 // For extruder drivers, we need to be able to calculate how much of the extrusion was completed after calling this.
 void DDA::StopDrive(size_t drive)
@@ -1779,11 +2501,11 @@ void DDA::StopDrive(size_t drive)
 		pdm->state = DMState::idle;
 		if (drive < reprap.GetGCodes().GetTotalAxes())
 		{
-			endPoint[drive] -= pdm->GetNetStepsLeft();
+			endPoint[drive] -= pdm->GetNetStepsLeft() * (1 << pdm->microstepShift);	// any remainder steps were made before the move started
 			endCoordinatesValid = false;			// the XYZ position is no longer valid
 		}
 		RemoveDM(drive);
-		if (firstDM == nullptr)
+		if (FirstDM() == nullptr)
 		{
 			state = completed;
 		}
@@ -1839,6 +2561,150 @@ float DDA::GetProportionDone(bool moveWasAborted) const
 	return proportionDone;
 }
 
+// Return true if this move has not been started and we can shorten it so that the machine decelerates to rest within it.
+// We only do this to moves from the file being printed that we would be allowed to pause after, and only if it saves a worthwhile part of the move.
+bool DDA::CanTruncateForPause() const
+{
+	if (   (state != provisional && state != frozen)
+		|| !canPauseAfter || !endCoordinatesValid || isLeadscrewAdjustmentMove
+		|| filePos == noFilePosition || startSpeed <= 0.0
+#if SUPPORT_LASER
+		|| reprap.GetGCodes().GetMachineType() == MachineType::laser			// Prepare would scale the laser power a second time
+#endif
+	   )
+	{
+		return false;
+	}
+
+	constexpr float MaxTruncatedFraction = 0.9;								// don't bother if we would still do most of the move
+	const float stopDistance = fsquare(startSpeed)/(2 * max<float>(acceleration, deceleration));
+	return stopDistance < totalDistance * MaxTruncatedFraction;
+}
+
+// Change the requested speed of a provisional move because the M220 speed factor has changed, and recalculate its profile.
+// The caller must process the provisional moves in order, because each one starts at the new end speed of the previous one.
+// We never raise the end speed, and when slowing down we only lower it as far as we can while keeping the speeds at each junction
+// within what the previous move can decelerate to, so the moves after this one can always still slow down in time.
+void DDA::ChangeSpeedFactor(float ratio)
+pre(state == provisional)
+{
+	if (prev->state == provisional)
+	{
+		startSpeed = prev->endSpeed;
+	}
+	if (usesSpeedFactor)
+	{
+		float newRequestedSpeed = max<float>(requestedSpeed * ratio, MinimumMovementSpeed);
+		if (ratio > 1.0)
+		{
+			// Don't exceed the speed limits that Init applied
+			float normalisedDirectionVector[DRIVES];
+			memcpy(normalisedDirectionVector, directionVector, sizeof(normalisedDirectionVector));
+			Absolute(normalisedDirectionVector, DRIVES);
+			requestedSpeed = min<float>(newRequestedSpeed, VectorBoxIntersection(normalisedDirectionVector, reprap.GetPlatform().MaxFeedrates(), DRIVES));
+			reprap.GetMove().GetKinematics().LimitSpeedAndAcceleration(*this, normalisedDirectionVector);	// moves that use the speed factor always use motor mapping
+		}
+		else
+		{
+			requestedSpeed = newRequestedSpeed;
+		}
+	}
+
+	// The start speed may be higher than the new requested speed, in which case we hold it until we can decelerate
+	requestedSpeed = max<float>(requestedSpeed, startSpeed);
+	const float minEndSpeed = sqrtf(max<float>(fsquare(startSpeed) - 2 * deceleration * totalDistance, 0.0));
+	const float maxEndSpeed = sqrtf(fsquare(startSpeed) + 2 * acceleration * totalDistance);
+	endSpeed = min<float>(min<float>(endSpeed, requestedSpeed), maxEndSpeed);
+	if (ratio < 1.0 && usesSpeedFactor)
+	{
+		endSpeed = min<float>(endSpeed, max<float>(endSpeed * ratio, minEndSpeed));
+	}
+	endSpeed = max<float>(endSpeed, minEndSpeed);
+	targetNextSpeed = endSpeed;
+	RecalculateMove();
+}
+
+// Shorten this move so that it decelerates from its start speed to rest as quickly as it is allowed to, then prepare it again.
+// CanTruncateForPause must have returned true. The caller must make sure that the step ISR won't reach this move before we have finished,
+// and must discard all the moves after this one, because their start points are no longer correct.
+void DDA::TruncateForPause(uint8_t simMode, bool prepareDMs)
+{
+	if (state == frozen)
+	{
+		// Throw away what Prepare did, but not the speeds it was based on
+		state = provisional;
+		ReleaseDMs();
+#if SUPPORT_INPUT_SHAPING
+		if (shapedProfile != nullptr)
+		{
+			ShapedProfile::Release(shapedProfile);
+			shapedProfile = nullptr;
+		}
+#endif
+	}
+
+	const float decel = max<float>(acceleration, deceleration);
+	const float stopDistance = fsquare(startSpeed)/(2 * decel);
+	const float fraction = stopDistance/totalDistance;
+
+	// Move the end point back along the straight line in machine coordinates, then convert it to motor positions
+	const Move& move = reprap.GetMove();
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+	{
+		const float startCoordinate = prev->GetEndCoordinate(axis, false);
+		endCoordinates[axis] = startCoordinate + (endCoordinates[axis] - startCoordinate) * fraction;
+	}
+	int32_t newEndPoint[MaxAxes];
+	memcpy(newEndPoint, endPoint, sizeof(newEndPoint));					// the invisible axes stay where they were unless the kinematics moves them
+	if (move.CartesianToMotorSteps(endCoordinates, newEndPoint, true))
+	{
+		memcpy(endPoint, newEndPoint, sizeof(newEndPoint));
+	}
+	else
+	{
+		// We can't normally get here because the point is on a line between two points that we could transform, but just in case...
+		for (size_t axis = 0; axis < numTotalAxes; ++axis)
+		{
+			endPoint[axis] = prev->endPoint[axis] + lrintf((float)(endPoint[axis] - prev->endPoint[axis]) * fraction);
+		}
+		endCoordinatesValid = false;
+	}
+
+	const int32_t * const positionNow = prev->DriveCoordinates();
+	for (size_t drive = 0; drive < DRIVES; ++drive)
+	{
+		if (drive < numTotalAxes)
+		{
+			netSteps[drive] = endPoint[drive] - positionNow[drive];
+		}
+		else
+		{
+			// The endpoint of an extruder is the number of steps to extrude in this move
+			endPoint[drive] = lrintf((float)endPoint[drive] * fraction);
+			endCoordinates[drive] *= fraction;
+			netSteps[drive] = endPoint[drive];
+		}
+	}
+
+	// Scale the part of the multi-segment move that this segment represents
+	const float proportionDoneAtStart = (filePos == prev->filePos) ? 1.0 - prev->proportionLeft : 0.0;
+	proportionLeft = 1.0 - (proportionDoneAtStart + (1.0 - proportionLeft - proportionDoneAtStart) * fraction);
+
+	// Make it a deceleration-only move
+	totalDistance = stopDistance;
+	deceleration = decel;
+	topSpeed = startSpeed;
+	endSpeed = 0.0;
+	accelDistance = 0.0;
+	decelDistance = stopDistance;
+	canPauseAfter = true;
+	clocksNeeded = (uint32_t)((startSpeed/deceleration) * StepClockRate);
+
+	Prepare(simMode, prepareDMs);
+}
+
 // Reduce the speed of this move to the indicated speed.
 // This is called from the ISR, so interrupts are disabled and nothing else can mess with us.
 // As this is only called for homing moves and with very low speeds, we assume that we don't need acceleration or deceleration phases.
@@ -1872,6 +2738,39 @@ void DDA::ReduceHomingSpeed()
 	}
 }
 
+// Return the planned speed at the specified time after the start of the move.
+// If we have reduced the speed because the Z probe is near its threshold then the original profile no longer applies, but probing moves are mostly steady speed so we use the reduced top speed.
+float DDA::GetSpeedAt(uint32_t clocksSinceStart) const
+{
+	if (goingSlow || (clocksSinceStart >= accelStopClocks && clocksSinceStart < decelStartClocks))
+	{
+		return topSpeed;
+	}
+	if (clocksSinceStart < accelStopClocks)
+	{
+		return startSpeed + (acceleration * (float)clocksSinceStart)/StepClockRate;
+	}
+	return max<float>(topSpeed - (deceleration * (float)(clocksSinceStart - decelStartClocks))/StepClockRate, endSpeed);
+}
+
+// Return how far the Z axis has moved since the Z probe input first crossed its threshold, or zero if the probe is not configured to interpolate the trigger position or we don't know when it triggered.
+// The averaging filters delay the probe result by several ticks, so the step count when the filtered reading reaches the threshold overstates how far Z had travelled when the probe really triggered.
+// We correct for this by integrating the planned speed over the interval between the timestamped raw trigger and now. Called from the step ISR.
+float DDA::GetZProbeOvershoot(const Platform& platform) const
+{
+	uint32_t triggerTime;
+	if (!platform.GetZProbeTriggerTime(triggerTime))
+	{
+		return 0.0;
+	}
+
+	const uint32_t clocksSinceStart = Platform::GetInterruptClocks() - moveStartTime;
+	const int32_t triggerOffset = (int32_t)(triggerTime - moveStartTime);
+	const uint32_t triggerClocksSinceStart = (triggerOffset < 0) ? 0 : min<uint32_t>((uint32_t)triggerOffset, clocksSinceStart);	// if the raw reading crossed the threshold before this move started, count from the start
+	const float distanceMoved = (GetSpeedAt(triggerClocksSinceStart) + GetSpeedAt(clocksSinceStart)) * 0.5 * (float)(clocksSinceStart - triggerClocksSinceStart)/StepClockRate;
+	return distanceMoved * directionVector[Z_AXIS];
+}
+
 bool DDA::HasStepError() const
 {
 #if 0	//debug
@@ -1896,6 +2795,20 @@ bool DDA::HasStepError() const
 bool DDA::Free()
 {
 	ReleaseDMs();
+#if SUPPORT_INPUT_SHAPING
+	if (shapedProfile != nullptr)
+	{
+		ShapedProfile::Release(shapedProfile);
+		shapedProfile = nullptr;
+	}
+#endif
+#if SUPPORT_LASER_RASTER
+	if (laserRaster != nullptr)
+	{
+		LaserRaster::Release(laserRaster);
+		laserRaster = nullptr;
+	}
+#endif
 	state = empty;
 	return hadLookaheadUnderrun;
 }
@@ -1903,13 +2816,13 @@ bool DDA::Free()
 // Return the number of net steps already taken in this move by a particular drive
 int32_t DDA::GetStepsTaken(size_t drive) const
 {
-	const DriveMovement * const dmp = FindDM(drive);
+	const DriveMovement * const dmp = FindSteppingDM(drive);
 	return (dmp != nullptr) ? dmp->GetNetStepsTaken() : 0;
 }
 
 bool DDA::IsNonPrintingExtruderMove(size_t drive) const
 {
-	return !isPrintingMove && FindDM(drive) != nullptr;
+	return !isPrintingMove && FindSteppingDM(drive) != nullptr;
 }
 
 void DDA::LimitSpeedAndAcceleration(float maxSpeed, float maxAcceleration)
@@ -12,6 +12,8 @@
 #include "DriveMovement.h"
 #include "GCodes/GCodes.h"			// for class RawMove
 
+class StageTimer;
+
 #ifdef DUET_NG
 #define DDA_LOG_PROBE_CHANGES	0
 #else
@@ -24,6 +26,9 @@
 class DDA
 {
 	friend class DriveMovement;
+#if SUPPORT_KINEMATICS_BENCHMARK
+	friend class KinematicsBenchmark;							// sets up the moves that it passes to LimitSpeedAndAcceleration
+#endif
 
 public:
 
@@ -42,15 +47,23 @@ public:
 	bool Init(const float_t steps[DRIVES]);							// Set up a raw (unmapped) motor move
 	void Init();													// Set up initial positions for machine startup
 	bool Start(uint32_t tim) __attribute__ ((hot));					// Start executing the DDA, i.e. move the move.
-	bool Step() __attribute__ ((hot));								// Take one step of the DDA, called by timed interrupt.
+	bool Step() __attribute__ ((hot)) ITCM_CODE;								// Take one step of the DDA, called by timed interrupt.
 	void SetNext(DDA *n) { next = n; }
 	void SetPrevious(DDA *p) { prev = p; }
 	void Complete() { state = completed; }
 	bool Free();
-	void Prepare(uint8_t simMode) __attribute__ ((hot));			// Calculate all the values and freeze this DDA
+	void Prepare(uint8_t simMode, bool prepareDMs) __attribute__ ((hot));	// Calculate all the values and freeze this DDA
+#if SUPPORT_STEP_TABLES
+	void RefillStepTables();										// Top up the precomputed step times of this DDA
+#endif
 	bool HasStepError() const;
+#if SUPPORT_INPUT_SHAPING
+	bool IsShaped() const { return shapedProfile != nullptr; }
+#endif
 	bool CanPauseAfter() const { return canPauseAfter; }
 	bool IsPrintingMove() const { return isPrintingMove; }			// Return true if this involves both XY movement and extrusion
+	bool HadLookaheadUnderrun() const { return hadLookaheadUnderrun; }
+	bool HadHiccup() const { return hadHiccup; }
 	bool UsingStandardFeedrate() const { return usingStandardFeedrate; }
 
 	DDAState GetState() const { return state; }
@@ -67,36 +80,60 @@ public:
     float GetRequestedSpeed() const { return requestedSpeed; }
     float GetTopSpeed() const { return topSpeed; }
     float GetVirtualExtruderPosition() const { return virtualExtruderPosition; }
-	float AdvanceBabyStepping(float amount);						// Try to push babystepping earlier in the move queue
+	void AddBabyStepOffset(float zAmount, const int32_t motorSteps[], const uint8_t motors[], size_t numMotors);	// Offset the end position by some babystepping
+	bool GetDriveDirection(size_t drive, bool& forwards) const;		// Return true if this move is stepping the drive, and its direction
+	bool CanBabyStep() const { return endStopsToCheck == 0 && !isLeadscrewAdjustmentMove; }
 	bool IsHomingAxes() const { return (endStopsToCheck & HomeAxes) != 0; }
 	uint32_t GetXAxes() const { return xAxes; }
 	uint32_t GetYAxes() const { return yAxes; }
 	float GetTotalDistance() const { return totalDistance; }
+	float GetExtrusion(size_t drive) const { return directionVector[drive] * totalDistance; }	// Get the distance moved by an extruder drive, negative if retracting
 	void LimitSpeedAndAcceleration(float maxSpeed, float maxAcceleration);	// Limit the speed an acceleration of this move
 
 	int32_t GetStepsTaken(size_t drive) const;
 	bool IsNonPrintingExtruderMove(size_t drive) const;
 
 	float GetProportionDone(bool moveWasAborted) const;						// Return the proportion of extrusion for the complete multi-segment move already done
+	float GetProportionDoneAtEnd() const { return 1.0 - proportionLeft; }	// Return the proportion of the complete multi-segment move done at the end of this segment
+	bool CanTruncateForPause() const;										// Return true if we can shorten this move so that the machine comes to rest within it
+	void TruncateForPause(uint8_t simMode, bool prepareDMs);				// Shorten this move so that it ends at rest as soon as possible, and prepare it again
+	void ChangeSpeedFactor(float ratio);											// Rescale the requested speed of a provisional move when the speed factor changes
 
 	void MoveAborted();
 
 	uint32_t GetClocksNeeded() const { return clocksNeeded; }
+	uint32_t GetMoveStartTime() const { return moveStartTime; }
+	float GetAccelerationTime() const { return (topSpeed - startSpeed)/acceleration + (topSpeed - endSpeed)/deceleration; }	// time spent accelerating and decelerating
 	bool IsGoodToPrepare() const;
 
 #if SUPPORT_LASER || SUPPORT_IOBITS
 	LaserPwmOrIoBits GetLaserPwmOrIoBits() const { return laserPwmOrIoBits; }
 #endif
 
+#if HAS_VOLTAGE_MONITOR
+	void DelayMove(uint32_t delayClocks) { moveStartTime += delayClocks; }	// Shift the timing of an executing move that was stopped temporarily
+#endif
+
 #if SUPPORT_IOBITS
-	uint32_t GetMoveStartTime() const { return moveStartTime; }
 	IoBits_t GetIoBits() const { return laserPwmOrIoBits.ioBits; }
 #endif
 
 #if HAS_SMART_DRIVERS
 	uint32_t GetStepInterval(size_t axis, uint32_t microstepShift) const;	// Get the current full step interval for this axis or extruder
+	bool IsAccelerating(uint32_t now) const;								// Return true if the move is accelerating or decelerating at the specified step clock time
+#endif
+
+#if SUPPORT_MICROSTEP_SWITCHING
+	AxesBitmap GetReducedMicrostepAxes() const { return reducedMicrostepAxes; }		// Return the axes that this move steps with reduced microstepping
+	AxesBitmap GetMicrostepRemainderAxes() const { return microstepRemainderAxes; }	// Return the reduced axes that need some steps at normal microstepping before the move starts
+	bool NeedsMicrostepChange(AxesBitmap currentlyReduced) const
+		{ return reducedMicrostepAxes != currentlyReduced || microstepRemainderAxes != 0; }
+	unsigned int GetMicrostepReduction(size_t axis) const;					// Return log2 of the factor by which the microstepping of an axis is reduced in this move
+	void MakeMicrostepRemainderSteps();										// Make the steps at normal microstepping that the reduced microstepping can't make
 #endif
 
+	void MeasureStepGeneration(StageTimer& timer, uint32_t& numStepsChecked, uint64_t& totalError, uint32_t& maxError);	// Calculate all the step times of a prepared move without stepping the motors, for benchmarking
+
 	void DebugPrint() const;												// print the DDA only
 	void DebugPrintAll() const;												// print the DDA and active DMs
 
@@ -121,6 +158,13 @@ public:
 	static constexpr uint32_t MinInterruptInterval = 4;									// about 6us minimum interval between interrupts, in step clocks
 #endif
 	static constexpr uint32_t MaxStepInterruptTime = 10 * MinInterruptInterval;			// the maximum time we spend looping in the ISR , in step clocks
+	static constexpr uint32_t MaxStepMergeWindow = (20 * StepClockRate)/1000000;		// the largest window (20us) within which we generate steps for several drives together
+#if SUPPORT_MICROSTEP_SWITCHING
+	static constexpr unsigned int MaxMicrostepReductionShift = 4;						// we reduce the microstepping by a factor of at most 16
+#endif
+#if SUPPORT_LASER
+	static constexpr uint32_t LaserPowerUpdateInterval = StepClockRate/1000;			// how often we scale the laser power to the speed (1ms)
+#endif
 
 	static void PrintMoves();										// print saved moves for debugging
 
@@ -131,23 +175,57 @@ public:
 #endif
 
 	static unsigned int numHiccups;									// how many times we delayed an interrupt to avoid using too much CPU time in interrupts
+	static uint32_t totalHiccups;									// as numHiccups, but not reset by M122
+	static uint32_t stepMergeWindow;								// steps due within this many clocks of each other are generated together
+	static uint32_t numStepEvents;									// how many times we have generated step pulses
+	static uint32_t numStepsGenerated;								// how many drive steps we generated in those events
 	static uint32_t lastStepLowTime;								// when we last completed a step pulse to a slow driver
 	static uint32_t lastDirChangeTime;								// when we last change the DIR signal to a slow driver
 
 private:
 	DriveMovement *FindDM(size_t drive) const;
+	float IdealClocksToDistance(float distance) const;				// the time from the start of the move at which the distance is reached, calculated in floating point
+	DriveMovement *FindSteppingDM(size_t drive) const;				// find the DM that steps a drive, which may be the DM of another drive
+	DriveMovement *FindLockstepExtruderDM(size_t drive, size_t numAxes) const;
 	void RecalculateMove() __attribute__ ((hot));
+#if SUPPORT_MICROSTEP_SWITCHING
+	void ReduceMicrostepping();
+#endif
 	void MatchSpeeds() __attribute__ ((hot));
 	void ReduceHomingSpeed();										// called to reduce homing speed when a near-endstop is triggered
+	float GetSpeedAt(uint32_t clocksSinceStart) const;				// return the planned speed at the specified time after the start of the move
+	float GetZProbeOvershoot(const Platform& platform) const;		// return how far Z has moved since the Z probe triggered
 	void StopDrive(size_t drive);									// stop movement of a drive and recalculate the endpoint
 	void InsertDM(DriveMovement *dm) __attribute__ ((hot));
 	void RemoveDM(size_t drive);
+	DriveMovement *FirstDM() const;									// return the DM with the earliest step due, or nullptr if none
+	void ClearActiveDMs();
+#if USE_DM_HEAP
+	DriveMovement *PopFirstDM() __attribute__ ((hot));
+	void HeapSiftUp(size_t pos) __attribute__ ((hot));
+	void HeapSiftDown(size_t pos) __attribute__ ((hot));
+	uint32_t HeapStepTime(size_t pos) const { return pddm[activeDrives[pos]]->nextStepTime; }
+#endif
+	void AllocateDMs();
 	void ReleaseDMs();
+	bool IsDriveMoving(size_t drive) const;							// return true if this un-prepared move uses this drive
+#if SUPPORT_INPUT_SHAPING
+	void PlanShapedProfile();
+#endif
+#if SUPPORT_LASER
+	void SetLaserPower(uint32_t clocksSinceStart);
+#endif
+#if SUPPORT_LASER_RASTER
+	void StartRaster();
+	void UpdateRasterPower(uint32_t clocksSinceStart);
+#endif
 	bool IsDecelerationMove() const;								// return true if this move is or have been might have been intended to be a deceleration-only move
 	bool IsAccelerationMove() const;								// return true if this move is or have been might have been intended to be an acceleration-only move
 	void DebugPrintVector(const char *name, const float *vec, size_t len) const;
 	void CheckEndstops(Platform& platform);
 	float NormaliseXYZ();											// Make the direction vector unit-normal in XYZ
+	void GetXYZDirection(float dir[3]) const;						// Get the unit-length XYZ direction of an XY move
+	float GetJunctionSpeedLimit(float junctionDeviation) const;		// Return the maximum speed at the junction between this move and the next one
 	void AdjustAcceleration();										// Adjust the acceleration and deceleration to reduce ringing
 
 	static void DoLookahead(DDA *laDDA) __attribute__ ((hot));		// Try to smooth out moves in the queue
@@ -178,6 +256,10 @@ private:
 			uint8_t isLeadscrewAdjustmentMove : 1;	// True if this is a leadscrews adjustment move
 			uint8_t usingStandardFeedrate : 1;		// True if this move uses the standard feed rate
 			uint8_t hadHiccup : 1;					// True if we had a hiccup while executing this move
+			uint8_t pollEndstops : 1;				// True if the step ISR must read the endstops at every step, false if it can wait for a pin change interrupt
+			uint8_t scaleLaserPower : 1;			// True if the step ISR must scale the laser power by the speed during acceleration and deceleration
+			uint8_t usesSpeedFactor : 1;			// True if the requested speed of this move includes the M220 speed factor
+			uint8_t isExtruderOnlyMove : 1;			// True if we know that no axis motors move, so we only need to look at the extruders
 		};
 		uint16_t flags;								// so that we can print all the flags at once for debugging
 	};
@@ -189,6 +271,10 @@ private:
     EndstopChecks endStopsToCheck;			// Which endstops we are checking on this move
     AxesBitmap xAxes;						// Which axes are behaving as X axes
     AxesBitmap yAxes;						// Which axes are behaving as Y axes
+#if SUPPORT_MICROSTEP_SWITCHING
+    AxesBitmap reducedMicrostepAxes;		// Which axes this move steps with reduced microstepping. Set up by Prepare().
+    AxesBitmap microstepRemainderAxes;		// Which of those axes need some steps at normal microstepping before the move starts
+#endif
 
     FilePosition filePos;					// The position in the SD card file after this move was read, or zero if not read from SD card
 
@@ -209,6 +295,7 @@ private:
 	float decelDistance;
 
 	float proportionLeft;					// what proportion of the extrusion in the G1 or G0 move of which this is a part remains to be done after this segment is complete
+	float smoothedSpeed;					// the smoothed speed at the end of this move, used for smoothed pressure advance. Set up by Prepare().
 	uint32_t clocksNeeded;
 
 	union
@@ -218,6 +305,7 @@ private:
 		{
 			float targetNextSpeed;				// The speed that the next move would like to start at, used to keep track of the lookahead without making recursive calls
 			float maxAcceleration;				// the maximum allowed acceleration for this move according to the limits set by M201
+			int32_t netSteps[DRIVES];			// the net number of steps that each drive moves. The DMs are created from these when the move is prepared.
 		};
 
 		// Values that are not set or accessed before Prepare is called
@@ -228,6 +316,8 @@ private:
 			uint32_t startSpeedTimesCdivA;		// the number of clocks it would have taken to reach the start speed from rest
 			uint32_t topSpeedTimesCdivDPlusDecelStartClocks;
 			int32_t extraAccelerationClocks;	// the additional number of clocks needed because we started the move at less than topSpeed. Negative after ReduceHomingSpeed has been called.
+			uint32_t accelStopClocks;			// the number of clocks after the start of the move at which acceleration ends
+			uint32_t decelStartClocks;			// the number of clocks after the start of the move at which deceleration starts
 
 			// These are used only in delta calculations
 		    int32_t cKc;						// The Z movement fraction multiplied by Kc and converted to integer
@@ -240,8 +330,24 @@ private:
 	void LogProbePosition();
 #endif
 
+#if SUPPORT_INPUT_SHAPING
+	ShapedProfile *shapedProfile;			// the shaped motion profile, or nullptr if this move uses the plain trapezoidal profile
+#endif
+#if SUPPORT_LASER
+	static uint32_t nextLaserUpdateClocks;	// when the step ISR should next scale the laser power, in clocks from the start of the move
+#endif
+#if SUPPORT_LASER_RASTER
+	LaserRaster *laserRaster;				// the per-pixel laser power, or nullptr if the laser power is constant during this move
+#endif
+
+#if USE_DM_HEAP
+	uint8_t activeDrives[DRIVES];			// binary heap of the indices in pddm of the DMs that need steps, ordered by step time
+	uint8_t numActiveDrives;				// the number of entries in activeDrives
+#else
     DriveMovement* firstDM;					// list of contained DMs that need steps, in step time order
-	DriveMovement *pddm[DRIVES];			// These describe the state of each drive movement
+#endif
+	DriveMovementBlock *dmBlock;			// the block of DMs allocated to this move when it was prepared, or nullptr
+	DriveMovement *pddm[DRIVES];			// These describe the state of each drive movement. They are allocated when the move is prepared.
 };
 
 // Find the DriveMovement record for a given drive, or return nullptr if there isn't one
@@ -250,6 +356,45 @@ inline DriveMovement *DDA::FindDM(size_t drive) const
 	return pddm[drive];
 }
 
+#if SUPPORT_MICROSTEP_SWITCHING
+
+inline unsigned int DDA::GetMicrostepReduction(size_t axis) const
+{
+	return (IsBitSet(reducedMicrostepAxes, axis)) ? pddm[axis]->microstepShift : 0;
+}
+
+#endif
+
+inline DriveMovement *DDA::FirstDM() const
+{
+#if USE_DM_HEAP
+	return (numActiveDrives != 0) ? pddm[activeDrives[0]] : nullptr;
+#else
+	return firstDM;
+#endif
+}
+
+inline void DDA::ClearActiveDMs()
+{
+#if USE_DM_HEAP
+	numActiveDrives = 0;
+#else
+	firstDM = nullptr;
+#endif
+}
+
+// Return true if this move is stepping the drive, and which direction it has set the direction pin to
+inline bool DDA::GetDriveDirection(size_t drive, bool& forwards) const
+{
+	const DriveMovement * const dm = FindSteppingDM(drive);
+	if (dm != nullptr && dm->state == DMState::moving)
+	{
+		forwards = dm->direction;
+		return true;
+	}
+	return false;
+}
+
 // Force an end point
 inline void DDA::SetDriveCoordinate(int32_t a, size_t drive)
 {
@@ -266,6 +411,13 @@ inline uint32_t DDA::GetStepInterval(size_t axis, uint32_t microstepShift) const
 	return (dm != nullptr) ? dm->GetStepInterval(microstepShift) : 0;
 }
 
+// Return true if the move is accelerating or decelerating at the specified step clock time. This is called from the stepper drivers SPI interface ISR.
+inline bool DDA::IsAccelerating(uint32_t now) const
+{
+	const uint32_t clocksSinceStart = now - moveStartTime;
+	return clocksSinceStart < accelStopClocks || clocksSinceStart >= decelStartClocks;
+}
+
 #endif
 
 #endif /* DDA_H_ */
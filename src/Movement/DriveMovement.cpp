@@ -11,19 +11,40 @@
 #include "RepRap.h"
 #include "Libraries/Math/Isqrt.h"
 #include "Kinematics/LinearDeltaKinematics.h"
+#include "InputShaper.h"
 
 // Static members
 
 DriveMovement *DriveMovement::freeList = nullptr;
 int DriveMovement::numFree = 0;
 int DriveMovement::minFree = 0;
+PoolStats DriveMovement::poolStats("DMs");
+
+#if USE_TCM
+# include <new>
+
+// Storage in DTCM for the default number of DMs, because the step ISR accesses them on every step. Any DMs added by M595 come from the heap.
+alignas(DriveMovement) static uint8_t dmStorage[DefaultNumDms * sizeof(DriveMovement)] DTCM_DATA;
+static size_t numDmsInTcm = 0;
+#endif
 
 void DriveMovement::InitialAllocate(unsigned int num)
 {
 	while (num != 0)
 	{
-		freeList = new DriveMovement(freeList);
+#if USE_TCM
+		if (numDmsInTcm < DefaultNumDms)
+		{
+			freeList = new (&dmStorage[numDmsInTcm * sizeof(DriveMovement)]) DriveMovement(freeList);
+			++numDmsInTcm;
+		}
+		else
+#endif
+		{
+			freeList = new DriveMovement(freeList);
+		}
 		++numFree;
+		poolStats.Created(1);
 		--num;
 	}
 	ResetMinFree();
@@ -40,16 +61,48 @@ DriveMovement *DriveMovement::Allocate(size_t drive, DMState st)
 		{
 			minFree = numFree;
 		}
-		dm->nextDM = nullptr;
-		dm->drive = (uint8_t)drive;
-		dm->state = st;
+		dm->SetUp(drive, st);
+		poolStats.Allocated();
+	}
+	else
+	{
+		poolStats.Failed();
 	}
 	return dm;
 }
 
+// Set the direction pins of this drive and of its follower drives
+void DriveMovement::SetDirectionPins() const
+{
+	Platform& platform = reprap.GetPlatform();
+	platform.SetDirection(drive, direction);
+	for (uint32_t followers = followerDrives; followers != 0; followers &= followers - 1)
+	{
+		platform.SetDirection(__builtin_ctz(followers), direction);
+	}
+}
+
+DriveMovementBlock *DriveMovementBlock::freeList = nullptr;
+unsigned int DriveMovementBlock::numFree = 0;
+PoolStats DriveMovementBlock::poolStats("DM blocks");
+
+/*static*/ void DriveMovementBlock::InitialAllocate(unsigned int num)
+{
+	while (num != 0)
+	{
+		freeList = new DriveMovementBlock(freeList);
+		++numFree;
+		poolStats.Created(1);
+		--num;
+	}
+}
+
 // Constructors
 DriveMovement::DriveMovement(DriveMovement *next) : nextDM(next)
 {
+#if SUPPORT_STEP_TABLES
+	stepTable = nullptr;
+#endif
 }
 
 // Non static members
@@ -57,6 +110,32 @@ DriveMovement::DriveMovement(DriveMovement *next) : nextDM(next)
 // Prepare this DM for a Cartesian axis move
 void DriveMovement::PrepareCartesianAxis(const DDA& dda, const PrepParams& params)
 {
+#if USE_FIXED_POINT_PREPARE
+	// Processors without an FPU do floating point arithmetic slowly, so use the values that DDA::Prepare calculated for the whole move instead.
+	// Each per-axis value then needs just an integer division by the number of steps or a multiplication by it.
+	mp.cart.twoCsquaredTimesMmPerStepDivA = params.twoCsquaredTimesTotalDistanceDivA/totalSteps;
+	mp.cart.twoCsquaredTimesMmPerStepDivD = params.twoCsquaredTimesTotalDistanceDivD/totalSteps;
+
+	// Acceleration phase parameters
+	mp.cart.accelStopStep = mulQ31(totalSteps, params.accelFraction) + 1;
+	mp.cart.compensationClocks = mp.cart.accelCompensationClocks = 0;
+
+	// Constant speed phase parameters
+	mp.cart.mmPerStepTimesCKdivtopSpeed = (uint32_t)(params.totalDistanceTimesCKdivTopSpeed/totalSteps);
+
+	// Deceleration phase parameters
+	// First check whether there is any deceleration at all, otherwise we may get strange results because of rounding errors
+	if ((uint64_t)totalSteps * params.decelFraction < (1u << 30))		// if less than half a step of deceleration
+	{
+		mp.cart.decelStartStep = totalSteps + 1;
+		twoDistanceToStopTimesCsquaredDivD = 0;
+	}
+	else
+	{
+		mp.cart.decelStartStep = mulQ31(totalSteps, params.decelStartFraction) + 1;
+		twoDistanceToStopTimesCsquaredDivD = params.twoDistanceToStopTimesCsquaredDivD;
+	}
+#else
 	const float stepsPerMm = (float)totalSteps/dda.totalDistance;
 	mp.cart.twoCsquaredTimesMmPerStepDivA = roundU64((double)(StepClockRateSquared * 2)/((double)stepsPerMm * (double)dda.acceleration));
 	mp.cart.twoCsquaredTimesMmPerStepDivD = roundU64((double)(StepClockRateSquared * 2)/((double)stepsPerMm * (double)dda.deceleration));
@@ -80,10 +159,17 @@ void DriveMovement::PrepareCartesianAxis(const DDA& dda, const PrepParams& param
 		mp.cart.decelStartStep = (uint32_t)(params.decelStartDistance * stepsPerMm) + 1;
 		twoDistanceToStopTimesCsquaredDivD = isquare64(params.topSpeedTimesCdivD) + roundU64((params.decelStartDistance * (StepClockRateSquared * 2))/dda.deceleration);
 	}
+#endif
 
 	// No reverse phase
 	reverseStartStep = totalSteps + 1;
 	mp.cart.fourMaxStepDistanceMinusTwoDistanceToStopTimesCsquaredDivD = 0;
+
+#if SUPPORT_INPUT_SHAPING
+	shapedDistancePerStep = dda.totalDistance/(float)totalSteps;
+	shapedCompensationClocks = 0.0;
+	shapedSegment = 0;
+#endif
 }
 
 // Prepare this DM for a Delta axis move
@@ -167,13 +253,20 @@ void DriveMovement::PrepareDeltaAxis(const DDA& dda, const PrepParams& params)
 		mp.delta.decelStartDsK = roundU32(params.decelStartDistance * stepsPerMm * K2);
 		twoDistanceToStopTimesCsquaredDivD = isquare64(params.topSpeedTimesCdivD) + roundU64((params.decelStartDistance * (StepClockRateSquared * 2))/dda.deceleration);
 	}
+
+#if SUPPORT_INPUT_SHAPING
+	shapedDistancePerStep = 1.0/(stepsPerMm * K2);
+	shapedCompensationClocks = 0.0;
+	shapedSegment = 0;
+#endif
 }
 
 // Prepare this DM for an extruder move
-void DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, float speedChange, bool doCompensation)
+// If 'extrusionFactor' is not 1.0 then the extrusion is scaled by it. This is used to apply smoothed pressure advance.
+void DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, float speedChange, bool doCompensation, float extrusionFactor)
 {
 	const float dv = dda.directionVector[drive];
-	float stepsPerMm = reprap.GetPlatform().DriveStepsPerUnit(drive) * fabsf(dv);
+	float stepsPerMm = reprap.GetPlatform().DriveStepsPerUnit(drive) * fabsf(dv) * extrusionFactor;
 	const size_t extruder = drive - reprap.GetGCodes().GetTotalAxes();
 
 #if SUPPORT_NONLINEAR_EXTRUSION
@@ -230,6 +323,21 @@ void DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, fl
 	// Constant speed phase parameters
 	mp.cart.mmPerStepTimesCKdivtopSpeed = (uint32_t)((float)((uint64_t)StepClockRate * K1)/(stepsPerMm * dda.topSpeed));
 
+#if SUPPORT_INPUT_SHAPING
+	if (dda.shapedProfile != nullptr)
+	{
+		// The step times come from the shaped motion profile. DDA::Prepare has already checked that the extruder doesn't need to reverse.
+		totalSteps = (uint32_t)max<int32_t>(netSteps, 0);
+		mp.cart.decelStartStep = reverseStartStep = totalSteps + 1;
+		mp.cart.fourMaxStepDistanceMinusTwoDistanceToStopTimesCsquaredDivD = 0;
+		twoDistanceToStopTimesCsquaredDivD = 0;
+		shapedDistancePerStep = 1.0/stepsPerMm;
+		shapedCompensationClocks = mp.cart.compensationClocks;
+		shapedSegment = 0;
+		return;
+	}
+#endif
+
 	// Calculate the deceleration and reverse phase parameters and update totalSteps
 	// First check whether there is any deceleration at all, otherwise we may get strange results because of rounding errors
 	if (dda.decelDistance * stepsPerMm < 0.5)		// if less than 1 deceleration step
@@ -338,6 +446,13 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 
 	const uint32_t nextCalcStep = nextStep + stepsTillRecalc;
 	uint32_t nextCalcStepTime;
+#if SUPPORT_INPUT_SHAPING
+	if (dda.shapedProfile != nullptr)
+	{
+		nextCalcStepTime = ShapedStepTime(*dda.shapedProfile, (float)nextCalcStep * shapedDistancePerStep);
+	}
+	else
+#endif
 	if (nextCalcStep < mp.cart.accelStopStep)
 	{
 		// acceleration phase
@@ -370,7 +485,7 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 			direction = !direction;
 			if (live)
 			{
-				reprap.GetPlatform().SetDirection(drive, direction);
+				SetDirectionPins();
 			}
 		}
 		const uint32_t adjustedTopSpeedTimesCdivDPlusDecelStartClocks = dda.topSpeedTimesCdivDPlusDecelStartClocks - mp.cart.compensationClocks;
@@ -479,6 +594,13 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 	}
 
 	uint32_t nextCalcStepTime;
+#if SUPPORT_INPUT_SHAPING
+	if (dda.shapedProfile != nullptr)
+	{
+		nextCalcStepTime = ShapedStepTime(*dda.shapedProfile, (float)dsK * shapedDistancePerStep);
+	}
+	else
+#endif
 	if ((uint32_t)dsK < mp.delta.accelStopDsK)
 	{
 		// Acceleration phase
@@ -531,6 +653,43 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 	return true;
 }
 
+#if SUPPORT_INPUT_SHAPING
+
+// Return the time in step clocks at which the specified distance along the move is reached when following a shaped motion profile.
+// For extruders with pressure advance, the extruder position corresponds to s + K * (v - v0) where s and v are the distance and speed along the move.
+uint32_t DriveMovement::ShapedStepTime(const ShapedProfile& profile, float distance)
+{
+	const float initialSpeed = profile.GetInitialSpeed();
+	size_t segNum = shapedSegment;
+	while (segNum + 1 < profile.NumSegments())
+	{
+		const MotionSegment& nextSeg = profile.GetSegment(segNum + 1);
+		if (distance < nextSeg.startDistance + shapedCompensationClocks * (nextSeg.startSpeed - initialSpeed))
+		{
+			break;
+		}
+		++segNum;
+	}
+	shapedSegment = (uint8_t)segNum;
+
+	const MotionSegment& seg = profile.GetSegment(segNum);
+	const float u = seg.startSpeed + shapedCompensationClocks * seg.acceleration;
+	const float d = distance - (seg.startDistance + shapedCompensationClocks * (seg.startSpeed - initialSpeed));
+	if (d <= 0.0)
+	{
+		return roundU32(seg.startTime);
+	}
+
+	// Solve d = u*t + a*t^2/2 for t. This form doesn't suffer from cancellation when the acceleration is small or negative.
+	const float discriminant = fsquare(u) + 2 * seg.acceleration * d;
+	const float denominator = u + ((discriminant > 0.0) ? sqrtf(discriminant) : 0.0);
+	return (denominator > 0.0)
+			? roundU32(seg.startTime + (2 * d)/denominator)
+			: roundU32(profile.GetEndTime());
+}
+
+#endif
+
 // Reduce the speed of this movement. Called to reduce the homing speed when we detect we are near the endstop for a drive.
 void DriveMovement::ReduceSpeed(const DDA& dda, uint32_t inverseSpeedFactor)
 {
@@ -554,4 +713,164 @@ void DriveMovement::ReduceSpeed(const DDA& dda, uint32_t inverseSpeedFactor)
 	}
 }
 
+#if SUPPORT_STEP_TABLES
+
+// Step table static members
+
+StepTable *StepTable::freeList = nullptr;
+unsigned int StepTable::numFree = 0;
+unsigned int StepTable::numUnderruns = 0;
+PoolStats StepTable::poolStats("step tables");
+
+/*static*/ void StepTable::InitialAllocate(unsigned int num)
+{
+	while (num != 0)
+	{
+		freeList = new StepTable(freeList);
+		++numFree;
+		poolStats.Created(1);
+		--num;
+	}
+}
+
+// Allocate a step table. Only called from Move::Spin, never from the ISR.
+/*static*/ StepTable *StepTable::Allocate()
+{
+	StepTable * const st = freeList;
+	if (st != nullptr)
+	{
+		freeList = st->nextTable;
+		--numFree;
+		st->nextTable = nullptr;
+		st->getIndex = st->putIndex = 0;
+		st->abandoned = false;
+		poolStats.Allocated();
+	}
+	else
+	{
+		poolStats.Failed();
+	}
+	return st;
+}
+
+// Release a step table. Only called from Move::Spin, never from the ISR.
+/*static*/ void StepTable::Release(StepTable *item)
+{
+	item->nextTable = freeList;
+	freeList = item;
+	++numFree;
+	poolStats.Released();
+}
+
+// Copy the state that the step time calculation uses and changes from another DM
+void DriveMovement::LoadCalcState(const DriveMovement& other)
+{
+	state = other.state;
+	stepsTillRecalc = other.stepsTillRecalc;
+	nextStep = other.nextStep;
+	nextStepTime = other.nextStepTime;
+	stepInterval = other.stepInterval;
+	twoDistanceToStopTimesCsquaredDivD = other.twoDistanceToStopTimesCsquaredDivD;
+	mp = other.mp;
+#if SUPPORT_INPUT_SHAPING
+	shapedSegment = other.shapedSegment;
+#endif
+}
+
+// Try to attach a step table to this DM and fill it. Called from DDA::Prepare after the time of the first step has been calculated.
+// We only use a table if there is no reversal, because the ISR must change the direction output at the right time.
+// Return true if a table was attached.
+bool DriveMovement::AttachStepTable(const DDA& dda, bool isDelta)
+{
+	if (reverseStartStep <= totalSteps || nextStep >= totalSteps)
+	{
+		return false;
+	}
+
+	stepTable = StepTable::Allocate();
+	if (stepTable == nullptr)
+	{
+		return false;
+	}
+
+	// The generator starts off in the same state as this DM. It must not have a table itself, or it would try to read from it.
+	stepTable->gen = *this;
+	stepTable->gen.nextDM = nullptr;
+	stepTable->gen.stepTable = nullptr;
+	RefillStepTable(dda, isDelta);
+	return true;
+}
+
+// Add as many step times to the table as there is room for. Called from DDA::Prepare and Move::Spin, never from the ISR.
+// This is called on the DM that the ISR uses, so we only look at its step state with interrupts disabled.
+// We do the calculation with interrupts enabled on a copy of the generator state, then commit the results with interrupts disabled.
+// If the ISR ran out of step times meanwhile then it has taken over the calculation, so we discard the results.
+void DriveMovement::RefillStepTable(const DDA& dda, bool isDelta)
+{
+	StepTable& table = *stepTable;
+	DriveMovement localGen(nullptr);
+	uint32_t putIndex, numToDo;
+
+	irqflags_t flags = cpu_irq_save();
+	if (table.abandoned && state == DMState::moving && nextStep < totalSteps)
+	{
+		// The ISR ran out of step times and took over the calculation, so hand it back to the generator from where the ISR has got to
+		table.gen.LoadCalcState(*this);
+		table.getIndex = table.putIndex;
+		table.abandoned = false;
+	}
+	const bool ok = !table.abandoned && table.gen.state == DMState::moving && table.gen.nextStep < table.gen.totalSteps;
+	if (ok)
+	{
+		localGen = table.gen;
+		putIndex = table.putIndex;
+		numToDo = StepTableLength - (putIndex - table.getIndex);
+	}
+	cpu_irq_restore(flags);
+
+	if (!ok)
+	{
+		return;
+	}
+
+	// The ISR never reads the slots we fill here until we advance putIndex, so it is safe to write them with interrupts enabled
+	uint32_t numDone = 0;
+	while (numDone < numToDo)
+	{
+		const bool more = (isDelta) ? localGen.CalcNextStepTimeDelta(dda, false) : localGen.CalcNextStepTimeCartesian(dda, false);
+		if (!more)
+		{
+			break;
+		}
+		table.stepTimes[(putIndex + numDone) % StepTableLength] = localGen.nextStepTime;
+		++numDone;
+	}
+
+	flags = cpu_irq_save();
+	if (!table.abandoned)
+	{
+		table.gen = localGen;
+		table.putIndex = putIndex + numDone;
+	}
+	cpu_irq_restore(flags);
+}
+
+// The step table ran dry, so take over the step calculation from the generator. Called only from the ISR.
+// The next call to RefillStepTable will hand the calculation back to the generator.
+// On entry nextStep has already been incremented. Return true if there are still steps to do, with nextStep incremented from the generator state.
+bool DriveMovement::TakeOverFromStepTable()
+{
+	stepTable->abandoned = true;
+	++StepTable::numUnderruns;
+	LoadCalcState(stepTable->gen);		// the table is empty, so the generator state matches the step we have just done
+	if (state != DMState::moving)
+	{
+		return false;					// the generator found a step error
+	}
+	++nextStep;
+	return true;
+}
+
+#endif
+
 // End
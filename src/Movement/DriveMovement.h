@@ -9,8 +9,11 @@
 #define DRIVEMOVEMENT_H_
 
 #include "RepRapFirmware.h"
+#include "Libraries/General/PoolStats.h"
 
 class LinearDeltaKinematics;
+class StepTable;
+class ShapedProfile;
 
 #define EVEN_STEPS			(1)			// 1 to generate steps at even intervals when doing double/quad/octal stepping
 #define ROUND_TO_NEAREST	(0)			// 1 for round to nearest (as used in 1.20beta10), 0 for round down (as used prior to 1.20beta10)
@@ -88,6 +91,22 @@ inline int64_t roundS64(double d)
 #endif
 }
 
+#if USE_FIXED_POINT_PREPARE
+
+// Convert a fraction in the range 0 to 1 to Q31 format, clamping it to that range
+inline uint32_t fractionToQ31(float f)
+{
+	return (f >= 1.0) ? 0x80000000u : (f <= 0.0) ? 0 : (uint32_t)(f * 2147483648.0);
+}
+
+// Multiply an unsigned integer by a Q31 fraction, truncating the result
+inline uint32_t mulQ31(uint32_t n, uint32_t q)
+{
+	return (uint32_t)(((uint64_t)n * q) >> 31);
+}
+
+#endif
+
 // Struct for passing parameters to the DriveMovement Prepare methods
 struct PrepParams
 {
@@ -95,6 +114,17 @@ struct PrepParams
 	float decelStartDistance;
 	uint32_t topSpeedTimesCdivD;
 
+#if USE_FIXED_POINT_PREPARE
+	// Parameters used only for Cartesian axes. The per-axis values are obtained from these by dividing by the number of steps, or multiplying by it for the fractions.
+	uint64_t twoCsquaredTimesTotalDistanceDivA;
+	uint64_t twoCsquaredTimesTotalDistanceDivD;
+	uint64_t totalDistanceTimesCKdivTopSpeed;
+	uint64_t twoDistanceToStopTimesCsquaredDivD;
+	uint32_t accelFraction;						// accelDistance/totalDistance in Q31 format
+	uint32_t decelFraction;						// decelDistance/totalDistance in Q31 format
+	uint32_t decelStartFraction;				// decelStartDistance/totalDistance in Q31 format
+#endif
+
 	// Parameters used only for extruders
 	float compFactor;
 
@@ -120,13 +150,13 @@ class DriveMovement
 public:
 	friend class DDA;
 
-	DriveMovement(DriveMovement *next);
+	DriveMovement(DriveMovement *next = nullptr);
 
 	bool CalcNextStepTimeCartesian(const DDA &dda, bool live) __attribute__ ((hot));
 	bool CalcNextStepTimeDelta(const DDA &dda, bool live) __attribute__ ((hot));
 	void PrepareCartesianAxis(const DDA& dda, const PrepParams& params) __attribute__ ((hot));
 	void PrepareDeltaAxis(const DDA& dda, const PrepParams& params) __attribute__ ((hot));
-	void PrepareExtruder(const DDA& dda, const PrepParams& params, float speedChange, bool doCompensation) __attribute__ ((hot));
+	void PrepareExtruder(const DDA& dda, const PrepParams& params, float speedChange, bool doCompensation, float extrusionFactor) __attribute__ ((hot));
 	void ReduceSpeed(const DDA& dda, uint32_t inverseSpeedFactor);
 	void DebugPrint(char c, bool withDelta) const;
 	int32_t GetNetStepsLeft() const;
@@ -142,14 +172,35 @@ public:
 	static void ResetMinFree() { minFree = numFree; }
 	static DriveMovement *Allocate(size_t drive, DMState st);
 	static void Release(DriveMovement *item);
+	static bool CanAllocateForMove();					// return true if we can allocate the DMs for any move
+
+	void SetUp(size_t drv, DMState st) { nextDM = nullptr; drive = (uint8_t)drv; state = st; }
+	void ReleaseStepTable();
+
+#if SUPPORT_STEP_TABLES
+	bool AttachStepTable(const DDA& dda, bool isDelta);
+	void RefillStepTable(const DDA& dda, bool isDelta);
+	bool HasStepTable() const { return stepTable != nullptr; }
+#endif
 
 private:
-	bool CalcNextStepTimeCartesianFull(const DDA &dda, bool live) __attribute__ ((hot));
-	bool CalcNextStepTimeDeltaFull(const DDA &dda, bool live) __attribute__ ((hot));
+	bool CalcNextStepTimeCartesianFull(const DDA &dda, bool live) __attribute__ ((hot)) ITCM_CODE;
+	void SetDirectionPins() const;
+	bool CalcNextStepTimeDeltaFull(const DDA &dda, bool live) __attribute__ ((hot)) ITCM_CODE;
+
+#if SUPPORT_INPUT_SHAPING
+	uint32_t ShapedStepTime(const ShapedProfile& profile, float distance) __attribute__ ((hot)) ITCM_CODE;
+#endif
+
+#if SUPPORT_STEP_TABLES
+	bool TakeOverFromStepTable() __attribute__ ((hot));
+	void LoadCalcState(const DriveMovement& other);
+#endif
 
 	static DriveMovement *freeList;
 	static int numFree;
 	static int minFree;
+	static PoolStats poolStats;
 
 	// Parameters common to Cartesian, delta and extruder moves
 
@@ -157,12 +208,17 @@ private:
 
 	DMState state;										// whether this is active or not
 	uint8_t drive;										// the drive that this DM controls
-	uint8_t microstepShift : 4,							// log2 of the microstepping factor (for when we use dynamic microstepping adjustment)
+	uint8_t microstepShift : 4,							// log2 of the factor by which the microstepping is reduced for this move, see M936
 			direction : 1,								// true=forwards, false=backwards
 			fullCurrent : 1;							// true if the drivers are set to the full current, false if they are set to the standstill current
 	uint8_t stepsTillRecalc;							// how soon we need to recalculate
+#if SUPPORT_MICROSTEP_SWITCHING
+	uint8_t microstepRemainder;							// the number of steps at normal microstepping left over when totalSteps was reduced
+#endif
 
 	uint32_t totalSteps;								// total number of steps for this move
+	uint32_t driversBitmap;								// the step bits to set when this DM steps, including those of its follower drives
+	uint32_t followerDrives;							// bitmap of mixing extruder drives that this DM steps in lockstep with its own drive
 
 	// These values change as the step is executed, except for reverseStartStep
 	uint32_t nextStep;									// number of steps already done
@@ -173,6 +229,17 @@ private:
 	// The following only needs to be stored per-drive if we are supporting pressure advance
 	uint64_t twoDistanceToStopTimesCsquaredDivD;
 
+#if SUPPORT_STEP_TABLES
+	StepTable *stepTable;								// table of precomputed step times, or nullptr if we calculate them in the ISR
+#endif
+
+#if SUPPORT_INPUT_SHAPING
+	// Parameters used when the DDA has a shaped motion profile
+	float shapedDistancePerStep;						// distance along the move per step, or per unit of dsK for a delta tower
+	float shapedCompensationClocks;						// the pressure advance time in clocks
+	uint8_t shapedSegment;								// the profile segment that the last calculated step was in
+#endif
+
 	// Parameters unique to a style of move (Cartesian, delta or extruder). Currently, extruders and Cartesian moves use the same parameters.
 	union MoveParams
 	{
@@ -213,6 +280,60 @@ private:
 	static constexpr int32_t Kc = 1024 * 1024;			// a power of 2 for scaling the Z movement fraction
 };
 
+#if SUPPORT_STEP_TABLES
+
+constexpr size_t StepTableLength = 32;					// number of step times in each table, must be a power of 2
+
+// Class to hold a batch of precomputed step times for one DM, so that the step ISR doesn't need to do the square root calculations.
+// The table is filled when the move is prepared and topped up from Move::Spin. The ISR takes entries from it.
+// If the table runs dry then the ISR takes over the calculation from the generator state, just as it would have done without a table.
+class StepTable
+{
+public:
+	friend class DriveMovement;
+
+	StepTable(StepTable *next) : nextTable(next), gen(nullptr) { }
+
+	static void InitialAllocate(unsigned int num);
+	static StepTable *Allocate();
+	static void Release(StepTable *item);
+	static unsigned int NumFree() { return numFree; }
+	static unsigned int NumUnderruns() { return numUnderruns; }
+	static void ResetUnderruns() { numUnderruns = 0; }
+
+private:
+	bool Get(uint32_t& stepTime, uint32_t& interval) __attribute__ ((hot));
+
+	static StepTable *freeList;
+	static unsigned int numFree;
+	static unsigned int numUnderruns;
+	static PoolStats poolStats;
+
+	StepTable *nextTable;								// link in the free list
+	volatile uint32_t getIndex;							// only written by the ISR
+	volatile uint32_t putIndex;							// only written by the filling task with interrupts disabled
+	volatile bool abandoned;							// set by the ISR if the table ran dry and it took over the calculation
+	DriveMovement gen;									// the step generator state after the last step time in the table
+	uint32_t stepTimes[StepTableLength];				// circular buffer of step times relative to the start of the move
+};
+
+// Fetch the next step time from the table if there is one. Called only from the ISR.
+inline bool StepTable::Get(uint32_t& stepTime, uint32_t& interval)
+{
+	const uint32_t gi = getIndex;
+	if (gi == putIndex)
+	{
+		return false;
+	}
+	const uint32_t nextStepTime = stepTimes[gi % StepTableLength];
+	interval = (nextStepTime > stepTime) ? nextStepTime - stepTime : 0;
+	stepTime = nextStepTime;
+	getIndex = gi + 1;
+	return true;
+}
+
+#endif
+
 // Calculate and store the time since the start of the move when the next step for the specified DriveMovement is due.
 // Return true if there are more steps to do. When finished, leave nextStep == totalSteps + 1.
 // This is also used for extruders on delta machines.
@@ -222,6 +343,19 @@ inline bool DriveMovement::CalcNextStepTimeCartesian(const DDA &dda, bool live)
 	++nextStep;
 	if (nextStep <= totalSteps)
 	{
+#if SUPPORT_STEP_TABLES
+		if (stepTable != nullptr && !stepTable->abandoned)
+		{
+			if (stepTable->Get(nextStepTime, stepInterval))
+			{
+				return true;
+			}
+			if (!TakeOverFromStepTable())
+			{
+				return false;
+			}
+		}
+#endif
 		if (stepsTillRecalc != 0)
 		{
 			--stepsTillRecalc;			// we are doing double/quad/octal stepping
@@ -245,6 +379,19 @@ inline bool DriveMovement::CalcNextStepTimeDelta(const DDA &dda, bool live)
 	++nextStep;
 	if (nextStep <= totalSteps)
 	{
+#if SUPPORT_STEP_TABLES
+		if (stepTable != nullptr && !stepTable->abandoned)
+		{
+			if (stepTable->Get(nextStepTime, stepInterval))
+			{
+				return true;
+			}
+			if (!TakeOverFromStepTable())
+			{
+				return false;
+			}
+		}
+#endif
 		if (stepsTillRecalc != 0)
 		{
 			--stepsTillRecalc;			// we are doing double or quad stepping
@@ -300,12 +447,82 @@ inline int32_t DriveMovement::GetNetStepsTaken() const
 	return (direction) ? netStepsTaken : -netStepsTaken;
 }
 
+inline void DriveMovement::ReleaseStepTable()
+{
+#if SUPPORT_STEP_TABLES
+	if (stepTable != nullptr)
+	{
+		StepTable::Release(stepTable);
+		stepTable = nullptr;
+	}
+#endif
+}
+
 // This is inlined because it is only called from one place
 inline void DriveMovement::Release(DriveMovement *item)
 {
+	item->ReleaseStepTable();
 	item->nextDM = freeList;
 	freeList = item;
 	++numFree;
+	poolStats.Released();
+}
+
+// A block of DMs that is allocated to a move as a unit when the move is prepared. Most moves only use a few drives (e.g. XYZ and one extruder),
+// so they get all their DMs in one allocation and the DMs are adjacent in memory. Moves that use more drives take the rest from the DM free list.
+class DriveMovementBlock
+{
+public:
+	static constexpr size_t DMsPerBlock = 4;
+
+	static void InitialAllocate(unsigned int num);
+	static unsigned int NumFree() { return numFree; }
+	static DriveMovementBlock *Allocate();
+	static void Release(DriveMovementBlock *item);
+
+	DriveMovement *GetDM(size_t index) { return &dms[index]; }
+	bool Contains(const DriveMovement *dm) const { return dm >= &dms[0] && dm < &dms[DMsPerBlock]; }
+
+private:
+	explicit DriveMovementBlock(DriveMovementBlock *n) : next(n) { }
+
+	static DriveMovementBlock *freeList;
+	static unsigned int numFree;
+	static PoolStats poolStats;
+
+	DriveMovementBlock *next;
+	DriveMovement dms[DMsPerBlock];
+};
+
+inline DriveMovementBlock *DriveMovementBlock::Allocate()
+{
+	DriveMovementBlock * const item = freeList;
+	if (item != nullptr)
+	{
+		freeList = item->next;
+		--numFree;
+		item->next = nullptr;
+		poolStats.Allocated();
+	}
+	else
+	{
+		poolStats.Failed();
+	}
+	return item;
+}
+
+inline void DriveMovementBlock::Release(DriveMovementBlock *item)
+{
+	item->next = freeList;
+	freeList = item;
+	++numFree;
+	poolStats.Released();
+}
+
+// Return true if there are enough free DMs to prepare a move, however many drives it uses
+inline bool DriveMovement::CanAllocateForMove()
+{
+	return numFree >= (int)((DriveMovementBlock::NumFree() != 0) ? DRIVES - DriveMovementBlock::DMsPerBlock : DRIVES);
 }
 
 #if HAS_STALL_DETECT
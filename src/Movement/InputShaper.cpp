@@ -0,0 +1,381 @@
+/*
+ * InputShaper.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "InputShaper.h"
+
+#if SUPPORT_INPUT_SHAPING
+
+#include "GCodes/GCodeBuffer.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+// Shaped profile pool
+
+ShapedProfile *ShapedProfile::freeList = nullptr;
+unsigned int ShapedProfile::numFree = 0;
+PoolStats ShapedProfile::poolStats("shaped profiles");
+
+/*static*/ void ShapedProfile::InitialAllocate(unsigned int num)
+{
+	while (num != 0)
+	{
+		freeList = new ShapedProfile(freeList);
+		++numFree;
+		poolStats.Created(1);
+		--num;
+	}
+}
+
+/*static*/ ShapedProfile *ShapedProfile::Allocate()
+{
+	ShapedProfile * const p = freeList;
+	if (p != nullptr)
+	{
+		freeList = p->next;
+		--numFree;
+		p->next = nullptr;
+		p->numSegments = 0;
+		poolStats.Allocated();
+	}
+	else
+	{
+		poolStats.Failed();
+	}
+	return p;
+}
+
+/*static*/ void ShapedProfile::Release(ShapedProfile *item)
+{
+	item->next = freeList;
+	freeList = item;
+	++numFree;
+	poolStats.Released();
+}
+
+void ShapedProfile::AddSegment(float startTime, float startDistance, float startSpeed, float acceleration)
+{
+	if (numSegments < MaxSegments)
+	{
+		MotionSegment& seg = segments[numSegments++];
+		seg.startTime = startTime;
+		seg.startDistance = startDistance;
+		seg.startSpeed = startSpeed;
+		seg.acceleration = acceleration;
+	}
+}
+
+// Return true if the extruder movement with pressure advance applied never needs to reverse during this profile.
+// With pressure advance the extruder position tracks s + K * v, so its speed during a segment is v + K * a.
+bool ShapedProfile::AllowsPressureAdvance(float compensationClocks) const
+{
+	for (size_t i = 0; i < numSegments; ++i)
+	{
+		const MotionSegment& seg = segments[i];
+		const float segEndTime = (i + 1 < numSegments) ? segments[i + 1].startTime : endTime;
+		const float endSpeed = seg.startSpeed + seg.acceleration * (segEndTime - seg.startTime);
+		const float compensationSpeed = compensationClocks * seg.acceleration;
+		if (seg.startSpeed + compensationSpeed < 0.0 || endSpeed + compensationSpeed < 0.0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Input shaper
+
+InputShaper::InputShaper()
+	: type(InputShaperType::none), frequency(40.0), damping(0.1), numImpulses(0), averageDelay(0.0), numShapedMoves(0), numUnshapedMoves(0)
+{
+}
+
+// Process the input shaping parameters of M593.
+// Return true if the command was for input shaping, false if it should be treated as a dynamic acceleration adjustment command.
+bool InputShaper::Configure(GCodeBuffer& gb, const StringRef& reply, bool& error)
+{
+	bool seen = false;
+	if (gb.Seen('P'))
+	{
+		String<7> typeName;
+		if (!gb.GetPossiblyQuotedString(typeName.GetRef()))
+		{
+			reply.copy("Missing input shaper type");
+			error = true;
+			return true;
+		}
+
+		if (StringEquals(typeName.c_str(), "daa"))
+		{
+			type = InputShaperType::none;
+			return false;					// let the caller handle the dynamic acceleration adjustment parameters
+		}
+		else if (StringEquals(typeName.c_str(), "none"))
+		{
+			type = InputShaperType::none;
+		}
+		else if (StringEquals(typeName.c_str(), "zv"))
+		{
+			type = InputShaperType::zv;
+		}
+		else if (StringEquals(typeName.c_str(), "zvd"))
+		{
+			type = InputShaperType::zvd;
+		}
+		else if (StringEquals(typeName.c_str(), "ei"))
+		{
+			type = InputShaperType::ei;
+		}
+		else if (StringEquals(typeName.c_str(), "scurve"))
+		{
+			type = InputShaperType::scurve;
+		}
+		else
+		{
+			reply.printf("Unknown input shaper type '%s'", typeName.c_str());
+			error = true;
+			return true;
+		}
+		seen = true;
+	}
+	else if (type == InputShaperType::none)
+	{
+		return false;						// not using input shaping, so the F and L parameters are for dynamic acceleration adjustment
+	}
+
+	if (gb.Seen('F'))
+	{
+		const float f = gb.GetFValue();
+		if (f < 4.0 || f > 1000.0)
+		{
+			reply.copy("Input shaper frequency must be between 4 and 1000Hz");
+			error = true;
+			return true;
+		}
+		frequency = f;
+		seen = true;
+	}
+
+	if (gb.Seen('S'))
+	{
+		const float d = gb.GetFValue();
+		if (d < 0.0 || d > 0.99)
+		{
+			reply.copy("Input shaper damping ratio must be between 0 and 0.99");
+			error = true;
+			return true;
+		}
+		damping = d;
+		seen = true;
+	}
+
+	if (seen)
+	{
+		CalculateImpulses();
+	}
+	else
+	{
+		AppendDetails(reply);
+	}
+	return true;
+}
+
+void InputShaper::AppendDetails(const StringRef& reply) const
+{
+	if (type == InputShaperType::none)
+	{
+		reply.cat("Input shaping is disabled");
+	}
+	else if (type == InputShaperType::scurve)
+	{
+		reply.catf("S-curve acceleration with jerk time %.1fms (cancels ringing at %.1fHz)", (double)(1000.0/frequency), (double)frequency);
+	}
+	else
+	{
+		const char * const typeName = (type == InputShaperType::zv) ? "ZV" : (type == InputShaperType::zvd) ? "ZVD" : "EI";
+		reply.catf("Input shaping %s at %.1fHz, damping ratio %.2f", typeName, (double)frequency, (double)damping);
+	}
+}
+
+// Calculate the impulse amplitudes and delays for the selected shaper
+void InputShaper::CalculateImpulses()
+{
+	const float sqrtOneMinusDampingSquared = sqrtf(1.0 - fsquare(damping));
+	const float k = expf(-damping * Pi/sqrtOneMinusDampingSquared);
+	float impulseSpacing = (0.5 * StepClockRate)/(frequency * sqrtOneMinusDampingSquared);	// half the damped period
+
+	switch (type)
+	{
+	case InputShaperType::zv:
+		numImpulses = 2;
+		amplitudes[0] = 1.0;
+		amplitudes[1] = k;
+		break;
+
+	case InputShaperType::zvd:
+		numImpulses = 3;
+		amplitudes[0] = 1.0;
+		amplitudes[1] = 2 * k;
+		amplitudes[2] = fsquare(k);
+		break;
+
+	case InputShaperType::ei:
+		{
+			constexpr float VibrationTolerance = 0.05;
+			numImpulses = 3;
+			amplitudes[0] = 0.25 * (1.0 + VibrationTolerance);
+			amplitudes[1] = 0.5 * (1.0 - VibrationTolerance) * k;
+			amplitudes[2] = amplitudes[0] * fsquare(k);
+		}
+		break;
+
+	case InputShaperType::scurve:
+		// Equal impulses spread over one period of the frequency. The damping ratio is not used.
+		numImpulses = ShapedProfile::SCurveSteps;
+		for (size_t i = 0; i < numImpulses; ++i)
+		{
+			amplitudes[i] = 1.0;
+		}
+		impulseSpacing = (float)StepClockRate/(frequency * ShapedProfile::SCurveSteps);
+		break;
+
+	case InputShaperType::none:
+	default:
+		numImpulses = 0;
+		return;
+	}
+
+	float total = 0.0;
+	for (size_t i = 0; i < numImpulses; ++i)
+	{
+		total += amplitudes[i];
+	}
+
+	averageDelay = 0.0;
+	for (size_t i = 0; i < numImpulses; ++i)
+	{
+		amplitudes[i] /= total;
+		delays[i] = i * impulseSpacing;
+		averageDelay += amplitudes[i] * delays[i];
+	}
+}
+
+// Add a shaped acceleration or deceleration phase to the profile, updating the time, distance and speed.
+// The acceleration 'accel' applied for 'duration' is convolved with the impulses, giving a series of constant-acceleration segments.
+// All values are in step clocks and mm.
+void InputShaper::AddPhase(ShapedProfile& profile, float& t, float& s, float& v, float accel, float duration) const
+{
+	// Each impulse starts its share of the acceleration at its delay and ends it 'duration' later. Sort the times at which the acceleration changes.
+	float changeTimes[2 * ShapedProfile::MaxImpulses];
+	size_t numChanges = 0;
+	for (size_t i = 0; i < numImpulses; ++i)
+	{
+		changeTimes[numChanges++] = delays[i];
+		changeTimes[numChanges++] = delays[i] + duration;
+	}
+	for (size_t i = 1; i < numChanges; ++i)
+	{
+		const float temp = changeTimes[i];
+		size_t j = i;
+		while (j != 0 && changeTimes[j - 1] > temp)
+		{
+			changeTimes[j] = changeTimes[j - 1];
+			--j;
+		}
+		changeTimes[j] = temp;
+	}
+
+	const float phaseStartTime = t;
+	for (size_t i = 0; i + 1 < numChanges; ++i)
+	{
+		const float segDuration = changeTimes[i + 1] - changeTimes[i];
+		if (segDuration >= 1.0)				// ignore segments shorter than one step clock
+		{
+			const float midTime = (changeTimes[i] + changeTimes[i + 1]) * 0.5;
+			float segAccel = 0.0;
+			for (size_t j = 0; j < numImpulses; ++j)
+			{
+				if (midTime >= delays[j] && midTime < delays[j] + duration)
+				{
+					segAccel += amplitudes[j];
+				}
+			}
+			segAccel *= accel;
+			profile.AddSegment(phaseStartTime + changeTimes[i], s, v, segAccel);
+			s += (v + 0.5 * segAccel * segDuration) * segDuration;
+			v += segAccel * segDuration;
+		}
+	}
+	t = phaseStartTime + changeTimes[numChanges - 1];
+}
+
+// Plan the shaped motion profile of a move, returning nullptr if it can't be shaped.
+// Speeds are in mm/sec and accelerations in mm/sec^2.
+ShapedProfile *InputShaper::PlanMove(float startSpeed, float topSpeed, float endSpeed, float acceleration, float deceleration,
+										float accelDistance, float decelDistance, float totalDistance)
+{
+	const bool shapeAccel = topSpeed > startSpeed && accelDistance > 0.0;
+	const bool shapeDecel = topSpeed > endSpeed && decelDistance > 0.0;
+	if (!shapeAccel && !shapeDecel)
+	{
+		return nullptr;						// nothing to shape
+	}
+
+	// Shaping each phase delays the impulse-weighted fraction of its speed change by the shaper duration, so it needs extra distance
+	const float shaperDuration = delays[numImpulses - 1] * (1.0/StepClockRate);
+	const float meanDelay = averageDelay * (1.0/StepClockRate);
+	const float shapedAccelDistance = (shapeAccel)
+										? accelDistance + startSpeed * shaperDuration + (topSpeed - startSpeed) * (shaperDuration - meanDelay)
+										: 0.0;
+	const float shapedDecelDistance = (shapeDecel)
+										? decelDistance + endSpeed * shaperDuration + (topSpeed - endSpeed) * meanDelay
+										: 0.0;
+	const float steadyDistance = totalDistance - shapedAccelDistance - shapedDecelDistance;
+	if (steadyDistance < 0.0)
+	{
+		++numUnshapedMoves;					// not enough room to shape this move
+		return nullptr;
+	}
+
+	ShapedProfile * const profile = ShapedProfile::Allocate();
+	if (profile == nullptr)
+	{
+		++numUnshapedMoves;
+		return nullptr;
+	}
+
+	// Convert speeds and accelerations to units of step clocks
+	constexpr float ClocksToSeconds = 1.0/StepClockRate;
+	float t = 0.0, s = 0.0, v = startSpeed * ClocksToSeconds;
+	if (shapeAccel)
+	{
+		AddPhase(*profile, t, s, v, acceleration * fsquare(ClocksToSeconds), ((topSpeed - startSpeed)/acceleration) * StepClockRate);
+	}
+
+	// Use the top speed in the steady phase rather than the speed that the shaped phase reached, so that rounding errors don't accumulate
+	v = topSpeed * ClocksToSeconds;
+	const float steadyStartDistance = (shapeAccel) ? shapedAccelDistance : 0.0;
+	profile->AddSegment(t, steadyStartDistance, v, 0.0);
+	s = totalDistance - shapedDecelDistance;
+	t += (s - steadyStartDistance)/v;
+
+	if (shapeDecel)
+	{
+		AddPhase(*profile, t, s, v, -deceleration * fsquare(ClocksToSeconds), ((topSpeed - endSpeed)/deceleration) * StepClockRate);
+	}
+	profile->endTime = t;
+	++numShapedMoves;
+	return profile;
+}
+
+void InputShaper::Diagnostics(MessageType mtype)
+{
+	reprap.GetPlatform().MessageF(mtype, "Shaped moves: %u, unshaped moves: %u\n", numShapedMoves, numUnshapedMoves);
+	numShapedMoves = numUnshapedMoves = 0;
+}
+
+#endif
+
+// End
@@ -0,0 +1,110 @@
+/*
+ * InputShaper.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Input shaping of the acceleration and deceleration phases of moves.
+ *  Each acceleration or deceleration phase of a move is convolved with a series of impulses, which turns it into a sequence of
+ *  constant-acceleration segments that does not excite ringing at the configured frequency. The shaped phases take longer and cover
+ *  more distance than the original ones, so the steady speed phase is shortened to compensate. Moves that don't have enough steady speed
+ *  distance to allow this are not shaped.
+ *
+ *  S-curve acceleration uses the same mechanism. Convolving a constant acceleration phase with a rectangular pulse of duration T makes the
+ *  acceleration ramp up and down over T, so the jerk is limited to acceleration/T, and a rectangular pulse of duration T also cancels ringing
+ *  at 1/T Hz. We approximate the pulse by SCurveSteps equal impulses, so the acceleration ramps in that number of steps.
+ *  The speeds at the start and end of each move are unchanged, so lookahead doesn't need to know whether moves are shaped.
+ */
+
+#ifndef SRC_MOVEMENT_INPUTSHAPER_H_
+#define SRC_MOVEMENT_INPUTSHAPER_H_
+
+#include "RepRapFirmware.h"
+#include "MessageType.h"
+#include "Libraries/General/PoolStats.h"
+
+#if SUPPORT_INPUT_SHAPING
+
+enum class InputShaperType : uint8_t
+{
+	none = 0,
+	zv,
+	zvd,
+	ei,
+	scurve
+};
+
+// One constant-acceleration segment of a shaped move. Times are in step clocks from the start of the move, distances in mm along the move.
+struct MotionSegment
+{
+	float startTime;
+	float startDistance;
+	float startSpeed;						// mm per step clock
+	float acceleration;						// mm per step clock squared, negative when decelerating
+};
+
+// The shaped motion profile of a prepared move
+class ShapedProfile
+{
+public:
+	friend class InputShaper;
+
+	static constexpr size_t SCurveSteps = 4;
+	static constexpr size_t MaxImpulses = SCurveSteps;
+	static constexpr size_t MaxSegments = 2 * (2 * MaxImpulses - 1) + 1;	// shaped acceleration phase, steady speed phase, shaped deceleration phase
+
+	ShapedProfile(ShapedProfile *n) : next(n), numSegments(0) { }
+
+	static void InitialAllocate(unsigned int num);
+	static ShapedProfile *Allocate();
+	static void Release(ShapedProfile *item);
+	static unsigned int NumFree() { return numFree; }
+
+	size_t NumSegments() const { return numSegments; }
+	const MotionSegment& GetSegment(size_t n) const { return segments[n]; }
+	float GetInitialSpeed() const { return segments[0].startSpeed; }
+	float GetEndTime() const { return endTime; }
+	bool AllowsPressureAdvance(float compensationClocks) const;
+
+private:
+	void AddSegment(float startTime, float startDistance, float startSpeed, float acceleration);
+
+	static ShapedProfile *freeList;
+	static unsigned int numFree;
+	static PoolStats poolStats;
+
+	ShapedProfile *next;
+	size_t numSegments;
+	float endTime;
+	MotionSegment segments[MaxSegments];
+};
+
+class InputShaper
+{
+public:
+	InputShaper();
+
+	bool Configure(GCodeBuffer& gb, const StringRef& reply, bool& error);	// process the shaping parameters of M593, return true if any were seen
+	void AppendDetails(const StringRef& reply) const;
+	bool IsShaping() const { return type != InputShaperType::none; }
+	ShapedProfile *PlanMove(float startSpeed, float topSpeed, float endSpeed, float acceleration, float deceleration,
+								float accelDistance, float decelDistance, float totalDistance);
+	void Diagnostics(MessageType mtype);
+
+private:
+	void CalculateImpulses();
+	void AddPhase(ShapedProfile& profile, float& t, float& s, float& v, float accel, float duration) const;
+
+	InputShaperType type;
+	float frequency;						// the ringing frequency in Hz
+	float damping;							// the damping ratio
+	size_t numImpulses;
+	float amplitudes[ShapedProfile::MaxImpulses];
+	float delays[ShapedProfile::MaxImpulses];		// in step clocks
+	float averageDelay;						// the amplitude-weighted mean delay in step clocks
+	unsigned int numShapedMoves;
+	unsigned int numUnshapedMoves;
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_INPUTSHAPER_H_ */
@@ -19,6 +19,7 @@ constexpr float DefaultAnchorB[3] = { 2000.0,  1000.0, -100.0};
 constexpr float DefaultAnchorC[3] = {-2000.0,  1000.0, -100.0};
 constexpr float DefaultAnchorDz = 3000.0;
 constexpr float DefaultPrintRadius = 1500.0;
+constexpr float DefaultSpoolRadius = 75.0;
 
 // Constructor
 HangprinterKinematics::HangprinterKinematics()
@@ -34,6 +35,11 @@ void HangprinterKinematics::Init()
 	ARRAY_INIT(anchorA, DefaultAnchorA);
 	ARRAY_INIT(anchorB, DefaultAnchorB);
 	ARRAY_INIT(anchorC, DefaultAnchorC);
+	for (float& r : spoolRadii)
+	{
+		r = DefaultSpoolRadius;
+	}
+	spoolBuildupFactor = 0.0;
 	doneAutoCalibration = false;
 	Recalc();
 }
@@ -72,6 +78,24 @@ void HangprinterKinematics::Recalc()
 		  ) * 2;
 	U = (anchorA[2] * P2) + (anchorA[0] * Q * P) + (anchorA[1] * R * P);
 	A = (P2 + fsquare(Q) + fsquare(R)) * 2;
+
+	// Precompute the spool buildup constants. As line is paid out the spool radius r falls so that r^2 = r0^2 - k * (L - L0),
+	// where r0 and L0 are the spool radius and line length with the head at the origin. Integrating dL/r, the distance that the motor
+	// has turned measured at the origin spool radius is D0 - (2 * r0/k) * sqrt(C - k * L), where C = r0^2 + k * L0 and D0 = L0 + 2 * r0^2/k.
+	anchorD[X_AXIS] = anchorD[Y_AXIS] = 0.0;
+	anchorD[Z_AXIS] = anchorDz;
+	const float origin[3] = { 0.0, 0.0, 0.0 };
+	const float * const anchors[HANGPRINTER_AXES] = { anchorA, anchorB, anchorC, anchorD };
+	for (size_t axis = 0; axis < HANGPRINTER_AXES; ++axis)
+	{
+		originLineLengths[axis] = sqrtf(LineLengthSquared(origin, anchors[axis]));
+		if (spoolBuildupFactor > 0.0)
+		{
+			spoolC[axis] = fsquare(spoolRadii[axis]) + spoolBuildupFactor * originLineLengths[axis];
+			spoolK[axis] = 2 * spoolRadii[axis]/spoolBuildupFactor;
+			spoolD0[axis] = originLineLengths[axis] + spoolK[axis] * spoolRadii[axis];
+		}
+	}
 }
 
 // Return the name of the current kinematics
@@ -90,6 +114,7 @@ bool HangprinterKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 		bool seenNonGeometry = false;
 		gb.TryGetFValue('S', segmentsPerSecond, seenNonGeometry);
 		gb.TryGetFValue('T', minSegmentLength, seenNonGeometry);
+		gb.TryGetFValue('Q', segmentationTolerance, seenNonGeometry);
 		if (gb.TryGetFloatArray('A', 3, anchorA, reply, seen))
 		{
 			error = true;
@@ -106,6 +131,12 @@ bool HangprinterKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 			return true;
 		}
 		gb.TryGetFValue('D', anchorDz, seen);
+		if (gb.TryGetFloatArray('R', HANGPRINTER_AXES, spoolRadii, reply, seen, true))
+		{
+			error = true;
+			return true;
+		}
+		gb.TryGetFValue('U', spoolBuildupFactor, seen);
 
 		if (seen || seenNonGeometry)
 		{
@@ -125,6 +156,15 @@ bool HangprinterKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 							(double)anchorC[X_AXIS], (double)anchorC[Y_AXIS], (double)anchorC[Z_AXIS],
 							(double)anchorDz, (double)printRadius,
 							(int)segmentsPerSecond, (double)minSegmentLength);
+			if (segmentationTolerance > 0.0)
+			{
+				reply.catf(", segmentation tolerance %.3fmm", (double)segmentationTolerance);
+			}
+			if (spoolBuildupFactor > 0.0)
+			{
+				reply.catf(", spool radii %.2f:%.2f:%.2f:%.2f buildup factor %.4f",
+							(double)spoolRadii[A_AXIS], (double)spoolRadii[B_AXIS], (double)spoolRadii[C_AXIS], (double)spoolRadii[D_AXIS], (double)spoolBuildupFactor);
+			}
 		}
 		return seen;
 	}
@@ -151,6 +191,20 @@ bool HangprinterKinematics::CartesianToMotorSteps(const float machinePos[], cons
 							+ fsquare(anchorDz - machinePos[Z_AXIS]);
 	if (aSquared > 0.0 && bSquared > 0.0 && cSquared > 0.0 && dSquared > 0.0)
 	{
+		if (spoolBuildupFactor > 0.0)
+		{
+			const float lineLengths[HANGPRINTER_AXES] = { sqrtf(aSquared), sqrtf(bSquared), sqrtf(cSquared), sqrtf(dSquared) };
+			for (size_t axis = 0; axis < HANGPRINTER_AXES; ++axis)
+			{
+				const float radiusSquared = spoolC[axis] - spoolBuildupFactor * lineLengths[axis];
+				if (!(radiusSquared > 0.0))
+				{
+					return false;										// the spool would be empty
+				}
+				motorPos[axis] = lrintf((spoolD0[axis] - spoolK[axis] * sqrtf(radiusSquared)) * stepsPerMm[axis]);
+			}
+			return true;
+		}
 		motorPos[A_AXIS] = lrintf(sqrtf(aSquared) * stepsPerMm[A_AXIS]);
 		motorPos[B_AXIS] = lrintf(sqrtf(bSquared) * stepsPerMm[B_AXIS]);
 		motorPos[C_AXIS] = lrintf(sqrtf(cSquared) * stepsPerMm[C_AXIS]);
@@ -160,10 +214,66 @@ bool HangprinterKinematics::CartesianToMotorSteps(const float machinePos[], cons
 	return false;
 }
 
+// Convert a sequence of Cartesian positions to motor positions.
+// The anchor coordinates and steps/mm are loaded once for all the points.
+bool HangprinterKinematics::CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const
+{
+	if (spoolBuildupFactor > 0.0)
+	{
+		// Spool buildup compensation isn't worth a special case here
+		for (size_t i = 0; i < numPoints; ++i)
+		{
+			if (!CartesianToMotorSteps(machinePos[i], stepsPerMm, numVisibleAxes, numTotalAxes, motorPos[i], isCoordinated))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const float ax = anchorA[X_AXIS], ay = anchorA[Y_AXIS], az = anchorA[Z_AXIS];
+	const float bx = anchorB[X_AXIS], by = anchorB[Y_AXIS], bz = anchorB[Z_AXIS];
+	const float cx = anchorC[X_AXIS], cy = anchorC[Y_AXIS], cz = anchorC[Z_AXIS];
+	const float dz = anchorDz;
+	const float aSteps = stepsPerMm[A_AXIS], bSteps = stepsPerMm[B_AXIS], cSteps = stepsPerMm[C_AXIS], dSteps = stepsPerMm[D_AXIS];
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		const float x = machinePos[i][X_AXIS], y = machinePos[i][Y_AXIS], z = machinePos[i][Z_AXIS];
+		const float aSquared = fsquare(ax - x) + fsquare(ay - y) + fsquare(az - z);
+		const float bSquared = fsquare(bx - x) + fsquare(by - y) + fsquare(bz - z);
+		const float cSquared = fsquare(cx - x) + fsquare(cy - y) + fsquare(cz - z);
+		const float dSquared = fsquare(x) + fsquare(y) + fsquare(dz - z);
+		if (!(aSquared > 0.0 && bSquared > 0.0 && cSquared > 0.0 && dSquared > 0.0))
+		{
+			return false;
+		}
+		int32_t * const mp = motorPos[i];
+		mp[A_AXIS] = lrintf(sqrtf(aSquared) * aSteps);
+		mp[B_AXIS] = lrintf(sqrtf(bSquared) * bSteps);
+		mp[C_AXIS] = lrintf(sqrtf(cSquared) * cSteps);
+		mp[D_AXIS] = lrintf(sqrtf(dSquared) * dSteps);
+	}
+	return true;
+}
+
 // Convert motor coordinates to machine coordinates. Used after homing and after individual motor moves.
 void HangprinterKinematics::MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const
 {
-	InverseTransform(motorPos[A_AXIS]/stepsPerMm[A_AXIS], motorPos[B_AXIS]/stepsPerMm[B_AXIS], motorPos[C_AXIS]/stepsPerMm[C_AXIS], machinePos);
+	InverseTransform(MotorDistanceToLineLength(A_AXIS, motorPos[A_AXIS]/stepsPerMm[A_AXIS]),
+					 MotorDistanceToLineLength(B_AXIS, motorPos[B_AXIS]/stepsPerMm[B_AXIS]),
+					 MotorDistanceToLineLength(C_AXIS, motorPos[C_AXIS]/stepsPerMm[C_AXIS]),
+					 machinePos);
+}
+
+// Convert the distance that a spool motor has turned, measured at the origin spool radius, to the line length
+float HangprinterKinematics::MotorDistanceToLineLength(size_t axis, float motorDistance) const
+{
+	if (spoolBuildupFactor > 0.0)
+	{
+		const float radius = (spoolD0[axis] - motorDistance)/spoolK[axis];
+		return (spoolC[axis] - fsquare(radius))/spoolBuildupFactor;
+	}
+	return motorDistance;
 }
 
 // Return true if the specified XY position is reachable by the print head reference point.
@@ -20,6 +20,7 @@ public:
 	const char *GetName(bool forStatusReport) const override;
 	bool Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error) override;
 	bool CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const override;
+	bool CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const override;
 	void MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const override;
 	bool SupportsAutoCalibration() const override { return true; }
 	bool DoAutoCalibration(size_t numFactors, const RandomProbePointSet& probePoints, const StringRef& reply) override;
@@ -53,6 +54,7 @@ private:
 	void Init();
 	void Recalc();
 	float LineLengthSquared(const float machinePos[3], const float anchor[3]) const;	// Calculate the square of the line length from a spool from a Cartesian coordinate
+	float MotorDistanceToLineLength(size_t axis, float motorDistance) const;			// Convert the distance a spool motor has moved to a line length, allowing for spool buildup
 	void InverseTransform(float La, float Lb, float Lc, float machinePos[3]) const;
 
 	floatc_t ComputeDerivative(unsigned int deriv, float La, float Lb, float Lc) const;	// Compute the derivative of height with respect to a parameter at a set of motor endpoints
@@ -62,6 +64,8 @@ private:
 	float anchorA[3], anchorB[3], anchorC[3];				// XYZ coordinates of the anchors
 	float anchorDz;
 	float printRadius;
+	float spoolRadii[HANGPRINTER_AXES];						// Effective spool radii with the head at the origin
+	float spoolBuildupFactor;								// Decrease in the square of the spool radius per mm of line paid out, or 0 for no buildup compensation
 
 	// Derived parameters
 	float printRadiusSquared;
@@ -70,6 +74,11 @@ private:
 	float Yab, Ybc, Yca;
 	float Zab, Zbc, Zca;
 	float P, Q, R, P2, U, A;
+	float anchorD[3];										// The D anchor as a vector, so that we can treat it like the others
+	float originLineLengths[HANGPRINTER_AXES];				// The line lengths with the head at the origin
+	float spoolC[HANGPRINTER_AXES];							// Square of spool radius plus buildup factor times origin line length
+	float spoolK[HANGPRINTER_AXES];							// Twice the spool radius divided by the buildup factor
+	float spoolD0[HANGPRINTER_AXES];						// Origin line length plus spoolK times spool radius
 
 	bool doneAutoCalibration;							// True if we have done auto calibration
 };
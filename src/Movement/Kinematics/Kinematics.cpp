@@ -26,10 +26,63 @@ const char * const Kinematics::StandardHomingFileNames[] = AXES_("homex.g", "hom
 
 // Constructor. Pass segsPerSecond <= 0.0 to get non-segmented kinematics.
 Kinematics::Kinematics(KinematicsType t, float segsPerSecond, float minSegLength, bool doUseRawG0)
-	: segmentsPerSecond(segsPerSecond), minSegmentLength(minSegLength), useSegmentation(segsPerSecond > 0.0), useRawG0(doUseRawG0), type(t)
+	: segmentsPerSecond(segsPerSecond), minSegmentLength(minSegLength), segmentationTolerance(0.0), useSegmentation(segsPerSecond > 0.0), useRawG0(doUseRawG0), type(t)
 {
 }
 
+// Convert a sequence of Cartesian positions to motor positions. This default implementation converts them one at a time.
+bool Kinematics::CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const
+{
+	bool ok = true;
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		if (!CartesianToMotorSteps(machinePos[i], stepsPerMm, numVisibleAxes, numTotalAxes, motorPos[i], isCoordinated))
+		{
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// Return how many segments a move needs so that its path stays within the segmentation tolerance of a straight line, but no more than maxSegments.
+// Between the ends of a segment the motors move linearly, so the path deviates from the straight line by an amount that is roughly proportional to
+// the square of the segment length. We measure the deviation at the middle of the move if it were done as a single segment and scale it.
+unsigned int Kinematics::GetAdaptiveSegments(const float startPos[], const float endPos[], size_t numVisibleAxes, size_t numTotalAxes, unsigned int maxSegments) const
+{
+	if (segmentationTolerance <= 0.0 || maxSegments <= 1)
+	{
+		return maxSegments;
+	}
+
+	const float * const stepsPerMm = reprap.GetPlatform().GetDriveStepsPerUnit();
+	float endPoints[2][MaxAxes];
+	memcpy(endPoints[0], startPos, numTotalAxes * sizeof(float));
+	memcpy(endPoints[1], endPos, numTotalAxes * sizeof(float));
+	int32_t endMotorPos[2][MaxAxes];
+	if (!CartesianToMotorStepsBatch(2, endPoints, stepsPerMm, numVisibleAxes, numTotalAxes, endMotorPos, true))
+	{
+		return maxSegments;
+	}
+
+	// Find where the linear motor movement would take the head half way through the move
+	int32_t midMotorPos[MaxAxes];
+	for (size_t axis = 0; axis < numTotalAxes; ++axis)
+	{
+		midMotorPos[axis] = (int32_t)(((int64_t)endMotorPos[0][axis] + endMotorPos[1][axis])/2);
+	}
+	float midPos[MaxAxes];
+	MotorStepsToCartesian(midMotorPos, stepsPerMm, numVisibleAxes, numTotalAxes, midPos);
+
+	float deviationSquared = 0.0;
+	for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+	{
+		deviationSquared += fsquare(midPos[axis] - (startPos[axis] + endPos[axis]) * 0.5);
+	}
+
+	const float segmentsNeeded = ceilf(sqrtf(sqrtf(deviationSquared)/segmentationTolerance));
+	return (segmentsNeeded >= (float)maxSegments) ? maxSegments : max<unsigned int>((unsigned int)segmentsNeeded, 1);
+}
+
 // Set or report the parameters from a M665, M666 or M669 command
 // This is the fallback function for when the derived class doesn't use the specified M-code
 bool Kinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error)
@@ -10,12 +10,15 @@
 
 #include "RepRapFirmware.h"
 #include "Libraries/Math/Matrix.h"
+#include "Libraries/General/FreelistManager.h"
 
 inline floatc_t fcsquare(floatc_t a)
 {
 	return a * a;
 }
 
+constexpr size_t MaxCalibrationDerivatives = 9;			// the maximum number of factors that GetCalibrationDerivatives can return
+
 // Different types of kinematics we support. Each of these has a class to represent it.
 // These must have the same numeric assignments as the K parameter of the M669 command, as documented in the GCodes wiki page
 enum class KinematicsType : uint8_t
@@ -78,6 +81,12 @@ public:
 	// Return true if successful, false if we were unable to convert
 	virtual bool CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const = 0;
 
+	// Convert a sequence of Cartesian positions to motor positions, for example the ends of the segments of a move.
+	// The parameters are as for CartesianToMotorSteps except that 'machinePos' and 'motorPos' hold 'numPoints' positions each.
+	// Return true if all the positions were converted, false if any of them could not be converted.
+	// Kinematics that do a lot of calculation per point should override this to avoid repeated virtual calls and to reuse terms that are common to all points.
+	virtual bool CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const;
+
 	// Convert motor positions (measured in steps from reference position) to Cartesian coordinates
 	// 'motorPos' is the input vector of motor positions
 	// 'stepsPerMm' is as configured in M92. On a Scara or polar machine this would actually be steps per degree.
@@ -94,6 +103,13 @@ public:
 	virtual bool DoAutoCalibration(size_t numFactors, const RandomProbePointSet& probePoints, const StringRef& reply)
 	pre(SupportsAutoCalibration()) { return false; }
 
+	// Compute the derivatives of the probed height with respect to the calibration factors at the specified machine XY position, so that the
+	// calibration can be estimated while the points are being probed. Return the number of derivatives, or zero if this kinematics doesn't support it.
+	virtual size_t GetCalibrationDerivatives(float x, float y, floatc_t derivatives[MaxCalibrationDerivatives]) const { return 0; }
+
+	// Return which of the derivatives from GetCalibrationDerivatives is used for a factor when calibrating the specified number of factors
+	virtual size_t GetCalibrationDerivativeIndex(size_t numFactors, size_t factor) const { return factor; }
+
 	// Set the default parameters that are changed by auto calibration back to their defaults.
 	// Do nothing if auto calibration is not supported.
 	virtual void SetCalibrationDefaults() { }
@@ -162,8 +178,12 @@ public:
 	// The speeds along individual Cartesian axes have already been limited before this is called.
 	virtual void LimitSpeedAndAcceleration(DDA& dda, const float *normalisedDirectionVector) const = 0;
 
-	// Return true if the specified axis is a continuous rotation axis
-	virtual bool IsContinuousRotationAxis(size_t axis) const { return false; }
+	// Return the set of axes that are continuous rotation axes. DDA::Init calls this once per move rather than asking about each axis.
+	virtual AxesBitmap GetContinuousRotationAxes() const { return 0; }
+
+	// Allocate kinematics objects from the size-class pools, so that we reuse the memory when the kinematics type is changed
+	void* operator new(size_t sz) { return PoolAllocate(sz); }
+	void operator delete(void* p, size_t sz) { PoolRelease(p, sz); }
 
 	// Override this virtual destructor if your constructor allocates any dynamic memory
 	virtual ~Kinematics() { }
@@ -179,6 +199,8 @@ public:
 	bool UseRawG0() const { return useRawG0; }
 	float GetSegmentsPerSecond() const pre(UseSegmentation()) { return segmentsPerSecond; }
 	float GetMinSegmentLength() const pre(UseSegmentation()) { return minSegmentLength; }
+	unsigned int GetAdaptiveSegments(const float startPos[], const float endPos[], size_t numVisibleAxes, size_t numTotalAxes, unsigned int maxSegments) const
+		pre(UseSegmentation());
 
 protected:
 	// Constructor. Pass segsPerSecond <= 0.0 to get non-segmented motion.
@@ -194,6 +216,7 @@ protected:
 
 	float segmentsPerSecond;				// if we are using segmentation, the target number of segments/second
 	float minSegmentLength;					// if we are using segmentation, the minimum segment size
+	float segmentationTolerance;			// if nonzero, the maximum path deviation that we allow, used to reduce the number of segments where the kinematics is nearly linear
 
 	static const char * const HomeAllFileName;
 	static const char * const StandardHomingFileNames[];
@@ -0,0 +1,211 @@
+/*
+ * KinematicsBenchmark.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "KinematicsBenchmark.h"
+
+#if SUPPORT_KINEMATICS_BENCHMARK
+
+#include "Kinematics.h"
+#include "GCodes/GCodeBuffer.h"
+#include "Movement/DDA.h"
+#include "Movement/StageTimer.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+DDA *KinematicsBenchmark::dda = nullptr;
+DDA *KinematicsBenchmark::previousDda = nullptr;
+float KinematicsBenchmark::batchPositions[BatchSize][MaxAxes];
+int32_t KinematicsBenchmark::batchMotorPositions[BatchSize][MaxAxes];
+
+// Process M942.
+// M942 runs the benchmark for every type of kinematics. K<n> runs it for just one type, numbered as in M669.
+// P<n> sets the number of points along the X and Y axes, so that P<n> uses up to n*n*3 points.
+/*static*/ GCodeResult KinematicsBenchmark::Run(GCodeBuffer& gb, const StringRef& reply)
+{
+	unsigned int pointsPerAxis = DefaultPointsPerAxis;
+	if (gb.Seen('P'))
+	{
+		pointsPerAxis = gb.GetUIValue();
+		if (pointsPerAxis < 2 || pointsPerAxis > MaxPointsPerAxis)
+		{
+			reply.printf("Number of points per axis must be between 2 and %u", MaxPointsPerAxis);
+			return GCodeResult::error;
+		}
+	}
+
+	KinematicsType onlyType = KinematicsType::unknown;
+	if (gb.Seen('K'))
+	{
+		const uint32_t k = gb.GetUIValue();
+		if (k >= (uint32_t)KinematicsType::unknown)
+		{
+			reply.copy("Unknown kinematics type");
+			return GCodeResult::error;
+		}
+		onlyType = (KinematicsType)k;
+	}
+
+	if (dda == nullptr)
+	{
+		// Like the move trace, the benchmark is rarely used, so we only allocate the moves it needs when it is first run
+		previousDda = new DDA(nullptr);
+		dda = new DDA(nullptr);
+		dda->SetPrevious(previousDda);
+	}
+
+	StageTimer::EnableCycleCounter();
+	const MessageType mtype = gb.GetResponseMessageType();
+	reprap.GetPlatform().MessageF(mtype, "Kinematics benchmark, mean CPU cycles per call at %" PRIu32 "MHz\n", (uint32_t)(VARIANT_MCK/1000000));
+	for (unsigned int k = 0; k < (unsigned int)KinematicsType::unknown; ++k)
+	{
+		if (onlyType == KinematicsType::unknown || (KinematicsType)k == onlyType)
+		{
+			Kinematics * const kin = Kinematics::Create((KinematicsType)k);
+			if (kin != nullptr)
+			{
+				RunOne(*kin, pointsPerAxis, mtype);
+				delete kin;
+			}
+		}
+	}
+	return GCodeResult::ok;
+}
+
+// Benchmark one kinematics and report the results
+/*static*/ void KinematicsBenchmark::RunOne(Kinematics& kin, unsigned int pointsPerAxis, MessageType mtype)
+{
+	Platform& platform = reprap.GetPlatform();
+	const float * const stepsPerMm = platform.GetDriveStepsPerUnit();
+
+	CycleCount forward, batch, inverse, limit;
+	forward.Clear();
+	batch.Clear();
+	inverse.Clear();
+	limit.Clear();
+	unsigned int numPoints = 0, numFailed = 0;
+	float maxError = 0.0;
+	float previousPos[MaxAxes];
+	bool havePrevious = false;
+	size_t batchCount = 0;
+
+	for (unsigned int zIndex = 0; zIndex < NumZLevels; ++zIndex)
+	{
+		for (unsigned int yIndex = 0; yIndex < pointsPerAxis; ++yIndex)
+		{
+			for (unsigned int xIndex = 0; xIndex < pointsPerAxis; ++xIndex)
+			{
+				// Space the points evenly within the M208 limits, avoiding the limits themselves
+				float pos[MaxAxes];
+				for (float& p : pos)
+				{
+					p = 0.0;
+				}
+				const unsigned int indices[XYZ_AXES] = { xIndex, yIndex, zIndex };
+				const unsigned int numSteps[XYZ_AXES] = { pointsPerAxis, pointsPerAxis, NumZLevels };
+				for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+				{
+					const float minimum = platform.AxisMinimum(axis);
+					pos[axis] = minimum + (platform.AxisMaximum(axis) - minimum) * ((float)indices[axis] + 0.5)/(float)numSteps[axis];
+				}
+				if (!kin.IsReachable(pos[X_AXIS], pos[Y_AXIS], true))
+				{
+					continue;
+				}
+				++numPoints;
+
+				// Convert the point to motor positions and time it
+				int32_t motorPos[MaxAxes];
+				for (int32_t& m : motorPos)
+				{
+					m = 0;
+				}
+				uint32_t startCycles = StageTimer::GetCycles();
+				const bool ok = kin.CartesianToMotorSteps(pos, stepsPerMm, NumAxes, NumAxes, motorPos, true);
+				forward.Add(StageTimer::GetCycles() - startCycles);
+				if (!ok)
+				{
+					++numFailed;
+					havePrevious = false;
+					continue;
+				}
+
+				// Convert it back again and check that we get the original point, to within the step size
+				float roundTrip[MaxAxes];
+				startCycles = StageTimer::GetCycles();
+				kin.MotorStepsToCartesian(motorPos, stepsPerMm, NumAxes, NumAxes, roundTrip);
+				inverse.Add(StageTimer::GetCycles() - startCycles);
+				float errorSquared = 0.0;
+				for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+				{
+					errorSquared += fsquare(roundTrip[axis] - pos[axis]);
+				}
+				maxError = max<float>(maxError, sqrtf(errorSquared));
+
+				// Time LimitSpeedAndAcceleration for the move from the previous point to this one
+				if (havePrevious)
+				{
+					float direction[DRIVES];
+					for (float& d : direction)
+					{
+						d = 0.0;
+					}
+					float distanceSquared = 0.0;
+					for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+					{
+						direction[axis] = pos[axis] - previousPos[axis];
+						distanceSquared += fsquare(direction[axis]);
+					}
+					const float distance = sqrtf(distanceSquared);
+					for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+					{
+						direction[axis] /= distance;
+					}
+
+					memcpy(dda->endPoint, motorPos, sizeof(motorPos));
+					memcpy(dda->directionVector, direction, sizeof(direction));
+					dda->totalDistance = distance;
+					dda->requestedSpeed = dda->acceleration = dda->deceleration = 1.0e6;
+					startCycles = StageTimer::GetCycles();
+					kin.LimitSpeedAndAcceleration(*dda, direction);
+					limit.Add(StageTimer::GetCycles() - startCycles);
+				}
+				memcpy(previousDda->endPoint, motorPos, sizeof(motorPos));
+				memcpy(previousPos, pos, sizeof(pos));
+				havePrevious = true;
+
+				// Collect the points for the batch conversion, which is what segmented moves use
+				memcpy(batchPositions[batchCount], pos, sizeof(pos));
+				++batchCount;
+				if (batchCount == BatchSize)
+				{
+					startCycles = StageTimer::GetCycles();
+					(void)kin.CartesianToMotorStepsBatch(BatchSize, batchPositions, stepsPerMm, NumAxes, NumAxes, batchMotorPositions, true);
+					batch.Add(StageTimer::GetCycles() - startCycles, BatchSize);
+					batchCount = 0;
+				}
+			}
+		}
+	}
+
+	if (numPoints == 0)
+	{
+		platform.MessageF(mtype, "%s: no reachable points within the axis limits\n", kin.GetName());
+	}
+	else
+	{
+		platform.MessageF(mtype, "%s: %u points, forward %" PRIu32 ", batched %" PRIu32 "/point, inverse %" PRIu32 ", limit speed %" PRIu32 ", max round trip error %.4fmm",
+							kin.GetName(), numPoints, forward.Mean(), batch.Mean(), inverse.Mean(), limit.Mean(), (double)maxError);
+		if (numFailed != 0)
+		{
+			platform.MessageF(mtype, ", %u points failed to convert", numFailed);
+		}
+		platform.Message(mtype, "\n");
+	}
+}
+
+#endif
+
+// End
@@ -0,0 +1,56 @@
+/*
+ * KinematicsBenchmark.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  Measures the execution time of the main kinematics functions for each type of kinematics, using a grid of points within the M208 axis limits,
+ *  and checks that converting each point to motor positions and back again returns the original point. Each kinematics is created with its
+ *  default geometry, so the active kinematics is not affected.
+ */
+
+#ifndef SRC_MOVEMENT_KINEMATICS_KINEMATICSBENCHMARK_H_
+#define SRC_MOVEMENT_KINEMATICS_KINEMATICSBENCHMARK_H_
+
+#include "RepRapFirmware.h"
+#include "GCodes/GCodeResult.h"
+#include "MessageType.h"
+
+#if SUPPORT_KINEMATICS_BENCHMARK
+
+class DDA;
+class Kinematics;
+
+class KinematicsBenchmark
+{
+public:
+	static GCodeResult Run(GCodeBuffer& gb, const StringRef& reply);		// process M942
+
+private:
+	static constexpr unsigned int DefaultPointsPerAxis = 10;
+	static constexpr unsigned int MaxPointsPerAxis = 50;
+	static constexpr unsigned int NumZLevels = 3;
+	static constexpr size_t NumAxes = (MaxAxes < 5) ? MaxAxes : 5;		// enough for CoreXYUV kinematics and the 4 motors of a Hangprinter
+	static constexpr size_t BatchSize = 8;								// number of points we convert in each call to CartesianToMotorStepsBatch
+
+	// Accumulated CPU cycles for one function
+	struct CycleCount
+	{
+		uint64_t totalCycles;
+		uint32_t numCalls;
+
+		void Clear() { totalCycles = 0; numCalls = 0; }
+		void Add(uint32_t cycles, uint32_t calls = 1) { totalCycles += cycles; numCalls += calls; }
+		uint32_t Mean() const { return (numCalls == 0) ? 0 : (uint32_t)(totalCycles/numCalls); }
+	};
+
+	static void RunOne(Kinematics& kin, unsigned int pointsPerAxis, MessageType mtype);
+
+	static DDA *dda;													// the moves we pass to LimitSpeedAndAcceleration, some kinematics look at the previous move too
+	static DDA *previousDda;
+	static float batchPositions[BatchSize][MaxAxes];					// working storage for the batch conversions, kept off the stack
+	static int32_t batchMotorPositions[BatchSize][MaxAxes];
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_KINEMATICS_KINEMATICSBENCHMARK_H_ */
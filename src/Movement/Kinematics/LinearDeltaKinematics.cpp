@@ -150,6 +150,49 @@ bool LinearDeltaKinematics::CartesianToMotorSteps(const float machinePos[], cons
 	return ok;
 }
 
+// Convert a sequence of Cartesian positions to motor positions.
+// The tower positions are loaded once, and the height and tilt terms that are common to all three towers are calculated once per point.
+bool LinearDeltaKinematics::CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const
+{
+	const size_t numDeltaAxes = min<size_t>(numVisibleAxes, DELTA_AXES);
+	const float d2 = D2, xt = xTilt, yt = yTilt;
+	float tx[DELTA_AXES], ty[DELTA_AXES], spm[DELTA_AXES];
+	for (size_t axis = 0; axis < numDeltaAxes; ++axis)
+	{
+		tx[axis] = towerX[axis];
+		ty[axis] = towerY[axis];
+		spm[axis] = stepsPerMm[axis];
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		const float * const pos = machinePos[i];
+		int32_t * const mp = motorPos[i];
+		const float x = pos[X_AXIS], y = pos[Y_AXIS];
+		const float heightOffset = pos[Z_AXIS] + (x * xt) + (y * yt);
+		for (size_t axis = 0; axis < numDeltaAxes; ++axis)
+		{
+			const float height = sqrtf(d2 - fsquare(x - tx[axis]) - fsquare(y - ty[axis])) + heightOffset;
+			if (isnan(height) || isinf(height))
+			{
+				ok = false;
+			}
+			else
+			{
+				mp[axis] = lrintf(height * spm[axis]);
+			}
+		}
+
+		// Transform any additional axes linearly
+		for (size_t axis = DELTA_AXES; axis < numVisibleAxes; ++axis)
+		{
+			mp[axis] = lrintf(pos[axis] * stepsPerMm[axis]);
+		}
+	}
+	return ok;
+}
+
 // Convert motor coordinates to machine coordinates. Used after homing and after individual motor moves.
 void LinearDeltaKinematics::MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const
 {
@@ -226,7 +269,6 @@ void LinearDeltaKinematics::GetAssumedInitialPosition(size_t numAxes, float posi
 // Auto calibrate from a set of probe points returning true if it failed
 bool LinearDeltaKinematics::DoAutoCalibration(size_t numFactors, const RandomProbePointSet& probePoints, const StringRef& reply)
 {
-	const size_t NumDeltaFactors = 9;		// maximum number of delta machine factors we can adjust
 	const size_t numPoints = probePoints.NumberOfProbePoints();
 
 	if (numFactors < 3 || numFactors > NumDeltaFactors || numFactors == 5)
@@ -263,47 +305,54 @@ bool LinearDeltaKinematics::DoAutoCalibration(size_t numFactors, const RandomPro
 		initialSumOfSquares += fcsquare(zp);
 	}
 
-	// Do 1 or more Newton-Raphson iterations
-	unsigned int iteration = 0;
-	float expectedRmsError;
-	for (;;)
+	// Do Levenberg-Marquardt iterations. We build the normal equations directly from the derivatives at each point, so we don't need to store
+	// the whole derivative matrix, and solve them by Cholesky decomposition. We only accept a step if it reduces the sum of squares,
+	// otherwise we increase the damping and try again. This stops a poorly-conditioned set of probe points from making the calibration diverge.
+	const unsigned int MaxIterations = 5;
+	const floatc_t InitialDamping = 1.0e-4;
+	const floatc_t MaxDamping = 1.0e4;
+	const floatc_t ConvergenceRatio = 0.99;			// stop iterating when an iteration reduces the sum of squares by less than 1%
+	floatc_t damping = InitialDamping;
+	floatc_t sumOfSquares = initialSumOfSquares;
+	for (unsigned int iteration = 0; iteration < MaxIterations; ++iteration)
 	{
-		// Build a Nx9 matrix of derivatives with respect to xa, xb, yc, za, zb, zc, diagonal.
-		FixedMatrix<floatc_t, MaxCalibrationPoints, NumDeltaFactors> derivativeMatrix;
-		for (size_t i = 0; i < numPoints; ++i)
+		// Build the normal equations for least squares fitting. The derivatives are with respect to xa, xb, yc, za, zb, zc, diagonal.
+		FixedMatrix<floatc_t, NumDeltaFactors, NumDeltaFactors + 1> normalMatrix;
+		for (size_t i = 0; i < numFactors; ++i)
 		{
-			for (size_t j = 0; j < numFactors; ++j)
+			for (size_t j = 0; j <= numFactors; ++j)
 			{
-				const size_t adjustedJ = (numFactors == 8 && j >= 6) ? j + 1 : j;		// skip diagonal rod length if doing 8-factor calibration
-				derivativeMatrix(i, j) =
-					ComputeDerivative(adjustedJ, probeMotorPositions(i, DELTA_A_AXIS), probeMotorPositions(i, DELTA_B_AXIS), probeMotorPositions(i, DELTA_C_AXIS));
+				normalMatrix(i, j) = 0.0;
 			}
 		}
 
-		if (reprap.Debug(moduleMove))
-		{
-			PrintMatrix("Derivative matrix", derivativeMatrix, numPoints, numFactors);
-		}
-
-		// Now build the normal equations for least squares fitting
-		FixedMatrix<floatc_t, NumDeltaFactors, NumDeltaFactors + 1> normalMatrix;
-		for (size_t i = 0; i < numFactors; ++i)
+		for (size_t k = 0; k < numPoints; ++k)
 		{
+			floatc_t derivatives[NumDeltaFactors];
 			for (size_t j = 0; j < numFactors; ++j)
 			{
-				floatc_t temp = derivativeMatrix(0, i) * derivativeMatrix(0, j);
-				for (size_t k = 1; k < numPoints; ++k)
+				derivatives[j] =
+					ComputeDerivative(GetCalibrationDerivativeIndex(numFactors, j), probeMotorPositions(k, DELTA_A_AXIS), probeMotorPositions(k, DELTA_B_AXIS), probeMotorPositions(k, DELTA_C_AXIS));
+			}
+
+			const floatc_t residual = -((floatc_t)probePoints.GetZHeight(k) + corrections[k]);
+			for (size_t i = 0; i < numFactors; ++i)
+			{
+				for (size_t j = 0; j <= i; ++j)
 				{
-					temp += derivativeMatrix(k, i) * derivativeMatrix(k, j);
+					normalMatrix(i, j) += derivatives[i] * derivatives[j];
 				}
-				normalMatrix(i, j) = temp;
+				normalMatrix(i, numFactors) += derivatives[i] * residual;
 			}
-			floatc_t temp = derivativeMatrix(0, i) * -((floatc_t)probePoints.GetZHeight(0) + corrections[0]);
-			for (size_t k = 1; k < numPoints; ++k)
+		}
+
+		// Fill in the upper triangle so that the matrix prints properly
+		for (size_t i = 0; i < numFactors; ++i)
+		{
+			for (size_t j = i + 1; j < numFactors; ++j)
 			{
-				temp += derivativeMatrix(k, i) * -((floatc_t)probePoints.GetZHeight(k) + corrections[k]);
+				normalMatrix(i, j) = normalMatrix(j, i);
 			}
-			normalMatrix(i, numFactors) = temp;
 		}
 
 		if (reprap.Debug(moduleMove))
@@ -311,28 +360,42 @@ bool LinearDeltaKinematics::DoAutoCalibration(size_t numFactors, const RandomPro
 			PrintMatrix("Normal matrix", normalMatrix, numFactors, numFactors + 1);
 		}
 
+		// Find the smallest damping that gives a step that reduces the sum of squares
 		floatc_t solution[NumDeltaFactors];
-		normalMatrix.GaussJordan(solution, numFactors);
-
-		if (reprap.Debug(moduleMove))
+		floatc_t newSumOfSquares = 0.0;
+		bool improved = false;
+		while (!improved && damping <= MaxDamping)
 		{
-			PrintMatrix("Solved matrix", normalMatrix, numFactors, numFactors + 1);
-			PrintVector("Solution", solution, numFactors);
-
-			// Calculate and display the residuals
-			// Save a little stack by not allocating a residuals vector, because stack for it doesn't only get reserved when debug is enabled.
-			debugPrintf("Residuals:");
-			for (size_t i = 0; i < numPoints; ++i)
+			FixedMatrix<floatc_t, NumDeltaFactors, NumDeltaFactors + 1> workMatrix(normalMatrix);
+			if (workMatrix.Cholesky(solution, numFactors, damping))
 			{
-				floatc_t residual = probePoints.GetZHeight(i);
-				for (size_t j = 0; j < numFactors; ++j)
+				LinearDeltaKinematics trialParams(*this);
+				trialParams.Adjust(numFactors, solution);
+				newSumOfSquares = 0.0;
+				for (size_t i = 0; i < numPoints; ++i)
 				{
-					residual += solution[j] * derivativeMatrix(i, j);
+					float newPosition[DELTA_AXES];
+					trialParams.ForwardTransform(probeMotorPositions(i, DELTA_A_AXIS) + solution[DELTA_A_AXIS], probeMotorPositions(i, DELTA_B_AXIS) + solution[DELTA_B_AXIS],
+													probeMotorPositions(i, DELTA_C_AXIS) + solution[DELTA_C_AXIS], newPosition);
+					newSumOfSquares += fcsquare((floatc_t)probePoints.GetZHeight(i) + newPosition[Z_AXIS]);
 				}
-				debugPrintf(" %7.4f", (double)residual);
+				improved = (newSumOfSquares < sumOfSquares);
 			}
+			if (!improved)
+			{
+				damping *= 10.0;
+			}
+		}
 
-			debugPrintf("\n");
+		if (!improved)
+		{
+			break;					// we can't do any better than we already have
+		}
+		damping = max<floatc_t>(damping * 0.1, InitialDamping);
+
+		if (reprap.Debug(moduleMove))
+		{
+			PrintVector("Solution", solution, numFactors);
 		}
 
 		// Save the old homed carriage heights before we change the endstop corrections
@@ -356,7 +419,6 @@ bool LinearDeltaKinematics::DoAutoCalibration(size_t numFactors, const RandomPro
 		// Calculate the expected probe heights using the new parameters
 		{
 			floatc_t expectedResiduals[MaxCalibrationPoints];
-			floatc_t sumOfSquares = 0.0;
 			for (size_t i = 0; i < numPoints; ++i)
 			{
 				for (size_t axis = 0; axis < DELTA_AXES; ++axis)
@@ -367,25 +429,22 @@ bool LinearDeltaKinematics::DoAutoCalibration(size_t numFactors, const RandomPro
 				ForwardTransform(probeMotorPositions(i, DELTA_A_AXIS), probeMotorPositions(i, DELTA_B_AXIS), probeMotorPositions(i, DELTA_C_AXIS), newPosition);
 				corrections[i] = newPosition[Z_AXIS];
 				expectedResiduals[i] = probePoints.GetZHeight(i) + newPosition[Z_AXIS];
-				sumOfSquares += fcsquare(expectedResiduals[i]);
 			}
 
-			expectedRmsError = sqrtf((float)(sumOfSquares/numPoints));
-
 			if (reprap.Debug(moduleMove))
 			{
 				PrintVector("Expected probe error", expectedResiduals, numPoints);
 			}
 		}
 
-		// Decide whether to do another iteration. Two is slightly better than one, but three doesn't improve things.
-		// Alternatively, we could stop when the expected RMS error is only slightly worse than the RMS of the residuals.
-		++iteration;
-		if (iteration == 2)
+		const bool converged = (newSumOfSquares > sumOfSquares * ConvergenceRatio);
+		sumOfSquares = newSumOfSquares;
+		if (converged)
 		{
 			break;
 		}
 	}
+	const float expectedRmsError = sqrtf((float)(sumOfSquares/numPoints));
 
 	// Print out the calculation time
 	//debugPrintf("Time taken %dms\n", (reprap.GetPlatform()->GetInterruptClocks() - startTime) * 1000 / DDA::stepClockRate);
@@ -404,6 +463,27 @@ bool LinearDeltaKinematics::DoAutoCalibration(size_t numFactors, const RandomPro
     return false;
 }
 
+// Compute the derivatives of the probed height with respect to all the factors we can calibrate, at the specified machine XY position
+size_t LinearDeltaKinematics::GetCalibrationDerivatives(float x, float y, floatc_t derivatives[MaxCalibrationDerivatives]) const
+{
+	static_assert(NumDeltaFactors <= MaxCalibrationDerivatives, "MaxCalibrationDerivatives too small");
+	const float machinePos[DELTA_AXES] = { x, y, 0.0 };
+	const float ha = Transform(machinePos, DELTA_A_AXIS);
+	const float hb = Transform(machinePos, DELTA_B_AXIS);
+	const float hc = Transform(machinePos, DELTA_C_AXIS);
+	for (size_t j = 0; j < NumDeltaFactors; ++j)
+	{
+		derivatives[j] = ComputeDerivative(j, ha, hb, hc);
+	}
+	return NumDeltaFactors;
+}
+
+// Return which derivative we use for a factor. We skip the diagonal rod length if doing 8-factor calibration.
+size_t LinearDeltaKinematics::GetCalibrationDerivativeIndex(size_t numFactors, size_t factor) const
+{
+	return (numFactors == 8 && factor >= 6) ? factor + 1 : factor;
+}
+
 // Return the type of motion computation needed by an axis
 MotionType LinearDeltaKinematics::GetMotionType(size_t axis) const
 {
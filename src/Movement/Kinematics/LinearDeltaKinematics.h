@@ -24,9 +24,12 @@ public:
 	const char *GetName(bool forStatusReport) const override;
 	bool Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error) override;
 	bool CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const override;
+	bool CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const override;
 	void MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const override;
 	bool SupportsAutoCalibration() const override { return true; }
 	bool DoAutoCalibration(size_t numFactors, const RandomProbePointSet& probePoints, const StringRef& reply) override;
+	size_t GetCalibrationDerivatives(float x, float y, floatc_t derivatives[MaxCalibrationDerivatives]) const override;
+	size_t GetCalibrationDerivativeIndex(size_t numFactors, size_t factor) const override;
 	void SetCalibrationDefaults() override { Init(); }
 	bool WriteCalibrationParameters(FileStore *f) const override;
 	float GetTiltCorrection(size_t axis) const override;
@@ -68,6 +71,8 @@ private:
 	static constexpr size_t DELTA_B_AXIS = 1;
 	static constexpr size_t DELTA_C_AXIS = 2;
 
+	static constexpr size_t NumDeltaFactors = 9;		// maximum number of delta machine factors we can adjust
+
 	// Delta parameter defaults in mm
 	static constexpr float DefaultDiagonal = 215.0;
 	static constexpr float DefaultDeltaRadius = 105.6;
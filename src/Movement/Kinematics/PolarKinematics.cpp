@@ -45,6 +45,7 @@ bool PolarKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 		bool seenNonGeometry = false;
 		gb.TryGetFValue('S', segmentsPerSecond, seenNonGeometry);
 		gb.TryGetFValue('T', minSegmentLength, seenNonGeometry);
+		gb.TryGetFValue('Q', segmentationTolerance, seenNonGeometry);
 
 		bool seen = false;
 		if (gb.Seen('R'))
@@ -79,6 +80,10 @@ bool PolarKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 			reply.printf("Kinematics is Polar with radius %.1f to %.1fmm, homed radius %.1fmm, segments/sec %d, min. segment length %.2f",
 							(double)minRadius, (double)maxRadius, (double)homedRadius,
 							(int)segmentsPerSecond, (double)minSegmentLength);
+			if (segmentationTolerance > 0.0)
+			{
+				reply.catf(", segmentation tolerance %.3fmm", (double)segmentationTolerance);
+			}
 		}
 		return seen;
 	}
@@ -261,10 +266,10 @@ void PolarKinematics::LimitSpeedAndAcceleration(DDA& dda, const float *normalise
 	}
 }
 
-// Return true if the specified axis is a continuous rotation axis
-bool PolarKinematics::IsContinuousRotationAxis(size_t axis) const
+// Return the set of axes that are continuous rotation axes
+AxesBitmap PolarKinematics::GetContinuousRotationAxes() const
 {
-	return axis == 1;
+	return MakeBitmap<AxesBitmap>(1);
 }
 
 // Update the derived parameters after the master parameters have been changed
@@ -11,10 +11,13 @@
 #include "Movement/DDA.h"
 #include "GCodes/GCodeBuffer.h"
 
+#include <limits>
+
 const float RotaryDeltaKinematics::NormalTowerAngles[DELTA_AXES] = { -150.0, -30.0, 90.0 };
 
 // Constructor
-RotaryDeltaKinematics::RotaryDeltaKinematics() : Kinematics(KinematicsType::rotaryDelta, DefaultSegmentsPerSecond, DefaultMinSegmentSize, false)
+RotaryDeltaKinematics::RotaryDeltaKinematics() : Kinematics(KinematicsType::rotaryDelta, DefaultSegmentsPerSecond, DefaultMinSegmentSize, false),
+	maxArmSpeed(0.0), maxArmAcceleration(0.0)
 {
 	Init();
 }
@@ -121,11 +124,15 @@ bool RotaryDeltaKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 			gb.TryGetFValue('Y', angleCorrections[DELTA_B_AXIS], seen);
 			gb.TryGetFValue('Z', angleCorrections[DELTA_C_AXIS], seen);
 
+			bool seenNonGeometry = false;
+			gb.TryGetFValue('F', maxArmSpeed, seenNonGeometry);
+			gb.TryGetFValue('J', maxArmAcceleration, seenNonGeometry);
+
 			if (seen)
 			{
 				Recalc();
 			}
-			else
+			else if (!seenNonGeometry)
 			{
 				reply.printf("Kinematics is rotary delta, arms (%.3f,%.2f,%.3f)mm, rods (%.3f,%.3f,%.3f)mm, bearingHeights (%.3f,%.2f,%.3f)mm"
 							 ", arm movement %.1f to %.1f" DEGREE_SYMBOL
@@ -137,6 +144,14 @@ bool RotaryDeltaKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 							 (double)minArmAngle, (double)maxArmAngle,
 							 (double)radius, (double)printRadius,
 							 (double)angleCorrections[DELTA_A_AXIS], (double)angleCorrections[DELTA_B_AXIS], (double)angleCorrections[DELTA_C_AXIS]);
+				if (maxArmSpeed > 0.0)
+				{
+					reply.catf(", max arm speed %.1f" DEGREE_SYMBOL "/sec", (double)maxArmSpeed);
+				}
+				if (maxArmAcceleration > 0.0)
+				{
+					reply.catf(", max arm acceleration %.1f" DEGREE_SYMBOL "/sec^2", (double)maxArmAcceleration);
+				}
 			}
 			return seen;
 		}
@@ -200,6 +215,61 @@ bool RotaryDeltaKinematics::CartesianToMotorSteps(const float machinePos[], cons
 	return ok;
 }
 
+// Convert a sequence of Cartesian positions to motor positions.
+// The arm geometry is loaded once, and the terms that depend only on the point are calculated once per point instead of once per arm.
+bool RotaryDeltaKinematics::CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const
+{
+	const size_t numDeltaAxes = min<size_t>(numVisibleAxes, DELTA_AXES);
+	const float r = radius;
+	float cosines[DELTA_AXES], sines[DELTA_AXES], u2[DELTA_AXES], heights[DELTA_AXES], rsmas[DELTA_AXES], spm[DELTA_AXES];
+	for (size_t axis = 0; axis < numDeltaAxes; ++axis)
+	{
+		cosines[axis] = armAngleCosines[axis];
+		sines[axis] = armAngleSines[axis];
+		u2[axis] = twiceU[axis];
+		heights[axis] = bearingHeights[axis];
+		rsmas[axis] = rodSquaredMinusArmSquared[axis];
+		spm[axis] = stepsPerMm[axis] * RadiansToDegrees;
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		const float * const pos = machinePos[i];
+		int32_t * const mp = motorPos[i];
+		const float px = pos[X_AXIS], py = pos[Y_AXIS], pz = pos[Z_AXIS];
+		const float xySquared = fsquare(px) + fsquare(py);			// the rotation to arm coordinates preserves x^2 + y^2
+		for (size_t axis = 0; axis < numDeltaAxes; ++axis)
+		{
+			// Rotate the point so that +X is along the arm, then solve for the arm angle as in Transform
+			const float x = px * cosines[axis] + py * sines[axis];
+			const float rMinusX = r - x;
+			const float hMinusZ = heights[axis] - pz;
+			const float a = u2[axis] * rMinusX;
+			const float b = u2[axis] * hMinusZ;
+			const float c = rsmas[axis] - (fsquare(hMinusZ) + fsquare(r) - 2 * r * x + xySquared);
+			const float aSquaredPlusBSquared = fsquare(a) + fsquare(b);
+			const float sinTheta = (b * c - a * sqrtf(aSquaredPlusBSquared - fsquare(c)))/aSquaredPlusBSquared;
+			const float theta = asinf(sinTheta);
+			if (isnan(theta) || isinf(theta))
+			{
+				ok = false;
+			}
+			else
+			{
+				mp[axis] = lrintf(theta * spm[axis]);
+			}
+		}
+
+		// Transform any additional axes linearly
+		for (size_t axis = DELTA_AXES; axis < numVisibleAxes; ++axis)
+		{
+			mp[axis] = lrintf(pos[axis] * stepsPerMm[axis]);
+		}
+	}
+	return ok;
+}
+
 // Convert motor positions (measured in steps from reference position) to Cartesian coordinates
 // 'motorPos' is the input vector of motor positions
 // 'stepsPerMm' is as configured in M92. On a Scara or polar machine this would actually be steps per degree.
@@ -379,6 +449,27 @@ void RotaryDeltaKinematics::LimitSpeedAndAcceleration(DDA& dda, const float *nor
 		const float maxAcceleration = min<float>(platform.Acceleration(X_AXIS), platform.Acceleration(Y_AXIS));
 		dda.LimitSpeedAndAcceleration(maxSpeed/xyFactor, maxAcceleration/xyFactor);
 	}
+
+	// Within a segment each arm motor moves at a constant rate relative to the head, so we can limit the arm speed and acceleration
+	// from the angle that each arm moves through. This allows segments where the geometry is favourable to run at full speed.
+	if (maxArmSpeed > 0.0 || maxArmAcceleration > 0.0)
+	{
+		const Platform& platform = reprap.GetPlatform();
+		const int32_t * const endPoint = dda.DriveCoordinates();
+		const int32_t * const startPoint = dda.GetPrevious()->DriveCoordinates();
+		float maxArmMovement = 0.0;
+		for (size_t axis = 0; axis < DELTA_AXES; ++axis)
+		{
+			const float armMovement = (float)labs(endPoint[axis] - startPoint[axis])/platform.DriveStepsPerUnit(axis);	// steps/mm is steps/degree for the arms
+			maxArmMovement = max<float>(maxArmMovement, armMovement);
+		}
+		if (maxArmMovement > 0.0)
+		{
+			const float distancePerDegree = dda.GetTotalDistance()/maxArmMovement;
+			dda.LimitSpeedAndAcceleration((maxArmSpeed > 0.0) ? distancePerDegree * maxArmSpeed : std::numeric_limits<float>::max(),
+											(maxArmAcceleration > 0.0) ? distancePerDegree * maxArmAcceleration : std::numeric_limits<float>::max());
+		}
+	}
 }
 
 // Calculate the motor position for a single tower from a Cartesian coordinate.
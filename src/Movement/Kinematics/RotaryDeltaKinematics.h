@@ -20,6 +20,7 @@ public:
 	const char *GetName(bool forStatusReport) const override;
 	bool Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error) override;
 	bool CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const override;
+	bool CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const override;
 	void MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const override;
 	bool SupportsAutoCalibration() const override { return false; }		// TODO support autocalibration
 	bool DoAutoCalibration(size_t numFactors, const RandomProbePointSet& probePoints, const StringRef& reply) override;
@@ -75,6 +76,8 @@ private:
 	float& minArmAngle = minMaxArmAngles[0];
 	float& maxArmAngle = minMaxArmAngles[1];
 	float printRadius;
+	float maxArmSpeed;									// Maximum arm angular speed in degrees/sec, or 0 if not limited
+	float maxArmAcceleration;							// Maximum arm angular acceleration in degrees/sec^2, or 0 if not limited
 
 	// Derived values
 	float armAngleCosines[DELTA_AXES];
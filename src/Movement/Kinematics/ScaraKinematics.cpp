@@ -40,7 +40,7 @@ bool ScaraKinematics::CalculateThetaAndPsi(const float machinePos[], bool isCoor
 {
 	const float x = machinePos[X_AXIS] + xOffset;
 	const float y = machinePos[Y_AXIS] + yOffset;
-	const float cosPsi = (fsquare(x) + fsquare(y) - proximalArmLengthSquared - distalArmLengthSquared) / twoPd;
+	const float cosPsi = (fsquare(x) + fsquare(y) - proximalArmLengthSquared - distalArmLengthSquared) * recipTwoPd;
 
 	// SCARA position is undefined if abs(SCARA_C2) >= 1. In reality abs(SCARA_C2) >0.95 can be problematic.
 	const float square = 1.0f - fsquare(cosPsi);
@@ -101,6 +101,79 @@ bool ScaraKinematics::CalculateThetaAndPsi(const float machinePos[], bool isCoor
 	return true;
 }
 
+// Calculate the cosines and sines of theta and psi for a position relative to the proximal joint in the specified arm mode, without using any trig functions.
+// Return false if the position is not reachable.
+bool ScaraKinematics::CalculateCosinesAndSines(float x, float y, bool armMode, float& cosTheta, float& sinTheta, float& cosPsi, float& sinPsi) const
+{
+	const float radiusSquared = fsquare(x) + fsquare(y);
+	cosPsi = (radiusSquared - proximalArmLengthSquared - distalArmLengthSquared) * recipTwoPd;
+	const float square = 1.0f - fsquare(cosPsi);
+	if (square < 0.01f)
+	{
+		return false;
+	}
+	sinPsi = (armMode) ? sqrtf(square) : -sqrtf(square);
+
+	// These are the arguments that CalculateThetaAndPsi passes to atan2f. Their magnitude is the square of the radius.
+	const float k1 = proximalArmLength + distalArmLength * cosPsi;
+	const float k2 = distalArmLength * sinPsi;
+	const float recipRadiusSquared = 1.0f/radiusSquared;
+	cosTheta = (k1 * x + k2 * y) * recipRadiusSquared;
+	sinTheta = (k1 * y - k2 * x) * recipRadiusSquared;
+	return true;
+}
+
+// Return the angle in degrees from one direction to another given their cosines and sines, if it is small enough for the series to be accurate
+static inline bool SmallAngleBetween(float cos0, float sin0, float cos1, float sin1, float minCos, float& angle)
+{
+	const float cosAngle = cos1 * cos0 + sin1 * sin0;
+	if (cosAngle < minCos)
+	{
+		return false;
+	}
+	const float t = (sin1 * cos0 - cos1 * sin0)/cosAngle;				// tangent of the angle
+	const float t2 = fsquare(t);
+	angle = t * (1.0f - t2 * (1.0f/3.0f - t2 * 0.2f)) * RadiansToDegrees;	// arctangent series, the first term omitted is less than 1e-6 degrees
+	return true;
+}
+
+// Calculate theta and psi from the last solution, when the position is close to it and we stay in the same arm mode.
+// We calculate the exact cosines and sines of the new angles and then the small changes in the angles from them, so we don't need acosf and atan2f.
+// Return false if we can't do this, in which case the caller must use CalculateThetaAndPsi.
+bool ScaraKinematics::UpdateThetaAndPsi(float x, float y, float& theta, float& psi) const
+{
+	float cosTheta, sinTheta, cosPsi, sinPsi, deltaTheta, deltaPsi;
+	if (   !lastSolutionValid
+		|| lastArmMode != currentArmMode
+		|| !CalculateCosinesAndSines(x, y, currentArmMode, cosTheta, sinTheta, cosPsi, sinPsi)
+		|| !SmallAngleBetween(lastCosTheta, lastSinTheta, cosTheta, sinTheta, MinIncrementalCos, deltaTheta)
+		|| !SmallAngleBetween(lastCosPsi, lastSinPsi, cosPsi, sinPsi, MinIncrementalCos, deltaPsi)
+	   )
+	{
+		return false;
+	}
+
+	theta = lastTheta + deltaTheta;
+	psi = lastPsi + deltaPsi;
+
+	// CalculateThetaAndPsi returns angles between -180 and +180 degrees, so leave it to that function to handle crossing those boundaries and the limits
+	if (   theta <= -180.0f || theta > 180.0f
+		|| (!supportsContinuousRotation[0] && (theta < thetaLimits[0] || theta > thetaLimits[1]))
+		|| (!supportsContinuousRotation[1] && (psi < psiLimits[0] || psi > psiLimits[1]))
+	   )
+	{
+		return false;
+	}
+
+	lastTheta = theta;
+	lastPsi = psi;
+	lastCosTheta = cosTheta;
+	lastSinTheta = sinTheta;
+	lastCosPsi = cosPsi;
+	lastSinPsi = sinPsi;
+	return true;
+}
+
 // Convert Cartesian coordinates to motor coordinates, returning true if successful
 // In the following, theta is the proximal arm angle relative to the X axis, psi is the distal arm angle relative to the proximal arm
 bool ScaraKinematics::CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const
@@ -112,7 +185,7 @@ bool ScaraKinematics::CartesianToMotorSteps(const float machinePos[], const floa
 		psi = cachedPsi;
 		currentArmMode = cachedArmMode;
 	}
-	else
+	else if (!UpdateThetaAndPsi(machinePos[X_AXIS] + xOffset, machinePos[Y_AXIS] + yOffset, theta, psi))
 	{
 		bool armMode = currentArmMode;
 		if (!CalculateThetaAndPsi(machinePos, isCoordinated, theta, psi, armMode))
@@ -120,6 +193,13 @@ bool ScaraKinematics::CartesianToMotorSteps(const float machinePos[], const floa
 			return false;
 		}
 		currentArmMode = armMode;
+
+		// Save this solution so that we can update it incrementally next time
+		lastSolutionValid = CalculateCosinesAndSines(machinePos[X_AXIS] + xOffset, machinePos[Y_AXIS] + yOffset, armMode,
+														lastCosTheta, lastSinTheta, lastCosPsi, lastSinPsi);
+		lastTheta = theta;
+		lastPsi = psi;
+		lastArmMode = armMode;
 	}
 
 //debugPrintf("psi = %.2f, theta = %.2f\n", psi * RadiansToDegrees, theta * RadiansToDegrees);
@@ -136,6 +216,44 @@ bool ScaraKinematics::CartesianToMotorSteps(const float machinePos[], const floa
 	return true;
 }
 
+// Convert a sequence of Cartesian positions to motor positions.
+// Consecutive points are usually close together, so we carry the arm mode from one point to the next and only update the cached values at the end.
+bool ScaraKinematics::CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const
+{
+	const float xSteps = stepsPerMm[X_AXIS], ySteps = stepsPerMm[Y_AXIS], zSteps = stepsPerMm[Z_AXIS];
+	const float crosstalkYTheta = crosstalk[0], crosstalkZTheta = crosstalk[1], crosstalkZPsi = crosstalk[2];
+	bool armMode = currentArmMode;
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		const float * const pos = machinePos[i];
+		int32_t * const mp = motorPos[i];
+		float theta, psi;
+		if (pos[X_AXIS] == cachedX && pos[Y_AXIS] == cachedY)
+		{
+			theta = cachedTheta;
+			psi = cachedPsi;
+			armMode = cachedArmMode;
+		}
+		else if (!CalculateThetaAndPsi(pos, isCoordinated, theta, psi, armMode))
+		{
+			currentArmMode = armMode;
+			return false;
+		}
+
+		mp[X_AXIS] = lrintf(theta * xSteps);
+		mp[Y_AXIS] = lrintf((psi - (crosstalkYTheta * theta)) * ySteps);
+		mp[Z_AXIS] = lrintf((pos[Z_AXIS] - (crosstalkZTheta * theta) - (crosstalkZPsi * psi)) * zSteps);
+
+		// Transform any additional axes linearly
+		for (size_t axis = XYZ_AXES; axis < numVisibleAxes; ++axis)
+		{
+			mp[axis] = lrintf(pos[axis] * stepsPerMm[axis]);
+		}
+	}
+	currentArmMode = armMode;
+	return true;
+}
+
 // Convert motor coordinates to machine coordinates. Used after homing and after individual motor moves.
 // For Scara, the X and Y components of stepsPerMm are actually steps per degree angle.
 void ScaraKinematics::MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const
@@ -168,6 +286,7 @@ bool ScaraKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 		gb.TryGetFValue('D', distalArmLength, seen);
 		gb.TryGetFValue('S', segmentsPerSecond, seenNonGeometry);
 		gb.TryGetFValue('T', minSegmentLength, seenNonGeometry);
+		gb.TryGetFValue('Q', segmentationTolerance, seenNonGeometry);
 		gb.TryGetFValue('X', xOffset, seen);
 		gb.TryGetFValue('Y', yOffset, seen);
 		if (gb.TryGetFloatArray('A', 2, thetaLimits, reply, seen))
@@ -199,6 +318,10 @@ bool ScaraKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 							(double)crosstalk[0], (double)crosstalk[1], (double)crosstalk[2],
 							(double)xOffset, (double)yOffset,
 							(int)segmentsPerSecond, (double)minSegmentLength);
+			if (segmentationTolerance > 0.0)
+			{
+				reply.catf(", segmentation tolerance %.3fmm", (double)segmentationTolerance);
+			}
 		}
 		return seen;
 	}
@@ -442,10 +565,19 @@ void ScaraKinematics::LimitSpeedAndAcceleration(DDA& dda, const float *normalise
 	}
 }
 
-// Return true if the specified axis is a continuous rotation axis
-bool ScaraKinematics::IsContinuousRotationAxis(size_t axis) const
+// Return the set of axes that are continuous rotation axes
+AxesBitmap ScaraKinematics::GetContinuousRotationAxes() const
 {
-	return axis < 2 && supportsContinuousRotation[axis];
+	AxesBitmap axes = 0;
+	if (supportsContinuousRotation[0])
+	{
+		SetBit(axes, X_AXIS);
+	}
+	if (supportsContinuousRotation[1])
+	{
+		SetBit(axes, Y_AXIS);
+	}
+	return axes;
 }
 
 // Recalculate the derived parameters
@@ -454,6 +586,7 @@ void ScaraKinematics::Recalc()
 	proximalArmLengthSquared = fsquare(proximalArmLength);
 	distalArmLengthSquared = fsquare(distalArmLength);
 	twoPd = proximalArmLength * distalArmLength * 2;
+	recipTwoPd = 1.0/twoPd;
 
 	minRadius = sqrtf(proximalArmLengthSquared + distalArmLengthSquared
 						- twoPd * max<float>(cosf(psiLimits[0] * DegreesToRadians), cosf(psiLimits[1] * DegreesToRadians))) * 1.005;
@@ -477,6 +610,7 @@ void ScaraKinematics::Recalc()
 	maxRadiusSquared = fsquare(maxRadius);
 
 	cachedX = cachedY = std::numeric_limits<float>::quiet_NaN();		// make sure that the cached values won't match any coordinates
+	lastSolutionValid = false;
 }
 
 // End
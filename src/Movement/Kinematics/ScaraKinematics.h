@@ -29,6 +29,7 @@ public:
 	const char *GetName(bool forStatusReport) const override;
 	bool Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error) override;
 	bool CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const override;
+	bool CartesianToMotorStepsBatch(size_t numPoints, const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[][MaxAxes], bool isCoordinated) const override;
 	void MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const override;
 	bool IsReachable(float x, float y, bool isCoordinated) const override;
 	bool LimitPosition(float position[], size_t numAxes, AxesBitmap axesHomed, bool isCoordinated) const override;
@@ -42,7 +43,7 @@ public:
 	bool QueryTerminateHomingMove(size_t axis) const override;
 	void OnHomingSwitchTriggered(size_t axis, bool highEnd, const float stepsPerMm[], DDA& dda) const override;
 	void LimitSpeedAndAcceleration(DDA& dda, const float *normalisedDirectionVector) const override;
-	bool IsContinuousRotationAxis(size_t axis) const override;
+	AxesBitmap GetContinuousRotationAxes() const override;
 
 private:
 	static constexpr float DefaultSegmentsPerSecond = 100.0;
@@ -53,12 +54,15 @@ private:
 	static constexpr float DefaultMaxTheta = 90.0;					// maximum proximal joint angle
 	static constexpr float DefaultMinPsi = -135.0;					// minimum distal joint angle
 	static constexpr float DefaultMaxPsi = 135.0;					// maximum distal joint angle
+	static constexpr float MinIncrementalCos = 0.995;				// use the incremental calculation if both joint angles change by less than about 5.7 degrees
 
 	static constexpr const char *HomeProximalFileName = "homeproximal.g";
 	static constexpr const char *HomeDistalFileName = "homedistal.g";
 
 	void Recalc();
 	bool CalculateThetaAndPsi(const float machinePos[], bool isCoordinated, float& theta, float& psi, bool& armMode) const;
+	bool CalculateCosinesAndSines(float x, float y, bool armMode, float& cosTheta, float& sinTheta, float& cosPsi, float& sinPsi) const;
+	bool UpdateThetaAndPsi(float x, float y, float& theta, float& psi) const;
 
 	// Primary parameters
 	float proximalArmLength;
@@ -76,10 +80,16 @@ private:
 	float proximalArmLengthSquared;
 	float distalArmLengthSquared;
 	float twoPd;
+	float recipTwoPd;
 
 	// State variables
 	mutable float cachedX, cachedY, cachedTheta, cachedPsi;
 	mutable bool currentArmMode, cachedArmMode;
+
+	// The last solution from CartesianToMotorSteps, used as the starting point for the next one
+	mutable float lastTheta, lastPsi;
+	mutable float lastCosTheta, lastSinTheta, lastCosPsi, lastSinPsi;
+	mutable bool lastArmMode, lastSolutionValid;
 };
 
 #endif /* SRC_MOVEMENT_KINEMATICS_SCARAKINEMATICS_H_ */
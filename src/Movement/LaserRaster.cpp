@@ -0,0 +1,96 @@
+/*
+ * LaserRaster.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "LaserRaster.h"
+
+#if SUPPORT_LASER_RASTER
+
+LaserRaster *LaserRaster::freeList = nullptr;
+unsigned int LaserRaster::numFree = 0;
+PoolStats LaserRaster::poolStats("laser rasters");
+
+/*static*/ void LaserRaster::InitialAllocate(unsigned int num)
+{
+	while (num != 0)
+	{
+		freeList = new LaserRaster(freeList);
+		++numFree;
+		poolStats.Created(1);
+		--num;
+	}
+}
+
+// Allocate a raster. Only called from the main task, never from the ISR.
+/*static*/ LaserRaster *LaserRaster::Allocate()
+{
+	LaserRaster * const p = freeList;
+	if (p != nullptr)
+	{
+		freeList = p->next;
+		--numFree;
+		p->next = nullptr;
+		p->numPixels = 0;
+		p->currentPixel = 0;
+		poolStats.Allocated();
+	}
+	else
+	{
+		poolStats.Failed();
+	}
+	return p;
+}
+
+// Release a raster. Only called from the main task, never from the ISR.
+/*static*/ void LaserRaster::Release(LaserRaster *item)
+{
+	item->next = freeList;
+	freeList = item;
+	++numFree;
+	poolStats.Released();
+}
+
+// Return the 6-bit value of a base64 character, or -1 if it isn't one
+static int Base64Value(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A'
+			: (c >= 'a' && c <= 'z') ? c - 'a' + 26
+				: (c >= '0' && c <= '9') ? c - '0' + 52
+					: (c == '+') ? 62
+						: (c == '/') ? 63
+							: -1;
+}
+
+// Decode the base64 power values. Padding characters are optional.
+bool LaserRaster::SetPixels(const char *encoded)
+{
+	numPixels = 0;
+	uint32_t bits = 0;
+	unsigned int numBits = 0;
+	for (; *encoded != 0 && *encoded != '='; ++encoded)
+	{
+		const int val = Base64Value(*encoded);
+		if (val < 0)
+		{
+			return true;
+		}
+		bits = (bits << 6) | (uint32_t)val;
+		numBits += 6;
+		if (numBits >= 8)
+		{
+			if (numPixels == MaxPixels)
+			{
+				return true;
+			}
+			numBits -= 8;
+			pixels[numPixels++] = (uint8_t)(bits >> numBits);
+		}
+	}
+	return numPixels == 0;
+}
+
+#endif
+
+// End
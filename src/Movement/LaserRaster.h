@@ -0,0 +1,55 @@
+/*
+ * LaserRaster.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  Per-pixel laser power for raster engraving. A G1 command on a laser machine may carry a D parameter holding a quoted base64 string of
+ *  power values. The move is divided into that many equal-length pixels, and the step ISR sets the laser power for each pixel as the
+ *  motor that moves furthest passes the pixel boundary. Each value scales the power given by the S parameter, with 255 meaning full S power.
+ */
+
+#ifndef SRC_MOVEMENT_LASERRASTER_H_
+#define SRC_MOVEMENT_LASERRASTER_H_
+
+#include "RepRapFirmware.h"
+#include "Libraries/General/PoolStats.h"
+
+#if SUPPORT_LASER_RASTER
+
+class LaserRaster
+{
+public:
+	static constexpr size_t MaxPixels = 96;					// 128 base64 characters, which fits in a G1 command of GCODE_LENGTH characters
+
+	LaserRaster(LaserRaster *n) : next(n), numPixels(0) { }
+
+	static void InitialAllocate(unsigned int num);
+	static LaserRaster *Allocate();
+	static void Release(LaserRaster *item);
+	static unsigned int NumFree() { return numFree; }
+
+	bool SetPixels(const char *encoded);					// decode the base64 power values, returning true if error
+
+	// These are called by the DDA, some of them from the step ISR
+	size_t NumPixels() const { return numPixels; }
+	uint8_t GetPixel(size_t n) const { return pixels[n]; }
+	size_t GetDrive() const { return drive; }
+	void SetDrive(size_t d) { drive = d; }
+	size_t GetCurrentPixel() const { return currentPixel; }
+	void SetCurrentPixel(size_t n) { currentPixel = n; }
+
+private:
+	static LaserRaster *freeList;
+	static unsigned int numFree;
+	static PoolStats poolStats;
+
+	LaserRaster *next;
+	uint8_t numPixels;
+	uint8_t drive;											// the drive whose step count we use to track progress along the move
+	uint8_t currentPixel;									// the pixel whose power we last set
+	uint8_t pixels[MaxPixels];
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_LASERRASTER_H_ */
@@ -37,27 +37,80 @@
 #include "Platform.h"
 #include "GCodes/GCodeBuffer.h"
 #include "Tools/Tool.h"
+#include "Heating/Heat.h"
+#include "Tasks.h"
+#if SUPPORT_LASER_RASTER
+# include "LaserRaster.h"
+#endif
+#if SUPPORT_MOVE_TRACE
+# include "MoveTracer.h"
+#endif
+
+#if USE_TCM
+# include <new>
+
+// Storage in DTCM for the initial DDA ring, because the step ISR accesses the current DDA on every step. Any DDAs added by M595 come from the heap.
+alignas(DDA) static uint8_t ddaRingStorage[DefaultDdaRingLength * sizeof(DDA)] DTCM_DATA;
+#endif
+
+// Create one of the DDAs in the initial ring
+static DDA *NewRingDda(size_t index, DDA *next)
+{
+#if USE_TCM
+	return new (&ddaRingStorage[index * sizeof(DDA)]) DDA(next);
+#else
+	(void)index;
+	return new DDA(next);
+#endif
+}
 
 constexpr uint32_t UsualMinimumPreparedTime = StepClockRate/10;			// 100ms
+constexpr uint32_t MinPauseSplitClocks = StepClockRate/20;				// 50ms, the least time before a move starts that we allow for shortening it to pause
 constexpr uint32_t AbsoluteMinimumPreparedTime = StepClockRate/20;		// 50ms
 
-Move::Move() : currentDda(nullptr), active(false), scheduledMoves(0), completedMoves(0)
+// Adaptive prepare-ahead parameters. When the moves are short we prepare up to the maximum time ahead, because they gain little from more lookahead
+// and a delay in calling Spin could otherwise starve the step ISR. When they are long we prepare only the absolute minimum time ahead, so that they
+// stay provisional for longer and lookahead can still raise their end speeds. We never prepare less than twice the time needed to survive
+// the longest recent gap between calls to Spin and then prepare another move.
+constexpr uint32_t MaximumPreparedTime = StepClockRate/5;				// 200ms
+constexpr uint32_t ShortMoveClocks = StepClockRate/100;					// 10ms, moves this short or shorter get the maximum prepare-ahead time
+constexpr uint32_t LongMoveClocks = StepClockRate/10;					// 100ms, moves this long or longer get the absolute minimum prepare-ahead time
+constexpr uint32_t SpinIntervalDecayClocks = 2 * StepClockRate;			// the time constant with which we forget a long gap between calls to Spin
+
+// Minimum move duration parameters. When the provisional moves in the ring will take less than the low water time to execute, we slow down short moves
+// so that each one takes at least as long as it typically takes to add a new move to the ring. We stop doing that when they will take longer than the high water time.
+constexpr uint32_t MinSegmentLowWaterTime = StepClockRate/5;			// 200ms
+constexpr uint32_t MinSegmentHighWaterTime = StepClockRate/2;			// 500ms
+constexpr uint32_t MaxMoveSupplySample = StepClockRate/20;				// 50ms, longer gaps between moves mean that GCodes had nothing to send us
+
+Move::Move() : currentDda(nullptr), ddaRingLength(DefaultDdaRingLength), numDms(DefaultNumDms), active(false), scheduledMoves(0), completedMoves(0), completedMoveClocks(0),
+	initTimer("Init"), lookaheadTimer("Lookahead"), prepareTimer("Prepare"), stepCalcTimer("Step calculation"), stepIsrCycles(0), lastStepIsrCycles(0), totalStepIsrCycles(0), isrTimingStartTime(0)
 {
 	kinematics = Kinematics::Create(KinematicsType::cartesian);			// default to Cartesian
 
 	// Build the DDA ring
-	DDA *dda = new DDA(nullptr);
+	DDA *dda = NewRingDda(0, nullptr);
 	ddaRingGetPointer = ddaRingAddPointer = dda;
-	for (size_t i = 1; i < DdaRingLength; i++)
+	for (size_t i = 1; i < ddaRingLength; i++)
 	{
 		DDA * const oldDda = dda;
-		dda = new DDA(dda);
+		dda = NewRingDda(i, dda);
 		oldDda->SetPrevious(dda);
 	}
 	ddaRingAddPointer->SetNext(dda);
 	dda->SetPrevious(ddaRingAddPointer);
 
-	DriveMovement::InitialAllocate(NumDms);
+	DriveMovementBlock::InitialAllocate(NumDmBlocks);
+	DriveMovement::InitialAllocate(numDms);
+#if SUPPORT_STEP_TABLES
+	StepTable::InitialAllocate(NumStepTables);
+#endif
+#if SUPPORT_INPUT_SHAPING
+	ShapedProfile::InitialAllocate(MaxPreparedMoves + 1);
+#endif
+#if SUPPORT_LASER_RASTER
+	LaserRaster::InitialAllocate(NumLaserRasters);
+#endif
 }
 
 void Move::Init()
@@ -74,9 +127,34 @@ void Move::Init()
 	currentDda = nullptr;
 	stepErrors = 0;
 	numLookaheadUnderruns = numPrepareUnderruns = numLookaheadErrors = 0;
+	moveTotals.accelTime = moveTotals.distance = moveTotals.peakSpeed = 0.0;
+	moveTotals.lookaheadUnderruns = moveTotals.prepareUnderruns = 0;
 	maxPrintingAcceleration = maxTravelAcceleration = 10000.0;
+	junctionDeviation = 0.0;
 	drcEnabled = false;											// disable dynamic ringing cancellation
 	drcMinimumAcceleration = 10.0;
+	fastPause = false;
+	pauseSplits = 0;
+	maxMinSegmentClocks = minSegmentClocks = moveSupplyClocks = lastMoveAddedTime = 0;
+	numSegmentsSlowed = 0;
+	ringHadSpace = enforcingMinSegmentTime = false;
+	lastSpinTime = Platform::GetInterruptClocks();
+	spinIntervalPeak = prepareCyclesAverage = 0;
+	moveClocksAverage = LongMoveClocks;
+	preparedTimeTarget = UsualMinimumPreparedTime;
+#if SUPPORT_MICROSTEP_SWITCHING
+	for (uint8_t& microsteps : reducedMicrostepping)
+	{
+		microsteps = 0;
+	}
+	minReducedMicrostepClocks = DefaultMinReducedMicrostepTime * (StepClockRate/1000);
+	reducedMicrostepAxes = changingMicrostepAxes = 0;
+	microstepChangeStartTime = 0;
+	numReducedMicrostepMoves = numMicrostepChangeTimeouts = 0;
+#endif
+	ClearCalibrationEstimate();
+	numCalibrationsDone = 0;
+	lastCalibrationDeviation = 0.0;
 
 	// Clear the transforms
 	SetIdentityTransform();
@@ -94,6 +172,7 @@ void Move::Init()
 		SetLiveCoordinates(move);
 		SetPositions(move);
 	}
+	cachedLiveCoordinatesSeq = 1;								// readers only ever see even sequence numbers, so this never matches
 
 	for (size_t i = 0; i < MaxExtruders; ++i)
 	{
@@ -105,6 +184,7 @@ void Move::Init()
 	usingMesh = false;
 	useTaper = false;
 	zShift = 0.0;
+	UpdateTransforms();
 
 	idleTimeout = DefaultIdleTimeout;
 	moveState = MoveState::idle;
@@ -112,9 +192,26 @@ void Move::Init()
 	idleCount = 0;
 
 	simulationMode = 0;
+	benchmarking = false;
+#if HAS_VOLTAGE_MONITOR
+	powerFailFrozen = false;
+	powerFailFreezeTime = 0;
+#endif
 	simulationTime = 0.0;
+	simulationStartMillis = 0;
 	longestGcodeWaitInterval = 0;
 	specialMoveAvailable = false;
+#if SUPPORT_MOVE_MERGING
+	merger.Clear();
+#endif
+	numBabyStepMotors = 0;
+	babyStepInterval = lastBabyStepTime = 0;
+	babyStepDirectionsSet = babyStepDirectionsForwards = 0;
+
+	StageTimer::EnableCycleCounter();
+	isrTimingStartTime = millis();
+	lastFeedForwardTime = millis();
+	feedForwardHeaters = 0;
 
 	active = true;
 }
@@ -122,6 +219,9 @@ void Move::Init()
 void Move::Exit()
 {
 	Platform::DisableStepInterrupt();
+#if SUPPORT_MOVE_MERGING
+	merger.Clear();
+#endif
 
 	// Clear the DDA ring so that we don't report any moves as pending
 	currentDda = nullptr;
@@ -144,15 +244,49 @@ void Move::Spin()
 	if (!active)
 	{
 		GCodes::RawMove nextMove;
-		(void) reprap.GetGCodes().ReadMove(nextMove);			// throw away any move that GCodes tries to pass us
+		if (reprap.GetGCodes().ReadMove(nextMove))				// throw away any move that GCodes tries to pass us
+		{
+#if SUPPORT_LASER_RASTER
+			if (nextMove.laserRaster != nullptr)
+			{
+				LaserRaster::Release(nextMove.laserRaster);
+			}
+#endif
+		}
 		return;
 	}
 
+#if SUPPORT_MOVE_TRACE
+	MoveTracer::Spin();
+#endif
+
 	if (idleCount < 1000)
 	{
 		++idleCount;
 	}
 
+	// Track the longest recent gap between calls to Spin, so that we can prepare moves far enough ahead to survive the next one
+	{
+		const uint32_t now = Platform::GetInterruptClocks();
+		const uint32_t spinInterval = now - lastSpinTime;
+		lastSpinTime = now;
+		spinIntervalPeak = (spinInterval >= spinIntervalPeak)
+							? spinInterval
+								: spinIntervalPeak - (uint32_t)(((uint64_t)spinIntervalPeak * spinInterval)/SpinIntervalDecayClocks);
+	}
+
+	// Collect the time spent in the step ISR often enough that the 32-bit counter that the ISR updates can't wrap round twice between collections
+	CollectStepIsrCycles();
+
+#if SUPPORT_STEP_TABLES
+	// Top up the precomputed step times of the move being executed
+	DDA * const edda = currentDda;								// currentDda is volatile, so copy it
+	if (edda != nullptr && simulationMode == 0)
+	{
+		edda->RefillStepTables();
+	}
+#endif
+
 	// Recycle the DDAs for completed moves, checking for DDA errors to print if Move debug is enabled
 	while (ddaRingCheckPointer->GetState() == DDA::completed)
 	{
@@ -171,6 +305,7 @@ void Move::Spin()
 		if (ddaRingCheckPointer->Free())
 		{
 			++numLookaheadUnderruns;
+			++moveTotals.lookaheadUnderruns;
 		}
 		ddaRingCheckPointer = ddaRingCheckPointer->GetNext();
 	}
@@ -182,7 +317,6 @@ void Move::Spin()
 #endif
 						  ddaRingAddPointer->GetState() == DDA::empty
 					   && ddaRingAddPointer->GetNext()->GetState() != DDA::provisional		// function Prepare needs to access the endpoints in the previous move, so don't change them
-					   && DriveMovement::NumFree() >= (int)DRIVES							// check that we won't run out of DMs
 					  );
 	if (canAddMove)
 	{
@@ -203,6 +337,7 @@ void Move::Spin()
 		}
 
 		canAddMove = (unPreparedTime < StepClockRate/2 || unPreparedTime + prevMoveTime < 2 * StepClockRate);
+		UpdateMinSegmentTime(unPreparedTime + prevMoveTime);
 	}
 
 	if (canAddMove)
@@ -235,52 +370,67 @@ void Move::Spin()
 		{
 			// If there's a G Code move available, add it to the DDA ring for processing.
 			GCodes::RawMove nextMove;
+#if SUPPORT_MOVE_MERGING
+			if (merger.IsHolding() && !merger.CanExtend())
+			{
+				// The move we are holding back can't have any more moves merged into it, so add it to the ring before we read another one
+				AddMoveToRing(merger.GetHeldMove());
+				merger.Clear();
+			}
+			else if (reprap.GetGCodes().ReadMove(nextMove))
+#else
 			if (reprap.GetGCodes().ReadMove(nextMove))		// if we have a new move
+#endif
 			{
 				if (simulationMode < 2)		// in simulation mode 2 and higher, we don't process incoming moves beyond this point
 				{
-#if 0	// disabled this because it causes jerky movements on the SCARA printer
-					// Add on the extrusion left over from last time.
-					const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
-					for (size_t drive = numAxes; drive < DRIVES; ++drive)
-					{
-						nextMove.coords[drive] += extrusionPending[drive - numAxes];
-					}
-#endif
-					if (nextMove.moveType == 0)
-					{
-						AxisAndBedTransform(nextMove.coords, nextMove.xAxes, nextMove.yAxes, true);
-					}
-
-					if (ddaRingAddPointer->Init(nextMove, !IsRawMotorMove(nextMove.moveType)))
+#if SUPPORT_MOVE_MERGING
+					if (merger.IsHolding())
 					{
-						ddaRingAddPointer = ddaRingAddPointer->GetNext();
-						idleCount = 0;
-						scheduledMoves++;
-						if (moveState == MoveState::idle || moveState == MoveState::timing)
+						// Merge the new move into the held one if no codes are queued to execute between them, otherwise add the held move to the ring and hold the new one
+						if (reprap.GetGCodes().HasQueuedCodesForMove(scheduledMoves + 1) || !merger.TryMerge(nextMove))
 						{
-							moveState = MoveState::collecting;
-							const uint32_t now = millis();
-							const uint32_t timeWaiting = now - lastStateChangeTime;
-							if (timeWaiting > longestGcodeWaitInterval)
-							{
-								longestGcodeWaitInterval = timeWaiting;
-							}
-							lastStateChangeTime = now;
+							AddMoveToRing(merger.GetHeldMove());
+							merger.Hold(nextMove);
+#if SUPPORT_LASER_RASTER
+							nextMove.laserRaster = nullptr;			// the held move owns the raster now
+#endif
 						}
 					}
-
-#if 0	// see above
-					// Save the amount of extrusion not done
-					for (size_t drive = numAxes; drive < DRIVES; ++drive)
+					else if (merger.CanHold(nextMove))
 					{
-						extrusionPending[drive - numAxes] = nextMove.coords[drive];
+						merger.Hold(nextMove);
 					}
+					else
 #endif
+					{
+						AddMoveToRing(nextMove);
+					}
+				}
+				else
+				{
+					reprap.GetGCodes().MovesDiscarded(1);
+				}
+#if SUPPORT_LASER_RASTER
+				if (nextMove.laserRaster != nullptr)			// if the DDA didn't take the raster
+				{
+					LaserRaster::Release(nextMove.laserRaster);
 				}
+#endif
+			}
+#if SUPPORT_MOVE_MERGING
+			else if (merger.IsHolding())
+			{
+				// No more moves are available yet, so don't delay the held move any longer
+				AddMoveToRing(merger.GetHeldMove());
+				merger.Clear();
 			}
+#endif
 		}
 	}
+	ringHadSpace = canAddMove;
+
+	UpdateExtrusionFeedForward();
 
 	// If we are simulating, simulate completion of the current move.
 	// Do this here rather than at the end, so that when simulating, currentDda is non-null for most of the time and IsExtruding() returns the correct value
@@ -288,24 +438,49 @@ void Move::Spin()
 		DDA *cdda;													// currentDda is declared volatile, so copy it in the next line
 		if (simulationMode != 0 && (cdda = currentDda) != nullptr)
 		{
+			if (benchmarking)
+			{
+				cdda->MeasureStepGeneration(stepCalcTimer, numStepsChecked, totalStepTimeError, maxStepTimeError);
+			}
 			simulationTime += (float)cdda->GetClocksNeeded()/StepClockRate;
 			cdda->Complete();
 			CurrentMoveCompleted();
 		}
 	}
 
+	// The step ISR makes the babysteps while a move is executing, so if no move is executing we need to make them here
+	if (babySteppingPending && currentDda == nullptr)
+	{
+		const irqflags_t flags = cpu_irq_save();
+		const uint32_t driversStepping = AddBabySteps(nullptr, 0, Platform::GetInterruptClocks());
+		if (driversStepping != 0)
+		{
+			Platform& platform = reprap.GetPlatform();
+			Platform::StepDriversHigh(driversStepping);
+			const uint32_t stepHighClocks = ((driversStepping & platform.GetSlowDriversBitmap()) != 0) ? platform.GetSlowDriverStepHighClocks() : 2;
+			const uint32_t stepTime = Platform::GetInterruptClocks();
+			while (Platform::GetInterruptClocks() - stepTime < stepHighClocks) {}
+			Platform::StepDriversLow();
+		}
+		cpu_irq_restore(flags);
+	}
+
 	// See whether we need to kick off a move
 	if (currentDda == nullptr)
 	{
 		// No DDA is executing, so start executing a new one if possible
-		if (!canAddMove || idleCount > 10)							// better to have a few moves in the queue so that we can do lookahead
+		if (   !canAddMove || idleCount > 10						// better to have a few moves in the queue so that we can do lookahead
+#if SUPPORT_MICROSTEP_SWITCHING
+			|| (ddaRingGetPointer->GetState() == DDA::frozen && ddaRingGetPointer->NeedsMicrostepChange(reducedMicrostepAxes))	// the step ISR left this move for us to start
+#endif
+		   )
 		{
 			// Prepare one move and execute it. We assume that we will enter the next if-block before it completes, giving us time to prepare more moves.
 			Platform::DisableStepInterrupt();						// should be disabled already because we weren't executing a move, but make sure
 			DDA * const dda = ddaRingGetPointer;					// capture volatile variable
-			if (dda->GetState() == DDA::provisional)
+			if (dda->GetState() == DDA::provisional && (!PreparingDMs() || DriveMovement::CanAllocateForMove()))
 			{
-				dda->Prepare(simulationMode);
+				dda->Prepare(simulationMode, PreparingDMs());
 			}
 			if (dda->GetState() == DDA::frozen)
 			{
@@ -313,6 +488,12 @@ void Move::Spin()
 				{
 					currentDda = dda;								// pretend we are executing this move
 				}
+#if SUPPORT_MICROSTEP_SWITCHING
+				else if (!SetMicrosteppingForMove(*dda))
+				{
+					// The drivers are not ready for this move yet, so try again next time
+				}
+#endif
 				else
 				{
 					if (StartNextMove(Platform::GetInterruptClocks()))	// start the next move
@@ -328,6 +509,12 @@ void Move::Spin()
 				{
 					lastStateChangeTime = millis();					// record when we first noticed that the machine was idle
 					moveState = MoveState::timing;
+#if SUPPORT_MICROSTEP_SWITCHING
+					if (reducedMicrostepAxes != 0 && DDARingEmpty())
+					{
+						ChangeMicrostepReduction(0);				// hold the motors at normal microstepping
+					}
+#endif
 				}
 				else if (moveState == MoveState::timing && millis() - lastStateChangeTime >= idleTimeout)
 				{
@@ -359,13 +546,15 @@ void Move::Spin()
 		// If the number of prepared moves will execute in less than the minimum time, prepare another move.
 		// Try to avoid preparing deceleration-only moves
 		while (st == DDA::provisional
-				&& preparedTime < (int32_t)UsualMinimumPreparedTime		// prepare moves one eighth of a second ahead of when they will be needed
-				&& preparedCount < DdaRingLength/2 - 1					// but don't prepare as much as half the ring
+				&& preparedTime < (int32_t)preparedTimeTarget			// prepare moves far enough ahead of when they will be needed
+				&& preparedCount < MaxPreparedMoves						// but don't prepare too many
+				&& (!PreparingDMs() || DriveMovement::CanAllocateForMove())	// check that we won't run out of DMs, but simulated moves don't use any
 			  )
 		{
 			if (cdda->IsGoodToPrepare() || preparedTime < (int32_t)AbsoluteMinimumPreparedTime)
 			{
-				cdda->Prepare(simulationMode);
+				cdda->Prepare(simulationMode, PreparingDMs());
+				UpdatePreparedTimeTarget(cdda->GetClocksNeeded());
 			}
 			preparedTime += cdda->GetTimeLeft();
 			++preparedCount;
@@ -375,16 +564,290 @@ void Move::Spin()
 	}
 }
 
+// Update the moving average of the move duration with a move that we just prepared, and recalculate how far ahead to prepare moves
+void Move::UpdatePreparedTimeTarget(uint32_t newMoveClocks)
+{
+	moveClocksAverage = moveClocksAverage - moveClocksAverage/8 + newMoveClocks/8;
+
+	uint32_t target;
+	if (moveClocksAverage <= ShortMoveClocks)
+	{
+		target = MaximumPreparedTime;
+	}
+	else if (moveClocksAverage >= LongMoveClocks)
+	{
+		target = AbsoluteMinimumPreparedTime;
+	}
+	else
+	{
+		target = MaximumPreparedTime
+				- (uint32_t)(((uint64_t)(MaximumPreparedTime - AbsoluteMinimumPreparedTime) * (moveClocksAverage - ShortMoveClocks))/(LongMoveClocks - ShortMoveClocks));
+	}
+
+	const uint32_t prepareClocks = (uint32_t)(((uint64_t)prepareCyclesAverage * StepClockRate)/VARIANT_MCK);
+	preparedTimeTarget = min<uint32_t>(max<uint32_t>(target, 2 * (spinIntervalPeak + prepareClocks)), MaximumPreparedTime);
+}
+
+// Return how many empty slots there are in the DDA ring. This is only advisory because the step ISR may free more slots at any time.
+unsigned int Move::GetNumberOfFreeMoveSlots() const
+{
+	unsigned int count = 0;
+	const DDA *dda = ddaRingAddPointer;
+	while (count < ddaRingLength && dda->GetState() == DDA::empty)
+	{
+		++count;
+		dda = dda->GetNext();
+	}
+	return count;
+}
+
+// Apply a change in the M220 speed factor to the moves already in the queue that have not been frozen yet.
+// This runs in the same task as Move::Spin, so the provisional moves can't be prepared while we adjust them.
+void Move::ChangeSpeedFactor(float ratio)
+{
+	DDA *dda = ddaRingGetPointer;
+	for (unsigned int i = 0; i < ddaRingLength && dda->GetState() != DDA::empty; ++i)
+	{
+		if (dda->GetState() == DDA::provisional)
+		{
+			dda->ChangeSpeedFactor(ratio);
+		}
+		dda = dda->GetNext();
+	}
+}
+
 // Return the number of currently used probe points
 unsigned int Move::GetNumProbePoints() const
 {
 	return probePoints.GetNumBedCompensationPoints();
 }
 
-// Try to push some babystepping through the lookahead queue
-float Move::PushBabyStepping(float amount)
+// Apply some babystepping. The endpoints of all the moves in the queue are offset immediately, so no moves need to be recalculated.
+// The babysteps themselves are made at a limited rate by the step ISR, or by Spin if no move is executing.
+void Move::PushBabyStepping(float amount)
+{
+	Platform& platform = reprap.GetPlatform();
+	if (!babySteppingPending)
+	{
+		if (IsDeltaMode())
+		{
+			numBabyStepMotors = XYZ_AXES;
+			for (size_t i = 0; i < XYZ_AXES; ++i)
+			{
+				babyStepMotors[i] = i;
+			}
+		}
+		else
+		{
+			numBabyStepMotors = 1;
+			babyStepMotors[0] = Z_AXIS;
+		}
+	}
+
+	// Work out the change in the number of steps from the total offset, so that rounding errors don't accumulate
+	const float newOffset = babyStepOffset + amount;
+	int32_t steps[XYZ_AXES];
+	float maxStepsPerMm = 0.0;
+	for (size_t i = 0; i < numBabyStepMotors; ++i)
+	{
+		const float stepsPerMm = platform.DriveStepsPerUnit(babyStepMotors[i]);
+		steps[i] = lrintf(newOffset * stepsPerMm) - lrintf(babyStepOffset * stepsPerMm);
+		maxStepsPerMm = max<float>(maxStepsPerMm, stepsPerMm);
+	}
+	babyStepOffset = newOffset;
+
+	// Limit the babystepping speed to half the Z jerk speed
+	babyStepInterval = (uint32_t)(StepClockRate/(0.5 * platform.GetInstantDv(Z_AXIS) * maxStepsPerMm));
+
+	const irqflags_t flags = cpu_irq_save();
+	DDA *dda = ddaRingAddPointer;
+	do
+	{
+		dda->AddBabyStepOffset(amount, steps, babyStepMotors, numBabyStepMotors);
+		dda = dda->GetNext();
+	} while (dda != ddaRingAddPointer);
+
+	liveLock.BeginWrite();
+	liveCoordinates[Z_AXIS] += amount;
+	for (size_t i = 0; i < numBabyStepMotors; ++i)
+	{
+		liveEndPoints[babyStepMotors[i]] += steps[i];
+		if (simulationMode == 0)
+		{
+			babyStepsPending[i] += steps[i];
+			if (babyStepsPending[i] != 0)
+			{
+				babySteppingPending = true;
+			}
+		}
+	}
+	liveLock.EndWrite();
+	cpu_irq_restore(flags);
+}
+
+// Add or remove pending babysteps in the set of drivers about to be stepped, returning the new set.
+// 'dda' is the move being executed, or nullptr if there is none. A motor that the move is stepping keeps the direction that the move set,
+// so we add an extra step if it is going the way we want, or leave out one of its steps if it isn't.
+// Called from the step ISR, or from Spin with interrupts disabled when no move is executing.
+uint32_t Move::AddBabySteps(const DDA *dda, uint32_t driversStepping, uint32_t now)
+{
+	if (now - lastBabyStepTime < babyStepInterval)
+	{
+		return driversStepping;
+	}
+
+	Platform& platform = reprap.GetPlatform();
+	bool stillPending = false;
+	for (size_t i = 0; i < numBabyStepMotors; ++i)
+	{
+		const int32_t pending = babyStepsPending[i];
+		if (pending != 0)
+		{
+			const size_t drive = babyStepMotors[i];
+			const bool wantForwards = (pending > 0);
+			const uint32_t driverBits = platform.GetDriversBitmap(drive);
+			const uint8_t motorBit = 1u << i;
+			bool moveForwards;
+			bool stepped = false;
+			if (dda != nullptr && dda->GetDriveDirection(drive, moveForwards))
+			{
+				if (moveForwards != wantForwards)
+				{
+					if ((driversStepping & driverBits) != 0)
+					{
+						driversStepping &= ~driverBits;				// leave out one of the steps of the move
+						stepped = true;
+					}
+				}
+				else if ((driversStepping & driverBits) == 0)
+				{
+					driversStepping |= driverBits;					// add an extra step
+					stepped = true;
+				}
+			}
+			else if ((babyStepDirectionsSet & motorBit) != 0 && ((babyStepDirectionsForwards & motorBit) != 0) == wantForwards)
+			{
+				driversStepping |= driverBits;
+				stepped = true;
+			}
+			else
+			{
+				// Set the direction now and make the step next time, which gives the driver time to see the direction change
+				platform.SetDirection(drive, wantForwards);
+				babyStepDirectionsSet |= motorBit;
+				if (wantForwards)
+				{
+					babyStepDirectionsForwards |= motorBit;
+				}
+				else
+				{
+					babyStepDirectionsForwards &= ~motorBit;
+				}
+				lastBabyStepTime = now;
+			}
+
+			if (stepped)
+			{
+				babyStepsPending[i] = (wantForwards) ? pending - 1 : pending + 1;
+				lastBabyStepTime = now;
+			}
+			if (babyStepsPending[i] != 0)
+			{
+				stillPending = true;
+			}
+		}
+	}
+	babySteppingPending = stillPending;
+	return driversStepping;
+}
+
+// Tell the heaters of the current tool how fast the planned moves say it will be extruding when the heat they generate now reaches the sensor,
+// so that they can start to supply the heat needed to melt the filament before the temperature drops. Other heaters get an extrusion rate of zero.
+void Move::UpdateExtrusionFeedForward()
+{
+	const uint32_t now = millis();
+	if (now - lastFeedForwardTime < FeedForwardUpdateInterval)
+	{
+		return;
+	}
+	lastFeedForwardTime = now;
+
+	Heat& heat = reprap.GetHeat();
+	uint32_t newFeedForwardHeaters = 0;
+	const Tool * const tool = reprap.GetCurrentTool();
+	if (tool != nullptr && simulationMode == 0)
+	{
+		for (size_t i = 0; i < tool->HeaterCount(); ++i)
+		{
+			const int heater = tool->Heater(i);
+			if (heater >= 0 && heater < (int)Heaters && heat.GetFeedForward(heater) > 0.0)
+			{
+				const float rate = GetPlannedExtrusionRate(*tool, heat.GetHeaterModel(heater).GetDeadTime());
+				heat.SetExtrusionRate(heater, rate);
+				if (rate != 0.0)
+				{
+					SetBit(newFeedForwardHeaters, heater);
+				}
+			}
+		}
+	}
+
+	// Tell any heaters that we no longer feed forward to that there is no extrusion
+	const uint32_t heatersToClear = feedForwardHeaters & ~newFeedForwardHeaters;
+	for (size_t heater = 0; heater < Heaters; ++heater)
+	{
+		if (IsBitSet(heatersToClear, heater))
+		{
+			heat.SetExtrusionRate(heater, 0.0);
+		}
+	}
+	feedForwardHeaters = newFeedForwardHeaters;
+}
+
+// Return the average rate at which the drives of a tool will be extruding in mm/sec, in a window centred 'lookAhead' seconds from now.
+// Retractions don't need any heat, so we ignore them. Moves we are still planning take longer to start than we will know about, so at worst we underestimate the rate.
+float Move::GetPlannedExtrusionRate(const Tool& tool, float lookAhead) const
 {
-	return ddaRingAddPointer->AdvanceBabyStepping(amount);
+	const int32_t windowStart = (int32_t)(max<float>(lookAhead - FeedForwardWindow/2, 0.0) * StepClockRate);
+	const int32_t windowEnd = (int32_t)((lookAhead + FeedForwardWindow/2) * StepClockRate);
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+
+	const DDA *dda = currentDda;								// capture volatile variable
+	int32_t moveStart;											// when the move starts relative to now, in step clocks
+	if (dda != nullptr)
+	{
+		moveStart = dda->GetTimeLeft() - (int32_t)dda->GetClocksNeeded();
+	}
+	else
+	{
+		dda = ddaRingGetPointer;
+		moveStart = 0;
+	}
+
+	float extrusion = 0.0;
+	while (moveStart < windowEnd && dda != ddaRingAddPointer)
+	{
+		const DDA::DDAState st = dda->GetState();
+		if (st != DDA::provisional && st != DDA::frozen && st != DDA::executing)
+		{
+			break;
+		}
+
+		const int32_t moveClocks = (int32_t)dda->GetClocksNeeded();
+		const int32_t overlap = min<int32_t>(moveStart + moveClocks, windowEnd) - max<int32_t>(moveStart, windowStart);
+		if (overlap > 0)
+		{
+			float moveExtrusion = 0.0;
+			for (size_t i = 0; i < tool.DriveCount(); ++i)
+			{
+				moveExtrusion += max<float>(dda->GetExtrusion(numTotalAxes + tool.Drive(i)), 0.0);
+			}
+			extrusion += moveExtrusion * (float)overlap/(float)moveClocks;
+		}
+		moveStart += moveClocks;
+		dda = dda->GetNext();
+	}
+	return extrusion * (float)StepClockRate/(float)(windowEnd - windowStart);
 }
 
 // Change the kinematics to the specified type if it isn't already
@@ -406,6 +869,96 @@ bool Move::SetKinematics(KinematicsType k)
 	return true;
 }
 
+// Add a move from GCodes to the DDA ring. The caller must have checked that there is room for it.
+void Move::AddMoveToRing(GCodes::RawMove& nextMove)
+{
+#if 0	// disabled this because it causes jerky movements on the SCARA printer
+	// Add on the extrusion left over from last time.
+	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t drive = numAxes; drive < DRIVES; ++drive)
+	{
+		nextMove.coords[drive] += extrusionPending[drive - numAxes];
+	}
+#endif
+	if (nextMove.moveType == 0)
+	{
+		AxisAndBedTransform(nextMove.coords, nextMove.xAxes, nextMove.yAxes, true);
+	}
+
+	const uint32_t initStartCycles = StageTimer::GetCycles();
+	const bool moveAdded = ddaRingAddPointer->Init(nextMove, !IsRawMotorMove(nextMove.moveType));
+	initTimer.Record(StageTimer::GetCycles() - initStartCycles);
+	if (!moveAdded)
+	{
+		reprap.GetGCodes().MovesDiscarded(1);		// keep the code queue synchronised
+	}
+	else
+	{
+		// Measure how often we can add moves, but only while the ring has had space for them, because otherwise we are waiting for moves to complete
+		const uint32_t now = Platform::GetInterruptClocks();
+		const uint32_t interval = now - lastMoveAddedTime;
+		if (ringHadSpace && interval < MaxMoveSupplySample)
+		{
+			moveSupplyClocks = (7 * moveSupplyClocks + interval)/8;
+		}
+		lastMoveAddedTime = now;
+
+		ddaRingAddPointer = ddaRingAddPointer->GetNext();
+		idleCount = 0;
+		scheduledMoves++;
+		if (moveState == MoveState::idle || moveState == MoveState::timing)
+		{
+			moveState = MoveState::collecting;
+			const uint32_t now = millis();
+			const uint32_t timeWaiting = now - lastStateChangeTime;
+			if (timeWaiting > longestGcodeWaitInterval)
+			{
+				longestGcodeWaitInterval = timeWaiting;
+			}
+			lastStateChangeTime = now;
+		}
+	}
+
+#if 0	// see above
+	// Save the amount of extrusion not done
+	for (size_t drive = numAxes; drive < DRIVES; ++drive)
+	{
+		extrusionPending[drive - numAxes] = nextMove.coords[drive];
+	}
+#endif
+
+#if SUPPORT_LASER_RASTER
+	if (nextMove.laserRaster != nullptr)			// if the DDA didn't take the raster
+	{
+		LaserRaster::Release(nextMove.laserRaster);
+		nextMove.laserRaster = nullptr;
+	}
+#endif
+}
+
+// Decide whether to enforce a minimum move duration. This is called when the ring has space for another move, passing the execution time of the provisional moves in it.
+// If the ring is draining because short moves execute faster than we can add new ones, we slow down the new moves so that each one lasts at least as long as it takes to add one.
+// This costs less print time than letting the ring run dry, which makes the machine stop.
+void Move::UpdateMinSegmentTime(uint32_t queuedClocks)
+{
+	if (maxMinSegmentClocks == 0 || simulationMode != 0)
+	{
+		enforcingMinSegmentTime = false;
+		minSegmentClocks = 0;
+		return;
+	}
+
+	if (queuedClocks < MinSegmentLowWaterTime)
+	{
+		enforcingMinSegmentTime = true;
+	}
+	else if (queuedClocks > MinSegmentHighWaterTime)
+	{
+		enforcingMinSegmentTime = false;
+	}
+	minSegmentClocks = (enforcingMinSegmentTime) ? min<uint32_t>(moveSupplyClocks + moveSupplyClocks/4, maxMinSegmentClocks) : 0;
+}
+
 // Return true if this is a raw motor move
 bool Move::IsRawMotorMove(uint8_t moveType) const
 {
@@ -423,7 +976,7 @@ bool Move::IsAccessibleProbePoint(float x, float y) const
 bool Move::PausePrint(RestorePoint& rp)
 {
 	// Find a move we can pause after.
-	// Ideally, we would adjust a move if necessary and possible so that we can pause after it, but for now we don't do that.
+	// If fast pausing is enabled (M576 S1), we may instead shorten a move that hasn't started so that the machine decelerates to rest within it.
 	// There are a few possibilities:
 	// 1. There is no currently executing move and no moves in the queue, and GCodes does not have a move for us.
 	//    Pause immediately. Resume from the current file position.
@@ -478,6 +1031,42 @@ bool Move::PausePrint(RestorePoint& rp)
 
 	cpu_irq_enable();
 
+	if (fastPause && SplitMoveForPause())
+	{
+		// We shortened a move so that the machine stops part way along it
+		dda = ddaRingAddPointer->GetPrevious();
+		const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+		for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+		{
+			rp.moveCoords[axis] = dda->GetEndCoordinate(axis, false);
+		}
+
+		InverseAxisAndBedTransform(rp.moveCoords, dda->GetXAxes(), dda->GetYAxes());
+
+#if SUPPORT_LASER || SUPPORT_IOBITS
+		rp.laserPwmOrIoBits = dda->GetLaserPwmOrIoBits();
+#endif
+		if (dda->UsingStandardFeedrate())
+		{
+			rp.feedRate = dda->GetRequestedSpeed();
+		}
+		rp.virtualExtruderPosition = dda->GetVirtualExtruderPosition();
+		rp.filePos = dda->GetFilePosition();
+		rp.proportionDone = dda->GetProportionDoneAtEnd();	// when we resume, skip the part of the move that we are still going to do
+
+		// Free the DDAs for the moves after it
+		for (dda = ddaRingAddPointer; dda != savedDdaRingAddPointer; dda = dda->GetNext())
+		{
+			(void)dda->Free();
+			scheduledMoves--;
+		}
+#if SUPPORT_MOVE_MERGING
+		merger.Clear();									// the move we were holding back comes after the ones we skipped
+#endif
+		++pauseSplits;
+		return true;
+	}
+
 	// We may be going to skip some moves. Get the end coordinate of the previous move.
 	DDA * const prevDda = ddaRingAddPointer->GetPrevious();
 	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
@@ -494,17 +1083,21 @@ bool Move::PausePrint(RestorePoint& rp)
 
 	if (ddaRingAddPointer == savedDdaRingAddPointer)
 	{
+#if SUPPORT_MOVE_MERGING
+		if (merger.IsHolding() && pauseOkHere)
+		{
+			SkipHeldMove(rp);							// we can pause before the move that we are holding back
+			return true;
+		}
+#endif
 		return false;									// we can't skip any moves
 	}
 
+#if SUPPORT_MOVE_MERGING
+	merger.Clear();										// the move we were holding back comes after the ones we are going to skip
+#endif
 	dda = ddaRingAddPointer;
-	rp.proportionDone = dda->GetProportionDone(false);	// get the proportion of the current multi-segment move that has been completed
-	if (dda->UsingStandardFeedrate())
-	{
-		rp.feedRate = dda->GetRequestedSpeed();
-	}
-	rp.virtualExtruderPosition = dda->GetVirtualExtruderPosition();
-	rp.filePos = dda->GetFilePosition();
+	SetRestorePointBefore(*dda, rp);
 
 	// Free the DDAs for the moves we are going to skip
 	do
@@ -518,6 +1111,137 @@ bool Move::PausePrint(RestorePoint& rp)
 	return true;
 }
 
+// Find the first move in the queue that we could pause before, in the same way as PausePrint, and set up the restore point to resume from the start of it.
+// Unlike PausePrint this doesn't discard any moves, so the caller can plan what to do at that point while the moves before it are still executing.
+// Return false if there is no such move in the queue, in which case the boundary is after the last queued move and the caller should use its own position.
+bool Move::GetNextPauseBoundary(RestorePoint& rp) const
+{
+	cpu_irq_disable();
+	const DDA *dda = currentDda;
+	bool pauseOkHere;
+	if (dda == nullptr)
+	{
+		pauseOkHere = true;
+		dda = ddaRingGetPointer;
+	}
+	else
+	{
+		pauseOkHere = dda->CanPauseAfter();
+		dda = dda->GetNext();
+	}
+
+	while (dda != ddaRingAddPointer && !pauseOkHere)
+	{
+		pauseOkHere = dda->CanPauseAfter();
+		dda = dda->GetNext();
+	}
+	cpu_irq_enable();
+
+	// Only Spin adds moves to the ring, so the move we found and the one before it can't be reused while we read them
+	if (dda == ddaRingAddPointer)
+	{
+		return false;
+	}
+	SetRestorePointBefore(*dda, rp);
+	return true;
+}
+
+// Set up a restore point to resume from the start of a move in the ring. The move before it must still be in the ring too.
+void Move::SetRestorePointBefore(const DDA& dda, RestorePoint& rp) const
+{
+	DDA * const prevDda = dda.GetPrevious();
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+	{
+		rp.moveCoords[axis] = prevDda->GetEndCoordinate(axis, false);
+	}
+	InverseAxisAndBedTransform(rp.moveCoords, prevDda->GetXAxes(), prevDda->GetYAxes());
+
+	if (dda.UsingStandardFeedrate())
+	{
+		rp.feedRate = dda.GetRequestedSpeed();
+	}
+	rp.virtualExtruderPosition = dda.GetVirtualExtruderPosition();
+	rp.filePos = dda.GetFilePosition();
+	rp.proportionDone = dda.GetProportionDone(false);
+#if SUPPORT_LASER || SUPPORT_IOBITS
+	rp.laserPwmOrIoBits = dda.GetLaserPwmOrIoBits();
+#endif
+}
+
+// Look for a move that hasn't been started, comes before the point at which PausePrint would otherwise pause, and that we can shorten
+// so that the machine decelerates to rest within it. If we find one, shorten it, set ddaRingAddPointer to the move after it and return true.
+// The caller must then discard the moves from the new ddaRingAddPointer up to the end of the queue.
+bool Move::SplitMoveForPause()
+{
+	cpu_irq_disable();
+	DDA *dda = currentDda;
+	if (dda == nullptr)
+	{
+		cpu_irq_enable();
+		return false;									// no move is executing, so PausePrint can already pause before the next one
+	}
+
+	// Don't choose a move that the step ISR might start before we have finished shortening it
+	int32_t clocksBeforeStart = dda->GetTimeLeft();
+	const DDA * const pauseDda = ddaRingAddPointer;		// PausePrint has set this to the move before which it would pause, or left it unchanged
+	DDA *splitDda = nullptr;
+	for (dda = dda->GetNext(); dda != pauseDda && clocksBeforeStart >= (int32_t)MinPauseSplitClocks; dda = dda->GetNext())
+	{
+		const DDA::DDAState st = dda->GetState();
+		if (st != DDA::frozen && (st != DDA::provisional || dda->GetPrevious()->GetState() == DDA::provisional))
+		{
+			break;										// moves are prepared in order, so don't shorten a move whose predecessor isn't prepared yet
+		}
+		if (dda->CanTruncateForPause() && (st == DDA::frozen || !PreparingDMs() || DriveMovement::CanAllocateForMove()))
+		{
+			splitDda = dda;
+			break;
+		}
+		clocksBeforeStart += dda->GetClocksNeeded();
+	}
+	cpu_irq_enable();
+
+	if (splitDda == nullptr)
+	{
+		return false;
+	}
+
+	splitDda->TruncateForPause(simulationMode, PreparingDMs());
+	ddaRingAddPointer = splitDda->GetNext();
+	return true;
+}
+
+#if SUPPORT_MOVE_MERGING
+
+// Discard the move that we are holding back for merging and set up the restore point to resume the print from the start of it.
+// The caller must have checked that we can pause after the last move in the ring.
+void Move::SkipHeldMove(RestorePoint& rp)
+{
+	DDA * const lastDda = ddaRingAddPointer->GetPrevious();
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+	{
+		rp.moveCoords[axis] = lastDda->GetEndCoordinate(axis, false);
+	}
+	InverseAxisAndBedTransform(rp.moveCoords, lastDda->GetXAxes(), lastDda->GetYAxes());
+
+	const GCodes::RawMove& heldMove = merger.GetHeldMove();
+	if (heldMove.usingStandardFeedrate)
+	{
+		rp.feedRate = heldMove.feedRate;
+	}
+	rp.virtualExtruderPosition = heldMove.virtualExtruderPosition;
+	rp.filePos = heldMove.filePos;
+	rp.proportionDone = 0.0;
+#if SUPPORT_LASER || SUPPORT_IOBITS
+	rp.laserPwmOrIoBits = heldMove.laserPwmOrIoBits;
+#endif
+	merger.Clear();
+}
+
+#endif
+
 #if HAS_VOLTAGE_MONITOR
 
 // Pause the print immediately, returning true if we were able to skip or abort any moves and setting up to the move we aborted
@@ -536,6 +1260,7 @@ bool Move::LowPowerPause(RestorePoint& rp)
 		CurrentMoveCompleted();							// updates live endpoints, extrusion, ddaRingGetPointer, currentDda etc.
 		--completedMoves;								// this move wasn't really completed
 		abortedMove = true;
+		powerFailFrozen = false;						// the tick ISR may have stopped this move already
 	}
 	else
 	{
@@ -558,9 +1283,20 @@ bool Move::LowPowerPause(RestorePoint& rp)
 
 	if (dda == savedDdaRingAddPointer)
 	{
+#if SUPPORT_MOVE_MERGING
+		if (merger.IsHolding())
+		{
+			SkipHeldMove(rp);							// the move that we are holding back always comes from the file, so we can skip it
+			return true;
+		}
+#endif
 		return false;									// we can't skip any moves
 	}
 
+#if SUPPORT_MOVE_MERGING
+	merger.Clear();										// the move we were holding back comes after the ones we are going to skip
+#endif
+
 	// We are going to skip some moves, or part of a move.
 	// Store the parameters of the first move we are going to execute when we resume
 	rp.feedRate = dda->GetRequestedSpeed();
@@ -594,20 +1330,86 @@ bool Move::LowPowerPause(RestorePoint& rp)
 	return true;
 }
 
+// Stop generating steps for the current move, if it is a move from the file being printed, because the power is failing.
+// This is called from the tick ISR as soon as it sees the low voltage, so that the motors stop without waiting for the main loop.
+// The move stays current with its step counts intact, so that LowPowerPause can abort it and work out where it stopped.
+void Move::PowerFailFreeze()
+{
+	const irqflags_t flags = cpu_irq_save();
+	const DDA * const dda = currentDda;
+	if (simulationMode == 0 && dda != nullptr && dda->GetFilePosition() != noFilePosition)
+	{
+		Platform::DisableStepInterrupt();
+		powerFailFreezeTime = Platform::GetInterruptClocks();
+		powerFailFrozen = true;
+	}
+	cpu_irq_restore(flags);
+}
+
+// Continue the move that PowerFailFreeze stopped. This is used when we don't pause the print after all, e.g. because it was already pausing.
+void Move::PowerFailUnfreeze()
+{
+	const irqflags_t flags = cpu_irq_save();
+	if (powerFailFrozen)
+	{
+		powerFailFrozen = false;
+		currentDda->DelayMove(Platform::GetInterruptClocks() - powerFailFreezeTime);	// carry on from where we stopped
+		Interrupt();
+	}
+	cpu_irq_restore(flags);
+}
+
 #endif
 
 void Move::Diagnostics(MessageType mtype)
 {
 	Platform& p = reprap.GetPlatform();
 	p.Message(mtype, "=== Move ===\n");
-	p.MessageF(mtype, "Hiccups: %u, StepErrors: %u, LaErrors: %u, FreeDm: %d, MinFreeDm: %d, MaxWait: %" PRIu32 "ms, Underruns: %u, %u\n",
-						DDA::numHiccups, stepErrors, numLookaheadErrors, DriveMovement::NumFree(), DriveMovement::MinFree(), longestGcodeWaitInterval, numLookaheadUnderruns, numPrepareUnderruns);
+	p.MessageF(mtype, "Hiccups: %u, StepErrors: %u, LaErrors: %u, FreeDm: %d, MinFreeDm: %d, FreeDmBlocks: %u, MaxWait: %" PRIu32 "ms, Underruns: %u, %u\n",
+						DDA::numHiccups, stepErrors, numLookaheadErrors, DriveMovement::NumFree(), DriveMovement::MinFree(), DriveMovementBlock::NumFree(),
+						longestGcodeWaitInterval, numLookaheadUnderruns, numPrepareUnderruns);
 	DDA::numHiccups = 0;
+	p.MessageF(mtype, "Step events: %" PRIu32 ", steps: %" PRIu32 ", pause splits: %u\n", DDA::numStepEvents, DDA::numStepsGenerated, pauseSplits);
+	DDA::numStepEvents = DDA::numStepsGenerated = 0;
+	pauseSplits = 0;
+	if (maxMinSegmentClocks != 0)
+	{
+		p.MessageF(mtype, "Move supply interval: %.2fms, moves slowed: %u\n", (double)((float)moveSupplyClocks * 1000.0/(float)StepClockRate), numSegmentsSlowed);
+	}
+	numSegmentsSlowed = 0;
+	p.MessageF(mtype, "Prepare ahead: %.1fms, longest Spin gap %.1fms, average move %.1fms\n",
+				(double)((float)preparedTimeTarget * 1000.0/(float)StepClockRate), (double)((float)spinIntervalPeak * 1000.0/(float)StepClockRate),
+				(double)((float)moveClocksAverage * 1000.0/(float)StepClockRate));
+#if SUPPORT_MICROSTEP_SWITCHING
+	p.MessageF(mtype, "Reduced microstepping moves: %u, driver timeouts: %u\n", numReducedMicrostepMoves, numMicrostepChangeTimeouts);
+	numReducedMicrostepMoves = numMicrostepChangeTimeouts = 0;
+#endif
 	stepErrors = 0;
 	numLookaheadUnderruns = numPrepareUnderruns = numLookaheadErrors = 0;
 	longestGcodeWaitInterval = 0;
 	DriveMovement::ResetMinFree();
 
+#if SUPPORT_INPUT_SHAPING
+	shaper.Diagnostics(mtype);
+#endif
+#if SUPPORT_MOVE_MERGING
+	merger.Diagnostics(mtype);
+#endif
+
+#if SUPPORT_STEP_TABLES
+	p.MessageF(mtype, "Step tables: free %u, underruns %u\n", StepTable::NumFree(), StepTable::NumUnderruns());
+	StepTable::ResetUnderruns();
+#endif
+
+	// Report the planner stage timings and the step ISR duty cycle
+	initTimer.Diagnostics(mtype);
+	lookaheadTimer.Diagnostics(mtype);
+	prepareTimer.Diagnostics(mtype);
+	initTimer.Reset();
+	lookaheadTimer.Reset();
+	prepareTimer.Reset();
+	p.MessageF(mtype, "Step ISR duty cycle: %.2f%%\n", (double)GetStepIsrDutyCycle());
+
 	reprap.GetPlatform().MessageF(mtype, "Scheduled moves: %" PRIu32 ", completed moves: %" PRIu32 "\n", scheduledMoves, completedMoves);
 
 #if defined(__ALLIGATOR__)
@@ -653,6 +1455,26 @@ void Move::Diagnostics(MessageType mtype)
 #endif
 }
 
+// Add the CPU time that the step ISR has used since we last did this to the total. The ISR only ever adds to stepIsrCycles, so we don't need to disable interrupts.
+void Move::CollectStepIsrCycles()
+{
+	const uint32_t isrCycles = stepIsrCycles;
+	totalStepIsrCycles += isrCycles - lastStepIsrCycles;
+	lastStepIsrCycles = isrCycles;
+}
+
+// Return the percentage of CPU time spent in the step ISR since we last asked, and start a new measurement period
+float Move::GetStepIsrDutyCycle()
+{
+	CollectStepIsrCycles();
+	const uint64_t isrCycles = totalStepIsrCycles;
+	const uint32_t now = millis();
+	const uint64_t elapsedCycles = (uint64_t)(now - isrTimingStartTime) * (VARIANT_MCK/1000);
+	totalStepIsrCycles = 0;
+	isrTimingStartTime = now;
+	return (elapsedCycles == 0) ? 0.0 : 100.0 * (float)isrCycles/(float)elapsedCycles;
+}
+
 // Set the current position to be this
 void Move::SetNewPosition(const float positionNow[DRIVES], bool doBedCompensation)
 {
@@ -669,6 +1491,16 @@ void Move::SetPositions(const float move[DRIVES])
 	if (DDARingEmpty())
 	{
 		ddaRingAddPointer->GetPrevious()->SetPositions(move, DRIVES);
+
+		// The new positions take the place of any babysteps that we haven't made yet
+		const irqflags_t flags = cpu_irq_save();
+		for (size_t i = 0; i < XYZ_AXES; ++i)
+		{
+			babyStepsPending[i] = 0;
+		}
+		babySteppingPending = false;
+		cpu_irq_restore(flags);
+		babyStepOffset = 0.0;
 	}
 	else
 	{
@@ -723,17 +1555,102 @@ bool Move::CartesianToMotorSteps(const float machinePos[MaxAxes], int32_t motorP
 
 void Move::AxisAndBedTransform(float xyzPoint[MaxAxes], AxesBitmap xAxes, AxesBitmap yAxes, bool useBedCompensation) const
 {
-	AxisTransform(xyzPoint, xAxes, yAxes);
-	if (useBedCompensation)
+	if (xAxes == DefaultXAxisMapping && yAxes == DefaultYAxisMapping && (useBedCompensation || !transformIncludesBed))
 	{
-		BedTransform(xyzPoint, xAxes, yAxes);
+		// Use the cached transform, leaving just the mesh or nonlinear bed compensation to do
+		ApplyTransform(transform, xyzPoint);
+		if (useBedCompensation && !transformIncludesBed)
+		{
+			BedTransform(xyzPoint, xAxes, yAxes);
+		}
+	}
+	else
+	{
+		AxisTransform(xyzPoint, xAxes, yAxes);
+		if (useBedCompensation)
+		{
+			BedTransform(xyzPoint, xAxes, yAxes);
+		}
 	}
 }
 
 void Move::InverseAxisAndBedTransform(float xyzPoint[MaxAxes], AxesBitmap xAxes, AxesBitmap yAxes) const
 {
-	InverseBedTransform(xyzPoint, xAxes, yAxes);
-	InverseAxisTransform(xyzPoint, xAxes, yAxes);
+	if (xAxes == DefaultXAxisMapping && yAxes == DefaultYAxisMapping)
+	{
+		if (!transformIncludesBed)
+		{
+			InverseBedTransform(xyzPoint, xAxes, yAxes);
+		}
+		ApplyTransform(inverseTransform, xyzPoint);
+	}
+	else
+	{
+		InverseBedTransform(xyzPoint, xAxes, yAxes);
+		InverseAxisTransform(xyzPoint, xAxes, yAxes);
+	}
+}
+
+// Recalculate the cached transforms. This must be called whenever the axis-angle compensation, the bed plane, the Z shift, the taper or the use of the mesh changes.
+void Move::UpdateTransforms()
+{
+	// Axis-angle compensation: X' = X + tanXY*Y + tanXZ*Z, Y' = Y + tanYZ*Z
+	float t[3][4] =
+	{
+		{ 1.0, tanXY, tanXZ, 0.0 },
+		{ 0.0, 1.0,   tanYZ, 0.0 },
+		{ 0.0, 0.0,   1.0,   0.0 }
+	};
+
+	// If the bed compensation is a plane and isn't tapered, it is linear too: Z' = Z + aX*X' + aY*Y' + aC + zShift
+	float aX, aY, aC;
+	transformIncludesBed = !usingMesh && !useTaper && probePoints.GetPlaneEquation(aX, aY, aC);
+	if (transformIncludesBed)
+	{
+		for (size_t col = 0; col < 4; ++col)
+		{
+			t[Z_AXIS][col] += aX * t[X_AXIS][col] + aY * t[Y_AXIS][col];
+		}
+		t[Z_AXIS][3] += aC + zShift;
+	}
+
+	// Invert the 3x3 part using its cofactors, then the constant terms
+	float det =   t[0][0] * (t[1][1] * t[2][2] - t[1][2] * t[2][1])
+				- t[0][1] * (t[1][0] * t[2][2] - t[1][2] * t[2][0])
+				+ t[0][2] * (t[1][0] * t[2][1] - t[1][1] * t[2][0]);
+	if (fabsf(det) < 0.01)
+	{
+		// The bed plane is too steep to invert the combined transform reliably, so leave the bed compensation out of it
+		transformIncludesBed = false;
+		t[Z_AXIS][X_AXIS] = t[Z_AXIS][Y_AXIS] = t[Z_AXIS][3] = 0.0;
+		t[Z_AXIS][Z_AXIS] = 1.0;
+		det = 1.0;
+	}
+
+	for (size_t row = 0; row < 3; ++row)
+	{
+		for (size_t col = 0; col < 3; ++col)
+		{
+			// The inverse is the transposed matrix of cofactors divided by the determinant
+			const size_t r1 = (col + 1) % 3, r2 = (col + 2) % 3, c1 = (row + 1) % 3, c2 = (row + 2) % 3;
+			inverseTransform[row][col] = (t[r1][c1] * t[r2][c2] - t[r1][c2] * t[r2][c1])/det;
+		}
+	}
+	for (size_t row = 0; row < 3; ++row)
+	{
+		inverseTransform[row][3] = -(inverseTransform[row][0] * t[0][3] + inverseTransform[row][1] * t[1][3] + inverseTransform[row][2] * t[2][3]);
+	}
+	memcpy(transform, t, sizeof(transform));
+}
+
+// Apply one of the cached transforms to the X, Y and Z coordinates
+/*static*/ void Move::ApplyTransform(const float t[3][4], float xyzPoint[MaxAxes])
+{
+	const float x = xyzPoint[X_AXIS], y = xyzPoint[Y_AXIS], z = xyzPoint[Z_AXIS];
+	for (size_t axis = 0; axis < 3; ++axis)
+	{
+		xyzPoint[axis] = t[axis][X_AXIS] * x + t[axis][Y_AXIS] * y + t[axis][Z_AXIS] * z + t[axis][3];
+	}
 }
 
 // Do the Axis transform BEFORE the bed transform
@@ -886,6 +1803,7 @@ void Move::SetZeroHeightError(const float coords[MaxAxes])
 	memcpy(tempCoords, coords, sizeof(tempCoords));
 	AxisTransform(tempCoords, DefaultXAxisMapping, DefaultYAxisMapping);
 	zShift = -GetInterpolatedHeightError(tempCoords[X_AXIS], tempCoords[Y_AXIS]);
+	UpdateTransforms();
 }
 
 void Move::SetIdentityTransform()
@@ -895,6 +1813,7 @@ void Move::SetIdentityTransform()
 	heightMap.UseHeightMap(false);
 	usingMesh = false;
 	zShift = 0.0;
+	UpdateTransforms();
 }
 
 // Load the height map from file, returning true if an error occurred with the error reason appended to the buffer
@@ -908,6 +1827,7 @@ bool Move::LoadHeightMapFromFile(FileStore *f, const StringRef& r)
 	else
 	{
 		zShift = 0.0;
+		UpdateTransforms();
 	}
 	return ret;
 }
@@ -938,12 +1858,14 @@ void Move::SetTaperHeight(float h)
 		taperHeight = h;
 		recipTaperHeight = 1.0/h;
 	}
+	UpdateTransforms();
 }
 
 // Enable mesh bed compensation
 bool Move::UseMesh(bool b)
 {
 	usingMesh = heightMap.UseHeightMap(b);
+	UpdateTransforms();
 	return usingMesh;
 }
 
@@ -957,6 +1879,7 @@ void Move::SetAxisCompensation(unsigned int axis, float tangent)
 	if (axis < ARRAY_SIZE(tangents))
 	{
 		tangents[axis] = tangent;
+		UpdateTransforms();
 	}
 }
 
@@ -995,22 +1918,125 @@ bool Move::FinishedBedProbing(int sParam, const StringRef& reply)
 			reply.copy("Compensation or calibration cancelled due to probing errors");
 			error = true;
 		}
-		else if (kinematics->SupportsAutoCalibration())
-		{
-			error = kinematics->DoAutoCalibration(sParam, probePoints, reply);
-		}
 		else
 		{
-			error = probePoints.SetProbedBedEquation(sParam, reply);
+			float sumOfSquares = 0.0;
+			for (size_t i = 0; i < numPoints; ++i)
+			{
+				sumOfSquares += fsquare(probePoints.GetZHeight(i));
+			}
+			lastCalibrationDeviation = sqrtf(sumOfSquares/numPoints);
+
+			error = (kinematics->SupportsAutoCalibration())
+					? kinematics->DoAutoCalibration(sParam, probePoints, reply)
+						: probePoints.SetProbedBedEquation(sParam, reply);
+			if (!error)
+			{
+				++numCalibrationsDone;
+			}
 		}
 	}
 
 	// Clear out the Z heights so that we don't re-use old points.
 	// This allows us to use different numbers of probe point on different occasions.
 	probePoints.ClearProbeHeights();
+	ClearCalibrationEstimate();
+	UpdateTransforms();									// the bed equation may have changed
 	return error;
 }
 
+// Estimate the RMS deviation that would remain if we calibrated the specified number of factors using the points probed so far.
+// This solves the normal equations built up as the points were probed, which is equivalent to the first iteration of the auto calibration.
+// Return false if we can't make an estimate, because the kinematics doesn't support it or we don't have enough good points yet.
+bool Move::GetExpectedCalibrationDeviation(size_t numFactors, float& deviation) const
+{
+	if (numFactors == 0 || numFactors > numCalibrationDerivatives || numCalibrationPoints <= numFactors)
+	{
+		return false;
+	}
+
+	FixedMatrix<floatc_t, MaxCalibrationDerivatives, MaxCalibrationDerivatives + 1> normalMatrix;
+	floatc_t rhs[MaxCalibrationDerivatives];
+	for (size_t i = 0; i < numFactors; ++i)
+	{
+		const size_t di = kinematics->GetCalibrationDerivativeIndex(numFactors, i);
+		for (size_t j = 0; j <= i; ++j)
+		{
+			const size_t dj = kinematics->GetCalibrationDerivativeIndex(numFactors, j);
+			normalMatrix(i, j) = (di >= dj) ? calibrationNormalMatrix(di, dj) : calibrationNormalMatrix(dj, di);
+		}
+		rhs[i] = normalMatrix(i, numFactors) = calibrationNormalMatrix(di, MaxCalibrationDerivatives);
+	}
+
+	floatc_t solution[MaxCalibrationDerivatives];
+	if (!normalMatrix.Cholesky(solution, numFactors, 0.0))
+	{
+		return false;
+	}
+
+	// For a linear least squares fit, the residual sum of squares is the sum of squares of the errors less the solution dotted with the right hand side
+	floatc_t residualSumOfSquares = calibrationSumOfSquares;
+	for (size_t i = 0; i < numFactors; ++i)
+	{
+		residualSumOfSquares -= solution[i] * rhs[i];
+	}
+	deviation = sqrtf((float)(max<floatc_t>(residualSumOfSquares, 0.0)/numCalibrationPoints));
+	return true;
+}
+
+// Start building the calibration normal equations again
+void Move::ClearCalibrationEstimate()
+{
+	for (size_t i = 0; i < MaxCalibrationDerivatives; ++i)
+	{
+		for (size_t j = 0; j <= MaxCalibrationDerivatives; ++j)
+		{
+			calibrationNormalMatrix(i, j) = 0.0;
+		}
+	}
+	calibrationSumOfSquares = 0.0;
+	numCalibrationDerivatives = 0;
+	numCalibrationPoints = 0;
+}
+
+// Add a newly probed point to the calibration normal equations. The points must be probed in order and without errors,
+// otherwise we stop estimating until the next set of points starts.
+void Move::AddCalibrationPoint(size_t index)
+{
+	if (index == 0)
+	{
+		ClearCalibrationEstimate();
+	}
+	else if (index != numCalibrationPoints || numCalibrationDerivatives == 0)
+	{
+		numCalibrationDerivatives = 0;
+		return;
+	}
+
+	float x, y;
+	const floatc_t zError = GetProbeCoordinates(index, x, y, probePoints.PointWasCorrected(index));
+	floatc_t derivatives[MaxCalibrationDerivatives];
+	const size_t numDerivatives = kinematics->GetCalibrationDerivatives(x, y, derivatives);
+	if (numDerivatives == 0 || (index != 0 && numDerivatives != numCalibrationDerivatives))
+	{
+		numCalibrationDerivatives = 0;
+		return;
+	}
+
+	// Accumulate the lower triangle of the normal matrix and the right hand side, which is in the last column
+	for (size_t i = 0; i < numDerivatives; ++i)
+	{
+		for (size_t j = 0; j <= i; ++j)
+		{
+			calibrationNormalMatrix(i, j) += derivatives[i] * derivatives[j];
+		}
+		calibrationNormalMatrix(i, MaxCalibrationDerivatives) -= derivatives[i] * zError;
+	}
+	calibrationSumOfSquares += fcsquare(zError);
+	numCalibrationDerivatives = numDerivatives;
+	++numCalibrationPoints;
+}
+
 // Perform motor endpoint adjustment
 void Move::AdjustMotorPositions(const float_t adjustment[], size_t numMotors)
 {
@@ -1018,6 +2044,8 @@ void Move::AdjustMotorPositions(const float_t adjustment[], size_t numMotors)
 	const int32_t * const endCoordinates = lastQueuedMove->DriveCoordinates();
 	const float * const driveStepsPerUnit = reprap.GetPlatform().GetDriveStepsPerUnit();
 
+	const irqflags_t flags = cpu_irq_save();
+	liveLock.BeginWrite();
 	for (size_t drive = 0; drive < numMotors; ++drive)
 	{
 		const int32_t ep = endCoordinates[drive] + lrintf(adjustment[drive] * driveStepsPerUnit[drive]);
@@ -1026,13 +2054,18 @@ void Move::AdjustMotorPositions(const float_t adjustment[], size_t numMotors)
 	}
 
 	liveCoordinatesValid = false;		// force the live XYZ position to be recalculated
+	liveLock.EndWrite();
+	cpu_irq_restore(flags);
 }
 
 // This is called from the step ISR when the current move has been completed
 void Move::CurrentMoveCompleted()
 {
 	// Save the current motor coordinates, and the machine Cartesian coordinates if known
+	liveLock.BeginWrite();
 	liveCoordinatesValid = currentDda->FetchEndPosition(const_cast<int32_t*>(liveEndPoints), const_cast<float *>(liveCoordinates));
+	liveLock.EndWrite();
+	babyStepDirectionsSet = 0;							// the direction pins of the babystepping motors may have been changed by the move
 	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
 	for (size_t drive = numAxes; drive < DRIVES; ++drive)
 	{
@@ -1042,18 +2075,54 @@ void Move::CurrentMoveCompleted()
 			extruderNonPrinting[drive - numAxes] = true;
 		}
 	}
+	completedMoveClocks += currentDda->GetClocksNeeded();
+	moveTotals.accelTime += currentDda->GetAccelerationTime();
+	moveTotals.distance += currentDda->GetTotalDistance();
+	if (currentDda->GetTopSpeed() > moveTotals.peakSpeed)
+	{
+		moveTotals.peakSpeed = currentDda->GetTopSpeed();
+	}
+#if SUPPORT_MOVE_TRACE
+	MoveTracer::Record(*currentDda);
+#endif
 	currentDda = nullptr;
 
 	ddaRingGetPointer = ddaRingGetPointer->GetNext();
 	completedMoves++;
 }
 
+// Return the total time that the completed moves were planned to take, in seconds.
+// PrintMonitor compares this with the simulated print time to estimate the time left.
+float Move::GetCompletedMoveTime() const
+{
+	const irqflags_t flags = cpu_irq_save();			// the step ISR updates this, and we can't read a 64-bit value atomically
+	const uint64_t clocks = completedMoveClocks;
+	cpu_irq_restore(flags);
+	return (float)clocks * (1.0/StepClockRate);
+}
+
+// Get the running totals of the move statistics, and clear the peak speed so that the next call returns the peak since this one
+void Move::GetMoveTotals(MoveTotals& totals)
+{
+	const irqflags_t flags = cpu_irq_save();
+	totals = moveTotals;
+	totals.hiccups = DDA::totalHiccups;
+	moveTotals.peakSpeed = 0.0;
+	cpu_irq_restore(flags);
+}
+
 // Try to start another move. Must be called with interrupts disabled, to avoid a race condition.
 bool Move::TryStartNextMove(uint32_t startTime)
 {
 	const DDA::DDAState st = ddaRingGetPointer->GetState();
 	if (st == DDA::frozen)
 	{
+#if SUPPORT_MICROSTEP_SWITCHING
+		if (ddaRingGetPointer->NeedsMicrostepChange(reducedMicrostepAxes))
+		{
+			return false;							// Move::Spin must change the microstepping of the drivers before it starts this move
+		}
+#endif
 		return StartNextMove(startTime);
 	}
 	else
@@ -1062,6 +2131,7 @@ bool Move::TryStartNextMove(uint32_t startTime)
 		{
 			// There are more moves available, but they are not prepared yet. Signal an underrun.
 			++numPrepareUnderruns;
+			++moveTotals.prepareUnderruns;
 		}
 		reprap.GetPlatform().ExtrudeOff();			// turn off ancillary PWM
 #if SUPPORT_LASER
@@ -1100,10 +2170,8 @@ void Move::GetCurrentMachinePosition(float m[MaxAxes], bool disableMotorMapping)
 // Is filament being extruded?
 bool Move::IsExtruding() const
 {
-	cpu_irq_disable();
-	const bool rslt = currentDda != nullptr && currentDda->IsPrintingMove();
-	cpu_irq_enable();
-	return rslt;
+	const DDA * const cdda = currentDda;						// capture volatile variable, then we don't need to disable interrupts
+	return cdda != nullptr && cdda->IsPrintingMove();
 }
 
 // Return the transformed machine coordinates
@@ -1117,37 +2185,54 @@ void Move::GetCurrentUserPosition(float m[MaxAxes], uint8_t moveType, AxesBitmap
 }
 
 // Return the current live XYZ and extruder coordinates
-// Interrupts are assumed enabled on entry
+// This must not be called from an ISR, because it waits for any update by the step ISR to complete
 void Move::LiveCoordinates(float m[DRIVES], AxesBitmap xAxes, AxesBitmap yAxes)
 {
-	// The live coordinates and live endpoints are modified by the ISR, so be careful to get a self-consistent set of them
-	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();		// do this before we disable interrupts
-	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();			// do this before we disable interrupts
-	cpu_irq_disable();
-	if (liveCoordinatesValid)
-	{
-		// All coordinates are valid, so copy them across
-		memcpy(m, const_cast<const float *>(liveCoordinates), sizeof(m[0]) * DRIVES);
-		cpu_irq_enable();
-	}
-	else
+	// The live coordinates and live endpoints are modified by the ISR, so take copies and try again if the ISR changed them while we were copying them
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	int32_t tempEndPoints[MaxAxes];
+	uint32_t seq;
+	bool valid;
+	do
 	{
-		// Only the extruder coordinates are valid, so we need to convert the motor endpoints to coordinates
-		memcpy(m + numTotalAxes, const_cast<const float *>(liveCoordinates + numTotalAxes), sizeof(m[0]) * (DRIVES - numTotalAxes));
-		int32_t tempEndPoints[MaxAxes];
-		memcpy(tempEndPoints, const_cast<const int32_t*>(liveEndPoints), sizeof(tempEndPoints));
-		cpu_irq_enable();
+		seq = liveLock.BeginRead();
+		valid = liveCoordinatesValid;
+		if (valid)
+		{
+			// All coordinates are valid, so copy them across
+			memcpy(m, const_cast<const float *>(liveCoordinates), sizeof(m[0]) * DRIVES);
+		}
+		else
+		{
+			// Only the extruder coordinates are valid, so we need to convert the motor endpoints to coordinates
+			memcpy(m + numTotalAxes, const_cast<const float *>(liveCoordinates + numTotalAxes), sizeof(m[0]) * (DRIVES - numTotalAxes));
+			memcpy(tempEndPoints, const_cast<const int32_t*>(liveEndPoints), sizeof(tempEndPoints));
+		}
+	} while (liveLock.ReadFailed(seq));
 
-		MotorStepsToCartesian(tempEndPoints, numVisibleAxes, numTotalAxes, m);		// this is slow, so do it with interrupts enabled
+	if (!valid)
+	{
+		// The sequence number identifies the endpoints we copied, so if we have already converted them we can use the cached result.
+		// The cache belongs to the tasks, so we only need to stop other tasks from using it at the same time, not the step ISR.
+		bool haveCached;
+		{
+			TaskCriticalSectionLocker lock;
+			haveCached = (cachedLiveCoordinatesSeq == seq);
+			if (haveCached)
+			{
+				memcpy(m, cachedLiveCoordinates, sizeof(m[0]) * numVisibleAxes);
+			}
+		}
 
-		// If the ISR has not updated the endpoints, store the live coordinates back so that we don't need to do it again
-		cpu_irq_disable();
-		if (memcmp(tempEndPoints, const_cast<const int32_t*>(liveEndPoints), sizeof(tempEndPoints)) == 0)
+		if (!haveCached)
 		{
-			memcpy(const_cast<float *>(liveCoordinates), m, sizeof(m[0]) * numVisibleAxes);
-			liveCoordinatesValid = true;
+			MotorStepsToCartesian(tempEndPoints, numVisibleAxes, numTotalAxes, m);	// this is slow, so do it outside the critical section
+
+			TaskCriticalSectionLocker lock;
+			memcpy(cachedLiveCoordinates, m, sizeof(m[0]) * numVisibleAxes);
+			cachedLiveCoordinatesSeq = seq;
 		}
-		cpu_irq_enable();
 	}
 	InverseAxisAndBedTransform(m, xAxes, yAxes);
 }
@@ -1156,22 +2241,34 @@ void Move::LiveCoordinates(float m[DRIVES], AxesBitmap xAxes, AxesBitmap yAxes)
 // The caller must make sure that no moves are in progress or pending when calling this
 void Move::SetLiveCoordinates(const float coords[DRIVES])
 {
+	// Convert the coordinates to motor endpoints before we disable interrupts, because this is slow on some machines. If it fails we keep the old endpoints.
+	int32_t endPoints[MaxAxes];
+	memcpy(endPoints, const_cast<const int32_t *>(liveEndPoints), sizeof(endPoints));
+	EndPointToMachine(coords, endPoints, reprap.GetGCodes().GetVisibleAxes());
+
+	const irqflags_t flags = cpu_irq_save();
+	liveLock.BeginWrite();
 	for (size_t drive = 0; drive < DRIVES; drive++)
 	{
 		liveCoordinates[drive] = coords[drive];
 	}
 	liveCoordinatesValid = true;
-	EndPointToMachine(coords, const_cast<int32_t *>(liveEndPoints), reprap.GetGCodes().GetVisibleAxes());
+	memcpy(const_cast<int32_t *>(liveEndPoints), endPoints, sizeof(endPoints));
+	liveLock.EndWrite();
+	cpu_irq_restore(flags);
 }
 
 void Move::ResetExtruderPositions()
 {
-	cpu_irq_disable();
-	for (size_t eDrive = reprap.GetGCodes().GetTotalAxes(); eDrive < DRIVES; eDrive++)
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	const irqflags_t flags = cpu_irq_save();
+	liveLock.BeginWrite();
+	for (size_t eDrive = numTotalAxes; eDrive < DRIVES; eDrive++)
 	{
 		liveCoordinates[eDrive] = 0.0;
 	}
-	cpu_irq_enable();
+	liveLock.EndWrite();
+	cpu_irq_restore(flags);
 }
 
 // Get the accumulated extruder motor steps taken by an extruder since the last call. Used by the filament monitoring code.
@@ -1230,6 +2327,14 @@ void Move::SetZBedProbePoint(size_t index, float z, bool wasXyCorrected, bool wa
 	else
 	{
 		probePoints.SetZBedProbePoint(index, z, wasXyCorrected, wasError);
+		if (wasError)
+		{
+			numCalibrationDerivatives = 0;
+		}
+		else
+		{
+			AddCalibrationPoint(index);
+		}
 	}
 }
 
@@ -1250,12 +2355,51 @@ float Move::GetProbeCoordinates(int count, float& x, float& y, bool wantNozzlePo
 }
 
 // Enter or leave simulation mode
-void Move::Simulate(uint8_t simMode)
+void Move::Simulate(uint8_t simMode, bool benchmark)
 {
 	simulationMode = simMode;
+	benchmarking = benchmark && simMode != 0;
 	if (simMode != 0)
 	{
 		simulationTime = 0.0;
+		simulationStartMillis = millis();
+		if (benchmarking)
+		{
+			initTimer.Reset();
+			lookaheadTimer.Reset();
+			prepareTimer.Reset();
+			stepCalcTimer.Reset();
+			numStepsChecked = maxStepTimeError = 0;
+			totalStepTimeError = 0;
+		}
+	}
+}
+
+// Report the planner performance at the end of a benchmark simulation. Call this before leaving simulation mode.
+void Move::ReportBenchmark(MessageType mtype) const
+{
+	if (benchmarking)
+	{
+		const uint32_t numMoves = initTimer.GetCount();
+		const float elapsedSeconds = (float)(millis() - simulationStartMillis) * 0.001;
+		reprap.GetPlatform().MessageF(mtype, "Benchmark: %" PRIu32 " moves planned in %.1f sec (%.0f moves/sec), simulated move time %.1f sec\n",
+										numMoves, (double)elapsedSeconds, (double)((elapsedSeconds > 0.0) ? numMoves/elapsedSeconds : 0.0), (double)simulationTime);
+		initTimer.Diagnostics(mtype);
+		lookaheadTimer.Diagnostics(mtype);
+		prepareTimer.Diagnostics(mtype);
+
+		// EVEN_STEPS and ROUND_TO_NEAREST are compile-time options, so we report them to allow builds that use different settings to be compared
+		Platform& p = reprap.GetPlatform();
+		stepCalcTimer.Diagnostics(mtype);
+		const uint32_t meanStepCycles = stepCalcTimer.GetMeanCycles();
+		p.MessageF(mtype, "Step generation on %s with EVEN_STEPS=%d ROUND_TO_NEAREST=%d: %" PRIu32 " cycles/step, calculation limit %.0f steps/sec\n",
+					p.GetElectronicsString(), EVEN_STEPS, ROUND_TO_NEAREST, meanStepCycles, (double)((meanStepCycles == 0) ? 0.0 : (float)VARIANT_MCK/meanStepCycles));
+		if (numStepsChecked != 0)
+		{
+			constexpr float ClocksToMicroseconds = 1000000.0/StepClockRate;
+			p.MessageF(mtype, "Step timing error of %" PRIu32 " steps: mean %.2fus, max %.2fus\n",
+						numStepsChecked, (double)((float)totalStepTimeError/numStepsChecked * ClocksToMicroseconds), (double)(maxStepTimeError * ClocksToMicroseconds));
+		}
 	}
 }
 
@@ -1325,6 +2469,17 @@ GCodeResult Move::ConfigureAccelerations(GCodeBuffer&gb, const StringRef& reply)
 // Process M593
 GCodeResult Move::ConfigureDynamicAcceleration(GCodeBuffer& gb, const StringRef& reply)
 {
+#if SUPPORT_INPUT_SHAPING
+	// M593 P"zv", P"zvd" or P"ei" selects input shaping, P"scurve" selects S-curve acceleration with a jerk time of 1/F seconds,
+	// P"none" turns off input shaping, S-curve acceleration and dynamic ringing cancellation
+	bool error = false;
+	if (shaper.Configure(gb, reply, error))
+	{
+		drcEnabled = false;
+		return GetGCodeResultFromError(error);
+	}
+#endif
+
 	bool seen = false;
 	if (gb.Seen('F'))
 	{
@@ -1360,6 +2515,303 @@ GCodeResult Move::ConfigureDynamicAcceleration(GCodeBuffer& gb, const StringRef&
 	return GCodeResult::ok;
 }
 
+// Process M596. Set or report the window within which steps for different drives are generated together.
+GCodeResult Move::ConfigureStepMerging(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (gb.Seen('W'))
+	{
+		const float window = gb.GetFValue();					// the window in microseconds
+		if (window < 0.0)
+		{
+			reply.copy("Step merge window must not be negative");
+			return GCodeResult::error;
+		}
+		const uint32_t windowClocks = (uint32_t)(window * (float)StepClockRate * 0.000001);
+		DDA::stepMergeWindow = constrain<uint32_t>(windowClocks, DDA::MinInterruptInterval, DDA::MaxStepMergeWindow);
+	}
+	else
+	{
+		reply.printf("Step merge window %.1fus", (double)((float)DDA::stepMergeWindow * 1000000.0/(float)StepClockRate));
+	}
+	return GCodeResult::ok;
+}
+
+// Process M937. P sets the number of moves in the DDA ring and S sets the number of DMs, which limits how many moves we can prepare ahead for machines with many drives.
+// We never free memory once we have allocated it, so we can only increase them. We make sure that enough RAM is left free for the other things that allocate memory later.
+GCodeResult Move::ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& reply)
+{
+	constexpr uint32_t MinRamToLeaveFree = 8 * 1024;			// a margin for network buffers, file handles and task stacks that are allocated later
+	constexpr size_t HeapOverhead = 8;							// the amount of memory that each heap allocation uses in addition to the object
+
+	bool seen = false;
+	uint32_t newRingLength = ddaRingLength, newNumDms = numDms;
+	gb.TryGetUIValue('P', newRingLength, seen);
+	gb.TryGetUIValue('S', newNumDms, seen);
+	if (!seen)
+	{
+		reply.printf("DDA ring length %u, DMs %u plus %u blocks of %u, never used RAM %" PRIu32,
+						ddaRingLength, numDms, NumDmBlocks, DriveMovementBlock::DMsPerBlock, Tasks::GetNeverUsedRam());
+		return GCodeResult::ok;
+	}
+
+	if (newRingLength < ddaRingLength || newNumDms < numDms)
+	{
+		reply.copy("The DDA ring length and number of DMs can only be increased");
+		return GCodeResult::error;
+	}
+
+	const uint32_t ramNeeded = (newRingLength - ddaRingLength) * (sizeof(DDA) + HeapOverhead) + (newNumDms - numDms) * (sizeof(DriveMovement) + HeapOverhead);
+	if (ramNeeded + MinRamToLeaveFree > Tasks::GetNeverUsedRam())
+	{
+		reply.printf("Not enough free RAM, %" PRIu32 " bytes needed", ramNeeded + MinRamToLeaveFree);
+		return GCodeResult::error;
+	}
+
+	// The caller waited for the movement to stop, but there may be completed moves that Spin hasn't freed yet
+	while (ddaRingCheckPointer->GetState() == DDA::completed)
+	{
+		(void)ddaRingCheckPointer->Free();
+		ddaRingCheckPointer = ddaRingCheckPointer->GetNext();
+	}
+
+	// Insert the new DDAs after the add pointer, so that the previous DDA of the next move we add is still the one holding the current position
+	while (ddaRingLength < newRingLength)
+	{
+		DDA * const oldNext = ddaRingAddPointer->GetNext();
+		DDA * const dda = new DDA(oldNext);
+		dda->Init();
+		dda->SetPrevious(ddaRingAddPointer);
+		oldNext->SetPrevious(dda);
+		ddaRingAddPointer->SetNext(dda);
+		++ddaRingLength;
+	}
+
+	if (newNumDms > numDms)
+	{
+		DriveMovement::InitialAllocate(newNumDms - numDms);
+		numDms = newNumDms;
+	}
+	return GCodeResult::ok;
+}
+
+// Process M934. S sets the longest minimum move duration in milliseconds that we may impose when the ring is draining, or S0 to disable this.
+GCodeResult Move::ConfigureMinSegmentTime(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (gb.Seen('S'))
+	{
+		const float maxTime = gb.GetFValue();					// the time in milliseconds
+		if (maxTime < 0.0 || maxTime > 100.0)
+		{
+			reply.copy("Minimum move duration must be between 0 and 100ms");
+			return GCodeResult::error;
+		}
+		maxMinSegmentClocks = (uint32_t)(maxTime * (float)StepClockRate * 0.001);
+		if (maxMinSegmentClocks == 0)
+		{
+			enforcingMinSegmentTime = false;
+			minSegmentClocks = 0;
+		}
+	}
+	else if (maxMinSegmentClocks == 0)
+	{
+		reply.copy("Minimum move duration is disabled");
+	}
+	else
+	{
+		reply.printf("Minimum move duration up to %.1fms, currently %.2fms, move supply interval %.2fms",
+						(double)((float)maxMinSegmentClocks * 1000.0/(float)StepClockRate), (double)((float)minSegmentClocks * 1000.0/(float)StepClockRate),
+						(double)((float)moveSupplyClocks * 1000.0/(float)StepClockRate));
+	}
+	return GCodeResult::ok;
+}
+
+#if SUPPORT_MICROSTEP_SWITCHING
+
+// Process M936. S sets the shortest move in milliseconds that we reduce the microstepping for.
+// The axis parameters set the microstepping to use for each axis in those moves, or zero to always use the microstepping set by M350.
+// We can only change the microstepping while the motors are stopped, so this only applies to travel moves that start and end at rest.
+GCodeResult Move::ConfigureMicrostepReduction(GCodeBuffer& gb, const StringRef& reply)
+{
+	bool seen = false;
+	if (gb.Seen('S'))
+	{
+		const float minTime = gb.GetFValue();					// the time in milliseconds
+		if (minTime < 0.0)
+		{
+			reply.copy("Minimum move duration must not be negative");
+			return GCodeResult::error;
+		}
+		minReducedMicrostepClocks = (uint32_t)(minTime * (float)StepClockRate * 0.001);
+		seen = true;
+	}
+
+	const Platform& platform = reprap.GetPlatform();
+	const char * const axisLetters = reprap.GetGCodes().GetAxisLetters();
+	const size_t numAxes = reprap.GetGCodes().GetVisibleAxes();
+	for (size_t axis = 0; axis < numAxes; ++axis)
+	{
+		if (gb.Seen(axisLetters[axis]))
+		{
+			seen = true;
+			const uint32_t microsteps = gb.GetUIValue();
+			if (microsteps != 0)
+			{
+				bool dummy;
+				const unsigned int normalMicrostepping = platform.GetMicrostepping(axis, dummy);
+				if (axis == Z_AXIS || !platform.CanReduceMicrostepping(axis))
+				{
+					reply.printf("Reduced microstepping is not supported on axis %c", axisLetters[axis]);
+					return GCodeResult::error;
+				}
+				if (   (microsteps & (microsteps - 1)) != 0
+					|| microsteps >= normalMicrostepping
+					|| (microsteps << DDA::MaxMicrostepReductionShift) < normalMicrostepping
+				   )
+				{
+					reply.printf("Reduced microstepping for axis %c must be a power of 2 from %u to %u", axisLetters[axis],
+									max<unsigned int>(normalMicrostepping >> DDA::MaxMicrostepReductionShift, 1), normalMicrostepping/2);
+					return GCodeResult::error;
+				}
+			}
+			reducedMicrostepping[axis] = (uint8_t)microsteps;
+		}
+	}
+
+	if (!seen)
+	{
+		reply.printf("Reduced microstepping in moves longer than %.0fms:", (double)((float)minReducedMicrostepClocks * 1000.0/(float)StepClockRate));
+		bool any = false;
+		for (size_t axis = 0; axis < numAxes; ++axis)
+		{
+			if (reducedMicrostepping[axis] != 0)
+			{
+				reply.catf(" %c%u", axisLetters[axis], reducedMicrostepping[axis]);
+				any = true;
+			}
+		}
+		if (!any)
+		{
+			reply.cat(" none");
+		}
+	}
+	return GCodeResult::ok;
+}
+
+// Return log2 of the factor by which to reduce the microstepping of an axis in a long travel move, or zero if we shouldn't reduce it
+unsigned int Move::GetMicrostepReduction(size_t axis) const
+{
+	const unsigned int microsteps = reducedMicrostepping[axis];
+	if (microsteps != 0)
+	{
+		bool dummy;
+		const unsigned int normalMicrostepping = reprap.GetPlatform().GetMicrostepping(axis, dummy);
+		if (normalMicrostepping > microsteps)
+		{
+			return min<unsigned int>(__builtin_ctz(normalMicrostepping) - __builtin_ctz(microsteps), DDA::MaxMicrostepReductionShift);
+		}
+	}
+	return 0;
+}
+
+// Get the drivers ready for a move that the step ISR didn't start because it needs a change to the microstepping, returning true if the move can be started now.
+// Any steps at normal microstepping that the move needs are made before its axes are switched to reduced microstepping.
+// Called from Spin with no move executing and the step interrupt disabled.
+bool Move::SetMicrosteppingForMove(DDA& dda)
+{
+	if (MicrostepChangePending())
+	{
+		return false;
+	}
+
+	const AxesBitmap remainderAxes = dda.GetMicrostepRemainderAxes();
+	if ((remainderAxes & reducedMicrostepAxes) != 0)
+	{
+		ChangeMicrostepReduction(reducedMicrostepAxes & ~remainderAxes);
+		return false;
+	}
+	if (remainderAxes != 0)
+	{
+		dda.MakeMicrostepRemainderSteps();
+	}
+
+	const AxesBitmap newReducedAxes = dda.GetReducedMicrostepAxes();
+	if (newReducedAxes != reducedMicrostepAxes)
+	{
+		for (AxesBitmap axes = newReducedAxes; axes != 0; axes &= axes - 1)
+		{
+			const size_t axis = __builtin_ctz(axes);
+			reprap.GetPlatform().SetMicrostepReduction(axis, dda.GetMicrostepReduction(axis));
+		}
+		ChangeMicrostepReduction(newReducedAxes);
+		return false;
+	}
+
+	if (newReducedAxes != 0)
+	{
+		++numReducedMicrostepMoves;
+	}
+	return true;
+}
+
+// Restore normal microstepping on the axes that are reduced but are not in the new set, and record the change so that we wait for the drivers to receive it.
+// The caller must already have set the reduction of the axes in the new set.
+void Move::ChangeMicrostepReduction(AxesBitmap newReducedAxes)
+{
+	for (AxesBitmap axes = reducedMicrostepAxes & ~newReducedAxes; axes != 0; axes &= axes - 1)
+	{
+		reprap.GetPlatform().SetMicrostepReduction(__builtin_ctz(axes), 0);
+	}
+	changingMicrostepAxes |= reducedMicrostepAxes | newReducedAxes;
+	reducedMicrostepAxes = newReducedAxes;
+	microstepChangeStartTime = millis();
+}
+
+// Return true if we are still waiting for the drivers to receive the last microstepping change.
+// If they haven't received it within the timeout, we assume they are not powered and carry on, because a driver without power doesn't move the motor anyway.
+bool Move::MicrostepChangePending()
+{
+	const Platform& platform = reprap.GetPlatform();
+	for (AxesBitmap axes = changingMicrostepAxes; axes != 0; axes &= axes - 1)
+	{
+		if (platform.IsMicrostepChangePending(__builtin_ctz(axes)))
+		{
+			if (millis() - microstepChangeStartTime < MicrostepChangeTimeout)
+			{
+				return true;
+			}
+			++numMicrostepChangeTimeouts;
+			break;
+		}
+	}
+	changingMicrostepAxes = 0;
+	return false;
+}
+
+bool Move::MicrosteppingRestored()
+{
+	if (reducedMicrostepAxes != 0)
+	{
+		ChangeMicrostepReduction(0);
+	}
+	return !MicrostepChangePending();
+}
+
+#endif
+
+// Process M576
+GCodeResult Move::ConfigurePause(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (gb.Seen('S'))
+	{
+		fastPause = (gb.GetIValue() > 0);
+	}
+	else
+	{
+		reply.printf("Pause %s", (fastPause) ? "as soon as the machine can decelerate to rest" : "at the end of a move");
+	}
+	return GCodeResult::ok;
+}
+
 // For debugging
 void Move::PrintCurrentDda() const
 {
@@ -15,21 +15,45 @@
 #include "BedProbing/Grid.h"
 #include "Kinematics/Kinematics.h"
 #include "GCodes/RestorePoint.h"
+#include "InputShaper.h"
+#include "MoveMerger.h"
+#include "StageTimer.h"
+#include "RTOSIface.h"
 
 // Define the number of DDAs and DMs.
-// A DDA represents a move in the queue.
-// Each DDA needs one DM per drive that it moves.
-// However, DM's are large, so we provide fewer than DRIVES * DdaRingLength of them. The planner checks that enough DMs are available before filling in a new DDA.
+// A DDA represents a move in the queue. Un-prepared DDAs hold just what the lookahead needs, so we can afford a long ring of them.
+// Each prepared DDA needs one DM per drive that it moves. DMs are large, so we only provide enough of them for the moves that are prepared or executing.
+// The DMs are allocated when a move is prepared, and Move::Spin checks that enough DMs are available before it prepares a move.
+// Each prepared move normally gets a block of DMs for its first few drives, so NumDms is the number of additional DMs for moves that use more drives.
+// The ring length and the number of DMs are the defaults. M937 can increase them at runtime if the board has the RAM to spare.
 
 #if SAM4E || SAM4S || SAME70
-const unsigned int DdaRingLength = 30;
-const unsigned int NumDms = DdaRingLength * 8;						// suitable for e.g. a delta + 5 input hot end
+const unsigned int DefaultDdaRingLength = 60;
+const unsigned int MaxPreparedMoves = 14;							// the maximum number of prepared or executing moves
+const unsigned int NumDmBlocks = MaxPreparedMoves + 2;
+const unsigned int DefaultNumDms = (MaxPreparedMoves + 2) * 4;		// with the DM blocks, suitable for e.g. a delta + 5 input hot end
+const unsigned int NumStepTables = 24;								// enough for the fast axes of the prepared moves
+const unsigned int NumLaserRasters = 32;							// the maximum number of queued raster moves
 #else
 // We are more memory-constrained on the SAM3X
-const unsigned int DdaRingLength = 20;
-const unsigned int NumDms = DdaRingLength * 5;						// suitable for e.g. a delta + 2-input hot end
+const unsigned int DefaultDdaRingLength = 32;
+const unsigned int MaxPreparedMoves = 9;							// the maximum number of prepared or executing moves
+const unsigned int NumDmBlocks = MaxPreparedMoves + 2;
+const unsigned int DefaultNumDms = (MaxPreparedMoves + 2) * 1;		// with the DM blocks, suitable for e.g. a delta + 2-input hot end
+const unsigned int NumLaserRasters = 8;								// the maximum number of queued raster moves
 #endif
 
+// Running totals of move execution statistics, used to profile each layer of a print. Unlike the M122 counters these are not reset when they are reported.
+struct MoveTotals
+{
+	float accelTime;									// time that the completed moves spent accelerating or decelerating
+	float distance;										// distance moved by the completed moves
+	float peakSpeed;									// highest top speed of the moves completed since the totals were last fetched
+	uint32_t lookaheadUnderruns;
+	uint32_t prepareUnderruns;
+	uint32_t hiccups;
+};
+
 /**
  * This is the master movement class.  It controls all movement in the machine.
  */
@@ -48,6 +72,8 @@ public:
 	void LiveCoordinates(float m[DRIVES], AxesBitmap xAxes, AxesBitmap yAxes);	// Gives the last point at the end of the last complete DDA transformed to user coords
 	void Interrupt() __attribute__ ((hot));							// The hardware's (i.e. platform's)  interrupt should call this.
 	bool AllMovesAreFinished();										// Is the look-ahead ring empty?  Stops more moves being added as well.
+	unsigned int GetNumberOfFreeMoveSlots() const;					// Return how many more moves could be queued right now
+	void ChangeSpeedFactor(float ratio);							// Apply a change in the speed factor to the moves that have not been frozen yet
 	void DoLookAhead() __attribute__ ((hot));						// Run the look-ahead procedure
 	void SetNewPosition(const float positionNow[DRIVES], bool doBedCompensation); // Set the current position to be this
 	void SetLiveCoordinates(const float coords[DRIVES]);			// Force the live coordinates (see above) to be these
@@ -56,6 +82,9 @@ public:
 	void SetZBedProbePoint(size_t index, float z, bool wasXyCorrected, bool wasError); // Record the Z coordinate of a probe point
 	float GetProbeCoordinates(int count, float& x, float& y, bool wantNozzlePosition) const; // Get pre-recorded probe coordinates
 	bool FinishedBedProbing(int sParam, const StringRef& reply);	// Calibrate or set the bed equation after probing
+	bool GetExpectedCalibrationDeviation(size_t numFactors, float& deviation) const;	// Estimate the deviation that calibrating now would leave
+	unsigned int GetNumCalibrationsDone() const { return numCalibrationsDone; }		// How many times calibration or bed compensation has succeeded
+	float GetLastCalibrationDeviation() const { return lastCalibrationDeviation; }	// The RMS of the probed heights before the last calibration
 	void SetAxisCompensation(unsigned int axis, float tangent);		// Set an axis-pair compensation angle
 	float AxisCompensation(unsigned int axis) const;				// The tangent value
 	void SetIdentityTransform();									// Cancel the bed equation; does not reset axis angle compensation
@@ -69,20 +98,46 @@ public:
 	bool UseMesh(bool b);											// Try to enable mesh bed compensation and report the final state
 	bool IsUsingMesh() const { return usingMesh; }					// Return true if we are using mesh compensation
 	unsigned int GetNumProbePoints() const;							// Return the number of currently used probe points
-	float PushBabyStepping(float amount);							// Try to push some babystepping through the lookahead queue
+	void PushBabyStepping(float amount);							// Offset the Z motor positions by some babystepping
+	bool HasBabyStepsPending() const { return babySteppingPending; }
+	uint32_t AddBabySteps(const DDA *dda, uint32_t driversStepping, uint32_t now) __attribute__ ((hot));	// Add pending babysteps to the drivers to be stepped
 
 	GCodeResult ConfigureAccelerations(GCodeBuffer&gb, const StringRef& reply);			// process M204
 	GCodeResult ConfigureDynamicAcceleration(GCodeBuffer& gb, const StringRef& reply);	// process M593
+	GCodeResult ConfigureStepMerging(GCodeBuffer& gb, const StringRef& reply);			// process M596
+	GCodeResult ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& reply);		// process M937
+	GCodeResult ConfigurePause(GCodeBuffer& gb, const StringRef& reply);				// process M576
+	GCodeResult ConfigureMinSegmentTime(GCodeBuffer& gb, const StringRef& reply);		// process M934
+	uint32_t GetMinSegmentClocks() const { return minSegmentClocks; }					// get the minimum duration of a normal move in step clocks, or zero
+	void RecordSegmentSlowed() { ++numSegmentsSlowed; }								// record that DDA::Init reduced the speed of a move to meet the minimum duration
+#if SUPPORT_MICROSTEP_SWITCHING
+	GCodeResult ConfigureMicrostepReduction(GCodeBuffer& gb, const StringRef& reply);	// process M936
+	uint32_t GetMinReducedMicrostepClocks() const { return minReducedMicrostepClocks; }	// get the shortest move that we use reduced microstepping for, in step clocks
+	unsigned int GetMicrostepReduction(size_t axis) const;								// get log2 of the factor by which to reduce the microstepping of an axis in long travel moves
+#endif
 
 	float GetMaxPrintingAcceleration() const { return maxPrintingAcceleration; }
 	float GetMaxTravelAcceleration() const { return maxTravelAcceleration; }
+	float GetJunctionDeviation() const { return junctionDeviation; }
+	void SetJunctionDeviation(float jd) { junctionDeviation = max<float>(jd, 0.0); }
 	float GetDRCfreq() const { return 1.0/drcPeriod; }
 	float GetDRCperiod() const { return drcPeriod; }
 	float GetDRCminimumAcceleration() const { return drcMinimumAcceleration; }
 	float IsDRCenabled() const { return drcEnabled; }
+#if SUPPORT_INPUT_SHAPING
+	InputShaper& GetShaper() { return shaper; }
+#endif
+#if SUPPORT_MOVE_MERGING
+	MoveMerger& GetMerger() { return merger; }
+	bool IsHoldingMove() const { return merger.IsHolding(); }		// Return true if we are holding back a move so that we can merge the following ones into it
+#endif
 
 	void Diagnostics(MessageType mtype);							// Report useful stuff
+	float GetStepIsrDutyCycle();									// Return the percentage of CPU time used by the step ISR since the last call
 	void RecordLookaheadError() { ++numLookaheadErrors; }			// Record a lookahead error
+	void RecordLookaheadTime(uint32_t cycles) { lookaheadTimer.Record(cycles); }	// Record how long a lookahead pass took
+	void RecordPrepareTime(uint32_t cycles)											// Record how long a call to DDA::Prepare took
+		{ prepareTimer.Record(cycles); prepareCyclesAverage = prepareCyclesAverage - prepareCyclesAverage/8 + cycles/8; }
 
 	// Kinematics and related functions
 	Kinematics& GetKinematics() const { return *kinematics; }
@@ -107,13 +162,17 @@ public:
 	float IdleTimeout() const;														// Returns the idle timeout in seconds
 	void SetIdleTimeout(float timeout);												// Set the idle timeout in seconds
 
-	void Simulate(uint8_t simMode);													// Enter or leave simulation mode
+	void Simulate(uint8_t simMode, bool benchmark = false);						// Enter or leave simulation mode, optionally preparing the moves fully to measure planner performance
+	void ReportBenchmark(MessageType mtype) const;									// Report the planner performance at the end of a benchmark simulation
 	float GetSimulationTime() const { return simulationTime; }						// Get the accumulated simulation time
 	void PrintCurrentDda() const;													// For debugging
 
 	bool PausePrint(RestorePoint& rp);												// Pause the print as soon as we can, returning true if we were able to
+	bool GetNextPauseBoundary(RestorePoint& rp) const;								// Describe the first queued point at which we could pause, without stopping or altering the queue
 #if HAS_VOLTAGE_MONITOR
 	bool LowPowerPause(RestorePoint& rp);											// Pause the print immediately, returning true if we were able to
+	void PowerFailFreeze();															// Stop generating steps for the current move because the power is failing
+	void PowerFailUnfreeze();														// Continue the move that PowerFailFreeze stopped, if it hasn't been aborted
 #endif
 
 	bool NoLiveMovement() const;													// Is a move running, or are there any queued?
@@ -123,6 +182,13 @@ public:
 	uint32_t GetScheduledMoves() const { return scheduledMoves; }					// How many moves have been scheduled?
 	uint32_t GetCompletedMoves() const { return completedMoves; }					// How many moves have been completed?
 	void ResetMoveCounters() { scheduledMoves = completedMoves = 0; }
+	float GetCompletedMoveTime() const;												// Get the total planned time of the moves that have been completed
+	void GetMoveTotals(MoveTotals& totals);											// Get the running totals of the move statistics and clear the peak speed
+	const MoveTotals& GetRunningTotals() const { return moveTotals; }				// Get the running totals without clearing anything
+	unsigned int GetStepErrors() const { return stepErrors; }						// Get the step error count since it was last reported by M122
+	const StageTimer& GetInitTimer() const { return initTimer; }
+	const StageTimer& GetLookaheadTimer() const { return lookaheadTimer; }
+	const StageTimer& GetPrepareTimer() const { return prepareTimer; }
 
 	HeightMap& AccessHeightMap() { return heightMap; }								// Access the bed probing grid
 	bool LoadHeightMapFromFile(FileStore *f, const StringRef& r);					// Load the height map from a file returning true if an error occurred
@@ -156,43 +222,112 @@ private:
 	};
 
 	bool StartNextMove(uint32_t startTime) __attribute__ ((hot));								// Start the next move, returning true if Step() needs to be called immediately
+	bool SplitMoveForPause();																	// Shorten a move that hasn't started so that we can pause at the end of it
+	void AddMoveToRing(GCodes::RawMove& nextMove);												// Add a move from GCodes to the DDA ring
+	void UpdateMinSegmentTime(uint32_t queuedClocks);											// Decide whether to enforce a minimum move duration to keep the ring from draining
+	void UpdatePreparedTimeTarget(uint32_t newMoveClocks);										// Decide how far ahead to prepare moves
+#if SUPPORT_MICROSTEP_SWITCHING
+	bool SetMicrosteppingForMove(DDA& dda);														// Get the drivers ready for a move, returning true if it can be started now
+	void ChangeMicrostepReduction(AxesBitmap newReducedAxes);									// Start changing which axes have reduced microstepping
+	bool MicrostepChangePending();																// Return true if the drivers are still receiving a microstepping change
+	bool MicrosteppingRestored();																// Restore normal microstepping, returning true when the drivers have it
+
+	static constexpr uint32_t DefaultMinReducedMicrostepTime = 200;								// The default shortest move that we reduce the microstepping for, in milliseconds
+	static constexpr uint32_t MicrostepChangeTimeout = 100;										// How long we wait for the drivers to receive a microstepping change, in milliseconds
+#endif
+#if SUPPORT_MOVE_MERGING
+	void SkipHeldMove(RestorePoint& rp);														// Discard the held move and set up the restore point to resume from it
+#endif
+	void SetRestorePointBefore(const DDA& dda, RestorePoint& rp) const;						// Set up a restore point to resume from the start of a queued move
 	void BedTransform(float move[MaxAxes], AxesBitmap xAxes, AxesBitmap yAxes) const;			// Take a position and apply the bed compensations
 	void InverseBedTransform(float move[MaxAxes], AxesBitmap xAxes, AxesBitmap yAxes) const;	// Go from a bed-transformed point back to user coordinates
 	void AxisTransform(float move[MaxAxes], AxesBitmap xAxes, AxesBitmap yAxes) const;			// Take a position and apply the axis-angle compensations
 	void InverseAxisTransform(float move[MaxAxes], AxesBitmap xAxes, AxesBitmap yAxes) const;	// Go from an axis transformed point back to user coordinates
+	void UpdateTransforms();																	// Recalculate the cached affine transforms after a compensation parameter has changed
+	static void ApplyTransform(const float transform[3][4], float move[MaxAxes]);				// Apply one of the cached affine transforms to the X, Y and Z coordinates
 	void SetPositions(const float move[DRIVES]);												// Force the machine coordinates to be these
 	float GetInterpolatedHeightError(float xCoord, float yCoord) const;							// Get the height error at an XY position
+	void ClearCalibrationEstimate();															// Start building the calibration normal equations again
+	void AddCalibrationPoint(size_t index);														// Add a newly probed point to the calibration normal equations
+	void CollectStepIsrCycles();																// Add the step ISR time since the last call to the total
+	void UpdateExtrusionFeedForward();															// Tell the heaters of the current tool how fast it will be extruding
+	float GetPlannedExtrusionRate(const Tool& tool, float lookAhead) const;						// Get the extrusion rate of a tool that the planned moves give a while from now
+
+	static constexpr uint32_t FeedForwardUpdateInterval = 50;	// How often we update the extrusion rates passed to the heaters, in milliseconds
+	static constexpr float FeedForwardWindow = 1.0;				// The length of time over which we average the planned extrusion rate, in seconds
 
 	bool DDARingAdd();									// Add a processed look-ahead entry to the DDA ring
 	DDA* DDARingGet();									// Get the next DDA ring entry to be run
+	bool PreparingDMs() const { return simulationMode == 0 || benchmarking; }	// Do the moves we prepare need drive movements?
 	bool DDARingEmpty() const;							// Anything there?
 
 	DDA* volatile currentDda;
+	unsigned int ddaRingLength;							// The number of DDAs in the ring
+	unsigned int numDms;								// The number of DMs we have allocated, not counting those in DM blocks
 	DDA* ddaRingAddPointer;
 	DDA* volatile ddaRingGetPointer;
 	DDA* ddaRingCheckPointer;
 
 	bool active;										// Are we live and running?
 	uint8_t simulationMode;								// Are we simulating, or really printing?
+	bool benchmarking;									// True if we are simulating with full preparation of the moves, to measure the planner
 	MoveState moveState;								// whether the idle timer is active
 	bool drcEnabled;
+	bool fastPause;										// True if we may shorten a move in the queue to pause sooner
+#if HAS_VOLTAGE_MONITOR
+	volatile bool powerFailFrozen;						// True if we have stopped generating steps for the current move because the power is failing
+	uint32_t powerFailFreezeTime;						// When we stopped it
+#endif
 
 	float maxPrintingAcceleration;
 	float maxTravelAcceleration;
+	float junctionDeviation;							// the junction deviation in mm, or zero to use the jerk limits at all junctions
 	float drcPeriod;									// the period of ringing that we don't want to excite
 	float drcMinimumAcceleration;						// the minimum value that we reduce acceleration to
+#if SUPPORT_INPUT_SHAPING
+	InputShaper shaper;									// input shaping parameters, used as an alternative to dynamic ringing cancellation
+#endif
+#if SUPPORT_MOVE_MERGING
+	MoveMerger merger;									// merges runs of short collinear moves before they are added to the ring
+#endif
 
 	unsigned int numLookaheadUnderruns;					// How many times we have run out of moves to adjust during lookahead
 	unsigned int numPrepareUnderruns;					// How many times we wanted a new move but there were only un-prepared moves in the queue
 	unsigned int numLookaheadErrors;					// How many times our lookahead algorithm failed
+	unsigned int pauseSplits;							// How many times we shortened a move to pause sooner
+	uint32_t maxMinSegmentClocks;						// The longest minimum move duration that we may impose, or zero if disabled
+	uint32_t minSegmentClocks;							// The minimum duration of a normal move that DDA::Init currently enforces, or zero
+	uint32_t moveSupplyClocks;							// Moving average of the interval between moves being added to the ring while it had space for them
+	uint32_t lastMoveAddedTime;							// When we last added a move to the ring
+	unsigned int numSegmentsSlowed;						// How many moves we slowed down to meet the minimum duration
+	bool ringHadSpace;									// True if we could add a move to the ring the last time Spin was called
+	uint32_t lastSpinTime;								// When Spin was last called, in step clocks
+	uint32_t spinIntervalPeak;							// The longest recent interval between calls to Spin, decaying over time, in step clocks
+	uint32_t prepareCyclesAverage;						// Moving average of the time DDA::Prepare takes, in CPU cycles
+	uint32_t moveClocksAverage;							// Moving average of the duration of the moves we prepare, in step clocks
+	uint32_t preparedTimeTarget;						// How far ahead we currently prepare moves, in step clocks
+#if SUPPORT_MICROSTEP_SWITCHING
+	uint8_t reducedMicrostepping[MaxAxes];				// The microstepping to use for each axis in long travel moves, or zero to not reduce it
+	uint32_t minReducedMicrostepClocks;					// The shortest move that we reduce the microstepping for, in step clocks
+	volatile AxesBitmap reducedMicrostepAxes;			// The axes whose drivers we have set to reduced microstepping, read by the step ISR
+	AxesBitmap changingMicrostepAxes;					// The axes whose drivers may not have received the latest microstepping change yet
+	uint32_t microstepChangeStartTime;					// When we last changed the microstepping
+	unsigned int numReducedMicrostepMoves;				// How many moves we executed with reduced microstepping
+	unsigned int numMicrostepChangeTimeouts;			// How many times the drivers didn't confirm a microstepping change in time
+#endif
+	bool enforcingMinSegmentTime;						// True if the ring was running low, so we are enforcing the minimum move duration
 	unsigned int idleCount;								// The number of times Spin was called and had no new moves to process
 	uint32_t longestGcodeWaitInterval;					// the longest we had to wait for a new GCode
 	float simulationTime;								// Print time since we started simulating
+	uint32_t simulationStartMillis;						// The millis() value when we started simulating, for benchmarking
 
 	float extrusionPending[MaxExtruders];				// Extrusion not done due to rounding to nearest step
 	volatile float liveCoordinates[DRIVES];				// The endpoint that the machine moved to in the last completed move
 	volatile bool liveCoordinatesValid;					// True if the XYZ live coordinates are reliable (the extruder ones always are)
 	volatile int32_t liveEndPoints[DRIVES];				// The XYZ endpoints of the last completed move in motor coordinates
+	SeqLock liveLock;									// Lets tasks read the above three without disabling interrupts
+	float cachedLiveCoordinates[MaxAxes];				// The XYZ coordinates we last calculated from liveEndPoints, owned by the tasks that read them
+	uint32_t cachedLiveCoordinatesSeq;					// The liveLock sequence number of the endpoints we calculated them from
 	volatile int32_t extrusionAccumulators[MaxExtruders]; // Accumulated extruder motor steps
 	volatile bool extruderNonPrinting[MaxExtruders];	// Set whenever the extruder starts a non-printing move
 
@@ -203,12 +338,25 @@ private:
 
 	HeightMap heightMap;    							// The grid definition in use and height map for G29 bed probing
 	RandomProbePointSet probePoints;					// G30 bed probe points
+
+	// Least squares normal equations built up as each G30 probe point is measured, so that we can estimate the result of calibration before probing has finished
+	FixedMatrix<floatc_t, MaxCalibrationDerivatives, MaxCalibrationDerivatives + 1> calibrationNormalMatrix;
+	floatc_t calibrationSumOfSquares;					// Sum of the squares of the probed height errors
+	size_t numCalibrationDerivatives;					// How many derivatives the kinematics provides, or 0 if we can't estimate the calibration
+	size_t numCalibrationPoints;						// How many probe points we have added to the normal equations
+	unsigned int numCalibrationsDone;					// How many times calibration or bed compensation has succeeded
+	float lastCalibrationDeviation;						// The RMS of the probed heights before the last calibration
 	float taperHeight;									// Height over which we taper
 	float recipTaperHeight;								// Reciprocal of the taper height
 	float zShift;										// Height to add to the bed transform
 	bool usingMesh;										// true if we are using the height map, false if we are using the random probe point set
 	bool useTaper;										// True to taper off the compensation
 
+	// The axis-angle compensation for the default X and Y axes composed with the bed compensation when that is a plane, and the inverse
+	float transform[3][4];								// Rows give the transformed X, Y and Z as coefficients of X, Y, Z and a constant
+	float inverseTransform[3][4];
+	bool transformIncludesBed;							// True if the transforms include all the bed compensation, false if they only include the axis-angle compensation
+
 	uint32_t idleTimeout;								// How long we wait with no activity before we reduce motor currents to idle, in milliseconds
 	uint32_t lastStateChangeTime;						// The approximate time at which the state last changed, except we don't record timing->idle
 
@@ -217,9 +365,36 @@ private:
 	unsigned int stepErrors;							// count of step errors, for diagnostics
 	uint32_t scheduledMoves;							// Move counters for the code queue
 	volatile uint32_t completedMoves;					// This one is modified by an ISR, hence volatile
+	uint64_t completedMoveClocks;						// The total planned step clocks of the completed moves, also modified by the ISR
+	MoveTotals moveTotals;								// Running totals for print profiling, partly modified by the ISR
+
+	StageTimer initTimer;								// Execution time of DDA::Init, including the lookahead
+	StageTimer lookaheadTimer;							// Execution time of DDA::DoLookahead
+	StageTimer prepareTimer;							// Execution time of DDA::Prepare
+	StageTimer stepCalcTimer;							// Execution time of each step time calculation, measured when benchmarking a simulation
+	uint32_t numStepsChecked;							// The number of step times compared with the exact motion profile when benchmarking
+	uint32_t maxStepTimeError;							// The largest difference in step clocks between a calculated step time and the exact one
+	uint64_t totalStepTimeError;
+	volatile uint32_t stepIsrCycles;					// CPU cycles spent in the step ISR, free-running and only written by the ISR
+	uint32_t lastStepIsrCycles;							// The value of stepIsrCycles when we last collected it
+	uint64_t totalStepIsrCycles;						// CPU cycles spent in the step ISR since the statistics were last reset
+	uint32_t isrTimingStartTime;						// The millis() value when the step ISR statistics were last reset
+
+	uint32_t lastFeedForwardTime;						// When we last updated the extrusion rates passed to the heaters
+	uint32_t feedForwardHeaters;						// Bitmap of heaters that we have passed non-zero extrusion rates to
 
 	float specialMoveCoords[DRIVES];					// Amounts by which to move individual motors (leadscrew adjustment move)
 	bool specialMoveAvailable;							// True if a leadscrew adjustment move is pending
+
+	float babyStepOffset;								// Babystepping applied since the positions were last set, used to avoid accumulating rounding errors
+	volatile int32_t babyStepsPending[XYZ_AXES];		// Babysteps not yet made on each babystepping motor, positive means forwards
+	volatile bool babySteppingPending;					// True if any of babyStepsPending is nonzero
+	uint32_t babyStepInterval;							// The minimum interval between babysteps, in step clocks
+	uint32_t lastBabyStepTime;							// When we last made a babystep or set a direction pin for babystepping
+	uint8_t babyStepMotors[XYZ_AXES];					// The motors that babystepping moves
+	uint8_t numBabyStepMotors;
+	uint8_t babyStepDirectionsSet;						// Bitmap of babystepping motors whose direction pins we have set while they are not moving
+	uint8_t babyStepDirectionsForwards;					// Bitmap of the directions we set them to
 };
 
 //******************************************************************************************************
@@ -240,7 +415,17 @@ inline bool Move::NoLiveMovement() const
 // Then call ResumeMoving() otherwise nothing more will ever happen.
 inline bool Move::AllMovesAreFinished()
 {
+#if SUPPORT_MOVE_MERGING
+	if (merger.IsHolding())
+	{
+		return false;
+	}
+#endif
+#if SUPPORT_MICROSTEP_SWITCHING
+	return NoLiveMovement() && MicrosteppingRestored();		// so that whatever the caller does next sees the normal microstepping
+#else
 	return NoLiveMovement();
+#endif
 }
 
 // Start the next move. Must be called with interrupts disabled, to avoid a race with the step ISR.
@@ -248,6 +433,7 @@ inline bool Move::StartNextMove(uint32_t startTime)
 pre(ddaRingGetPointer->GetState() == DDA::frozen)
 {
 	currentDda = ddaRingGetPointer;
+	babyStepDirectionsSet = 0;							// the new move may set the direction pins of the babystepping motors
 	return currentDda->Start(startTime);
 }
 
@@ -255,11 +441,17 @@ pre(ddaRingGetPointer->GetState() == DDA::frozen)
 // This may occasionally get called prematurely.
 inline void Move::Interrupt()
 {
+#if HAS_VOLTAGE_MONITOR
+	if (currentDda != nullptr && !powerFailFrozen)
+#else
 	if (currentDda != nullptr)
+#endif
 	{
+		const uint32_t startCycles = StageTimer::GetCycles();
 		do
 		{
 		} while (currentDda->Step());
+		stepIsrCycles += StageTimer::GetCycles() - startCycles;
 	}
 }
 
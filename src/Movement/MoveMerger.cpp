@@ -0,0 +1,226 @@
+/*
+ * MoveMerger.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "MoveMerger.h"
+
+#if SUPPORT_MOVE_MERGING
+
+#include "GCodes/GCodeBuffer.h"
+#include "Move.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+const float DefaultPositionTolerance = 0.01;			// mm
+const float DefaultAngleTolerance = 2.0;				// degrees
+
+MoveMerger::MoveMerger()
+	: heldLength(0.0), numSegments(0), canExtend(false), positionTolerance(DefaultPositionTolerance), cosAngleTolerance(cosf(DefaultAngleTolerance * DegreesToRadians)),
+	  enabled(false), numMovesMerged(0), numMergedMovesAdded(0)
+{
+}
+
+// Process M933.
+// M933 S1 enables merging and S0 disables it. D sets the positional tolerance in mm and A the angular tolerance in degrees.
+GCodeResult MoveMerger::Configure(GCodeBuffer& gb, const StringRef& reply)
+{
+	bool seen = false;
+	if (gb.Seen('D'))
+	{
+		const float d = gb.GetFValue();
+		if (d < 0.0)
+		{
+			reply.copy("Move merging tolerance must not be negative");
+			return GCodeResult::error;
+		}
+		positionTolerance = d;
+		seen = true;
+	}
+
+	if (gb.Seen('A'))
+	{
+		const float a = gb.GetFValue();
+		if (a < 0.0 || a >= 90.0)
+		{
+			reply.copy("Move merging angle must be between 0 and 90 degrees");
+			return GCodeResult::error;
+		}
+		cosAngleTolerance = cosf(a * DegreesToRadians);
+		seen = true;
+	}
+
+	if (gb.Seen('S'))
+	{
+		enabled = (gb.GetIValue() > 0);
+		seen = true;
+	}
+
+	if (!seen)
+	{
+		reply.printf("Move merging is %s, tolerance %.3fmm, angle %.1f degrees",
+						(enabled) ? "enabled" : "disabled", (double)positionTolerance, (double)(acosf(cosAngleTolerance) * RadiansToDegrees));
+	}
+	return GCodeResult::ok;
+}
+
+// Return the distance between two points in XYZ
+/*static*/ float MoveMerger::Length(const float *from, const float *to)
+{
+	float sumOfSquares = 0.0;
+	for (size_t axis = 0; axis < NumMergeAxes; ++axis)
+	{
+		sumOfSquares += fsquare(to[axis] - from[axis]);
+	}
+	return sqrtf(sumOfSquares);
+}
+
+// Return true if this move is a plain move from the file being printed that only moves X, Y and Z.
+// Moves that are part of a segmented move are never merged, nor are moves when mesh bed compensation is in use,
+// because merging them would lose the segment boundaries at which GCodes applies the compensation.
+bool MoveMerger::IsCandidate(const GCodes::RawMove& m) const
+{
+	if (   m.moveType != 0 || !m.isCoordinated || m.isFirmwareRetraction || m.endStopsToCheck != 0 || !m.canPauseAfter
+		|| m.proportionLeft != 0.0 || m.filePos == noFilePosition
+#if SUPPORT_LASER_RASTER
+		|| m.laserRaster != nullptr
+#endif
+		|| reprap.GetMove().IsUsingMesh()
+	   )
+	{
+		return false;
+	}
+
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	for (size_t axis = NumMergeAxes; axis < numVisibleAxes; ++axis)
+	{
+		if (m.coords[axis] != m.initialCoords[axis])
+		{
+			return false;
+		}
+	}
+	return Length(m.initialCoords, m.coords) > 0.0;
+}
+
+bool MoveMerger::CanHold(const GCodes::RawMove& m) const
+{
+	return enabled && IsCandidate(m);
+}
+
+void MoveMerger::Hold(const GCodes::RawMove& m)
+{
+	heldMove = m;
+	for (size_t axis = 0; axis < NumMergeAxes; ++axis)
+	{
+		segmentEnds[0][axis] = m.coords[axis];
+	}
+	heldLength = Length(m.initialCoords, m.coords);
+	numSegments = 1;
+	canExtend = CanHold(m);
+}
+
+// Append the move to the held move if the result is within tolerance, returning true if we did
+bool MoveMerger::TryMerge(const GCodes::RawMove& m)
+{
+	if (   numSegments == 0 || !CanExtend() || !IsCandidate(m)
+		|| m.feedRate != heldMove.feedRate || m.xAxes != heldMove.xAxes || m.yAxes != heldMove.yAxes
+		|| m.usePressureAdvance != heldMove.usePressureAdvance || m.usingStandardFeedrate != heldMove.usingStandardFeedrate
+		|| m.hasExtrusion != heldMove.hasExtrusion || m.maxExtrusionRate != heldMove.maxExtrusionRate
+#if SUPPORT_LASER || SUPPORT_IOBITS
+		|| memcmp(&m.laserPwmOrIoBits, &heldMove.laserPwmOrIoBits, sizeof(m.laserPwmOrIoBits)) != 0
+#endif
+	   )
+	{
+		return false;
+	}
+
+	// The new move must start where the held move ends
+	const float * const junction = segmentEnds[numSegments - 1];
+	for (size_t axis = 0; axis < NumMergeAxes; ++axis)
+	{
+		if (fabsf(m.initialCoords[axis] - junction[axis]) > 0.0001)
+		{
+			return false;
+		}
+	}
+
+	// Check the change of direction at the junction
+	const float * const lastStart = (numSegments == 1) ? heldMove.initialCoords : segmentEnds[numSegments - 2];
+	const float lastLength = Length(lastStart, junction);
+	const float newLength = Length(m.initialCoords, m.coords);
+	float dotProduct = 0.0;
+	for (size_t axis = 0; axis < NumMergeAxes; ++axis)
+	{
+		dotProduct += (junction[axis] - lastStart[axis]) * (m.coords[axis] - m.initialCoords[axis]);
+	}
+	if (dotProduct < cosAngleTolerance * lastLength * newLength)
+	{
+		return false;
+	}
+
+	// The extruders must deposit the same amount per mm in both moves
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t drive = numTotalAxes; drive < DRIVES; ++drive)
+	{
+		const float heldRatio = heldMove.coords[drive]/heldLength;
+		const float newRatio = m.coords[drive]/newLength;
+		if (fabsf(newRatio - heldRatio) > MaxExtrusionRatioMismatch * max<float>(fabsf(heldRatio), fabsf(newRatio)))
+		{
+			return false;
+		}
+	}
+
+	// Every junction that the merged move replaces must be within tolerance of the straight line from the start of the held move to the end of the new one
+	float chord[NumMergeAxes];
+	float chordLengthSquared = 0.0;
+	for (size_t axis = 0; axis < NumMergeAxes; ++axis)
+	{
+		chord[axis] = m.coords[axis] - heldMove.initialCoords[axis];
+		chordLengthSquared += fsquare(chord[axis]);
+	}
+	const float toleranceSquared = fsquare(positionTolerance);
+	for (size_t i = 0; i < numSegments; ++i)
+	{
+		float projection = 0.0, distanceFromStartSquared = 0.0;
+		for (size_t axis = 0; axis < NumMergeAxes; ++axis)
+		{
+			const float offset = segmentEnds[i][axis] - heldMove.initialCoords[axis];
+			projection += offset * chord[axis];
+			distanceFromStartSquared += fsquare(offset);
+		}
+		if (projection <= 0.0 || projection >= chordLengthSquared
+			|| distanceFromStartSquared - fsquare(projection)/chordLengthSquared > toleranceSquared)
+		{
+			return false;
+		}
+	}
+
+	// Merge the moves. The held move keeps its start position, file position and virtual extruder position so that pausing before it still works.
+	for (size_t axis = 0; axis < NumMergeAxes; ++axis)
+	{
+		heldMove.coords[axis] = segmentEnds[numSegments][axis] = m.coords[axis];
+	}
+	for (size_t drive = numTotalAxes; drive < DRIVES; ++drive)
+	{
+		heldMove.coords[drive] += m.coords[drive];
+	}
+	heldLength += newLength;
+	if (numSegments == 1)
+	{
+		++numMergedMovesAdded;
+	}
+	++numSegments;
+	++numMovesMerged;
+	return true;
+}
+
+void MoveMerger::Diagnostics(MessageType mtype)
+{
+	reprap.GetPlatform().MessageF(mtype, "Moves merged: %u into %u\n", numMovesMerged, numMergedMovesAdded);
+	numMovesMerged = numMergedMovesAdded = 0;
+}
+
+#endif
+
+// End
@@ -0,0 +1,61 @@
+/*
+ * MoveMerger.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  Merging of runs of short, nearly collinear G1 moves before they are added to the DDA ring.
+ *  Move holds back the latest move it has read from GCodes for as long as the following moves can be appended to it. A move can be appended
+ *  if the combined move stays within the positional tolerance of every junction it replaces, the junction angle is within the angular tolerance,
+ *  and the extrusion per mm is the same, so that spreading the extrusion evenly over the combined move doesn't change the amount deposited.
+ */
+
+#ifndef SRC_MOVEMENT_MOVEMERGER_H_
+#define SRC_MOVEMENT_MOVEMERGER_H_
+
+#include "RepRapFirmware.h"
+#include "MessageType.h"
+#include "GCodes/GCodes.h"			// for class RawMove
+#include "GCodes/GCodeResult.h"
+
+#if SUPPORT_MOVE_MERGING
+
+class MoveMerger
+{
+public:
+	MoveMerger();
+
+	GCodeResult Configure(GCodeBuffer& gb, const StringRef& reply);	// process M933
+	bool IsHolding() const { return numSegments != 0; }
+	bool CanHold(const GCodes::RawMove& m) const;						// return true if the move could have others merged into it
+	bool CanExtend() const { return canExtend && numSegments < MaxMergedSegments; }	// return true if more moves may be merged into the held move
+	void Hold(const GCodes::RawMove& m);								// hold back a move, which may or may not be one that we can merge others into
+	bool TryMerge(const GCodes::RawMove& m);							// append the move to the held move if we can, returning true if we did
+	GCodes::RawMove& GetHeldMove() { return heldMove; }
+	void Clear() { numSegments = 0; }									// forget the held move, after it has been added to the ring or discarded
+	void Diagnostics(MessageType mtype);
+
+private:
+	static constexpr size_t MaxMergedSegments = 16;					// the most moves that we merge into one
+	static constexpr size_t NumMergeAxes = Z_AXIS + 1;					// we only merge moves that don't move any axes other than X, Y and Z
+	static constexpr float MaxExtrusionRatioMismatch = 0.02;			// the relative difference in extrusion per mm that we allow between merged moves
+
+	bool IsCandidate(const GCodes::RawMove& m) const;
+	static float Length(const float *from, const float *to);
+
+	GCodes::RawMove heldMove;
+	float segmentEnds[MaxMergedSegments][NumMergeAxes];				// the end points of the moves that make up the held move
+	float heldLength;													// the total path length of the held move
+	size_t numSegments;													// the number of moves that make up the held move, or zero if there isn't one
+	bool canExtend;														// true if the held move is one that we can merge others into
+
+	float positionTolerance;											// the maximum distance of any replaced junction from the merged move in mm
+	float cosAngleTolerance;											// the cosine of the maximum change of direction at a replaced junction
+	bool enabled;
+
+	unsigned int numMovesMerged;										// the number of moves that were merged into the one before, for diagnostics
+	unsigned int numMergedMovesAdded;									// the number of moves that had others merged into them
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_MOVEMERGER_H_ */
@@ -0,0 +1,188 @@
+/*
+ * MoveTracer.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "MoveTracer.h"
+
+#if SUPPORT_MOVE_TRACE
+
+#include "DDA.h"
+#include "GCodes/GCodeBuffer.h"
+#include "OutputMemory.h"
+#include "Platform.h"
+#include "RepRap.h"
+#include "Storage/FileStore.h"
+
+MoveTracer::TraceEntry *MoveTracer::entries = nullptr;
+volatile uint32_t MoveTracer::putIndex = 0;
+uint32_t MoveTracer::getIndex = 0;
+uint32_t MoveTracer::numDropped = 0;
+FileStore *MoveTracer::traceFile = nullptr;
+volatile bool MoveTracer::tracing = false;
+
+const uint32_t MinEntriesToWrite = 32;						// don't write to the trace file until we have at least this number of entries, to avoid lots of small writes
+
+// Process M931.
+// M931 S1 clears the trace and starts tracing executed moves. If a P"filename" parameter is also given, the trace is streamed to that file in the log directory (see M938) as well.
+// M931 S0 stops tracing and closes the file. With no S parameter, report the state of the trace.
+// The last TraceLength entries can also be fetched in binary form using rr_movetrace. The trace file uses the same binary format, see MoveTracer.h.
+/*static*/ GCodeResult MoveTracer::Configure(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (!gb.Seen('S'))
+	{
+		Report(reply);
+		return GCodeResult::ok;
+	}
+
+	Stop();
+	if (gb.GetIValue() > 0)
+	{
+		String<MaxFilenameLength> fileName;
+		bool seenFile = false;
+		gb.TryGetQuotedString('P', fileName.GetRef(), seenFile);
+		if (seenFile)
+		{
+			Platform& platform = reprap.GetPlatform();
+			traceFile = platform.OpenFile(platform.GetLogDir(), fileName.c_str(), OpenMode::write);
+			if (traceFile == nullptr)
+			{
+				reply.printf("Failed to create move trace file %s", fileName.c_str());
+				return GCodeResult::error;
+			}
+		}
+
+		if (entries == nullptr)
+		{
+			// We don't normally allow dynamic memory allocation when running, but tracing is rarely used so we make an exception here.
+			// Once allocated, the trace stays allocated so that it can be fetched after tracing has stopped.
+			entries = new TraceEntry[TraceLength];
+		}
+		putIndex = getIndex = numDropped = 0;
+		tracing = true;
+		reply.printf("Move tracing started, step clock rate %" PRIu32 "Hz", (uint32_t)StepClockRate);
+	}
+	return GCodeResult::ok;
+}
+
+// Stop tracing and write any remaining entries to the trace file
+/*static*/ void MoveTracer::Stop()
+{
+	tracing = false;
+	if (traceFile != nullptr)
+	{
+		(void)WriteEntries(putIndex);
+		if (traceFile != nullptr)
+		{
+			traceFile->Close();
+			traceFile = nullptr;
+		}
+	}
+}
+
+/*static*/ void MoveTracer::Report(const StringRef& reply)
+{
+	reply.printf("Move trace %s, %" PRIu32 " moves recorded", (tracing) ? "running" : "stopped", putIndex);
+	if (traceFile != nullptr)
+	{
+		reply.catf(", %" PRIu32 " not written to file because the buffer overflowed", numDropped);
+	}
+}
+
+// Record a completed move. Called from the step ISR, or from Move with interrupts disabled.
+/*static*/ void MoveTracer::Record(const DDA& dda)
+{
+	if (tracing)
+	{
+		TraceEntry& e = entries[putIndex & (TraceLength - 1)];
+		e.startTime = dda.GetMoveStartTime();
+		e.clocksNeeded = dda.GetClocksNeeded();
+		e.topSpeed = dda.GetTopSpeed();
+		e.filePos = dda.GetFilePosition();
+		uint16_t drivesMoved = 0;
+		for (size_t drive = 0; drive < DRIVES; ++drive)
+		{
+			if (dda.GetStepsTaken(drive) != 0)
+			{
+				drivesMoved |= 1u << drive;
+			}
+		}
+		e.drivesMoved = drivesMoved;
+		e.flags = ((dda.HadLookaheadUnderrun()) ? FlagLookaheadUnderrun : 0)
+				| ((dda.HadHiccup()) ? FlagHiccup : 0)
+				| ((dda.IsPrintingMove()) ? FlagPrintingMove : 0);
+		e.spare = 0;
+		++putIndex;
+	}
+}
+
+// Write new entries to the trace file if we are streaming. Called from Move::Spin.
+/*static*/ void MoveTracer::Spin()
+{
+	if (traceFile != nullptr)
+	{
+		const uint32_t end = putIndex;
+		if (end - getIndex >= MinEntriesToWrite)
+		{
+			(void)WriteEntries(end);
+		}
+	}
+}
+
+// Write the entries from getIndex up to but not including 'end' to the trace file, returning true if successful.
+// If writing fails, close the file and stop streaming.
+/*static*/ bool MoveTracer::WriteEntries(uint32_t end)
+{
+	if (end - getIndex > TraceLength - MinEntriesToWrite)
+	{
+		// The ISR may have overwritten the oldest entries, or may be about to, so skip them
+		const uint32_t newGetIndex = end - (TraceLength - MinEntriesToWrite);
+		numDropped += newGetIndex - getIndex;
+		getIndex = newGetIndex;
+	}
+
+	bool ok = true;
+	while (ok && getIndex != end)
+	{
+		const size_t firstSlot = getIndex & (TraceLength - 1);
+		const size_t numToWrite = min<size_t>(end - getIndex, TraceLength - firstSlot);
+		ok = traceFile->Write(reinterpret_cast<const char *>(&entries[firstSlot]), numToWrite * sizeof(TraceEntry));
+		getIndex += numToWrite;
+	}
+
+	if (!ok)
+	{
+		traceFile->Close();
+		traceFile = nullptr;
+		reprap.GetPlatform().Message(ErrorMessage, "Failed to write move trace file, streaming stopped\n");
+	}
+	return ok;
+}
+
+// Append the trace to an output buffer in binary form, oldest entry first
+/*static*/ bool MoveTracer::GetBinaryTrace(OutputBuffer *buf)
+{
+	if (entries == nullptr)
+	{
+		return false;
+	}
+
+	const irqflags_t flags = cpu_irq_save();					// take a snapshot of the put index and stop the ISR changing the entries while we copy them
+	const bool wasTracing = tracing;
+	tracing = false;
+	cpu_irq_restore(flags);
+
+	const uint32_t numEntries = min<uint32_t>(putIndex, TraceLength);
+	const uint32_t first = putIndex - numEntries;
+	const size_t firstSlot = first & (TraceLength - 1);
+	const size_t firstPart = min<size_t>(numEntries, TraceLength - firstSlot);
+	buf->cat(reinterpret_cast<const char *>(&entries[firstSlot]), firstPart * sizeof(TraceEntry));
+	buf->cat(reinterpret_cast<const char *>(&entries[0]), (numEntries - firstPart) * sizeof(TraceEntry));
+	tracing = wasTracing;
+	return true;
+}
+
+#endif
+
+// End
@@ -0,0 +1,65 @@
+/*
+ * MoveTracer.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  Records a timeline of the moves executed, so that we can find out afterwards where print throughput was lost.
+ */
+
+#ifndef SRC_MOVEMENT_MOVETRACER_H_
+#define SRC_MOVEMENT_MOVETRACER_H_
+
+#include "RepRapFirmware.h"
+#include "GCodes/GCodeResult.h"
+
+#if SUPPORT_MOVE_TRACE
+
+class DDA;
+class FileStore;
+class OutputBuffer;
+
+class MoveTracer
+{
+public:
+	static constexpr size_t TraceLength = 256;				// must be a power of 2
+
+	static GCodeResult Configure(GCodeBuffer& gb, const StringRef& reply);		// process M931
+	static bool GetBinaryTrace(OutputBuffer *buf);			// append the trace in binary form, returning false if there isn't one
+	static void Spin();										// write new entries to the trace file if we are streaming
+
+	// This is called from Move when a move completes, usually from the step ISR
+	static void Record(const DDA& dda);
+
+private:
+	// Binary trace format, little endian with no padding: move start time and duration in step clocks, top speed in mm/sec,
+	// position in the file being printed after the move was read, bitmap of drives that moved, flags
+	struct TraceEntry
+	{
+		uint32_t startTime;
+		uint32_t clocksNeeded;
+		float topSpeed;
+		uint32_t filePos;
+		uint16_t drivesMoved;
+		uint8_t flags;
+		uint8_t spare;
+	} __attribute__((packed));
+
+	static constexpr uint8_t FlagLookaheadUnderrun = 0x01;
+	static constexpr uint8_t FlagHiccup = 0x02;
+	static constexpr uint8_t FlagPrintingMove = 0x04;
+
+	static void Stop();
+	static bool WriteEntries(uint32_t end);
+	static void Report(const StringRef& reply);
+
+	static TraceEntry *entries;
+	static volatile uint32_t putIndex;						// free-running index of the next entry to write
+	static uint32_t getIndex;								// free-running index of the next entry to stream to the file
+	static uint32_t numDropped;								// number of entries that we failed to stream because the buffer overflowed
+	static FileStore *traceFile;							// the file we are streaming to, or nullptr
+	static volatile bool tracing;
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_MOVETRACER_H_ */
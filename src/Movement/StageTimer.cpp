@@ -0,0 +1,75 @@
+/*
+ * StageTimer.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "StageTimer.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+// Start the free-running CPU cycle counter in the data watchpoint and trace unit.
+// If it is already running then leave it alone, because the RTOS run time statistics depend on it counting up steadily.
+/*static*/ void StageTimer::EnableCycleCounter()
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+	{
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+}
+
+void StageTimer::Record(uint32_t cycles)
+{
+	++count;
+	totalCycles += cycles;
+	if (cycles < minCycles)
+	{
+		minCycles = cycles;
+	}
+	if (cycles > maxCycles)
+	{
+		maxCycles = cycles;
+	}
+
+	const unsigned int log2Cycles = (cycles == 0) ? 0 : 31 - __builtin_clz(cycles);
+	const size_t bucket = (log2Cycles <= FirstBucketLog2) ? 0 : min<size_t>(log2Cycles - FirstBucketLog2, NumBuckets - 1);
+	++histogram[bucket];
+}
+
+void StageTimer::Reset()
+{
+	count = 0;
+	minCycles = 0xFFFFFFFF;
+	maxCycles = 0;
+	totalCycles = 0;
+	for (uint32_t& h : histogram)
+	{
+		h = 0;
+	}
+}
+
+// Report the statistics. The histogram buckets are powers of 2 in duration, starting at 2^(FirstBucketLog2 + 1) cycles.
+void StageTimer::Diagnostics(MessageType mtype) const
+{
+	Platform& p = reprap.GetPlatform();
+	if (count == 0)
+	{
+		p.MessageF(mtype, "%s: no calls\n", name);
+	}
+	else
+	{
+		p.MessageF(mtype, "%s: %" PRIu32 " calls, min %.1fus, mean %.1fus, max %.1fus, log2 histogram",
+					name, count, (double)CyclesToMicroseconds(minCycles), (double)CyclesToMicroseconds((uint32_t)(totalCycles/count)), (double)CyclesToMicroseconds(maxCycles));
+		char sep = ' ';
+		for (uint32_t h : histogram)
+		{
+			p.MessageF(mtype, "%c%" PRIu32, sep, h);
+			sep = ',';
+		}
+		p.Message(mtype, "\n");
+	}
+}
+
+// End
@@ -0,0 +1,45 @@
+/*
+ * StageTimer.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Execution time statistics for the stages of move planning, measured using the CPU cycle counter.
+ */
+
+#ifndef SRC_MOVEMENT_STAGETIMER_H_
+#define SRC_MOVEMENT_STAGETIMER_H_
+
+#include "RepRapFirmware.h"
+#include "MessageType.h"
+
+class StageTimer
+{
+public:
+	static constexpr size_t NumBuckets = 16;
+	static constexpr unsigned int FirstBucketLog2 = 7;		// bucket 0 counts durations below 2^8 cycles, bucket n counts durations from 2^(n+7) to 2^(n+8) - 1
+
+	explicit StageTimer(const char *nm) : name(nm) { Reset(); }
+
+	static void EnableCycleCounter();
+	static uint32_t GetCycles() { return DWT->CYCCNT; }
+
+	void Record(uint32_t cycles);
+	uint32_t GetCount() const { return count; }
+	uint32_t GetMeanCycles() const { return (count == 0) ? 0 : (uint32_t)(totalCycles/count); }
+	uint64_t GetTotalCycles() const { return totalCycles; }
+	void Reset();
+	void Diagnostics(MessageType mtype) const;
+
+	static float CyclesToMicroseconds(uint32_t cycles) { return (float)cycles * (1000000.0/VARIANT_MCK); }
+
+private:
+
+	const char *name;
+	uint32_t count;
+	uint32_t minCycles;
+	uint32_t maxCycles;
+	uint64_t totalCycles;
+	uint32_t histogram[NumBuckets];
+};
+
+#endif /* SRC_MOVEMENT_STAGETIMER_H_ */
@@ -0,0 +1,133 @@
+/*
+ * StepTracer.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "StepTracer.h"
+
+#if SUPPORT_STEP_TRACE
+
+#include "GCodes/GCodeBuffer.h"
+#include "Platform.h"
+#include "RepRap.h"
+#include "Storage/FileStore.h"
+
+StepTracer::TraceEntry StepTracer::entries[TraceLength];
+volatile uint32_t StepTracer::putIndex = 0;
+volatile uint32_t StepTracer::scheduledTime = 0;
+volatile bool StepTracer::tracing = false;
+
+// Process M597.
+// M597 S1 clears the trace and starts tracing, M597 S0 stops tracing, M597 P"filename" writes the trace to a file in the log directory (see M938).
+// With no parameters, report the latency statistics of the trace.
+/*static*/ GCodeResult StepTracer::Configure(GCodeBuffer& gb, const StringRef& reply)
+{
+	bool seen = false;
+	if (gb.Seen('S'))
+	{
+		seen = true;
+		if (gb.GetIValue() > 0)
+		{
+			Start();
+		}
+		else
+		{
+			tracing = false;
+		}
+	}
+
+	String<MaxFilenameLength> fileName;
+	bool seenFile = false;
+	gb.TryGetQuotedString('P', fileName.GetRef(), seenFile);
+	if (seenFile)
+	{
+		return (Dump(fileName.c_str(), reply)) ? GCodeResult::error : GCodeResult::ok;
+	}
+
+	if (!seen)
+	{
+		Report(reply);
+	}
+	return GCodeResult::ok;
+}
+
+/*static*/ void StepTracer::Start()
+{
+	tracing = false;
+	putIndex = 0;
+	tracing = true;
+}
+
+// Report the step interrupt latency statistics
+/*static*/ void StepTracer::Report(const StringRef& reply)
+{
+	const bool wasTracing = tracing;
+	tracing = false;											// stop the ISR changing the entries while we read them
+	const uint32_t numEntries = min<uint32_t>(putIndex, TraceLength);
+	reply.printf("Step trace %s, %" PRIu32 " interrupts recorded", (wasTracing) ? "running" : "stopped", putIndex);
+	if (numEntries != 0)
+	{
+		int32_t minLatency = INT32_MAX, maxLatency = INT32_MIN;
+		int64_t totalLatency = 0;
+		uint64_t totalLatencySquared = 0;
+		for (uint32_t i = putIndex - numEntries; i != putIndex; ++i)
+		{
+			const TraceEntry& e = entries[i & (TraceLength - 1)];
+			const int32_t latency = (int32_t)(e.actualTime - e.scheduledTime);
+			minLatency = min<int32_t>(minLatency, latency);
+			maxLatency = max<int32_t>(maxLatency, latency);
+			totalLatency += latency;
+			totalLatencySquared += (uint64_t)((int64_t)latency * latency);
+		}
+		const float meanLatency = (float)totalLatency/numEntries;
+		const float variance = (float)totalLatencySquared/numEntries - fsquare(meanLatency);
+		constexpr float ClocksToMicroseconds = 1000000.0/StepClockRate;
+		reply.catf(", latency of last %" PRIu32 ": min %.1fus, mean %.1fus, max %.1fus, jitter %.1fus",
+					numEntries, (double)(minLatency * ClocksToMicroseconds), (double)(meanLatency * ClocksToMicroseconds),
+					(double)(maxLatency * ClocksToMicroseconds), (double)(sqrtf(max<float>(variance, 0.0)) * ClocksToMicroseconds));
+	}
+	tracing = wasTracing;
+}
+
+// Write the trace to a CSV file, oldest entry first. Return true if there was an error.
+/*static*/ bool StepTracer::Dump(const char *fileName, const StringRef& reply)
+{
+	Platform& platform = reprap.GetPlatform();
+	FileStore * const f = platform.OpenFile(platform.GetLogDir(), fileName, OpenMode::write);
+	if (f == nullptr)
+	{
+		reply.printf("Failed to create step trace file %s", fileName);
+		return true;
+	}
+
+	const bool wasTracing = tracing;
+	tracing = false;											// stop the ISR changing the entries while we write them
+	const uint32_t numEntries = min<uint32_t>(putIndex, TraceLength);
+	String<ShortScratchStringLength> line;
+	bool ok = f->Write("scheduled,actual,latency\n");		// all in step clocks
+	for (uint32_t i = putIndex - numEntries; ok && i != putIndex; ++i)
+	{
+		const TraceEntry& e = entries[i & (TraceLength - 1)];
+		line.printf("%" PRIu32 ",%" PRIu32 ",%" PRIi32 "\n", e.scheduledTime, e.actualTime, (int32_t)(e.actualTime - e.scheduledTime));
+		ok = f->Write(line.c_str());
+	}
+	tracing = wasTracing;
+
+	if (!f->Close())
+	{
+		ok = false;
+	}
+	if (!ok)
+	{
+		platform.GetMassStorage()->Delete(platform.GetSysDir(), fileName);
+		reply.printf("Failed to write step trace file %s", fileName);
+		return true;
+	}
+	reply.printf("%" PRIu32 " step trace entries written to file %s, step clock rate %" PRIu32 "Hz", numEntries, fileName, (uint32_t)StepClockRate);
+	return false;
+}
+
+#endif
+
+// End
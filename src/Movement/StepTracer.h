@@ -0,0 +1,59 @@
+/*
+ * StepTracer.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Records the scheduled and actual times of step interrupts, so that we can measure step interrupt latency and jitter.
+ */
+
+#ifndef SRC_MOVEMENT_STEPTRACER_H_
+#define SRC_MOVEMENT_STEPTRACER_H_
+
+#include "RepRapFirmware.h"
+#include "GCodes/GCodeResult.h"
+
+#if SUPPORT_STEP_TRACE
+
+class StepTracer
+{
+public:
+	static constexpr size_t TraceLength = 512;				// must be a power of 2
+
+	static GCodeResult Configure(GCodeBuffer& gb, const StringRef& reply);		// process M597
+
+	// These are called from Platform, some of them from the step ISR
+	static void SetScheduledTime(uint32_t tim) { scheduledTime = tim; }
+	static void RecordInterrupt(uint32_t now);
+
+private:
+	struct TraceEntry
+	{
+		uint32_t scheduledTime;
+		uint32_t actualTime;
+	};
+
+	static void Start();
+	static void Report(const StringRef& reply);
+	static bool Dump(const char *fileName, const StringRef& reply);
+
+	static TraceEntry entries[TraceLength];
+	static volatile uint32_t putIndex;						// free-running index of the next entry to write
+	static volatile uint32_t scheduledTime;					// the time at which the pending step interrupt was scheduled
+	static volatile bool tracing;
+};
+
+// Record a step interrupt. Called from the step ISR.
+inline void StepTracer::RecordInterrupt(uint32_t now)
+{
+	if (tracing)
+	{
+		TraceEntry& e = entries[putIndex & (TraceLength - 1)];
+		e.scheduledTime = scheduledTime;
+		e.actualTime = now;
+		++putIndex;
+	}
+}
+
+#endif
+
+#endif /* SRC_MOVEMENT_STEPTRACER_H_ */
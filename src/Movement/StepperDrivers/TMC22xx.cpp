@@ -20,6 +20,9 @@
 // The TMC2224 does _not_ handle back-to-back read requests, it needs some sort of a delay between them.
 // Therefore this driver will only work if there are at least two TMC22xx drivers being driven,
 // so that each one gets an interval while the other one is being polled.
+// We never poll the same driver twice in succession from the ISR. If no other driver needs polling, the ISR stops and Spin restarts polling later.
+
+constexpr uint32_t IdlePollInterval = 100;					// how often we poll a driver that is not moving and has nothing to send, in milliseconds
 
 const float MaximumMotorCurrent = 1600.0;
 const uint32_t DefaultMicrosteppingShift = 4;				// x16 microstepping
@@ -248,6 +251,10 @@ public:
 	void SetCoolStep(uint16_t coolStepConfig);
 	bool SetMicrostepping(uint32_t shift, bool interpolate);
 	unsigned int GetMicrostepping(bool& interpolation) const;		// Get microstepping
+#if SUPPORT_MICROSTEP_SWITCHING
+	void SetMicrostepReduction(uint32_t shift);
+	bool IsMicrostepChangePending() const { return (registersToUpdate & (1u << WriteChopConf)) != 0; }
+#endif
 	bool SetDriverMode(unsigned int mode);
 	DriverMode GetDriverMode() const;
 	void SetCurrent(float current);
@@ -262,6 +269,7 @@ public:
 
 	void TransferDone() __attribute__ ((hot));				// called by the ISR when the SPI transfer has completed
 	void StartTransfer() __attribute__ ((hot));				// called to start a transfer
+	bool IsPollDue(uint32_t now) const __attribute__ ((hot));	// return true if this driver needs a transfer now
 	void TransferTimedOut() { ++numTimeouts; }
 	void AbortTransfer();
 
@@ -281,12 +289,13 @@ private:
 
 #if TMC22xx_HAS_MUX
 	void SetUartMux();
-	static void SetupDMASend(uint8_t regnum, uint32_t outVal, uint8_t crc) __attribute__ ((hot));	// set up the PDC to send a register
+	static void SetupDMASend(size_t numWrites) __attribute__ ((hot));								// set up the PDC to send the write datagrams we have stored
 	static void SetupDMAReceive(uint8_t regnum, uint8_t crc) __attribute__ ((hot));					// set up the PDC to receive a register
 #else
-	void SetupDMASend(uint8_t regnum, uint32_t outVal, uint8_t crc) __attribute__ ((hot));			// set up the PDC to send a register
+	void SetupDMASend(size_t numWrites) __attribute__ ((hot));										// set up the PDC to send the write datagrams we have stored
 	void SetupDMAReceive(uint8_t regnum, uint8_t crc) __attribute__ ((hot));						// set up the PDC to receive a register
 #endif
+	static void StoreWriteDatagram(size_t index, uint8_t regNum, uint32_t regVal, uint8_t crc) __attribute__ ((hot));
 
 	static constexpr unsigned int NumWriteRegisters = 5;	// the number of registers that we write to
 	static const uint8_t WriteRegNumbers[NumWriteRegisters];	// the register numbers that we write to
@@ -311,10 +320,13 @@ private:
 
 	uint32_t configuredChopConfReg;							// the configured chopper control register, in the Enabled state, without the microstepping bits
 	volatile uint32_t registersToUpdate;					// bitmap of register indices whose values need to be sent to the driver chip
-	volatile uint32_t registerBeingUpdated;					// which register we are sending
+	volatile uint32_t registersBeingUpdated;				// bitmap of the register indices we are sending and whose values haven't changed since we started
+	uint32_t numRegistersBeingUpdated;						// how many registers we are sending in the current transfer
+	uint32_t lastPollTime;									// the millis() value when we last started a transfer to this driver
 
 	uint32_t axisNumber;									// the axis number of this driver as used to index the DriveMovements in the DDA
 	uint32_t microstepShiftFactor;							// how much we need to shift 1 left by to get the current microstepping
+	uint32_t microstepReduction;							// how much we have temporarily reduced microstepShiftFactor by, never more than microstepShiftFactor
 	uint32_t motorCurrent;									// the configured motor current
 
 #if TMC22xx_HAS_MUX
@@ -323,12 +335,16 @@ private:
 	Uart *uart;												// the UART that controls this driver
 #endif
 
-	// To write a register, we send one 8-byte packet to write it, then a 4-byte packet to ask for the IFCOUNT register, then we receive an 8-byte packet containing IFCOUNT.
+	// To write registers, we send one 8-byte packet to write each of them, then a 4-byte packet to ask for the IFCOUNT register, then we receive an 8-byte packet containing IFCOUNT.
+	// The driver increments IFCOUNT once for each write that it accepts, so this lets us check that all the writes in the batch were received.
 	// This is the message we send - volatile because we care about when it is written
-	static volatile uint8_t sendData[12];
+	static constexpr size_t WriteDatagramLength = 8;
+	static constexpr size_t ReadRequestLength = 4;
+	static constexpr size_t ReadReplyLength = 8;
+	static volatile uint8_t sendData[NumWriteRegisters * WriteDatagramLength + ReadRequestLength];
 
-	// Buffer for the message we receive when reading data. The first 4 or 12 bytes bytes are our own transmitted data.
-	static volatile uint8_t receiveData[20];
+	// Buffer for the message we receive when reading data. The first part is our own transmitted data.
+	static volatile uint8_t receiveData[NumWriteRegisters * WriteDatagramLength + ReadRequestLength + ReadReplyLength];
 
 	uint16_t readErrors;									// how many read errors we had
 	uint16_t writeErrors;									// how many write errors we had
@@ -354,21 +370,12 @@ Uart * const TmcDriverState::uart = UART_TMC22xx;
 TmcDriverState * volatile TmcDriverState::currentDriver = nullptr;	// volatile because the ISR changes it
 uint32_t TmcDriverState::transferStartedTime;
 
-// To write a register, we send one 8-byte packet to write it, then a 4-byte packet to ask for the IFCOUNT register, then we receive an 8-byte packet containing IFCOUNT.
-// This is the message we send - volatile because we care about when it is written
-volatile uint8_t TmcDriverState::sendData[12] =
-{
-	0x05, 0x00,							// sync byte and slave address
-	0x00,								// register address and write flag (filled in)
-	0x00, 0x00, 0x00, 0x00,				// value to write (if writing), or 1 byte of CRC if read request (filled in)
-	0x00,								// CRC of write request (filled in)
-	0x05, 0x00,							// sync byte and slave address
-	REGNUM_IFCOUNT,						// register we want to read
-	ReadIfcountCRC						// CRC
-};
+// The message we send. Each write datagram is sync byte, slave address, register address with write flag, 4 bytes of value, CRC.
+// A read request is sync byte, slave address, register address, CRC. All the fields are filled in when we set up the transfer.
+volatile uint8_t TmcDriverState::sendData[NumWriteRegisters * WriteDatagramLength + ReadRequestLength];
 
-// Buffer for the message we receive when reading data. The first 4 or 12 bytes bytes are our own transmitted data.
-volatile uint8_t TmcDriverState::receiveData[20];
+// Buffer for the message we receive. The first part is our own transmitted data, because the UART line is shared between transmit and receive.
+volatile uint8_t TmcDriverState::receiveData[NumWriteRegisters * WriteDatagramLength + ReadRequestLength + ReadReplyLength];
 
 const uint8_t TmcDriverState::WriteRegNumbers[NumWriteRegisters] =
 {
@@ -394,25 +401,39 @@ const uint8_t TmcDriverState::ReadRegCRCs[NumReadRegisters] =
 // State structures for all drivers
 static TmcDriverState driverStates[MaxSmartDrivers];
 
-// Set up the PDC to send a register
-inline void TmcDriverState::SetupDMASend(uint8_t regNum, uint32_t regVal, uint8_t crc)
+// Store a write datagram in the send buffer
+/*static*/ inline void TmcDriverState::StoreWriteDatagram(size_t index, uint8_t regNum, uint32_t regVal, uint8_t crc)
+{
+	volatile uint8_t * const p = sendData + index * WriteDatagramLength;
+	p[0] = 0x05;													// sync byte
+	p[1] = 0x00;													// slave address
+	p[2] = regNum | 0x80;
+	p[3] = (uint8_t)(regVal >> 24);
+	p[4] = (uint8_t)(regVal >> 16);
+	p[5] = (uint8_t)(regVal >> 8);
+	p[6] = (uint8_t)regVal;
+	p[7] = crc;
+}
+
+// Set up the PDC to send the write datagrams we have stored followed by a request to read IFCOUNT
+inline void TmcDriverState::SetupDMASend(size_t numWrites)
 {
 	// Faster code, not using the ASF
 	Pdc * const pdc = uart_get_pdc_base(uart);
 	pdc->PERIPH_PTCR = (PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);	// disable the PDC
 
-	sendData[2] = regNum | 0x80;
-	sendData[3] = (uint8_t)(regVal >> 24);
-	sendData[4] = (uint8_t)(regVal >> 16);
-	sendData[5] = (uint8_t)(regVal >> 8);
-	sendData[6] = (uint8_t)regVal;
-	sendData[7] = crc;
+	volatile uint8_t * const p = sendData + numWrites * WriteDatagramLength;
+	p[0] = 0x05;
+	p[1] = 0x00;
+	p[2] = REGNUM_IFCOUNT;
+	p[3] = ReadIfcountCRC;
 
+	const size_t sendLength = numWrites * WriteDatagramLength + ReadRequestLength;
 	pdc->PERIPH_TPR = reinterpret_cast<uint32_t>(sendData);
-	pdc->PERIPH_TCR = 12;											// number of bytes to send: 8 bytes send request + 4 bytes read IFCOUNT request
+	pdc->PERIPH_TCR = sendLength;									// number of bytes to send: the write requests + the read IFCOUNT request
 
 	pdc->PERIPH_RPR = reinterpret_cast<uint32_t>(receiveData);
-	pdc->PERIPH_RCR = 20;											// number of bytes to receive: the sent data + 8 bytes of received data
+	pdc->PERIPH_RCR = sendLength + ReadReplyLength;					// number of bytes to receive: the sent data + 8 bytes of received data
 
 	pdc->PERIPH_PTCR = (PERIPH_PTCR_RXTEN | PERIPH_PTCR_TXTEN);		// enable the PDC to transmit and receive
 }
@@ -424,14 +445,16 @@ inline void TmcDriverState::SetupDMAReceive(uint8_t regNum, uint8_t crc)
 	Pdc * const pdc = uart_get_pdc_base(uart);
 	pdc->PERIPH_PTCR = (PERIPH_PTCR_RXTDIS | PERIPH_PTCR_TXTDIS);	// disable the PDC
 
+	sendData[0] = 0x05;
+	sendData[1] = 0x00;
 	sendData[2] = regNum;
 	sendData[3] = crc;
 
 	pdc->PERIPH_TPR = reinterpret_cast<uint32_t>(sendData);
-	pdc->PERIPH_TCR = 4;											// send a 4 byte read data request
+	pdc->PERIPH_TCR = ReadRequestLength;							// send a 4 byte read data request
 
 	pdc->PERIPH_RPR = reinterpret_cast<uint32_t>(receiveData);
-	pdc->PERIPH_RCR = 12;											// receive the 4 bytes we sent + 8 bytes of received data
+	pdc->PERIPH_RCR = ReadRequestLength + ReadReplyLength;			// receive the 4 bytes we sent + 8 bytes of received data
 
 	pdc->PERIPH_PTCR = (PERIPH_PTCR_RXTEN | PERIPH_PTCR_TXTEN);		// enable the PDC to transmit and receive
 }
@@ -449,14 +472,17 @@ void TmcDriverState::UpdateRegister(size_t regIndex, uint32_t regVal)
 	const irqflags_t flags = cpu_irq_save();
 	writeRegisters[regIndex] = regVal;
 	writeRegCRCs[regIndex] = crc;
+	registersBeingUpdated &= ~(1u << regIndex);							// if we are already sending it, make sure we send the new value too
 	registersToUpdate |= (1u << regIndex);								// flag it for sending
 	cpu_irq_restore(flags);
 }
 
-// Calculate the chopper control register and flag it for sending
+// Calculate the chopper control register and flag it for sending. The microstep resolution is the configured one less any temporary reduction.
 void TmcDriverState::UpdateChopConfRegister()
 {
-	UpdateRegister(WriteChopConf, (enabled) ? configuredChopConfReg : configuredChopConfReg & ~CHOPCONF_TOFF_MASK);
+	const uint32_t chopConfReg = (microstepReduction == 0) ? configuredChopConfReg
+									: (configuredChopConfReg & ~CHOPCONF_MRES_MASK) | ((8 - (microstepShiftFactor - microstepReduction)) << CHOPCONF_MRES_SHIFT);
+	UpdateRegister(WriteChopConf, (enabled) ? chopConfReg : chopConfReg & ~CHOPCONF_TOFF_MASK);
 }
 
 // Initialise the state of the driver and its CS pin
@@ -483,6 +509,7 @@ pre(!driversPowered)
 	UpdateRegister(WriteGConf, DefaultGConfReg);
 	UpdateRegister(WriteSlaveConf, DefaultSlaveConfReg);
 	configuredChopConfReg = DefaultChopConfReg;
+	microstepReduction = 0;
 	SetMicrostepping(DefaultMicrosteppingShift, DefaultInterpolation);	// this also updates the chopper control register
 	UpdateRegister(WriteIholdIrun, DefaultIholdIrunReg);
 	UpdateRegister(WritePwmConf, DefaultPwmConfReg);
@@ -490,7 +517,9 @@ pre(!driversPowered)
 	{
 		accumulatedReadRegisters[i] = readRegisters[i] = 0;
 	}
-	registerBeingUpdated = 0;
+	registersBeingUpdated = 0;
+	numRegistersBeingUpdated = 0;
+	lastPollTime = millis();
 	registerToRead = 0;
 	lastIfCount = 0;
 	readErrors = writeErrors = numReads = numTimeouts = 0;
@@ -522,6 +551,7 @@ void TmcDriverState::SetStandstillCurrentPercent(float percent)
 bool TmcDriverState::SetMicrostepping(uint32_t shift, bool interpolate)
 {
 	microstepShiftFactor = shift;
+	microstepReduction = min<uint32_t>(microstepReduction, shift);
 	configuredChopConfReg = (configuredChopConfReg & ~(CHOPCONF_MRES_MASK | CHOPCONF_INTPOL)) | ((8 - shift) << CHOPCONF_MRES_SHIFT);
 	if (interpolate)
 	{
@@ -531,6 +561,18 @@ bool TmcDriverState::SetMicrostepping(uint32_t shift, bool interpolate)
 	return true;
 }
 
+#if SUPPORT_MICROSTEP_SWITCHING
+
+// Temporarily reduce the microstepping by a factor of (1 << shift) without changing the configured microstepping, or restore it if shift is zero.
+// The driver keeps its microstep counter when the resolution changes, so provided that it isn't being stepped while the new value is sent, the motor position is preserved.
+void TmcDriverState::SetMicrostepReduction(uint32_t shift)
+{
+	microstepReduction = min<uint32_t>(shift, microstepShiftFactor);
+	UpdateChopConfRegister();
+}
+
+#endif
+
 // Get microstepping or chopper control register
 unsigned int TmcDriverState::GetMicrostepping(bool& interpolation) const
 {
@@ -687,12 +729,12 @@ void TmcDriverState::AppendDriverStatus(const StringRef& reply)
 // This is called by the ISR when the SPI transfer has completed
 inline void TmcDriverState::TransferDone()
 {
-	if (sendData[2] & 0x80)								// if we were writing a register
+	if (sendData[2] & 0x80)								// if we were writing registers
 	{
-		const uint8_t currentIfCount = receiveData[18];
-		if (currentIfCount == (uint8_t)(lastIfCount + 1))
+		const uint8_t currentIfCount = receiveData[numRegistersBeingUpdated * WriteDatagramLength + ReadRequestLength + 6];
+		if (currentIfCount == (uint8_t)(lastIfCount + numRegistersBeingUpdated))
 		{
-			registersToUpdate &= ~registerBeingUpdated;
+			registersToUpdate &= ~registersBeingUpdated;
 		}
 		else
 		{
@@ -774,10 +816,12 @@ inline void TmcDriverState::StartTransfer()
 	SetUartMux();
 #endif
 
-	// Find which register to send. The common case is when no registers need to be updated.
+	lastPollTime = millis();
+
+	// Find which registers to send. The common case is when no registers need to be updated.
 	if (registersToUpdate == 0)
 	{
-		registerBeingUpdated = 0;
+		registersBeingUpdated = 0;
 
 		// Read a register
 		const irqflags_t flags = cpu_irq_save();		// avoid race condition
@@ -790,24 +834,24 @@ inline void TmcDriverState::StartTransfer()
 	}
 	else
 	{
-		// Write a register
-		size_t regNum = 0;
-		uint32_t mask = 1;
-		do
+		// Write all the registers that need updating in a single transfer, in priority order
+		const irqflags_t flags = cpu_irq_save();		// avoid race condition
+		const uint32_t toUpdate = registersToUpdate;
+		size_t numWrites = 0;
+		for (size_t regNum = 0; regNum < NumWriteRegisters; ++regNum)
 		{
-			if ((registersToUpdate & mask) != 0)
+			if ((toUpdate & (1u << regNum)) != 0)
 			{
-				break;
+				StoreWriteDatagram(numWrites, WriteRegNumbers[regNum], writeRegisters[regNum], writeRegCRCs[regNum]);
+				++numWrites;
 			}
-			++regNum;
-			mask <<= 1;
-		} while (regNum < NumWriteRegisters - 1);
+		}
+		registersBeingUpdated = toUpdate;
+		numRegistersBeingUpdated = numWrites;
 
-		// Kick off a transfer for that register
-		const irqflags_t flags = cpu_irq_save();		// avoid race condition
-		registerBeingUpdated = mask;
+		// Kick off a transfer for those registers
 		uart->UART_CR = UART_CR_RSTRX | UART_CR_RSTTX;	// reset transmitter and receiver
-		SetupDMASend(WriteRegNumbers[regNum], writeRegisters[regNum], writeRegCRCs[regNum]);	// set up the PDC
+		SetupDMASend(numWrites);						// set up the PDC
 		uart->UART_IER = UART_IER_ENDRX;				// enable end-of-transfer interrupt
 		uart->UART_CR = UART_CR_RXEN | UART_CR_TXEN;	// enable transmitter and receiver
 		transferStartedTime = millis();
@@ -815,6 +859,38 @@ inline void TmcDriverState::StartTransfer()
 	}
 }
 
+// Return true if this driver needs a transfer now, because we have registers to send to it, or its motor is moving, or we haven't read its status for a while
+inline bool TmcDriverState::IsPollDue(uint32_t now) const
+{
+	if (registersToUpdate != 0 || now - lastPollTime >= IdlePollInterval)
+	{
+		return true;
+	}
+	const DDA * const dda = reprap.GetMove().GetCurrentDDA();
+	bool forwards;
+	return dda != nullptr && dda->GetDriveDirection(axisNumber, forwards);
+}
+
+// Find a driver that needs a transfer, searching 'count' drivers starting at 'start' and wrapping round, or return nullptr if none does
+static inline TmcDriverState *FindDueDriver(TmcDriverState *start, size_t count)
+{
+	const uint32_t now = millis();
+	TmcDriverState *driver = start;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (driver->IsPollDue(now))
+		{
+			return driver;
+		}
+		++driver;
+		if (driver >= driverStates + numTmc22xxDrivers)
+		{
+			driver = driverStates;
+		}
+	}
+	return nullptr;
+}
+
 // ISR(s) for the UART(s)
 
 inline void TmcDriverState::UartTmcHandler()
@@ -823,19 +899,21 @@ inline void TmcDriverState::UartTmcHandler()
 	TransferDone();										// tidy up after the transfer we just completed
 	if (driversState != DriversState::noPower)
 	{
-		// Power is still good, so send/receive again
+		// Power is still good, so send/receive to/from the next driver that needs it, but not this one again because the TMC22xx needs a delay between reads
 		TmcDriverState *driver = this;
 		++driver;										// advance to the next driver
 		if (driver >= driverStates + numTmc22xxDrivers)
 		{
 			driver = driverStates;
 		}
-		driver->StartTransfer();
-	}
-	else
-	{
-		currentDriver = nullptr;						// signal that we are not waiting for an interrupt
+		driver = FindDueDriver(driver, numTmc22xxDrivers - 1);
+		if (driver != nullptr)
+		{
+			driver->StartTransfer();
+			return;
+		}
 	}
+	currentDriver = nullptr;							// signal that we are not waiting for an interrupt
 }
 
 #if TMC22xx_HAS_MUX
@@ -994,6 +1072,21 @@ namespace SmartDrivers
 		return (drive < numTmc22xxDrivers) ? driverStates[drive].GetMicrostepping(interpolation) : 1;
 	}
 
+#if SUPPORT_MICROSTEP_SWITCHING
+	void SetMicrostepReduction(size_t driver, unsigned int shift)
+	{
+		if (driver < numTmc22xxDrivers)
+		{
+			driverStates[driver].SetMicrostepReduction(shift);
+		}
+	}
+
+	bool IsMicrostepChangePending(size_t driver)
+	{
+		return driver < numTmc22xxDrivers && driverStates[driver].IsMicrostepChangePending();
+	}
+#endif
+
 	bool SetDriverMode(size_t driver, unsigned int mode)
 	{
 		return driver < numTmc22xxDrivers && driverStates[driver].SetDriverMode(mode);
@@ -1046,11 +1139,16 @@ namespace SmartDrivers
 			// If a transfer has timed out, abort it.
 			if (TmcDriverState::currentDriver == nullptr)
 			{
-				// No transfer in progress, so start one
+				// No transfer in progress, so start one if any driver needs it
 				if (numTmc22xxDrivers != 0)
 				{
-					// Kick off the first transfer
-					driverStates[0].StartTransfer();
+					const irqflags_t flags = cpu_irq_save();
+					TmcDriverState * const driver = FindDueDriver(driverStates, numTmc22xxDrivers);
+					if (driver != nullptr)
+					{
+						driver->StartTransfer();
+					}
+					cpu_irq_restore(flags);
 				}
 			}
 			else if (millis() - TmcDriverState::transferStartedTime > TransferTimeout)
@@ -46,6 +46,10 @@ namespace SmartDrivers
 	uint32_t GetAccumulatedStatus(size_t drive, uint32_t bitsToKeep);
 	bool SetMicrostepping(size_t drive, unsigned int microsteps, bool interpolation);
 	unsigned int GetMicrostepping(size_t drive, bool& interpolation);
+#if SUPPORT_MICROSTEP_SWITCHING
+	void SetMicrostepReduction(size_t driver, unsigned int shift);		// temporarily reduce the microstepping by a factor of (1 << shift), or restore it
+	bool IsMicrostepChangePending(size_t driver);						// return true if a microstepping change hasn't been confirmed by the driver yet
+#endif
 	bool SetDriverMode(size_t driver, unsigned int mode);
 	DriverMode GetDriverMode(size_t driver);
 	bool SetChopperControlRegister(size_t driver, uint32_t ccr);
@@ -21,6 +21,7 @@ const bool DefaultInterpolation = true;						// interpolation enabled
 const int DefaultStallDetectThreshold = 1;
 const bool DefaultStallDetectFiltered = false;
 const unsigned int DefaultMinimumStepsPerSecond = 200;		// for stall detection: 1 rev per second assuming 1.8deg/step, as per the TMC2660 datasheet
+const unsigned int CruiseLoadHysteresis = 50;				// how far the StallGuard reading must fall below the cruise threshold before we restore full current
 
 static size_t numTmc2660Drivers;
 
@@ -172,6 +173,10 @@ public:
 	void SetCoolStep(uint16_t coolStepConfig);
 	bool SetMicrostepping(uint32_t shift, bool interpolate);
 	unsigned int GetMicrostepping(bool& interpolation) const;		// Get microstepping
+#if SUPPORT_MICROSTEP_SWITCHING
+	void SetMicrostepReduction(uint32_t shift);
+	bool IsMicrostepChangePending() const { return (registersToUpdate & (1u << DriveControl)) != 0 || sendingDriveControl; }
+#endif
 	bool SetDriverMode(unsigned int mode);
 	DriverMode GetDriverMode() const;
 	void SetCurrent(float current);
@@ -180,11 +185,15 @@ public:
 	void SetStallDetectThreshold(int sgThreshold);
 	void SetStallDetectFilter(bool sgFilter);
 	void SetStallMinimumStepsPerSecond(unsigned int stepsPerSecond);
+	void SetDynamicCurrent(uint32_t accelPercent, uint32_t cruisePercent, uint32_t loadThreshold);
+	void GetDynamicCurrent(uint32_t& accelPercent, uint32_t& cruisePercent, uint32_t& loadThreshold) const;
 	void AppendStallConfig(const StringRef& reply) const;
 	void AppendDriverStatus(const StringRef& reply);
+	bool GetLoadStats(DriverLoadStats& stats) const;
 
 	void TransferDone() __attribute__ ((hot));						// called by the ISR when the SPI transfer has completed
 	void StartTransfer() __attribute__ ((hot));						// called to start a transfer
+	bool IsPollDue(uint32_t now) const __attribute__ ((hot));		// return true if this driver needs a transfer now
 
 	uint32_t ReadLiveStatus() const;
 	uint32_t ReadAccumulatedStatus(uint32_t bitsToKeep);
@@ -196,7 +205,13 @@ private:
 		maxSgLoadRegister = 0;
 	}
 
+	bool DynamicCurrentEnabled() const { return accelCurrentPercent != 100 || cruiseCurrentPercent != 100; }
+	void UpdateDynamicCurrent(const DDA *dda, uint32_t interval, bool loadValid, uint32_t sgLoad) __attribute__ ((hot));
+	static uint32_t ScaleCsBits(uint32_t csBits, unsigned int percent);
+
 	static void SetupDMA(uint32_t outVal) __attribute__ ((hot));	// set up the PDC to send a register and receive the status
+	void UpdateMicrostepResolution();								// set the microstep resolution bits in the drive control register
+	uint32_t GetStepShiftFactor() const { return microstepShiftFactor - microstepReduction; }	// the microstepping that the driver is using now is (1 << this)
 
 	static constexpr unsigned int NumRegisters = 5;			// the number of registers that we write to
 	volatile uint32_t registers[NumRegisters];				// the values we want the TMC2660 writable registers to have
@@ -215,13 +230,33 @@ private:
 	volatile uint32_t registersToUpdate;					// bitmap of register values that need to be sent to the driver chip
 	uint32_t axisNumber;									// the axis number of this driver as used to index the DriveMovements in the DDA
 	uint32_t microstepShiftFactor;							// how much we need to shift 1 left by to get the current microstepping
+	uint32_t microstepReduction;							// how much we have temporarily reduced microstepShiftFactor by, never more than microstepShiftFactor
 	uint32_t maxStallStepInterval;							// maximum interval between full steps to take any notice of stall detection
 	uint32_t minSgLoadRegister;								// the minimum value of the StallGuard bits we read
 	uint32_t maxSgLoadRegister;								// the maximum value of the StallGuard bits we read
 
 	volatile uint32_t lastReadStatus;						// the status word that we read most recently, updated by the ISR
 	volatile uint32_t accumulatedStatus;
+	// Load readings taken during the current move, and a summary of those taken during the last move that we got readings for. These are updated by the ISR.
+	const DDA *loadStatsDda;								// the move that the current load readings belong to
+	uint32_t moveLoadSum;
+	uint32_t moveLoadReadings;
+	uint16_t moveMinLoad;
+	uint16_t moveMaxLoad;
+	DriverLoadStats lastMoveLoadStats;
+
+	// Dynamic current control. The current scale bits in registers[StallGuardConfig] are the ones for the configured current, but we send desiredCsBits instead.
+	volatile uint32_t desiredCsBits;						// the current scale bits we want the driver to use, updated by the ISR
+	uint32_t sentCsBits;									// the current scale bits we last sent to the driver
+	uint16_t cruiseLoadThreshold;							// the StallGuard reading at or above which we reduce the current when cruising
+	uint8_t accelCurrentPercent;							// the percentage of the configured current to use while accelerating or decelerating
+	uint8_t cruiseCurrentPercent;							// the percentage of the configured current to use while cruising with a light load
+	bool cruiseCurrentReduced;
+
+	uint32_t lastPollTime;									// the millis() value when we last started a transfer to this driver
+	uint32_t numPolls;										// the number of transfers since the diagnostics were last reported
 	bool enabled;
+	volatile bool sendingDriveControl;						// true if the transfer in progress is sending the drive control register
 };
 
 // State structures for all drivers
@@ -242,6 +277,10 @@ volatile static uint32_t spiDataIn = 0;						// volatile because the PDC writes
 // Variables used by the ISR
 static TmcDriverState * volatile currentDriver = nullptr;	// volatile because the ISR changes it
 
+// A driver that is moving is polled continuously so that we get timely stall and load readings. A driver that is idle with nothing to send is polled only
+// this often, which is enough to notice over temperature and short-to-ground conditions, and frees the SPI bus and the CPU the rest of the time.
+constexpr uint32_t IdlePollInterval = 100;					// milliseconds
+
 // Set up the PDC to send a register and receive the status
 /*static*/ inline void TmcDriverState::SetupDMA(uint32_t outVal)
 {
@@ -276,6 +315,17 @@ pre(!driversPowered)
 	registers[DriveConfig] = defaultDrvConfReg;
 	registersToUpdate = UpdateAllRegisters;
 	accumulatedStatus = lastReadStatus = 0;
+	lastPollTime = millis();
+	numPolls = 0;
+	loadStatsDda = nullptr;
+	moveLoadSum = moveLoadReadings = 0;
+	lastMoveLoadStats.numReadings = 0;
+	desiredCsBits = sentCsBits = registers[StallGuardConfig] & TMC_SGCSCONF_CS_MASK;
+	accelCurrentPercent = cruiseCurrentPercent = 100;
+	cruiseLoadThreshold = 0;
+	cruiseCurrentReduced = false;
+	sendingDriveControl = false;
+	microstepReduction = 0;
 	ResetLoadRegisters();
 	SetMicrostepping(DefaultMicrosteppingShift, DefaultInterpolation);
 	SetStallDetectThreshold(DefaultStallDetectThreshold);
@@ -350,21 +400,38 @@ DriverMode TmcDriverState::GetDriverMode() const
 bool TmcDriverState::SetMicrostepping(uint32_t shift, bool interpolate)
 {
 	microstepShiftFactor = shift;
-	uint32_t drvCtrlReg = registers[DriveControl] & ~TMC_DRVCTRL_MRES_MASK;
-	drvCtrlReg |= (((8u - shift) << TMC_DRVCTRL_MRES_SHIFT) & TMC_DRVCTRL_MRES_MASK);
+	microstepReduction = min<uint32_t>(microstepReduction, shift);
 	if (interpolate)
 	{
-		drvCtrlReg |= TMC_DRVCTRL_INTPOL;
+		registers[DriveControl] |= TMC_DRVCTRL_INTPOL;
 	}
 	else
 	{
-		drvCtrlReg &= ~TMC_DRVCTRL_INTPOL;
+		registers[DriveControl] &= ~TMC_DRVCTRL_INTPOL;
 	}
-	registers[DriveControl] = drvCtrlReg;
-	registersToUpdate |= 1u << DriveControl;
+	UpdateMicrostepResolution();
 	return true;
 }
 
+#if SUPPORT_MICROSTEP_SWITCHING
+
+// Temporarily reduce the microstepping by a factor of (1 << shift) without changing the configured microstepping, or restore it if shift is zero.
+// The driver keeps its microstep counter when the resolution changes, so provided that it isn't being stepped while the new value is sent, the motor position is preserved.
+void TmcDriverState::SetMicrostepReduction(uint32_t shift)
+{
+	microstepReduction = min<uint32_t>(shift, microstepShiftFactor);
+	UpdateMicrostepResolution();
+}
+
+#endif
+
+// Set the microstep resolution bits in the drive control register from the configured microstepping and any reduction, and flag the register for sending
+void TmcDriverState::UpdateMicrostepResolution()
+{
+	registers[DriveControl] = (registers[DriveControl] & ~TMC_DRVCTRL_MRES_MASK) | (((8u - GetStepShiftFactor()) << TMC_DRVCTRL_MRES_SHIFT) & TMC_DRVCTRL_MRES_MASK);
+	registersToUpdate |= 1u << DriveControl;
+}
+
 // Set the motor current
 void TmcDriverState::SetCurrent(float current)
 {
@@ -373,9 +440,74 @@ void TmcDriverState::SetCurrent(float current)
 	const uint32_t iCurrent = static_cast<uint32_t>(constrain<float>(current, 100.0, MaximumMotorCurrent));
 	const uint32_t csBits = (32 * iCurrent - 1600)/3236;		// formula checked by simulation on a spreadsheet
 	registers[StallGuardConfig] = (registers[StallGuardConfig] & ~TMC_SGCSCONF_CS_MASK) | TMC_SGCSCONF_CS(csBits);
+	desiredCsBits = csBits;										// if dynamic current control is enabled then the ISR will adjust this when the driver is next polled
 	registersToUpdate |= 1u << StallGuardConfig;
 }
 
+// Configure dynamic current control. Setting both percentages to 100 disables it.
+void TmcDriverState::SetDynamicCurrent(uint32_t accelPercent, uint32_t cruisePercent, uint32_t loadThreshold)
+{
+	accelCurrentPercent = (uint8_t)constrain<uint32_t>(accelPercent, 100, 200);
+	cruiseCurrentPercent = (uint8_t)constrain<uint32_t>(cruisePercent, 30, 100);
+	cruiseLoadThreshold = (uint16_t)min<uint32_t>(loadThreshold, 1023);
+}
+
+void TmcDriverState::GetDynamicCurrent(uint32_t& accelPercent, uint32_t& cruisePercent, uint32_t& loadThreshold) const
+{
+	accelPercent = accelCurrentPercent;
+	cruisePercent = cruiseCurrentPercent;
+	loadThreshold = cruiseLoadThreshold;
+}
+
+// Scale the current scale bits by a percentage. The current is proportional to (csBits + 1).
+/*static*/ inline uint32_t TmcDriverState::ScaleCsBits(uint32_t csBits, unsigned int percent)
+{
+	const uint32_t scaled = ((csBits + 1) * percent + 50)/100;
+	return (scaled == 0) ? 0 : min<uint32_t>(scaled - 1, TMC_SGCSCONF_CS_MASK);
+}
+
+// Choose the motor current for the phase of the move that the driver is executing. Called by the ISR after reading the status.
+// We raise the current while the move is accelerating or decelerating, because that is when the motor needs the most torque. While cruising, we reduce it
+// if the StallGuard reading shows that the motor has plenty of torque in reserve. The StallGuard reading falls when we reduce the current, so we use some hysteresis.
+inline void TmcDriverState::UpdateDynamicCurrent(const DDA *dda, uint32_t interval, bool loadValid, uint32_t sgLoad)
+{
+	uint32_t csBits = registers[StallGuardConfig] & TMC_SGCSCONF_CS_MASK;
+	if (!DynamicCurrentEnabled() || interval == 0 || dda == nullptr)
+	{
+		cruiseCurrentReduced = false;
+	}
+	else if (dda->IsAccelerating(Platform::GetInterruptClocks()))
+	{
+		cruiseCurrentReduced = false;
+		csBits = ScaleCsBits(csBits, accelCurrentPercent);
+	}
+	else if (!loadValid)
+	{
+		cruiseCurrentReduced = false;
+	}
+	else
+	{
+		if (sgLoad >= cruiseLoadThreshold)
+		{
+			cruiseCurrentReduced = true;
+		}
+		else if (sgLoad + CruiseLoadHysteresis < cruiseLoadThreshold)
+		{
+			cruiseCurrentReduced = false;
+		}
+		if (cruiseCurrentReduced)
+		{
+			csBits = ScaleCsBits(csBits, cruiseCurrentPercent);
+		}
+	}
+
+	desiredCsBits = csBits;
+	if (csBits != sentCsBits)
+	{
+		registersToUpdate |= 1u << StallGuardConfig;
+	}
+}
+
 // Enable or disable the driver. Also called from SetChopConf after the chopper control configuration has been changed.
 void TmcDriverState::Enable(bool en)
 {
@@ -501,9 +633,20 @@ void TmcDriverState::AppendDriverStatus(const StringRef& reply)
 	{
 		reply.cat(", SG min/max not available");
 	}
+	reply.catf(", polls %" PRIu32, numPolls);
+	numPolls = 0;
 	ResetLoadRegisters();
 }
 
+// Get the summary of the load readings taken during the last move that we have readings for, returning false if we have none
+bool TmcDriverState::GetLoadStats(DriverLoadStats& stats) const
+{
+	const irqflags_t flags = cpu_irq_save();			// the ISR updates the stats
+	stats = lastMoveLoadStats;
+	cpu_irq_restore(flags);
+	return stats.numReadings != 0;
+}
+
 // Get microstepping
 unsigned int TmcDriverState::GetMicrostepping(bool& interpolation) const
 {
@@ -527,17 +670,35 @@ uint32_t TmcDriverState::GetOffTime() const
 inline void TmcDriverState::TransferDone()
 {
 	fastDigitalWriteHigh(pin);									// set the CS pin high for the driver we just polled
+	sendingDriveControl = false;
 	if (driversPowered)											// if the power is still good, update the status
 	{
 		uint32_t status = be32_to_cpu(spiDataIn) >> 12;			// get the status
-		const uint32_t interval = reprap.GetMove().GetStepInterval(axisNumber, microstepShiftFactor);		// get the full step interval
-		if (interval == 0 || interval > maxStallStepInterval)	// if the motor speed is too low to get reliable stall indication
+		const Move& move = reprap.GetMove();
+		const DDA * const dda = move.GetCurrentDDA();
+		if (dda != loadStatsDda)
+		{
+			// The move has changed, so if we took any load readings during the last one then summarise them
+			if (moveLoadReadings != 0)
+			{
+				lastMoveLoadStats.numReadings = moveLoadReadings;
+				lastMoveLoadStats.minLoadReading = moveMinLoad;
+				lastMoveLoadStats.maxLoadReading = moveMaxLoad;
+				lastMoveLoadStats.meanLoadReading = (uint16_t)((moveLoadSum + moveLoadReadings/2)/moveLoadReadings);
+				moveLoadSum = moveLoadReadings = 0;
+			}
+			loadStatsDda = dda;
+		}
+
+		const uint32_t interval = move.GetStepInterval(axisNumber, GetStepShiftFactor());		// get the full step interval
+		const uint32_t sgLoad = (status >> TMC_RR_SG_LOAD_SHIFT) & 1023;	// get the StallGuard load register
+		const bool loadValid = (interval != 0 && interval <= maxStallStepInterval);
+		if (!loadValid)											// if the motor speed is too low to get reliable stall indication
 		{
 			status &= ~TMC_RR_SG;								// remove the stall status bit
 		}
 		else
 		{
-			const uint32_t sgLoad = (status >> TMC_RR_SG_LOAD_SHIFT) & 1023;	// get the StallGuard load register
 			if (sgLoad < minSgLoadRegister)
 			{
 				minSgLoadRegister = sgLoad;
@@ -546,7 +707,23 @@ inline void TmcDriverState::TransferDone()
 			{
 				maxSgLoadRegister = sgLoad;
 			}
+
+			if (moveLoadReadings == 0)
+			{
+				moveMinLoad = moveMaxLoad = (uint16_t)sgLoad;
+			}
+			else if (sgLoad < moveMinLoad)
+			{
+				moveMinLoad = (uint16_t)sgLoad;
+			}
+			else if (sgLoad > moveMaxLoad)
+			{
+				moveMaxLoad = (uint16_t)sgLoad;
+			}
+			moveLoadSum += sgLoad;
+			++moveLoadReadings;
 		}
+		UpdateDynamicCurrent(dda, interval, loadValid, sgLoad);
 		lastReadStatus = status;
 		accumulatedStatus |= status;
 	}
@@ -556,12 +733,15 @@ inline void TmcDriverState::TransferDone()
 inline void TmcDriverState::StartTransfer()
 {
 	currentDriver = this;
+	lastPollTime = millis();
+	++numPolls;
 
 	// Find which register to send. The common case is when no registers need to be updated.
 	uint32_t regVal;
 	if (registersToUpdate == 0)
 	{
 		regVal = registers[SmartEnable];
+		sendingDriveControl = false;
 	}
 	else
 	{
@@ -578,6 +758,13 @@ inline void TmcDriverState::StartTransfer()
 		} while (regNum < NumRegisters - 1);
 		registersToUpdate &= ~mask;
 		regVal = registers[regNum];
+		sendingDriveControl = (regNum == DriveControl);
+		if (regNum == StallGuardConfig)
+		{
+			const uint32_t csBits = desiredCsBits;				// capture volatile variable
+			regVal = (regVal & ~TMC_SGCSCONF_CS_MASK) | TMC_SGCSCONF_CS(csBits);
+			sentCsBits = csBits;
+		}
 	}
 
 	// Kick off a transfer for that register
@@ -604,6 +791,34 @@ inline void TmcDriverState::StartTransfer()
 	cpu_irq_restore(flags);
 }
 
+// Return true if this driver needs a transfer now, because we have a register to send to it, or its motor is moving, or we haven't read its status for a while
+inline bool TmcDriverState::IsPollDue(uint32_t now) const
+{
+	return registersToUpdate != 0
+		|| now - lastPollTime >= IdlePollInterval
+		|| reprap.GetMove().GetStepInterval(axisNumber, GetStepShiftFactor()) != 0;
+}
+
+// Find the first driver that needs a transfer, starting at the one specified and wrapping round, or return nullptr if none does
+static inline TmcDriverState *FindDueDriver(TmcDriverState *start)
+{
+	const uint32_t now = millis();
+	TmcDriverState *driver = start;
+	do
+	{
+		if (driver->IsPollDue(now))
+		{
+			return driver;
+		}
+		++driver;
+		if (driver == driverStates + numTmc2660Drivers)
+		{
+			driver = driverStates;
+		}
+	} while (driver != start);
+	return nullptr;
+}
+
 // ISR for the USART
 
 #ifndef TMC2660_SPI_Handler
@@ -620,18 +835,22 @@ void TMC2660_SPI_Handler(void)
 		driver->TransferDone();							// tidy up after the transfer we just completed
 		if (driversPowered)
 		{
-			// Power is still good, so send/receive to/from the next driver
+			// Power is still good, so send/receive to/from the next driver that needs it
 			++driver;									// advance to the next driver
 			if (driver == driverStates + numTmc2660Drivers)
 			{
 				driver = driverStates;
 			}
-			driver->StartTransfer();
-			return;
+			driver = FindDueDriver(driver);
+			if (driver != nullptr)
+			{
+				driver->StartTransfer();
+				return;
+			}
 		}
 	}
 
-	// Driver power is down or there is no current driver, so stop polling
+	// Driver power is down, or there is no current driver, or no driver needs a transfer yet, so stop polling. The tick ISR restarts it when a driver is due.
 
 #if TMC2660_USES_USART
 	USART_TMC2660->US_IDR = US_IDR_ENDRX;
@@ -771,6 +990,21 @@ namespace SmartDrivers
 		return 1;
 	}
 
+#if SUPPORT_MICROSTEP_SWITCHING
+	void SetMicrostepReduction(size_t driver, unsigned int shift)
+	{
+		if (driver < numTmc2660Drivers)
+		{
+			driverStates[driver].SetMicrostepReduction(shift);
+		}
+	}
+
+	bool IsMicrostepChangePending(size_t driver)
+	{
+		return driver < numTmc2660Drivers && driverStates[driver].IsMicrostepChangePending();
+	}
+#endif
+
 	bool SetDriverMode(size_t driver, unsigned int mode)
 	{
 		return driver < numTmc2660Drivers && driverStates[driver].SetDriverMode(mode);
@@ -820,12 +1054,7 @@ namespace SmartDrivers
 					driverStates[driver].WriteAll();
 				}
 			}
-			if (currentDriver == nullptr && numTmc2660Drivers != 0)
-			{
-				// Kick off the first transfer
-				NVIC_EnableIRQ(TMC2660_SPI_IRQn);
-				driverStates[0].StartTransfer();
-			}
+			RestartPolling();
 		}
 		else if (wasPowered)
 		{
@@ -833,6 +1062,24 @@ namespace SmartDrivers
 		}
 	}
 
+	// Start polling the drivers again if it has stopped because no driver needed a transfer. This is called from the tick ISR and from Spin.
+	void RestartPolling()
+	{
+		if (driversPowered && currentDriver == nullptr && numTmc2660Drivers != 0)
+		{
+			const irqflags_t flags = cpu_irq_save();
+			if (currentDriver == nullptr)				// check again now that the SPI ISR can't change it
+			{
+				TmcDriverState * const driver = FindDueDriver(driverStates);
+				if (driver != nullptr)
+				{
+					driver->StartTransfer();
+				}
+			}
+			cpu_irq_restore(flags);
+		}
+	}
+
 	// This is called from the tick ISR, possibly while Spin (with powered either true or false) is being executed
 	void TurnDriversOff()
 	{
@@ -872,6 +1119,27 @@ namespace SmartDrivers
 		}
 	}
 
+	void SetDynamicCurrent(size_t driver, uint32_t accelPercent, uint32_t cruisePercent, uint32_t loadThreshold)
+	{
+		if (driver < numTmc2660Drivers)
+		{
+			driverStates[driver].SetDynamicCurrent(accelPercent, cruisePercent, loadThreshold);
+		}
+	}
+
+	void GetDynamicCurrent(size_t driver, uint32_t& accelPercent, uint32_t& cruisePercent, uint32_t& loadThreshold)
+	{
+		if (driver < numTmc2660Drivers)
+		{
+			driverStates[driver].GetDynamicCurrent(accelPercent, cruisePercent, loadThreshold);
+		}
+		else
+		{
+			accelPercent = cruisePercent = 100;
+			loadThreshold = 0;
+		}
+	}
+
 	void AppendStallConfig(size_t driver, const StringRef& reply)
 	{
 		if (driver < numTmc2660Drivers)
@@ -888,6 +1156,17 @@ namespace SmartDrivers
 		}
 	}
 
+	// Get the summary of the StallGuard readings taken during the last move that the driver took part in, returning false if there are none
+	bool GetLoadStats(size_t driver, DriverLoadStats& stats)
+	{
+		if (driver < numTmc2660Drivers)
+		{
+			return driverStates[driver].GetLoadStats(stats);
+		}
+		stats.numReadings = 0;
+		return false;
+	}
+
 	float GetStandstillCurrentPercent(size_t driver)
 	{
 		return 100.0;			// not supported
@@ -26,12 +26,23 @@ const uint32_t TMC_RR_OLB = 1 << 6;			// open load B
 const uint32_t TMC_RR_STST = 1 << 7;		// standstill detected
 const uint32_t TMC_RR_SG_LOAD_SHIFT = 10;	// shift to get stallguard load register
 
+// StallGuard load readings taken while a driver was executing a move. The StallGuard reading falls as the load on the motor rises, reaching 0 at stall.
+// Readings are only taken while the motor is turning faster than the minimum stall detection speed, because they are meaningless at lower speeds.
+struct DriverLoadStats
+{
+	uint32_t numReadings;					// the number of readings taken during the move, or 0 if we have no readings
+	uint16_t minLoadReading;
+	uint16_t maxLoadReading;
+	uint16_t meanLoadReading;
+};
+
 namespace SmartDrivers
 {
 	void Init(const Pin[DRIVES], size_t numTmcDrivers)
 		pre(numTmcDrivers <= DRIVES);
 	void Spin(bool powered);
 	void TurnDriversOff();
+	void RestartPolling();
 
 	void SetAxisNumber(size_t driver, uint32_t axisNumber);
 	void SetCurrent(size_t driver, float current);
@@ -40,6 +51,10 @@ namespace SmartDrivers
 	uint32_t GetAccumulatedStatus(size_t drive, uint32_t bitsToKeep);
 	bool SetMicrostepping(size_t drive, unsigned int microsteps, bool interpolation);
 	unsigned int GetMicrostepping(size_t drive, bool& interpolation);
+#if SUPPORT_MICROSTEP_SWITCHING
+	void SetMicrostepReduction(size_t driver, unsigned int shift);		// temporarily reduce the microstepping by a factor of (1 << shift), or restore it
+	bool IsMicrostepChangePending(size_t driver);						// return true if a microstepping change hasn't been sent to the driver yet
+#endif
 	bool SetDriverMode(size_t driver, unsigned int mode);
 	DriverMode GetDriverMode(size_t driver);
 	bool SetChopperControlRegister(size_t driver, uint32_t ccr);
@@ -50,8 +65,11 @@ namespace SmartDrivers
 	void SetStallFilter(size_t driver, bool sgFilter);
 	void SetStallMinimumStepsPerSecond(size_t driver, unsigned int stepsPerSecond);
 	void SetCoolStep(size_t driver, uint16_t coolStepConfig);
+	void SetDynamicCurrent(size_t driver, uint32_t accelPercent, uint32_t cruisePercent, uint32_t loadThreshold);
+	void GetDynamicCurrent(size_t driver, uint32_t& accelPercent, uint32_t& cruisePercent, uint32_t& loadThreshold);
 	void AppendStallConfig(size_t driver, const StringRef& reply);
 	void AppendDriverStatus(size_t driver, const StringRef& reply);
+	bool GetLoadStats(size_t driver, DriverLoadStats& stats);
 	float GetStandstillCurrentPercent(size_t driver);
 	void SetStandstillCurrentPercent(size_t driver, float percent);
 };
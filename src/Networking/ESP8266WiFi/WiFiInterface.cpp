@@ -48,6 +48,10 @@ static_assert(SsidLength == SsidBufferLength, "SSID lengths in NetworkDefs.h and
 # error Unknown board
 #endif
 
+// With the PDC and the DMAC we send the data that accompanies a command directly from the caller's buffer, after the header in our own buffer.
+// This saves copying file data and other large blocks of data into bufferOut.
+#define SEND_DATA_IN_PLACE	(USE_PDC || USE_DMAC)
+
 #if USE_PDC
 #include "pdc/pdc.h"
 #endif
@@ -68,6 +72,7 @@ const uint32_t WiFiStartupMillis = 300;
 const uint32_t WiFiStableMillis = 100;
 
 const unsigned int MaxHttpConnections = 4;
+const unsigned int MaxFtpConnections = 2;				// the FTP sessions share the data port, but they can interleave their transfers
 
 // Forward declarations of static functions
 static void spi_dma_disable();
@@ -76,7 +81,9 @@ static bool spi_dma_check_rx_complete();
 struct MessageBufferOut
 {
 	MessageHeaderSamToEsp hdr;
+#if !SEND_DATA_IN_PLACE
 	uint8_t data[MaxDataLength];	// data to send
+#endif
 };
 
 struct MessageBufferIn
@@ -173,6 +180,9 @@ void WiFiInterface::Init()
 
 	uploader = new WifiFirmwareUploader(Serial1, *this);
 	currentSocket = 0;
+
+	// Start the ESP8266 booting now, so that its start-up time overlaps running config.g. It is not put into the requested mode until we are activated.
+	Start();
 }
 
 GCodeResult WiFiInterface::EnableProtocol(NetworkProtocol protocol, int port, int secure, const StringRef& reply)
@@ -240,7 +250,7 @@ void WiFiInterface::StartProtocol(NetworkProtocol protocol)
 		break;
 
 	case FtpProtocol:
-		SendListenCommand(portNumbers[protocol], protocol, 1);
+		SendListenCommand(portNumbers[protocol], protocol, MaxFtpConnections);
 		break;
 
 	case TelnetProtocol:
@@ -329,19 +339,20 @@ NetworkProtocol WiFiInterface::GetProtocolByLocalPort(Port port) const
 }
 
 // This is called at the end of config.g processing.
-// Start the network if it was enabled
+// The module was started when we were initialised, so stop it if the network was not enabled, or restart it if it failed to start.
 void WiFiInterface::Activate()
 {
 	if (!activated)
 	{
 		activated = true;
-		if (requestedMode != WiFiState::disabled)
+		if (requestedMode == WiFiState::disabled)
 		{
-			Start();
+			Stop();
+			platform.Message(UsbMessage, "WiFi is disabled.\n");
 		}
-		else
+		else if (state == NetworkState::disabled)
 		{
-			platform.Message(UsbMessage, "WiFi is disabled.\n");
+			Start();
 		}
 	}
 }
@@ -544,7 +555,8 @@ void WiFiInterface::Spin(bool full)
 				}
 				GetNewStatus();
 			}
-			else if (   currentMode != requestedMode
+			else if (   activated
+					 && currentMode != requestedMode
 					 && currentMode != WiFiState::connecting
 					 && currentMode != WiFiState::reconnecting
 					 && currentMode != WiFiState::autoReconnecting
@@ -1455,15 +1467,67 @@ static void spi_rx_dma_setup(const void *buf, uint32_t transferLength)
 #endif
 }
 
+#if USE_DMAC
+
+// Linked list of DMAC transfer descriptors used to send the header from our buffer followed by the data from the caller's buffer
+static dma_transfer_descriptor_t txDescriptors[2];
+
+#endif
+
+#if SEND_DATA_IN_PLACE
+
+// Set up DMA to send the header in bufferOut followed by data that is elsewhere
+static void spi_tx_dma_setup_in_place(const void *dataOut, uint32_t dataOutSize)
+{
+#if USE_PDC
+	pdc_packet_t pdc_header_packet, pdc_data_packet;
+	pdc_header_packet.ul_addr = reinterpret_cast<uint32_t>(&bufferOut.hdr);
+	pdc_header_packet.ul_size = sizeof(MessageHeaderSamToEsp);
+	pdc_data_packet.ul_addr = reinterpret_cast<uint32_t>(dataOut);
+	pdc_data_packet.ul_size = dataOutSize;
+	pdc_tx_init(spi_pdc, &pdc_header_packet, &pdc_data_packet);		// the PDC moves on to the 'next' packet when the first one is done
+#endif
+
+#if USE_DMAC
+	DMAC->DMAC_EBCISR;		// clear any pending interrupts
+
+	// The data may not be word aligned, so we use byte transfers for both buffers
+	txDescriptors[0].ul_source_addr = reinterpret_cast<uint32_t>(&bufferOut.hdr);
+	txDescriptors[0].ul_destination_addr = reinterpret_cast<uint32_t>(& SPI->SPI_TDR);
+	txDescriptors[0].ul_ctrlA = sizeof(MessageHeaderSamToEsp) | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+	txDescriptors[0].ul_ctrlB = DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_INCREMENTING | DMAC_CTRLB_DST_INCR_FIXED;
+	txDescriptors[0].ul_descriptor_addr = reinterpret_cast<uint32_t>(&txDescriptors[1]);
+
+	txDescriptors[1].ul_source_addr = reinterpret_cast<uint32_t>(dataOut);
+	txDescriptors[1].ul_destination_addr = reinterpret_cast<uint32_t>(& SPI->SPI_TDR);
+	txDescriptors[1].ul_ctrlA = dataOutSize | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+	txDescriptors[1].ul_ctrlB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_INCREMENTING | DMAC_CTRLB_DST_INCR_FIXED;
+	txDescriptors[1].ul_descriptor_addr = 0;						// this is the last buffer
+
+	// With SRC_DSCR clear in CTRLB, the controller fetches the first descriptor when the channel is enabled
+	dmac_channel_set_descriptor_addr(DMAC, CONF_SPI_DMAC_TX_CH, reinterpret_cast<uint32_t>(&txDescriptors[0]));
+	dmac_channel_set_ctrlB(DMAC, CONF_SPI_DMAC_TX_CH, DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC | DMAC_CTRLB_SRC_INCR_INCREMENTING | DMAC_CTRLB_DST_INCR_FIXED);
+#endif
+}
+
+#endif
+
 /**
  * \brief Set SPI slave transfer.
  */
-static void spi_slave_dma_setup(uint32_t dataOutSize, uint32_t dataInSize)
+static void spi_slave_dma_setup(const void *dataOut, uint32_t dataOutSize, uint32_t dataInSize)
 {
 #if USE_PDC
 	pdc_disable_transfer(spi_pdc, PERIPH_PTCR_TXTDIS | PERIPH_PTCR_RXTDIS);
 	spi_rx_dma_setup(&bufferIn, dataInSize + sizeof(MessageHeaderEspToSam));
-	spi_tx_dma_setup(&bufferOut, dataOutSize + sizeof(MessageHeaderSamToEsp));
+	if (dataOut != nullptr && dataOutSize != 0)
+	{
+		spi_tx_dma_setup_in_place(dataOut, dataOutSize);
+	}
+	else
+	{
+		spi_tx_dma_setup(&bufferOut, sizeof(MessageHeaderSamToEsp));
+	}
 	pdc_enable_transfer(spi_pdc, PERIPH_PTCR_TXTEN | PERIPH_PTCR_RXTEN);
 #endif
 
@@ -1472,7 +1536,19 @@ static void spi_slave_dma_setup(uint32_t dataOutSize, uint32_t dataInSize)
 
 	spi_rx_dma_setup(&bufferIn, dataInSize + sizeof(MessageHeaderEspToSam));
 	spi_rx_dma_enable();
+# if SEND_DATA_IN_PLACE
+	if (dataOut != nullptr && dataOutSize != 0)
+	{
+		spi_tx_dma_setup_in_place(dataOut, dataOutSize);
+	}
+	else
+	{
+		spi_tx_dma_setup(&bufferOut, sizeof(MessageHeaderSamToEsp));
+	}
+# else
+	(void)dataOut;
 	spi_tx_dma_setup(&bufferOut, dataOutSize + sizeof(MessageHeaderSamToEsp));
+# endif
 	spi_tx_dma_enable();
 #endif
 }
@@ -1583,10 +1659,12 @@ int32_t WiFiInterface::SendCommand(NetworkCommand cmd, SocketNumber socketNum, u
 	bufferOut.hdr.param32 = 0;
 	bufferOut.hdr.dataLength = (uint16_t)dataOutLength;
 	bufferOut.hdr.dataBufferAvailable = (uint16_t)dataInLength;
+#if !SEND_DATA_IN_PLACE
 	if (dataOut != nullptr)
 	{
 		memcpy(bufferOut.data, dataOut, dataOutLength);
 	}
+#endif
 	bufferIn.hdr.formatVersion = InvalidFormatVersion;
 	transferPending = true;
 
@@ -1597,7 +1675,7 @@ int32_t WiFiInterface::SendCommand(NetworkCommand cmd, SocketNumber socketNum, u
 	spi_set_bits_per_transfer(ESP_SPI, 0, SPI_CSR_BITS_8_BIT);
 
 	// Set up the DMA controller
-	spi_slave_dma_setup(dataOutLength, dataInLength);
+	spi_slave_dma_setup(dataOut, dataOutLength, dataInLength);
 	spi_enable(ESP_SPI);
 
 	// Enable the end-of transfer interrupt
@@ -13,7 +13,7 @@
 const unsigned int MaxBuffersPerSocket = 4;
 
 
-WiFiSocket::WiFiSocket(NetworkInterface *iface) : Socket(iface), receivedData(nullptr), state(SocketState::inactive), needsPolling(false)
+WiFiSocket::WiFiSocket(NetworkInterface *iface) : Socket(iface), receivedData(nullptr), state(SocketState::inactive), needsPolling(false), pushNeeded(false)
 {
 }
 
@@ -22,6 +22,7 @@ void WiFiSocket::Init(SocketNumber n)
 	socketNum = n;
 	state = SocketState::inactive;
 	txBufferSpace = 0;
+	pushNeeded = false;
 }
 
 // Close a connection when the last packet has been sent
@@ -55,6 +56,7 @@ void WiFiSocket::Terminate()
 	}
 	DiscardReceivedData();
 	txBufferSpace = 0;
+	pushNeeded = false;
 }
 
 // Return true if there is or may soon be more data to read
@@ -299,11 +301,33 @@ void WiFiSocket::DiscardReceivedData()
 
 // Send the data, returning the length buffered
 size_t WiFiSocket::Send(const uint8_t *data, size_t length)
+{
+	const size_t sent = SendData(data, length, 0);
+	if (sent != 0)
+	{
+		pushNeeded = true;
+	}
+	return sent;
+}
+
+// Send the last data of a reply and ask the WiFi module to push it, returning the length buffered.
+// This saves the SPI transaction that Send() would otherwise need to push the data.
+size_t WiFiSocket::SendAndPush(const uint8_t *data, size_t length)
+{
+	const size_t sent = SendData(data, length, MessageHeaderSamToEsp::FlagPush);
+	if (sent != 0)
+	{
+		pushNeeded = false;
+	}
+	return sent;
+}
+
+size_t WiFiSocket::SendData(const uint8_t *data, size_t length, uint8_t flags)
 {
 	if (state == SocketState::connected && txBufferSpace != 0)
 	{
 		const size_t lengthToSend = min<size_t>(length, min<size_t>(txBufferSpace, MaxDataLength));
-		const int32_t reply = GetInterface()->SendCommand(NetworkCommand::connWrite, socketNum, 0, data, lengthToSend, nullptr, 0);
+		const int32_t reply = GetInterface()->SendCommand(NetworkCommand::connWrite, socketNum, flags, data, lengthToSend, nullptr, 0);
 		if (reply >= 0 && (size_t)reply <= lengthToSend)
 		{
 			txBufferSpace -= (size_t)reply;
@@ -318,11 +342,12 @@ size_t WiFiSocket::Send(const uint8_t *data, size_t length)
 	return 0;
 }
 
-// Tell the interface to send the outstanding data
+// Tell the interface to send the outstanding data, unless we have already done so
 void WiFiSocket::Send()
 {
-	if (state == SocketState::connected)
+	if (state == SocketState::connected && pushNeeded)
 	{
+		pushNeeded = false;
 		const int32_t reply = GetInterface()->SendCommand(NetworkCommand::connWrite, socketNum, MessageHeaderSamToEsp::FlagPush, nullptr, 0, nullptr, 0);
 		if (reply < 0)
 		{
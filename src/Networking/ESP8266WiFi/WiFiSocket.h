@@ -32,6 +32,7 @@ public:
 	bool CanRead() const;
 	bool CanSend() const;
 	size_t Send(const uint8_t *data, size_t length);
+	size_t SendAndPush(const uint8_t *data, size_t length);
 	void Send();
 	void SetNeedsPolling() { needsPolling = true; }
 	bool NeedsPolling() const;
@@ -50,6 +51,7 @@ private:
 	WiFiInterface *GetInterface() const;
 	void ReceiveData(uint16_t bytesAvailable);
 	void DiscardReceivedData();
+	size_t SendData(const uint8_t *data, size_t length, uint8_t flags);
 
 	NetworkBuffer *receivedData;						// List of buffers holding received data
 	uint32_t whenConnected;
@@ -57,6 +59,7 @@ private:
 	SocketNumber socketNum;								// The WiFi socket number we are using
 	SocketState state;
 	bool needsPolling;
+	bool pushNeeded;									// True if we have sent data to the WiFi module without asking it to push the data
 };
 
 #endif /* SRC_NETWORKING_WIFISOCKET_H_ */
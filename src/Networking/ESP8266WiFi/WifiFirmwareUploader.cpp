@@ -65,7 +65,9 @@ const char * const resultMessages[] =
 // Probably our UART ISR cannot receive bytes fast enough, perhaps because of the latency of the system tick ISR.
 // 460800b doesn't always manage to connect, but if it does then uploading appears to be reliable.
 // 230400b always manages to connect.
-static const uint32_t uploadBaudRates[] = { 230400, 115200, 74880, 9600 };
+// So we try 460800b first, because it halves the upload time, but we only make one set of attempts at it before falling back to 230400b.
+// If uploading fails at 460800b then we start again at 230400b.
+static const uint32_t uploadBaudRates[] = { 460800, 230400, 115200, 74880, 9600 };
 
 WifiFirmwareUploader::WifiFirmwareUploader(UARTClass& port, WiFiInterface& iface)
 	: uploadPort(port), interface(iface), uploadFile(nullptr), state(UploadState::idle)
@@ -587,7 +589,7 @@ void WifiFirmwareUploader::Spin()
 	switch (state)
 	{
 	case UploadState::resetting:
-		if (connectAttemptNumber == ARRAY_SIZE(uploadBaudRates) * retriesPerBaudRate)
+		if (baudRateIndex == ARRAY_SIZE(uploadBaudRates))
 		{
 			// Time to give up
 			interface.ResetWiFi();
@@ -597,8 +599,8 @@ void WifiFirmwareUploader::Spin()
 		else
 		{
 			// Reset the serial port at the new baud rate. Also reset the ESP8266.
-			const uint32_t baud = uploadBaudRates[connectAttemptNumber/retriesPerBaudRate];
-			if (connectAttemptNumber % retriesPerBaudRate == 0)
+			const uint32_t baud = uploadBaudRates[baudRateIndex];
+			if (connectAttemptNumber == 0)
 			{
 				// First attempt at this baud rate
 				MessageF("Trying to connect at %u baud: ", baud);
@@ -630,9 +632,11 @@ void WifiFirmwareUploader::Spin()
 				++connectAttemptNumber;
 				if (connectAttemptNumber % retriesPerReset == 0)
 				{
-					if (connectAttemptNumber % retriesPerBaudRate == 0)
+					if (connectAttemptNumber == ((baudRateIndex == 0) ? retriesPerReset : retriesPerBaudRate))
 					{
 						MessageF(" failed\n");
+						++baudRateIndex;
+						connectAttemptNumber = 0;
 					}
 					state = UploadState::resetting;		// try a reset and a lower baud rate
 				}
@@ -687,6 +691,15 @@ void WifiFirmwareUploader::Spin()
 				lastAttemptTime = millis();
 				if (uploadResult != EspUploadResult::success)
 				{
+					if (baudRateIndex == 0 && uploadFile->Seek(0))
+					{
+						// We are using the fastest baud rate, which isn't always reliable, so start again at the next one
+						MessageF("Flash block upload failed, retrying at a lower baud rate\n");
+						baudRateIndex = 1;
+						connectAttemptNumber = 0;
+						state = UploadState::resetting;
+						break;
+					}
 					MessageF("Flash block upload failed\n");
 					state = UploadState::done;
 				}
@@ -759,6 +772,7 @@ void WifiFirmwareUploader::SendUpdateFile(const char *file, const char *dir, uin
 
 	// Set up the state so that subsequent calls to Spin() will attempt the upload
 	uploadAddress = address;
+	baudRateIndex = 0;
 	connectAttemptNumber = 0;
 	state = UploadState::resetting;
 }
@@ -91,7 +91,8 @@ private:
 	uint32_t uploadAddress;
 	uint32_t uploadBlockNumber;
 	unsigned int uploadNextPercentToReport;
-	unsigned int connectAttemptNumber;
+	size_t baudRateIndex;
+	unsigned int connectAttemptNumber;						// the number of attempts we have made at the current baud rate
 	uint32_t lastAttemptTime;
 	uint32_t lastResetTime;
 	UploadState state;
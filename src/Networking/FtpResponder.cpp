@@ -11,6 +11,8 @@
 #include "NetworkInterface.h"
 #include "Platform.h"
 
+FtpResponder *FtpResponder::dataPortOwner = nullptr;
+
 FtpResponder::FtpResponder(NetworkResponder *n) : NetworkResponder(n), dataSocket(nullptr),
 	passivePort(0),	passivePortOpenTime(0), dataBuf(nullptr)
 {
@@ -343,10 +345,11 @@ void FtpResponder::SendPassiveData()
 // Write some more upload data
 void FtpResponder::DoUpload()
 {
-	// Write incoming data to the file
+	// Write incoming data to the file. The socket gives us one received segment at a time, so pass several of them to the file in each call.
 	const uint8_t *buffer;
 	size_t len;
-	if (dataSocket->ReadBuffer(buffer, len))
+	size_t bytesWritten = 0;
+	while (bytesWritten < ftpUploadBytesPerSpin && dataSocket->ReadBuffer(buffer, len))
 	{
 		if (reprap.Debug(moduleWebserver))
 		{
@@ -363,6 +366,8 @@ void FtpResponder::DoUpload()
 			responderState = ResponderState::pasvTransferComplete;
 			return;
 		}
+		ScanUploadData(buffer, len);
+		bytesWritten += len;
 	}
 
 	// Upload has finished if the connection is closed
@@ -534,9 +539,17 @@ void FtpResponder::ProcessLine()
 			}
 			Commit(ResponderState::reading);
 		}
+		// all the FTP sessions share one data port, so only one of them can transfer data at a time
+		else if (StringEquals(clientMessage, "PASV") && dataPortOwner != nullptr && dataPortOwner != this)
+		{
+			outBuf->copy("425 Data connection in use by another session, try again later.\r\n");
+			Commit(ResponderState::reading);
+		}
 		// enter passive mode mode
 		else if (StringEquals(clientMessage, "PASV"))
 		{
+			dataPortOwner = this;
+
 			// reset error conditions
 			uploadError = sendError = false;
 
@@ -669,20 +682,7 @@ void FtpResponder::ProcessLine()
 			Commit(ResponderState::sendingPasvData);
 
 			// build directory listing, dataBuf is sent later in the Spin loop
-			MassStorage * const massStorage = GetPlatform().GetMassStorage();
-			FileInfo fileInfo;
-			if (massStorage->FindFirst(currentDirectory, fileInfo))
-			{
-				do {
-					// Example for a typical UNIX-like file list:
-					// "drwxr-xr-x    2 ftp      ftp             0 Apr 11 2013 bin\r\n"
-					const char dirChar = (fileInfo.isDirectory) ? 'd' : '-';
-					const struct tm * const timeInfo = gmtime(&fileInfo.lastModified);
-					dataBuf->catf("%crw-rw-rw- 1 ftp ftp %13lu %s %02d %04d %s\r\n",
-							dirChar, fileInfo.size, massStorage->GetMonthName(timeInfo->tm_mon + 1),
-							timeInfo->tm_mday, timeInfo->tm_year + 1900, fileInfo.fileName);
-				} while (massStorage->FindNext(fileInfo));
-			}
+			SendDirectoryListing();
 		}
 		// switch transfer mode (sends response, but doesn't have any effects)
 		else if (StringStartsWith(clientMessage, "TYPE"))
@@ -873,6 +873,72 @@ void FtpResponder::ChangeDirectory(const char *newDirectory)
 	}
 }
 
+// Append a listing of the current directory to dataBuf
+void FtpResponder::SendDirectoryListing()
+{
+	MassStorage * const massStorage = GetPlatform().GetMassStorage();
+	FileInfo fileInfo;
+	if (massStorage->FindFirst(currentDirectory, fileInfo))
+	{
+		// Build the start of each line in a local buffer instead of using catf, because parsing the format string for every file makes long listings slow.
+		// Example for a typical UNIX-like file list:
+		// "drwxr-xr-x    2 ftp      ftp             0 Apr 11 2013 bin\r\n"
+		char line[ftpListLineLength];
+		do
+		{
+			char *p = line;
+			*p++ = (fileInfo.isDirectory) ? 'd' : '-';
+			for (const char *q = "rw-rw-rw- 1 ftp ftp "; *q != 0; )
+			{
+				*p++ = *q++;
+			}
+
+			// File size, right justified in 13 characters
+			char digits[10];
+			size_t numDigits = 0;
+			uint32_t size = fileInfo.size;
+			do
+			{
+				digits[numDigits++] = (char)('0' + size % 10);
+				size /= 10;
+			} while (size != 0);
+			for (size_t i = numDigits; i < 13; ++i)
+			{
+				*p++ = ' ';
+			}
+			while (numDigits != 0)
+			{
+				*p++ = digits[--numDigits];
+			}
+			*p++ = ' ';
+
+			// Date as "Mmm dd yyyy"
+			const struct tm * const timeInfo = gmtime(&fileInfo.lastModified);
+			for (const char *q = massStorage->GetMonthName(timeInfo->tm_mon + 1); *q != 0; )
+			{
+				*p++ = *q++;
+			}
+			*p++ = ' ';
+			*p++ = (char)('0' + timeInfo->tm_mday / 10);
+			*p++ = (char)('0' + timeInfo->tm_mday % 10);
+			*p++ = ' ';
+			unsigned int year = timeInfo->tm_year + 1900;
+			for (size_t i = 4; i != 0; )
+			{
+				--i;
+				p[i] = (char)('0' + year % 10);
+				year /= 10;
+			}
+			p += 4;
+			*p++ = ' ';
+
+			dataBuf->cat(line, p - line);
+			dataBuf->cat(fileInfo.fileName);
+			dataBuf->cat("\r\n", 2);
+		} while (massStorage->FindNext(fileInfo));
+	}
+}
+
 void FtpResponder::CloseDataPort()
 {
 	if (reprap.Debug(moduleWebserver))
@@ -897,6 +963,11 @@ void FtpResponder::CloseDataPort()
 		fileBeingSent->Close();
 		fileBeingSent = nullptr;
 	}
+
+	if (dataPortOwner == this)
+	{
+		dataPortOwner = nullptr;
+	}
 }
 
 // End
@@ -9,6 +9,7 @@
 #define SRC_NETWORKING_FTPRESPONDER_H_
 
 #include "NetworkResponder.h"
+#include "NetworkBuffer.h"
 
 class FtpResponder : public NetworkResponder
 {
@@ -23,6 +24,10 @@ public:
 protected:
 	static const size_t ftpMessageLength = 128;			// maximum line length for incoming FTP commands
 	static const uint32_t ftpPasvPortTimeout = 10000;	// maximum time to wait for an FTP data connection in milliseconds
+	static const size_t ftpUploadBytesPerSpin = 4 * NetworkBuffer::bufferSize;	// how much upload data we pass to the file in each call to Spin
+	static const size_t ftpListLineLength = 64;			// enough for a line of a directory listing, excluding the file name
+
+	static FtpResponder *dataPortOwner;					// the responder that is using the data port, which all sessions share
 
 	Socket *dataSocket;
 	Port passivePort;
@@ -36,6 +41,7 @@ protected:
 	void SendPassiveData();
 
 	void DoUpload();
+	void SendDirectoryListing();
 
 	bool ReadData();
 	void CharFromClient(char c);
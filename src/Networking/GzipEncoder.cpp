@@ -0,0 +1,233 @@
+/*
+ * GzipEncoder.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "GzipEncoder.h"
+
+#if SUPPORT_HTTP_GZIP
+
+#include "OutputMemory.h"
+
+// Deflate length and distance codes, see RFC 1951 section 3.2.5
+static const uint16_t LengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LengthExtraBits[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DistanceBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+										1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DistanceExtraBits[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static_assert(ARRAY_SIZE(LengthBase) == ARRAY_SIZE(LengthExtraBits), "Length table sizes don't match");
+static_assert(ARRAY_SIZE(DistanceBase) == ARRAY_SIZE(DistanceExtraBits), "Distance table sizes don't match");
+
+// Start a new compressed response
+bool GzipEncoder::Start()
+{
+	if (!OutputBuffer::Allocate(out))
+	{
+		out = nullptr;
+		return false;
+	}
+
+	crc.Reset();
+	inputLength = pos = 0;
+	lookahead = 0;
+	bitBuffer = 0;
+	numBits = 0;
+	numOutBytes = 0;
+	memset(head, 0, sizeof(head));
+
+	// gzip header: magic number, deflate method, no flags, no modification time, no extra flags, unknown OS
+	static const char GzipHeader[] = { 0x1F, (char)0x8B, 8, 0, 0, 0, 0, 0, 0, (char)0xFF };
+	out->copy(GzipHeader, sizeof(GzipHeader));
+
+	PutBits(1, 1);										// this is the final block
+	PutBits(1, 2);										// compressed with fixed Huffman codes
+	return true;
+}
+
+// Compress the data in a chain of output buffers
+void GzipEncoder::Add(const OutputBuffer *buf)
+{
+	for (; buf != nullptr; buf = buf->Next())
+	{
+		const uint8_t *data = reinterpret_cast<const uint8_t *>(buf->Data());
+		const size_t length = buf->DataLength();
+		crc.Update(buf->Data(), length);
+		inputLength += length;
+		for (size_t i = 0; i < length; ++i)
+		{
+			window[(pos + lookahead) & (WindowSize - 1)] = data[i];
+			++lookahead;
+			if (lookahead == MaxMatch)
+			{
+				EncodeNext();
+			}
+		}
+	}
+}
+
+// Finish the compressed response and return it. Return nullptr if we ran out of buffers, in which case the caller should send the response uncompressed.
+OutputBuffer *GzipEncoder::Finish()
+{
+	while (lookahead != 0)
+	{
+		EncodeNext();
+	}
+	PutLiteralOrLength(256);							// end of block
+	if (numBits != 0)
+	{
+		PutBits(0, 8 - numBits);						// pad to a byte boundary
+	}
+
+	// gzip trailer: CRC and length of the uncompressed data, little endian
+	const uint32_t crcValue = crc.Get();
+	for (unsigned int i = 0; i < 32; i += 8)
+	{
+		PutByte((uint8_t)(crcValue >> i));
+	}
+	for (unsigned int i = 0; i < 32; i += 8)
+	{
+		PutByte((uint8_t)(inputLength >> i));
+	}
+	FlushBytes();
+
+	OutputBuffer *result = out;
+	out = nullptr;
+	if (result->HadOverflow())
+	{
+		OutputBuffer::ReleaseAll(result);
+	}
+	return result;
+}
+
+inline size_t GzipEncoder::Hash(uint32_t p) const
+{
+	const uint32_t sequence = ((uint32_t)window[p & (WindowSize - 1)] << 16) | ((uint32_t)window[(p + 1) & (WindowSize - 1)] << 8) | window[(p + 2) & (WindowSize - 1)];
+	return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+// Encode the byte at the start of the lookahead data, or a match starting there
+void GzipEncoder::EncodeNext()
+{
+	size_t length = 0, distance = 0;
+	if (lookahead >= MinMatch)
+	{
+		const size_t h = Hash(pos);
+		distance = (uint16_t)((uint16_t)pos - head[h]);
+		head[h] = (uint16_t)pos;
+
+		// We only have the low 16 bits of the candidate position, but we compare the data so a stale candidate just costs us a match
+		if (distance != 0 && distance <= MaxDistance && distance <= pos)
+		{
+			const size_t maxLength = min<size_t>(lookahead, MaxMatch);
+			while (length < maxLength && window[(pos - distance + length) & (WindowSize - 1)] == window[(pos + length) & (WindowSize - 1)])
+			{
+				++length;
+			}
+		}
+	}
+
+	if (length >= MinMatch)
+	{
+		PutMatch(length, distance);
+
+		// Record the positions within the match so that later data can refer to them
+		for (size_t i = 1; i < length && lookahead - i >= MinMatch; ++i)
+		{
+			head[Hash(pos + i)] = (uint16_t)(pos + i);
+		}
+		pos += length;
+		lookahead -= length;
+	}
+	else
+	{
+		PutLiteralOrLength(window[pos & (WindowSize - 1)]);
+		++pos;
+		--lookahead;
+	}
+}
+
+// Write a literal byte, end of block or length code using the fixed Huffman codes, see RFC 1951 section 3.2.6
+void GzipEncoder::PutLiteralOrLength(unsigned int code)
+{
+	if (code < 144)
+	{
+		PutHuffman(0x30 + code, 8);
+	}
+	else if (code < 256)
+	{
+		PutHuffman(0x190 + code - 144, 9);
+	}
+	else if (code < 280)
+	{
+		PutHuffman(code - 256, 7);
+	}
+	else
+	{
+		PutHuffman(0xC0 + code - 280, 8);
+	}
+}
+
+void GzipEncoder::PutMatch(size_t length, size_t distance)
+{
+	size_t lengthCode = 0;
+	while (lengthCode + 1 < ARRAY_SIZE(LengthBase) && LengthBase[lengthCode + 1] <= length)
+	{
+		++lengthCode;
+	}
+	PutLiteralOrLength(257 + lengthCode);
+	PutBits(length - LengthBase[lengthCode], LengthExtraBits[lengthCode]);
+
+	size_t distanceCode = 0;
+	while (distanceCode + 1 < ARRAY_SIZE(DistanceBase) && DistanceBase[distanceCode + 1] <= distance)
+	{
+		++distanceCode;
+	}
+	PutHuffman(distanceCode, 5);
+	PutBits(distance - DistanceBase[distanceCode], DistanceExtraBits[distanceCode]);
+}
+
+// Huffman codes are packed starting with the most significant bit, unlike all other data elements
+void GzipEncoder::PutHuffman(uint32_t code, unsigned int numCodeBits)
+{
+	uint32_t reversed = 0;
+	for (unsigned int i = 0; i < numCodeBits; ++i)
+	{
+		reversed = (reversed << 1) | (code & 1);
+		code >>= 1;
+	}
+	PutBits(reversed, numCodeBits);
+}
+
+// Data elements other than Huffman codes are packed starting with the least significant bit
+void GzipEncoder::PutBits(uint32_t bits, unsigned int numNewBits)
+{
+	bitBuffer |= bits << numBits;
+	numBits += numNewBits;
+	while (numBits >= 8)
+	{
+		PutByte((uint8_t)bitBuffer);
+		bitBuffer >>= 8;
+		numBits -= 8;
+	}
+}
+
+void GzipEncoder::PutByte(uint8_t b)
+{
+	outBytes[numOutBytes++] = (char)b;
+	if (numOutBytes == OutBytesSize)
+	{
+		FlushBytes();
+	}
+}
+
+void GzipEncoder::FlushBytes()
+{
+	out->cat(outBytes, numOutBytes);
+	numOutBytes = 0;
+}
+
+#endif
+
+// End
@@ -0,0 +1,65 @@
+/*
+ * GzipEncoder.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  Compresses HTTP responses held in output buffers into gzip format, for clients that accept gzip encoding.
+ *  To keep the memory and time needed small, this uses a single fixed-Huffman deflate block and finds matches using a hash table
+ *  that holds just the most recent position of each 3-byte sequence, searching a 1K window. JSON responses typically compress to less than half size.
+ */
+
+#ifndef SRC_NETWORKING_GZIPENCODER_H_
+#define SRC_NETWORKING_GZIPENCODER_H_
+
+#include "RepRapFirmware.h"
+
+#if SUPPORT_HTTP_GZIP
+
+#include "Storage/CRC32.h"
+
+class OutputBuffer;
+
+class GzipEncoder
+{
+public:
+	static constexpr size_t MinLength = 512;			// we don't compress responses shorter than this
+
+	GzipEncoder() : out(nullptr) { }
+
+	bool Start();										// start a new compressed response, returning false if we couldn't allocate a buffer
+	void Add(const OutputBuffer *buf);					// compress the data in a chain of output buffers
+	OutputBuffer *Finish();								// finish the compressed response and return it, or return nullptr if we ran out of buffers
+
+private:
+	static constexpr size_t WindowSize = 1024;			// must be a power of 2
+	static constexpr size_t HashBits = 9;
+	static constexpr size_t MinMatch = 3;
+	static constexpr size_t MaxMatch = 130;				// the longest match we look for, deflate allows up to 258
+	static constexpr size_t MaxDistance = WindowSize - MaxMatch;	// the window holds the data we haven't encoded yet as well as the data we can refer back to
+	static constexpr size_t OutBytesSize = 32;
+
+	size_t Hash(uint32_t p) const;
+	void EncodeNext();
+	void PutLiteralOrLength(unsigned int code);
+	void PutMatch(size_t length, size_t distance);
+	void PutHuffman(uint32_t code, unsigned int numBits);
+	void PutBits(uint32_t bits, unsigned int numBits);
+	void PutByte(uint8_t b);
+	void FlushBytes();
+
+	OutputBuffer *out;
+	CRC32 crc;
+	uint32_t inputLength;
+	uint32_t pos;										// the position in the input of the next byte to encode
+	size_t lookahead;									// the number of bytes in the window that we haven't encoded yet
+	uint32_t bitBuffer;
+	unsigned int numBits;
+	size_t numOutBytes;
+	uint16_t head[1u << HashBits];						// the low 16 bits of the most recent position of each hashed 3-byte sequence
+	uint8_t window[WindowSize];
+	char outBytes[OutBytesSize];						// output bytes waiting to be added to the output buffer
+};
+
+#endif
+
+#endif /* SRC_NETWORKING_GZIPENCODER_H_ */
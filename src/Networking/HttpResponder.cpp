@@ -9,6 +9,9 @@
 #include "Socket.h"
 #include "GCodes/GCodes.h"
 #include "PrintMonitor.h"
+#include "PerfCounters.h"
+#include "Heating/HeaterTracer.h"
+#include "Movement/MoveTracer.h"
 #include "Libraries/General/IP4String.h"
 
 #define KO_START "rr_"
@@ -43,14 +46,7 @@ bool HttpResponder::Accept(Socket *s, NetworkProtocol protocol)
 		responderState = ResponderState::reading;
 		skt = s;
 		timer = millis();
-
-		// Reset the parse state variables
-		clientPointer = 0;
-		parseState = HttpParseState::doingCommandWord;
-		numCommandWords = 0;
-		numQualKeys = 0;
-		numHeaderKeys = 0;
-		commandWords[0] = clientMessage;
+		ResetParser();
 
 		if (reprap.Debug(moduleWebserver))
 		{
@@ -61,6 +57,17 @@ bool HttpResponder::Accept(Socket *s, NetworkProtocol protocol)
 	return false;
 }
 
+// Reset the parse state variables ready to receive a new request
+void HttpResponder::ResetParser()
+{
+	clientPointer = 0;
+	parseState = HttpParseState::doingCommandWord;
+	numCommandWords = 0;
+	numQualKeys = 0;
+	numHeaderKeys = 0;
+	commandWords[0] = clientMessage;
+}
+
 // Do some work, returning true if we did anything significant
 bool HttpResponder::Spin()
 {
@@ -92,7 +99,17 @@ bool HttpResponder::Spin()
 
 			if (!skt->CanRead() || millis() - timer >= HttpReceiveTimeout)
 			{
-				ConnectionLost();
+				if (clientPointer == 0 && skt->CanRead())
+				{
+					// A persistent connection has been idle for too long, so close it tidily to free up the responder
+					skt->Close();
+					skt = nullptr;
+					responderState = ResponderState::free;
+				}
+				else
+				{
+					ConnectionLost();
+				}
 				return true;
 			}
 
@@ -107,10 +124,17 @@ bool HttpResponder::Spin()
 		(void)SendFileInfo(millis() - startedProcessingRequestAt >= MaxFileInfoGetTime);
 		return true;
 
+	case ResponderState::waitingForStatus:
+		return SendStatusWhenChanged();
+
 	case ResponderState::uploading:
 		DoUpload();
 		return true;
 
+	case ResponderState::postingGCode:
+		DoGCodePost();
+		return true;
+
 	case ResponderState::sending:
 		SendData();
 		return true;
@@ -505,6 +529,20 @@ bool HttpResponder::GetJsonResponse(const char* request, OutputBuffer *&response
 				type = 1;
 			}
 
+			// If the client passed the sequence number of the response it last received, send just the members that have changed since then.
+			// It may also ask us to wait until something has changed, which saves it polling.
+			const char * const dseqString = GetKeyValue("dseq");
+			if (dseqString != nullptr)
+			{
+				const char * const waitString = GetKeyValue("wait");
+				statusSeq = SafeStrtoul(dseqString);
+				statusWaitTime = (waitString != nullptr) ? min<uint32_t>(SafeStrtoul(waitString), MaxStatusWaitTime) : 0;
+				statusIndex = (size_t)(type - 1);
+				statusKeepOpen = CanKeepAlive();
+				responderState = ResponderState::waitingForStatus;
+				return false;
+			}
+
 			OutputBuffer::Release(response);
 			response = reprap.GetStatusResponse(type, ResponseSource::HTTP);		// this may return nullptr
 		}
@@ -515,11 +553,17 @@ bool HttpResponder::GetJsonResponse(const char* request, OutputBuffer *&response
 			response = reprap.GetLegacyStatusResponse(1, 0);
 		}
 	}
-	else if (StringEquals(request, "gcode") && GetKeyValue("gcode") != nullptr)
+	else if (StringEquals(request, "gcode") && (responderState == ResponderState::postingGCode || GetKeyValue("gcode") != nullptr))
 	{
+		// A GET request may hold several commands separated by newlines, but they must all fit in the buffer. A POST request has already been passed on.
 		NetworkGCodeInput * const httpInput = reprap.GetGCodes().GetHTTPInput();
-		httpInput->Put(HttpMessage, GetKeyValue("gcode"));
-		response->printf("{\"buff\":%u}", httpInput->BufferSpaceLeft());
+		bool ok = true;
+		if (responderState != ResponderState::postingGCode)
+		{
+			const char * const command = GetKeyValue("gcode");
+			ok = httpInput->Put(HttpMessage, command, strlen(command) + 1);
+		}
+		response->printf("{\"buff\":%u,\"err\":%d}", httpInput->BufferSpaceLeft(), (ok) ? 0 : 1);
 	}
 	else if (StringEquals(request, "upload"))
 	{
@@ -551,6 +595,15 @@ bool HttpResponder::GetJsonResponse(const char* request, OutputBuffer *&response
 		const bool flagDirs = flagDirsVal != nullptr && SafeStrtol(flagDirsVal) == 1;
 		response = reprap.GetFilesResponse(dir, startAt, flagDirs);				// this may return nullptr
 	}
+#if SUPPORT_RECENT_FILES
+	else if (StringEquals(request, "recent"))
+	{
+		OutputBuffer::Release(response);
+		const char* const maxVal = GetKeyValue("max");
+		const unsigned int maxFiles = (maxVal == nullptr) ? RecentFiles::MaxFiles : (unsigned int)SafeStrtol(maxVal);
+		response = reprap.GetRecentFilesResponse(maxFiles);						// this may return nullptr
+	}
+#endif
 	else if (StringEquals(request, "fileinfo"))
 	{
 		const char* const nameVal = GetKeyValue("name");
@@ -598,6 +651,17 @@ bool HttpResponder::GetJsonResponse(const char* request, OutputBuffer *&response
 		OutputBuffer::Release(response);
 		response = reprap.GetConfigResponse();
 	}
+	else if (StringEquals(request, "perf"))
+	{
+		// rr_perf?reset=1 returns the counters and then starts new totals
+		OutputBuffer::Release(response);
+		response = PerfCounters::GetJsonResponse();							// this may return nullptr
+		const char* const resetVal = GetKeyValue("reset");
+		if (resetVal != nullptr && SafeStrtol(resetVal) == 1)
+		{
+			PerfCounters::Reset();
+		}
+	}
 	else
 	{
 		RejectMessage("Unknown request", 500);
@@ -619,6 +683,75 @@ const char* HttpResponder::GetKeyValue(const char *key) const
 	return nullptr;
 }
 
+// Get the value of a header. Header names are not case sensitive.
+const char* HttpResponder::GetHeaderValue(const char *key) const
+{
+	for (size_t i = 0; i < numHeaderKeys; ++i)
+	{
+		if (StringEquals(headers[i].key, key))
+		{
+			return headers[i].value;
+		}
+	}
+	return nullptr;
+}
+
+// Return true if we can keep the connection open after replying to the current request.
+// We only do this for GET requests, because if we reply to any other request before reading all of it then the rest would be taken as the next request.
+bool HttpResponder::CanKeepAlive() const
+{
+	if (responderState != ResponderState::processingRequest || numCommandWords == 0 || !StringEquals(commandWords[0], "GET"))
+	{
+		return false;
+	}
+	const char * const connection = GetHeaderValue("Connection");
+	return connection != nullptr && StringEquals(connection, "keep-alive");		// comment out this line and return false to disable persistent connections
+}
+
+#if SUPPORT_HTTP_GZIP
+
+// Return true if the client accepts gzip-encoded responses
+bool HttpResponder::ClientAcceptsGzip() const
+{
+	const char * const acceptEncoding = GetHeaderValue("Accept-Encoding");
+	return acceptEncoding != nullptr && strstr(acceptEncoding, "gzip") != nullptr;
+}
+
+#endif
+
+// Return true if the client doesn't have an up-to-date copy of a web file, according to the If-None-Match or If-Modified-Since request headers
+bool HttpResponder::CheckModified(const char *eTag, time_t lastModified) const
+{
+	const char * const ifNoneMatch = GetHeaderValue("If-None-Match");
+	if (ifNoneMatch != nullptr)
+	{
+		return strstr(ifNoneMatch, eTag) == nullptr;		// the header may hold a list of ETags, possibly marked as weak
+	}
+
+	const char * const ifModifiedSince = GetHeaderValue("If-Modified-Since");
+	if (ifModifiedSince != nullptr)
+	{
+		struct tm timeInfo;
+		memset(&timeInfo, 0, sizeof(timeInfo));
+		if (strptime(ifModifiedSince, "%a, %d %b %Y %H:%M:%S", &timeInfo) != nullptr)
+		{
+			return lastModified > mktime(&timeInfo);
+		}
+	}
+	return true;
+}
+
+// Append a time to the output buffer in the format used by HTTP headers, followed by newline. We treat file times as GMT.
+void HttpResponder::AppendHttpDate(time_t time)
+{
+	static const char * const DayNames[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char * const MonthNames[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	const struct tm * const timeInfo = gmtime(&time);
+	outBuf->catf("%s, %02d %s %04d %02d:%02d:%02d GMT\n",
+					DayNames[timeInfo->tm_wday], timeInfo->tm_mday, MonthNames[timeInfo->tm_mon], timeInfo->tm_year + 1900,
+					timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
+}
+
 // Called to process a FileInfo request, which may take several calls
 // Return true if complete
 bool HttpResponder::SendFileInfo(bool quitEarly)
@@ -715,6 +848,7 @@ void HttpResponder::SendFile(const char* nameOfFileToSend, bool isWebFile)
 {
 	FileStore *fileToSend = nullptr;
 	bool zip = false;
+	String<MaxFilenameLength> nameOfFileOpened;
 
 	if (isWebFile)
 	{
@@ -727,30 +861,39 @@ void HttpResponder::SendFile(const char* nameOfFileToSend, bool isWebFile)
 			}
 		}
 
+		// Find out which versions of the file exist, so that we don't need to try to open versions that don't exist
+		bool tryGzip = true, tryPlain = true;
+#if SUPPORT_WEB_FILE_TABLE
+		const unsigned int variants = GetPlatform().GetMassStorage()->FindWebFile(nameOfFileToSend);
+		tryGzip = (variants & WebFileTable::GzipFileExists) != 0;
+		tryPlain = (variants & WebFileTable::PlainFileExists) != 0;
+#endif
+
 		// Try to open a gzipped version of the file first
-		if (!StringEndsWith(nameOfFileToSend, ".gz") && strlen(nameOfFileToSend) + 3 <= MaxFilenameLength)
+		if (tryGzip && !StringEndsWith(nameOfFileToSend, ".gz") && strlen(nameOfFileToSend) + 3 <= MaxFilenameLength)
 		{
 			String<MaxFilenameLength> nameBuf;
 			nameBuf.copy(nameOfFileToSend);
 			nameBuf.cat(".gz");
-			fileToSend = GetPlatform().OpenFile(GetPlatform().GetWebDir(), nameBuf.c_str(), OpenMode::read);
+			fileToSend = GetPlatform().OpenFile(GetPlatform().GetWebDir(), nameBuf.c_str(), OpenMode::read, true);
 			if (fileToSend != nullptr)
 			{
 				zip = true;
+				nameOfFileOpened.copy(nameBuf.c_str());
 			}
 		}
 
 		// If that failed, try to open the normal version of the file
-		if (fileToSend == nullptr)
+		if (fileToSend == nullptr && tryPlain)
 		{
-			fileToSend = GetPlatform().OpenFile(GetPlatform().GetWebDir(), nameOfFileToSend, OpenMode::read);
+			fileToSend = GetPlatform().OpenFile(GetPlatform().GetWebDir(), nameOfFileToSend, OpenMode::read, true);
 		}
 
 		// If we still couldn't find the file and it was an HTML file, return the 404 error page
 		if (fileToSend == nullptr && (StringEndsWith(nameOfFileToSend, ".html") || StringEndsWith(nameOfFileToSend, ".htm")))
 		{
 			nameOfFileToSend = FOUR04_PAGE_FILE;
-			fileToSend = GetPlatform().OpenFile(GetPlatform().GetWebDir(), nameOfFileToSend, OpenMode::read);
+			fileToSend = GetPlatform().OpenFile(GetPlatform().GetWebDir(), nameOfFileToSend, OpenMode::read, true);
 		}
 
 		if (fileToSend == nullptr)
@@ -758,7 +901,32 @@ void HttpResponder::SendFile(const char* nameOfFileToSend, bool isWebFile)
 			RejectMessage("page not found", 404);
 			return;
 		}
+		if (!zip)
+		{
+			nameOfFileOpened.copy(nameOfFileToSend);
+		}
+
+		// Web files change rarely, so let the browser cache them and check that its copy is still current using the ETag or the modification time.
+		// The ETag is derived from the size and modification time of the file.
+		const time_t lastModified = GetPlatform().GetMassStorage()->GetLastModifiedTime(GetPlatform().GetWebDir(), nameOfFileOpened.c_str());
+		String<ETagLength> eTag;
+		eTag.printf("\"%" PRIx32 "-%" PRIx32 "\"", (uint32_t)fileToSend->Length(), (uint32_t)lastModified);
+		if (lastModified != 0 && !CheckModified(eTag.c_str(), lastModified))
+		{
+			fileToSend->Close();
+			const bool keepOpen = CanKeepAlive();
+			outBuf->printf("HTTP/1.1 304 Not Modified\nETag: %s\nCache-Control: no-cache\nConnection: %s\n\n", eTag.c_str(), (keepOpen) ? "keep-alive" : "close");
+			Commit((keepOpen) ? ResponderState::reading : ResponderState::free);
+			return;
+		}
+
 		fileBeingSent = fileToSend;
+		outBuf->copy("HTTP/1.1 200 OK\n");
+		if (lastModified != 0)
+		{
+			outBuf->catf("Cache-Control: no-cache\nETag: %s\nLast-Modified: ", eTag.c_str());
+			AppendHttpDate(lastModified);
+		}
 	}
 	else
 	{
@@ -769,14 +937,10 @@ void HttpResponder::SendFile(const char* nameOfFileToSend, bool isWebFile)
 			return;
 		}
 		fileBeingSent = fileToSend;
-	}
-
-	outBuf->copy("HTTP/1.1 200 OK\n");
 
-	// Don't cache files served by rr_download
-	if (!isWebFile)
-	{
-		outBuf->cat(	"Cache-Control: no-cache, no-store, must-revalidate\n"
+		// Don't cache files served by rr_download
+		outBuf->copy(	"HTTP/1.1 200 OK\n"
+						"Cache-Control: no-cache, no-store, must-revalidate\n"
 						"Pragma: no-cache\n"
 						"Expires: 0\n"
 						"Access-Control-Allow-Origin: *\n"
@@ -819,23 +983,41 @@ void HttpResponder::SendFile(const char* nameOfFileToSend, bool isWebFile)
 	}
 	outBuf->catf("Content-Type: %s\n", contentType);
 
-	if (zip && fileToSend != nullptr)
+	if (zip)
 	{
 		outBuf->cat("Content-Encoding: gzip\n");
-		outBuf->catf("Content-Length: %lu\n", fileToSend->Length());
 	}
 
-	outBuf->cat("Connection: close\n\n");
-	Commit();
+	// We always send the length, so that the client can tell where the file ends if we keep the connection open
+	const bool keepOpen = CanKeepAlive();
+	outBuf->catf("Content-Length: %lu\n", fileToSend->Length());
+	outBuf->catf("Connection: %s\n\n", (keepOpen) ? "keep-alive" : "close");
+	Commit((keepOpen) ? ResponderState::reading : ResponderState::free);
 }
 
 void HttpResponder::SendGCodeReply()
 {
+	const bool keepOpen = CanKeepAlive();
 	{
 		// Do we need to keep the G-Code reply for other clients?
 		bool clearReply = false;
 		MutexLocker Lock(gcodeReplyMutex);
 
+#if SUPPORT_HTTP_GZIP
+		// If the reply is long and the client accepts it, send this client its own compressed copy of the reply instead of the shared buffers
+		OutputBuffer *compressed = nullptr;
+		if (gcodeReply.DataLength() >= GzipEncoder::MinLength && ClientAcceptsGzip() && gzipEncoder.Start())
+		{
+			for (size_t i = 0; gcodeReply.GetItem(i) != nullptr; ++i)
+			{
+				gzipEncoder.Add(gcodeReply.GetItem(i));
+			}
+			compressed = gzipEncoder.Finish();
+		}
+#else
+		OutputBuffer * const compressed = nullptr;
+#endif
+
 		if (!gcodeReply.IsEmpty())
 		{
 			clientsServed++;
@@ -843,7 +1025,10 @@ void HttpResponder::SendGCodeReply()
 			{
 				// Yes - make sure the Network class doesn't discard its buffers yet
 				// NB: This must happen here, because NetworkTransaction::Write() might already release OutputBuffers
-				gcodeReply.IncreaseReferences(1);
+				if (compressed == nullptr)
+				{
+					gcodeReply.IncreaseReferences(1);
+				}
 			}
 			else
 			{
@@ -865,18 +1050,34 @@ void HttpResponder::SendGCodeReply()
 						"Access-Control-Allow-Origin: *\n"
 						"Content-Type: text/plain\n"
 					);
-		outBuf->catf("Content-Length: %u\n", gcodeReply.DataLength());
-		outBuf->cat("Connection: close\n\n");
-		outStack.Append(gcodeReply);
+		if (compressed != nullptr)
+		{
+			outBuf->cat("Content-Encoding: gzip\n");
+			outBuf->catf("Content-Length: %u\n", compressed->Length());
+			outBuf->catf("Connection: %s\n\n", (keepOpen) ? "keep-alive" : "close");
+			outBuf->Append(compressed);
 
-		// Possibly clean up the G-code reply once again
-		if (clearReply)
+			// We didn't send the shared buffers, so we must release them ourselves if no other client needs them
+			if (clearReply)
+			{
+				gcodeReply.ReleaseAll();
+			}
+		}
+		else
 		{
-			gcodeReply.Clear();
+			outBuf->catf("Content-Length: %u\n", gcodeReply.DataLength());
+			outBuf->catf("Connection: %s\n\n", (keepOpen) ? "keep-alive" : "close");
+			outStack.Append(gcodeReply);
+
+			// Possibly clean up the G-code reply once again
+			if (clearReply)
+			{
+				gcodeReply.Clear();
+			}
 		}
 	}
 
-	Commit();
+	Commit((keepOpen) ? ResponderState::reading : ResponderState::free);
 }
 
 void HttpResponder::SendJsonResponse(const char* command)
@@ -913,6 +1114,53 @@ void HttpResponder::SendJsonResponse(const char* command)
 				return;
 			}
 		}
+
+#if SUPPORT_HEATER_TRACE
+		if (StringEquals(command, "heatertrace"))	// rr_heatertrace?heater=N sends the heater trace in binary form, see HeaterTracer.h for the format
+		{
+			const char * const heaterString = GetKeyValue("heater");
+			if (heaterString != nullptr)
+			{
+				const uint32_t heater = SafeStrtoul(heaterString);
+				OutputBuffer *traceResponse;
+				if (!OutputBuffer::Allocate(traceResponse))
+				{
+					CheckOutputBufferWait();
+					return;
+				}
+				if (heater < Heaters && HeaterTracer::GetBinaryTrace(heater, traceResponse) && !traceResponse->HadOverflow())
+				{
+					if (!SendJsonReply(traceResponse, CanKeepAlive(), "application/octet-stream"))
+					{
+						CheckOutputBufferWait();
+					}
+					return;
+				}
+				OutputBuffer::ReleaseAll(traceResponse);
+			}
+		}
+#endif
+
+#if SUPPORT_MOVE_TRACE
+		if (StringEquals(command, "movetrace"))		// rr_movetrace sends the most recent executed moves in binary form, see MoveTracer.h for the format
+		{
+			OutputBuffer *traceResponse;
+			if (!OutputBuffer::Allocate(traceResponse))
+			{
+				CheckOutputBufferWait();
+				return;
+			}
+			if (MoveTracer::GetBinaryTrace(traceResponse) && !traceResponse->HadOverflow())
+			{
+				if (!SendJsonReply(traceResponse, CanKeepAlive(), "application/octet-stream"))
+				{
+					CheckOutputBufferWait();
+				}
+				return;
+			}
+			OutputBuffer::ReleaseAll(traceResponse);
+		}
+#endif
 	}
 
 	// Try to process a request for JSON responses
@@ -934,83 +1182,136 @@ void HttpResponder::SendJsonResponse(const char* command)
 		}
 	}
 
-	if (jsonResponse == nullptr)
-	{
-		// We ran out of buffers at some point.
-		// Unfortunately the protocol is prone to deadlocking, because if most output buffer are used up holding a GCode reply,
-		// there may be insufficient buffers left to compose the status response to tell DWC that it needs to fetch that GCode reply.
-		// Until we fix the protocol, the best we can do is time out and throw the GCode response away.
-		if (millis() - startedProcessingRequestAt >= MaxBufferWaitTime)
-		{
-			{
-				MutexLocker lock(gcodeReplyMutex);
-				OutputBuffer *buf = gcodeReply.Pop();
-				OutputBuffer::ReleaseAll(buf);
-			}
-			ReportOutputBufferExhaustion(__FILE__, __LINE__);
-		}
-		return;
-	}
-
-	// Send the JSON response
-	bool keepOpen = false;
-	if (mayKeepOpen)
+	if (jsonResponse == nullptr || !SendJsonReply(jsonResponse, mayKeepOpen && CanKeepAlive()))		// check that the browser wants to persist the connection too
 	{
-		// Check that the browser wants to persist the connection too
-		for (size_t i = 0; i < numHeaderKeys; ++i)
-		{
-			if (StringEquals(headers[i].key, "Connection"))
-			{
-				// Comment out the following line to disable persistent connections
-				keepOpen = StringEquals(headers[i].value, "keep-alive");
-				break;
-			}
-		}
+		CheckOutputBufferWait();
 	}
+}
 
+// Send a JSON response, or some other response that has been built in output buffers, with its HTTP headers, returning true if we committed it.
+// If we ran out of buffers then release the response and our output buffer and return false, and the caller must try again later.
+bool HttpResponder::SendJsonReply(OutputBuffer *jsonResponse, bool keepOpen, const char *contentType)
+{
 	// Note that when using RTOS the following response should preferably be small enough to fit in a single buffer.
 	// This is because the current task may get suspended e.g. when reading from SD card to build a file list,
 	// so other tasks may allocate buffers meanwhile, and the previous mechanism for ensuring that there is sufficient
 	// buffer space remaining don't work.
-	// This response is currently about 230 bytes long in the worst case.
+	// This response is currently about 255 bytes long in the worst case.
 	outBuf->copy(	"HTTP/1.1 200 OK\n"
 					"Cache-Control: no-cache, no-store, must-revalidate\n"
 					"Pragma: no-cache\n"
 					"Expires: 0\n"
 					"Access-Control-Allow-Origin: *\n"
-					"Content-Type: application/json\n"
 				);
-	const unsigned int replyLength = (jsonResponse != nullptr) ? jsonResponse->Length() : 0;
+	outBuf->catf("Content-Type: %s\n", contentType);
+#if SUPPORT_HTTP_GZIP
+	// Compress large responses if the client accepts it. If we run out of buffers while compressing, send the response uncompressed.
+	if (jsonResponse->Length() >= GzipEncoder::MinLength && ClientAcceptsGzip() && gzipEncoder.Start())
+	{
+		gzipEncoder.Add(jsonResponse);
+		OutputBuffer *compressed = gzipEncoder.Finish();
+		if (compressed != nullptr && compressed->Length() < jsonResponse->Length())
+		{
+			OutputBuffer::ReleaseAll(jsonResponse);
+			jsonResponse = compressed;
+			outBuf->cat("Content-Encoding: gzip\n");
+		}
+		else
+		{
+			OutputBuffer::ReleaseAll(compressed);
+		}
+	}
+#endif
+	const unsigned int replyLength = jsonResponse->Length();
 	outBuf->catf("Content-Length: %u\n", replyLength);
 	outBuf->catf("Connection: %s\n\n", keepOpen ? "keep-alive" : "close");
 	outBuf->Append(jsonResponse);
 
 	if (outBuf->HadOverflow())
 	{
-		// We ran out of buffers. Release the buffers we have and return false. The caller will retry later.
 		OutputBuffer::ReleaseAll(outBuf);
-		// We ran out of buffers at some point.
-		// Unfortunately the protocol is prone to deadlocking, because if most output buffer are used up holding a GCode reply,
-		// there may be insufficient buffers left to compose the status response to tell DWC that it needs to fetch that GCode reply.
-		// Until we fix the protocol, the best we can do is time out and throw the GCode response away.
-		if (millis() - startedProcessingRequestAt >= MaxBufferWaitTime)
+		return false;
+	}
+
+	Commit(keepOpen ? ResponderState::reading : ResponderState::free, false);
+	if (reprap.Debug(moduleWebserver))
+	{
+		debugPrintf("Sending JSON reply, length %u\n", replyLength);
+	}
+	return true;
+}
+
+// We ran out of buffers at some point.
+// Unfortunately the protocol is prone to deadlocking, because if most output buffer are used up holding a GCode reply,
+// there may be insufficient buffers left to compose the status response to tell DWC that it needs to fetch that GCode reply.
+// Until we fix the protocol, the best we can do is time out and throw the GCode response away.
+void HttpResponder::CheckOutputBufferWait()
+{
+	if (millis() - startedProcessingRequestAt >= MaxBufferWaitTime)
+	{
 		{
-			{
-				MutexLocker lock(gcodeReplyMutex);
-				OutputBuffer *buf = gcodeReply.Pop();
-				OutputBuffer::ReleaseAll(buf);
-			}
-			ReportOutputBufferExhaustion(__FILE__, __LINE__);
+			MutexLocker lock(gcodeReplyMutex);
+			OutputBuffer *buf = gcodeReply.Pop();
+			OutputBuffer::ReleaseAll(buf);
 		}
+		ReportOutputBufferExhaustion(__FILE__, __LINE__);
 	}
-	else
+}
+
+// Send a status response to a client that passed the sequence number of the last one it received, as soon as there is a newer one or its wait time expires.
+// All such clients share the same status response, which we generate at most once per StatusRefreshInterval. Each client gets its own copy or delta of it,
+// because responders sending the same output buffer at the same time would interfere with each other.
+bool HttpResponder::SendStatusWhenChanged()
+{
+	if (!skt->CanRead())
 	{
-		Commit(keepOpen ? ResponderState::reading : ResponderState::free, false);
-		if (reprap.Debug(moduleWebserver))
+		ConnectionLost();						// the client has gone away
+		return true;
+	}
+
+	bool refreshed = false;
+	if (statusResponses[statusIndex] == nullptr || millis() - statusResponseTimes[statusIndex] >= StatusRefreshInterval)
+	{
+		refreshed = RefreshStatusResponse(statusIndex);
+	}
+
+	const OutputBuffer * const response = statusResponses[statusIndex];
+	const bool timedOut = millis() - startedProcessingRequestAt >= statusWaitTime;
+	if (timedOut || (response != nullptr && statusDeltas[statusIndex].GetSeq() != statusSeq))
+	{
+		if (response != nullptr && (outBuf != nullptr || OutputBuffer::Allocate(outBuf)))
+		{
+			OutputBuffer * const reply = statusDeltas[statusIndex].MakeResponse(response, statusSeq);
+			if (reply != nullptr && SendJsonReply(reply, statusKeepOpen))
+			{
+				return true;
+			}
+		}
+
+		// We ran out of buffers, so measure how long we wait for them from now instead of from when the client started waiting
+		if (statusWaitTime != 0)
 		{
-			debugPrintf("Sending JSON reply, length %u\n", replyLength);
+			statusWaitTime = 0;
+			startedProcessingRequestAt = millis();
 		}
+		CheckOutputBufferWait();
+	}
+	return refreshed;
+}
+
+// Generate a new shared status response, returning true if we succeeded
+/*static*/ bool HttpResponder::RefreshStatusResponse(size_t index)
+{
+	OutputBuffer::ReleaseAll(statusResponses[index]);		// release the old one first to make buffers available, and because StatusDelta only knows about the latest one
+	OutputBuffer *response = reprap.GetStatusResponse(index + 1, ResponseSource::HTTP);
+	if (response == nullptr || response->HadOverflow() || !statusDeltas[index].Update(response))
+	{
+		OutputBuffer::ReleaseAll(response);
+		return false;
 	}
+	statusResponses[index] = response;
+	statusResponseTimes[index] = millis();
+	return true;
 }
 
 // Process the message received. We have reached the end of the headers.
@@ -1033,6 +1334,7 @@ void HttpResponder::ProcessMessage()
 		p.Message(UsbMessage, " }\n");
 	}
 
+	++numRequests;
 	responderState = ResponderState::processingRequest;
 	startedProcessingRequestAt = millis();
 }
@@ -1092,6 +1394,24 @@ void HttpResponder::ProcessRequest()
 
 		if (CheckAuthenticated() && StringEquals(commandWords[0], "POST"))
 		{
+			const bool isGCodeRequest = (StringEquals(commandWords[1], KO_START "gcode"))
+									 || (commandWords[1][0] == '/' && StringEquals(commandWords[1] + 1, KO_START "gcode"));
+			if (isGCodeRequest)
+			{
+				// The body is a batch of G-code commands separated by newlines
+				const char * const contentLength = GetHeaderValue("Content-Length");
+				if (contentLength == nullptr)
+				{
+					RejectMessage("invalid POST gcode request");
+					return;
+				}
+				postFileLength = SafeStrtoul(contentLength);
+				uploadedBytes = 0;
+				timer = millis();
+				responderState = ResponderState::postingGCode;
+				return;
+			}
+
 			const bool isUploadRequest = (StringEquals(commandWords[1], KO_START "upload"))
 									  || (commandWords[1][0] == '/' && StringEquals(commandWords[1] + 1, KO_START "upload"));
 			if (isUploadRequest)
@@ -1126,6 +1446,7 @@ void HttpResponder::ProcessRequest()
 						return;
 
 					}
+					(void)file->Preallocate(postFileLength);
 					StartUpload(file, filename);
 
 					// Try to get the last modified file date and time
@@ -1169,7 +1490,7 @@ void HttpResponder::ProcessRequest()
 					return;
 				}
 			}
-			RejectMessage("only rr_upload is supported for POST requests");
+			RejectMessage("only rr_upload and rr_gcode are supported for POST requests");
 		}
 		else
 		{
@@ -1193,9 +1514,12 @@ void HttpResponder::RejectMessage(const char* response, unsigned int code)
 
 	if (outBuf != nullptr || OutputBuffer::Allocate(outBuf))
 	{
-		outBuf->printf("HTTP/1.1 %u %s\nConnection: close\n\n", code, response);
+		// If we have parsed the whole request then we can keep the connection open, otherwise the rest of the request would be taken as the next request
+		const bool keepOpen = CanKeepAlive();
+		outBuf->printf("HTTP/1.1 %u %s\nContent-Length: %u\nConnection: %s\n\n",
+						code, response, (unsigned int)(strlen(ErrorPagePart1) + strlen(response) + strlen(ErrorPagePart2)), (keepOpen) ? "keep-alive" : "close");
 		outBuf->catf("%s%s%s", ErrorPagePart1, response, ErrorPagePart2);
-		Commit();
+		Commit((keepOpen) ? ResponderState::reading : ResponderState::free);
 	}
 	else
 	{
@@ -1206,26 +1530,34 @@ void HttpResponder::RejectMessage(const char* response, unsigned int code)
 
 // This function overrides the one in class NetworkResponder.
 // It tries to process a chunk of uploaded data and changes the state if finished.
+// Write uploaded data to the file.
+// We take all the data that the socket has received each time we are called, because each network buffer often holds just one TCP segment.
+// The file's write buffer collects the data into whole sectors, so the card sees large aligned writes. While we are writing to the card
+// the network interface isn't polled, and when it is polled it only accepts as much data as it has free network buffers for. The rest stays
+// in the interface, which closes the TCP receive window and stops the client sending data faster than the card can accept it.
 void HttpResponder::DoUpload()
 {
 	const uint8_t *buffer;
 	size_t len;
 	if (skt->ReadBuffer(buffer, len))
 	{
-		skt->Taken(len);
-		uploadedBytes += len;
-
 		(void)CheckAuthenticated();							// uploading may take a long time, so make sure the requester IP is not timed out
-		timer = millis();									// reset the timer
-
-		if (!fileBeingUploaded.Write(buffer, len))
+		do
 		{
-			uploadError = true;
-			GetPlatform().Message(ErrorMessage, "Could not write upload data!\n");
-			CancelUpload();
-			SendJsonResponse("upload");
-			return;
-		}
+			if (!fileBeingUploaded.Write(buffer, len))
+			{
+				skt->Taken(len);
+				uploadError = true;
+				GetPlatform().Message(ErrorMessage, "Could not write upload data!\n");
+				CancelUpload();
+				SendJsonResponse("upload");
+				return;
+			}
+			ScanUploadData(buffer, len);
+			skt->Taken(len);
+			uploadedBytes += len;
+		} while (uploadedBytes < postFileLength && skt->ReadBuffer(buffer, len));
+		timer = millis();									// reset the timer
 	}
 	else if (!skt->CanRead() || millis() - timer >= HttpSessionTimeout)
 	{
@@ -1254,6 +1586,42 @@ void HttpResponder::DoUpload()
 	}
 }
 
+// Pass the body of a POST rr_gcode request to the HTTP G-code input.
+// We only take as much data from the socket as the G-code input has room for. The rest stays in the network interface, which closes the
+// TCP receive window and stops the client sending commands faster than we execute them. So a client can send a long batch of commands
+// in a single request, instead of making a request for each command and polling the buffer space between them.
+void HttpResponder::DoGCodePost()
+{
+	NetworkGCodeInput * const httpInput = reprap.GetGCodes().GetHTTPInput();
+	if (uploadedBytes < postFileLength)
+	{
+		const uint8_t *buffer;
+		size_t len;
+		if (skt->ReadBuffer(buffer, len))
+		{
+			(void)CheckAuthenticated();						// the commands may take a long time to execute, so make sure the requester IP is not timed out
+			len = min<size_t>(min<size_t>(len, postFileLength - uploadedBytes), httpInput->BufferSpaceLeft());
+			if (len != 0 && httpInput->Put(HttpMessage, reinterpret_cast<const char*>(buffer), len))
+			{
+				skt->Taken(len);
+				uploadedBytes += len;
+			}
+			timer = millis();								// waiting for buffer space is not a timeout
+		}
+		else if (!skt->CanRead() || millis() - timer >= HttpSessionTimeout)
+		{
+			ConnectionLost();
+			return;
+		}
+	}
+
+	// When we have passed on the whole batch, terminate the last command in case the client didn't end it with a newline
+	if (uploadedBytes >= postFileLength && httpInput->Put(HttpMessage, "", 1))
+	{
+		SendJsonResponse("gcode");
+	}
+}
+
 // This is called to force termination if we implement the specified protocol
 void HttpResponder::Terminate(NetworkProtocol protocol)
 {
@@ -1288,6 +1656,7 @@ void HttpResponder::SendData()
 	if (responderState == ResponderState::reading)
 	{
 		timer = millis();				// restart the timer
+		ResetParser();					// the connection is persistent, so get ready for the next request, which the client may already have sent
 	}
 }
 
@@ -1367,6 +1736,15 @@ void HttpResponder::Diagnostics(MessageType mt) const
 		}
 	}
 
+	// Release shared status responses that are too old to be sent again, to free up buffers
+	for (size_t i = 0; i < ARRAY_SIZE(statusResponses); ++i)
+	{
+		if (statusResponses[i] != nullptr && now - statusResponseTimes[i] >= StatusRefreshInterval)
+		{
+			OutputBuffer::ReleaseAll(statusResponses[i]);
+		}
+	}
+
 	// If we cannot send the G-Code reply to anyone, we may free up some run-time space by dumping it
 	if (clientsTimedOut != 0)
 	{
@@ -1399,9 +1777,17 @@ void HttpResponder::Diagnostics(MessageType mt) const
 HttpResponder::HttpSession HttpResponder::sessions[MaxHttpSessions];
 unsigned int HttpResponder::numSessions = 0;
 unsigned int HttpResponder::clientsServed = 0;
+uint32_t HttpResponder::numRequests = 0;
 
 volatile uint32_t HttpResponder::seq = 0;
 volatile OutputStack HttpResponder::gcodeReply;
 Mutex HttpResponder::gcodeReplyMutex;
+StatusDelta HttpResponder::statusDeltas[3];
+OutputBuffer *HttpResponder::statusResponses[3] = { nullptr, nullptr, nullptr };
+uint32_t HttpResponder::statusResponseTimes[3];
+
+#if SUPPORT_HTTP_GZIP
+GzipEncoder HttpResponder::gzipEncoder;
+#endif
 
 // End
@@ -9,6 +9,8 @@
 #define SRC_NETWORKING_HTTPRESPONDER_H_
 
 #include "NetworkResponder.h"
+#include "StatusDelta.h"
+#include "GzipEncoder.h"
 
 class HttpResponder : public NetworkResponder
 {
@@ -23,6 +25,7 @@ public:
 	static void HandleGCodeReply(const char *reply);
 	static void HandleGCodeReply(OutputBuffer *reply);
 	static uint32_t GetReplySeq() { return seq; }
+	static uint32_t GetNumRequests() { return numRequests; }
 	static void CheckSessions();
 	static void CommonDiagnostics(MessageType mtype);
 
@@ -39,6 +42,9 @@ private:
 	static const uint32_t HttpSessionTimeout = 8000;	// HTTP session timeout in milliseconds
 	static const uint32_t MaxFileInfoGetTime = 2000;	// maximum length of time we spend getting file info, to avoid the client timing out (actual time will be a little longer than this)
 	static const uint32_t MaxBufferWaitTime = 1000;		// maximum length of time we spend waiting for a buffer before we discard gcodeReply buffers
+	static const size_t ETagLength = 20;				// enough for two 32-bit hex numbers separated by a dash, in quotes
+	static const uint32_t StatusRefreshInterval = 200;	// minimum interval between generating the status responses that clients using sequence numbers share
+	static const uint32_t MaxStatusWaitTime = 5000;		// maximum length of time a client may ask us to wait for the status to change
 
 	enum class HttpParseState
 	{
@@ -79,15 +85,28 @@ private:
 	void SendFile(const char* nameOfFileToSend, bool isWebFile);
 	void SendGCodeReply();
 	void SendJsonResponse(const char* command);
+	bool SendJsonReply(OutputBuffer *jsonResponse, bool keepOpen, const char *contentType = "application/json");
+	bool SendStatusWhenChanged();
+	void CheckOutputBufferWait();
+	static bool RefreshStatusResponse(size_t index);
 	bool GetJsonResponse(const char* request, OutputBuffer *&response, bool& keepOpen);
 	void ProcessMessage();
 	void ProcessRequest();
 	void RejectMessage(const char* s, unsigned int code = 500);
 	bool SendFileInfo(bool quitEarly);
+	bool CheckModified(const char *eTag, time_t lastModified) const;
+	void AppendHttpDate(time_t time);
 
 	void DoUpload();
+	void DoGCodePost();
 
 	const char* GetKeyValue(const char *key) const;	// return the value of the specified key, or nullptr if not present
+	const char* GetHeaderValue(const char *key) const;	// return the value of the specified header, or nullptr if not present
+	bool CanKeepAlive() const;						// return true if we can keep the connection open after replying to the current request
+#if SUPPORT_HTTP_GZIP
+	bool ClientAcceptsGzip() const;					// return true if the client accepts gzip-encoded responses
+#endif
+	void ResetParser();
 
 	HttpParseState parseState;
 
@@ -108,15 +127,31 @@ private:
 	uint32_t startedProcessingRequestAt;			// when we started processing the current HTTP request
 	char filenameBeingProcessed[MaxFilenameLength];	// The filename being processed (for rr_fileinfo)
 
+	// rr_status requests that wait for the status to change
+	uint32_t statusSeq;								// the sequence number of the status response the client already has
+	uint32_t statusWaitTime;						// how long the client is prepared to wait for a newer one, in milliseconds
+	size_t statusIndex;								// the status response type requested, minus one
+	bool statusKeepOpen;							// whether to keep the connection open after sending the response
+
 	// Keeping track of HTTP sessions
 	static HttpSession sessions[MaxHttpSessions];
 	static unsigned int numSessions;
 	static unsigned int clientsServed;
+	static uint32_t numRequests;					// total number of HTTP requests received, never reset
 
 	// Responses from GCodes class
 	static volatile uint32_t seq;					// Sequence number for G-Code replies
 	static volatile OutputStack gcodeReply;
 	static Mutex gcodeReplyMutex;
+
+	// Status responses of types 1 to 3 shared by the clients that use sequence numbers
+	static StatusDelta statusDeltas[3];				// records of the status responses, used to send only the changes
+	static OutputBuffer *statusResponses[3];		// the most recent status responses
+	static uint32_t statusResponseTimes[3];			// when we generated them
+
+#if SUPPORT_HTTP_GZIP
+	static GzipEncoder gzipEncoder;					// shared by all responders because they all run in the network task
+#endif
 };
 
 #endif /* SRC_NETWORKING_HTTPRESPONDER_H_ */
@@ -45,6 +45,19 @@
 /* Include ethernet configuration first */
 #include "conf_eth.h"
 
+/**
+ * LWIP_HIGH_THROUGHPUT==1: Use larger TCP windows and send buffers, and the extra heap,
+ * segments and pool buffers they need. This costs about 40K of RAM, so it is only the
+ * default on the SAME70.
+ */
+#ifndef LWIP_HIGH_THROUGHPUT
+# ifdef __SAME70Q21__
+#  define LWIP_HIGH_THROUGHPUT		1
+# else
+#  define LWIP_HIGH_THROUGHPUT		0
+# endif
+#endif
+
 /*
    -----------------------------------------------
    -------------- LwIP API Support ---------------
@@ -101,7 +114,11 @@
  * MEM_SIZE: the size of the heap memory. If the application will send
  * a lot of data that needs to be copied, this should be set high.
  */
+#if LWIP_HIGH_THROUGHPUT
+#define MEM_SIZE                		32768		// enough for the send buffers of a few busy connections
+#else
 #define MEM_SIZE                		12288		// 8192 works too but then lwip reports mem errors. sadly "max" isn't working
+#endif
 
 /**
  * MEMP_NUM_UDP_PCB: the number of UDP protocol control blocks. One
@@ -126,7 +143,11 @@
  * MEMP_NUM_TCP_SEG: the number of simultaneously queued TCP segments.
  * (requires the LWIP_TCP option)
  */
+#if LWIP_HIGH_THROUGHPUT
+#define MEMP_NUM_TCP_SEG                32			// must be at least TCP_SND_QUEUELEN
+#else
 #define MEMP_NUM_TCP_SEG                8
+#endif
 
 /**
  * MEMP_NUM_REASSDATA: the number of IP packets simultaneously queued for
@@ -165,7 +186,11 @@
 /**
  * PBUF_POOL_SIZE: the number of buffers in the pbuf pool.
  */
+#if LWIP_HIGH_THROUGHPUT
+#define PBUF_POOL_SIZE                  (GMAC_RX_BUFFERS + 12)		// enough to hold a full receive window
+#else
 #define PBUF_POOL_SIZE                  (GMAC_RX_BUFFERS + 4)
+#endif
 
 /**
  * PBUF_POOL_BUFSIZE: the size of each pbuf in the pbuf pool.
@@ -235,13 +260,21 @@ extern uint32_t trueRandom(void);
  * TCP_WND: The size of a TCP window.  This must be at least
  * (2 * TCP_MSS) for things to work well
  */
+#if LWIP_HIGH_THROUGHPUT
+#define TCP_WND                 (8 * TCP_MSS)
+#else
 #define TCP_WND                 (2 * TCP_MSS)
+#endif
 
 /**
  * TCP_SND_BUF: TCP sender buffer space (bytes).
  * To achieve good performance, this should be at least 2 * TCP_MSS.
  */
+#if LWIP_HIGH_THROUGHPUT
+#define TCP_SND_BUF             (8 * TCP_MSS)
+#else
 #define TCP_SND_BUF             (2 * TCP_MSS)
+#endif
 
 /**
  * TCP_SND_QUEUELEN: TCP sender buffer space (pbufs). This must be at least
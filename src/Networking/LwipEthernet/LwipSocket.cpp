@@ -400,6 +400,19 @@ void LwipSocket::DiscardReceivedData()
 
 // Send the data, returning the length buffered
 size_t LwipSocket::Send(const uint8_t *data, size_t length)
+{
+	return SendData(data, length, TCP_WRITE_FLAG_MORE);
+}
+
+// Send the last data of a reply, returning the length buffered. This is the only data we send with the PSH flag.
+size_t LwipSocket::SendAndPush(const uint8_t *data, size_t length)
+{
+	return SendData(data, length, 0);
+}
+
+// Send some data, returning the length buffered.
+// The data is copied, because the caller releases or reuses its buffer as soon as we return, but lwip may need to retransmit the data until it is acknowledged.
+size_t LwipSocket::SendData(const uint8_t *data, size_t length, u8_t apiFlags)
 {
 	// This is always called outside the EthernetInterface::Spin method. Wait for pending ISRs to finish
 	while (!LockLWIP()) { }
@@ -425,7 +438,7 @@ size_t LwipSocket::Send(const uint8_t *data, size_t length)
 		err_t err;
 		do
 		{
-			err = tcp_write(connectionPcb, data, bytesToSend, 0);
+			err = tcp_write(connectionPcb, data, bytesToSend, apiFlags | TCP_WRITE_FLAG_COPY);
 			if (ERR_IS_FATAL(err))
 			{
 				Terminate();
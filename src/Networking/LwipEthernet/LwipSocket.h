@@ -44,6 +44,7 @@ public:
 	bool CanRead() const override;
 	bool CanSend() const override;
 	size_t Send(const uint8_t *data, size_t length) override;
+	size_t SendAndPush(const uint8_t *data, size_t length) override;
 	void Send() override { }
 
 private:
@@ -60,6 +61,7 @@ private:
 
 	void ReInit();
 	void DiscardReceivedData();
+	size_t SendData(const uint8_t *data, size_t length, u8_t apiFlags);
 
 	uint32_t whenConnected;
 	uint32_t whenWritten;
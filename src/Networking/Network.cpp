@@ -27,6 +27,7 @@
 #include "Platform.h"
 #include "RepRap.h"
 #include "HttpResponder.h"
+#include "GCodes/GCodeBuffer.h"
 #include "FtpResponder.h"
 #include "TelnetResponder.h"
 #include "Libraries/General/IP4String.h"
@@ -38,11 +39,15 @@
 # include "RTOSIface.h"
 
 constexpr size_t NetworkStackWords = 550;
+constexpr uint32_t NetworkIdleWaitTicks = 1;		// how long the network task sleeps when it found nothing to do, unless it is woken earlier
 static Task<NetworkStackWords> networkTask;
+static uint32_t networkIdleWaits = 0;
 
 #endif
 
-Network::Network(Platform& p) : platform(p), responders(nullptr), nextResponderToPoll(nullptr)
+Network::Network(Platform& p) : platform(p), responders(nullptr), nextResponderToPoll(nullptr),
+	numHttpResponders(DefaultNumHttpResponders), numFtpResponders(DefaultNumFtpResponders), numTelnetResponders(DefaultNumTelnetResponders),
+	numNetworkBuffers(DefaultNetworkBufferCount)
 {
 #if defined(SAME70_TEST_BOARD)
 	interfaces[0] = new LwipEthernetInterface(p);
@@ -66,27 +71,11 @@ void Network::Init()
 	interfaces[0] = (platform.IsDuetWiFi()) ? static_cast<NetworkInterface*>(new WiFiInterface(platform)) : static_cast<NetworkInterface*>(new W5500Interface(platform));
 #endif
 
-	// Create the responders
 	HttpResponder::InitStatic();
 	TelnetResponder::InitStatic();
 
-	for (size_t i = 0; i < NumTelnetResponders; ++i)
-	{
-		responders = new TelnetResponder(responders);
-	}
-	for (size_t i = 0; i < NumFtpResponders; ++i)
-	{
-		responders = new FtpResponder(responders);
-	}
-	for (size_t i = 0; i < NumHttpResponders; ++i)
-	{
-		responders = new HttpResponder(responders);
-	}
-
 	strcpy(hostname, DEFAULT_HOSTNAME);
 
-	NetworkBuffer::AllocateBuffers(NetworkBufferCount);
-
 	for (NetworkInterface *iface : interfaces)
 	{
 		iface->Init();
@@ -208,19 +197,46 @@ void Network::ResetWiFiForUpload(bool external)
 #endif
 }
 
+#ifdef RTOS
+
+// The network task runs at the same priority as the main task. If it yielded after every pass even when there was nothing to do,
+// it would take every other time slice from the main task, so when the responders are idle we sleep until the next tick instead.
+// We get woken early when there is a G-code reply to send.
 extern "C" void NetworkLoop(void *)
 {
 	for (;;)
 	{
-		reprap.GetNetwork().Spin(true);
-		RTOSIface::Yield();
+		if (reprap.GetNetwork().Spin(true))
+		{
+			RTOSIface::Yield();
+		}
+		else
+		{
+			++networkIdleWaits;
+			(void)TaskBase::Take(NetworkIdleWaitTicks);
+		}
 	}
 }
 
+#endif
+
+// Wake up the network task if it is waiting for something to do
+static inline void WakeNetworkTask()
+{
+#ifdef RTOS
+	if (networkTask.GetHandle() != nullptr)
+	{
+		networkTask.Give();
+	}
+#endif
+}
+
 // This is called at the end of config.g processing.
 // Start the network if it was enabled
 void Network::Activate()
 {
+	AllocateResources();
+
 	for (NetworkInterface *iface : interfaces)
 	{
 		if (iface != nullptr)
@@ -235,6 +251,63 @@ void Network::Activate()
 
 }
 
+// Create the responders and network buffers. We do this when we activate the network so that config.g can change the numbers using M598.
+void Network::AllocateResources()
+{
+	for (size_t i = 0; i < numTelnetResponders; ++i)
+	{
+		responders = new TelnetResponder(responders);
+	}
+	for (size_t i = 0; i < numFtpResponders; ++i)
+	{
+		responders = new FtpResponder(responders);
+	}
+	for (size_t i = 0; i < numHttpResponders; ++i)
+	{
+		responders = new HttpResponder(responders);
+	}
+
+	NetworkBuffer::AllocateBuffers(numNetworkBuffers);
+}
+
+// Process M598, which sets the numbers of responders and network buffers. This must be used in config.g, because we create them at the end of it.
+// M598 H<HTTP responders> F<FTP responders> T<Telnet responders> B<network buffers>
+GCodeResult Network::ConfigureResources(GCodeBuffer& gb, const StringRef& reply)
+{
+	bool seen = false;
+	uint32_t newHttp = numHttpResponders, newFtp = numFtpResponders, newTelnet = numTelnetResponders, newBuffers = numNetworkBuffers;
+	gb.TryGetUIValue('H', newHttp, seen);
+	gb.TryGetUIValue('F', newFtp, seen);
+	gb.TryGetUIValue('T', newTelnet, seen);
+	gb.TryGetUIValue('B', newBuffers, seen);
+
+	if (!seen)
+	{
+		reply.printf("Responders: %u HTTP, %u FTP, %u Telnet; %u network buffers", numHttpResponders, numFtpResponders, numTelnetResponders, numNetworkBuffers);
+		return GCodeResult::ok;
+	}
+
+	if (responders != nullptr)
+	{
+		reply.copy("Network resources can only be changed in config.g");
+		return GCodeResult::error;
+	}
+
+	if (newHttp < 1 || newHttp > MaxNumHttpResponders || newFtp > MaxNumFtpResponders || newTelnet > MaxNumTelnetResponders
+		|| newBuffers < MinNetworkBufferCount || newBuffers > MaxNetworkBufferCount)
+	{
+		reply.printf("Responder or buffer count out of range, maximum %u HTTP, %u FTP, %u Telnet, buffers %u to %u",
+						MaxNumHttpResponders, MaxNumFtpResponders, MaxNumTelnetResponders, MinNetworkBufferCount, MaxNetworkBufferCount);
+		return GCodeResult::error;
+	}
+
+	numHttpResponders = newHttp;
+	numFtpResponders = newFtp;
+	numTelnetResponders = newTelnet;
+	numNetworkBuffers = newBuffers;
+	return GCodeResult::ok;
+}
+
 void Network::Exit()
 {
 	for (NetworkInterface *iface : interfaces)
@@ -266,7 +339,8 @@ bool Network::IsWiFiInterface(unsigned int interface) const
 }
 
 // Main spin loop. If 'full' is true then we are being called from the main spin loop. If false then we are being called during HSMCI idle time.
-void Network::Spin(bool full)
+// Return true if a responder did some work.
+bool Network::Spin(bool full)
 {
 	const uint32_t lastTime = Platform::GetInterruptClocks();
 
@@ -277,10 +351,10 @@ void Network::Spin(bool full)
 	}
 
 	// Poll the responders
+	bool doneSomething = false;
 	if (full)
 	{
 		NetworkResponder *nr = nextResponderToPoll;
-		bool doneSomething = false;
 		do
 		{
 			if (nr == nullptr)
@@ -305,6 +379,7 @@ void Network::Spin(bool full)
 	{
 		slowLoop = dt;
 	}
+	return doneSomething;
 }
 
 // Process the network timer interrupt
@@ -323,6 +398,10 @@ void Network::Diagnostics(MessageType mtype)
 	platform.MessageF(mtype, "Slowest loop: %.2fms; fastest: %.2fms\n", (double)(slowLoop * StepClocksToMillis), (double)(fastLoop * StepClocksToMillis));
 	fastLoop = UINT32_MAX;
 	slowLoop = 0;
+#ifdef RTOS
+	platform.MessageF(mtype, "Idle waits: %" PRIu32 "\n", networkIdleWaits);
+	networkIdleWaits = 0;
+#endif
 
 	platform.Message(mtype, "Responder states:");
 	for (NetworkResponder *r = responders; r != nullptr; r = r->GetNext())
@@ -436,26 +515,38 @@ bool Network::FindResponder(Socket *skt, NetworkProtocol protocol)
 
 void Network::HandleHttpGCodeReply(const char *msg)
 {
-	MutexLocker lock(httpMutex);
-	HttpResponder::HandleGCodeReply(msg);
+	{
+		MutexLocker lock(httpMutex);
+		HttpResponder::HandleGCodeReply(msg);
+	}
+	WakeNetworkTask();
 }
 
 void Network::HandleTelnetGCodeReply(const char *msg)
 {
-	MutexLocker lock(telnetMutex);
-	TelnetResponder::HandleGCodeReply(msg);
+	{
+		MutexLocker lock(telnetMutex);
+		TelnetResponder::HandleGCodeReply(msg);
+	}
+	WakeNetworkTask();
 }
 
 void Network::HandleHttpGCodeReply(OutputBuffer *buf)
 {
-	MutexLocker lock(httpMutex);
-	HttpResponder::HandleGCodeReply(buf);
+	{
+		MutexLocker lock(httpMutex);
+		HttpResponder::HandleGCodeReply(buf);
+	}
+	WakeNetworkTask();
 }
 
 void Network::HandleTelnetGCodeReply(OutputBuffer *buf)
 {
-	MutexLocker lock(telnetMutex);
-	TelnetResponder::HandleGCodeReply(buf);
+	{
+		MutexLocker lock(telnetMutex);
+		TelnetResponder::HandleGCodeReply(buf);
+	}
+	WakeNetworkTask();
 }
 
 uint32_t Network::GetHttpReplySeq()
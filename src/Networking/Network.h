@@ -22,9 +22,13 @@ const size_t NumNetworkInterfaces = 1;
 # error Wrong Network.h file included
 #endif
 
-const size_t NumHttpResponders = 4;		// the number of concurrent HTTP requests we can process
-const size_t NumFtpResponders = 1;		// the number of concurrent FTP sessions we support
-const size_t NumTelnetResponders = 2;	// the number of concurrent Telnet sessions we support
+// Default and maximum numbers of responders of each type. The numbers can be changed using M598 in config.g.
+const size_t DefaultNumHttpResponders = 4;		// the number of concurrent HTTP requests we can process
+const size_t DefaultNumFtpResponders = 1;		// the number of concurrent FTP sessions we support
+const size_t DefaultNumTelnetResponders = 2;	// the number of concurrent Telnet sessions we support
+const size_t MaxNumHttpResponders = 8;
+const size_t MaxNumFtpResponders = 2;
+const size_t MaxNumTelnetResponders = 4;
 
 // Forward declarations
 class NetworkResponder;
@@ -42,7 +46,7 @@ public:
 	void Init();
 	void Activate();
 	void Exit();
-	void Spin(bool full);
+	bool Spin(bool full);
 	void Interrupt();
 	void Diagnostics(MessageType mtype);
 	bool InNetworkStack() const;
@@ -52,6 +56,7 @@ public:
 	GCodeResult EnableProtocol(unsigned int interface, NetworkProtocol protocol, int port, int secure, const StringRef& reply);
 	GCodeResult DisableProtocol(unsigned int interface, NetworkProtocol protocol, const StringRef& reply);
 	GCodeResult ReportProtocols(unsigned int interface, const StringRef& reply) const;
+	GCodeResult ConfigureResources(GCodeBuffer& gb, const StringRef& reply);
 
 	// WiFi interfaces
 	GCodeResult HandleWiFiCode(int mcode, GCodeBuffer& gb, const StringRef& reply, OutputBuffer*& longReply);
@@ -79,6 +84,7 @@ public:
 
 private:
 	WiFiInterface *FindWiFiInterface() const;
+	void AllocateResources();
 
 	Platform& platform;
 
@@ -86,6 +92,10 @@ private:
 	NetworkResponder *responders;
 	NetworkResponder *nextResponderToPoll;
 
+	// The numbers of responders and network buffers to create when we activate the network
+	size_t numHttpResponders, numFtpResponders, numTelnetResponders;
+	size_t numNetworkBuffers;
+
 	Mutex httpMutex, telnetMutex;
 
 	uint32_t fastLoop, slowLoop;
@@ -9,6 +9,7 @@
 #include "Storage/FileStore.h"
 
 NetworkBuffer *NetworkBuffer::freelist = nullptr;
+PoolStats NetworkBuffer::poolStats("network buffers");
 
 NetworkBuffer::NetworkBuffer(NetworkBuffer *n) : next(n), dataLength(0), readPointer(0)
 {
@@ -20,6 +21,7 @@ NetworkBuffer *NetworkBuffer::Release()
 	NetworkBuffer *ret = next;
 	next = freelist;
 	freelist = this;
+	poolStats.Released();
 	return ret;
 }
 
@@ -111,6 +113,11 @@ void NetworkBuffer::Empty()
 		freelist = ret->next;
 		ret->next = nullptr;
 		ret->dataLength = ret->readPointer = 0;
+		poolStats.Allocated();
+	}
+	else
+	{
+		poolStats.Failed();
 	}
 	return ret;
 }
@@ -120,6 +127,7 @@ void NetworkBuffer::Empty()
 	while (number != 0)
 	{
 		freelist = new NetworkBuffer(freelist);
+		poolStats.Created(1);
 		--number;
 	}
 }
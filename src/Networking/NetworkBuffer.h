@@ -10,6 +10,7 @@
 
 #include "RepRapFirmware.h"
 #include "NetworkDefs.h"
+#include "Libraries/General/PoolStats.h"
 
 class WiFiSocket;
 class W5500Socket;
@@ -89,6 +90,7 @@ private:
 	// When doing unaligned transfers on the WiFi interface, up to 3 extra bytes may be returned, hence the +1 in the following
 	uint32_t data32[bufferSize/sizeof(uint32_t) + 1];		// 32-bit aligned buffer so we can do direct DMA
 	static NetworkBuffer *freelist;
+	static PoolStats poolStats;
 };
 
 #endif /* SRC_NETWORKING_NETWORKBUFFER_H_ */
@@ -35,7 +35,9 @@ const Port DefaultTelnetPort = 23;
 const Port DefaultPortNumbers[NumProtocols] = { DefaultHttpPort, DefaultFtpPort, DefaultTelnetPort };
 const char * const ProtocolNames[NumProtocols] = { "HTTP", "FTP", "TELNET" };
 
-const size_t NetworkBufferCount = 6;			// number of 2K network buffers
+const size_t DefaultNetworkBufferCount = 6;	// default number of 2K network buffers, can be changed using M598
+const size_t MinNetworkBufferCount = 4;
+const size_t MaxNetworkBufferCount = 24;
 const size_t SsidBufferLength = 32;				// maximum characters in an SSID
 
 #endif /* SRC_NETWORKING_NETWORKDEFS_H_ */
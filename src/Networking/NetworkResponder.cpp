@@ -11,10 +11,15 @@
 
 // NetworkResponder members
 
+uint32_t NetworkResponder::bytesSent = 0;
+
 NetworkResponder::NetworkResponder(NetworkResponder *n)
 	: next(n), responderState(ResponderState::free), skt(nullptr),
 	  outBuf(nullptr), fileBeingSent(nullptr), fileBuffer(nullptr)
 {
+#if SUPPORT_FILE_INFO_INDEX
+	uploadScanner = nullptr;
+#endif
 }
 
 // Send the contents of the output buffers
@@ -50,7 +55,10 @@ void NetworkResponder::SendData()
 		}
 		else
 		{
-			const size_t sent = skt->Send(reinterpret_cast<const uint8_t *>(outBuf->UnreadData()), bytesLeft);
+			const bool isLast = outBuf->Next() == nullptr && outStack.IsEmpty() && fileBeingSent == nullptr;
+			const size_t sent = (isLast)
+								? skt->SendAndPush(reinterpret_cast<const uint8_t *>(outBuf->UnreadData()), bytesLeft)
+								: skt->Send(reinterpret_cast<const uint8_t *>(outBuf->UnreadData()), bytesLeft);
 			if (sent == 0)
 			{
 				// Check whether the connection has been closed
@@ -67,6 +75,7 @@ void NetworkResponder::SendData()
 			}
 
 			outBuf->Taken(sent);				// tell the output buffer how much data we have taken
+			bytesSent += sent;
 			if (sent < bytesLeft)
 			{
 				return;
@@ -109,7 +118,9 @@ void NetworkResponder::SendData()
 		else
 		{
 			const size_t remaining = fileBuffer->Remaining();
-			const size_t sent = skt->Send(fileBuffer->UnreadData(), remaining);
+			const size_t sent = (fileBeingSent == nullptr)			// if we have read the last of the file
+								? skt->SendAndPush(fileBuffer->UnreadData(), remaining)
+								: skt->Send(fileBuffer->UnreadData(), remaining);
 			if (sent == 0)
 			{
 				// Check whether the connection has been closed
@@ -125,6 +136,7 @@ void NetworkResponder::SendData()
 			}
 
 			fileBuffer->Taken(sent);
+			bytesSent += sent;
 			if (sent < remaining)
 			{
 				return;
@@ -179,11 +191,46 @@ void NetworkResponder::StartUpload(FileStore *file, const char *fileName)
 	SafeStrncpy(filenameBeingUploaded, fileName, ARRAY_SIZE(filenameBeingUploaded));
 	responderState = ResponderState::uploading;
 	uploadError = false;
+#if SUPPORT_FILE_INFO_INDEX
+	uploadScanner = (FileInfoParser::IsGCodeFile(fileName)) ? GetPlatform().GetMassStorage()->ClaimUploadScanner() : nullptr;
+	if (uploadScanner != nullptr)
+	{
+		uploadScanner->StartScan();
+	}
+#endif
+}
+
+// Parse the G-code file details of data that has just been written to the file being uploaded, so that we don't need to read the file back later
+void NetworkResponder::ScanUploadData(const uint8_t *data, size_t len)
+{
+#if SUPPORT_FILE_INFO_INDEX
+	if (uploadScanner != nullptr)
+	{
+		uploadScanner->ScanData(reinterpret_cast<const char *>(data), len);
+	}
+#endif
+}
+
+#if SUPPORT_FILE_INFO_INDEX
+
+// Stop parsing the file being uploaded
+void NetworkResponder::ReleaseUploadScanner()
+{
+	if (uploadScanner != nullptr)
+	{
+		GetPlatform().GetMassStorage()->ReleaseUploadScanner();
+		uploadScanner = nullptr;
+	}
 }
 
+#endif
+
 // If this responder has an upload in progress, cancel it
 void NetworkResponder::CancelUpload()
 {
+#if SUPPORT_FILE_INFO_INDEX
+	ReleaseUploadScanner();
+#endif
 	if (fileBeingUploaded.IsLive())
 	{
 		fileBeingUploaded.Close();
@@ -224,12 +271,28 @@ void NetworkResponder::FinishUpload(uint32_t fileLength, time_t fileLastModified
 		{
 			GetPlatform().GetMassStorage()->Delete(FS_PREFIX, filenameBeingUploaded);
 		}
-		else if (fileLastModified != 0)
+		else
 		{
-			// Update the file timestamp if it was specified
-			(void)GetPlatform().GetMassStorage()->SetLastModifiedTime(nullptr, filenameBeingUploaded, fileLastModified);
+			if (fileLastModified != 0)
+			{
+				// Update the file timestamp if it was specified
+				(void)GetPlatform().GetMassStorage()->SetLastModifiedTime(nullptr, filenameBeingUploaded, fileLastModified);
+			}
+#if SUPPORT_FILE_INFO_INDEX
+			if (uploadScanner != nullptr)
+			{
+				// Record the details we parsed during the upload, keyed on the final size and timestamp of the file
+				MassStorage * const massStorage = GetPlatform().GetMassStorage();
+				GCodeFileInfo info;
+				uploadScanner->FinishScan(massStorage->GetLastModifiedTime(nullptr, filenameBeingUploaded), info);
+				massStorage->GetFileInfoIndex().Store(FS_PREFIX, filenameBeingUploaded, info);
+			}
+#endif
 		}
 	}
+#if SUPPORT_FILE_INFO_INDEX
+	ReleaseUploadScanner();
+#endif
 
 	// Clean up again
 	filenameBeingUploaded[0] = 0;
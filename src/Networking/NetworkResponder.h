@@ -18,6 +18,7 @@
 // Forward declarations
 class NetworkResponder;
 class Socket;
+class FileInfoParser;
 
 // Network responder base class
 class NetworkResponder
@@ -29,6 +30,8 @@ public:
 	virtual void Terminate(NetworkProtocol protocol) = 0;		// terminate the responder if it is serving the specified protocol
 	virtual void Diagnostics(MessageType mtype) const = 0;
 
+	static uint32_t GetBytesSent() { return bytesSent; }
+
 protected:
 	// States machine control. Not all derived classes use all states.
 	enum class ResponderState
@@ -41,6 +44,8 @@ protected:
 		// HTTP responder additional states
 		processingRequest,
 		gettingFileInfo,								// getting file info
+		waitingForStatus,								// waiting for the status to change before sending a status response
+		postingGCode,									// passing the body of a POST rr_gcode request to the G-code input
 
 		// FTP responder additional states
 		waitingForPasvPort,
@@ -61,6 +66,10 @@ protected:
 
 	void StartUpload(FileStore *file, const char *fileName);
 	void FinishUpload(uint32_t fileLength, time_t fileLastModified);
+	void ScanUploadData(const uint8_t *data, size_t len);		// Parse the G-code file details of data that has been uploaded
+#if SUPPORT_FILE_INFO_INDEX
+	void ReleaseUploadScanner();
+#endif
 	virtual void CancelUpload();
 
 	uint32_t GetRemoteIP() const;
@@ -87,7 +96,12 @@ protected:
 	char filenameBeingUploaded[MaxFilenameLength];
 	uint32_t postFileLength, uploadedBytes;				// How many POST bytes do we expect and how many have already been written?
 	time_t fileLastModified;
+#if SUPPORT_FILE_INFO_INDEX
+	FileInfoParser *uploadScanner;						// parses the file being uploaded if it is a G-code file, else nullptr
+#endif
 	bool uploadError;
+
+	static uint32_t bytesSent;							// total number of bytes sent by all responders, never reset
 };
 
 #endif /* SRC_NETWORKING_NETWORKRESPONDER_H_ */
@@ -39,6 +39,7 @@ public:
 	virtual bool CanRead() const = 0;
 	virtual bool CanSend() const = 0;
 	virtual size_t Send(const uint8_t *data, size_t length) = 0;
+	virtual size_t SendAndPush(const uint8_t *data, size_t length) { return Send(data, length); }	// send the last data of a reply, which may save a separate call to Send()
 	virtual void Send() = 0;
 
 protected:
@@ -72,7 +72,15 @@ bool TelnetResponder::SendGCodeReply()
 {
 	MutexLocker lock(gcodeReplyMutex);
 
-	if (gcodeReply != nullptr)
+	// While there are more commands waiting to be executed, wait for their replies too so that we send fewer, larger TCP segments.
+	// Once one client has it, all the others must have it too.
+	if (gcodeReply != nullptr
+		&& (   clientsServed != 0
+			|| gcodeReply->Length() >= TelnetReplyFlushBytes
+			|| gcodeReply->GetAge() >= TelnetReplyFlushMillis
+			|| reprap.GetGCodes().GetTelnetInput()->BytesCached() == 0
+		   )
+	   )
 	{
 		bool clearReply = false;
 		clientsServed++;
@@ -144,14 +152,7 @@ bool TelnetResponder::Spin()
 
 	case ResponderState::authenticating:
 		{
-			bool readSomething = false;
-			char c;
-			while (!haveCompleteLine && skt->ReadChar(c))
-			{
-				CharFromClient(c);
-				readSomething = true;
-			}
-
+			const bool readSomething = ReadLine();
 			if (!readSomething && !skt->CanRead())
 			{
 				ConnectionLost();
@@ -187,14 +188,7 @@ bool TelnetResponder::Spin()
 		}
 		{
 			// See if we can read anything
-			bool readSomething = false;
-			char c;
-			while (!haveCompleteLine && skt->ReadChar(c))
-			{
-				CharFromClient(c);
-				readSomething = true;
-			}
-
+			const bool readSomething = ReadLines();
 			if (!readSomething && !skt->CanRead())
 			{
 				ConnectionLost();
@@ -222,6 +216,61 @@ bool TelnetResponder::Spin()
 	}
 }
 
+// Read characters from the client until we have a complete line or there are none left, returning true if we read any.
+// We take them from the socket a buffer at a time, because fetching each one is expensive.
+bool TelnetResponder::ReadLine()
+{
+	bool readSomething = false;
+	const uint8_t *data;
+	size_t len;
+	while (!haveCompleteLine && skt->ReadBuffer(data, len))
+	{
+		size_t taken = 0;
+		while (taken < len && !haveCompleteLine)
+		{
+			CharFromClient((char)data[taken++]);
+		}
+		skt->Taken(taken);
+		readSomething = true;
+	}
+	return readSomething;
+}
+
+// Read all the complete lines the client has sent that will fit in the Telnet G-code input and pass them to it together, returning true if we read anything.
+// On return, if haveCompleteLine is set then the line in clientMessage is either a special Telnet command or it didn't fit.
+bool TelnetResponder::ReadLines()
+{
+	NetworkGCodeInput * const telnetInput = reprap.GetGCodes().GetTelnetInput();
+	const size_t spaceLeft = min<size_t>(telnetInput->BufferSpaceLeft(), GCodeInputBufferSize);
+	char batch[GCodeInputBufferSize];
+	size_t batchLength = 0;
+	bool readSomething = false;
+	for (;;)
+	{
+		if (ReadLine())
+		{
+			readSomething = true;
+		}
+		if (   !haveCompleteLine
+			|| StringEquals(clientMessage, "exit") || StringEquals(clientMessage, "quit")
+			|| batchLength + clientPointer + 1 > spaceLeft
+		   )
+		{
+			break;
+		}
+		memcpy(batch + batchLength, clientMessage, clientPointer + 1);		// include the null terminator, which ends the command
+		batchLength += clientPointer + 1;
+		haveCompleteLine = false;
+		clientPointer = 0;
+	}
+
+	if (batchLength != 0)
+	{
+		(void)telnetInput->Put(TelnetMessage, batch, batchLength);			// this only fails if we couldn't get the mutex, and ProcessLine has the same problem
+	}
+	return readSomething;
+}
+
 // Process a character from the client, returning true if we have a complete line
 void TelnetResponder::CharFromClient(char c)
 {
@@ -25,7 +25,9 @@ public:
 
 private:
 	void CharFromClient(char c);
+	bool ReadLine();
 	void ProcessLine();
+	bool ReadLines();
 	void ConnectionLost() override;
 
 	bool SendGCodeReply();
@@ -41,6 +43,8 @@ private:
 	static Mutex gcodeReplyMutex;
 
 	static const uint32_t TelnetSetupDuration = 4000;	// ignore the first Telnet request within this duration (in ms)
+	static const size_t TelnetReplyFlushBytes = 1024;	// send the G-code reply when it reaches this length...
+	static const uint32_t TelnetReplyFlushMillis = 5;	// ...or when the oldest part of it has waited this long (in ms)
 };
 
 #endif /* SRC_NETWORKING_TELNETRESPONDER_H_ */
@@ -18,7 +18,8 @@
 #include "Libraries/General/IP4String.h"
 
 W5500Interface::W5500Interface(Platform& p)
-	: platform(p), lastTickMillis(0), state(NetworkState::disabled), activated(false)
+	: platform(p), lastTickMillis(0), nextSocketToPoll(0), idleSocketsToPoll(0), lastIdlePollMillis(0), socketPolls(0), idleSocketsSkipped(0),
+	  state(NetworkState::disabled), activated(false), chipStarted(false)
 {
 	// Create the sockets
 	for (W5500Socket*& skt : sockets)
@@ -39,6 +40,10 @@ void W5500Interface::Init()
 
 	// Ensure that the W5500 chip is in the reset state
 	pinMode(W5500ResetPin, OUTPUT_LOW);
+	if (W5500InterruptPin != NoPin)
+	{
+		pinMode(W5500InterruptPin, INPUT_PULLUP);
+	}
 	lastTickMillis = millis();
 
 	SetIPAddress(DefaultIpAddress, DefaultNetMask, DefaultGateway);
@@ -229,16 +234,22 @@ void W5500Interface::SetMacAddress(const uint8_t mac[])
 	}
 }
 
+// Reset the W5500 and start auto negotiation
+void W5500Interface::ResetChip()
+{
+	pinMode(W5500ResetPin, OUTPUT_LOW);
+	delayMicroseconds(550);						// W550 reset pulse must be at least 500us long
+	IoPort::WriteDigital(W5500ResetPin, true);	// raise /Reset pin
+	delay(55);									// W5500 needs 50ms to start up
+	setPHYCFGR(PHYCFGR_OPMD | PHYCFGR_OPMDC_ALLA);					// set auto negotiation and reset the PHY
+}
+
 // Start up the network
 void W5500Interface::Start()
 {
 	MutexLocker lock(interfaceMutex);
 
 	SetIPAddress(platform.GetIPAddress(), platform.NetMask(), platform.GateWay());
-	pinMode(W5500ResetPin, OUTPUT_LOW);
-	delayMicroseconds(550);						// W550 reset pulse must be at least 500us long
-	IoPort::WriteDigital(W5500ResetPin, true);	// raise /Reset pin
-	delay(55);									// W5500 needs 50ms to start up
 
 #ifdef USE_3K_BUFFERS
 	static const uint8_t bufSizes[8] = { 3, 3, 3, 3, 1, 1, 1, 1 };	// 3K buffers for http, 1K for everything else (FTP will be slow)
@@ -246,13 +257,22 @@ void W5500Interface::Start()
 	static const uint8_t bufSizes[8] = { 2, 2, 2, 2, 2, 2, 2, 2 };	// 2K buffers for everything
 #endif
 
-	setPHYCFGR(PHYCFGR_OPMD | PHYCFGR_OPMDC_ALLA);					// set auto negotiation and reset the PHY
+	// If we started the chip while config.g was running then auto negotiation is already under way, so don't reset it again
+	if (chipStarted)
+	{
+		chipStarted = false;
+	}
+	else
+	{
+		ResetChip();
+	}
 
 	wizchip_init(bufSizes, bufSizes);
 	setSHAR(macAddress);
 	setSIPR(ipAddress);
 	setGAR(gateway);
 	setSUBR(netmask);
+	setSIMR((1u << NumW5500TcpSockets) - 1);						// let the TCP sockets assert the interrupt output
 
 	setPHYCFGR(PHYCFGR_OPMD | PHYCFGR_OPMDC_ALLA | ~PHYCFGR_RST);	// remove the reset
 
@@ -298,6 +318,10 @@ void W5500Interface::Spin(bool full)
 					// IP address is all zeros, so use DHCP
 //					debugPrintf("Link established, getting IP address\n");
 					DHCP_init(DhcpSocketNumber, platform.Random(), reprap.GetNetwork().GetHostname());
+					if (ReadDhcpLease())
+					{
+						DHCP_set_previous_ip(leasedIpAddress);
+					}
 					lastTickMillis = millis();
 					state = NetworkState::obtainingIP;
 				}
@@ -328,6 +352,7 @@ void W5500Interface::Spin(bool full)
 				{
 //					debugPrintf("IP address obtained, network running\n");
 					getSIPR(ipAddress);
+					SaveDhcpLease();
 					// Send mDNS announcement so that some routers can perform hostname mapping
 					// if this board is connected via a non-IGMP capable WiFi bridge (like the TP-Link WR701N)
 					//mdns_announce();
@@ -374,17 +399,40 @@ void W5500Interface::Spin(bool full)
 					{
 //						debugPrintf("IP address changed\n");
 						getSIPR(ipAddress);
+						SaveDhcpLease();
 					}
 				}
 
-				// Poll the next TCP socket
-				sockets[nextSocketToPoll]->Poll(full);
-
-				// Move on to the next TCP socket for next time
-				++nextSocketToPoll;
-				if (nextSocketToPoll == NumW5500TcpSockets)
+				// Poll the next TCP socket that needs it. A socket that is listening only needs to be polled when the W5500 reports a connection on it,
+				// which we find out by reading the socket interrupt register, or without reading anything over SPI if the interrupt output is connected.
+				// In case we miss an event, we poll all the sockets every so often.
+				const uint32_t now = millis();
+				if (now - lastIdlePollMillis >= IdleSocketPollInterval)
 				{
-					nextSocketToPoll = 0;
+					lastIdlePollMillis = now;
+					idleSocketsToPoll = NumW5500TcpSockets;
+				}
+				const uint8_t pendingConnections = (W5500InterruptPin == NoPin || !digitalRead(W5500InterruptPin)) ? getSIR() : 0;
+				for (size_t i = 0; i < NumW5500TcpSockets; ++i)
+				{
+					const size_t skt = nextSocketToPoll;
+					++nextSocketToPoll;
+					if (nextSocketToPoll == NumW5500TcpSockets)
+					{
+						nextSocketToPoll = 0;
+					}
+
+					if (idleSocketsToPoll != 0 || (pendingConnections & (1u << skt)) != 0 || sockets[skt]->NeedsPolling())
+					{
+						if (idleSocketsToPoll != 0)
+						{
+							--idleSocketsToPoll;
+						}
+						sockets[skt]->Poll(full);
+						++socketPolls;
+						break;
+					}
+					++idleSocketsSkipped;
 				}
 			}
 			else if (full)
@@ -412,6 +460,8 @@ void W5500Interface::Diagnostics(MessageType mtype)
 	const char * const linkSpeed = ((phycfgr & 1) == 0) ? "down" : ((phycfgr & 2) != 0) ? "100Mbps" : "10Mbps";
 	const char * const linkDuplex = ((phycfgr & 1) == 0) ? "" : ((phycfgr & 4) != 0) ? " full duplex" : " half duplex";
 	platform.MessageF(mtype, "Interface state %d, link %s%s\n", (int)state, linkSpeed, linkDuplex);
+	platform.MessageF(mtype, "Socket polls %" PRIu32 ", idle sockets skipped %" PRIu32 "\n", socketPolls, idleSocketsSkipped);
+	socketPolls = idleSocketsSkipped = 0;
 }
 
 // Enable or disable the network
@@ -420,6 +470,23 @@ GCodeResult W5500Interface::EnableInterface(int mode, const StringRef& ssid, con
 	if (!activated)
 	{
 		state = (mode == 0) ? NetworkState::disabled : NetworkState::enabled;
+
+		// Start the W5500 and let the link come up while the rest of config.g runs. We set up the addresses when we are activated.
+		if (mode == 0)
+		{
+			if (chipStarted)
+			{
+				digitalWrite(W5500ResetPin, false);
+				chipStarted = false;
+			}
+		}
+		else if (!chipStarted)
+		{
+			ResetChip();
+			wizchip_init(nullptr, nullptr);
+			setPHYCFGR(PHYCFGR_OPMD | PHYCFGR_OPMDC_ALLA | ~PHYCFGR_RST);	// remove the reset
+			chipStarted = true;
+		}
 	}
 	else if (mode == 0)
 	{
@@ -450,6 +517,40 @@ void W5500Interface::SetIPAddress(const uint8_t p_ipAddress[], const uint8_t p_n
 	memcpy(gateway, p_gateway, sizeof(gateway));
 }
 
+// Read the IP address that DHCP last gave us, returning true if we have one
+bool W5500Interface::ReadDhcpLease()
+{
+	FileStore * const f = platform.OpenFile(platform.GetSysDir(), DHCP_LEASE_FILE, OpenMode::read);
+	bool ok = false;
+	if (f != nullptr)
+	{
+		ok = f->Read(reinterpret_cast<char*>(leasedIpAddress), sizeof(leasedIpAddress)) == (int)sizeof(leasedIpAddress);
+		f->Close();
+	}
+	if (!ok)
+	{
+		memset(leasedIpAddress, 0, sizeof(leasedIpAddress));
+	}
+	return ok && (leasedIpAddress[0] | leasedIpAddress[1] | leasedIpAddress[2] | leasedIpAddress[3]) != 0;
+}
+
+// Save the IP address that DHCP gave us, so that we can ask for it again next time we start up
+void W5500Interface::SaveDhcpLease()
+{
+	if (memcmp(ipAddress, leasedIpAddress, sizeof(ipAddress)) != 0)
+	{
+		FileStore * const f = platform.OpenFile(platform.GetSysDir(), DHCP_LEASE_FILE, OpenMode::write);
+		if (f != nullptr)
+		{
+			if (f->Write(ipAddress, sizeof(ipAddress)))
+			{
+				memcpy(leasedIpAddress, ipAddress, sizeof(leasedIpAddress));
+			}
+			f->Close();
+		}
+	}
+}
+
 void W5500Interface::OpenDataPort(Port port)
 {
 	sockets[FtpDataSocketNumber]->Init(FtpDataSocketNumber, port, FtpDataProtocol);
@@ -471,6 +572,7 @@ void W5500Interface::InitSockets()
 		}
 	}
 	nextSocketToPoll = 0;
+	idleSocketsToPoll = NumW5500TcpSockets;
 }
 
 void W5500Interface::TerminateSockets()
@@ -27,6 +27,8 @@ const SocketNumber TelnetSocketNumber = 6;
 const size_t NumW5500TcpSockets = 7;
 const SocketNumber DhcpSocketNumber = 7;		// TODO can we allocate this dynamically when required, to allow more http sockets most of the time?
 
+const uint32_t IdleSocketPollInterval = 250;	// how often we poll listening sockets that the W5500 hasn't reported a connection on, in milliseconds
+
 class Platform;
 
 // The main network class that drives the network.
@@ -70,6 +72,7 @@ private:
 		active						// network running
 	};
 
+	void ResetChip();
 	void Start();
 	void Stop();
 	void InitSockets();
@@ -85,11 +88,17 @@ private:
 	pre(protocol < NumProtocols);
 
 	void SetIPAddress(const uint8_t p_ipAddress[], const uint8_t p_netmask[], const uint8_t p_gateway[]);
+	bool ReadDhcpLease();
+	void SaveDhcpLease();
+
 	Platform& platform;
 	uint32_t lastTickMillis;
 
 	W5500Socket *sockets[NumW5500TcpSockets];
 	size_t nextSocketToPoll;						// next TCP socket number to poll for read/write operations
+	size_t idleSocketsToPoll;						// how many more sockets to poll regardless of whether they need it
+	uint32_t lastIdlePollMillis;					// when we last started polling all the sockets
+	uint32_t socketPolls, idleSocketsSkipped;		// statistics for M122
 
 	Port portNumbers[NumProtocols];					// port number used for each protocol
 	bool protocolEnabled[NumProtocols];				// whether each protocol is enabled
@@ -97,11 +106,13 @@ private:
 	NetworkState state;
 	bool activated;
 	bool usingDhcp;
+	bool chipStarted;								// true if we took the W5500 out of reset while config.g was running, so that the link can come up sooner
 
 	uint8_t ipAddress[4];
 	uint8_t netmask[4];
 	uint8_t gateway[4];
 	uint8_t macAddress[6];
+	uint8_t leasedIpAddress[4];						// the IP address in the DHCP lease file
 };
 
 #endif
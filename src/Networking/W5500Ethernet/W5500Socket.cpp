@@ -18,7 +18,7 @@
 const unsigned int MaxBuffersPerSocket = 4;
 
 W5500Socket::W5500Socket(NetworkInterface *iface)
-	: Socket(iface), receivedData(nullptr)
+	: Socket(iface), receivedData(nullptr), waitingForConnection(false)
 {
 }
 
@@ -52,10 +52,12 @@ void W5500Socket::ReInit()
 	persistConnection = true;
 	isTerminated = false;
 	isSending = false;
+	waitingForConnection = false;
 	state = SocketState::inactive;
 
-	// Re-initialise the socket on the W5500
+	// Re-initialise the socket on the W5500. Only a new connection raises an interrupt, because that is the only event we wait for.
 	socket(socketNum, Sn_MR_TCP, localPort, 0x00);
+	setSn_IMR(socketNum, Sn_IR_CON);
 }
 
 // Close a connection when the last packet has been sent
@@ -153,7 +155,9 @@ void W5500Socket::Poll(bool full)
 	{
 		MutexLocker lock(interface->interfaceMutex);
 
-		switch(getSn_SR(socketNum))
+		const uint8_t status = getSn_SR(socketNum);
+		waitingForConnection = (status == SOCK_LISTEN);
+		switch(status)
 		{
 		case SOCK_INIT:
 			// Socket has been initialised but is not listening yet
@@ -20,6 +20,7 @@ public:
 	void Init(SocketNumber s, Port serverPort, NetworkProtocol p);
 
 	void Poll(bool full) override;
+	bool NeedsPolling() const { return !waitingForConnection; }		// false if we only need to poll this socket when the W5500 reports a connection on it
 	void Close() override;
 	void Terminate() override;
 	void TerminateAndDisable() override;
@@ -43,6 +44,7 @@ private:
 	SocketNumber socketNum;								// The W5500 socket number we are using
 	bool sendOutstanding;								// True if we have written data to the socket but not flushed it
 	bool isSending;										// True if we have written data to the W5500 to send and have not yet seen success or timeout
+	bool waitingForConnection;							// True if the socket was listening with no connection pending when we last polled it
 	uint16_t wizTxBufferPtr;							// Current offset into the Wizchip send buffer, if sendOutstanding is true
 	uint16_t wizTxBufferLeft;							// Transmit buffer space left, if sendOutstanding is true
 };
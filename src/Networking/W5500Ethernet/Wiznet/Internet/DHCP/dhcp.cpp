@@ -68,6 +68,8 @@ extern "C" void debugPrintf(const char *fmt, ...);
 enum class DhcpState : uint8_t
 {
 	init = 0,				///< Initialize
+	initReboot,				///< Initialize with a previously leased IP
+	rebooting,				///< send REQUEST for the previously leased IP and wait ACK or NACK
 	discover,				///< send DISCOVER and wait OFFER
 	request,				///< send REQUEST and wait ACK or NACK
 	leased,					///< Received ACK and IP leased
@@ -219,6 +221,7 @@ int8_t   dhcp_retry_count;
 uint32_t dhcp_lease_time;
 volatile uint32_t dhcp_tick_1s;                 // unit 1 second
 uint32_t dhcp_tick_next;
+uint32_t dhcp_wait_time;							// how long to wait before the next retry
 
 uint32_t DHCP_XID;      							// Any number
 
@@ -481,13 +484,17 @@ void send_DHCP_REQUEST(void)
 		pDHCPMSG->OPT[k++] = DHCP_allocated_ip[1];
 		pDHCPMSG->OPT[k++] = DHCP_allocated_ip[2];
 		pDHCPMSG->OPT[k++] = DHCP_allocated_ip[3];
-	
-		pDHCPMSG->OPT[k++] = dhcpServerIdentifier;
-		pDHCPMSG->OPT[k++] = 0x04;
-		pDHCPMSG->OPT[k++] = DHCP_SIP[0];
-		pDHCPMSG->OPT[k++] = DHCP_SIP[1];
-		pDHCPMSG->OPT[k++] = DHCP_SIP[2];
-		pDHCPMSG->OPT[k++] = DHCP_SIP[3];
+
+		// When we are asking for our previous IP address we don't know which server leased it to us
+		if (dhcp_state != DhcpState::rebooting)
+		{
+			pDHCPMSG->OPT[k++] = dhcpServerIdentifier;
+			pDHCPMSG->OPT[k++] = 0x04;
+			pDHCPMSG->OPT[k++] = DHCP_SIP[0];
+			pDHCPMSG->OPT[k++] = DHCP_SIP[1];
+			pDHCPMSG->OPT[k++] = DHCP_SIP[2];
+			pDHCPMSG->OPT[k++] = DHCP_SIP[3];
+		}
 	}
 
 	// host name
@@ -728,6 +735,11 @@ DhcpRunResult DHCP_run(void)
 		dhcp_state = DhcpState::discover;
 		break;
 
+	case DhcpState::initReboot:
+		dhcp_state = DhcpState::rebooting;			// set the state first so that send_DHCP_REQUEST omits the server identifier
+		send_DHCP_REQUEST();
+		break;
+
 	case DhcpState::discover:
 		if (type == DHCP_OFFER)
 		{
@@ -747,9 +759,17 @@ DhcpRunResult DHCP_run(void)
 		break;
 
 	case DhcpState::request:
+	case DhcpState::rebooting:
 		if (type == DHCP_ACK)
 		{
 			DEBUG_PRINTF("> Receive DHCP_ACK, lease time = %u\n", (unsigned int)dhcp_lease_time);
+			if (dhcp_state == DhcpState::rebooting)
+			{
+				DHCP_allocated_ip[0] = pDHCPMSG->yiaddr[0];
+				DHCP_allocated_ip[1] = pDHCPMSG->yiaddr[1];
+				DHCP_allocated_ip[2] = pDHCPMSG->yiaddr[2];
+				DHCP_allocated_ip[3] = pDHCPMSG->yiaddr[3];
+			}
 			uint8_t currentIp[4];
 			getSIPR(currentIp);
 			if (memcmp(DHCP_allocated_ip, currentIp, 4) == 0)
@@ -771,7 +791,7 @@ DhcpRunResult DHCP_run(void)
 		{
 			DEBUG_PRINTF("> Receive DHCP_NACK\n");
 			reset_DHCP_timeout();
-			dhcp_state = DhcpState::discover;
+			dhcp_state = DhcpState::init;			// start again with DISCOVER straight away
 		}
 		else
 		{
@@ -888,6 +908,7 @@ DhcpRunResult check_DHCP_timeout(void)
 				break;
 
 			case DhcpState::request :
+			case DhcpState::rebooting :
 				DEBUG_PRINTF("<<timeout>> state : STATE_DHCP_REQUEST\n");
 
 				send_DHCP_REQUEST();
@@ -903,8 +924,10 @@ DhcpRunResult check_DHCP_timeout(void)
 				break;
 			}
 
+			// Back off exponentially, so that a packet lost while the link was starting up costs us little time
+			dhcp_wait_time = (2 * dhcp_wait_time < DHCP_WAIT_TIME) ? 2 * dhcp_wait_time : DHCP_WAIT_TIME;
 			dhcp_tick_1s = 0;
-			dhcp_tick_next = dhcp_tick_1s + DHCP_WAIT_TIME;
+			dhcp_tick_next = dhcp_tick_1s + dhcp_wait_time;
 			dhcp_retry_count++;
 		}
 	}
@@ -917,6 +940,7 @@ DhcpRunResult check_DHCP_timeout(void)
 			ret = DhcpRunResult::DHCP_FAILED;
 			break;
 		case DhcpState::request:
+		case DhcpState::rebooting:
 		case DhcpState::rerequest:
 		case DhcpState::checkingIpConflict:
 			send_DHCP_DISCOVER();
@@ -980,11 +1004,21 @@ void DHCP_init(uint8_t s, uint32_t seed, const char *hname)
 	dhcp_state = DhcpState::init;
 }
 
+void DHCP_set_previous_ip(const uint8_t *ip)
+{
+	DHCP_allocated_ip[0] = ip[0];
+	DHCP_allocated_ip[1] = ip[1];
+	DHCP_allocated_ip[2] = ip[2];
+	DHCP_allocated_ip[3] = ip[3];
+	dhcp_state = DhcpState::initReboot;
+}
+
 /* Rset the DHCP timeout count and retry count. */
 void reset_DHCP_timeout(void)
 {
 	dhcp_tick_1s = 0;
-	dhcp_tick_next = DHCP_WAIT_TIME;
+	dhcp_wait_time = DHCP_INITIAL_WAIT_TIME;
+	dhcp_tick_next = dhcp_wait_time;
 	dhcp_retry_count = 0;
 }
 
@@ -48,6 +48,7 @@
 /* Retry to processing DHCP */
 #define	MAX_DHCP_RETRY		2        ///< Maxium retry count
 #define	DHCP_WAIT_TIME		10       ///< Wait Time 10s
+#define	DHCP_INITIAL_WAIT_TIME	2     ///< Wait Time before the first retry, doubled for each retry up to DHCP_WAIT_TIME
 
 
 /* UDP port numbers for DHCP */
@@ -79,6 +80,12 @@ enum class DhcpRunResult : uint8_t
  */
 void DHCP_init(uint8_t s, uint32_t seed, const char *hname);
 
+/*
+ * @brief Ask the DHCP server to confirm the IP address we leased before we were restarted (INIT-REBOOT), instead of starting with DISCOVER
+ * @param ip - the previously leased IP address. Call this after DHCP_init.
+ */
+void DHCP_set_previous_ip(const uint8_t *ip);
+
 /*
  * @brief DHCP 1s Tick Timer handler
  * @note SHOULD BE register to your system 1s Tick timer handler 
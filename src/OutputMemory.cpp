@@ -10,9 +10,12 @@
 #include "RepRap.h"
 #include <cstdarg>
 
-/*static*/ OutputBuffer * volatile OutputBuffer::freeOutputBuffers = nullptr;		// Messages may also be sent by ISRs,
-/*static*/ volatile size_t OutputBuffer::usedOutputBuffers = 0;						// so make these volatile.
-/*static*/ volatile size_t OutputBuffer::maxUsedOutputBuffers = 0;
+/*static*/ OutputBuffer * volatile OutputBuffer::freeOutputBuffers = nullptr;		// Messages may also be sent by ISRs, so make this volatile
+/*static*/ PoolStats OutputBuffer::poolStats("output buffers");
+/*static*/ size_t OutputBuffer::usedGranules = 0;
+/*static*/ size_t OutputBuffer::maxUsedGranules = 0;
+alignas(4) /*static*/ char OutputBuffer::arena[OUTPUT_BUFFER_ARENA_SIZE];
+/*static*/ uint32_t OutputBuffer::granuleMap[(NumGranules + 31)/32];
 
 //*************************************************************************************************
 // OutputBuffer class implementation
@@ -160,32 +163,14 @@ size_t OutputBuffer::copy(const char *src, size_t len)
 
 size_t OutputBuffer::cat(const char c)
 {
-	// See if we can append a char
-	if (last->dataLength == OUTPUT_BUFFER_SIZE)
+	// See if we can append a char, growing the last buffer or adding a new one if it is full
+	if (last->dataLength == last->capacity && !last->Extend(1) && AddBuffer(1) == nullptr)
 	{
-		// No - allocate a new item and copy the data
-		OutputBuffer *nextBuffer;
-		if (!Allocate(nextBuffer))
-		{
-			// We cannot store any more data
-			hadOverflow = true;
-			return 0;
-		}
-		nextBuffer->references = references;
-		nextBuffer->copy(c);
-
-		// Link the new item to this list
-		last->next = nextBuffer;
-		for (OutputBuffer *item = this; item != nextBuffer; item = item->Next())
-		{
-			item->last = nextBuffer;
-		}
-	}
-	else
-	{
-		// Yes - we have enough space left
-		last->data[last->dataLength++] = c;
+		// We cannot store any more data
+		hadOverflow = true;
+		return 0;
 	}
+	last->data[last->dataLength++] = c;
 	return 1;
 }
 
@@ -199,25 +184,14 @@ size_t OutputBuffer::cat(const char *src, size_t len)
 	size_t copied = 0;
 	while (copied < len)
 	{
-		if (last->dataLength == OUTPUT_BUFFER_SIZE)
+		// If the last buffer is full, try to grow it to hold the rest of the data, else add a new buffer to the chain
+		if (last->dataLength == last->capacity && !last->Extend(len - copied) && AddBuffer(len - copied) == nullptr)
 		{
-			// The last buffer is full
-			OutputBuffer *nextBuffer;
-			if (!Allocate(nextBuffer))
-			{
-				// We cannot store any more data, stop here
-				hadOverflow = true;
-				break;
-			}
-			nextBuffer->references = references;
-			last->next = nextBuffer;
-			last = nextBuffer->last;
-			for (OutputBuffer *item = Next(); item != nextBuffer; item = item->Next())
-			{
-				item->last = last;
-			}
+			// We cannot store any more data, stop here
+			hadOverflow = true;
+			break;
 		}
-		const size_t copyLength = min<size_t>(len - copied, OUTPUT_BUFFER_SIZE - last->dataLength);
+		const size_t copyLength = min<size_t>(len - copied, last->capacity - last->dataLength);
 		memcpy(last->data + last->dataLength, src + copied, copyLength);
 		last->dataLength += copyLength;
 		copied += copyLength;
@@ -230,6 +204,67 @@ size_t OutputBuffer::cat(StringRef &str)
 	return cat(str.c_str(), str.strlen());
 }
 
+size_t OutputBuffer::catUInt(uint32_t val)
+{
+	char buf[10];
+	const char * const p = FormatUnsigned(buf + sizeof(buf), val);
+	return cat(p, buf + sizeof(buf) - p);
+}
+
+size_t OutputBuffer::catInt(int32_t val)
+{
+	return (val < 0) ? cat('-') + catUInt(-(uint32_t)val) : catUInt((uint32_t)val);
+}
+
+// Append a floating point number with the specified number of decimal places, as "%.*f" would but without using double precision arithmetic
+size_t OutputBuffer::catFloat(float val, unsigned int decimals)
+{
+	char buf[FastFloatBufferSize];
+	const char * const p = FormatFloatFixed(buf + sizeof(buf), val, decimals);
+	return (p == nullptr) ? catf("%.*f", (int)decimals, (double)val) : cat(p, buf + sizeof(buf) - p);
+}
+
+// Try to grow the chunk of this buffer into the free granules that follow it, so that it can hold up to another bytesWanted bytes.
+// Return true if we grew it at all.
+bool OutputBuffer::Extend(size_t bytesWanted)
+{
+	TaskCriticalSectionLocker lock;
+
+	const size_t firstNewGranule = (data - arena + capacity)/OUTPUT_BUFFER_GRANULE;
+	const size_t maxNewGranules = min<size_t>(min<size_t>(GranulesNeeded(bytesWanted), MaxChunkGranules - capacity/OUTPUT_BUFFER_GRANULE), NumGranules - firstNewGranule);
+	size_t numNewGranules = 0;
+	while (numNewGranules < maxNewGranules && IsGranuleFree(firstNewGranule + numNewGranules))
+	{
+		++numNewGranules;
+	}
+
+	if (numNewGranules == 0)
+	{
+		return false;
+	}
+	MarkGranules(firstNewGranule, numNewGranules, true);
+	capacity += numNewGranules * OUTPUT_BUFFER_GRANULE;
+	return true;
+}
+
+// Allocate a new buffer with space for bytesWanted bytes and add it to the end of this chain. Return the new buffer, or nullptr if we couldn't allocate one.
+OutputBuffer *OutputBuffer::AddBuffer(size_t bytesWanted)
+{
+	OutputBuffer *nextBuffer;
+	if (!Allocate(nextBuffer, bytesWanted))
+	{
+		return nullptr;
+	}
+
+	nextBuffer->references = references;
+	last->next = nextBuffer;
+	for (OutputBuffer *item = this; item != nextBuffer; item = item->Next())
+	{
+		item->last = nextBuffer;
+	}
+	return nextBuffer;
+}
+
 // Encode a string in JSON format and append it to a string buffer and return the number of bytes written
 size_t OutputBuffer::EncodeString(const char *src, size_t srcLength, bool allowControlChars, bool encapsulateString, bool prependAsterisk)
 {
@@ -347,27 +382,34 @@ bool OutputBuffer::WriteToFile(FileData& f) const
 /*static*/ void OutputBuffer::Init()
 {
 	freeOutputBuffers = nullptr;
-	for (size_t i = 0; i < OUTPUT_BUFFER_COUNT; i++)
+	for (size_t i = 0; i < OUTPUT_BUFFER_HEADERS; i++)
 	{
 		freeOutputBuffers = new OutputBuffer(freeOutputBuffers);
 	}
+	poolStats.Created(OUTPUT_BUFFER_HEADERS);
+	memset(granuleMap, 0, sizeof(granuleMap));
+	usedGranules = maxUsedGranules = 0;
 }
 
 // Allocates an output buffer instance which can be used for (large) string outputs. This must be thread safe. Not safe to call from interrupts!
-/*static*/ bool OutputBuffer::Allocate(OutputBuffer *&buf)
+// We give it a chunk at the start of the largest free area of the arena, so that it has the best chance of growing in place.
+/*static*/ bool OutputBuffer::Allocate(OutputBuffer *&buf, size_t sizeHint)
 {
 	{
 		TaskCriticalSectionLocker lock;
 
 		buf = freeOutputBuffers;
-		if (buf != nullptr)
+		size_t firstGranule;
+		const size_t freeGranules = FindLargestFreeRun(firstGranule);
+		if (buf != nullptr && freeGranules != 0)
 		{
+			const size_t numGranules = min<size_t>(min<size_t>(GranulesNeeded(sizeHint), MaxChunkGranules), freeGranules);
+			MarkGranules(firstGranule, numGranules, true);
+			buf->data = arena + firstGranule * OUTPUT_BUFFER_GRANULE;
+			buf->capacity = numGranules * OUTPUT_BUFFER_GRANULE;
+
 			freeOutputBuffers = buf->next;
-			usedOutputBuffers++;
-			if (usedOutputBuffers > maxUsedOutputBuffers)
-			{
-				maxUsedOutputBuffers = usedOutputBuffers;
-			}
+			poolStats.Allocated();
 
 			// Initialise the buffer before we release the lock in case another task uses it immediately
 			buf->next = nullptr;
@@ -379,8 +421,10 @@ bool OutputBuffer::WriteToFile(FileData& f) const
 
 			return true;
 		}
+		poolStats.Failed();
 	}
 
+	buf = nullptr;
 	reprap.GetPlatform().LogError(ErrorCode::OutputStarvation);
 	return false;
 }
@@ -388,16 +432,17 @@ bool OutputBuffer::WriteToFile(FileData& f) const
 // Get the number of bytes left for continuous writing
 /*static*/ size_t OutputBuffer::GetBytesLeft(const OutputBuffer *writingBuffer)
 {
-	const size_t freeOutputBuffers = OUTPUT_BUFFER_COUNT - usedOutputBuffers;
-	const size_t bytesLeft = OUTPUT_BUFFER_SIZE - writingBuffer->last->DataLength();
+	constexpr size_t ReservedBytes = RESERVED_OUTPUT_BUFFERS * OUTPUT_BUFFER_SIZE;
+	const size_t freeBytes = (NumGranules - usedGranules) * OUTPUT_BUFFER_GRANULE;
+	const size_t bytesLeft = (writingBuffer == nullptr) ? 0 : writingBuffer->last->capacity - writingBuffer->last->DataLength();
 
-	if (freeOutputBuffers < RESERVED_OUTPUT_BUFFERS)
+	if (freeBytes < ReservedBytes || GetFreeBuffers() < RESERVED_OUTPUT_BUFFERS)
 	{
 		// Keep some space left to encapsulate the responses (e.g. via an HTTP header)
 		return bytesLeft;
 	}
 
-	return bytesLeft + (freeOutputBuffers - RESERVED_OUTPUT_BUFFERS) * OUTPUT_BUFFER_SIZE;
+	return bytesLeft + freeBytes - ReservedBytes;
 }
 
 // Truncate an output buffer to free up more memory. Returns the number of released bytes.
@@ -425,8 +470,8 @@ bool OutputBuffer::WriteToFile(FileData& f) const
 
 		// Unlink and free the last entry
 		previousItem->next = nullptr;
+		releasedBytes += lastItem->capacity;
 		Release(lastItem);
-		releasedBytes += OUTPUT_BUFFER_SIZE;
 	} while (previousItem != buffer && releasedBytes < bytesNeeded);
 
 	// Update all the references to the last item
@@ -451,10 +496,13 @@ bool OutputBuffer::WriteToFile(FileData& f) const
 	}
 	else
 	{
-		// Otherwise prepend it to the list of free output buffers again
+		// Otherwise give its chunk back to the arena and prepend it to the list of free output buffers again
+		MarkGranules((buf->data - arena)/OUTPUT_BUFFER_GRANULE, buf->capacity/OUTPUT_BUFFER_GRANULE, false);
+		buf->data = nullptr;
+		buf->capacity = 0;
 		buf->next = freeOutputBuffers;
 		freeOutputBuffers = buf;
-		usedOutputBuffers--;
+		poolStats.Released();
 	}
 	return nextBuffer;
 }
@@ -467,10 +515,68 @@ bool OutputBuffer::WriteToFile(FileData& f) const
 	}
 }
 
+// Mark some granules of the arena as used or free. Must be called with the task critical section held.
+/*static*/ void OutputBuffer::MarkGranules(size_t first, size_t count, bool used)
+{
+	for (size_t granule = first; granule < first + count; ++granule)
+	{
+		if (used)
+		{
+			granuleMap[granule/32] |= 1u << (granule % 32);
+		}
+		else
+		{
+			granuleMap[granule/32] &= ~(1u << (granule % 32));
+		}
+	}
+
+	if (used)
+	{
+		usedGranules += count;
+		if (usedGranules > maxUsedGranules)
+		{
+			maxUsedGranules = usedGranules;
+		}
+	}
+	else
+	{
+		usedGranules -= count;
+	}
+}
+
+// Find the largest run of free granules in the arena, returning its length and setting 'first' to the first granule in it.
+// Must be called with the task critical section held.
+/*static*/ size_t OutputBuffer::FindLargestFreeRun(size_t& first)
+{
+	size_t bestLength = 0, runStart = 0, runLength = 0;
+	for (size_t granule = 0; granule < NumGranules; ++granule)
+	{
+		if (IsGranuleFree(granule))
+		{
+			if (runLength == 0)
+			{
+				runStart = granule;
+			}
+			++runLength;
+			if (runLength > bestLength)
+			{
+				bestLength = runLength;
+				first = runStart;
+			}
+		}
+		else
+		{
+			runLength = 0;
+		}
+	}
+	return bestLength;
+}
+
 /*static*/ void OutputBuffer::Diagnostics(MessageType mtype)
 {
-	reprap.GetPlatform().MessageF(mtype, "Used output buffers: %d of %d (%d max)\n",
-			usedOutputBuffers, OUTPUT_BUFFER_COUNT, maxUsedOutputBuffers);
+	reprap.GetPlatform().MessageF(mtype, "Used output buffers: %" PRIu32 " of %d (%" PRIu32 " max), output memory: %u of %u bytes used (%u max)\n",
+			poolStats.GetNumInUse(), OUTPUT_BUFFER_HEADERS, poolStats.GetMaxInUse(),
+			usedGranules * OUTPUT_BUFFER_GRANULE, OUTPUT_BUFFER_ARENA_SIZE, maxUsedGranules * OUTPUT_BUFFER_GRANULE);
 }
 
 //*************************************************************************************************
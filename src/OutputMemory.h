@@ -11,6 +11,7 @@
 #include "RepRapFirmware.h"
 #include "MessageType.h"
 #include "Storage/FileData.h"
+#include "Libraries/General/PoolStats.h"
 
 const size_t OUTPUT_STACK_DEPTH = 4;	// Number of OutputBuffer chains that can be pushed onto one stack instance
 
@@ -22,7 +23,7 @@ class OutputBuffer
 	public:
 		friend class OutputStack;
 
-		OutputBuffer(OutputBuffer *n) : next(n) { }
+		OutputBuffer(OutputBuffer *n) : next(n), data(nullptr), capacity(0) { }
 
 		void Append(OutputBuffer *other);
 		OutputBuffer *Next() const { return next; }
@@ -54,6 +55,11 @@ class OutputBuffer
 		size_t cat(const char *src, size_t len);
 		size_t cat(StringRef &str);
 
+		// Fast number formatting for JSON responses, which avoids parsing a printf format string each time
+		size_t catInt(int32_t val);
+		size_t catUInt(uint32_t val);
+		size_t catFloat(float val, unsigned int decimals);
+
 		size_t EncodeString(const char *src, size_t srcLength, bool allowControlChars, bool encapsulateString = true, bool prependAsterisk = false);
 		size_t EncodeString(const StringRef& str, bool allowControlChars, bool encapsulateString = true);
 		size_t EncodeReply(OutputBuffer *src, bool allowControlChars);
@@ -67,7 +73,8 @@ class OutputBuffer
 		static void Init();
 
 		// Allocate an unused OutputBuffer instance. Returns true on success or false if no instance could be allocated.
-		static bool Allocate(OutputBuffer *&buf);
+		// If we know how much data will be written to it, pass that as sizeHint so that we can give it enough space to start with.
+		static bool Allocate(OutputBuffer *&buf, size_t sizeHint = 0);
 
 		// Get the number of bytes left for allocation. If writingBuffer is not NULL, this returns the number of free bytes for
 		// continuous writes, i.e. for writes that need to allocate an extra OutputBuffer instance to finish the message.
@@ -84,25 +91,39 @@ class OutputBuffer
 
 		static void Diagnostics(MessageType mtype);
 
-		static unsigned int GetFreeBuffers() { return OUTPUT_BUFFER_COUNT - usedOutputBuffers; }
+		static unsigned int GetFreeBuffers() { return OUTPUT_BUFFER_HEADERS - poolStats.GetNumInUse(); }
 
 	private:
+		static constexpr size_t NumGranules = OUTPUT_BUFFER_ARENA_SIZE/OUTPUT_BUFFER_GRANULE;
+		static constexpr size_t MaxChunkGranules = OUTPUT_BUFFER_MAX_CHUNK/OUTPUT_BUFFER_GRANULE;
+
+		bool Extend(size_t bytesWanted);
+		OutputBuffer *AddBuffer(size_t bytesWanted);
+
+		static size_t GranulesNeeded(size_t bytes) { return max<size_t>((bytes + OUTPUT_BUFFER_GRANULE - 1)/OUTPUT_BUFFER_GRANULE, 1); }
+		static bool IsGranuleFree(size_t granule) { return (granuleMap[granule/32] & (1u << (granule % 32))) == 0; }
+		static void MarkGranules(size_t first, size_t count, bool used);
+		static size_t FindLargestFreeRun(size_t& first);
 
 		OutputBuffer *next;
 		OutputBuffer *last;
 
 		uint32_t whenQueued;
 
-		char data[OUTPUT_BUFFER_SIZE];
+		char *data;											// the chunk of the arena that this buffer owns
+		size_t capacity;									// the size of that chunk, a multiple of OUTPUT_BUFFER_GRANULE
 		size_t dataLength, bytesRead;
 
 		bool isReferenced;
 		bool hadOverflow;
 		volatile size_t references;
 
-		static OutputBuffer * volatile freeOutputBuffers;		// Messages may be sent by multiple tasks
-		static volatile size_t usedOutputBuffers;				// so make these volatile.
-		static volatile size_t maxUsedOutputBuffers;
+		static OutputBuffer * volatile freeOutputBuffers;		// Messages may be sent by multiple tasks, so make this volatile
+		static PoolStats poolStats;								// usage of the buffer headers
+		static size_t usedGranules, maxUsedGranules;
+
+		alignas(4) static char arena[OUTPUT_BUFFER_ARENA_SIZE];
+		static uint32_t granuleMap[(NumGranules + 31)/32];		// one bit per granule of the arena, set if it is in use
 };
 
 inline uint32_t OutputBuffer::GetAge() const
@@ -138,6 +159,9 @@ class OutputStack
 		// Returns the last item from the stack or NULL if none is available
 		OutputBuffer *GetLastItem() const volatile;
 
+		// Returns the specified item from the stack or NULL if there are not that many items
+		OutputBuffer *GetItem(size_t index) const volatile { return (index < count) ? items[index] : nullptr; }
+
 		// Get the total length of all queued buffers
 		size_t DataLength() const volatile;
 
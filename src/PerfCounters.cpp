@@ -0,0 +1,232 @@
+/*
+ * PerfCounters.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "PerfCounters.h"
+#include "OutputMemory.h"
+#include "RepRap.h"
+#include "Movement/DDA.h"
+#include "Movement/Move.h"
+#include "Movement/StageTimer.h"
+#include "Storage/FileStore.h"
+#include "Libraries/General/PoolStats.h"
+
+#if SUPPORT_STORAGE_TASK
+# include "Storage/StorageService.h"
+#endif
+
+#if HAS_NETWORKING && !HAS_LEGACY_NETWORKING
+# include "Networking/HttpResponder.h"
+#endif
+
+uint32_t PerfCounters::lastSampleTime = 0;
+uint32_t PerfCounters::resetTime = 0;
+volatile bool PerfCounters::resetPending = false;
+
+PerfCounters::Count PerfCounters::stepEvents;
+PerfCounters::Count PerfCounters::stepsGenerated;
+PerfCounters::Count PerfCounters::hiccups;
+PerfCounters::Count PerfCounters::stepErrors;
+PerfCounters::Count PerfCounters::lookaheadUnderruns;
+PerfCounters::Count PerfCounters::prepareUnderruns;
+uint32_t PerfCounters::stepRateWindowStart = 0;
+uint32_t PerfCounters::stepRateWindowSteps = 0;
+uint32_t PerfCounters::peakStepRate = 0;
+
+PerfCounters::TimerTotals PerfCounters::initTimes;
+PerfCounters::TimerTotals PerfCounters::lookaheadTimes;
+PerfCounters::TimerTotals PerfCounters::prepareTimes;
+
+PerfCounters::Peak PerfCounters::longestSdWrite;
+#if SUPPORT_STORAGE_TASK
+PerfCounters::Count PerfCounters::storageRequests;
+PerfCounters::Peak PerfCounters::longestStorageRequest;
+#endif
+
+#if HAS_NETWORKING && !HAS_LEGACY_NETWORKING
+PerfCounters::Count PerfCounters::httpRequests;
+PerfCounters::Count PerfCounters::networkBytesSent;
+#endif
+
+PerfCounters::PoolTotals PerfCounters::pools[MaxPools];
+size_t PerfCounters::numPools = 0;
+
+void PerfCounters::TimerTotals::Update(const StageTimer& timer)
+{
+	const uint32_t newCount = timer.GetCount();
+	const uint64_t newCycles = timer.GetTotalCycles();
+	totalCycles += (newCount >= count.lastSeen) ? newCycles - lastCycles : newCycles;
+	lastCycles = newCycles;
+	count.Update(newCount);
+}
+
+/*static*/ void PerfCounters::Spin()
+{
+	if (resetPending)
+	{
+		DoReset();
+	}
+	else if (millis() - lastSampleTime >= SampleInterval)
+	{
+		Sample();
+	}
+}
+
+/*static*/ void PerfCounters::Sample()
+{
+	const uint32_t now = millis();
+	lastSampleTime = now;
+
+	Move& move = reprap.GetMove();
+	stepEvents.Update(DDA::numStepEvents);
+	stepsGenerated.Update(DDA::numStepsGenerated);
+	hiccups.Update(DDA::totalHiccups);
+	stepErrors.Update(move.GetStepErrors());
+	const MoveTotals& moveTotals = move.GetRunningTotals();
+	lookaheadUnderruns.Update(moveTotals.lookaheadUnderruns);
+	prepareUnderruns.Update(moveTotals.prepareUnderruns);
+
+	const uint32_t stepRateTime = now - stepRateWindowStart;
+	if (stepRateTime >= StepRateInterval)
+	{
+		const uint32_t stepRate = (uint32_t)(((uint64_t)(stepsGenerated.total - stepRateWindowSteps) * 1000u)/stepRateTime);
+		if (stepRate > peakStepRate)
+		{
+			peakStepRate = stepRate;
+		}
+		stepRateWindowStart = now;
+		stepRateWindowSteps = stepsGenerated.total;
+	}
+
+	initTimes.Update(move.GetInitTimer());
+	lookaheadTimes.Update(move.GetLookaheadTimer());
+	prepareTimes.Update(move.GetPrepareTimer());
+
+	longestSdWrite.Update(FileStore::GetLongestWriteClocks());
+#if SUPPORT_STORAGE_TASK
+	storageRequests.Update(StorageService::GetNumRequests());
+	longestStorageRequest.Update(StorageService::GetLongestRequestTime());
+#endif
+
+#if HAS_NETWORKING && !HAS_LEGACY_NETWORKING
+	httpRequests.Update(HttpResponder::GetNumRequests());
+	networkBytesSent.Update(NetworkResponder::GetBytesSent());
+#endif
+
+	for (const PoolStats *ps = PoolStats::GetStatsList(); ps != nullptr; ps = ps->GetNext())
+	{
+		size_t i = 0;
+		while (i < numPools && pools[i].pool != ps)
+		{
+			++i;
+		}
+		if (i == numPools)
+		{
+			if (numPools == MaxPools)
+			{
+				continue;
+			}
+			pools[i].pool = ps;
+			++numPools;
+		}
+		pools[i].maxInUse.Update(ps->GetMaxInUse());
+		pools[i].failures.Update(ps->GetNumFailures());
+	}
+}
+
+/*static*/ void PerfCounters::Reset()
+{
+	resetPending = true;
+}
+
+// Clear the totals. Sample first, so that the increases before now aren't counted in the new totals.
+/*static*/ void PerfCounters::DoReset()
+{
+	Sample();
+	resetPending = false;
+	resetTime = stepRateWindowStart = lastSampleTime;
+
+	stepEvents.total = stepsGenerated.total = hiccups.total = stepErrors.total = 0;
+	lookaheadUnderruns.total = prepareUnderruns.total = 0;
+	stepRateWindowSteps = peakStepRate = 0;
+
+	initTimes.Clear();
+	lookaheadTimes.Clear();
+	prepareTimes.Clear();
+
+	longestSdWrite.peak = 0;
+#if SUPPORT_STORAGE_TASK
+	storageRequests.total = longestStorageRequest.peak = 0;
+#endif
+
+#if HAS_NETWORKING && !HAS_LEGACY_NETWORKING
+	httpRequests.total = networkBytesSent.total = 0;
+#endif
+
+	for (size_t i = 0; i < numPools; ++i)
+	{
+		pools[i].maxInUse.peak = pools[i].pool->GetNumInUse();
+		pools[i].failures.total = 0;
+	}
+}
+
+/*static*/ void PerfCounters::AppendTimer(OutputBuffer *response, const char *name, const TimerTotals& timer)
+{
+	const uint32_t meanCycles = (timer.count.total == 0) ? 0 : (uint32_t)(timer.totalCycles/timer.count.total);
+	response->catf("\"%s\":{\"count\":%" PRIu32 ",\"mean\":", name, timer.count.total);
+	response->catFloat(StageTimer::CyclesToMicroseconds(meanCycles), 1);
+	response->cat('}');
+}
+
+// Get the counters as a JSON object. Times are in seconds, except for the planner stages which are in microseconds and the storage latencies which are in milliseconds.
+/*static*/ OutputBuffer *PerfCounters::GetJsonResponse()
+{
+	OutputBuffer *response;
+	if (!OutputBuffer::Allocate(response))
+	{
+		return nullptr;
+	}
+
+	response->printf("{\"ver\":%u,\"time\":%" PRIu32, Version, (millis() - resetTime)/1000);
+
+	response->catf(",\"move\":{\"stepEvents\":%" PRIu32 ",\"steps\":%" PRIu32 ",\"peakStepRate\":%" PRIu32 ",\"hiccups\":%" PRIu32 ",\"stepErrors\":%" PRIu32,
+					stepEvents.total, stepsGenerated.total, peakStepRate, hiccups.total, stepErrors.total);
+	response->catf(",\"lookaheadUnderruns\":%" PRIu32 ",\"prepareUnderruns\":%" PRIu32 "}", lookaheadUnderruns.total, prepareUnderruns.total);
+
+	response->cat(",\"planner\":{");
+	AppendTimer(response, "init", initTimes);
+	response->cat(',');
+	AppendTimer(response, "lookahead", lookaheadTimes);
+	response->cat(',');
+	AppendTimer(response, "prepare", prepareTimes);
+
+	response->cat("},\"storage\":{\"maxWrite\":");
+	response->catFloat((float)longestSdWrite.peak * StepClocksToMillis, 1);
+#if SUPPORT_STORAGE_TASK
+	response->catf(",\"requests\":%" PRIu32 ",\"maxRequest\":%" PRIu32, storageRequests.total, longestStorageRequest.peak);
+#endif
+
+#if HAS_NETWORKING && !HAS_LEGACY_NETWORKING
+	response->catf("},\"network\":{\"requests\":%" PRIu32 ",\"bytesSent\":%" PRIu32, httpRequests.total, networkBytesSent.total);
+#endif
+
+	response->cat("},\"pools\":{");
+	for (size_t i = 0; i < numPools; ++i)
+	{
+		if (i != 0)
+		{
+			response->cat(',');
+		}
+		const char * const name = pools[i].pool->GetName();
+		response->EncodeString(name, strlen(name), false);
+		response->catf(":{\"max\":%" PRIu32 ",\"size\":%" PRIu32 ",\"fails\":%" PRIu32 "}",
+						pools[i].maxInUse.peak, pools[i].pool->GetCapacity(), pools[i].failures.total);
+	}
+	response->cat("}}");
+
+	return response;
+}
+
+// End
@@ -0,0 +1,112 @@
+/*
+ * PerfCounters.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  Throughput counters for comparing firmware builds and configurations, reported as a JSON object by M408 S7 and rr_perf.
+ *  Most of the counters they are built from are cleared when M122 reports them, so we sample them regularly and accumulate the increases
+ *  instead. That way M122 doesn't disturb the totals, and the totals can be reset at the start of each print so that they cover one job.
+ *  The names of the members of the JSON object don't change between builds, and members are only added, so that scripts can rely on them.
+ */
+
+#ifndef SRC_PERFCOUNTERS_H_
+#define SRC_PERFCOUNTERS_H_
+
+#include "RepRapFirmware.h"
+
+class OutputBuffer;
+class PoolStats;
+class StageTimer;
+
+class PerfCounters
+{
+public:
+	static void Spin();								// called by RepRap to sample the counters
+	static void Sample();							// sample the counters now, called before M122 clears them
+	static void Reset();							// start new totals at the next call to Spin, so that this can be called from any task
+	static OutputBuffer *GetJsonResponse();			// get the counters as a JSON object for M408 S7 or rr_perf, or nullptr if no buffer is available
+
+private:
+	static constexpr unsigned int Version = 1;					// the "ver" member of the response, incremented if a member changes meaning
+	static constexpr uint32_t SampleInterval = 250;				// how often we sample the counters in milliseconds
+	static constexpr uint32_t StepRateInterval = 1000;			// the period over which we measure the step rate, in milliseconds
+	static constexpr size_t MaxPools = 16;						// the maximum number of pools we keep high-water marks for
+
+	// A count that other code may clear. We add the increase since we last looked at it to our total.
+	struct Count
+	{
+		uint32_t lastSeen;
+		uint32_t total;
+
+		void Update(uint32_t now) { total += (now >= lastSeen) ? now - lastSeen : now; lastSeen = now; }
+	};
+
+	// A maximum that other code may clear. We only take a value when it changes, so that a maximum from before a Reset isn't reported again.
+	struct Peak
+	{
+		uint32_t lastSeen;
+		uint32_t peak;
+
+		void Update(uint32_t now) { if (now != lastSeen) { lastSeen = now; if (now > peak) { peak = now; } } }
+	};
+
+	// The totals of a StageTimer, which M122 resets
+	struct TimerTotals
+	{
+		Count count;
+		uint64_t lastCycles;
+		uint64_t totalCycles;
+
+		void Update(const StageTimer& timer);
+		void Clear() { count.total = 0; totalCycles = 0; }
+	};
+
+	struct PoolTotals
+	{
+		const PoolStats *pool;
+		Peak maxInUse;
+		Count failures;
+	};
+
+	static void DoReset();
+	static void AppendTimer(OutputBuffer *response, const char *name, const TimerTotals& timer);
+
+	static uint32_t lastSampleTime;
+	static uint32_t resetTime;
+	static volatile bool resetPending;
+
+	// Move execution
+	static Count stepEvents;
+	static Count stepsGenerated;
+	static Count hiccups;
+	static Count stepErrors;
+	static Count lookaheadUnderruns;
+	static Count prepareUnderruns;
+	static uint32_t stepRateWindowStart;						// when we started the current step rate measurement
+	static uint32_t stepRateWindowSteps;						// stepsGenerated.total at that time
+	static uint32_t peakStepRate;								// steps per second
+
+	// Planner stages
+	static TimerTotals initTimes;
+	static TimerTotals lookaheadTimes;
+	static TimerTotals prepareTimes;
+
+	// Storage
+	static Peak longestSdWrite;									// in step clocks
+#if SUPPORT_STORAGE_TASK
+	static Count storageRequests;
+	static Peak longestStorageRequest;							// in milliseconds
+#endif
+
+	// Network
+#if HAS_NETWORKING && !HAS_LEGACY_NETWORKING
+	static Count httpRequests;
+	static Count networkBytesSent;
+#endif
+
+	// Pools
+	static PoolTotals pools[MaxPools];
+	static size_t numPools;
+};
+
+#endif /* SRC_PERFCOUNTERS_H_ */
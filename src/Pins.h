@@ -60,10 +60,121 @@
 # define SUPPORT_DOTSTAR_LED	0
 #endif
 
+#ifndef SUPPORT_INPUT_SHAPING
+# define SUPPORT_INPUT_SHAPING	0
+#endif
+
+#ifndef SUPPORT_STEP_TABLES
+# define SUPPORT_STEP_TABLES	0
+#endif
+
+#ifndef SUPPORT_STEP_TRACE
+# define SUPPORT_STEP_TRACE		0
+#endif
+
+#ifndef SUPPORT_MOVE_TRACE
+# define SUPPORT_MOVE_TRACE		0
+#endif
+
+#ifndef SUPPORT_MOVE_MERGING
+# define SUPPORT_MOVE_MERGING	0
+#endif
+
+#ifndef SUPPORT_HEATER_TRACE
+# define SUPPORT_HEATER_TRACE	0
+#endif
+
+#ifndef SUPPORT_TOOL_PREHEAT
+# define SUPPORT_TOOL_PREHEAT	0
+#endif
+
+#ifndef SUPPORT_ENDSTOP_INTERRUPTS
+# define SUPPORT_ENDSTOP_INTERRUPTS	0
+#endif
+
+#ifndef SUPPORT_KINEMATICS_BENCHMARK
+# define SUPPORT_KINEMATICS_BENCHMARK	0
+#endif
+
+#ifndef SUPPORT_MACRO_CACHE
+# define SUPPORT_MACRO_CACHE	0
+#endif
+
+#ifndef SUPPORT_WEB_FILE_CACHE
+# define SUPPORT_WEB_FILE_CACHE	0
+#endif
+
+#ifndef SUPPORT_WEB_FILE_TABLE
+# define SUPPORT_WEB_FILE_TABLE	0
+#endif
+
+#ifndef SUPPORT_COMPILED_CONFIG
+# define SUPPORT_COMPILED_CONFIG	0
+#endif
+
+#ifndef SUPPORT_FILE_INFO_INDEX
+# define SUPPORT_FILE_INFO_INDEX	0
+#endif
+
+#ifndef SUPPORT_RECENT_FILES
+# define SUPPORT_RECENT_FILES	0
+#endif
+
+#ifndef SUPPORT_SECTOR_CACHE
+# define SUPPORT_SECTOR_CACHE	0
+#endif
+
+#ifndef SUPPORT_STORAGE_TASK
+# define SUPPORT_STORAGE_TASK	0
+#endif
+
+#ifndef SUPPORT_RESUME_CHECKPOINT
+# define SUPPORT_RESUME_CHECKPOINT	0
+#endif
+
+#ifndef SUPPORT_AUX_PDC
+# define SUPPORT_AUX_PDC		0
+#endif
+
+#ifndef SUPPORT_LASER_RASTER
+# define SUPPORT_LASER_RASTER	0
+#endif
+
+#ifndef SUPPORT_HTTP_GZIP
+# define SUPPORT_HTTP_GZIP		0
+#endif
+
+#ifndef SUPPORT_USB_STREAMING
+# define SUPPORT_USB_STREAMING	0
+#endif
+
+#ifndef USE_FIXED_POINT_PREPARE
+# define USE_FIXED_POINT_PREPARE	0
+#endif
+
+#ifndef USE_DM_HEAP
+# define USE_DM_HEAP			0
+#endif
+
 #ifndef USE_CACHE
 # define USE_CACHE				0
 #endif
 
+#ifndef USE_TCM
+# define USE_TCM				0
+#endif
+
+// Placement of the step interrupt code and data in tightly-coupled memory, so that the step ISR doesn't suffer flash wait states or cache misses.
+// The linker script must copy .itcm into ITCM at startup in the same way as .ramfunc, and must zero-fill .dtcm, so that objects placed in
+// DTCM must either be zero-initialised or constructed at runtime. The GPNVM bits must also be set to enable the TCMs.
+#if USE_TCM
+# define ITCM_CODE				__attribute__ ((section(".itcm"), noinline))
+# define DTCM_DATA				__attribute__ ((section(".dtcm")))
+#else
+# define ITCM_CODE
+# define DTCM_DATA
+#endif
+
 #ifndef SUPPORT_TMC2660
 # define SUPPORT_TMC2660		0
 #endif
@@ -75,6 +186,10 @@
 #define HAS_SMART_DRIVERS		(SUPPORT_TMC2660 || SUPPORT_TMC22xx)
 #define HAS_STALL_DETECT		SUPPORT_TMC2660
 
+#ifndef SUPPORT_MICROSTEP_SWITCHING
+# define SUPPORT_MICROSTEP_SWITCHING	0
+#endif
+
 // HAS_LWIP_NETWORKING refers to Lwip 2 support in the Networking folder, not legacy SAM3XA networking using Lwip 1
 #ifndef HAS_LWIP_NETWORKING
 # define HAS_LWIP_NETWORKING	0
@@ -99,4 +214,12 @@
 # error DHT sensor support requires RTOS
 #endif
 
+#if SUPPORT_MICROSTEP_SWITCHING && !HAS_SMART_DRIVERS
+# error Microstep switching needs smart drivers
+#endif
+
+#if SUPPORT_STORAGE_TASK && !defined(RTOS)
+# error Storage task support requires RTOS
+#endif
+
 #endif // PINS_H__
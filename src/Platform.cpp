@@ -24,6 +24,7 @@
 #include "Heating/Heat.h"
 #include "Movement/DDA.h"
 #include "Movement/Move.h"
+#include "Movement/StepTracer.h"
 #include "Network.h"
 #include "PrintMonitor.h"
 #include "FilamentMonitors/FilamentMonitor.h"
@@ -34,10 +35,15 @@
 #include "Logger.h"
 #include "Tasks.h"
 #include "Libraries/Math/Isqrt.h"
+#include "Libraries/Fatfs/diskio.h"
+#include "Storage/StorageService.h"
 #include "Wire.h"
 
 #include "sam/drivers/tc/tc.h"
 #include "sam/drivers/hsmci/hsmci.h"
+#if SUPPORT_AUX_PDC
+# include "sam/drivers/pdc/pdc.h"
+#endif
 
 #include "sd_mmc.h"
 
@@ -129,6 +135,12 @@ uint32_t nextInterruptScheduledAt = 0;
 uint32_t lastInterruptTime = 0;
 #endif
 
+#ifdef RTOS
+constexpr unsigned int TickTaskStackWords = 200;		// the tick task just updates the ADC filters and the Z probe reading
+static Task<TickTaskStackWords> tickTask;
+extern "C" void TickTask(void * pvParameters);
+#endif
+
 //#define SOFT_TIMER_DEBUG
 
 #ifdef SOFT_TIMER_DEBUG
@@ -171,12 +183,13 @@ extern "C" void UrgentInit()
 uint8_t Platform::softwareResetDebugInfo = 0;			// extra info for debugging
 
 Platform::Platform() :
-		logger(nullptr), board(DEFAULT_BOARD_TYPE), active(false), errorCodeBits(0),
+		logger(nullptr), firmwareStagingFile(nullptr), board(DEFAULT_BOARD_TYPE), active(false), errorCodeBits(0),
 #if HAS_SMART_DRIVERS
 		nextDriveToPoll(0),
 		onBoardDriversFanRunning(false), offBoardDriversFanRunning(false), onBoardDriversFanStartMillis(0), offBoardDriversFanStartMillis(0),
 #endif
-		lastFanCheckTime(0), auxGCodeReply(nullptr), tickState(0), debugCode(0), lastWarningMillis(0), deliberateError(false), i2cInitialised(false)
+		lastFanCheckTime(0), auxGCodeReply(nullptr), tickState(0),
+		tickIsrTimer("Tick ISR"), adcTickTimer("Tick ADC and Z probe"), adcFilterTimer("ADC filters"), debugCode(0), lastWarningMillis(0), deliberateError(false), i2cInitialised(false)
 {
 	// Files
 	massStorage = new MassStorage(this);
@@ -235,6 +248,9 @@ void Platform::Init()
 	auxMutex.Create("Aux");
 	auxDetected = false;
 	auxSeq = 0;
+# if SUPPORT_AUX_PDC
+	auxPdcBusy = false;
+# endif
 #endif
 
 	SERIAL_MAIN_DEVICE.begin(baudRates[0]);
@@ -250,6 +266,7 @@ void Platform::Init()
 
 	// File management
 	massStorage->Init();
+	logDir.copy(SYS_DIR);
 
 	ARRAY_INIT(ipAddress, DefaultIpAddress);
 	ARRAY_INIT(netMask, DefaultNetMask);
@@ -413,6 +430,12 @@ void Platform::Init()
 	}
 	slowDriversBitmap = 0;										// assume no drivers need extended step pulse timing
 
+	pressureAdvanceSmoothingTime = 0.0;
+#if SUPPORT_ENDSTOP_INTERRUPTS
+	endstopInterruptDrives = 0;
+	endstopChanged = false;
+	useEndstopInterrupts = zProbeInterruptAttached = false;
+#endif
 	for (size_t extr = 0; extr < MaxExtruders; ++extr)
 	{
 		extruderDrivers[extr] = (uint8_t)(extr + MinAxes);		// set up default extruder drive mapping
@@ -474,7 +497,7 @@ void Platform::Init()
 #endif
 
 #if HAS_VOLTAGE_MONITOR
-	autoSaveEnabled = false;
+	autoSaveEnabled = powerFailFastPathArmed = false;
 	autoSaveState = AutoSaveState::starting;
 #endif
 
@@ -538,6 +561,8 @@ void Platform::Init()
 	for (size_t filter = 0; filter < NumAdcFilters; ++filter)
 	{
 		adcFilters[filter].Init(0);
+		adcOversampleSums[filter] = 0;
+		adcOversampleCounts[filter] = 0;
 		AnalogInEnableChannel(filteredAdcChannels[filter], true);
 	}
 
@@ -613,6 +638,7 @@ void Platform::InitZProbe()
 {
 	zProbeOnFilter.Init(0);
 	zProbeOffFilter.Init(0);
+	zProbeRawTriggered = false;
 
 #ifdef DUET_06_085
 	zProbeModulationPin = (board == BoardType::Duet_07 || board == BoardType::Duet_085) ? Z_PROBE_MOD_PIN07 : Z_PROBE_MOD_PIN06;
@@ -779,6 +805,9 @@ void Platform::SetZProbeType(unsigned int pt)
 {
 	zProbeType = (pt < (unsigned int)ZProbeType::numTypes) ? (ZProbeType)pt : ZProbeType::none;
 	InitZProbe();
+#if SUPPORT_ENDSTOP_INTERRUPTS
+	UpdateEndstopInterrupts();
+#endif
 }
 
 void Platform::SetProbing(bool isProbing)
@@ -875,6 +904,13 @@ bool Platform::HomingZWithProbe() const
 	return zProbeType != ZProbeType::none && (endStopInputType[Z_AXIS] == EndStopInputType::zProbe || endStopPos[Z_AXIS] == EndStopPosition::noEndStop);
 }
 
+#if !defined(IFLASH_PAGE_SIZE) && defined(IFLASH0_PAGE_SIZE)
+# define IFLASH_PAGE_SIZE	IFLASH0_PAGE_SIZE
+#endif
+#if !defined(IFLASH_ADDR) && defined(IFLASH0_ADDR)
+# define IFLASH_ADDR		IFLASH0_ADDR
+#endif
+
 // Check the prerequisites for updating the main firmware. Return True if satisfied, else print a message to 'reply' and return false.
 bool Platform::CheckFirmwareUpdatePrerequisites(const StringRef& reply)
 {
@@ -910,6 +946,116 @@ bool Platform::CheckFirmwareUpdatePrerequisites(const StringRef& reply)
 	return true;
 }
 
+// Start verifying the main firmware binary in the background. We can do this while printing, so that the firmware is known to be good
+// before the machine is taken out of service to install it. The CRC of the whole file is reported when the check is complete.
+// M997 V1 C"crc" also checks the CRC against the expected value, which is given in hexadecimal.
+GCodeResult Platform::StageFirmwareUpdate(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (firmwareStagingFile != nullptr)
+	{
+		reply.copy("The firmware binary is already being verified");
+		return GCodeResult::error;
+	}
+
+	if (!CheckFirmwareUpdatePrerequisites(reply))
+	{
+		return GCodeResult::error;
+	}
+
+	firmwareCheckCrc = gb.Seen('C');
+	if (firmwareCheckCrc)
+	{
+		String<12> crcString;
+		gb.GetPossiblyQuotedString(crcString.GetRef());
+		const char *endptr;
+		firmwareExpectedCrc = SafeStrtoul(crcString.c_str(), &endptr, 16);
+		if (crcString.IsEmpty() || *endptr != 0)
+		{
+			reply.copy("Expected CRC must be a hexadecimal number");
+			return GCodeResult::error;
+		}
+	}
+
+	FileStore * const firmwareFile = OpenFile(GetSysDir(), IAP_FIRMWARE_FILE, OpenMode::read);
+	if (firmwareFile == nullptr)
+	{
+		reply.printf("Firmware binary \"%s\" not found", IAP_FIRMWARE_FILE);
+		return GCodeResult::error;
+	}
+
+	// The binary must fit below the IAP area, and the second word is the reset vector, which must be a Thumb address within the binary
+	const FilePosition length = firmwareFile->Length();
+	uint32_t vectors[2];
+	const bool ok = firmwareFile->Read(reinterpret_cast<char*>(vectors), sizeof(vectors)) == (int)sizeof(vectors)
+					&& length <= IAP_FLASH_START - IFLASH_ADDR
+					&& (vectors[1] & 1) != 0 && vectors[1] >= IFLASH_ADDR && vectors[1] < IFLASH_ADDR + length
+					&& firmwareFile->Seek(0);
+	if (!ok)
+	{
+		firmwareFile->Close();
+		reply.printf("Firmware binary \"%s\" is not valid for this electronics", IAP_FIRMWARE_FILE);
+		return GCodeResult::error;
+	}
+
+	firmwareStagingCrc.Reset();
+	firmwareStagingFile = firmwareFile;
+	reply.printf("Verifying firmware binary \"%s\"", IAP_FIRMWARE_FILE);
+	return GCodeResult::ok;
+}
+
+// Read the next part of the firmware binary that we are verifying, reporting the result when we reach the end
+void Platform::SpinFirmwareStaging()
+{
+	char buf[512];
+	const int bytesRead = firmwareStagingFile->Read(buf, sizeof(buf));
+	if (bytesRead > 0)
+	{
+		firmwareStagingCrc.Update(buf, bytesRead);
+		return;
+	}
+
+	const FilePosition length = firmwareStagingFile->Length();
+	firmwareStagingFile->Close();
+	firmwareStagingFile = nullptr;
+	if (bytesRead < 0)
+	{
+		MessageF(ErrorMessage, "Failed to read firmware binary \"%s\"\n", IAP_FIRMWARE_FILE);
+	}
+	else if (firmwareCheckCrc && firmwareStagingCrc.Get() != firmwareExpectedCrc)
+	{
+		MessageF(ErrorMessage, "Firmware binary \"%s\" has CRC %08" PRIx32 " but %08" PRIx32 " was expected\n",
+					IAP_FIRMWARE_FILE, firmwareStagingCrc.Get(), firmwareExpectedCrc);
+	}
+	else
+	{
+		MessageF(GenericMessage, "Firmware binary \"%s\" verified, %" PRIu32 " bytes, CRC %08" PRIx32 "\n",
+					IAP_FIRMWARE_FILE, length, firmwareStagingCrc.Get());
+	}
+}
+
+// Return true if the IAP area of flash memory already holds the IAP binary followed by zeros, as written by a previous firmware update.
+// This saves erasing and writing the IAP area again, which is the slowest part of installing new firmware. The file is left at the start.
+bool Platform::IapFlashMatches(FileStore *iapFile)
+{
+	uint32_t data32[IFLASH_PAGE_SIZE/4];
+	char* const data = reinterpret_cast<char *>(data32);
+	bool matches = true;
+	for (uint32_t flashAddr = IAP_FLASH_START; matches && flashAddr < IAP_FLASH_END; flashAddr += IFLASH_PAGE_SIZE)
+	{
+		const int bytesRead = iapFile->Read(data, IFLASH_PAGE_SIZE);
+		if (bytesRead < 0)
+		{
+			matches = false;
+		}
+		else
+		{
+			memset(data + bytesRead, 0, IFLASH_PAGE_SIZE - bytesRead);
+			matches = memcmp(reinterpret_cast<const void *>(flashAddr), data, min<size_t>(IFLASH_PAGE_SIZE, IAP_FLASH_END + 1 - flashAddr)) == 0;
+		}
+	}
+	return iapFile->Seek(0) && matches;
+}
+
 // Update the firmware. Prerequisites should be checked before calling this.
 void Platform::UpdateFirmware()
 {
@@ -930,121 +1076,123 @@ void Platform::UpdateFirmware()
 	// Step 0 - disable the cache because it seems to interfere with flash memory access
 	DisableCache();
 
-	// Step 1 - Write update binary to Flash and overwrite the remaining space with zeros
-	// Leave the last 1KB of Flash memory untouched, so we can reuse the NvData after this update
-
-#if !defined(IFLASH_PAGE_SIZE) && defined(IFLASH0_PAGE_SIZE)
-# define IFLASH_PAGE_SIZE	IFLASH0_PAGE_SIZE
-#endif
-
-	// Use a 32-bit aligned buffer. This gives us the option of calling the EFC functions directly in future.
-	uint32_t data32[IFLASH_PAGE_SIZE/4];
-	char* const data = reinterpret_cast<char *>(data32);
+	// Step 1 - Write update binary to Flash and overwrite the remaining space with zeros, unless it is already there from a previous update
+	if (IapFlashMatches(iapFile))
+	{
+		MessageF(FirmwareUpdateMessage, "IAP already in flash memory\n");
+	}
+	else
+	{
+		// Leave the last 1KB of Flash memory untouched, so we can reuse the NvData after this update
+		// Use a 32-bit aligned buffer. This gives us the option of calling the EFC functions directly in future.
+		uint32_t data32[IFLASH_PAGE_SIZE/4];
+		char* const data = reinterpret_cast<char *>(data32);
 
 #if SAM4E || SAM4S || SAME70
-	// The EWP command is not supported for non-8KByte sectors in the SAM4 series.
-	// So we have to unlock and erase the complete 64Kb sector first.
-	flash_unlock(IAP_FLASH_START, IAP_FLASH_END, nullptr, nullptr);
-	flash_erase_sector(IAP_FLASH_START);
-
-	for (uint32_t flashAddr = IAP_FLASH_START; flashAddr < IAP_FLASH_END; flashAddr += IFLASH_PAGE_SIZE)
-	{
-		const int bytesRead = iapFile->Read(data, IFLASH_PAGE_SIZE);
+		// The EWP command is not supported for non-8KByte sectors in the SAM4 series.
+		// So we have to unlock and erase the complete 64Kb sector first.
+		flash_unlock(IAP_FLASH_START, IAP_FLASH_END, nullptr, nullptr);
+		flash_erase_sector(IAP_FLASH_START);
 
-		if (bytesRead > 0)
+		for (uint32_t flashAddr = IAP_FLASH_START; flashAddr < IAP_FLASH_END; flashAddr += IFLASH_PAGE_SIZE)
 		{
-			// Do we have to fill up the remaining buffer with zeros?
-			if (bytesRead != IFLASH_PAGE_SIZE)
+			const int bytesRead = iapFile->Read(data, IFLASH_PAGE_SIZE);
+
+			if (bytesRead > 0)
 			{
-				memset(data + bytesRead, 0, sizeof(data[0]) * (IFLASH_PAGE_SIZE - bytesRead));
-			}
+				// Do we have to fill up the remaining buffer with zeros?
+				if (bytesRead != IFLASH_PAGE_SIZE)
+				{
+					memset(data + bytesRead, 0, sizeof(data[0]) * (IFLASH_PAGE_SIZE - bytesRead));
+				}
 
-			// Write one page at a time
-			cpu_irq_disable();
-			const uint32_t rc = flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 0);
-			cpu_irq_enable();
+				// Write one page at a time
+				cpu_irq_disable();
+				const uint32_t rc = flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 0);
+				cpu_irq_enable();
 
-			if (rc != FLASH_RC_OK)
-			{
-				MessageF(FirmwareUpdateErrorMessage, "flash write failed, code=%" PRIu32 ", address=0x%08" PRIx32 "\n", rc, flashAddr);
-				return;
+				if (rc != FLASH_RC_OK)
+				{
+					MessageF(FirmwareUpdateErrorMessage, "flash write failed, code=%" PRIu32 ", address=0x%08" PRIx32 "\n", rc, flashAddr);
+					return;
+				}
+				// Verify written data
+				if (memcmp(reinterpret_cast<void *>(flashAddr), data, bytesRead) != 0)
+				{
+					MessageF(FirmwareUpdateErrorMessage, "verify during flash write failed, address=0x%08" PRIx32 "\n", flashAddr);
+					return;
+				}
 			}
-			// Verify written data
-			if (memcmp(reinterpret_cast<void *>(flashAddr), data, bytesRead) != 0)
+			else
 			{
-				MessageF(FirmwareUpdateErrorMessage, "verify during flash write failed, address=0x%08" PRIx32 "\n", flashAddr);
-				return;
+				// Fill up the remaining space with zeros
+				memset(data, 0, sizeof(data[0]) * sizeof(data));
+				cpu_irq_disable();
+				flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 0);
+				cpu_irq_enable();
 			}
 		}
-		else
-		{
-			// Fill up the remaining space with zeros
-			memset(data, 0, sizeof(data[0]) * sizeof(data));
-			cpu_irq_disable();
-			flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 0);
-			cpu_irq_enable();
-		}
-	}
 
-	// Re-lock the whole area
-	flash_lock(IAP_FLASH_START, IAP_FLASH_END, nullptr, nullptr);
+		// Re-lock the whole area
+		flash_lock(IAP_FLASH_START, IAP_FLASH_END, nullptr, nullptr);
 
 #else	// SAM3X code
 
-	for (uint32_t flashAddr = IAP_FLASH_START; flashAddr < IAP_FLASH_END; flashAddr += IFLASH_PAGE_SIZE)
-	{
-		const int bytesRead = iapFile->Read(data, IFLASH_PAGE_SIZE);
-
-		if (bytesRead > 0)
+		for (uint32_t flashAddr = IAP_FLASH_START; flashAddr < IAP_FLASH_END; flashAddr += IFLASH_PAGE_SIZE)
 		{
-			// Do we have to fill up the remaining buffer with zeros?
-			if (bytesRead != IFLASH_PAGE_SIZE)
+			const int bytesRead = iapFile->Read(data, IFLASH_PAGE_SIZE);
+
+			if (bytesRead > 0)
 			{
-				memset(data + bytesRead, 0, sizeof(data[0]) * (IFLASH_PAGE_SIZE - bytesRead));
-			}
+				// Do we have to fill up the remaining buffer with zeros?
+				if (bytesRead != IFLASH_PAGE_SIZE)
+				{
+					memset(data + bytesRead, 0, sizeof(data[0]) * (IFLASH_PAGE_SIZE - bytesRead));
+				}
 
-			// Write one page at a time
-			cpu_irq_disable();
+				// Write one page at a time
+				cpu_irq_disable();
 
-			const char* op = "unlock";
-			uint32_t rc = flash_unlock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
+				const char* op = "unlock";
+				uint32_t rc = flash_unlock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
 
-			if (rc == FLASH_RC_OK)
-			{
-				op = "write";
-				rc = flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 1);
-			}
-			if (rc == FLASH_RC_OK)
-			{
-				op = "lock";
-				rc = flash_lock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
-			}
-			cpu_irq_enable();
+				if (rc == FLASH_RC_OK)
+				{
+					op = "write";
+					rc = flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 1);
+				}
+				if (rc == FLASH_RC_OK)
+				{
+					op = "lock";
+					rc = flash_lock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
+				}
+				cpu_irq_enable();
 
-			if (rc != FLASH_RC_OK)
-			{
-				MessageF(FirmwareUpdateErrorMessage, "flash %s failed, code=%" PRIu32 ", address=0x%08" PRIx32 "\n", op, rc, flashAddr);
-				return;
+				if (rc != FLASH_RC_OK)
+				{
+					MessageF(FirmwareUpdateErrorMessage, "flash %s failed, code=%" PRIu32 ", address=0x%08" PRIx32 "\n", op, rc, flashAddr);
+					return;
+				}
+				// Verify written data
+				if (memcmp(reinterpret_cast<void *>(flashAddr), data, bytesRead) != 0)
+				{
+					MessageF(FirmwareUpdateErrorMessage, "verify during flash write failed, address=0x%08" PRIx32 "\n", flashAddr);
+					return;
+				}
 			}
-			// Verify written data
-			if (memcmp(reinterpret_cast<void *>(flashAddr), data, bytesRead) != 0)
+			else
 			{
-				MessageF(FirmwareUpdateErrorMessage, "verify during flash write failed, address=0x%08" PRIx32 "\n", flashAddr);
-				return;
+				// Fill up the remaining space
+				memset(data, 0, sizeof(data[0]) * sizeof(data));
+				cpu_irq_disable();
+				flash_unlock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
+				flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 1);
+				flash_lock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
+				cpu_irq_enable();
 			}
 		}
-		else
-		{
-			// Fill up the remaining space
-			memset(data, 0, sizeof(data[0]) * sizeof(data));
-			cpu_irq_disable();
-			flash_unlock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
-			flash_write(flashAddr, data, IFLASH_PAGE_SIZE, 1);
-			flash_lock(flashAddr, flashAddr + IFLASH_PAGE_SIZE - 1, nullptr, nullptr);
-			cpu_irq_enable();
-		}
-	}
 #endif
+	}
 
 	iapFile->Close();
 
@@ -1169,6 +1317,9 @@ void Platform::Exit()
 	// Close down USB and serial ports
 	SERIAL_MAIN_DEVICE.end();
 #ifdef SERIAL_AUX_DEVICE
+# if SUPPORT_AUX_PDC
+	AbortAuxPdc();
+# endif
 	SERIAL_AUX_DEVICE.end();
 #endif
 #ifdef SERIAL_AUX2_DEVICE
@@ -1222,6 +1373,16 @@ void Platform::SetNetMask(uint8_t nm[])
 	UpdateNetworkAddress(netMask, nm);
 }
 
+// Return true if there is anything waiting to be sent to the aux line
+bool Platform::AuxOutputPending() const
+{
+#ifdef SERIAL_AUX_DEVICE
+	return !auxOutput.IsEmpty();
+#else
+	return false;
+#endif
+}
+
 // Flush messages to aux, returning true if there is more to send
 bool Platform::FlushAuxMessages()
 {
@@ -1229,6 +1390,38 @@ bool Platform::FlushAuxMessages()
 	// Write non-blocking data to the AUX line
 	MutexLocker lock(auxMutex);
 	OutputBuffer *auxOutputBuffer = auxOutput.GetFirstItem();
+#if SUPPORT_AUX_PDC
+	// Send whole output buffers using the PDC, so that we don't have to copy them into the serial driver's ring buffer
+	// and take a transmit interrupt for every character. The buffer being sent stays at the head of the stack until the PDC has finished with it.
+	if (auxPdcBusy)
+	{
+		if ((AuxUart->UART_SR & UART_SR_ENDTX) == 0)
+		{
+			return true;										// still sending
+		}
+		uart_get_pdc_base(AuxUart)->PERIPH_PTCR = PERIPH_PTCR_TXTDIS;
+		auxPdcBusy = false;
+		auxOutputBuffer = OutputBuffer::Release(auxOutputBuffer);
+		auxOutput.SetFirstItem(auxOutputBuffer);
+	}
+
+	while (auxOutputBuffer != nullptr && auxOutputBuffer->BytesLeft() == 0)
+	{
+		auxOutputBuffer = OutputBuffer::Release(auxOutputBuffer);
+		auxOutput.SetFirstItem(auxOutputBuffer);
+	}
+
+	// Only start a transfer when the serial driver has finished sending, otherwise the two could interleave characters
+	if (auxOutputBuffer != nullptr && (AuxUart->UART_IMR & UART_IMR_TXRDY) == 0)
+	{
+		const size_t len = auxOutputBuffer->BytesLeft();
+		Pdc * const auxPdc = uart_get_pdc_base(AuxUart);
+		auxPdc->PERIPH_TPR = reinterpret_cast<uint32_t>(auxOutputBuffer->Read(len));
+		auxPdc->PERIPH_TCR = len;
+		auxPdcBusy = true;
+		auxPdc->PERIPH_PTCR = PERIPH_PTCR_TXTEN;
+	}
+#else
 	if (auxOutputBuffer != nullptr)
 	{
 		const size_t bytesToWrite = min<size_t>(SERIAL_AUX_DEVICE.canWrite(), auxOutputBuffer->BytesLeft());
@@ -1243,12 +1436,29 @@ bool Platform::FlushAuxMessages()
 			auxOutput.SetFirstItem(auxOutputBuffer);
 		}
 	}
+#endif
 	return auxOutput.GetFirstItem() != nullptr;
 #else
 	return false;
 #endif
 }
 
+#if defined(SERIAL_AUX_DEVICE) && SUPPORT_AUX_PDC
+
+// Stop any PDC transfer to the aux port and discard the buffer it was sending. Call this before shutting down the serial driver.
+void Platform::AbortAuxPdc()
+{
+	MutexLocker lock(auxMutex);
+	if (auxPdcBusy)
+	{
+		uart_get_pdc_base(AuxUart)->PERIPH_PTCR = PERIPH_PTCR_TXTDIS;
+		auxPdcBusy = false;
+		auxOutput.SetFirstItem(OutputBuffer::Release(auxOutput.GetFirstItem()));
+	}
+}
+
+#endif
+
 // Flush messages to USB and aux, returning true if there is more to send
 bool Platform::FlushMessages()
 {
@@ -1326,6 +1536,11 @@ void Platform::Spin()
 
 	massStorage->Spin();
 
+	if (firmwareStagingFile != nullptr)
+	{
+		SpinFirmwareStaging();
+	}
+
 	// Try to flush messages to serial ports
 	(void)FlushMessages();
 
@@ -1484,6 +1699,11 @@ void Platform::Spin()
 	if (now - lastFanCheckTime >= FanCheckInterval)
 	{
 		lastFanCheckTime = now;
+		for (size_t i = 0; i < NumTachos; ++i)
+		{
+			tachos[i].Spin();
+		}
+
 		bool thermostaticFanRunning = false;
 		for (size_t fan = 0; fan < NUM_FANS; ++fan)
 		{
@@ -1587,12 +1807,14 @@ void Platform::Spin()
 			if (currentVin >= autoResumeReading || currentVin > autoPauseReading + PowerVoltageToAdcReading(0.5))
 			{
 				autoSaveState = AutoSaveState::normal;
+				powerFailFastPathArmed = true;
 			}
 			break;
 
 		case AutoSaveState::normal:
 			if (currentVin < autoPauseReading)
 			{
+				powerFailFastPathArmed = false;						// the tick ISR may have frozen the current move already, but it mustn't do so once we have started pausing
 				if (reprap.GetGCodes().LowVoltagePause())
 				{
 					autoSaveState = AutoSaveState::autoPaused;
@@ -1606,6 +1828,7 @@ void Platform::Spin()
 				if (reprap.GetGCodes().LowVoltageResume())
 				{
 					autoSaveState = AutoSaveState::normal;
+					powerFailFastPathArmed = true;
 				}
 			}
 			break;
@@ -1681,7 +1904,7 @@ bool Platform::ExtruderMotorStalled(size_t extruder) const pre(drive < DRIVES)
 
 void Platform::DisableAutoSave()
 {
-	autoSaveEnabled = false;
+	autoSaveEnabled = powerFailFastPathArmed = false;
 }
 
 bool Platform::IsPowerOk() const
@@ -1714,16 +1937,6 @@ bool Platform::GetAutoSaveSettings(float& saveVoltage, float&resumeVoltage)
 #endif
 
 // Save some resume information
-bool Platform::WriteFanSettings(FileStore *f) const
-{
-	bool ok = true;
-	for (size_t fanNum = 0; ok && fanNum < NUM_FANS; ++fanNum)
-	{
-		ok = fans[fanNum].WriteSettings(f, fanNum);
-	}
-	return ok;
-}
-
 #if HAS_CPU_TEMP_SENSOR
 
 float Platform::AdcReadingToCpuTemperature(uint32_t adcVal) const
@@ -1905,6 +2118,7 @@ void Platform::InitialiseInterrupts()
 
 #if SUPPORT_TMC2660
 	NVIC_SetPriority(TMC2660_SPI_IRQn, NvicPriorityDriversSerialTMC);	// set priority for TMC2660 SPI interrupt
+	NVIC_EnableIRQ(TMC2660_SPI_IRQn);									// enable it here because polling may be restarted from the tick ISR
 #endif
 
 	// Timer interrupt for stepper motors
@@ -1979,6 +2193,9 @@ void Platform::InitialiseInterrupts()
 	// Tick interrupt for ADC conversions
 	tickState = 0;
 	currentFilterNumber = 0;
+#ifdef RTOS
+	tickTask.Create(TickTask, "TICK", nullptr, TaskBase::TickPriority);
+#endif
 
 	// Set up the timeout of the regulator watchdog, and set up the backup watchdog if there is one
 	// The clock frequency for both watchdogs is 32768/128 = 256Hz
@@ -2185,6 +2402,25 @@ void Platform::Diagnostics(MessageType mtype)
 
 	// Show the longest SD card write time
 	MessageF(mtype, "SD card longest block write time: %.1fms, max retries %u\n", (double)FileStore::GetAndClearLongestWriteTime(), FileStore::GetAndClearMaxRetryCount());
+#if SUPPORT_MACRO_CACHE
+	massStorage->GetMacroCache().Diagnostics(mtype);
+#endif
+#if SUPPORT_WEB_FILE_CACHE
+	massStorage->GetWebFileCache().Diagnostics(mtype);
+#endif
+#if SUPPORT_FILE_INFO_INDEX
+	massStorage->GetFileInfoIndex().Diagnostics(mtype);
+#endif
+#if SUPPORT_SECTOR_CACHE
+	{
+		unsigned int hits, misses;
+		DiskioGetAndClearCacheStats(hits, misses);
+		MessageF(mtype, "SD sector cache: %u hits, %u misses\n", hits, misses);
+	}
+#endif
+#if SUPPORT_STORAGE_TASK
+	StorageService::Diagnostics(mtype);
+#endif
 
 #if HAS_CPU_TEMP_SENSOR
 	// Show the MCU temperatures
@@ -2248,6 +2484,13 @@ void Platform::Diagnostics(MessageType mtype)
 
 	reprap.Timing(mtype);
 
+	tickIsrTimer.Diagnostics(mtype);
+	adcTickTimer.Diagnostics(mtype);
+	adcFilterTimer.Diagnostics(mtype);
+	tickIsrTimer.Reset();
+	adcTickTimer.Reset();
+	adcFilterTimer.Reset();
+
 #ifdef MOVE_DEBUG
 	MessageF(mtype, "Interrupts scheduled %u, done %u, last %u, next %u sched at %u, now %u\n",
 			numInterruptsScheduled, numInterruptsExecuted, lastInterruptTime, nextInterruptTime, nextInterruptScheduledAt, GetInterruptClocks());
@@ -2259,6 +2502,43 @@ void Platform::Diagnostics(MessageType mtype)
 #endif
 }
 
+// Time one implementation of the square root function on 62-bit and 32-bit inputs, checking that the results are exact
+static void TimeSquareRoot(const StringRef& reply, const char *name, uint32_t (*fn)(uint64_t))
+{
+	uint32_t tim1 = 0;
+	bool ok1 = true;
+	for (uint32_t i = 0; i < 100; ++i)
+	{
+		const uint32_t num1 = 0x7265ac3d + i;
+		const uint32_t now1 = Platform::GetInterruptClocks();
+		const uint32_t num1a = fn((uint64_t)num1 * num1);
+		const uint32_t num1b = fn((uint64_t)num1 * num1 - 1);
+		tim1 += Platform::GetInterruptClocks() - now1;
+		if (num1a != num1 || num1b != num1 - 1)
+		{
+			ok1 = false;
+		}
+	}
+
+	uint32_t tim2 = 0;
+	bool ok2 = true;
+	for (uint32_t i = 0; i < 100; ++i)
+	{
+		const uint32_t num2 = 0x0000a4c5 + i;
+		const uint32_t now2 = Platform::GetInterruptClocks();
+		const uint32_t num2a = fn((uint64_t)num2 * num2);
+		const uint32_t num2b = fn((uint64_t)num2 * num2 - 1);
+		tim2 += Platform::GetInterruptClocks() - now2;
+		if (num2a != num2 || num2b != num2 - 1)
+		{
+			ok2 = false;
+		}
+	}
+	reply.catf("Square roots (%s): 62-bit %.2fus %s, 32-bit %.2fus %s\n", name,
+			(double)(tim1 * 5000)/StepClockRate, (ok1) ? "ok" : "ERROR",
+					(double)(tim2 * 5000)/StepClockRate, (ok2) ? "ok" : "ERROR");
+}
+
 bool Platform::DiagnosticTest(GCodeBuffer& gb, const StringRef& reply, int d)
 {
 	static const uint32_t dummy[2] = { 0, 0 };
@@ -2442,36 +2722,11 @@ bool Platform::DiagnosticTest(GCodeBuffer& gb, const StringRef& reply, int d)
 
 	case (int)DiagnosticTestType::TimeSquareRoot:		// Show the square root calculation time. The displayed value is subject to interrupts.
 		{
-			uint32_t tim1 = 0;
-			bool ok1 = true;
-			for (uint32_t i = 0; i < 100; ++i)
-			{
-				const uint32_t num1 = 0x7265ac3d + i;
-				const uint32_t now1 = Platform::GetInterruptClocks();
-				const uint32_t num1a = isqrt64((uint64_t)num1 * num1);
-				tim1 += Platform::GetInterruptClocks() - now1;
-				if (num1a != num1)
-				{
-					ok1 = false;
-				}
-			}
-
-			uint32_t tim2 = 0;
-			bool ok2 = true;
-			for (uint32_t i = 0; i < 100; ++i)
-			{
-				const uint32_t num2 = 0x0000a4c5 + i;
-				const uint32_t now2 = Platform::GetInterruptClocks();
-				const uint32_t num2a = isqrt64((uint64_t)num2 * num2);
-				tim2 += Platform::GetInterruptClocks() - now2;
-				if (num2a != num2)
-				{
-					ok2 = false;
-				}
-			}
-			reply.printf("Square roots: 62-bit %.2fus %s, 32-bit %.2fus %s\n",
-					(double)(tim1 * 10000)/StepClockRate, (ok1) ? "ok" : "ERROR",
-							(double)(tim2 * 10000)/StepClockRate, (ok2) ? "ok" : "ERROR");
+			reply.Clear();
+			TimeSquareRoot(reply, "bitwise", isqrt64_bitwise);
+#if ISQRT_HAS_FPU_VERSION
+			TimeSquareRoot(reply, "fpu", isqrt64_fpu);
+#endif
 		}
 		break;
 
@@ -2676,6 +2931,17 @@ EndStopHit Platform::GetZProbeResult() const
 				: EndStopHit::noStop;
 }
 
+// Get the step clock time at which the unfiltered Z probe reading crossed the threshold, returning false if it is below the threshold or the probe doesn't interpolate its trigger position
+bool Platform::GetZProbeTriggerTime(uint32_t& when) const
+{
+	if (zProbeRawTriggered && GetCurrentZProbeParameters().interpolateTrigger)
+	{
+		when = zProbeRawTriggerTime;
+		return true;
+	}
+	return false;
+}
+
 // Write the platform parameters to file
 bool Platform::WritePlatformParameters(FileStore *f, bool includingG31) const
 {
@@ -3103,6 +3369,45 @@ unsigned int Platform::GetDriverMicrostepping(size_t driver, bool& interpolation
 #endif
 }
 
+#if SUPPORT_MICROSTEP_SWITCHING
+
+// Return true if all the drivers of an axis are smart drivers, so that we can change their microstepping between moves
+bool Platform::CanReduceMicrostepping(size_t axis) const
+{
+	for (size_t i = 0; i < axisDrivers[axis].numDrivers; ++i)
+	{
+		if (axisDrivers[axis].driverNumbers[i] >= numSmartDrivers)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Temporarily reduce the microstepping of the drivers of an axis by a factor of (1 << shift), or restore the configured microstepping if shift is zero.
+// The caller is responsible for making sure that the drivers are not stepped until the change has been sent to them.
+void Platform::SetMicrostepReduction(size_t axis, unsigned int shift)
+{
+	for (size_t i = 0; i < axisDrivers[axis].numDrivers; ++i)
+	{
+		SmartDrivers::SetMicrostepReduction(axisDrivers[axis].driverNumbers[i], shift);
+	}
+}
+
+bool Platform::IsMicrostepChangePending(size_t axis) const
+{
+	for (size_t i = 0; i < axisDrivers[axis].numDrivers; ++i)
+	{
+		if (SmartDrivers::IsMicrostepChangePending(axisDrivers[axis].driverNumbers[i]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif
+
 // Get the microstepping for an axis or extruder
 unsigned int Platform::GetMicrostepping(size_t drive, bool& interpolation) const
 {
@@ -3255,6 +3560,12 @@ bool Platform::IsFanControllable(size_t fan) const
 	return fan < NUM_FANS && !fans[fan].HasMonitoredHeaters() && fans[fan].IsConfigured();
 }
 
+// Check if the given fan is under thermostatic control, in which case we don't need to restore its speed when we resume a print
+bool Platform::IsFanThermostatic(size_t fan) const
+{
+	return fan < NUM_FANS && fans[fan].HasMonitoredHeaters();
+}
+
 // Return the fan's name
 const char *Platform::GetFanName(size_t fan) const
 {
@@ -3326,6 +3637,9 @@ void Platform::SetEndStopConfiguration(size_t axis, EndStopPosition esPos, EndSt
 {
 	endStopPos[axis] = esPos;
 	endStopInputType[axis] = inputType;
+#if SUPPORT_ENDSTOP_INTERRUPTS
+	UpdateEndstopInterrupts();
+#endif
 }
 
 void Platform::GetEndStopConfiguration(size_t axis, EndStopPosition& esType, EndStopInputType& inputType) const
@@ -3334,6 +3648,62 @@ void Platform::GetEndStopConfiguration(size_t axis, EndStopPosition& esType, End
 	inputType = endStopInputType[axis];
 }
 
+#if SUPPORT_ENDSTOP_INTERRUPTS
+
+void Platform::SetUseEndstopInterrupts(bool b)
+{
+	useEndstopInterrupts = b;
+	UpdateEndstopInterrupts();
+}
+
+// Attach pin change interrupts to the switch endstop inputs of the axes in use and to an unfiltered digital Z probe input,
+// so that the step ISR only needs to read them when one of them changes. Inputs that need filtering or stall detection are still polled.
+void Platform::UpdateEndstopInterrupts()
+{
+	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t axis = 0; axis < MaxAxes; ++axis)
+	{
+		const Pin pin = endStopPins[axis];
+		const bool wanted = useEndstopInterrupts
+							&& axis < numAxes
+							&& pin != NoPin
+							&& endStopPos[axis] != EndStopPosition::noEndStop
+							&& (endStopInputType[axis] == EndStopInputType::activeLow || endStopInputType[axis] == EndStopInputType::activeHigh);
+		if (wanted && !EndstopHasInterrupt(axis))
+		{
+			if (attachInterrupt(pin, EndstopInterrupt, INTERRUPT_MODE_CHANGE, this))
+			{
+				endstopInterruptDrives |= 1u << axis;
+			}
+		}
+		else if (!wanted && EndstopHasInterrupt(axis))
+		{
+			detachInterrupt(pin);
+			endstopInterruptDrives &= ~(1u << axis);
+		}
+	}
+
+	const bool wantZProbe = useEndstopInterrupts && zProbePin != NoPin && (zProbeType == ZProbeType::unfilteredDigital || zProbeType == ZProbeType::blTouch);
+	if (wantZProbe && !zProbeInterruptAttached)
+	{
+		zProbeInterruptAttached = attachInterrupt(zProbePin, EndstopInterrupt, INTERRUPT_MODE_CHANGE, this);
+	}
+	else if (!wantZProbe && zProbeInterruptAttached)
+	{
+		detachInterrupt(zProbePin);
+		zProbeInterruptAttached = false;
+	}
+	endstopChanged = true;
+}
+
+// Pin change interrupt for the endstop and Z probe inputs
+/*static*/ void Platform::EndstopInterrupt(CallbackParameter param)
+{
+	static_cast<Platform*>(param.vp)->endstopChanged = true;
+}
+
+#endif
+
 //-----------------------------------------------------------------------------------------------------
 
 void Platform::AppendAuxReply(const char *msg, bool rawMessage)
@@ -3387,7 +3757,19 @@ void Platform::AppendAuxReply(OutputBuffer *reply, bool rawMessage)
 		{
 			// Other responses are stored for M105/M408
 			auxSeq++;
-			if (auxGCodeReply == nullptr)
+			if (reply->IsReferenced())
+			{
+				// Other destinations share this buffer, so we mustn't link it into the stored reply, which later replies are appended to. Copy it instead.
+				if (auxGCodeReply != nullptr || OutputBuffer::Allocate(auxGCodeReply))
+				{
+					for (const OutputBuffer *buf = reply; buf != nullptr; buf = buf->Next())
+					{
+						auxGCodeReply->cat(buf->Data(), buf->DataLength());
+					}
+				}
+				OutputBuffer::ReleaseAll(reply);
+			}
+			else if (auxGCodeReply == nullptr)
 			{
 				auxGCodeReply = reply;
 			}
@@ -3411,6 +3793,31 @@ void Platform::RawMessage(MessageType type, const char *message)
 		logger->LogMessage(realTime, message);
 	}
 
+	// If a long message is going to more than one destination that queues output buffers, put it in a single buffer that they all share
+	// instead of copying it for each one. Short messages are still copied, because they can usually be appended to a buffer that is already
+	// queued, whereas each shared buffer takes a slot in the output stack of every destination.
+	const MessageType queuedType = (MessageType)(type & (HttpMessage | TelnetMessage | AuxMessage
+													| (((type & ImmediateLcdMessage) == 0) ? LcdMessage : 0)
+													| (((type & BlockingUsbMessage) == 0) ? UsbMessage : 0)));
+	const size_t length = strlen(message);
+	if (length >= MIN_SHARED_MESSAGE_LENGTH && NumDestinations(queuedType) > 1)
+	{
+		OutputBuffer *buf;
+		if (OutputBuffer::Allocate(buf, length))
+		{
+			buf->cat(message, length);
+			if (buf->HadOverflow())
+			{
+				OutputBuffer::ReleaseAll(buf);
+			}
+			else
+			{
+				Message((MessageType)(queuedType | (type & RawMessageFlag)), buf);
+				type = (MessageType)(type & ~queuedType);
+			}
+		}
+	}
+
 	// Send the message to the destinations
 	if ((type & ImmediateLcdMessage) != 0)
 	{
@@ -3438,8 +3845,20 @@ void Platform::RawMessage(MessageType type, const char *message)
 		// Message that is to be sent to the second auxiliary device (blocking)
 		if (!aux2Output.IsEmpty())
 		{
-			// If we're still busy sending a response to the USART device, append this message to the output buffer
-			aux2Output.GetLastItem()->cat(message);
+			// If we're still busy sending a response to the USART device, append this message to the output buffer unless other destinations share it
+			OutputBuffer *aux2OutputBuffer = aux2Output.GetLastItem();
+			if (aux2OutputBuffer->IsReferenced())
+			{
+				if (OutputBuffer::Allocate(aux2OutputBuffer))
+				{
+					aux2Output.Push(aux2OutputBuffer);
+					aux2OutputBuffer->cat(message);
+				}
+			}
+			else
+			{
+				aux2OutputBuffer->cat(message);
+			}
 		}
 		else
 		{
@@ -3490,18 +3909,9 @@ void Platform::RawMessage(MessageType type, const char *message)
 	}
 }
 
-// Note: this overload of Platform::Message does not process the special action flags in the MessageType.
-// Also it treats calls to send a blocking USB message the same as ordinary USB messages,
-// and calls to send an immediate LCD message the same as ordinary LCD messages
-void Platform::Message(const MessageType type, OutputBuffer *buffer)
+// Return how many destinations the version of Platform::Message that takes an OutputBuffer sends a message of this type to
+/*static*/ size_t Platform::NumDestinations(MessageType type)
 {
-	// First deal with logging because it doesn't hang on to the buffer
-	if ((type & LogMessage) != 0 && logger != nullptr)
-	{
-		logger->LogMessage(realTime, buffer);
-	}
-
-	// Now send the message to all the destinations
 	size_t numDestinations = 0;
 	if ((type & (LcdMessage | ImmediateLcdMessage)) != 0)
 	{
@@ -3527,6 +3937,22 @@ void Platform::Message(const MessageType type, OutputBuffer *buffer)
 	}
 #endif
 
+	return numDestinations;
+}
+
+// Note: this overload of Platform::Message does not process the special action flags in the MessageType.
+// Also it treats calls to send a blocking USB message the same as ordinary USB messages,
+// and calls to send an immediate LCD message the same as ordinary LCD messages
+void Platform::Message(const MessageType type, OutputBuffer *buffer)
+{
+	// First deal with logging because it doesn't hang on to the buffer
+	if ((type & LogMessage) != 0 && logger != nullptr)
+	{
+		logger->LogMessage(realTime, buffer);
+	}
+
+	// Now send the message to all the destinations
+	const size_t numDestinations = NumDestinations(type);
 	if (numDestinations == 0)
 	{
 		OutputBuffer::ReleaseAll(buffer);
@@ -3697,6 +4123,41 @@ bool Platform::ConfigureLogging(GCodeBuffer& gb, const StringRef& reply)
 	return false;
 }
 
+// Process M938. P selects the SD card that log, trace and profile files are written to, so that on a machine with two cards,
+// writing them doesn't compete with reading the file being printed from the other card. A log file that is already open stays where it is.
+GCodeResult Platform::ConfigureLogVolume(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (gb.Seen('P'))
+	{
+		const unsigned int volume = gb.GetUIValue();
+		if (volume >= NumSdCards)
+		{
+			reply.copy("SD card number out of range");
+			return GCodeResult::error;
+		}
+
+		String<8> dir;
+		dir.printf("%u:/sys", volume);
+		if (!massStorage->CheckDriveMounted(dir.c_str()))
+		{
+			reply.printf("SD card %u is not mounted", volume);
+			return GCodeResult::error;
+		}
+		if (!massStorage->DirectoryExists(dir.c_str()) && !massStorage->MakeDirectory(dir.c_str()))
+		{
+			reply.printf("Failed to create directory %s", dir.c_str());
+			return GCodeResult::error;
+		}
+		dir.cat('/');
+		logDir.copy(dir.c_str());
+	}
+	else
+	{
+		reply.printf("Log, trace and profile files are written to %s", logDir.c_str());
+	}
+	return GCodeResult::ok;
+}
+
 // This is called from EmergencyStop. It closes the log file and stops logging.
 void Platform::StopLogging()
 {
@@ -3740,6 +4201,21 @@ void Platform::SetPressureAdvance(size_t extruder, float factor)
 	}
 }
 
+// Return true if two extruders have the same steps/mm, pressure advance and nonlinear extrusion settings.
+// If so then a move that gives them the same number of steps generates identical step timing on both, so one DM can step them together.
+bool Platform::ExtrudersStepAlike(size_t e1, size_t e2) const
+{
+	const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+	return driveStepsPerUnit[e1 + numAxes] == driveStepsPerUnit[e2 + numAxes]
+		&& GetPressureAdvance(e1) == GetPressureAdvance(e2)
+#if SUPPORT_NONLINEAR_EXTRUSION
+		&& nonlinearExtrusionA[e1] == nonlinearExtrusionA[e2]
+		&& nonlinearExtrusionB[e1] == nonlinearExtrusionB[e2]
+		&& nonlinearExtrusionLimit[e1] == nonlinearExtrusionLimit[e2]
+#endif
+		;
+}
+
 #if SUPPORT_NONLINEAR_EXTRUSION
 
 bool Platform::GetExtrusionCoefficients(size_t extruder, float& a, float& b, float& limit) const
@@ -3808,6 +4284,9 @@ void Platform::ResetChannel(size_t chan)
 
 #ifdef SERIAL_AUX_DEVICE
 	case 1:
+# if SUPPORT_AUX_PDC
+		AbortAuxPdc();
+# endif
 		SERIAL_AUX_DEVICE.end();
 		SERIAL_AUX_DEVICE.begin(baudRates[1]);
 		break;
@@ -4245,11 +4724,11 @@ float Platform::GetTmcDriversTemperature(unsigned int board) const
 #if HAS_STALL_DETECT
 
 // Configure the motor stall detection, returning true if an error was encountered
-bool Platform::ConfigureStallDetection(GCodeBuffer& gb, const StringRef& reply)
+// Build a bitmap of the smart drivers referenced by the P parameter and the axis letters in a command, returning true if there was an error
+bool Platform::GetSmartDriversBitmap(GCodeBuffer& gb, const StringRef& reply, DriversBitmap& drivers) const
 {
-	// Build a bitmap of all the drivers referenced
 	// First looks for explicit driver numbers
-	DriversBitmap drivers = 0;
+	drivers = 0;
 	if (gb.Seen('P'))
 	{
 		uint32_t drives[DRIVES];
@@ -4277,6 +4756,17 @@ bool Platform::ConfigureStallDetection(GCodeBuffer& gb, const StringRef& reply)
 			}
 		}
 	}
+	return false;
+}
+
+bool Platform::ConfigureStallDetection(GCodeBuffer& gb, const StringRef& reply)
+{
+	// Build a bitmap of all the drivers referenced
+	DriversBitmap drivers;
+	if (GetSmartDriversBitmap(gb, reply, drivers))
+	{
+		return true;
+	}
 
 	// Now check for values to change
 	bool seen = false;
@@ -4384,6 +4874,12 @@ bool Platform::ConfigureStallDetection(GCodeBuffer& gb, const StringRef& reply)
 									: (IsBitSet(logOnStallDrivers, drive)) ? "log"
 										: "none"
 						  );
+				DriverLoadStats loadStats;
+				if (SmartDrivers::GetLoadStats(drive, loadStats))
+				{
+					reply.catf(", last move load min/mean/max %u/%u/%u from %" PRIu32 " readings",
+								loadStats.minLoadReading, loadStats.meanLoadReading, loadStats.maxLoadReading, loadStats.numReadings);
+				}
 				printed = true;
 			}
 		}
@@ -4392,6 +4888,58 @@ bool Platform::ConfigureStallDetection(GCodeBuffer& gb, const StringRef& reply)
 	return false;
 }
 
+// Configure dynamic motor current control, or report it if no values are given. This is M919.
+// S is the percentage of the configured current we use during acceleration and deceleration, R is the percentage we use while cruising with a light load,
+// and L is the StallGuard reading at or above which we consider the load light. S100 R100 disables dynamic current control.
+bool Platform::ConfigureDynamicCurrent(GCodeBuffer& gb, const StringRef& reply)
+{
+	DriversBitmap drivers;
+	if (GetSmartDriversBitmap(gb, reply, drivers))
+	{
+		return true;
+	}
+	if (drivers == 0)
+	{
+		drivers = LowestNBits<DriversBitmap>(numSmartDrivers);
+	}
+
+	bool seen = false;
+	bool printed = false;
+	for (size_t drive = 0; drive < numSmartDrivers; ++drive)
+	{
+		if (IsBitSet(drivers, drive))
+		{
+			uint32_t accelPercent, cruisePercent, loadThreshold;
+			SmartDrivers::GetDynamicCurrent(drive, accelPercent, cruisePercent, loadThreshold);
+			gb.TryGetUIValue('S', accelPercent, seen);
+			gb.TryGetUIValue('R', cruisePercent, seen);
+			gb.TryGetUIValue('L', loadThreshold, seen);
+			if (seen)
+			{
+				SmartDrivers::SetDynamicCurrent(drive, accelPercent, cruisePercent, loadThreshold);
+			}
+			else
+			{
+				if (printed)
+				{
+					reply.cat('\n');
+				}
+				reply.catf("Driver %u: ", drive);
+				if (accelPercent == 100 && cruisePercent == 100)
+				{
+					reply.cat("dynamic current disabled");
+				}
+				else
+				{
+					reply.catf("acceleration current %" PRIu32 "%%, cruise current %" PRIu32 "%% when StallGuard reading >= %" PRIu32, accelPercent, cruisePercent, loadThreshold);
+				}
+				printed = true;
+			}
+		}
+	}
+	return false;
+}
+
 #endif
 
 // Real-time clock
@@ -4446,12 +4994,12 @@ uint32_t Platform::Random()
 #endif
 
 // Step pulse timer interrupt
-void STEP_TC_HANDLER() __attribute__ ((hot));
+void STEP_TC_HANDLER() __attribute__ ((hot)) ITCM_CODE;
 
 #if SAM4S || SAME70
 // Static data used by step ISR
-volatile uint32_t Platform::stepTimerPendingStatus = 0;	// for holding status bits that we have read (and therefore cleared) but haven't serviced yet
-volatile uint32_t Platform::stepTimerHighWord = 0;		// upper 16 bits of step timer
+volatile uint32_t Platform::stepTimerPendingStatus DTCM_DATA = 0;	// for holding status bits that we have read (and therefore cleared) but haven't serviced yet
+volatile uint32_t Platform::stepTimerHighWord DTCM_DATA = 0;		// upper 16 bits of step timer
 #endif
 
 void STEP_TC_HANDLER()
@@ -4481,6 +5029,9 @@ void STEP_TC_HANDLER()
 #ifdef MOVE_DEBUG
 			++numInterruptsExecuted;
 			lastInterruptTime = Platform::GetInterruptClocks();
+#endif
+#if SUPPORT_STEP_TRACE
+			StepTracer::RecordInterrupt(Platform::GetInterruptClocks());
 #endif
 			reprap.GetMove().Interrupt();							// execute the step interrupt
 		}
@@ -4505,6 +5056,9 @@ void STEP_TC_HANDLER()
 #ifdef MOVE_DEBUG
 		++numInterruptsExecuted;
 		lastInterruptTime = Platform::GetInterruptClocks();
+#endif
+#if SUPPORT_STEP_TRACE
+		StepTracer::RecordInterrupt(Platform::GetInterruptClocks());
 #endif
 		reprap.GetMove().Interrupt();								// execute the step interrupt
 	}
@@ -4559,6 +5113,9 @@ void STEP_TC_HANDLER()
 	}
 
 	STEP_TC->TC_CHANNEL[STEP_TC_CHAN].TC_RA = tim;						// set up the compare register
+#if SUPPORT_STEP_TRACE
+	StepTracer::SetScheduledTime(tim);
+#endif
 
 	// We would like to clear any pending step interrupt. To do this, we must read the TC status register.
 	// Unfortunately, this would clear any other pending interrupts from the same TC.
@@ -4626,12 +5183,44 @@ void STEP_TC_HANDLER()
 // 3b. If the last ADC reading was a thermistor reading, check for an over-temperature situation and turn off the heater if necessary.
 //     We do this here because the usual polling loop sometimes gets stuck trying to send data to the USB port.
 
+// Feed a Z probe reading to an averaging filter. Called from the tick ISR.
+// The Z probe result comes from the filtered readings, so it is delayed by up to 2 * Z_PROBE_AVERAGE_READINGS ticks, which at probing speed can be a considerable distance.
+// So we also note when the unfiltered reading crosses the threshold, which lets the probing code interpolate the trigger position from the planned speed.
+// This doesn't apply to modulated probes because we only get a meaningful reading from them by combining readings, or to unfiltered probes because they don't have the delay.
+void Platform::ProcessZProbeReading(volatile ZProbeAveragingFilter& filter)
+{
+	// The conversion we are reading was started at the end of the previous tick, so on average the probe triggered half a tick before that
+	constexpr uint32_t ZProbeSampleDelayClocks = (3 * StepClockRate)/(2 * 1000);
+
+	const uint16_t reading = GetRawZProbeReading();
+	const_cast<ZProbeAveragingFilter&>(filter).ProcessReading(reading);		// because we are in the tick ISR and no other ISR reads the averaging filter, we can cast away 'volatile' here
+	if (zProbeType != ZProbeType::dumbModulated && zProbeType != ZProbeType::unfilteredDigital && zProbeType != ZProbeType::blTouch && zProbeType != ZProbeType::zMotorStall)
+	{
+		const ZProbe& params = GetCurrentZProbeParameters();
+		const int32_t val = (params.invertReading) ? 1000 - reading/4 : reading/4;
+		if (val < params.adcValue)
+		{
+			zProbeRawTriggered = false;
+		}
+		else if (!zProbeRawTriggered)
+		{
+			zProbeRawTriggerTime = GetInterruptClocks() - ZProbeSampleDelayClocks;
+			zProbeRawTriggered = true;
+		}
+	}
+}
+
 void Platform::Tick()
 {
+	const uint32_t startCycles = StageTimer::GetCycles();
 #if SAM4E || SAME70
 	rswdt_restart(RSWDT);							// kick the secondary watchdog (the primary one is kicked in CoreNG)
 #endif
 
+#if SUPPORT_TMC2660
+	SmartDrivers::RestartPolling();					// restart driver polling if it stopped because all the drivers were idle
+#endif
+
 	if (tickState != 0)
 	{
 #if HAS_VOLTAGE_MONITOR
@@ -4646,6 +5235,21 @@ void Platform::Tick()
 			lowestVin = currentVin;
 		}
 
+		// If the power is failing, stop the motors and heaters now instead of waiting for the main loop to notice, which may be busy.
+		// The main loop still does the pause, and saves the resume information once the motors have stopped.
+		if (powerFailFastPathArmed && currentVin < autoPauseReading)
+		{
+			powerFailFastPathArmed = false;
+			reprap.GetMove().PowerFailFreeze();
+			for (size_t heater = 0; heater < Heaters; ++heater)
+			{
+				if ((configuredHeaters & (1u << heater)) != 0)
+				{
+					SetHeater(heater, 0.0);
+				}
+			}
+		}
+
 # if HAS_SMART_DRIVERS
 		if (driversPowered && currentVin > driverOverVoltageAdcReading)
 		{
@@ -4656,15 +5260,59 @@ void Platform::Tick()
 #endif
 	}
 
+#ifdef RTOS
+	tickTask.GiveFromISR();							// the tick task does the rest, so that the tick interrupt doesn't delay the step interrupt for long
+#else
+	ProcessAdcTick();
+#endif
+	tickIsrTimer.Record(StageTimer::GetCycles() - startCycles);
+}
+
+#ifdef RTOS
+
+void Platform::TickTaskLoop()
+{
+	for (;;)
+	{
+		(void)TaskBase::Take(portMAX_DELAY);		// wait for the tick interrupt
+		ProcessAdcTick();
+	}
+}
+
+extern "C" void TickTask(void * pvParameters)
+{
+	reprap.GetPlatform().TickTaskLoop();
+}
+
+#endif
+
+// Collect the ADC readings from the last tick, update the filters and the Z probe reading, and start the next conversion.
+// In RTOS builds this runs in the tick task, otherwise in the tick interrupt.
+void Platform::ProcessAdcTick()
+{
+	const uint32_t startCycles = StageTimer::GetCycles();
 	switch (tickState)
 	{
 	case 1:
 	case 3:
 		{
-			// We read a filtered ADC channel on alternate ticks
-			// Because we are in the tick ISR and no other ISR reads the averaging filter, we can cast away 'volatile' here.
+			// Each conversion sequence converts all the enabled channels, so collect the results for all the filtered channels, not just the one we update this time.
+			// This oversamples each channel by NumAdcFilters, so each filter reading is the mean of that many conversions, at the cost of just a register read and an add per channel.
+			const uint32_t filterStartCycles = StageTimer::GetCycles();
+			for (size_t filter = 0; filter < NumAdcFilters; ++filter)
+			{
+				adcOversampleSums[filter] += AnalogInReadChannel(filteredAdcChannels[filter]);
+				++adcOversampleCounts[filter];
+			}
+
+			// We update a filter from its oversampled conversions on alternate ticks
+			// Because only this function writes the averaging filter and no ISR reads it, we can cast away 'volatile' here.
 			ThermistorAveragingFilter& currentFilter = const_cast<ThermistorAveragingFilter&>(adcFilters[currentFilterNumber]);		// cast away 'volatile'
-			currentFilter.ProcessReading(AnalogInReadChannel(filteredAdcChannels[currentFilterNumber]));
+			const uint32_t count = adcOversampleCounts[currentFilterNumber];
+			currentFilter.ProcessReading((uint16_t)((adcOversampleSums[currentFilterNumber] + count/2)/count));
+			adcOversampleSums[currentFilterNumber] = 0;
+			adcOversampleCounts[currentFilterNumber] = 0;
+			adcFilterTimer.Record(StageTimer::GetCycles() - filterStartCycles);
 
 			// Guard against overly long delays between successive calls of PID::Spin().
 			// Do not call Time() here, it isn't safe. We use millis() instead.
@@ -4685,14 +5333,14 @@ void Platform::Tick()
 			// so on alternate ticks we read it and switch the emitter
 			if (zProbeType != ZProbeType::dumbModulated)
 			{
-				const_cast<ZProbeAveragingFilter&>((tickState == 1) ? zProbeOnFilter : zProbeOffFilter).ProcessReading(GetRawZProbeReading());
+				ProcessZProbeReading((tickState == 1) ? zProbeOnFilter : zProbeOffFilter);
 			}
 			++tickState;
 		}
 		break;
 
 	case 2:
-		const_cast<ZProbeAveragingFilter&>(zProbeOnFilter).ProcessReading(GetRawZProbeReading());
+		ProcessZProbeReading(zProbeOnFilter);
 		if (zProbeType == ZProbeType::dumbModulated)									// if using a modulated IR sensor
 		{
 			digitalWrite(zProbeModulationPin, LOW);				// turn off the IR emitter
@@ -4702,7 +5350,7 @@ void Platform::Tick()
 		break;
 
 	case 4:			// last conversion started was the Z probe, with IR LED off if modulation is enabled
-		const_cast<ZProbeAveragingFilter&>(zProbeOffFilter).ProcessReading(GetRawZProbeReading());
+		ProcessZProbeReading(zProbeOffFilter);
 		// no break
 	case 0:			// this is the state after initialisation, no conversion has been started
 	default:
@@ -4715,6 +5363,7 @@ void Platform::Tick()
 	}
 
 	AnalogInStartConversion();
+	adcTickTimer.Record(StageTimer::GetCycles() - startCycles);
 }
 
 // Pragma pop_options is not supported on this platform
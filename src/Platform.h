@@ -38,10 +38,12 @@ Licence: GPL
 #include "Storage/FileStore.h"
 #include "Storage/FileData.h"
 #include "Storage/MassStorage.h"	// must be after Pins.h because it needs NumSdCards defined
+#include "Storage/CRC32.h"
 #include "MessageType.h"
 #include "Spindle.h"
 #include "ZProbe.h"
 #include "ZProbeProgrammer.h"
+#include "Movement/StageTimer.h"
 
 #if defined(DUET_NG)
 # include "DueXn.h"
@@ -343,6 +345,9 @@ public:
 	static bool ScheduleSoftTimerInterrupt(uint32_t tim);	// Schedule an interrupt at the specified clock count, or return true if it has passed already
 	static void DisableSoftTimerInterrupt();				// Make sure we get no software timer interrupts
 	void Tick() __attribute__((hot));						// Process a systick interrupt
+#ifdef RTOS
+	void TickTaskLoop() __attribute__((noreturn));			// Do the ADC and Z probe processing that each tick interrupt triggers
+#endif
 
 	// Real-time clock
 	bool IsDateTimeSet() const;						// Has the RTC been set yet?
@@ -355,6 +360,7 @@ public:
 	void AppendAuxReply(const char *msg, bool rawMessage);
     uint32_t GetAuxSeq() { return auxSeq; }
     bool HaveAux() const { return auxDetected; }	// Any device on the AUX line?
+    bool AuxOutputPending() const;					// Is there anything waiting to be sent to the AUX line?
     void SetAuxDetected() { auxDetected = true; }
 
 	void SetIPAddress(uint8_t ip[]);
@@ -376,11 +382,12 @@ public:
 	friend class FileStore;
 
 	MassStorage* GetMassStorage() const;
-	FileStore* OpenFile(const char* directory, const char* fileName, OpenMode mode) { return massStorage->OpenFile(directory, fileName, mode); }
+	FileStore* OpenFile(const char* directory, const char* fileName, OpenMode mode, bool useCache = false) { return massStorage->OpenFile(directory, fileName, mode, useCache); }
 
 	const char* GetWebDir() const; 					// Where the html etc files are
 	const char* GetGCodeDir() const; 				// Where the gcodes are
 	const char* GetSysDir() const;  				// Where the system files are
+	const char* GetLogDir() const { return logDir.c_str(); }	// Where log, trace and profile files are written
 	const char* GetMacroDir() const;				// Where the user-defined macros are
 	const char* GetConfigFile() const; 				// Where the configuration is stored (in the system dir).
 	const char* GetDefaultFile() const;				// Where the default configuration is stored (in the system dir).
@@ -417,6 +424,11 @@ public:
 	unsigned int GetDriverMicrostepping(size_t drive, bool& interpolate) const;
 	bool SetMicrostepping(size_t axisOrExtruder, int microsteps, bool mode);
 	unsigned int GetMicrostepping(size_t axisOrExtruder, bool& interpolation) const;
+#if SUPPORT_MICROSTEP_SWITCHING
+	bool CanReduceMicrostepping(size_t axis) const;					// Return true if all the drivers of an axis support changing the microstepping while running
+	void SetMicrostepReduction(size_t axis, unsigned int shift);	// Temporarily reduce the microstepping of an axis by a factor of (1 << shift), or restore it
+	bool IsMicrostepChangePending(size_t axis) const;				// Return true if a microstepping change hasn't reached all the drivers of an axis yet
+#endif
 	void SetDriverStepTiming(size_t driver, const float microseconds[4]);
 	void GetDriverStepTiming(size_t driver, float microseconds[4]) const;
 	float DriveStepsPerUnit(size_t axisOrExtruder) const;
@@ -439,13 +451,24 @@ public:
 	void SetAxisMinimum(size_t axis, float value, bool byProbing);
 	float AxisTotalLength(size_t axis) const;
 	float GetPressureAdvance(size_t extruder) const;
+	bool ExtrudersStepAlike(size_t e1, size_t e2) const;	// return true if equal step counts give identical step timing on these two extruders
 	void SetPressureAdvance(size_t extruder, float factor);
+	float GetPressureAdvanceSmoothingTime() const { return pressureAdvanceSmoothingTime; }
+	void SetPressureAdvanceSmoothingTime(float t) { pressureAdvanceSmoothingTime = max<float>(t, 0.0); }
 
 	void SetEndStopConfiguration(size_t axis, EndStopPosition endstopPos, EndStopInputType inputType)
 	pre(axis < MaxAxes);
 
 	void GetEndStopConfiguration(size_t axis, EndStopPosition& endstopPos, EndStopInputType& inputType) const
 	pre(axis < MaxAxes);
+#if SUPPORT_ENDSTOP_INTERRUPTS
+	void SetUseEndstopInterrupts(bool b);
+	bool GetUseEndstopInterrupts() const { return useEndstopInterrupts; }
+	bool EndstopHasInterrupt(size_t drive) const { return (endstopInterruptDrives & (1u << drive)) != 0; }
+	bool ZProbeHasInterrupt() const { return zProbeInterruptAttached; }
+	void SetEndstopChanged() { endstopChanged = true; }
+	bool CheckEndstopChanged();										// return true if an endstop or Z probe input has changed since we last checked
+#endif
 
 	uint32_t GetAllEndstopStates() const;
 	void SetAxisDriversConfig(size_t axis, const AxisDriversConfig& config);
@@ -477,6 +500,7 @@ public:
 	float GetZProbeTravelSpeed() const;
 	int GetZProbeReading() const;
 	EndStopHit GetZProbeResult() const;
+	bool GetZProbeTriggerTime(uint32_t& when) const;				// get the step clock time at which the unfiltered Z probe reading crossed the threshold
 	int GetZProbeSecondaryValues(int& v1, int& v2);
 	void SetZProbeType(unsigned int iZ);
 	ZProbeType GetZProbeType() const { return zProbeType; }
@@ -515,14 +539,15 @@ public:
 	void EnableSharedFan(bool enable);						// enable/disable the fan that shares its PWM pin with the last heater
 #endif
 	bool IsFanControllable(size_t fan) const;
+	bool IsFanThermostatic(size_t fan) const;
 	const char *GetFanName(size_t fan) const;
 
-	bool WriteFanSettings(FileStore *f) const;		// Save some resume information
 	uint32_t GetFanRPM(size_t tachoIndex) const;
 
 	// Flash operations
 	void UpdateFirmware();
 	bool CheckFirmwareUpdatePrerequisites(const StringRef& reply);
+	GCodeResult StageFirmwareUpdate(GCodeBuffer& gb, const StringRef& reply);	// process M997 V1
 
 	// AUX device
 	void Beep(int freq, int ms);
@@ -565,6 +590,7 @@ public:
 
 #if HAS_STALL_DETECT
 	bool ConfigureStallDetection(GCodeBuffer& gb, const StringRef& reply);
+	bool ConfigureDynamicCurrent(GCodeBuffer& gb, const StringRef& reply);
 #endif
 
 	// User I/O and servo support
@@ -579,6 +605,7 @@ public:
 
 	// Logging support
 	bool ConfigureLogging(GCodeBuffer& gb, const StringRef& reply);
+	GCodeResult ConfigureLogVolume(GCodeBuffer& gb, const StringRef& reply);	// process M938
 
 	// Ancillary PWM
 	void SetExtrusionAncilliaryPwmValue(float v);
@@ -621,6 +648,7 @@ private:
 	Platform(const Platform&);						// private copy constructor to make sure we don't try to copy a Platform
 
 	void RawMessage(MessageType type, const char *message);	// called by Message after handling error/warning flags
+	static size_t NumDestinations(MessageType type);		// how many destinations a message in an OutputBuffer goes to
 
 	void ResetChannel(size_t chan);					// re-initialise a serial channel
 	float AdcReadingToCpuTemperature(uint32_t reading) const;
@@ -630,6 +658,7 @@ private:
 #endif
 #if HAS_STALL_DETECT
 	bool AnyAxisMotorStalled(size_t drive) const pre(drive < DRIVES);
+	bool GetSmartDriversBitmap(GCodeBuffer& gb, const StringRef& reply, DriversBitmap& drivers) const;
 	bool ExtruderMotorStalled(size_t extruder) const pre(extruder < MaxExtruders);
 #endif
 
@@ -691,6 +720,16 @@ private:
 
 	// Logging
 	Logger *logger;
+	String<8> logDir;						// the directory that log, trace and profile files are written to, e.g. "0:/sys/"
+
+	// Firmware update
+	bool IapFlashMatches(FileStore *iapFile);
+	void SpinFirmwareStaging();
+
+	FileStore *firmwareStagingFile;			// the firmware binary we are verifying in the background, or nullptr
+	CRC32 firmwareStagingCrc;
+	uint32_t firmwareExpectedCrc;
+	bool firmwareCheckCrc;					// true if we were given the CRC that the firmware binary should have
 
 	// Z probes
 	ZProbe switchZProbeParameters;			// Z probe values for the switch Z-probe
@@ -737,6 +776,7 @@ private:
 	float driveStepsPerUnit[DRIVES];
 	float instantDvs[DRIVES];
 	float pressureAdvance[MaxExtruders];
+	float pressureAdvanceSmoothingTime;		// if nonzero, pressure advance follows the speed smoothed over this time instead of the instantaneous speed
 #if SUPPORT_NONLINEAR_EXTRUSION
 	float nonlinearExtrusionA[MaxExtruders], nonlinearExtrusionB[MaxExtruders], nonlinearExtrusionLimit[MaxExtruders];
 #endif
@@ -785,9 +825,13 @@ private:
 	ZProbeProgrammer zProbeProg;
 	volatile ZProbeAveragingFilter zProbeOnFilter;					// Z probe readings we took with the IR turned on
 	volatile ZProbeAveragingFilter zProbeOffFilter;					// Z probe readings we took with the IR turned off
+	volatile uint32_t zProbeRawTriggerTime;							// the step clock time at which the unfiltered Z probe reading last crossed the threshold
+	volatile bool zProbeRawTriggered;								// true if the unfiltered Z probe reading is at or above the threshold
 
 	// Thermistors and temperature monitoring
 	volatile ThermistorAveragingFilter adcFilters[NumAdcFilters];	// ADC reading averaging filters
+	uint32_t adcOversampleSums[NumAdcFilters];						// Sums of the conversions of each filtered channel since its filter was last updated, only accessed by the tick ISR
+	uint16_t adcOversampleCounts[NumAdcFilters];					// Number of conversions in each of the above sums
 
 #if HAS_CPU_TEMP_SENSOR
 	uint32_t highestMcuTemperature, lowestMcuTemperature;
@@ -796,6 +840,7 @@ private:
 
 	void InitZProbe();
 	uint16_t GetRawZProbeReading() const;
+	void ProcessZProbeReading(volatile ZProbeAveragingFilter& filter);
 	void UpdateNetworkAddress(uint8_t dst[4], const uint8_t src[4]);
 
 	// Axes and endstops
@@ -807,6 +852,16 @@ private:
 
 	static bool WriteAxisLimits(FileStore *f, AxesBitmap axesProbed, const float limits[MaxAxes], int sParam);
 
+#if SUPPORT_ENDSTOP_INTERRUPTS
+	void UpdateEndstopInterrupts();
+	static void EndstopInterrupt(CallbackParameter param);
+
+	uint32_t endstopInterruptDrives;								// bitmap of the axes whose endstop inputs have pin change interrupts attached
+	volatile bool endstopChanged;									// set by the pin change interrupt, cleared by the step ISR when it checks the endstops
+	bool useEndstopInterrupts;
+	bool zProbeInterruptAttached;
+#endif
+
 	// Heaters
 	uint32_t configuredHeaters;										// bitmask of all real heaters in use
 	uint32_t heatSampleTicks;
@@ -827,6 +882,10 @@ private:
 #ifdef SERIAL_AUX_DEVICE
 	volatile OutputStack auxOutput;
 	Mutex auxMutex;
+# if SUPPORT_AUX_PDC
+	bool auxPdcBusy;								// true if the PDC is sending the first buffer in auxOutput
+	void AbortAuxPdc();
+# endif
 #endif
 
 	OutputBuffer *auxGCodeReply;				// G-Code reply for AUX devices (special one because it is actually encapsulated before sending)
@@ -881,6 +940,11 @@ private:
 	AnalogChannelNumber zProbeAdcChannel;
 	uint8_t tickState;
 	size_t currentFilterNumber;
+	StageTimer tickIsrTimer;								// execution times of the tick interrupt
+	StageTimer adcTickTimer;								// execution times of the ADC filter and Z probe processing for each tick
+	StageTimer adcFilterTimer;								// execution times of the ADC filter updates alone
+
+	void ProcessAdcTick() __attribute__((hot));
 	int debugCode;
 
 	// Hotend configuration
@@ -896,6 +960,7 @@ private:
 	uint32_t numUnderVoltageEvents, previousUnderVoltageEvents;
 	volatile uint32_t numOverVoltageEvents, previousOverVoltageEvents;
 	bool autoSaveEnabled;
+	volatile bool powerFailFastPathArmed;				// true if the tick ISR should stop the print as soon as the voltage drops below the auto save threshold
 
 	enum class AutoSaveState : uint8_t
 	{
@@ -1169,6 +1234,21 @@ inline float Platform::GetPressureAdvance(size_t extruder) const
 #endif
 
 // Get the interrupt clock count when we only care about the lowest 16 bits. More efficient than calling GetInterruptClocks on platforms with 16-bit timers.
+#if SUPPORT_ENDSTOP_INTERRUPTS
+
+// Return true if an endstop or Z probe input has changed since we last checked. Called from the step ISR.
+inline bool Platform::CheckEndstopChanged()
+{
+	if (endstopChanged)
+	{
+		endstopChanged = false;
+		return true;
+	}
+	return false;
+}
+
+#endif
+
 /*static*/ inline uint16_t Platform::GetInterruptClocks16()
 {
 	return (uint16_t)STEP_TC->TC_CHANNEL[STEP_TC_CHAN].TC_CV;
@@ -22,57 +22,100 @@ void PortControl::Init()
 	advanceMillis = 0;
 	advanceClocks = 0;
 	currentPortState = 0;
+	useTimer = false;
 }
 
 void PortControl::Exit()
 {
+	portTimer.CancelCallback();
 	UpdatePorts(0);
 	numConfiguredPorts = 0;
 }
 
+// If the ports can be written from an ISR then the port changes are made by the software timer callback, scheduled at the end of each move less the advance time.
+// In that case we only need to start the timer off here when movement starts. Otherwise we poll.
 void PortControl::Spin(bool full)
 {
-	if (numConfiguredPorts != 0 && reprap.GetGCodes().GetMachineType() != MachineType::laser)
+	if (numConfiguredPorts != 0)
 	{
-		cpu_irq_disable();
-		const DDA * cdda = reprap.GetMove().GetCurrentDDA();
-		if (cdda == nullptr)
+		if (reprap.GetGCodes().GetMachineType() == MachineType::laser)
 		{
-			// Movement has stopped, so turn all ports off
-			cpu_irq_enable();
-			UpdatePorts(0);
+			portTimer.CancelCallback();
 		}
-		else
+		else if (!portTimer.IsScheduled())
 		{
-			const uint32_t now = Platform::GetInterruptClocks() + advanceClocks;
-			uint32_t moveEndTime = cdda->GetMoveStartTime();
-			DDA::DDAState st = cdda->GetState();
-			do
+			const irqflags_t flags = cpu_irq_save();
+			uint32_t nextChangeTime;
+			bool moving;
+			const IoBits_t bits = GetPortState(nextChangeTime, moving);
+			if (useTimer)
 			{
-				moveEndTime += cdda->GetClocksNeeded();
-				if ((int32_t)(moveEndTime - now) >= 0)
+				UpdatePorts(bits);
+				if (moving)
 				{
-					break;
+					(void)portTimer.ScheduleCallback(nextChangeTime, TimerCallback, this);
 				}
-				cdda = cdda->GetNext();
-				st = cdda->GetState();
-			} while (st == DDA::executing || st == DDA::frozen);
-			cpu_irq_enable();
-
-			const IoBits_t bits = (st == DDA::executing || st == DDA::frozen || st == DDA::provisional) ? cdda->GetIoBits() : 0;
-			UpdatePorts(bits);
+				cpu_irq_restore(flags);
+			}
+			else
+			{
+				cpu_irq_restore(flags);
+				UpdatePorts(bits);
+			}
 		}
 	}
 }
 
+// Return the port state required by the move that is executing 'advanceClocks' from now.
+// If movement is in progress then set 'moving' and return the time at which the state may next need to change.
+// Interrupts must be disabled when calling this.
+IoBits_t PortControl::GetPortState(uint32_t& nextChangeTime, bool& moving) const
+{
+	moving = false;
+	const DDA * cdda = reprap.GetMove().GetCurrentDDA();
+	if (cdda == nullptr)
+	{
+		return 0;							// movement has stopped, so turn all ports off
+	}
+
+	const uint32_t now = Platform::GetInterruptClocks() + advanceClocks;
+	uint32_t moveEndTime = cdda->GetMoveStartTime();
+	DDA::DDAState st = cdda->GetState();
+	do
+	{
+		moveEndTime += cdda->GetClocksNeeded();
+		if ((int32_t)(moveEndTime - now) >= 0)
+		{
+			moving = true;
+			break;
+		}
+		cdda = cdda->GetNext();
+		st = cdda->GetState();
+	} while (st == DDA::executing || st == DDA::frozen);
+
+	nextChangeTime = moveEndTime - advanceClocks;
+	return (st == DDA::executing || st == DDA::frozen || st == DDA::provisional) ? cdda->GetIoBits() : 0;
+}
+
+// Software timer callback, called from the step timer ISR. Only used if all the ports can be written from an ISR.
+/*static*/ bool PortControl::TimerCallback(void *param, uint32_t& when)
+{
+	PortControl * const pc = static_cast<PortControl*>(param);
+	bool moving;
+	pc->UpdatePorts(pc->GetPortState(when, moving));
+	return moving;
+}
+
 bool PortControl::Configure(GCodeBuffer& gb, const StringRef& reply)
 {
 	bool seen = false;
 	if (gb.Seen('P'))
 	{
 		seen = true;
+		portTimer.CancelCallback();
 		UpdatePorts(0);
 		numConfiguredPorts = 0;
+		useTimer = true;
 		uint32_t portNumbers[MaxPorts];
 		size_t numPorts = MaxPorts;
 		gb.GetUnsignedArray(portNumbers, numPorts, false);
@@ -91,6 +134,7 @@ bool PortControl::Configure(GCodeBuffer& gb, const StringRef& reply)
 				return true;
 			}
 			pm.WriteDigital(false);				// ensure the port is off
+			useTimer = useTimer && pm.CanWriteFromInterrupt();
 			if (i >= numConfiguredPorts)
 			{
 				numConfiguredPorts = i + 1;
@@ -100,6 +144,7 @@ bool PortControl::Configure(GCodeBuffer& gb, const StringRef& reply)
 	if (gb.Seen('T'))
 	{
 		seen = true;
+		portTimer.CancelCallback();				// Spin will restart it using the new advance
 		advanceMillis = (unsigned int)constrain<int>(gb.GetIValue(), 0, 1000);
 		advanceClocks = (advanceMillis * (uint64_t)StepClockRate)/1000;
 	}
@@ -10,6 +10,7 @@
 
 #include "RepRapFirmware.h"
 #include "IoPorts.h"			// for PinConfiguration
+#include "SoftTimer.h"
 
 class GCodeBuffer;
 
@@ -26,6 +27,8 @@ public:
 
 private:
 	void UpdatePorts(IoBits_t newPortState);
+	IoBits_t GetPortState(uint32_t& nextChangeTime, bool& moving) const;
+	static bool TimerCallback(void *param, uint32_t& when);
 
 	static const size_t MaxPorts = 16;		// the port bitmap is currently a 16-bit word
 
@@ -34,6 +37,8 @@ private:
 	unsigned int advanceMillis;
 	uint32_t advanceClocks;
 	IoBits_t currentPortState;
+	bool useTimer;							// true if all the ports can be written from the software timer interrupt
+	SoftTimer portTimer;					// timer used to switch the ports at move boundaries independently of Spin
 };
 
 #endif
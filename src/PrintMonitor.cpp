@@ -22,14 +22,17 @@ Licence: GPL
 #include "GCodes/GCodes.h"
 #include "Heating/Heat.h"
 #include "Movement/Move.h"
+#include "PerfCounters.h"
 #include "Platform.h"
 #include "RepRap.h"
 
 PrintMonitor::PrintMonitor(Platform& p, GCodes& gc) : platform(p), gCodes(gc), isPrinting(false), heatingUp(false),
 	printStartTime(0), pauseStartTime(0), totalPauseTime(0), currentLayer(0), warmUpDuration(0.0),
 	firstLayerDuration(0.0), firstLayerFilament(0.0), firstLayerProgress(0.0), lastLayerChangeTime(0.0),
-	lastLayerFilament(0.0), lastLayerZ(0.0), numLayerSamples(0), layerEstimatedTimeLeft(0.0), printingFileParsed(false)
+	lastLayerFilament(0.0), lastLayerZ(0.0), printStartMoveTime(0.0), numLayerSamples(0), layerEstimatedTimeLeft(0.0), profilingLayers(false),
+	layerStartTime(0.0), layerStartMoveTime(0.0), layerStartWarmUpDuration(0.0), printingFileParsed(false)
 {
+	layerProfileFilename.copy(DEFAULT_LAYER_PROFILE_FILE);
 	filenameBeingPrinted[0] = 0;
 }
 
@@ -146,6 +149,7 @@ void PrintMonitor::Spin()
 					// Check if we've finished the first layer
 					if (liveCoordinates[Z_AXIS] > printingFileInfo.firstLayerHeight + LAYER_HEIGHT_TOLERANCE)
 					{
+						RecordLayerProfile(currentLayer, printingFileInfo.firstLayerHeight);
 						FirstLayerComplete();
 						currentLayer++;
 
@@ -156,6 +160,7 @@ void PrintMonitor::Spin()
 				// Else check for following layer changes
 				else if (liveCoordinates[Z_AXIS] > lastLayerZ + LAYER_HEIGHT_TOLERANCE)
 				{
+					RecordLayerProfile(currentLayer, lastLayerZ);
 					LayerComplete();
 					currentLayer++;
 
@@ -197,6 +202,18 @@ void PrintMonitor::StartedPrint()
 	heatingUp = false;
 	printStartTime = millis64();
 	warmUpDuration = 0.0;
+	printStartMoveTime = reprap.GetMove().GetCompletedMoveTime();
+	PerfCounters::Reset();
+	if (profilingLayers && !gCodes.IsSimulating())
+	{
+		FileStore * const f = platform.OpenFile(platform.GetLogDir(), layerProfileFilename.c_str(), OpenMode::write);
+		if (f != nullptr)
+		{
+			f->Write("layer,z,duration,moveTime,accelTime,cruiseTime,avgSpeed,peakSpeed,lookaheadUnderruns,prepareUnderruns,hiccups,heaterWait,stall\n");
+			f->Close();
+		}
+	}
+	StartLayerProfile();
 }
 
 // Called when the first layer has been finished
@@ -280,6 +297,10 @@ void PrintMonitor::LayerComplete()
 
 void PrintMonitor::StoppedPrint()
 {
+	if (isPrinting && currentLayer != 0)
+	{
+		RecordLayerProfile(currentLayer, (currentLayer == 1) ? printingFileInfo.firstLayerHeight : lastLayerZ);
+	}
 	isPrinting = heatingUp = printingFileParsed = false;
 	currentLayer = numLayerSamples = 0;
 	pauseStartTime = totalPauseTime = 0;
@@ -288,6 +309,71 @@ void PrintMonitor::StoppedPrint()
 	lastLayerChangeTime = lastLayerFilament = lastLayerZ = 0.0;
 }
 
+// Record the totals at the start of a layer, so that we can profile the layer when it is complete
+void PrintMonitor::StartLayerProfile()
+{
+	Move& move = reprap.GetMove();
+	move.GetMoveTotals(layerStartTotals);
+	layerStartMoveTime = move.GetCompletedMoveTime();
+	layerStartTime = GetPrintDuration();
+	layerStartWarmUpDuration = GetWarmUpDuration();
+}
+
+// Append a line describing the layer just finished to the layer profile file.
+// The move and acceleration times are the planned times of the moves completed during the layer. Stall time is the time when no move was executing, excluding heater waits.
+void PrintMonitor::RecordLayerProfile(unsigned int layer, float z)
+{
+	if (profilingLayers && !gCodes.IsSimulating())
+	{
+		Move& move = reprap.GetMove();
+		MoveTotals totals;
+		move.GetMoveTotals(totals);
+		const float layerTime = GetPrintDuration() - layerStartTime;
+		const float moveTime = move.GetCompletedMoveTime() - layerStartMoveTime;
+		const float accelTime = constrain<float>(totals.accelTime - layerStartTotals.accelTime, 0.0, moveTime);
+		const float heaterWait = GetWarmUpDuration() - layerStartWarmUpDuration;
+		const float distance = totals.distance - layerStartTotals.distance;
+
+		String<ScratchStringLength> line;
+		line.printf("%u,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%.1f,%.1f\n",
+					layer, (double)z, (double)layerTime, (double)moveTime, (double)accelTime, (double)(moveTime - accelTime),
+					(double)((moveTime > 0.0) ? distance/moveTime : 0.0), (double)totals.peakSpeed,
+					totals.lookaheadUnderruns - layerStartTotals.lookaheadUnderruns, totals.prepareUnderruns - layerStartTotals.prepareUnderruns,
+					totals.hiccups - layerStartTotals.hiccups, (double)heaterWait, (double)max<float>(layerTime - moveTime - heaterWait, 0.0));
+		FileStore * const f = platform.OpenFile(platform.GetLogDir(), layerProfileFilename.c_str(), OpenMode::append);
+		if (f != nullptr)
+		{
+			f->Write(line.c_str());
+			f->Close();
+		}
+	}
+	StartLayerProfile();
+}
+
+// Handle M930: enable or disable per-layer print profiling, or report whether it is enabled
+bool PrintMonitor::ConfigureLayerProfiling(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (gb.Seen('P'))
+	{
+		String<MaxFilenameLength> filename;
+		if (!gb.GetQuotedString(filename.GetRef()))
+		{
+			reply.copy("Missing filename in M930 command");
+			return true;
+		}
+		layerProfileFilename.copy(filename.c_str());
+	}
+	if (gb.Seen('S'))
+	{
+		profilingLayers = (gb.GetIValue() > 0);
+	}
+	else
+	{
+		reply.printf("Layer profiling is %s, file %s", (profilingLayers) ? "enabled" : "disabled", layerProfileFilename.c_str());
+	}
+	return false;
+}
+
 // Estimate the print time left in seconds on a preset estimation method
 float PrintMonitor::EstimateTimeLeft(PrintEstimationMethod method) const
 {
@@ -415,6 +501,19 @@ float PrintMonitor::EstimateTimeLeft(PrintEstimationMethod method) const
 				return (timeLeft > 0.0) ? timeLeft : 0.1;
 			}
 			break;
+
+		case simulationBased:
+		{
+			// Subtract the planned time of the moves we have executed from the total print time, preferably the time measured by simulating the file.
+			// Unlike the other methods this doesn't depend on the layers being similar, but it doesn't include heating time or allow for speed factor changes.
+			const uint32_t totalPrintTime = (printingFileInfo.simulatedTime != 0) ? printingFileInfo.simulatedTime : printingFileInfo.printTime;
+			if (totalPrintTime != 0 && !heatingUp)
+			{
+				const float moveTimeDone = reprap.GetMove().GetCompletedMoveTime() - printStartMoveTime;
+				return max<float>((float)totalPrintTime - moveTimeDone, 0.1);
+			}
+			break;
+		}
 	}
 
 	return 0.0;
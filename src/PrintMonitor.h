@@ -22,6 +22,7 @@ Licence: GPL
 
 #include "RepRapFirmware.h"
 #include "Storage/FileInfoParser.h"	// for struct GCodeFileInfo
+#include "Movement/Move.h"				// for struct MoveTotals
 
 const float LAYER_HEIGHT_TOLERANCE = 0.015;			// Tolerance for comparing two Z heights (in mm)
 
@@ -36,7 +37,8 @@ enum PrintEstimationMethod
 {
 	filamentBased,
 	fileBased,
-	layerBased
+	layerBased,
+	simulationBased
 };
 
 class PrintMonitor
@@ -65,6 +67,8 @@ class PrintMonitor
 		const char *GetPrintingFilename() const { return (isPrinting) ? filenameBeingPrinted.c_str() : nullptr; }
 		bool GetPrintingFileInfoResponse(OutputBuffer *&response) const;
 
+		bool ConfigureLayerProfiling(GCodeBuffer& gb, const StringRef& reply);	// Handle M930, returning true if an error occurred
+
 	private:
 		Platform& platform;
 		GCodes& gCodes;
@@ -73,6 +77,8 @@ class PrintMonitor
 		// Information/Events concerning the file being printed
 		void FirstLayerComplete();
 		void LayerComplete();
+		void StartLayerProfile();
+		void RecordLayerProfile(unsigned int layer, float z);
 
 		bool isPrinting;
 		bool heatingUp;
@@ -85,12 +91,20 @@ class PrintMonitor
 		float firstLayerFilament, firstLayerProgress;
 		float lastLayerChangeTime, lastLayerFilament, lastLayerZ;
 
+		float printStartMoveTime;						// the completed move time when the print started
+
 		unsigned int numLayerSamples;
 		float layerDurations[MAX_LAYER_SAMPLES];
 		float filamentUsagePerLayer[MAX_LAYER_SAMPLES];
 		float fileProgressPerLayer[MAX_LAYER_SAMPLES];
 		float layerEstimatedTimeLeft;
 
+		// Per-layer profiling, enabled by M930
+		bool profilingLayers;
+		String<MaxFilenameLength> layerProfileFilename;
+		float layerStartTime, layerStartMoveTime, layerStartWarmUpDuration;
+		MoveTotals layerStartTotals;
+
 		bool printingFileParsed;
 		GCodeFileInfo printingFileInfo;
 		String<MaxFilenameLength> filenameBeingPrinted;
@@ -9,6 +9,7 @@
 #define SRC_RTOSIFACE_H_
 
 #include <cstdint>
+#include <cstddef>
 
 // Type declarations to hide the type-unsafe definitions in the FreeRTOS headers
 
@@ -71,8 +72,13 @@ public:
 
 	TaskHandle GetHandle() const { return static_cast<TaskHandle>(handle); }
 	void Suspend() const { vTaskSuspend(handle); }
+	void Give() const { xTaskNotifyGive(handle); }
+	void GiveFromISR() const;						// wake the task from an interrupt, if the task has been created
 	const TaskBase *GetNext() const { return next; }
 
+	// Wait until the task is given a notification or the timeout (in ticks) expires, returning zero if it timed out. Must be called from the task itself.
+	static uint32_t Take(uint32_t timeout) { return ulTaskNotifyTake(pdTRUE, timeout); }
+
 	TaskBase(const TaskBase&) = delete;				// it's not safe to copy these
 	TaskBase& operator=(const TaskBase&) = delete;	// it's not safe to assign these
 	// Ideally we would declare the destructor as deleted too, because it's unsafe to delete these because they are linked together via the 'next' field.
@@ -87,6 +93,8 @@ public:
 
 	static constexpr int SpinPriority = 1;			// priority for tasks that rarely block
 	static constexpr int HeatPriority = 2;
+	static constexpr int StoragePriority = 2;		// above the main and network tasks, so that print file reads go first
+	static constexpr int TickPriority = 3;			// the tick task does the work that used to be done in the tick interrupt, so it must pre-empt everything else
 
 protected:
 	TaskHandle_t handle;
@@ -96,6 +104,16 @@ protected:
 	static TaskBase *taskList;
 };
 
+inline void TaskBase::GiveFromISR() const
+{
+	if (handle != nullptr)
+	{
+		BaseType_t higherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(handle, &higherPriorityTaskWoken);
+		portYIELD_FROM_ISR(higherPriorityTaskWoken);
+	}
+}
+
 template<unsigned int StackWords> class Task : public TaskBase
 {
 public:
@@ -194,8 +212,85 @@ namespace RTOSIface
 		taskYIELD();
 #endif
 	}
+
+	// Stop the compiler moving memory accesses across this point. We only have one core, so an ISR or another task always sees our memory accesses in program order.
+	inline void CompilerBarrier()
+	{
+		__asm volatile ("" : : : "memory");
+	}
 }
 
+// Lock-free ring buffer for passing items from a single producer to a single consumer, e.g. from an ISR to a task.
+// The producer only writes putIndex and the consumer only writes getIndex, so neither needs to disable interrupts. N must be a power of 2.
+template<class T, size_t N> class SpscQueue
+{
+public:
+	SpscQueue() : putIndex(0), getIndex(0) { }
+
+	// These may only be called by the producer
+	bool Put(const T& item);						// returns false if the queue is full
+	bool IsFull() const { return putIndex - getIndex == N; }
+
+	// These may only be called by the consumer
+	bool Get(T& item);								// returns false if the queue is empty
+	bool IsEmpty() const { return putIndex == getIndex; }
+	void Clear() { getIndex = putIndex; }
+
+	size_t Count() const { return putIndex - getIndex; }
+
+private:
+	static_assert(N != 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of 2");
+
+	T items[N];
+	volatile uint32_t putIndex;						// free-running count of items put
+	volatile uint32_t getIndex;						// free-running count of items taken
+};
+
+template<class T, size_t N> bool SpscQueue<T, N>::Put(const T& item)
+{
+	const uint32_t pi = putIndex;
+	if (pi - getIndex == N)
+	{
+		return false;
+	}
+	items[pi & (N - 1)] = item;
+	RTOSIface::CompilerBarrier();					// the item must be stored before the consumer can see it
+	putIndex = pi + 1;
+	return true;
+}
+
+template<class T, size_t N> bool SpscQueue<T, N>::Get(T& item)
+{
+	const uint32_t gi = getIndex;
+	if (putIndex == gi)
+	{
+		return false;
+	}
+	RTOSIface::CompilerBarrier();					// don't fetch the item until we know it has been stored
+	item = items[gi & (N - 1)];
+	RTOSIface::CompilerBarrier();					// the item must be fetched before the producer can overwrite it
+	getIndex = gi + 1;
+	return true;
+}
+
+// Sequence lock, so that readers can take a consistent copy of data that an ISR updates without disabling interrupts.
+// Only one writer may be active at a time, so a writer that is not an ISR must disable interrupts while writing. The data is consistent if ReadFailed
+// returns false after reading it, otherwise the reader must try again. A reader must never interrupt a writer, in practice this means that readers are tasks.
+class SeqLock
+{
+public:
+	SeqLock() : sequence(0) { }
+
+	void BeginWrite() { sequence = sequence + 1; RTOSIface::CompilerBarrier(); }
+	void EndWrite() { RTOSIface::CompilerBarrier(); sequence = sequence + 1; }
+
+	uint32_t BeginRead() const { const uint32_t seq = sequence; RTOSIface::CompilerBarrier(); return seq; }
+	bool ReadFailed(uint32_t seq) const { RTOSIface::CompilerBarrier(); return (seq & 1) != 0 || sequence != seq; }
+
+private:
+	volatile uint32_t sequence;						// odd while a write is in progress
+};
+
 class InterruptCriticalSectionLocker
 {
 public:
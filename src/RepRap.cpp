@@ -2,6 +2,7 @@
 
 #include "Movement/Move.h"
 #include "GCodes/GCodes.h"
+#include "GCodes/GCodeBuffer.h"
 #include "Heating/Heat.h"
 #include "Network.h"
 #include "Platform.h"
@@ -10,6 +11,8 @@
 #include "Tools/Tool.h"
 #include "Tools/Filament.h"
 #include "Tasks.h"
+#include "PerfCounters.h"
+#include "Movement/StageTimer.h"
 #include "Version.h"
 
 #ifdef DUET_NG
@@ -20,6 +23,10 @@
 # include "PortControl.h"
 #endif
 
+#if SUPPORT_TMC2660
+# include "Movement/StepperDrivers/TMC2660.h"
+#endif
+
 #if SUPPORT_12864_LCD
 # include "Display/Display.h"
 #endif
@@ -255,6 +262,13 @@ void RepRap::Init()
 
 	fastLoop = UINT32_MAX;
 	slowLoop = 0;
+	for (uint64_t& c : moduleSpinCycles)
+	{
+		c = 0;
+	}
+	spinBudgetCycles = DefaultSpinBudgetMicroseconds * (VARIANT_MCK/1000000);
+	ResetModuleSpinStats();
+	lastModuleSwitchCycles = StageTimer::GetCycles();
 }
 
 void RepRap::Exit()
@@ -279,6 +293,32 @@ void RepRap::Exit()
 	platform->Exit();
 }
 
+// Record that we are about to spin a module, charging the CPU cycles since the last change to the module that was spinning.
+// The cycle counter wraps after 2^32 cycles, which is tens of seconds, but a module that spins for that long is about to trigger the watchdog anyway.
+inline void RepRap::SetSpinningModule(Module m)
+{
+	const uint32_t now = StageTimer::GetCycles();
+	const uint32_t spinCycles = now - lastModuleSwitchCycles;
+	moduleSpinCycles[spinningModule] += spinCycles;
+	if (spinningModule < numModules)
+	{
+		ModuleSpinStats& stats = moduleSpinStats[spinningModule];
+		stats.totalCycles += spinCycles;
+		++stats.numSpins;
+		if (spinCycles > stats.maxCycles)
+		{
+			stats.maxCycles = spinCycles;
+		}
+		if (spinCycles > spinBudgetCycles)
+		{
+			++stats.numOverBudget;
+		}
+	}
+	lastModuleSwitchCycles = now;
+	ticksInSpinState = 0;
+	spinningModule = m;
+}
+
 void RepRap::Spin()
 {
 	if (!active)
@@ -288,73 +328,75 @@ void RepRap::Spin()
 
 	const uint32_t lastTime = Platform::GetInterruptClocks();
 
-	ticksInSpinState = 0;
-	spinningModule = modulePlatform;
+	SetSpinningModule(modulePlatform);
 	platform->Spin();
 
-#ifndef RTOS
-	ticksInSpinState = 0;
-	spinningModule = moduleNetwork;
-	network->Spin(true);
+#ifdef RTOS
+	if (processingConfig)			// the network task isn't created until config.g has been run, but we need to spin the network so that the WiFi module can start meanwhile
 #endif
+	{
+		SetSpinningModule(moduleNetwork);
+		network->Spin(true);
+	}
 
-	ticksInSpinState = 0;
-	spinningModule = moduleWebserver;
-
-	ticksInSpinState = 0;
-	spinningModule = moduleGcodes;
+	SetSpinningModule(moduleGcodes);
 	gCodes->Spin();
 
-	ticksInSpinState = 0;
-	spinningModule = moduleMove;
+	SetSpinningModule(moduleMove);
 	move->Spin();
 
+	// When simulating a file the moves complete as soon as they are prepared, so run the file through the planner in a tight loop until our time slice is used up
+	if (gCodes->IsSimulatingFile())
+	{
+		const uint32_t simulationStartTime = millis();
+		do
+		{
+			SetSpinningModule(moduleGcodes);
+			gCodes->SpinSimulation();
+
+			SetSpinningModule(moduleMove);
+			move->Spin();
+		} while (gCodes->IsSimulatingFile() && millis() - simulationStartTime < SimulationSpinTime);
+	}
+
 #ifndef RTOS
-	ticksInSpinState = 0;
-	spinningModule = moduleHeat;
+	SetSpinningModule(moduleHeat);
 	heat->Spin();
 #endif
 
 #if SUPPORT_ROLAND
-	ticksInSpinState = 0;
-	spinningModule = moduleRoland;
+	SetSpinningModule(moduleRoland);
 	roland->Spin();
 #endif
 
 #if SUPPORT_SCANNER && !SCANNER_AS_SEPARATE_TASK
-	ticksInSpinState = 0;
-	spinningModule = moduleScanner;
+	SetSpinningModule(moduleScanner);
 	scanner->Spin();
 #endif
 
 #if SUPPORT_IOBITS
-	ticksInSpinState = 0;
-	spinningModule = modulePortControl;
+	SetSpinningModule(modulePortControl);
 	portControl->Spin(true);
 #endif
 
-	ticksInSpinState = 0;
-	spinningModule = modulePrintMonitor;
+	SetSpinningModule(modulePrintMonitor);
 	printMonitor->Spin();
 
 #ifdef DUET_NG
-	ticksInSpinState = 0;
-	spinningModule = moduleDuetExpansion;
+	SetSpinningModule(moduleDuetExpansion);
 	DuetExpansion::Spin(true);
 #endif
 
-	ticksInSpinState = 0;
-	spinningModule = moduleFilamentSensors;
+	SetSpinningModule(moduleFilamentSensors);
 	FilamentMonitor::Spin(true);
 
 #if SUPPORT_12864_LCD
-	ticksInSpinState = 0;
-	spinningModule = moduleDisplay;
+	SetSpinningModule(moduleDisplay);
 	display->Spin(true);
 #endif
 
-	ticksInSpinState = 0;
-	spinningModule = noModule;
+	SetSpinningModule(noModule);
+	PerfCounters::Spin();
 
 	// Check if we need to send diagnostics
 	if (diagnosticsDestination != MessageType::NoDestinationMessage)
@@ -400,11 +442,88 @@ void RepRap::Spin()
 	RTOSIface::Yield();
 }
 
+// Get the percentage of the main task's elapsed time spent spinning each module since we last asked, and start a new measurement period.
+// Under RTOS this includes any time for which the main task was pre-empted. The last element is the time spent outside all the modules.
+void RepRap::GetModuleSpinPercentages(float percentages[numModules + 1])
+{
+	const uint32_t now = StageTimer::GetCycles();
+	moduleSpinCycles[spinningModule] += now - lastModuleSwitchCycles;
+	lastModuleSwitchCycles = now;
+
+	uint64_t totalCycles = 0;
+	for (uint64_t c : moduleSpinCycles)
+	{
+		totalCycles += c;
+	}
+	for (size_t i = 0; i <= numModules; ++i)
+	{
+		percentages[i] = (totalCycles == 0) ? 0.0 : 100.0 * (float)moduleSpinCycles[i]/(float)totalCycles;
+		moduleSpinCycles[i] = 0;
+	}
+}
+
+void RepRap::ResetModuleSpinStats()
+{
+	for (ModuleSpinStats& stats : moduleSpinStats)
+	{
+		stats.totalCycles = 0;
+		stats.numSpins = stats.maxCycles = stats.numOverBudget = 0;
+	}
+}
+
+// Process M932, which sets or reports the time that a module may spin for before we count it as over budget in the M122 report
+GCodeResult RepRap::ConfigureSpinBudget(GCodeBuffer& gb, const StringRef& reply)
+{
+	if (gb.Seen('S'))
+	{
+		const float budgetMillis = gb.GetFValue();
+		if (budgetMillis <= 0.0 || budgetMillis > 10000.0)
+		{
+			reply.copy("Spin time budget out of range");
+			return GCodeResult::error;
+		}
+		spinBudgetCycles = (uint32_t)(budgetMillis * (float)(VARIANT_MCK/1000));
+		ResetModuleSpinStats();
+	}
+	else
+	{
+		reply.printf("Module spin time budget %.2fms", (double)(StageTimer::CyclesToMicroseconds(spinBudgetCycles) * 0.001));
+	}
+	return GCodeResult::ok;
+}
+
 void RepRap::Timing(MessageType mtype)
 {
 	platform->MessageF(mtype, "Slowest loop: %.2fms; fastest: %.2fms\n", (double)(slowLoop * StepClocksToMillis), (double)(fastLoop * StepClocksToMillis));
 	fastLoop = UINT32_MAX;
 	slowLoop = 0;
+
+	float spinPercentages[numModules + 1];
+	GetModuleSpinPercentages(spinPercentages);
+	platform->Message(mtype, "Spin time:");
+	for (size_t i = 0; i <= numModules; ++i)
+	{
+		if (spinPercentages[i] != 0.0)
+		{
+			platform->MessageF(mtype, " %s %.1f%%", moduleName[i], (double)spinPercentages[i]);
+		}
+	}
+	platform->Message(mtype, "\n");
+
+	// Report the individual spin times of each module, so that we can see which one is causing stutters. Under RTOS these include any time the main task was pre-empted.
+	platform->MessageF(mtype, "Module spins (mean/max ms, number over %.2fms budget):", (double)(StageTimer::CyclesToMicroseconds(spinBudgetCycles) * 0.001));
+	for (size_t i = 0; i < numModules; ++i)
+	{
+		const ModuleSpinStats& stats = moduleSpinStats[i];
+		if (stats.numSpins != 0)
+		{
+			platform->MessageF(mtype, " %s %.2f/%.2f/%" PRIu32, moduleName[i],
+								(double)(StageTimer::CyclesToMicroseconds((uint32_t)(stats.totalCycles/stats.numSpins)) * 0.001),
+								(double)(StageTimer::CyclesToMicroseconds(stats.maxCycles) * 0.001), stats.numOverBudget);
+		}
+	}
+	platform->Message(mtype, "\n");
+	ResetModuleSpinStats();
 }
 
 void RepRap::Diagnostics(MessageType mtype)
@@ -428,7 +547,8 @@ void RepRap::Diagnostics(MessageType mtype)
 	// Show the used and free buffer counts. Do this early in case we are running out of them and the diagnostics get truncated.
 	OutputBuffer::Diagnostics(mtype);
 
-	// Now print diagnostics for other modules
+	// Now print diagnostics for other modules. Many of them clear their counters, so sample the counters before and after that.
+	PerfCounters::Sample();
 	Tasks::Diagnostics(mtype);
 	platform->Diagnostics(mtype);				// this includes a call to our Timing() function
 	move->Diagnostics(mtype);
@@ -439,6 +559,7 @@ void RepRap::Diagnostics(MessageType mtype)
 #ifdef DUET_NG
 	DuetExpansion::Diagnostics(mtype);
 #endif
+	PerfCounters::Sample();
 	justSentDiagnostics = true;
 }
 
@@ -760,7 +881,9 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 
 	// Machine status
 	char ch = GetStatusCharacter();
-	response->printf("{\"status\":\"%c\",\"coords\":{", ch);
+	response->cat("{\"status\":\"");
+	response->cat(ch);
+	response->cat("\",\"coords\":{");
 
 	// Coordinates
 	const size_t numVisibleAxes = gCodes->GetVisibleAxes();
@@ -769,7 +892,8 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 	ch = '[';
 	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
 	{
-		response->catf("%c%d", ch, (gCodes->GetAxisIsHomed(axis)) ? 1 : 0);
+		response->cat(ch);
+		response->catInt((gCodes->GetAxisIsHomed(axis)) ? 1 : 0);
 		ch = ',';
 	}
 
@@ -785,7 +909,8 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 	for (size_t axis = 0; axis < numVisibleAxes; axis++)
 	{
 		const float coord = userPos[axis];
-		response->catf("%c%.3f", ch, HideNan(coord));
+		response->cat(ch);
+		response->catFloat(HideNan(coord), 3);
 		ch = ',';
 	}
 
@@ -804,20 +929,22 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		}
 
 		// Machine coordinates
-		response->catf("],\"machine\":");		// announce the machine position
+		response->cat("],\"machine\":");		// announce the machine position
 		ch = '[';
 		for (size_t drive = 0; drive < numVisibleAxes; drive++)
 		{
-			response->catf("%c%.3f", ch, HideNan(liveCoordinates[drive]));
+			response->cat(ch);
+			response->catFloat(HideNan(liveCoordinates[drive]), 3);
 			ch = ',';
 		}
 
 		// Actual and theoretical extruder positions since power up, last G92 or last M23
-		response->catf("],\"extr\":");			// announce actual extruder positions
+		response->cat("],\"extr\":");			// announce actual extruder positions
 		ch = '[';
 		for (size_t extruder = 0; extruder < GetExtrudersInUse(); extruder++)
 		{
-			response->catf("%c%.1f", ch, (double)liveCoordinates[gCodes->GetTotalAxes() + extruder]);
+			response->cat(ch);
+			response->catFloat(liveCoordinates[gCodes->GetTotalAxes() + extruder], 1);
 			ch = ',';
 		}
 		if (ch == '[')							// we may have no extruders
@@ -827,11 +954,15 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 	}
 
 	// Current speeds
-	response->catf("]},\"speeds\":{\"requested\":%.1f,\"top\":%.1f}",
-			(double)move->GetRequestedSpeed(), (double)move->GetTopSpeed());
+	response->cat("]},\"speeds\":{\"requested\":");
+	response->catFloat(move->GetRequestedSpeed(), 1);
+	response->cat(",\"top\":");
+	response->catFloat(move->GetTopSpeed(), 1);
+	response->cat('}');
 
  	// Current tool number
-	response->catf(",\"currentTool\":%d", GetCurrentToolNumber());
+	response->cat(",\"currentTool\":");
+	response->catInt(GetCurrentToolNumber());
 
 	// Output notifications
 	{
@@ -853,7 +984,10 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 			// Report beep values
 			if (sendBeep)
 			{
-				response->catf("\"beepDuration\":%u,\"beepFrequency\":%u", beepDuration, beepFrequency);
+				response->cat("\"beepDuration\":");
+				response->catUInt(beepDuration);
+				response->cat(",\"beepFrequency\":");
+				response->catUInt(beepFrequency);
 				if (sendMessage)
 				{
 					response->cat(",");
@@ -880,7 +1014,15 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				response->EncodeString(boxMessage.c_str(), boxMessage.Capacity(), false);
 				response->cat(",\"title\":");
 				response->EncodeString(boxTitle.c_str(), boxTitle.Capacity(), false);
-				response->catf(",\"mode\":%d,\"seq\":%" PRIu32 ",\"timeout\":%.1f,\"controls\":%" PRIu32 "}", boxMode, boxSeq, (double)timeLeft, boxControls);
+				response->cat(",\"mode\":");
+				response->catInt(boxMode);
+				response->cat(",\"seq\":");
+				response->catUInt(boxSeq);
+				response->cat(",\"timeout\":");
+				response->catFloat(timeLeft, 1);
+				response->cat(",\"controls\":");
+				response->catUInt(boxControls);
+				response->cat('}');
 			}
 			response->cat("}");
 		}
@@ -889,14 +1031,16 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 	// Parameters
 	{
 		// ATX power
-		response->catf(",\"params\":{\"atxPower\":%d", platform->AtxPower() ? 1 : 0);
+		response->cat(",\"params\":{\"atxPower\":");
+		response->catInt(platform->AtxPower() ? 1 : 0);
 
 		// Cooling fan value
 		response->cat(",\"fanPercent\":");
 		ch = '[';
 		for (size_t i = 0; i < NUM_FANS; i++)
 		{
-			response->catf("%c%d", ch, (int)lrintf(platform->GetFanValue(i) * 100.0));
+			response->cat(ch);
+			response->catInt((int)lrintf(platform->GetFanValue(i) * 100.0));
 			ch = ',';
 		}
 		response->cat((ch == '[') ? "[]" : "]");
@@ -918,21 +1062,27 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		}
 
 		// Speed and Extrusion factors
-		response->catf(",\"speedFactor\":%.1f,\"extrFactors\":", (double)(gCodes->GetSpeedFactor() * 100.0));
+		response->cat(",\"speedFactor\":");
+		response->catFloat(gCodes->GetSpeedFactor() * 100.0, 1);
+		response->cat(",\"extrFactors\":");
 		ch = '[';
 		for (size_t extruder = 0; extruder < GetExtrudersInUse(); extruder++)
 		{
-			response->catf("%c%.1f", ch, (double)(gCodes->GetExtrusionFactor(extruder) * 100.0));
+			response->cat(ch);
+			response->catFloat(gCodes->GetExtrusionFactor(extruder) * 100.0, 1);
 			ch = ',';
 		}
 		response->cat((ch == '[') ? "[]" : "]");
-		response->catf(",\"babystep\":%.3f}", (double)gCodes->GetBabyStepOffset());
+		response->cat(",\"babystep\":");
+		response->catFloat(gCodes->GetBabyStepOffset(), 3);
+		response->cat('}');
 	}
 
 	// G-code reply sequence for webserver (sequence number for AUX is handled later)
 	if (source == ResponseSource::HTTP)
 	{
-		response->catf(",\"seq\":%" PRIu32, network->GetHttpReplySeq());
+		response->cat(",\"seq\":");
+		response->catUInt(network->GetHttpReplySeq());
 	}
 
 	/* Sensors */
@@ -945,13 +1095,24 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		switch (platform->GetZProbeSecondaryValues(v1, v2))
 		{
 			case 1:
-				response->catf("\"probeValue\":%d,\"probeSecondary\":[%d]", v0, v1);
+				response->cat("\"probeValue\":");
+				response->catInt(v0);
+				response->cat(",\"probeSecondary\":[");
+				response->catInt(v1);
+				response->cat(']');
 				break;
 			case 2:
-				response->catf("\"probeValue\":%d,\"probeSecondary\":[%d,%d]", v0, v1, v2);
+				response->cat("\"probeValue\":");
+				response->catInt(v0);
+				response->cat(",\"probeSecondary\":[");
+				response->catInt(v1);
+				response->cat(',');
+				response->catInt(v2);
+				response->cat(']');
 				break;
 			default:
-				response->catf("\"probeValue\":%d", v0);
+				response->cat("\"probeValue\":");
+				response->catInt(v0);
 				break;
 		}
 
@@ -965,16 +1126,41 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				char ch = '[';
 				for (size_t i = 0; i < NumTachos; ++i)
 				{
-					response->catf("%c%" PRIu32, ch, platform->GetFanRPM(i));
+					response->cat(ch);
+					response->catUInt(platform->GetFanRPM(i));
 					ch = ',';
 				}
 				response->cat(']');
 			}
 			else
 			{
-				response->catf("%" PRIu32, platform->GetFanRPM(0));
+				response->catUInt(platform->GetFanRPM(0));
 			}
 		}
+
+#if SUPPORT_TMC2660
+		// Send the min/mean/max StallGuard readings from the last move of each smart driver, or an empty array if there are none. Lower readings mean higher motor load.
+		if (platform->GetNumSmartDrivers() != 0)
+		{
+			response->cat(",\"driverLoad\":");
+			char ch = '[';
+			for (size_t driver = 0; driver < platform->GetNumSmartDrivers(); ++driver)
+			{
+				response->cat(ch);
+				ch = ',';
+				DriverLoadStats loadStats;
+				if (SmartDrivers::GetLoadStats(driver, loadStats))
+				{
+					response->catf("[%u,%u,%u]", loadStats.minLoadReading, loadStats.meanLoadReading, loadStats.maxLoadReading);
+				}
+				else
+				{
+					response->cat("[]");
+				}
+			}
+			response->cat(']');
+		}
+#endif
 		response->cat('}');		// end sensors
 	}
 
@@ -986,27 +1172,48 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		const int8_t bedHeater = (NumBedHeaters > 0) ? heat->GetBedHeater(0) : -1;
 		if (bedHeater != -1)
 		{
-			response->catf("\"bed\":{\"current\":%.1f,\"active\":%.1f,\"state\":%d,\"heater\":%d},",
-				(double)heat->GetTemperature(bedHeater), (double)heat->GetActiveTemperature(bedHeater),
-					heat->GetStatus(bedHeater), bedHeater);
+			response->cat("\"bed\":{\"current\":");
+			const Heat::HeaterReport report = heat->GetHeaterReport(bedHeater);
+			response->catFloat(report.current, 1);
+			response->cat(",\"active\":");
+			response->catFloat(report.active, 1);
+			response->cat(",\"state\":");
+			response->catInt(report.status);
+			response->cat(",\"heater\":");
+			response->catInt(bedHeater);
+			response->cat("},");
 		}
 
 		/* Chamber */
 		const int8_t chamberHeater = (NumChamberHeaters > 0) ? heat->GetChamberHeater(0) : -1;
 		if (chamberHeater != -1)
 		{
-			response->catf("\"chamber\":{\"current\":%.1f,\"active\":%.1f,\"state\":%d,\"heater\":%d},",
-				(double)heat->GetTemperature(chamberHeater), (double)heat->GetActiveTemperature(chamberHeater),
-					heat->GetStatus(chamberHeater), chamberHeater);
+			response->cat("\"chamber\":{\"current\":");
+			const Heat::HeaterReport report = heat->GetHeaterReport(chamberHeater);
+			response->catFloat(report.current, 1);
+			response->cat(",\"active\":");
+			response->catFloat(report.active, 1);
+			response->cat(",\"state\":");
+			response->catInt(report.status);
+			response->cat(",\"heater\":");
+			response->catInt(chamberHeater);
+			response->cat("},");
 		}
 
 		/* Cabinet */
 		const int8_t cabinetHeater = (NumChamberHeaters > 1) ? heat->GetChamberHeater(1) : -1;
 		if (cabinetHeater != -1)
 		{
-			response->catf("\"cabinet\":{\"current\":%.1f,\"active\":%.1f,\"state\":%d,\"heater\":%d},",
-				(double)heat->GetTemperature(cabinetHeater), (double)heat->GetActiveTemperature(cabinetHeater),
-					heat->GetStatus(cabinetHeater), cabinetHeater);
+			response->cat("\"cabinet\":{\"current\":");
+			const Heat::HeaterReport report = heat->GetHeaterReport(cabinetHeater);
+			response->catFloat(report.current, 1);
+			response->cat(",\"active\":");
+			response->catFloat(report.active, 1);
+			response->cat(",\"state\":");
+			response->catInt(report.status);
+			response->cat(",\"heater\":");
+			response->catInt(cabinetHeater);
+			response->cat("},");
 		}
 
 		/* Heaters */
@@ -1016,7 +1223,8 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		ch = '[';
 		for (size_t heater = 0; heater < Heaters; heater++)
 		{
-			response->catf("%c%.1f", ch, (double)heat->GetTemperature(heater));
+			response->cat(ch);
+			response->catFloat(heat->GetHeaterReport(heater).current, 1);
 			ch = ',';
 		}
 		response->cat((ch == '[') ? "[]" : "]");
@@ -1026,7 +1234,8 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		ch = '[';
 		for (size_t heater = 0; heater < Heaters; heater++)
 		{
-			response->catf("%c%d", ch, heat->GetStatus(heater));
+			response->cat(ch);
+			response->catInt(heat->GetHeaterReport(heater).status);
 			ch = ',';
 		}
 		response->cat((ch == '[') ? "[]" : "]");
@@ -1056,7 +1265,8 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				ch = '[';
 				for (size_t heater = 0; heater < tool->heaterCount; heater++)
 				{
-					response->catf("%c%.1f", ch, (double)tool->activeTemperatures[heater]);
+					response->cat(ch);
+					response->catFloat(tool->activeTemperatures[heater], 1);
 					ch = ',';
 				}
 				response->cat((ch == '[') ? "[]" : "]");
@@ -1073,7 +1283,8 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				ch = '[';
 				for (size_t heater = 0; heater < tool->heaterCount; heater++)
 				{
-					response->catf("%c%.1f", ch, (double)tool->standbyTemperatures[heater]);
+					response->cat(ch);
+					response->catFloat(tool->standbyTemperatures[heater], 1);
 					ch = ',';
 				}
 				response->cat((ch == '[') ? "[]" : "]");
@@ -1100,9 +1311,9 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				first = false;
 				response->cat("{\"name\":");
 				response->EncodeString(nm, strlen(nm), false, true);
-				TemperatureError err;
-				const float t = heat->GetTemperature(heater, err);
-				response->catf(",\"temp\":%.1f}", (double)t);
+				response->cat(",\"temp\":");
+				response->catFloat(heat->GetExtraTemperatureReport(heater), 1);
+				response->cat('}');
 			}
 		}
 
@@ -1110,14 +1321,19 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 	}
 
 	// Time since last reset
-	response->catf(",\"time\":%.1f", (double)(millis64()/1000u));
+	response->cat(",\"time\":");
+	response->catFloat((float)(millis64()/1000u), 1);
 
 #if SUPPORT_SCANNER
 	// Scanner
 	if (scanner->IsEnabled())
 	{
-		response->catf(",\"scanner\":{\"status\":\"%c\"", scanner->GetStatusCharacter());
-		response->catf(",\"progress\":%.1f}", (double)(scanner->GetProgress()));
+		response->cat(",\"scanner\":{\"status\":\"");
+		response->cat(scanner->GetStatusCharacter());
+		response->cat('"');
+		response->cat(",\"progress\":");
+		response->catFloat(scanner->GetProgress(), 1);
+		response->cat('}');
 	}
 #endif
 
@@ -1144,10 +1360,15 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				}
 
 				const Spindle& spindle = platform->AccessSpindle(i);
-				response->catf("{\"current\":%.1f,\"active\":%.1f", (double)spindle.GetCurrentRpm(), (double)spindle.GetRpm());
+				response->cat("{\"current\":");
+				response->catFloat(spindle.GetCurrentRpm(), 1);
+				response->cat(",\"active\":");
+				response->catFloat(spindle.GetRpm(), 1);
 				if (type == 2)
 				{
-					response->catf(",\"tool\":%d}", spindle.GetToolNumber());
+					response->cat(",\"tool\":");
+					response->catInt(spindle.GetToolNumber());
+					response->cat('}');
 				}
 				else
 				{
@@ -1162,8 +1383,10 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 	if (type == 2)
 	{
 		// Cold Extrude/Retract
-		response->catf(",\"coldExtrudeTemp\":%.1f", (double)(heat->ColdExtrude() ? 0.0 : HOT_ENOUGH_TO_EXTRUDE));
-		response->catf(",\"coldRetractTemp\":%.1f", (double)(heat->ColdExtrude() ? 0.0 : HOT_ENOUGH_TO_RETRACT));
+		response->cat(",\"coldExtrudeTemp\":");
+		response->catFloat(heat->ColdExtrude() ? 0.0 : HOT_ENOUGH_TO_EXTRUDE, 1);
+		response->cat(",\"coldRetractTemp\":");
+		response->catFloat(heat->ColdExtrude() ? 0.0 : HOT_ENOUGH_TO_RETRACT, 1);
 
 		// Compensation type
 		response->cat(",\"compensation\":");
@@ -1173,7 +1396,9 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		}
 		else if (move->GetNumProbePoints() > 0)
 		{
-			response->catf("\"%u Point\"", move->GetNumProbePoints());
+			response->cat('"');
+			response->catUInt(move->GetNumProbePoints());
+			response->cat(" Point\"");
 		}
 		else
 		{
@@ -1189,10 +1414,12 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				SetBit(controllableFans, fan);
 			}
 		}
-		response->catf(",\"controllableFans\":%lu", controllableFans);
+		response->cat(",\"controllableFans\":");
+		response->catUInt(controllableFans);
 
 		// Maximum hotend temperature - DWC just wants the highest one
-		response->catf(",\"tempLimit\":%.1f", (double)(heat->GetHighestTemperatureLimit()));
+		response->cat(",\"tempLimit\":");
+		response->catFloat(heat->GetHighestTemperatureLimit(), 1);
 
 		// Endstops
 		uint32_t endstops = 0;
@@ -1213,11 +1440,21 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				endstops |= (1u << drive);
 			}
 		}
-		response->catf(",\"endstops\":%" PRIu32, endstops);
+		response->cat(",\"endstops\":");
+		response->catUInt(endstops);
 
 		// Firmware name, machine geometry and number of axes
-		response->catf(",\"firmwareName\":\"%s\",\"geometry\":\"%s\",\"axes\":%u,\"totalAxes\":%u,\"axisNames\":\"%s\"",
-			FIRMWARE_NAME, move->GetGeometryString(), numVisibleAxes, numTotalAxes, gCodes->GetAxisLetters());
+		response->cat(",\"firmwareName\":\"");
+		response->cat(FIRMWARE_NAME);
+		response->cat("\",\"geometry\":\"");
+		response->cat(move->GetGeometryString());
+		response->cat("\",\"axes\":");
+		response->catUInt(numVisibleAxes);
+		response->cat(",\"totalAxes\":");
+		response->catUInt(numTotalAxes);
+		response->cat(",\"axisNames\":\"");
+		response->cat(gCodes->GetAxisLetters());
+		response->cat('"');
 
 		// Total and mounted volumes
 		size_t mountedCards = 0;
@@ -1228,7 +1465,10 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				mountedCards |= (1 << i);
 			}
 		}
-		response->catf(",\"volumes\":%u,\"mountedVolumes\":%u", NumSdCards, mountedCards);
+		response->cat(",\"volumes\":");
+		response->catUInt(NumSdCards);
+		response->cat(",\"mountedVolumes\":");
+		response->catUInt(mountedCards);
 
 		// Machine name
 		response->cat(",\"name\":");
@@ -1239,13 +1479,17 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 			const ZProbe probeParams = platform->GetCurrentZProbeParameters();
 
 			// Trigger threshold
-			response->catf(",\"probe\":{\"threshold\":%" PRIi32, probeParams.adcValue);
+			response->cat(",\"probe\":{\"threshold\":");
+			response->catInt(probeParams.adcValue);
 
 			// Trigger height
-			response->catf(",\"height\":%.2f", (double)probeParams.triggerHeight);
+			response->cat(",\"height\":");
+			response->catFloat(probeParams.triggerHeight, 2);
 
 			// Type
-			response->catf(",\"type\":%u}", (unsigned int)platform->GetZProbeType());
+			response->cat(",\"type\":");
+			response->catUInt((unsigned int)platform->GetZProbeType());
+			response->cat('}');
 		}
 
 		/* Tool Mapping */
@@ -1255,7 +1499,8 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 			for (Tool *tool = toolList; tool != nullptr; tool = tool->Next())
 			{
 				// Number
-				response->catf("{\"number\":%d", tool->Number());
+				response->cat("{\"number\":");
+				response->catInt(tool->Number());
 
 				// Name
 				const char *toolName = tool->GetName();
@@ -1269,7 +1514,7 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				response->cat(",\"heaters\":[");
 				for (size_t heater = 0; heater < tool->HeaterCount(); heater++)
 				{
-					response->catf("%d", tool->Heater(heater));
+					response->catInt(tool->Heater(heater));
 					if (heater + 1 < tool->HeaterCount())
 					{
 						response->cat(",");
@@ -1280,7 +1525,7 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				response->cat("],\"drives\":[");
 				for (size_t drive = 0; drive < tool->DriveCount(); drive++)
 				{
-					response->catf("%d", tool->Drive(drive));
+					response->catInt(tool->Drive(drive));
 					if (drive + 1 < tool->DriveCount())
 					{
 						response->cat(",");
@@ -1302,7 +1547,7 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 						{
 							response->cat(",");
 						}
-						response->catf("%u", xi);
+						response->catUInt(xi);
 					}
 				}
 				response->cat("],[");
@@ -1319,19 +1564,20 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 						{
 							response->cat(",");
 						}
-						response->catf("%u", yi);
+						response->catUInt(yi);
 					}
 				}
 				response->cat("]]");
 
 				// Fan mapping
-				response->catf(",\"fans\":%lu", tool->GetFanMapping());
+				response->cat(",\"fans\":");
+				response->catUInt(tool->GetFanMapping());
 
 				// Filament (if any)
 				if (tool->GetFilament() != nullptr)
 				{
 					const char *filamentName = tool->GetFilament()->GetName();
-					response->catf(",\"filament\":");
+					response->cat(",\"filament\":");
 					response->EncodeString(filamentName, strlen(filamentName), false);
 				}
 
@@ -1339,7 +1585,11 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 				response->cat(",\"offsets\":[");
 				for (size_t i = 0; i < numVisibleAxes; i++)
 				{
-					response->catf((i == 0) ? "%.2f" : ",%.2f", (double)tool->GetOffset(i));
+					if (i != 0)
+					{
+						response->cat(',');
+					}
+					response->catFloat(tool->GetOffset(i), 2);
 				}
 
   				// Do we have any more tools?
@@ -1353,7 +1603,13 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		{
 			float minT, currT, maxT;
 			platform->GetMcuTemperatures(minT, currT, maxT);
-			response->catf(",\"mcutemp\":{\"min\":%.1f,\"cur\":%.1f,\"max\":%.1f}", (double)minT, (double)currT, (double)maxT);
+			response->cat(",\"mcutemp\":{\"min\":");
+			response->catFloat(minT, 1);
+			response->cat(",\"cur\":");
+			response->catFloat(currT, 1);
+			response->cat(",\"max\":");
+			response->catFloat(maxT, 1);
+			response->cat('}');
 		}
 #endif
 
@@ -1362,24 +1618,33 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		{
 			float minV, currV, maxV;
 			platform->GetPowerVoltages(minV, currV, maxV);
-			response->catf(",\"vin\":{\"min\":%.1f,\"cur\":%.1f,\"max\":%.1f}", (double)minV, (double)currV, (double)maxV);
+			response->cat(",\"vin\":{\"min\":");
+			response->catFloat(minV, 1);
+			response->cat(",\"cur\":");
+			response->catFloat(currV, 1);
+			response->cat(",\"max\":");
+			response->catFloat(maxV, 1);
+			response->cat('}');
 		}
 #endif
 	}
 	else if (type == 3)
 	{
 		// Current Layer
-		response->catf(",\"currentLayer\":%d", printMonitor->GetCurrentLayer());
+		response->cat(",\"currentLayer\":");
+		response->catInt(printMonitor->GetCurrentLayer());
 
 		// Current Layer Time
-		response->catf(",\"currentLayerTime\":%.1f", (double)(printMonitor->GetCurrentLayerTime()));
+		response->cat(",\"currentLayerTime\":");
+		response->catFloat(printMonitor->GetCurrentLayerTime(), 1);
 
 		// Raw Extruder Positions
 		response->cat(",\"extrRaw\":");
 		ch = '[';
 		for (size_t extruder = 0; extruder < GetExtrudersInUse(); extruder++)		// loop through extruders
 		{
-			response->catf("%c%.1f", ch, (double)(gCodes->GetRawExtruderTotalByDrive(extruder)));
+			response->cat(ch);
+			response->catFloat(gCodes->GetRawExtruderTotalByDrive(extruder), 1);
 			ch = ',';
 		}
 		if (ch == '[')
@@ -1388,34 +1653,48 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		}
 
 		// Fraction of file printed
-		response->catf("],\"fractionPrinted\":%.1f", (double)((printMonitor->IsPrinting()) ? (gCodes->FractionOfFilePrinted() * 100.0) : 0.0));
+		response->cat("],\"fractionPrinted\":");
+		response->catFloat((printMonitor->IsPrinting()) ? (gCodes->FractionOfFilePrinted() * 100.0) : 0.0, 1);
 
 		// Byte position of the file being printed
-		response->catf(",\"filePosition\":%lu", gCodes->GetFilePosition());
+		response->cat(",\"filePosition\":");
+		response->catUInt(gCodes->GetFilePosition());
 
 		// First Layer Duration
-		response->catf(",\"firstLayerDuration\":%.1f", (double)(printMonitor->GetFirstLayerDuration()));
+		response->cat(",\"firstLayerDuration\":");
+		response->catFloat(printMonitor->GetFirstLayerDuration(), 1);
 
 		// First Layer Height
 		// NB: This shouldn't be needed any more, but leave it here for the case that the file-based first-layer detection fails
-		response->catf(",\"firstLayerHeight\":%.2f", (double)(printMonitor->GetFirstLayerHeight()));
+		response->cat(",\"firstLayerHeight\":");
+		response->catFloat(printMonitor->GetFirstLayerHeight(), 2);
 
 		// Print Duration
-		response->catf(",\"printDuration\":%.1f", (double)(printMonitor->GetPrintDuration()));
+		response->cat(",\"printDuration\":");
+		response->catFloat(printMonitor->GetPrintDuration(), 1);
 
 		// Warm-Up Time
-		response->catf(",\"warmUpDuration\":%.1f", (double)(printMonitor->GetWarmUpDuration()));
+		response->cat(",\"warmUpDuration\":");
+		response->catFloat(printMonitor->GetWarmUpDuration(), 1);
 
 		/* Print Time Estimations */
 		{
 			// Based on file progress
-			response->catf(",\"timesLeft\":{\"file\":%.1f", (double)(printMonitor->EstimateTimeLeft(fileBased)));
+			response->cat(",\"timesLeft\":{\"file\":");
+			response->catFloat(printMonitor->EstimateTimeLeft(fileBased), 1);
 
 			// Based on filament usage
-			response->catf(",\"filament\":%.1f", (double)(printMonitor->EstimateTimeLeft(filamentBased)));
+			response->cat(",\"filament\":");
+			response->catFloat(printMonitor->EstimateTimeLeft(filamentBased), 1);
 
 			// Based on layers
-			response->catf(",\"layer\":%.1f}", (double)(printMonitor->EstimateTimeLeft(layerBased)));
+			response->cat(",\"layer\":");
+			response->catFloat(printMonitor->EstimateTimeLeft(layerBased), 1);
+
+			// Based on the simulated or sliced print time and the moves executed
+			response->cat(",\"simulation\":");
+			response->catFloat(printMonitor->EstimateTimeLeft(simulationBased), 1);
+			response->cat('}');
 		}
 	}
 
@@ -1425,7 +1704,9 @@ OutputBuffer *RepRap::GetStatusResponse(uint8_t type, ResponseSource source)
 		if (response != nullptr)
 		{
 			// Send the response to the last command. Do this last
-			response->catf(",\"seq\":%" PRIu32 ",\"resp\":", platform->GetAuxSeq());			// send the response sequence number
+			response->cat(",\"seq\":");			// send the response sequence number
+			response->catUInt(platform->GetAuxSeq());
+			response->cat(",\"resp\":");
 
 			// Send the JSON response
 			response->EncodeReply(reply, true);										// also releases the OutputBuffer chain
@@ -1542,6 +1823,76 @@ OutputBuffer *RepRap::GetConfigResponse()
 	return response;
 }
 
+// Get the CPU usage of each task, the step ISR and each module that the main task spins, as percentages since the last report.
+// This shares its measurement periods with the M122 report.
+OutputBuffer *RepRap::GetCpuUsageResponse()
+{
+	OutputBuffer *response;
+	if (!OutputBuffer::Allocate(response))
+	{
+		return nullptr;
+	}
+
+	Tasks::TaskCpuUsage usage[Tasks::MaxReportedTasks];
+	const size_t numTasks = Tasks::GetCpuUsage(usage);
+	response->copy("{\"tasks\":[");
+	for (size_t i = 0; i < numTasks; ++i)
+	{
+		if (i != 0)
+		{
+			response->cat(',');
+		}
+		response->cat("{\"name\":");
+		response->EncodeString(usage[i].name, strlen(usage[i].name), false);
+		response->cat(",\"cpu\":");
+		response->catFloat(usage[i].percent, 1);
+		response->cat('}');
+	}
+
+	response->cat("],\"stepIsr\":");
+	response->catFloat(move->GetStepIsrDutyCycle(), 2);
+
+	float spinPercentages[numModules + 1];
+	GetModuleSpinPercentages(spinPercentages);
+	response->cat(",\"spin\":{");
+	for (size_t i = 0; i <= numModules; ++i)
+	{
+		if (i != 0)
+		{
+			response->cat(',');
+		}
+		response->cat('"');
+		response->cat(moduleName[i]);
+		response->cat("\":");
+		response->catFloat(spinPercentages[i], 1);
+	}
+
+	// Individual spin times of each module that has spun: mean and maximum in milliseconds, and the number of spins over budget
+	response->cat("},\"spinTimes\":{");
+	bool first = true;
+	for (size_t i = 0; i < numModules; ++i)
+	{
+		const ModuleSpinStats& stats = moduleSpinStats[i];
+		if (stats.numSpins != 0)
+		{
+			if (!first)
+			{
+				response->cat(',');
+			}
+			first = false;
+			response->catf("\"%s\":{\"mean\":", moduleName[i]);
+			response->catFloat(StageTimer::CyclesToMicroseconds((uint32_t)(stats.totalCycles/stats.numSpins)) * 0.001, 3);
+			response->cat(",\"max\":");
+			response->catFloat(StageTimer::CyclesToMicroseconds(stats.maxCycles) * 0.001, 3);
+			response->catf(",\"over\":%" PRIu32 "}", stats.numOverBudget);
+		}
+	}
+	ResetModuleSpinStats();
+	response->cat("}}");
+
+	return response;
+}
+
 // Get the JSON status response for PanelDue or the old web server.
 // Type 0 was the old-style webserver status response, but is no longer supported.
 // Type 1 is the new-style webserver status response.
@@ -1568,40 +1919,50 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 	{
 		ch = 'S';
 	}
-	response->printf("{\"status\":\"%c\",\"heaters\":", ch);
+	response->cat("{\"status\":\"");
+	response->cat(ch);
+	response->cat("\",\"heaters\":");
 
 	// Send the heater actual temperatures. If there is no bed heater, send zero for PanelDue.
 	const int8_t bedHeater = (NumBedHeaters > 0) ? heat->GetBedHeater(0) : -1;
 	ch = ',';
-	response->catf("[%.1f", (double)((bedHeater == -1) ? 0.0 : heat->GetTemperature(bedHeater)));
+	response->cat('[');
+	response->catFloat((bedHeater == -1) ? 0.0 : heat->GetHeaterReport(bedHeater).current, 1);
 	for (size_t heater = DefaultE0Heater; heater < GetToolHeatersInUse(); heater++)
 	{
-		response->catf("%c%.1f", ch, (double)(heat->GetTemperature(heater)));
+		response->cat(ch);
+		response->catFloat(heat->GetHeaterReport(heater).current, 1);
 		ch = ',';
 	}
 	response->cat((ch == '[') ? "[]" : "]");
 
 	// Send the heater active temperatures
-	response->catf(",\"active\":[%.1f", (double)((bedHeater == -1) ? 0.0 : heat->GetActiveTemperature(bedHeater)));
+	response->cat(",\"active\":[");
+	response->catFloat((bedHeater == -1) ? 0.0 : heat->GetHeaterReport(bedHeater).active, 1);
 	for (size_t heater = DefaultE0Heater; heater < GetToolHeatersInUse(); heater++)
 	{
-		response->catf(",%.1f", (double)(heat->GetActiveTemperature(heater)));
+		response->cat(',');
+		response->catFloat(heat->GetHeaterReport(heater).active, 1);
 	}
 	response->cat("]");
 
 	// Send the heater standby temperatures
-	response->catf(",\"standby\":[%.1f", (double)((bedHeater == -1) ? 0.0 : heat->GetStandbyTemperature(bedHeater)));
+	response->cat(",\"standby\":[");
+	response->catFloat((bedHeater == -1) ? 0.0 : heat->GetHeaterReport(bedHeater).standby, 1);
 	for (size_t heater = DefaultE0Heater; heater < GetToolHeatersInUse(); heater++)
 	{
-		response->catf(",%.1f", (double)(heat->GetStandbyTemperature(heater)));
+		response->cat(',');
+		response->catFloat(heat->GetHeaterReport(heater).standby, 1);
 	}
 	response->cat("]");
 
 	// Send the heater statuses (0=off, 1=standby, 2=active, 3 = fault)
-	response->catf(",\"hstat\":[%d", (bedHeater == -1) ? 0 : static_cast<int>(heat->GetStatus(bedHeater)));
+	response->cat(",\"hstat\":[");
+	response->catInt((bedHeater == -1) ? 0 : static_cast<int>(heat->GetHeaterReport(bedHeater).status));
 	for (size_t heater = DefaultE0Heater; heater < GetToolHeatersInUse(); heater++)
 	{
-		response->catf(",%d", static_cast<int>(heat->GetStatus(heater)));
+		response->cat(',');
+		response->catInt(static_cast<int>(heat->GetHeaterReport(heater).status));
 	}
 	response->cat("]");
 
@@ -1609,43 +1970,50 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 	const size_t numVisibleAxes = gCodes->GetVisibleAxes();
 
 	// First the user coordinates
-	response->catf(",\"pos\":");			// announce the user position
+	response->cat(",\"pos\":");			// announce the user position
 	const float * const userPos = gCodes->GetUserPosition();
 	ch = '[';
 	for (size_t axis = 0; axis < numVisibleAxes; axis++)
 	{
 		// Coordinates may be NaNs, for example when delta or SCARA homing fails. Replace any NaNs or infinities by 9999.9 to prevent JSON parsing errors.
 		const float coord = userPos[axis];
-		response->catf("%c%.3f", ch, (double)((std::isnan(coord) || std::isinf(coord)) ? 9999.9 : coord));
+		response->cat(ch);
+		response->catFloat((std::isnan(coord) || std::isinf(coord)) ? 9999.9 : coord, 3);
 		ch = ',';
 	}
 
 	// Now the machine coordinates
 	float liveCoordinates[DRIVES];
 	move->LiveCoordinates(liveCoordinates, GetCurrentXAxes(), GetCurrentYAxes());
-	response->catf("],\"machine\":");		// announce the machine position
+	response->cat("],\"machine\":");		// announce the machine position
 	ch = '[';
 	for (size_t drive = 0; drive < numVisibleAxes; drive++)
 	{
-		response->catf("%c%.3f", ch, (double)liveCoordinates[drive]);
+		response->cat(ch);
+		response->catFloat(liveCoordinates[drive], 3);
 		ch = ',';
 	}
 
 	// Send the speed and extruder override factors
-	response->catf("],\"sfactor\":%.2f,\"efactor\":", (double)(gCodes->GetSpeedFactor() * 100.0));
+	response->cat("],\"sfactor\":");
+	response->catFloat(gCodes->GetSpeedFactor() * 100.0, 2);
+	response->cat(",\"efactor\":");
 	ch = '[';
 	for (size_t i = 0; i < GetExtrudersInUse(); ++i)
 	{
-		response->catf("%c%.2f", ch, (double)(gCodes->GetExtrusionFactor(i) * 100.0));
+		response->cat(ch);
+		response->catFloat(gCodes->GetExtrusionFactor(i) * 100.0, 2);
 		ch = ',';
 	}
 	response->cat((ch == '[') ? "[]" : "]");
 
 	// Send the baby stepping offset
-	response->catf(",\"babystep\":%.03f", (double)(gCodes->GetBabyStepOffset()));
+	response->cat(",\"babystep\":");
+	response->catFloat(gCodes->GetBabyStepOffset(), 3);
 
 	// Send the current tool number
-	response->catf(",\"tool\":%d", GetCurrentToolNumber());
+	response->cat(",\"tool\":");
+	response->catInt(GetCurrentToolNumber());
 
 	// Send the Z probe value
 	const int v0 = platform->GetZProbeReading();
@@ -1653,22 +2021,35 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 	switch (platform->GetZProbeSecondaryValues(v1, v2))
 	{
 	case 1:
-		response->catf(",\"probe\":\"%d (%d)\"", v0, v1);
+		response->cat(",\"probe\":\"");
+		response->catInt(v0);
+		response->cat(" (");
+		response->catInt(v1);
+		response->cat(")\"");
 		break;
 	case 2:
-		response->catf(",\"probe\":\"%d (%d, %d)\"", v0, v1, v2);
+		response->cat(",\"probe\":\"");
+		response->catInt(v0);
+		response->cat(" (");
+		response->catInt(v1);
+		response->cat(", ");
+		response->catInt(v2);
+		response->cat(")\"");
 		break;
 	default:
-		response->catf(",\"probe\":\"%d\"", v0);
+		response->cat(",\"probe\":\"");
+		response->catInt(v0);
+		response->cat('"');
 		break;
 	}
 
 	// Send the fan settings, for PanelDue firmware 1.13 and later
-	response->catf(",\"fanPercent\":");
+	response->cat(",\"fanPercent\":");
 	ch = '[';
 	for (size_t i = 0; i < NUM_FANS; ++i)
 	{
-		response->catf("%c%.1f", ch, (double)(platform->GetFanValue(i) * 100.0));
+		response->cat(ch);
+		response->catFloat(platform->GetFanValue(i) * 100.0, 1);
 		ch = ',';
 	}
 
@@ -1683,14 +2064,15 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 			char ch = '[';
 			for (size_t i = 0; i < NumTachos; ++i)
 			{
-				response->catf("%c%" PRIu32, ch, platform->GetFanRPM(i));
+				response->cat(ch);
+				response->catUInt(platform->GetFanRPM(i));
 				ch = ',';
 			}
 			response->cat(']');
 		}
 		else
 		{
-			response->catf("%" PRIu32, platform->GetFanRPM(0));
+			response->catUInt(platform->GetFanRPM(0));
 		}
 	}
 
@@ -1699,7 +2081,8 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 	ch = '[';
 	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
 	{
-		response->catf("%c%d", ch, (gCodes->GetAxisIsHomed(axis)) ? 1 : 0);
+		response->cat(ch);
+		response->catInt((gCodes->GetAxisIsHomed(axis)) ? 1 : 0);
 		ch = ',';
 	}
 	response->cat(']');
@@ -1707,7 +2090,8 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 	if (printMonitor->IsPrinting())
 	{
 		// Send the fraction printed
-		response->catf(",\"fraction_printed\":%.4f", (double)max<float>(0.0, gCodes->FractionOfFilePrinted()));
+		response->cat(",\"fraction_printed\":");
+		response->catFloat(max<float>(0.0, gCodes->FractionOfFilePrinted()), 4);
 	}
 
 	// Short messages are now pushed directly to PanelDue, so don't include them here as well
@@ -1726,8 +2110,14 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 
 		if (displayMessageBox)
 		{
-			response->catf(",\"msgBox.mode\":%d,\"msgBox.seq\":%" PRIu32 ",\"msgBox.timeout\":%.1f,\"msgBox.controls\":%" PRIu32 "",
-							boxMode, boxSeq, (double)timeLeft, boxControls);
+			response->cat(",\"msgBox.mode\":");
+			response->catInt(boxMode);
+			response->cat(",\"msgBox.seq\":");
+			response->catUInt(boxSeq);
+			response->cat(",\"msgBox.timeout\":");
+			response->catFloat(timeLeft, 1);
+			response->cat(",\"msgBox.controls\":");
+			response->catUInt(boxControls);
 			response->cat(",\"msgBox.msg\":");
 			response->EncodeString(boxMessage.c_str(), boxMessage.Capacity(), false);
 			response->cat(",\"msgBox.title\":");
@@ -1744,17 +2134,31 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 		if (printMonitor->IsPrinting())
 		{
 			// Send estimated times left based on file progress, filament usage, and layers
-			response->catf(",\"timesLeft\":[%.1f,%.1f,%.1f]",
-					(double)(printMonitor->EstimateTimeLeft(fileBased)),
-					(double)(printMonitor->EstimateTimeLeft(filamentBased)),
-					(double)(printMonitor->EstimateTimeLeft(layerBased)));
+			response->cat(",\"timesLeft\":[");
+			response->catFloat(printMonitor->EstimateTimeLeft(fileBased), 1);
+			response->cat(',');
+			response->catFloat(printMonitor->EstimateTimeLeft(filamentBased), 1);
+			response->cat(',');
+			response->catFloat(printMonitor->EstimateTimeLeft(layerBased), 1);
+			response->cat(']');
 		}
 	}
 	else if (type == 3)
 	{
 		// Add the static fields
-		response->catf(",\"geometry\":\"%s\",\"axes\":%u,\"totalAxes\":%u,\"axisNames\":\"%s\",\"volumes\":%u,\"numTools\":%u,\"myName\":",
-						move->GetGeometryString(), numVisibleAxes, gCodes->GetTotalAxes(), gCodes->GetAxisLetters(), NumSdCards, GetNumberOfContiguousTools());
+		response->cat(",\"geometry\":\"");
+		response->cat(move->GetGeometryString());
+		response->cat("\",\"axes\":");
+		response->catUInt(numVisibleAxes);
+		response->cat(",\"totalAxes\":");
+		response->catUInt(gCodes->GetTotalAxes());
+		response->cat(",\"axisNames\":\"");
+		response->cat(gCodes->GetAxisLetters());
+		response->cat("\",\"volumes\":");
+		response->catUInt(NumSdCards);
+		response->cat(",\"numTools\":");
+		response->catUInt(GetNumberOfContiguousTools());
+		response->cat(",\"myName\":");
 		response->EncodeString(myName.c_str(), myName.Capacity(), false);
 		response->cat(",\"firmwareName\":");
 		response->EncodeString(FIRMWARE_NAME, strlen(FIRMWARE_NAME), false);
@@ -1765,7 +2169,9 @@ OutputBuffer *RepRap::GetLegacyStatusResponse(uint8_t type, int seq)
 	{
 
 		// Send the response to the last command. Do this last because it can be long and may need to be truncated.
-		response->catf(",\"seq\":%d,\"resp\":", auxSeq);					// send the response sequence number
+		response->cat(",\"seq\":");					// send the response sequence number
+		response->catInt(auxSeq);
+		response->cat(",\"resp\":");
 
 		// Send the JSON response
 		response->EncodeReply(platform->GetAuxGCodeReply(), true);			// also releases the OutputBuffer chain
@@ -1804,8 +2210,18 @@ OutputBuffer *RepRap::GetFilesResponse(const char *dir, unsigned int startAt, bo
 	{
 		err = 0;
 		FileInfo fileInfo;
-		unsigned int filesFound = 0;
-		bool gotFile = platform->GetMassStorage()->FindFirst(dir, fileInfo);	// TODO error handling here
+		unsigned int filesFound;
+		bool gotFile;
+		if (startAt != 0 && platform->GetMassStorage()->ResumeListing(dir, startAt, fileInfo))
+		{
+			filesFound = startAt;									// carry on from where the previous page stopped
+			gotFile = true;
+		}
+		else
+		{
+			filesFound = 0;
+			gotFile = platform->GetMassStorage()->FindFirst(dir, fileInfo);	// TODO error handling here
+		}
 
 		size_t bytesLeft = OutputBuffer::GetBytesLeft(response);	// don't write more bytes than we can
 
@@ -1818,8 +2234,8 @@ OutputBuffer *RepRap::GetFilesResponse(const char *dir, unsigned int startAt, bo
 					// Make sure we can end this response properly
 					if (bytesLeft < strlen(fileInfo.fileName) * 2 + 20)
 					{
-						// No more space available - stop here
-						platform->GetMassStorage()->AbandonFindNext();
+						// No more space available - stop here, and save our position so that the next page doesn't have to read the directory from the start
+						platform->GetMassStorage()->SaveListingPosition(filesFound);
 						nextFile = filesFound;
 						break;
 					}
@@ -1877,8 +2293,18 @@ OutputBuffer *RepRap::GetFilelistResponse(const char *dir, unsigned int startAt)
 	{
 		err = 0;
 		FileInfo fileInfo;
-		unsigned int filesFound = 0;
-		bool gotFile = platform->GetMassStorage()->FindFirst(dir, fileInfo);
+		unsigned int filesFound;
+		bool gotFile;
+		if (startAt != 0 && platform->GetMassStorage()->ResumeListing(dir, startAt, fileInfo))
+		{
+			filesFound = startAt;									// carry on from where the previous page stopped
+			gotFile = true;
+		}
+		else
+		{
+			filesFound = 0;
+			gotFile = platform->GetMassStorage()->FindFirst(dir, fileInfo);
+		}
 		size_t bytesLeft = OutputBuffer::GetBytesLeft(response);	// don't write more bytes than we can
 
 		while (gotFile)
@@ -1890,8 +2316,8 @@ OutputBuffer *RepRap::GetFilelistResponse(const char *dir, unsigned int startAt)
 					// Make sure we can end this response properly
 					if (bytesLeft < strlen(fileInfo.fileName) * 2 + 50)
 					{
-						// No more space available - stop here
-						platform->GetMassStorage()->AbandonFindNext();
+						// No more space available - stop here, and save our position so that the next page doesn't have to read the directory from the start
+						platform->GetMassStorage()->SaveListingPosition(filesFound);
 						nextFile = filesFound;
 						break;
 					}
@@ -1939,6 +2365,58 @@ OutputBuffer *RepRap::GetFilelistResponse(const char *dir, unsigned int startAt)
 	return response;
 }
 
+#if SUPPORT_RECENT_FILES
+
+// Get a JSON-style list of the most recently modified files in the G-code files directory, newest first
+OutputBuffer *RepRap::GetRecentFilesResponse(unsigned int maxFiles)
+{
+	OutputBuffer *response;
+	if (!OutputBuffer::Allocate(response))
+	{
+		return nullptr;
+	}
+
+	const char * const dir = platform->GetGCodeDir();
+	response->copy("{\"dir\":");
+	response->EncodeString(dir, strlen(dir), false);
+	response->cat(",\"files\":[");
+
+	if (!platform->GetMassStorage()->CheckDriveMounted(dir))
+	{
+		response->cat("],\"err\":1}");
+		return response;
+	}
+
+	FileInfo fileInfo;
+	for (unsigned int i = 0; i < maxFiles && platform->GetMassStorage()->GetRecentFile(i, fileInfo); ++i)
+	{
+		if (i != 0)
+		{
+			response->cat(',');
+		}
+		response->cat("{\"name\":");
+		response->EncodeString(fileInfo.fileName, MaxFilenameLength, false);
+		response->catf(",\"size\":%" PRIu32, fileInfo.size);
+
+		const struct tm * const timeInfo = gmtime(&fileInfo.lastModified);
+		if (timeInfo->tm_year <= /*19*/80)
+		{
+			// Don't send the last modified date if it is invalid
+			response->cat('}');
+		}
+		else
+		{
+			response->catf(",\"date\":\"%04u-%02u-%02uT%02u:%02u:%02u\"}",
+					timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday,
+					timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
+		}
+	}
+	response->cat("]}");
+	return response;
+}
+
+#endif
+
 // Get information for the specified file, or the currently printing file, in JSON format
 bool RepRap::GetFileInfoResponse(const char *filename, OutputBuffer *&response, bool quitEarly)
 {
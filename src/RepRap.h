@@ -24,6 +24,7 @@ Licence: GPL
 #include "RepRapFirmware.h"
 #include "MessageType.h"
 #include "RTOSIface.h"
+#include "GCodes/GCodeResult.h"
 
 enum class ResponseSource
 {
@@ -93,6 +94,7 @@ public:
 
 	void Tick();
 	bool SpinTimeoutImminent() const;
+	GCodeResult ConfigureSpinBudget(GCodeBuffer& gb, const StringRef& reply);	// process M932
 	bool IsStopped() const;
 
 	uint16_t GetExtrudersInUse() const;
@@ -100,9 +102,13 @@ public:
 
 	OutputBuffer *GetStatusResponse(uint8_t type, ResponseSource source);
 	OutputBuffer *GetConfigResponse();
+	OutputBuffer *GetCpuUsageResponse();
 	OutputBuffer *GetLegacyStatusResponse(uint8_t type, int seq);
 	OutputBuffer *GetFilesResponse(const char* dir, unsigned int startAt, bool flagsDirs);
 	OutputBuffer *GetFilelistResponse(const char* dir, unsigned int startAt);
+#if SUPPORT_RECENT_FILES
+	OutputBuffer *GetRecentFilesResponse(unsigned int maxFiles);
+#endif
 	bool GetFileInfoResponse(const char *filename, OutputBuffer *&response, bool quitEarly);
 
 	void Beep(unsigned int freq, unsigned int ms);
@@ -125,9 +131,22 @@ private:
 	static void EncodeString(StringRef& response, const char* src, size_t spaceToLeave, bool allowControlChars = false, char prefix = 0);
 
 	char GetStatusCharacter() const;
+	void SetSpinningModule(Module m);
+	void GetModuleSpinPercentages(float percentages[numModules + 1]);
+	void ResetModuleSpinStats();
 
 	static constexpr uint32_t MaxTicksInSpinState = 20000;	// timeout before we reset the processor
 	static constexpr uint32_t HighTicksInSpinState = 16000;	// how long before we warn that timeout is approaching
+	static constexpr uint32_t DefaultSpinBudgetMicroseconds = 10000;	// default time that a module may spin for before we count it as slow
+
+	// Statistics for the individual spins of a module since the last report
+	struct ModuleSpinStats
+	{
+		uint64_t totalCycles;
+		uint32_t numSpins;
+		uint32_t maxCycles;
+		uint32_t numOverBudget;
+	};
 
 	Platform* platform;
 	Network* network;
@@ -160,6 +179,10 @@ private:
 #endif
 	Module spinningModule;
 	uint32_t fastLoop, slowLoop;
+	uint32_t lastModuleSwitchCycles;			// the CPU cycle count when spinningModule last changed
+	uint64_t moduleSpinCycles[numModules + 1];	// CPU cycles spent spinning each module since the last report, with the time outside them in the last element
+	ModuleSpinStats moduleSpinStats[numModules];
+	uint32_t spinBudgetCycles;					// a module that spins for longer than this is counted as over budget
 
 	uint32_t debug;
 	bool stopped;
@@ -84,6 +84,7 @@ class OutputBuffer;
 class OutputStack;
 class GCodeBuffer;
 class GCodeQueue;
+class ToolPreheater;
 class FilamentMonitor;
 class RandomProbePointSet;
 class Logger;
@@ -96,6 +97,10 @@ class PortControl;
 class Display;
 #endif
 
+#if SUPPORT_LASER_RASTER
+class LaserRaster;
+#endif
+
 // Define floating point type to use for calculations where we would like high precision in matrix calculations
 #if SAM4E || SAM4S || SAME70
 typedef double floatc_t;					// type of matrix element used for calibration
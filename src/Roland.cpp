@@ -19,7 +19,7 @@ void Roland::Init()
 	sBuffer = new StringRef(buffer, ARRAY_SIZE(buffer));
 	sBuffer->Clear();
 
-	bufferPointer = 0;
+	queueHead = queueTail = 0;
 	Zero(true);
 	longWait = platform.Time();
 	active = false;
@@ -39,37 +39,19 @@ void Roland::Spin()
 	//SERIAL_AUX2_DEVICE.flush();
 	//return;
 
-	// Are we sending something to the Roland?
+	// Send as much as the Roland and the UART transmit buffer will take. The UART interrupt sends it, so we never wait here.
 
-	if (Busy())	// Busy means we are sending something
+	SendQueued();
+
+	// Translate moves while there is room in the queue, so that the Roland always has the next move waiting
+
+	EndstopChecks endStopsToCheck;
+	uint8_t moveType;
+	FilePosition filePos;
+	while (!Busy() && reprap.GetGCodes()->ReadMove(move, endStopsToCheck, moveType, filePos))
 	{
-		if (digitalRead(ROLAND_CTS_PIN))
-		{
-			platform.ClassReport(longWait);
-			return;
-		}
-
-		SERIAL_AUX2_DEVICE.write(buffer[bufferPointer]);
-		SERIAL_AUX2_DEVICE.flush();
-		bufferPointer++;
-	}
-	else		// Not sending.
-	{	
-		// Finished talking to the Roland
-
-		sBuffer->Clear();
-		bufferPointer = 0;
-
-		// Anything new to do?
-
-		EndstopChecks endStopsToCheck;
-		uint8_t moveType;
-		FilePosition filePos;
-		if (reprap.GetGCodes()->ReadMove(move, endStopsToCheck, moveType, filePos))
-		{
-			move[AXES] = move[DRIVES]; // Roland doesn't have extruders etc.
-			ProcessMove();
-		}
+		move[AXES] = move[DRIVES]; // Roland doesn't have extruders etc.
+		ProcessMove();
 	}
 
 	platform.ClassReport(longWait);
@@ -92,9 +74,36 @@ void Roland::Zero(bool feed)
 	}
 }
 
+// Busy means there isn't room in the queue for another command
 bool Roland::Busy()
 {
-	return buffer[bufferPointer] != 0;
+	return QueueSpace() < ROLAND_BUFFER_SIZE;
+}
+
+size_t Roland::QueueSpace() const
+{
+	return (queueHead + ROLAND_QUEUE_SIZE - queueTail - 1) % ROLAND_QUEUE_SIZE;
+}
+
+// Add the translated command in 'buffer' to the queue. The caller has checked that there is room.
+void Roland::Enqueue()
+{
+	for (const char *p = buffer; *p != 0; ++p)
+	{
+		queue[queueTail] = *p;
+		queueTail = (queueTail + 1) % ROLAND_QUEUE_SIZE;
+	}
+	sBuffer->Clear();
+}
+
+// Pass queued bytes to the UART while the Roland is ready to accept them
+void Roland::SendQueued()
+{
+	while (queueHead != queueTail && !digitalRead(ROLAND_CTS_PIN) && SERIAL_AUX2_DEVICE.canWrite() != 0)
+	{
+		SERIAL_AUX2_DEVICE.write(queue[queueHead]);
+		queueHead = (queueHead + 1) % ROLAND_QUEUE_SIZE;
+	}
 }
 
 bool Roland::ProcessHome()
@@ -110,6 +119,7 @@ bool Roland::ProcessHome()
 	{
 		platform.MessageF(HOST_MESSAGE, "Roland home: %s", buffer);
 	}
+	Enqueue();
 	return true;
 }
 
@@ -127,6 +137,7 @@ bool Roland::ProcessDwell(long milliseconds)
 	{
 		platform.MessageF(HOST_MESSAGE, "Roland dwell: %s", buffer);
 	}
+	Enqueue();
 	return true;
 }
 
@@ -168,6 +179,7 @@ bool Roland::ProcessSpindle(float rpm)
 	{
 		platform.MessageF(HOST_MESSAGE, "Roland spindle: %s", buffer);
 	}
+	Enqueue();
 	return true;
 
 }
@@ -212,6 +224,7 @@ void Roland::ProcessMove()
 	{
 		platform.MessageF(HOST_MESSAGE, "Roland move: %s", buffer);
 	}
+	Enqueue();
 }
 
 
@@ -229,6 +242,7 @@ bool Roland::RawWrite(const char* s)
 	{
 		platform.MessageF(HOST_MESSAGE, "Roland rawwrite: %s", buffer);
 	}
+	Enqueue();
 	return true;
 }
 
@@ -250,7 +264,7 @@ void Roland::Activate()
 
 bool Roland::Deactivate()
 {
-	if (Busy())
+	if (queueHead != queueTail)
 	{
 		return false;
 	}
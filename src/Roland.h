@@ -31,7 +31,8 @@ Licence: GPL
 #include "Platform.h"
 
 const float ROLAND_FACTOR = (1.016088061*100.0/2.54);	// Roland units are 0.001"
-const size_t ROLAND_BUFFER_SIZE = 50;
+const size_t ROLAND_BUFFER_SIZE = 50;					// Room for one translated command
+const size_t ROLAND_QUEUE_SIZE = 512;					// Commands waiting to be sent, so that we can translate several moves ahead
 
 class Roland
 {
@@ -53,6 +54,9 @@ class Roland
 		void ProcessMove();
 		void Zero(bool feed);
 		bool Busy();
+		void Enqueue();
+		size_t QueueSpace() const;
+		void SendQueued();
 
 		Platform& platform;
 		float longWait;
@@ -62,8 +66,9 @@ class Roland
 		float oldCoordinates[AXES+1];
 		float offset[AXES+1];
 		char buffer[ROLAND_BUFFER_SIZE];
-		int bufferPointer;
 		StringRef *sBuffer;
+		char queue[ROLAND_QUEUE_SIZE];
+		size_t queueHead, queueTail;							// next byte to send, next free byte
 		bool active;
 };
 
@@ -68,6 +68,9 @@
 /** Network link speed. */
 #define NET_LINK_SPEED        100000000
 
+/** How many times we check for a free TX descriptor before giving up on a frame. */
+#define GMAC_TX_WAIT_LOOPS    1000000
+
 #if (NO_SYS == 0)
 /* Interrupt priorities. (lowest value = highest priority) */
 /* ISRs using FreeRTOS *FromISR APIs must have priorities below or equal to */
@@ -227,6 +230,11 @@ static void gmac_rx_populate_queue(struct gmac_device *p_gmac_dev)
 			LWIP_ASSERT("gmac_rx_populate_queue: unaligned p->payload buffer address",
 					(((uint32_t)p->payload & 0xFFFFFFFC) == (uint32_t)p->payload));
 
+#if __DCACHE_PRESENT
+			/* Write back and discard any cached data in the buffer, so that no dirty line can overwrite what the GMAC writes. */
+			SCB_CleanInvalidateDCache_by_Addr((uint32_t*)p->payload, GMAC_FRAME_LENTGH_MAX);
+#endif
+
 			if (ul_index == GMAC_RX_BUFFERS - 1)
 				p_gmac_dev->rx_desc[ul_index].addr.val = (u32_t) p->payload | GMAC_RXD_WRAP;
 			else
@@ -398,6 +406,19 @@ static err_t gmac_low_level_output(struct netif *netif, struct pbuf *p)
 		gmac_enable_transmit(GMAC, true);
 	}
 
+	/* With large TCP send buffers lwIP can queue frames faster than the GMAC sends them, */
+	/* so wait until the GMAC has finished with the descriptor before reusing its buffer. */
+	/* If it doesn't finish, drop the frame and let TCP retransmit it. */
+	{
+		uint32_t ul_timeout = GMAC_TX_WAIT_LOOPS;
+		while ((ps_gmac_dev->tx_desc[ps_gmac_dev->us_tx_idx].status.val & GMAC_TXD_USED) == 0) {
+			if (--ul_timeout == 0) {
+				LINK_STATS_INC(link.drop);
+				return ERR_IF;
+			}
+		}
+	}
+
 	buffer = (uint8_t*)ps_gmac_dev->tx_desc[ps_gmac_dev->us_tx_idx].addr;
 
 	/* Copy pbuf chain into TX buffer. */
@@ -406,6 +427,11 @@ static err_t gmac_low_level_output(struct netif *netif, struct pbuf *p)
 		buffer += q->len;
 	}
 
+#if __DCACHE_PRESENT
+	/* Write the frame back to RAM before the GMAC reads it, in case the data cache is enabled. */
+	SCB_CleanDCache_by_Addr((uint32_t*)ps_gmac_dev->tx_desc[ps_gmac_dev->us_tx_idx].addr, p->tot_len);
+#endif
+
 	/* Set len and mark the buffer to be sent by GMAC. */
 	ps_gmac_dev->tx_desc[ps_gmac_dev->us_tx_idx].status.bm.b_len = p->tot_len;
 	ps_gmac_dev->tx_desc[ps_gmac_dev->us_tx_idx].status.bm.b_used = 0;
@@ -475,6 +501,13 @@ static struct pbuf *gmac_low_level_input(struct netif *netif)
 
 		/* Fetch pre-allocated pbuf. */
 		p = ps_gmac_dev->rx_pbuf[ps_gmac_dev->us_rx_idx];
+
+#if __DCACHE_PRESENT
+		/* Discard any cached copy of the buffer, so that we read the frame that the GMAC wrote. */
+		/* Do this before we write to the pbuf header, which may share a cache line with the start of the payload. */
+		SCB_InvalidateDCache_by_Addr((uint32_t*)p->payload, length);
+#endif
+
 		p->len = length;
 
 		/* Remove this pbuf from its desriptor. */
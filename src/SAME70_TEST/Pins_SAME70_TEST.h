@@ -24,8 +24,14 @@ const size_t NumFirmwareUpdateModules = 4;		// 3 modules, plus one for manual up
 #define SUPPORT_IOBITS		1					// set to support P parameter in G0/G1 commands
 #define SUPPORT_DHT_SENSOR	0					// set nonzero to support DHT temperature/humidity sensors
 #define SUPPORT_WORKPLACE_COORDINATES	1		// set nonzero to support G10 L2 and G53..59
+#define SUPPORT_INPUT_SHAPING	1				// set nonzero to support input shaping (needs an FPU)
+#define SUPPORT_STEP_TABLES	1					// set nonzero to precompute step times outside the step ISR
+#define SUPPORT_STEP_TRACE	1					// set nonzero to support tracing step interrupt latency (M597)
+#define SUPPORT_MOVE_TRACE	1					// set nonzero to support recording a timeline of executed moves (M931)
+#define SUPPORT_MOVE_MERGING	1				// set nonzero to support merging runs of short collinear moves (M933)
 
 #define USE_CACHE			0					// Cache controller has some problems on the SAME70
+#define USE_TCM				0					// set nonzero to run the step ISR from ITCM with its data in DTCM (needs .itcm and .dtcm linker sections)
 
 // The physical capabilities of the machine
 
@@ -172,76 +172,54 @@ void Scanner::Spin()
 
 		case ScannerState::Uploading:
 		{
-			// Write incoming scan data from USB to the file
-			int bytesToRead = SERIAL_MAIN_DEVICE.available();
-			FileWriteBuffer *buf = fileBeingUploaded->GetWriteBuffer();
-			if (buf != nullptr)
+			// Copy incoming scan data from the USB RX buffer and write it to the file in whole blocks.
+			// If the file has a write buffer then we collect the data in that, otherwise we use our own block.
+			size_t bytesToRead = min<size_t>((size_t)SERIAL_MAIN_DEVICE.available(), uploadBytesLeft);
+			FileWriteBuffer * const buf = fileBeingUploaded->GetWriteBuffer();
+			char * const block = (buf != nullptr) ? buf->Data() : reinterpret_cast<char *>(uploadBlock);
+			const size_t blockSize = (buf != nullptr) ? FileWriteBufLen : ScanUploadBlockSize;
+			const size_t bytesInBlock = (buf != nullptr) ? buf->BytesStored() : uploadBlockBytes;
+
+			bytesToRead = SERIAL_MAIN_DEVICE.readBytes(block + bytesInBlock, min<size_t>(bytesToRead, blockSize - bytesInBlock));
+			if (uploadHasCrc)
 			{
-				// Copy whole blocks from the USB RX buffer
-				if (bytesToRead > (int)buf->BytesLeft())
-				{
-					bytesToRead = buf->BytesLeft();
-				}
-
-				SERIAL_MAIN_DEVICE.readBytes(buf->Data() + buf->BytesStored(), bytesToRead);
-				buf->DataStored(bytesToRead);
-				uploadBytesLeft -= bytesToRead;
+				uploadCrc.Update(block + bytesInBlock, bytesToRead);
+			}
+			uploadBytesLeft -= bytesToRead;
 
+			if (bytesInBlock + bytesToRead == blockSize || uploadBytesLeft == 0)
+			{
 				// Note we call FileStore::Write here instead of FileStore::Flush because we
 				// do not want to update the FS table every time an upload buffer is written
-				if ((buf->BytesLeft() == 0 || uploadBytesLeft == 0) && !fileBeingUploaded->Write(buf->Data(), 0))
+				bool ok;
+				if (buf != nullptr)
 				{
-					fileBeingUploaded->Close();
-					fileBeingUploaded = nullptr;
-					platform.GetMassStorage()->Delete(SCANS_DIRECTORY, uploadFilename);
+					buf->DataStored(bytesToRead);
+					ok = fileBeingUploaded->Write(buf->Data(), 0);
+				}
+				else
+				{
+					ok = fileBeingUploaded->Write(block, bytesInBlock + bytesToRead);
+					uploadBlockBytes = 0;
+				}
 
+				if (!ok)
+				{
 					platform.Message(ErrorMessage, "Failed to write scan file\n");
-					SetState(ScannerState::Idle);
-					break;
+					EndUpload(false);
 				}
-			}
-			else
-			{
-				// Write data character by character if there is no file write buffer available
-				while (bytesToRead > 0)
+				else if (uploadBytesLeft == 0)
 				{
-					char b = static_cast<char>(SERIAL_MAIN_DEVICE.read());
-					bytesToRead--;
-
-					if (fileBeingUploaded->Write(&b, sizeof(char)))
-					{
-						uploadBytesLeft--;
-						if (uploadBytesLeft == 0)
-						{
-							// Upload complete
-							break;
-						}
-					}
-					else
-					{
-						fileBeingUploaded->Close();
-						fileBeingUploaded = nullptr;
-						platform.GetMassStorage()->Delete(SCANS_DIRECTORY, uploadFilename);
-
-						platform.Message(ErrorMessage, "Failed to write scan file\n");
-						SetState(ScannerState::Idle);
-						break;
-					}
+					EndUpload(true);
 				}
 			}
-
-			// Have we finished this upload?
-			if (fileBeingUploaded != nullptr && uploadBytesLeft == 0)
+			else if (buf != nullptr)
 			{
-				if (reprap.Debug(moduleScanner))
-				{
-					platform.MessageF(HttpMessage, "Finished uploading %u bytes of scan data\n", uploadSize);
-				}
-
-				fileBeingUploaded->Close();
-				fileBeingUploaded = nullptr;
-
-				SetState(ScannerState::Idle);
+				buf->DataStored(bytesToRead);
+			}
+			else
+			{
+				uploadBlockBytes += bytesToRead;
 			}
 			break;
 		}
@@ -311,34 +289,14 @@ void Scanner::ProcessCommand()
 	// Upload request: UPLOAD <SIZE> <FILENAME>
 	else if (StringStartsWith(buffer, "UPLOAD "))
 	{
-		uploadSize = atoi(&buffer[7]);
-		uploadFilename = nullptr;
-		for(size_t i = 8; i < bufferPointer - 1; i++)
-		{
-			if (buffer[i] == ' ')
-			{
-				uploadFilename = &buffer[i+1];
-				break;
-			}
-		}
+		StartUpload(&buffer[7], false);
+	}
 
-		if (uploadFilename != nullptr)
-		{
-			uploadBytesLeft = uploadSize;
-			fileBeingUploaded = platform.OpenFile(SCANS_DIRECTORY, uploadFilename, OpenMode::write);
-			if (fileBeingUploaded != nullptr)
-			{
-				SetState(ScannerState::Uploading);
-				if (reprap.Debug(moduleScanner))
-				{
-					platform.MessageF(HttpMessage, "Starting scan upload for file %s (%u bytes total)\n", uploadFilename, uploadSize);
-				}
-			}
-		}
-		else
-		{
-			platform.Message(ErrorMessage, "Malformed scanner upload request\n");
-		}
+	// Upload request with a CRC check: UPLOADCRC <SIZE> <CRC32 IN HEX> <FILENAME>
+	// We reply with OK when the file has been written and its CRC matches, otherwise with ERROR
+	else if (StringStartsWith(buffer, "UPLOADCRC "))
+	{
+		StartUpload(&buffer[10], true);
 	}
 
 	// Acknowledgment: OK
@@ -542,6 +500,82 @@ const char Scanner::GetStatusCharacter() const
 	return 'I';
 }
 
+// Start an upload, given the arguments of the upload request
+void Scanner::StartUpload(const char *args, bool withCrc)
+{
+	const char *p = args;
+	uploadSize = SafeStrtoul(p, &p);
+	uploadHasCrc = withCrc;
+	if (withCrc)
+	{
+		while (*p == ' ')
+		{
+			++p;
+		}
+		uploadExpectedCrc = SafeStrtoul(p, &p, 16);
+	}
+	uploadFilename = (*p == ' ' && p[1] != 0) ? p + 1 : nullptr;
+
+	if (uploadFilename != nullptr)
+	{
+		uploadBytesLeft = uploadSize;
+		uploadBlockBytes = 0;
+		uploadCrc.Reset();
+		fileBeingUploaded = platform.OpenFile(SCANS_DIRECTORY, uploadFilename, OpenMode::write);
+		if (fileBeingUploaded != nullptr)
+		{
+			SetState(ScannerState::Uploading);
+			if (reprap.Debug(moduleScanner))
+			{
+				platform.MessageF(HttpMessage, "Starting scan upload for file %s (%u bytes total)\n", uploadFilename, uploadSize);
+			}
+		}
+		else if (withCrc)
+		{
+			platform.Message(MessageType::BlockingUsbMessage, "ERROR\n");
+		}
+	}
+	else
+	{
+		platform.Message(ErrorMessage, "Malformed scanner upload request\n");
+		if (withCrc)
+		{
+			platform.Message(MessageType::BlockingUsbMessage, "ERROR\n");
+		}
+	}
+}
+
+// Finish an upload, deleting the file if it failed or its CRC doesn't match
+void Scanner::EndUpload(bool ok)
+{
+	fileBeingUploaded->Close();
+	fileBeingUploaded = nullptr;
+
+	if (ok && uploadHasCrc && uploadCrc.Get() != uploadExpectedCrc)
+	{
+		platform.MessageF(ErrorMessage, "CRC mismatch in scan file, expected %08" PRIx32 " got %08" PRIx32 "\n", uploadExpectedCrc, uploadCrc.Get());
+		ok = false;
+	}
+
+	if (ok)
+	{
+		if (reprap.Debug(moduleScanner))
+		{
+			platform.MessageF(HttpMessage, "Finished uploading %u bytes of scan data\n", uploadSize);
+		}
+	}
+	else
+	{
+		platform.GetMassStorage()->Delete(SCANS_DIRECTORY, uploadFilename);
+	}
+
+	if (uploadHasCrc)
+	{
+		platform.Message(MessageType::BlockingUsbMessage, (ok) ? "OK\n" : "ERROR\n");
+	}
+	SetState(ScannerState::Idle);
+}
+
 // Return the progress of the current operation
 float Scanner::GetProgress() const
 {
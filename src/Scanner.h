@@ -10,6 +10,7 @@
 
 #include "RepRapFirmware.h"
 #include "GCodes/GCodeBuffer.h"
+#include "Storage/CRC32.h"
 
 #if SUPPORT_SCANNER
 
@@ -17,6 +18,7 @@
 //#define SCANNER_AS_SEPARATE_TASK	(defined(RTOS))		// set to 1 to use a separate task for the scanner (requires RTOS enabled too)
 
 const size_t ScanBufferSize = 128;						// Size of the buffer for incoming commands
+const size_t ScanUploadBlockSize = 512;					// Size of the block we use for uploads when no file write buffer is available
 
 enum class ScannerState
 {
@@ -75,6 +77,8 @@ private:
 
 	void SetState(const ScannerState s);
 	void ProcessCommand();
+	void StartUpload(const char *args, bool withCrc);
+	void EndUpload(bool ok);
 
 	bool IsDoingFileMacro() const;
 	void DoFileMacro(const char *filename);
@@ -98,6 +102,11 @@ private:
 	const char *uploadFilename;
 	size_t uploadSize, uploadBytesLeft;
 	FileStore *fileBeingUploaded;
+	bool uploadHasCrc;									// true if the scanner sent the CRC of the file and wants to be told whether the upload succeeded
+	uint32_t uploadExpectedCrc;
+	CRC32 uploadCrc;
+	size_t uploadBlockBytes;							// how many bytes are in uploadBlock
+	uint32_t uploadBlock[ScanUploadBlockSize/sizeof(uint32_t)];	// 32-bit aligned for better HSMCI performance
 };
 
 inline bool Scanner::IsRegistered() const { return (state != ScannerState::Disconnected); }
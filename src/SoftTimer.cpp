@@ -10,19 +10,46 @@
 
 SoftTimer * volatile SoftTimer::pendingList = nullptr;
 
-SoftTimer::SoftTimer() : next(nullptr), callback(nullptr)
+SoftTimer::SoftTimer() : next(nullptr), pprev(nullptr), callback(nullptr)
 {
 }
 
+// Link this timer into the pending list in front of the one that *ppst points to. Interrupts must be disabled.
+void SoftTimer::Insert(SoftTimer** ppst)
+{
+	next = *ppst;
+	if (next != nullptr)
+	{
+		next->pprev = &next;
+	}
+	*ppst = this;
+	pprev = ppst;
+}
+
+// Remove this timer from the pending list in constant time. Harmless if it is not in the list. Interrupts must be disabled.
+void SoftTimer::Unlink()
+{
+	if (pprev != nullptr)
+	{
+		*pprev = next;
+		if (next != nullptr)
+		{
+			next->pprev = pprev;
+		}
+		pprev = nullptr;
+	}
+}
+
 // Schedule a callback at a particular tick count, returning true if it was not scheduled because it is already due or imminent.
-// There must be no callback already scheduled for this timer, else the linked list will get messed up. If in doubt, call CancelCallback before calling this.
+// Any callback already scheduled for this timer is cancelled first.
 bool SoftTimer::ScheduleCallback(Ticks when, Callback cb, void *param)
 {
+	const irqflags_t flags = cpu_irq_save();
+	Unlink();
 	whenDue = when;
 	callback = cb;
 	cbParam = param;
 
-	const irqflags_t flags = cpu_irq_save();
 	const Ticks now = GetTimerTicksNow();
 	const int32_t howSoon = (int32_t)(when - now);
 	SoftTimer** ppst = const_cast<SoftTimer**>(&pendingList);
@@ -43,8 +70,7 @@ bool SoftTimer::ScheduleCallback(Ticks when, Callback cb, void *param)
 		}
 	}
 
-	next = *ppst;
-	*ppst = this;
+	Insert(ppst);
 	cpu_irq_restore(flags);
 	return false;
 }
@@ -53,14 +79,7 @@ bool SoftTimer::ScheduleCallback(Ticks when, Callback cb, void *param)
 void SoftTimer::CancelCallback()
 {
 	const irqflags_t flags = cpu_irq_save();
-	for (SoftTimer** ppst = const_cast<SoftTimer**>(&pendingList); *ppst != nullptr; ppst = &((*ppst)->next))
-	{
-		if (*ppst == this)
-		{
-			*ppst = this->next;		// unlink this from the pending list
-			break;
-		}
-	}
+	Unlink();
 	cpu_irq_restore(flags);
 }
 
@@ -92,17 +111,19 @@ void SoftTimer::CancelCallback()
 		// On subsequent iterations this just sets up the interrupt for the next timer that is due to expire.
 		if (Platform::ScheduleSoftTimerInterrupt(tmr->whenDue))
 		{
-			pendingList = tmr->next;														// remove it from the pending list
+			tmr->Unlink();																	// remove it from the pending list
 			if (tmr->callback != nullptr && tmr->callback(tmr->cbParam, tmr->whenDue))		// execute its callback
 			{
-				// Schedule another callback for this timer
-				SoftTimer** ppst = const_cast<SoftTimer**>(&pendingList);
-				while (*ppst != nullptr && (int32_t)(tmr->whenDue - (*ppst)->whenDue) > 0)
+				// Schedule another callback for this timer, unless the callback has already rescheduled it
+				if (!tmr->IsScheduled())
 				{
-					ppst = &((*ppst)->next);
+					SoftTimer** ppst = const_cast<SoftTimer**>(&pendingList);
+					while (*ppst != nullptr && (int32_t)(tmr->whenDue - (*ppst)->whenDue) > 0)
+					{
+						ppst = &((*ppst)->next);
+					}
+					tmr->Insert(ppst);
 				}
-				tmr->next = *ppst;
-				*ppst = tmr;
 			}
 		}
 		else
@@ -26,6 +26,9 @@ public:
 	// Cancel any scheduled callbacks
 	void CancelCallback();
 
+	// Return true if a callback is scheduled
+	bool IsScheduled() const { return pprev != nullptr; }
+
 	// Get the current tick count
 	static Ticks GetTimerTicksNow();
 
@@ -36,7 +39,11 @@ public:
 	static void Interrupt();
 
 private:
+	void Insert(SoftTimer** ppst);						// link this timer into the pending list before *ppst, interrupts must be disabled
+	void Unlink();										// remove this timer from the pending list if it is in it, interrupts must be disabled
+
 	SoftTimer *next;
+	SoftTimer **pprev;									// the pointer that points to this timer in the pending list, or nullptr if it is not scheduled
 	Ticks whenDue;
 	Callback callback;
 	void *cbParam;
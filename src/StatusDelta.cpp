@@ -0,0 +1,294 @@
+/*
+ * StatusDelta.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "StatusDelta.h"
+#include "OutputMemory.h"
+#include "Storage/CRC32.h"
+
+bool StatusDelta::Update(OutputBuffer *response)
+{
+	uint8_t memberIndices[MaxMembers];
+	char *finalBrace;
+	numTexts = FindMembers(response, memberIndices, finalBrace);
+	if (numTexts == 0)
+	{
+		return false;									// not a JSON object that we can handle
+	}
+
+	// Update our record of the members, recording the ones that have changed
+	for (size_t i = 0; i < numMembers; ++i)
+	{
+		members[i].seen = false;
+	}
+
+	bool changed = false;
+	for (size_t i = 0; i < numTexts; ++i)
+	{
+		Member& m = members[memberIndices[i]];
+		m.seen = true;
+		CRC32 crc;
+		size_t offset = 0;
+		for (const OutputBuffer *buf = response; buf != nullptr && offset < texts[i].end; buf = buf->Next())
+		{
+			const size_t bufEnd = offset + buf->DataLength();
+			if (bufEnd > texts[i].start)
+			{
+				const size_t from = max<size_t>(offset, texts[i].start), to = min<size_t>(bufEnd, texts[i].end);
+				crc.Update(buf->Data() + from - offset, to - from);
+			}
+			offset = bufEnd;
+		}
+
+		if (m.changedSeq == 0 || crc.Get() != m.crc)
+		{
+			m.crc = crc.Get();
+			m.changedSeq = currentSeq + 1;
+			changed = true;
+		}
+	}
+
+	// Check for members that are no longer present. Clients that don't know they have gone need a full response.
+	bool removed = false;
+	for (size_t i = 0; i < numMembers; ++i)
+	{
+		if (!members[i].seen)
+		{
+			removed = true;
+		}
+	}
+
+	if (changed || removed)
+	{
+		++currentSeq;
+		if (removed)
+		{
+			fullSeq = currentSeq;
+		}
+	}
+
+	// Record when each member of this response changed, because removing members changes the indices into 'members'
+	for (size_t i = 0; i < numTexts; ++i)
+	{
+		texts[i].changedSeq = members[memberIndices[i]].changedSeq;
+	}
+	if (removed)
+	{
+		RemoveUnseenMembers();
+	}
+
+	// Add the sequence number to the response
+	*finalBrace = ',';
+	response->catf("\"dseq\":%" PRIu32 "}", currentSeq);
+	return true;
+}
+
+OutputBuffer *StatusDelta::MakeResponse(const OutputBuffer *response, uint32_t clientSeq) const
+{
+	OutputBuffer *buf;
+	if (!OutputBuffer::Allocate(buf))
+	{
+		return nullptr;
+	}
+
+	if (clientSeq != 0 && clientSeq >= fullSeq && clientSeq <= currentSeq)
+	{
+		// The client has the latest version or a recent one, so send just the changes
+		buf->cat('{');
+		for (size_t i = 0; i < numTexts; ++i)
+		{
+			if (texts[i].changedSeq > clientSeq)
+			{
+				CopyText(response, texts[i].start, texts[i].end, buf);
+				buf->cat(',');
+			}
+		}
+		buf->catf("\"dseq\":%" PRIu32 ",\"delta\":1}", currentSeq);
+	}
+	else
+	{
+		CopyText(response, 0, SIZE_MAX, buf);
+	}
+
+	if (buf->HadOverflow())
+	{
+		OutputBuffer::ReleaseAll(buf);
+		return nullptr;
+	}
+	return buf;
+}
+
+// Forget the members that were not in the latest response. This changes the indices of other members.
+void StatusDelta::RemoveUnseenMembers()
+{
+	for (size_t i = 0; i < numMembers; )
+	{
+		if (members[i].seen)
+		{
+			++i;
+		}
+		else
+		{
+			members[i] = members[--numMembers];
+		}
+	}
+}
+
+// Find the top-level members of the JSON object in the response and the corresponding entries in our table, adding new entries as needed.
+// Record where they are in 'texts'. Return the number of members found, or 0 if the response isn't a JSON object, or it is too long or has too many members.
+size_t StatusDelta::FindMembers(const OutputBuffer *response, uint8_t memberIndices[], char*& finalBrace)
+{
+	size_t numFound = 0;
+	size_t offset = 0;
+	unsigned int depth = 0;
+	bool inString = false, escaped = false, readingKey = false;
+	uint32_t keyHash = 0;
+	finalBrace = nullptr;
+
+	for (const OutputBuffer *buf = response; buf != nullptr; buf = buf->Next())
+	{
+		if (offset + buf->DataLength() > UINT16_MAX)
+		{
+			return 0;
+		}
+		const char * const data = buf->Data();
+		for (size_t i = 0; i < buf->DataLength(); ++i, ++offset)
+		{
+			const char c = data[i];
+			if (finalBrace != nullptr)
+			{
+				if (c != ' ' && c != '\n')
+				{
+					return 0;							// something after the end of the object
+				}
+			}
+			else if (inString)
+			{
+				if (escaped)
+				{
+					escaped = false;
+				}
+				else if (c == '\\')
+				{
+					escaped = true;
+				}
+				else if (c == '"')
+				{
+					inString = false;
+					if (readingKey)
+					{
+						readingKey = false;
+						const size_t member = LookUp(keyHash);
+						if (member == MaxMembers || numFound == MaxMembers)
+						{
+							return 0;
+						}
+						memberIndices[numFound] = (uint8_t)member;
+						++numFound;
+					}
+				}
+				if (readingKey)
+				{
+					keyHash = (keyHash ^ (uint8_t)c) * 16777619u;		// FNV-1a
+				}
+			}
+			else
+			{
+				switch (c)
+				{
+				case '"':
+					inString = true;
+					if (depth == 1 && (numFound == 0 || texts[numFound - 1].end != 0))
+					{
+						// This is the name of a new member
+						readingKey = true;
+						keyHash = 2166136261u;
+						texts[numFound].start = offset;
+						texts[numFound].end = 0;
+					}
+					break;
+
+				case '{':
+				case '[':
+					++depth;
+					break;
+
+				case '}':
+				case ']':
+					if (depth == 0)
+					{
+						return 0;
+					}
+					--depth;
+					if (depth == 0)
+					{
+						if (c != '}' || numFound == 0)
+						{
+							return 0;
+						}
+						texts[numFound - 1].end = offset;
+						finalBrace = const_cast<char *>(data + i);
+					}
+					break;
+
+				case ',':
+					if (depth == 1)
+					{
+						if (numFound == 0)
+						{
+							return 0;
+						}
+						texts[numFound - 1].end = offset;
+					}
+					break;
+
+				default:
+					break;
+				}
+			}
+		}
+	}
+	return (finalBrace != nullptr) ? numFound : 0;
+}
+
+// Find the entry for a member in our table, adding it if necessary. Return MaxMembers if the table is full.
+size_t StatusDelta::LookUp(uint32_t keyHash)
+{
+	for (size_t i = 0; i < numMembers; ++i)
+	{
+		if (members[i].keyHash == keyHash)
+		{
+			return i;
+		}
+	}
+	if (numMembers == MaxMembers)
+	{
+		return MaxMembers;
+	}
+	Member& m = members[numMembers];
+	m.keyHash = keyHash;
+	m.crc = 0;
+	m.changedSeq = 0;
+	m.seen = false;
+	return numMembers++;
+}
+
+// Copy part of the text of one output buffer chain to another
+/*static*/ void StatusDelta::CopyText(const OutputBuffer *src, size_t start, size_t end, OutputBuffer *dst)
+{
+	size_t offset = 0;
+	for (const OutputBuffer *buf = src; buf != nullptr && offset < end; buf = buf->Next())
+	{
+		const size_t bufEnd = offset + buf->DataLength();
+		if (bufEnd > start)
+		{
+			const size_t from = max<size_t>(offset, start), to = min<size_t>(bufEnd, end);
+			dst->cat(buf->Data() + from - offset, to - from);
+		}
+		offset = bufEnd;
+	}
+}
+
+// End
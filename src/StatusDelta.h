@@ -0,0 +1,65 @@
+/*
+ * StatusDelta.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Reduces JSON status responses to the top-level members that have changed since a previous response that the client has already received.
+ *  Each response carries a sequence number "dseq". A client that passes the sequence number of the last response it received gets a
+ *  response flagged "delta":1 containing only the members that have changed since then. The client merges these into the object it already has.
+ *  One response is generated and recorded by Update(), then MakeResponse() makes a copy or delta of it for each client that asks for it.
+ *  Used for HTTP status requests and for the status updates pushed to PanelDue on the aux channel (M408 P).
+ */
+
+#ifndef SRC_STATUSDELTA_H_
+#define SRC_STATUSDELTA_H_
+
+#include "RepRapFirmware.h"
+
+class OutputBuffer;
+
+class StatusDelta
+{
+public:
+	StatusDelta() : currentSeq(0), fullSeq(0), numMembers(0), numTexts(0) { }
+
+	// Record a new status response and add the sequence number to it. Return false if it isn't a JSON object that we can handle.
+	bool Update(OutputBuffer *response);
+
+	// Make the response to send to a client, which is either a delta or a copy of the full response. Return nullptr if we ran out of buffers.
+	// The response passed must be the one most recently passed to Update().
+	OutputBuffer *MakeResponse(const OutputBuffer *response, uint32_t clientSeq) const;
+
+	uint32_t GetSeq() const { return currentSeq; }
+
+private:
+	static constexpr size_t MaxMembers = 48;			// maximum number of top-level members in a status response
+
+	struct Member
+	{
+		uint32_t keyHash;								// hash of the member name
+		uint32_t crc;									// CRC of the whole member, name and value
+		uint32_t changedSeq;							// the sequence number of the response in which this member last changed
+		bool seen;										// used to detect members that have been removed
+	};
+
+	struct MemberText
+	{
+		uint16_t start;									// offset of the start of the member name in the response
+		uint16_t end;									// offset just past the end of the member value
+		uint32_t changedSeq;							// the sequence number of the response in which this member last changed
+	};
+
+	size_t FindMembers(const OutputBuffer *response, uint8_t memberIndices[], char*& finalBrace);
+	size_t LookUp(uint32_t keyHash);
+	void RemoveUnseenMembers();
+	static void CopyText(const OutputBuffer *src, size_t start, size_t end, OutputBuffer *dst);
+
+	uint32_t currentSeq;								// the sequence number of the most recent response
+	uint32_t fullSeq;									// clients that have a sequence number older than this need a full response
+	size_t numMembers;
+	size_t numTexts;									// the number of members in the most recent response
+	Member members[MaxMembers];
+	MemberText texts[MaxMembers];						// where the members are in the most recent response
+};
+
+#endif /* SRC_STATUSDELTA_H_ */
@@ -7,7 +7,7 @@
 class CRC32
 {
 private:
-	static const uint32_t CRC_32_TAB[];
+	static const uint32_t CRC_32_TAB[8][256];
 	uint32_t crc;
 
 public:
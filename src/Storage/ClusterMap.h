@@ -0,0 +1,37 @@
+/*
+ * ClusterMap.h
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#ifndef SRC_STORAGE_CLUSTERMAP_H_
+#define SRC_STORAGE_CLUSTERMAP_H_
+
+#include "RepRapFirmware.h"
+
+#if SAM4E || SAM4S || SAME70
+const size_t NumClusterMaps = 2;						// Number of cluster maps, enough for the file being printed and the file being parsed
+const size_t ClusterMapLength = 128;					// Number of 32-bit words in each map, enough for a file in 63 fragments
+#else
+const size_t NumClusterMaps = 1;
+const size_t ClusterMapLength = 64;
+#endif
+
+// Class to hold the cluster link map that FatFs uses for fast seeking. With a cluster map, FatFs can find the cluster holding any position
+// in a file without following the FAT chain from the start of the file, which takes a long time in a large file.
+class ClusterMap
+{
+public:
+	ClusterMap(ClusterMap *n) : next(n) { }
+
+	ClusterMap *Next() const { return next; }
+	void SetNext(ClusterMap *n) { next = n; }
+
+	uint32_t *Table() { table[0] = ClusterMapLength; return table; }	// FatFs needs the table length in the first word
+
+private:
+	ClusterMap *next;
+	uint32_t table[ClusterMapLength];
+};
+
+#endif /* SRC_STORAGE_CLUSTERMAP_H_ */
@@ -0,0 +1,158 @@
+/*
+ * FileCache.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "FileCache.h"
+
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+
+#include "FileStore.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+FileCache::FileCache(const char *p_name)
+	: name(p_name), entries(nullptr), data(nullptr), dataSize(0), maxEntries(0), maxFileSize(0), numEntries(0), bytesUsed(0), numReaders(0), hits(0), misses(0)
+{
+}
+
+// Allocate the storage. We never free it, so this can only be done once.
+bool FileCache::Allocate(size_t p_dataSize, size_t p_maxEntries, size_t p_maxFileSize)
+{
+	if (data != nullptr)
+	{
+		return false;
+	}
+	entries = new Entry[p_maxEntries];
+	maxEntries = p_maxEntries;
+	maxFileSize = p_maxFileSize;
+	dataSize = p_dataSize;
+	data = new char[p_dataSize];
+	return true;
+}
+
+// Skip the volume specifier if it is the default volume, so that "0:/sys/x.g" and "/sys/x.g" refer to the same entry
+static inline const char *SkipDefaultVolume(const char *path)
+{
+	return (path[0] == '0' && path[1] == ':') ? path + 2 : path;
+}
+
+const FileCache::Entry *FileCache::Lookup(const char *path) const
+{
+	path = SkipDefaultVolume(path);
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		const Entry& e = entries[i];
+		if (e.valid && StringEquals(data + e.pathOffset, path))			// file names are not case sensitive
+		{
+			return &e;
+		}
+	}
+	return nullptr;
+}
+
+// Look up a file. If it is cached, return a pointer to its contents and set 'length'. The caller must call AddReader if it uses the contents.
+const char *FileCache::Find(const char *path, size_t& length)
+{
+	const Entry * const e = Lookup(path);
+	if (e == nullptr)
+	{
+		++misses;
+		return nullptr;
+	}
+	++hits;
+	length = e->length;
+	return data + e->dataOffset;
+}
+
+// Look up a file. If it is cached, set 'lastModified' to the timestamp that was provided when it was added.
+bool FileCache::GetLastModifiedTime(const char *path, time_t& lastModified) const
+{
+	const Entry * const e = Lookup(path);
+	if (e == nullptr)
+	{
+		return false;
+	}
+	lastModified = e->lastModified;
+	return true;
+}
+
+// Cache the contents of a file that has just been opened for reading, if it is small enough and there is room
+void FileCache::Add(const char *path, FileStore *f, time_t lastModified)
+{
+	path = SkipDefaultVolume(path);
+	const FilePosition length = f->Length();
+	const size_t pathLength = strlen(path) + 1;
+	if (length > maxFileSize || pathLength + length > dataSize)
+	{
+		return;
+	}
+
+	if (numEntries == maxEntries || bytesUsed + pathLength + length > dataSize)
+	{
+		Reclaim();
+		if (numEntries == maxEntries || bytesUsed + pathLength + length > dataSize)
+		{
+			return;														// a cached file is open, so we can't reclaim the space yet
+		}
+	}
+
+	const FilePosition pos = f->Position();
+	char * const fileData = data + bytesUsed + pathLength;
+	const bool ok = f->Seek(0) && f->Read(fileData, length) == (int)length;
+	f->Seek(pos);
+	if (ok)
+	{
+		Entry& e = entries[numEntries++];
+		e.pathOffset = bytesUsed;
+		e.dataOffset = bytesUsed + pathLength;
+		e.length = length;
+		e.lastModified = lastModified;
+		e.valid = true;
+		memcpy(data + bytesUsed, path, pathLength);
+		bytesUsed += pathLength + length;
+	}
+}
+
+// Forget a file because it is about to be changed. The space it uses is reclaimed later.
+void FileCache::Invalidate(const char *path)
+{
+	Entry * const e = const_cast<Entry*>(Lookup(path));
+	if (e != nullptr)
+	{
+		e->valid = false;
+	}
+}
+
+void FileCache::InvalidateAll()
+{
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		entries[i].valid = false;
+	}
+	Reclaim();
+}
+
+// Free the space used by all entries, if no cached file is open
+void FileCache::Reclaim()
+{
+	if (numReaders == 0)
+	{
+		numEntries = 0;
+		bytesUsed = 0;
+	}
+}
+
+void FileCache::Diagnostics(MessageType mtype)
+{
+	if (data != nullptr)
+	{
+		reprap.GetPlatform().MessageF(mtype, "%s cache: %u entries, %u of %u bytes used, %u hits, %u misses\n", name, numEntries, bytesUsed, dataSize, hits, misses);
+		hits = misses = 0;
+	}
+}
+
+#endif
+
+// End
@@ -0,0 +1,72 @@
+/*
+ * FileCache.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  Copies of small files held in RAM, so that files that are read often don't need to be read from the SD card each time.
+ *  We use one cache for macro files (e.g. tool change files) and another for the files of the web interface.
+ *  Entries are invalidated when the corresponding file is written, deleted or renamed, and when the card is unmounted, so the cached
+ *  copy and its timestamp always match the file on the card unless the card is changed without being unmounted.
+ *  Space is only reclaimed when no cached file is open, so the data of an open cached file never moves.
+ */
+
+#ifndef SRC_STORAGE_FILECACHE_H_
+#define SRC_STORAGE_FILECACHE_H_
+
+#include "RepRapFirmware.h"
+#include "MessageType.h"
+
+#include <ctime>
+
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+
+class FileStore;
+
+class FileCache
+{
+public:
+	FileCache(const char *p_name);
+
+	bool Allocate(size_t p_dataSize, size_t p_maxEntries, size_t p_maxFileSize);	// Allocate the storage, returning false if it has already been allocated
+	static size_t RamNeeded(size_t p_dataSize, size_t p_maxEntries) { return p_dataSize + p_maxEntries * sizeof(Entry); }
+	bool IsAllocated() const { return data != nullptr; }
+	size_t GetSize() const { return dataSize; }
+	size_t GetMaxFileSize() const { return maxFileSize; }
+
+	const char *Find(const char *path, size_t& length);			// Look up a file and return its data if it is cached
+	bool GetLastModifiedTime(const char *path, time_t& lastModified) const;	// Look up the timestamp of a cached file
+	void Add(const char *path, FileStore *f, time_t lastModified = 0);	// Cache a file that has just been opened, leaving its position unchanged
+	void Invalidate(const char *path);							// Forget a file because it is being changed
+	void InvalidateAll();										// Forget all files, e.g. because the file system has changed
+	void AddReader() { ++numReaders; }							// Called when a cached file is opened
+	void ReleaseReader() { if (numReaders != 0) { --numReaders; } }	// Called when a cached file is closed
+	void Diagnostics(MessageType mtype);
+
+private:
+	struct Entry
+	{
+		uint32_t pathOffset;									// where the path name starts in 'data'
+		uint32_t dataOffset;									// where the file contents start in 'data'
+		uint32_t length;										// the length of the file
+		time_t lastModified;									// the timestamp of the file, if the caller provided it
+		bool valid;
+	};
+
+	const Entry *Lookup(const char *path) const;
+	void Reclaim();
+
+	const char *name;
+	Entry *entries;
+	char *data;
+	size_t dataSize;
+	size_t maxEntries;
+	size_t maxFileSize;
+	size_t numEntries;
+	size_t bytesUsed;
+	unsigned int numReaders;									// how many cached files are open
+	unsigned int hits, misses;
+};
+
+#endif
+
+#endif /* SRC_STORAGE_FILECACHE_H_ */
@@ -91,6 +91,11 @@ public:
 		return f->Length();
 	}
 
+	uint32_t ClusterSize() const
+	{
+		return f->ClusterSize();
+	}
+
 	// Assignment operator
 	void CopyFrom(const FileData& other)
 	{
@@ -0,0 +1,222 @@
+/*
+ * FileInfoIndex.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "FileInfoIndex.h"
+
+#if SUPPORT_FILE_INFO_INDEX
+
+#include "CRC32.h"
+#include "FileStore.h"
+#include "MassStorage.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+constexpr uint32_t IndexLockTimeout = 200;		// how long we wait for another task to finish using the index, in milliseconds
+
+FileInfoIndex::FileInfoIndex() : hits(0), misses(0)
+{
+	indexMutex.Create("FileInfoIndex");
+}
+
+// Look up the information about a file, returning true if we found an up-to-date entry for it
+bool FileInfoIndex::Find(const char *directory, const char *fileName, FilePosition fileSize, time_t lastModifiedTime, GCodeFileInfo& info)
+{
+	String<MaxFilenameLength> dir, leafName;
+	if (!SplitPath(directory, fileName, dir, leafName))
+	{
+		return false;
+	}
+
+	MutexLocker lock(indexMutex, IndexLockTimeout);
+	if (!lock)
+	{
+		return false;
+	}
+
+	FileStore * const f = reprap.GetPlatform().OpenFile(dir.c_str(), FILE_INFO_INDEX_FILE, OpenMode::read);
+	if (f != nullptr)
+	{
+		const bool found = FindSlot(f, leafName.c_str(), false) >= 0;
+		f->Close();
+		if (found && entry.info.fileSize == fileSize && entry.info.lastModifiedTime == lastModifiedTime)
+		{
+			info = entry.info;
+			++hits;
+			return true;
+		}
+	}
+	++misses;
+	return false;
+}
+
+// Record the information about a file, replacing any previous entry for it
+void FileInfoIndex::Store(const char *directory, const char *fileName, const GCodeFileInfo& info)
+{
+	String<MaxFilenameLength> dir, leafName;
+	if (!SplitPath(directory, fileName, dir, leafName))
+	{
+		return;
+	}
+
+	MutexLocker lock(indexMutex, IndexLockTimeout);
+	if (!lock)
+	{
+		return;
+	}
+
+	FileStore * const f = reprap.GetPlatform().OpenFile(dir.c_str(), FILE_INFO_INDEX_FILE, OpenMode::append);		// open for random access, creating the file if necessary
+	if (f != nullptr)
+	{
+		const int slot = FindSlot(f, leafName.c_str(), true);
+		memset(&entry, 0, sizeof(entry));
+		entry.version = IndexVersion;
+		entry.entrySize = sizeof(Entry);
+		SafeStrncpy(entry.fileName, leafName.c_str(), ARRAY_SIZE(entry.fileName));
+		entry.info = info;
+		entry.crc = CalcCrc(entry);
+
+		// If the slot is beyond the end of the index, seeking extends the file. The contents of any gap are undefined, but the CRC stops them being mistaken for entries.
+		bool ok = f->Seek(slot * sizeof(Entry)) && f->Write(reinterpret_cast<const char *>(&entry), sizeof(Entry));
+		if (!f->Close())
+		{
+			ok = false;
+		}
+		if (!ok && reprap.Debug(moduleStorage))
+		{
+			reprap.GetPlatform().MessageF(UsbMessage, "Failed to update file info index in %s\n", dir.c_str());
+		}
+	}
+}
+
+// Forget a file, because it has been changed in a way that doesn't change its size or modification time
+void FileInfoIndex::Invalidate(const char *directory, const char *fileName)
+{
+	String<MaxFilenameLength> dir, leafName;
+	if (!SplitPath(directory, fileName, dir, leafName))
+	{
+		return;
+	}
+
+	MutexLocker lock(indexMutex, IndexLockTimeout);
+	if (!lock)
+	{
+		return;
+	}
+
+	// Check that the index exists before we open it for writing, because opening it for writing would create it
+	FileStore * f = reprap.GetPlatform().OpenFile(dir.c_str(), FILE_INFO_INDEX_FILE, OpenMode::read);
+	if (f != nullptr)
+	{
+		const int slot = FindSlot(f, leafName.c_str(), false);
+		f->Close();
+		if (slot >= 0)
+		{
+			f = reprap.GetPlatform().OpenFile(dir.c_str(), FILE_INFO_INDEX_FILE, OpenMode::append);
+			if (f != nullptr)
+			{
+				memset(&entry, 0, sizeof(entry));		// an all-zero entry has the wrong CRC, so it reads as unused
+				if (f->Seek(slot * sizeof(Entry)))
+				{
+					(void)f->Write(reinterpret_cast<const char *>(&entry), sizeof(Entry));
+				}
+				f->Close();
+			}
+		}
+	}
+}
+
+void FileInfoIndex::Diagnostics(MessageType mtype)
+{
+	reprap.GetPlatform().MessageF(mtype, "File info index: %u hits, %u misses\n", hits, misses);
+	hits = misses = 0;
+}
+
+// Split the path of a file into the directory that holds it and its name within that directory
+/*static*/ bool FileInfoIndex::SplitPath(const char *directory, const char *fileName, String<MaxFilenameLength>& dir, String<MaxFilenameLength>& leafName)
+{
+	MassStorage::CombineName(dir.GetRef(), directory, fileName);
+	const char * const lastSlash = strrchr(dir.c_str(), '/');
+	if (lastSlash == nullptr || lastSlash[1] == 0)
+	{
+		return false;
+	}
+	leafName.copy(lastSlash + 1);
+	dir.Truncate(lastSlash + 1 - dir.c_str());
+	return true;
+}
+
+// Hash a file name. FAT file names are not case sensitive, so neither is the hash.
+/*static*/ uint32_t FileInfoIndex::Hash(const char *fileName)
+{
+	uint32_t hash = 2166136261u;					// FNV-1a
+	while (*fileName != 0)
+	{
+		hash = (hash ^ (uint8_t)tolower(*fileName++)) * 16777619u;
+	}
+	return hash;
+}
+
+/*static*/ uint32_t FileInfoIndex::CalcCrc(const Entry& e)
+{
+	CRC32 crc;
+	crc.Update(reinterpret_cast<const char *>(&e) + sizeof(e.crc), sizeof(Entry) - sizeof(e.crc));
+	return crc.Get();
+}
+
+// Read an entry into our buffer, returning true if we read a whole entry
+bool FileInfoIndex::ReadEntry(FileStore *f, size_t slot)
+{
+	return f->Seek(slot * sizeof(Entry)) && f->Read(reinterpret_cast<char *>(&entry), sizeof(Entry)) == (int)sizeof(Entry);
+}
+
+bool FileInfoIndex::EntryIsValid() const
+{
+	return entry.version == IndexVersion && entry.entrySize == sizeof(Entry) && entry.crc == CalcCrc(entry);
+}
+
+// Find the slot that holds the entry for a file and leave the entry in our buffer, returning -1 if it isn't in the index.
+// If 'forWriting' is true, return the slot to store the file in instead. This is its existing slot, else the first unused slot we find,
+// else its home slot, which discards the entry for some other file.
+int FileInfoIndex::FindSlot(FileStore *f, const char *fileName, bool forWriting)
+{
+	const size_t homeSlot = Hash(fileName) % FileInfoIndexSlots;
+	int unusedSlot = -1;
+	for (size_t probe = 0; probe < FileInfoIndexProbes; ++probe)
+	{
+		const size_t slot = (homeSlot + probe) % FileInfoIndexSlots;
+		if (!ReadEntry(f, slot))
+		{
+			// We have reached the end of the index, so the file can't be in any later slot either
+			if (unusedSlot < 0)
+			{
+				unusedSlot = (int)slot;
+			}
+			break;
+		}
+
+		if (EntryIsValid())
+		{
+			if (StringEquals(entry.fileName, fileName))
+			{
+				return (int)slot;
+			}
+		}
+		else if (unusedSlot < 0)
+		{
+			unusedSlot = (int)slot;					// keep looking, because we don't shorten the probe sequence when we invalidate an entry
+		}
+	}
+
+	if (!forWriting)
+	{
+		return -1;
+	}
+	return (unusedSlot >= 0) ? unusedSlot : (int)homeSlot;
+}
+
+#endif
+
+// End
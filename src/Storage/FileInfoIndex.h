@@ -0,0 +1,61 @@
+/*
+ * FileInfoIndex.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  The parsed information about G-code files, kept in an index file in each directory so that we don't need to parse a file again
+ *  each time a client asks for its details. The index is a hash table of fixed-size entries keyed on the file name. An entry is only used
+ *  if the size and modification time of the file still match, so entries for files that have been changed or replaced are ignored.
+ */
+
+#ifndef SRC_STORAGE_FILEINFOINDEX_H_
+#define SRC_STORAGE_FILEINFOINDEX_H_
+
+#include "RepRapFirmware.h"
+#include "MessageType.h"
+#include "RTOSIface.h"
+
+#if SUPPORT_FILE_INFO_INDEX
+
+#include "FileInfoParser.h"
+
+class FileStore;
+
+class FileInfoIndex
+{
+public:
+	FileInfoIndex();
+
+	bool Find(const char *directory, const char *fileName, FilePosition fileSize, time_t lastModifiedTime, GCodeFileInfo& info);	// Look up the information about a file
+	void Store(const char *directory, const char *fileName, const GCodeFileInfo& info);		// Record the information about a file
+	void Invalidate(const char *directory, const char *fileName);								// Forget a file because it has been changed
+	void Diagnostics(MessageType mtype);
+
+private:
+	static constexpr uint16_t IndexVersion = 1;			// change this if the meaning of the entries changes
+
+	struct Entry
+	{
+		uint32_t crc;									// CRC of the rest of the entry, so that we can detect unused or damaged entries
+		uint16_t version;
+		uint16_t entrySize;
+		char fileName[MaxFilenameLength];				// the name of the file within the directory
+		GCodeFileInfo info;
+	};
+
+	static bool SplitPath(const char *directory, const char *fileName, String<MaxFilenameLength>& dir, String<MaxFilenameLength>& leafName);
+	static uint32_t Hash(const char *fileName);
+	static uint32_t CalcCrc(const Entry& e);
+
+	bool ReadEntry(FileStore *f, size_t slot);
+	bool EntryIsValid() const;
+	int FindSlot(FileStore *f, const char *fileName, bool forWriting);
+
+	Mutex indexMutex;
+	Entry entry;										// buffer for the entry being read or written, kept here to save stack space
+	unsigned int hits, misses;
+};
+
+#endif
+
+#endif /* SRC_STORAGE_FILEINFOINDEX_H_ */
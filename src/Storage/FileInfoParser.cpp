@@ -12,6 +12,52 @@
 #include "PrintMonitor.h"
 #include "GCodes/GCodes.h"
 
+// The strings we look for in slicer comments, indexed by CommentKey
+const char * const FileInfoParser::CommentKeyStrings[] =
+{
+	// Layer height
+	"layer_height",						// slic3r
+	"Layer height",						// Cura
+	"layerHeight",						// S3D
+	"layer_thickness_mm",				// Kisslicer
+	"layerThickness",					// Matter Control
+
+	// Slicer
+	"generated by ",					// slic3r and S3D
+	";Sliced by ",						// ideaMaker
+	"; KISSlicer",						// KISSlicer
+	";Sliced at: ",						// Cura (old)
+	";Generated with ",					// Cura (new)
+
+	// Filament used
+	"ilament used",						// slic3r and Cura, followed by filament used and "mm"
+	";Material#",						// Ideamaker, e.g. ";Material#1 Used: 868.0"
+	"ilament length",					// S3D
+	";    Ext ",						// recent KISSlicer versions
+	"; Estimated Build Volume: ",		// old KISSlicer
+
+	// Print time
+	" estimated printing time",			// slic3r PE		"; estimated printing time = 1h 5m 24s"
+	";TIME",							// Cura				";TIME:38846"
+	" Build time",						// S3D				";   Build time: 0 hours 42 minutes"
+										// also KISSlicer	"; Estimated Build Time:   332.83 minutes"
+	// Simulated print time
+	FileInfoParser::SimulatedTimeString
+};
+
+// Return true if the null-terminated string 'p' starts with 'key'
+static inline bool KeyMatches(const char *p, const char *key)
+{
+	while (*key != 0)
+	{
+		if (*p++ != *key++)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 void GCodeFileInfo::Init()
 {
 	isValid = false;
@@ -92,14 +138,26 @@ bool FileInfoParser::GetFileInfo(const char *directory, const char *fileName, GC
 		}
 
 		// If the file is empty or not a G-Code file, we don't need to parse anything
-		if (fileBeingParsed->Length() == 0 || (!StringEndsWith(fileName, ".gcode") && !StringEndsWith(fileName, ".g")
-					&& !StringEndsWith(fileName, ".gco") && !StringEndsWith(fileName, ".gc")))
+		if (fileBeingParsed->Length() == 0 || !IsGCodeFile(fileName))
 		{
 			fileBeingParsed->Close();
 			parsedFileInfo.incomplete = false;
 			info = parsedFileInfo;
 			return true;
 		}
+
+#if SUPPORT_FILE_INFO_INDEX
+		// If we have parsed this file before, use the information we saved
+		if (reprap.GetPlatform().GetMassStorage()->GetFileInfoIndex().Find(directory, fileName, parsedFileInfo.fileSize, parsedFileInfo.lastModifiedTime, info))
+		{
+			fileBeingParsed->Close();
+			return true;
+		}
+#endif
+		if (fileBeingParsed->Length() > GCODE_HEADER_SIZE)
+		{
+			(void)fileBeingParsed->EnableFastSeek();				// we seek backwards through the footer, which is slow in a large file without a cluster map
+		}
 		parseState = parsingHeader;
 	}
 
@@ -144,6 +202,12 @@ bool FileInfoParser::GetFileInfo(const char *directory, const char *fileName, GC
 				accumulatedReadTime += now - startTime;
 				startTime = now;
 
+				// Find the slicer comments that hold the details we haven't found yet
+				FindCommentKeys(buf,   ((parsedFileInfo.numFilaments == 0) ? FilamentKeys : 0)
+									 | ((parsedFileInfo.layerHeight == 0.0) ? LayerHeightKeys : 0)
+									 | ((parsedFileInfo.generatedBy.IsEmpty()) ? SlicerKeys : 0)
+									 | ((parsedFileInfo.printTime == 0) ? PrintTimeKeys : 0));
+
 				// Search for filament usage (Cura puts it at the beginning of a G-code file)
 				if (parsedFileInfo.numFilaments == 0)
 				{
@@ -216,9 +280,9 @@ bool FileInfoParser::GetFileInfo(const char *directory, const char *fileName, GC
 					currentPos = 0;
 				}
 
-				// Seek at most 512 clusters at a time
+				// Seek at most 512 clusters at a time, unless we have a cluster map so that seeking is quick
 				const FilePosition maxSeekDistance = 512 * (FilePosition)clsize;
-				const bool doFullSeek = (nextSeekPos <= currentPos + maxSeekDistance);
+				const bool doFullSeek = fileBeingParsed->IsFastSeekEnabled() || (nextSeekPos <= currentPos + maxSeekDistance);
 				const FilePosition thisSeekPos = (doFullSeek) ? nextSeekPos : currentPos + maxSeekDistance;
 
 				const uint32_t startTime = millis();
@@ -272,6 +336,12 @@ bool FileInfoParser::GetFileInfo(const char *directory, const char *fileName, GC
 
 				bool footerInfoComplete = true;
 
+				// Find the slicer comments that hold the details we haven't found yet
+				FindCommentKeys(buf,   ((parsedFileInfo.numFilaments == 0) ? FilamentKeys : 0)
+									 | ((parsedFileInfo.layerHeight == 0.0) ? LayerHeightKeys : 0)
+									 | ((parsedFileInfo.printTime == 0) ? PrintTimeKeys : 0)
+									 | ((parsedFileInfo.simulatedTime == 0) ? SimulatedTimeKeys : 0));
+
 				// Search for filament used
 				if (parsedFileInfo.numFilaments == 0)
 				{
@@ -334,6 +404,9 @@ bool FileInfoParser::GetFileInfo(const char *directory, const char *fileName, GC
 					fileBeingParsed->Close();
 					parsedFileInfo.incomplete = false;
 					info = parsedFileInfo;
+#if SUPPORT_FILE_INFO_INDEX
+					reprap.GetPlatform().GetMassStorage()->GetFileInfoIndex().Store(directory, fileName, parsedFileInfo);
+#endif
 					return true;
 				}
 
@@ -364,6 +437,191 @@ bool FileInfoParser::GetFileInfo(const char *directory, const char *fileName, GC
 	return false;
 }
 
+/*static*/ bool FileInfoParser::IsGCodeFile(const char *fileName)
+{
+	return StringEndsWith(fileName, ".gcode") || StringEndsWith(fileName, ".g") || StringEndsWith(fileName, ".gco") || StringEndsWith(fileName, ".gc");
+}
+
+#if SUPPORT_FILE_INFO_INDEX
+
+// Start parsing a file that is being uploaded
+void FileInfoParser::StartScan()
+{
+	parsedFileInfo.Init();
+	parsedFileInfo.isValid = true;
+	fileOverlapLength = 0;
+	bytesScanned = 0;
+	scanFooterFilament = scanFooterLayerHeight = scanFooterPrintTime = false;
+}
+
+// Parse some more data of the file being uploaded. We copy it to our own buffer so that we can null-terminate it and search across the boundaries between chunks.
+void FileInfoParser::ScanData(const char *data, size_t len)
+{
+	char * const buf = reinterpret_cast<char*>(buf32);
+	while (len != 0)
+	{
+		const size_t sizeToRead = min<size_t>(len, GCODE_READ_SIZE);
+		memcpy(&buf[fileOverlapLength], data, sizeToRead);
+		const size_t sizeToScan = fileOverlapLength + sizeToRead;
+		buf[sizeToScan] = 0;
+		ScanChunk(buf, sizeToScan);
+
+		data += sizeToRead;
+		len -= sizeToRead;
+		bytesScanned += sizeToRead;
+		fileOverlapLength = min<size_t>(sizeToScan, GCODE_OVERLAP_SIZE);
+		memmove(buf, &buf[sizeToScan - fileOverlapLength], fileOverlapLength);
+	}
+}
+
+// Look for the file details in a chunk of the file being uploaded. The buffer is null-terminated.
+// We can't search the footer backwards from the end like GetFileInfo does, so we search every chunk after the header and let later matches replace earlier ones.
+void FileInfoParser::ScanChunk(const char *buf, size_t len)
+{
+	if (bytesScanned < GCODE_HEADER_SIZE)
+	{
+		// Look for the details that we search the header for, in the same way as GetFileInfo
+		FindCommentKeys(buf,   ((parsedFileInfo.numFilaments == 0) ? FilamentKeys : 0)
+							 | ((parsedFileInfo.layerHeight == 0.0) ? LayerHeightKeys : 0)
+							 | ((parsedFileInfo.generatedBy.IsEmpty()) ? SlicerKeys : 0)
+							 | ((parsedFileInfo.printTime == 0) ? PrintTimeKeys : 0)
+							 | SimulatedTimeKeys);
+		if (parsedFileInfo.numFilaments == 0)
+		{
+			parsedFileInfo.numFilaments = FindFilamentUsed(buf, len);
+		}
+		if (parsedFileInfo.firstLayerHeight == 0.0)
+		{
+			(void)FindFirstLayerHeight(buf, len);
+		}
+		if (parsedFileInfo.layerHeight == 0.0)
+		{
+			(void)FindLayerHeight(buf, len);
+		}
+		if (parsedFileInfo.generatedBy.IsEmpty())
+		{
+			(void)FindSlicerInfo(buf, len);
+		}
+		if (parsedFileInfo.printTime == 0)
+		{
+			(void)FindPrintTime(buf, len);
+		}
+
+		if (bytesScanned + (len - fileOverlapLength) >= GCODE_HEADER_SIZE)
+		{
+			// This was the last chunk of the header, so from now on look only for the details that we haven't found
+			scanFooterFilament = (parsedFileInfo.numFilaments == 0);
+			scanFooterLayerHeight = (parsedFileInfo.layerHeight == 0.0);
+			scanFooterPrintTime = (parsedFileInfo.printTime == 0);
+		}
+	}
+	else
+	{
+		FindCommentKeys(buf,   ((scanFooterFilament) ? FilamentKeys : 0)
+							 | ((scanFooterLayerHeight) ? LayerHeightKeys : 0)
+							 | ((scanFooterPrintTime) ? PrintTimeKeys : 0)
+							 | SimulatedTimeKeys);
+		if (scanFooterFilament)
+		{
+			const unsigned int filamentsFound = FindFilamentUsed(buf, len);
+			if (filamentsFound != 0)
+			{
+				parsedFileInfo.numFilaments = filamentsFound;
+			}
+		}
+		if (scanFooterLayerHeight)
+		{
+			(void)FindLayerHeight(buf, len);
+		}
+		if (scanFooterPrintTime)
+		{
+			(void)FindPrintTime(buf, len);
+		}
+	}
+
+	// The object height and the simulated print time come from the end of the file, so keep looking for them all the way through
+	(void)FindHeight(buf, len);
+	(void)FindSimulatedTime(buf, len);
+}
+
+// Finish parsing the file that was uploaded and return the details, which are complete because we have seen all of the file
+void FileInfoParser::FinishScan(time_t lastModifiedTime, GCodeFileInfo& info)
+{
+	parsedFileInfo.fileSize = bytesScanned;
+	parsedFileInfo.lastModifiedTime = lastModifiedTime;
+	parsedFileInfo.incomplete = false;
+	info = parsedFileInfo;
+}
+
+#endif
+
+// Search the comments in the buffer for the wanted strings that identify the file details, in a single pass, and record where we first find each one.
+// This is much faster than searching the whole buffer for each string in turn, because most of a G-code file is not comments and we skip those parts using strchr.
+// We don't know whether the start of the buffer is in a comment, so we assume that it is. The buffer is null-terminated.
+void FileInfoParser::FindCommentKeys(const char *buf, uint32_t wantedKeys)
+{
+	static_assert(ARRAY_SIZE(CommentKeyStrings) == NumCommentKeys, "Wrong number of comment key strings");
+	static_assert(NumCommentKeys <= 32, "Too many comment keys");
+
+	for (const char *& pos : keyPositions)
+	{
+		pos = nullptr;
+	}
+
+	// Make a map of the first characters of the strings we want, so that we can reject most characters quickly
+	uint32_t firstChars[256/32] = { 0 };
+	for (unsigned int key = 0; key < NumCommentKeys; ++key)
+	{
+		if ((wantedKeys & ((uint32_t)1 << key)) != 0)
+		{
+			const uint8_t c = (uint8_t)CommentKeyStrings[key][0];
+			firstChars[c >> 5] |= (uint32_t)1 << (c & 31);
+		}
+	}
+
+	const char *p = buf;
+	bool inComment = true;
+	while (wantedKeys != 0)
+	{
+		if (!inComment)
+		{
+			// Skip to the next comment. If it starts a line then start from the newline, because the simulated time string starts with one.
+			const char * const semicolon = strchr(p, ';');
+			if (semicolon == nullptr)
+			{
+				break;
+			}
+			p = (semicolon > p && semicolon[-1] == '\n') ? semicolon - 1 : semicolon;
+			inComment = true;
+		}
+
+		const char c = *p;
+		if (c == 0)
+		{
+			break;
+		}
+
+		if ((firstChars[(uint8_t)c >> 5] & ((uint32_t)1 << ((uint8_t)c & 31))) != 0)
+		{
+			for (unsigned int key = 0; key < NumCommentKeys; ++key)
+			{
+				const uint32_t keyBit = (uint32_t)1 << key;
+				if ((wantedKeys & keyBit) != 0 && KeyMatches(p, CommentKeyStrings[key]))
+				{
+					keyPositions[key] = p;
+					wantedKeys &= ~keyBit;
+				}
+			}
+		}
+
+		if (c == '\n' && p[1] != ';')
+		{
+			inComment = false;
+		}
+		++p;
+	}
+}
+
 // Scan the buffer for a G1 Zxxx command. The buffer is null-terminated.
 bool FileInfoParser::FindFirstLayerHeight(const char* buf, size_t len)
 {
@@ -534,94 +792,69 @@ bool FileInfoParser::FindHeight(const char* buf, size_t len)
 	return foundHeight;
 }
 
-// Scan the buffer for the layer height. The buffer is null-terminated.
+// Scan the buffer for the layer height. The buffer is null-terminated and FindCommentKeys must have been called for it.
 bool FileInfoParser::FindLayerHeight(const char *buf, size_t len)
 {
-	static const char* const layerHeightStrings[] =
+	for (unsigned int key = keyLayerHeightSlic3r; key <= keyLayerHeightMatterControl; ++key)	// try each string in turn
 	{
-		"layer_height",			// slic3r
-		"Layer height",			// Cura
-		"layerHeight",			// S3D
-		"layer_thickness_mm",	// Kisslicer
-		"layerThickness"		// Matter Control
-	};
-
-	if (*buf != 0)
-	{
-		++buf;														// make sure we can look back 1 character after we find a match
-		for (const char * lhStr : layerHeightStrings)				// search for each string in turn
+		const char * const lhStr = CommentKeyStrings[key];
+		const char *pos = keyPositions[key];
+		while (pos != nullptr)										// loop until success or strstr returns null
 		{
-			const char *pos = buf;
-			for(;;)													// loop until success or strstr returns null
+			const char c = (pos == buf) ? 0 : pos[-1];				// fetch the previous character
+			pos += strlen(lhStr);									// skip the string we matched
+			if (c == ' ' || c == ';' || c == '\t')					// check we are not in the middle of a word
 			{
-				pos = strstr(pos, lhStr);
-				if (pos == nullptr)
+				while (strchr(" \t=:,", *pos) != nullptr)			// skip the possible separators
 				{
-					break;											// didn't find this string in the buffer, so try the next string
+					++pos;
 				}
-
-				const char c = pos[-1];								// fetch the previous character
-				pos += strlen(lhStr);				// skip the string we matched
-				if (c == ' ' || c == ';' || c == '\t')				// check we are not in the middle of a word
+				const char *tailPtr;
+				const float val = SafeStrtof(pos, &tailPtr);
+				if (tailPtr != pos)									// if we found and converted a number
 				{
-					while (strchr(" \t=:,", *pos) != nullptr)		// skip the possible separators
-					{
-						++pos;
-					}
-					const char *tailPtr;
-					const float val = SafeStrtof(pos, &tailPtr);
-					if (tailPtr != pos)								// if we found and converted a number
-					{
-						parsedFileInfo.layerHeight = val;
-						return true;
-					}
+					parsedFileInfo.layerHeight = val;
+					return true;
 				}
 			}
+			pos = strstr(pos, lhStr);								// look for a later instance of this string
 		}
 	}
 
 	return false;
 }
 
+// Scan the buffer for the name of the slicer. The buffer is null-terminated and FindCommentKeys must have been called for it.
 bool FileInfoParser::FindSlicerInfo(const char* buf, size_t len)
 {
-	static const char * const GeneratedByStrings[] =
-	{
-		"generated by ",	// slic3r and S3D
-		";Sliced by ",		// ideaMaker
-		"; KISSlicer",		// KISSlicer
-		";Sliced at: ",		// Cura (old)
-		";Generated with "	// Cura (new)
-	};
-
-	size_t index = 0;
+	unsigned int key = keyGeneratedBy;
 	const char* pos;
 	do
 	{
-		pos = strstr(buf, GeneratedByStrings[index]);
+		pos = keyPositions[key];
 		if (pos != nullptr)
 		{
 			break;
 		}
-		++index;
-	} while (index < ARRAY_SIZE(GeneratedByStrings));
+		++key;
+	} while (key <= keyGeneratedWith);
 
 	if (pos != nullptr)
 	{
 		const char* introString = "";
-		switch (index)
+		switch (key)
 		{
 		default:
-			pos += strlen(GeneratedByStrings[index]);
+			pos += strlen(CommentKeyStrings[key]);
 			break;
 
-		case 2:		// KISSlicer
+		case keyKisslicer:
 			pos += 2;
 			break;
 
-		case 3:		// Cura (old)
+		case keySlicedAt:		// Cura (old)
 			introString = "Cura at ";
-			pos += strlen(GeneratedByStrings[index]);
+			pos += strlen(CommentKeyStrings[key]);
 			break;
 		}
 
@@ -635,7 +868,7 @@ bool FileInfoParser::FindSlicerInfo(const char* buf, size_t len)
 	return false;
 }
 
-// Scan the buffer for the filament used. The buffer is null-terminated.
+// Scan the buffer for the filament used. The buffer is null-terminated and FindCommentKeys must have been called for it.
 // Returns the number of filaments found.
 unsigned int FileInfoParser::FindFilamentUsed(const char* buf, size_t len)
 {
@@ -643,9 +876,9 @@ unsigned int FileInfoParser::FindFilamentUsed(const char* buf, size_t len)
 	const size_t maxFilaments = reprap.GetGCodes().GetNumExtruders();
 
 	// Look for filament usage as generated by Slic3r and Cura
-	const char* const filamentUsedStr1 = "ilament used";			// comment string used by slic3r and Cura, followed by filament used and "mm"
-	const char* p = buf;
-	while (filamentsFound < maxFilaments &&	(p = strstr(p, filamentUsedStr1)) != nullptr)
+	const char* const filamentUsedStr1 = CommentKeyStrings[keyFilamentUsed];
+	const char* p = keyPositions[keyFilamentUsed];
+	while (filamentsFound < maxFilaments && p != nullptr)
 	{
 		p += strlen(filamentUsedStr1);
 		while(strchr(" :=\t", *p) != nullptr)
@@ -675,12 +908,13 @@ unsigned int FileInfoParser::FindFilamentUsed(const char* buf, size_t len)
 				++p;
 			}
 		}
+		p = strstr(p, filamentUsedStr1);
 	}
 
 	// Look for filament usage string generated by Ideamaker
-	const char* const filamentUsedStr2 = ";Material#";			// comment string used by Ideamaker, e.g. ";Material#1 Used: 868.0"
-	p = buf;
-	while (filamentsFound < maxFilaments &&	(p = strstr(p, filamentUsedStr2)) != nullptr)
+	const char* const filamentUsedStr2 = CommentKeyStrings[keyMaterialUsed];
+	p = keyPositions[keyMaterialUsed];
+	while (filamentsFound < maxFilaments && p != nullptr)
 	{
 		p += strlen(filamentUsedStr2);
 		const char *q;
@@ -698,14 +932,15 @@ unsigned int FileInfoParser::FindFilamentUsed(const char* buf, size_t len)
 				++filamentsFound;
 			}
 		}
+		p = strstr(p, filamentUsedStr2);
 	}
 
 	// Look for filament usage as generated by S3D
 	if (filamentsFound == 0)
 	{
-		const char *filamentLengthStr = "ilament length";	// comment string used by S3D
-		p = buf;
-		while (filamentsFound < maxFilaments &&	(p = strstr(p, filamentLengthStr)) != nullptr)
+		const char *filamentLengthStr = CommentKeyStrings[keyFilamentLength];
+		p = keyPositions[keyFilamentLength];
+		while (filamentsFound < maxFilaments && p != nullptr)
 		{
 			p += strlen(filamentLengthStr);
 			while(strchr(" :=\t", *p) != nullptr)
@@ -717,15 +952,16 @@ unsigned int FileInfoParser::FindFilamentUsed(const char* buf, size_t len)
 				parsedFileInfo.filamentNeeded[filamentsFound] = SafeStrtof(p, nullptr); // S3D reports filament usage in mm, no conversion needed
 				++filamentsFound;
 			}
+			p = strstr(p, filamentLengthStr);
 		}
 	}
 
 	// Look for filament usage as generated by recent KISSlicer versions
 	if (filamentsFound == 0)
 	{
-		const char *filamentLengthStr = ";    Ext ";
-		p = buf;
-		while (filamentsFound < maxFilaments && (p = strstr(p, filamentLengthStr)) != nullptr)
+		const char *filamentLengthStr = CommentKeyStrings[keyKisslicerExt];
+		p = keyPositions[keyKisslicerExt];
+		while (filamentsFound < maxFilaments && p != nullptr)
 		{
 			p += strlen(filamentLengthStr);
 			while(isdigit(*p))
@@ -742,14 +978,15 @@ unsigned int FileInfoParser::FindFilamentUsed(const char* buf, size_t len)
 				parsedFileInfo.filamentNeeded[filamentsFound] = SafeStrtof(p, nullptr);
 				++filamentsFound;
 			}
+			p = strstr(p, filamentLengthStr);
 		}
 	}
 
 	// Special case: Old KISSlicer only generates the filament volume, so we need to calculate the length from it
 	if (filamentsFound == 0)
 	{
-		const char *filamentVolumeStr = "; Estimated Build Volume: ";
-		p = strstr(buf, filamentVolumeStr);
+		const char *filamentVolumeStr = CommentKeyStrings[keyBuildVolume];
+		p = keyPositions[keyBuildVolume];
 		if (p != nullptr)
 		{
 			const float filamentCMM = SafeStrtof(p + strlen(filamentVolumeStr), nullptr) * 1000.0;
@@ -760,23 +997,15 @@ unsigned int FileInfoParser::FindFilamentUsed(const char* buf, size_t len)
 	return filamentsFound;
 }
 
-// Scan the buffer for the estimated print time
+// Scan the buffer for the estimated print time. The buffer is null-terminated and FindCommentKeys must have been called for it.
 bool FileInfoParser::FindPrintTime(const char* buf, size_t len)
 {
-	static const char* const PrintTimeStrings[] =
-	{
-		" estimated printing time",		// slic3r PE		"; estimated printing time = 1h 5m 24s"
-		";TIME",						// Cura				";TIME:38846"
-		" Build time"					// S3D				";   Build time: 0 hours 42 minutes"
-										// also KISSlicer	"; Estimated Build Time:   332.83 minutes"
-	};
-
-	for (const char * ptStr : PrintTimeStrings)
+	for (unsigned int key = keyPrintTimeSlic3r; key <= keyBuildTime; ++key)
 	{
-		const char* pos = strstr(buf, ptStr);
+		const char* pos = keyPositions[key];
 		if (pos != nullptr)
 		{
-			pos += strlen(ptStr);
+			pos += strlen(CommentKeyStrings[key]);
 			while (strchr(" \t=:", *pos))
 			{
 				++pos;
@@ -828,10 +1057,10 @@ bool FileInfoParser::FindPrintTime(const char* buf, size_t len)
 	return false;
 }
 
-// Scan the buffer for the simulated print time
+// Scan the buffer for the simulated print time. The buffer is null-terminated and FindCommentKeys must have been called for it.
 bool FileInfoParser::FindSimulatedTime(const char* buf, size_t len)
 {
-	const char* pos = strstr(buf, SimulatedTimeString);
+	const char* pos = keyPositions[keySimulatedTime];
 	if (pos != nullptr)
 	{
 		pos += strlen(SimulatedTimeString);
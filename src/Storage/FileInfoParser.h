@@ -62,11 +62,39 @@ public:
 	// The following method needs to be called until it returns true - this may take a few runs
 	bool GetFileInfo(const char *directory, const char *fileName, GCodeFileInfo& info, bool quitEarly);
 
+#if SUPPORT_FILE_INFO_INDEX
+	// Incremental parsing of a file as it is uploaded, so that we don't need to read it back afterwards
+	void StartScan();
+	void ScanData(const char *data, size_t len);
+	void FinishScan(time_t lastModifiedTime, GCodeFileInfo& info);
+#endif
+
+	static bool IsGCodeFile(const char *fileName);										// Return true if the file name has one of the extensions we parse
+
 	static constexpr const char* SimulatedTimeString = "\n; Simulated print time";	// used by FileInfoParser and MassStorage
 
 private:
+	// The strings in slicer comments that identify the file details. Where there is more than one string for a detail, they are in order of priority.
+	enum CommentKey : unsigned int
+	{
+		keyLayerHeightSlic3r = 0, keyLayerHeightCura, keyLayerHeightS3D, keyLayerHeightKisslicer, keyLayerHeightMatterControl,
+		keyGeneratedBy, keySlicedBy, keyKisslicer, keySlicedAt, keyGeneratedWith,
+		keyFilamentUsed, keyMaterialUsed, keyFilamentLength, keyKisslicerExt, keyBuildVolume,
+		keyPrintTimeSlic3r, keyPrintTimeCura, keyBuildTime,
+		keySimulatedTime,
+		NumCommentKeys
+	};
+
+	static constexpr uint32_t KeyRange(CommentKey first, CommentKey last) { return (((uint32_t)1 << (last + 1)) - 1) & ~(((uint32_t)1 << first) - 1); }
+	static constexpr uint32_t LayerHeightKeys = KeyRange(keyLayerHeightSlic3r, keyLayerHeightMatterControl);
+	static constexpr uint32_t SlicerKeys = KeyRange(keyGeneratedBy, keyGeneratedWith);
+	static constexpr uint32_t FilamentKeys = KeyRange(keyFilamentUsed, keyBuildVolume);
+	static constexpr uint32_t PrintTimeKeys = KeyRange(keyPrintTimeSlic3r, keyBuildTime);
+	static constexpr uint32_t SimulatedTimeKeys = KeyRange(keySimulatedTime, keySimulatedTime);
+	static const char * const CommentKeyStrings[];
 
 	// G-Code parser methods
+	void FindCommentKeys(const char *buf, uint32_t wantedKeys);
 	bool FindHeight(const char* buf, size_t len);
 	bool FindFirstLayerHeight(const char* buf, size_t len);
 	bool FindLayerHeight(const char* buf, size_t len);
@@ -74,6 +102,9 @@ private:
 	bool FindPrintTime(const char* buf, size_t len);
 	bool FindSimulatedTime(const char* buf, size_t len);
 	unsigned int FindFilamentUsed(const char* buf, size_t len);
+#if SUPPORT_FILE_INFO_INDEX
+	void ScanChunk(const char *buf, size_t len);
+#endif
 
 	// We parse G-Code files in multiple stages. These variables hold the required information
 	Mutex parserMutex;
@@ -86,6 +117,11 @@ private:
 	uint32_t lastFileParseTime;
 	uint32_t accumulatedParseTime, accumulatedReadTime, accumulatedSeekTime;
 	size_t fileOverlapLength;
+	const char *keyPositions[NumCommentKeys];			// where FindCommentKeys found each string in the buffer, or nullptr if it didn't
+#if SUPPORT_FILE_INFO_INDEX
+	FilePosition bytesScanned;							// how much of the file being uploaded we have scanned
+	bool scanFooterFilament, scanFooterLayerHeight, scanFooterPrintTime;	// which details we didn't find in the header of the file being uploaded
+#endif
 
 	// We used to allocate the following buffer on the stack; but now that this is called by more than one task
 	// it is more economical to allocate it permanently because that lets us use smaller stacks.
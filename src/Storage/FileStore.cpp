@@ -8,10 +8,12 @@
 #include "Libraries/Fatfs/diskio.h"
 
 uint32_t FileStore::longestWriteTime = 0;
+PoolStats FileStore::poolStats("files");
 
-FileStore::FileStore() : writeBuffer(nullptr)
+FileStore::FileStore() : writeBuffer(nullptr), clusterMap(nullptr)
 {
 	Init();
+	poolStats.Created(1);
 }
 
 void FileStore::Init()
@@ -19,6 +21,8 @@ void FileStore::Init()
 	usageMode = FileUseMode::free;
 	openCount = 0;
 	closeRequested = false;
+	preallocated = false;
+	readingAhead = false;
 }
 
 // Invalidate the file if it uses the specified FATFS object
@@ -38,6 +42,7 @@ bool FileStore::Invalidate(const FATFS *fs, bool doClose)
 				reprap.GetPlatform().GetMassStorage()->ReleaseWriteBuffer(writeBuffer);
 				writeBuffer = nullptr;
 			}
+			ReleaseClusterMap();
 		}
 		usageMode = FileUseMode::invalidated;
 		return true;
@@ -108,11 +113,39 @@ bool FileStore::Open(const char* directory, const char* fileName, OpenMode mode)
 		return false;
 	}
 	crc.Reset();
+	preallocated = readingAhead = false;
 	usageMode = (writing) ? FileUseMode::readWrite : FileUseMode::readOnly;
 	openCount = 1;
+	poolStats.Allocated();
 	return true;
 }
 
+// Open a file whose contents are held in a file cache.
+// This is protected - only MassStorage can access it.
+void FileStore::OpenCached(FileCache *p_cache, const char *data, size_t length)
+{
+	file.fs = nullptr;								// the file doesn't belong to any file system, so it doesn't get invalidated if the card is unmounted
+	cache = p_cache;
+	cachedData = data;
+	cachedLength = length;
+	cachedPosition = 0;
+	readingAhead = false;
+	crc.Reset();
+	usageMode = FileUseMode::cached;
+	openCount = 1;
+	poolStats.Allocated();
+}
+
+// Mark this file as free, updating the pool statistics if it was in use
+void FileStore::SetFree()
+{
+	if (usageMode != FileUseMode::free)
+	{
+		usageMode = FileUseMode::free;
+		poolStats.Released();
+	}
+}
+
 void FileStore::Duplicate()
 {
 	switch (usageMode)
@@ -123,6 +156,7 @@ void FileStore::Duplicate()
 
 	case FileUseMode::readOnly:
 	case FileUseMode::readWrite:
+	case FileUseMode::cached:
 		{
 			const irqflags_t flags = cpu_irq_save();
 			++openCount;
@@ -171,6 +205,25 @@ bool FileStore::Close()
 			}
 		}
 
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+	case FileUseMode::cached:
+		{
+			const irqflags_t flags = cpu_irq_save();
+			if (openCount > 1)
+			{
+				--openCount;
+			}
+			else
+			{
+				SetFree();
+				openCount = 0;
+				cache->ReleaseReader();
+			}
+			cpu_irq_restore(flags);
+			return true;
+		}
+#endif
+
 	case FileUseMode::invalidated:
 	default:
 		{
@@ -181,7 +234,7 @@ bool FileStore::Close()
 			}
 			else
 			{
-				usageMode = FileUseMode::free;
+				SetFree();
 			}
 			cpu_irq_restore(flags);
 			return true;
@@ -195,16 +248,22 @@ bool FileStore::ForceClose()
 	if (usageMode == FileUseMode::readWrite)
 	{
 		ok = Flush();
+		if (preallocated && file.fptr < file.fsize && f_truncate(&file) != FR_OK)		// release the space we allocated but didn't use
+		{
+			ok = false;
+		}
 	}
+	preallocated = false;
 
 	if (writeBuffer != nullptr)
 	{
 		reprap.GetPlatform().GetMassStorage()->ReleaseWriteBuffer(writeBuffer);
 		writeBuffer = nullptr;
 	}
+	ReleaseClusterMap();
 
 	const FRESULT fr = f_close(&file);
-	usageMode = FileUseMode::free;
+	SetFree();
 	closeRequested = false;
 	openCount = 0;
 	return ok && fr == FR_OK;
@@ -222,6 +281,10 @@ bool FileStore::Seek(FilePosition pos)
 	case FileUseMode::readWrite:
 		return f_lseek(&file, pos) == FR_OK;
 
+	case FileUseMode::cached:
+		cachedPosition = min<FilePosition>(pos, cachedLength);
+		return true;
+
 	case FileUseMode::invalidated:
 	default:
 		return false;
@@ -230,7 +293,13 @@ bool FileStore::Seek(FilePosition pos)
 
 FilePosition FileStore::Position() const
 {
-	return (usageMode == FileUseMode::readOnly || usageMode == FileUseMode::readWrite) ? file.fptr : 0;
+	if (readingAhead)
+	{
+		return readAheadPosition;
+	}
+	return (usageMode == FileUseMode::readOnly || usageMode == FileUseMode::readWrite) ? file.fptr
+			: (usageMode == FileUseMode::cached) ? cachedPosition
+				: 0;
 }
 
 uint32_t FileStore::ClusterSize() const
@@ -257,7 +326,13 @@ FilePosition FileStore::Length() const
 		return file.fsize;
 
 	case FileUseMode::readWrite:
-		return (writeBuffer != nullptr) ? file.fsize + writeBuffer->BytesStored() : file.fsize;
+		{
+			const FilePosition len = (preallocated) ? file.fptr : file.fsize;			// if we preallocated the file then its size is the amount written so far
+			return (writeBuffer != nullptr) ? len + writeBuffer->BytesStored() : len;
+		}
+
+	case FileUseMode::cached:
+		return cachedLength;
 
 	case FileUseMode::invalidated:
 	default:
@@ -293,6 +368,14 @@ int FileStore::Read(char* extBuf, size_t nBytes)
 			return (int)bytes_read;
 		}
 
+	case FileUseMode::cached:
+		{
+			const size_t bytesRead = min<size_t>(nBytes, cachedLength - cachedPosition);
+			memcpy(extBuf, cachedData + cachedPosition, bytesRead);
+			cachedPosition += bytesRead;
+			return (int)bytesRead;
+		}
+
 	case FileUseMode::invalidated:
 	default:
 		return -1;
@@ -375,7 +458,20 @@ bool FileStore::Write(const char *s, size_t len)
 			}
 			else
 			{
-				do
+				// If the buffer is empty and we have at least a whole buffer's worth of word-aligned data, write whole buffers' worth straight from the caller's data.
+				// This keeps the writes the same size and alignment as when we use the buffer, but saves copying the data.
+				if (writeBuffer->IsEmpty() && len >= FileWriteBufLen && ((reinterpret_cast<uint32_t>(s) & 3) == 0))
+				{
+					const size_t bytesToWrite = len - (len % FileWriteBufLen);
+					writeStatus = Store(s, bytesToWrite, &totalBytesWritten);
+					if (writeStatus != FR_OK || totalBytesWritten != bytesToWrite)
+					{
+						reprap.GetPlatform().MessageF(ErrorMessage, "Failed to write to file, error code %d. Card may be full.\n", (int)writeStatus);
+						return false;
+					}
+				}
+
+				while (writeStatus == FR_OK && totalBytesWritten != len)
 				{
 					size_t bytesStored = writeBuffer->Store(s + totalBytesWritten, len - totalBytesWritten);
 					if (writeBuffer->BytesLeft() == 0)
@@ -393,7 +489,6 @@ bool FileStore::Write(const char *s, size_t len)
 					}
 					totalBytesWritten += bytesStored;
 				}
-				while (writeStatus == FR_OK && totalBytesWritten != len);
 			}
 
 			if ((writeStatus != FR_OK) || (totalBytesWritten != len))
@@ -419,6 +514,7 @@ bool FileStore::Flush()
 		return false;
 
 	case FileUseMode::readOnly:
+	case FileUseMode::cached:
 		return true;
 
 	case FileUseMode::readWrite:
@@ -469,6 +565,20 @@ bool FileStore::Truncate()
 	}
 }
 
+// Allocate a contiguous block of clusters to an empty file that is about to be written, so that the file doesn't get fragmented
+// and FatFs doesn't need to update the FAT each time the file grows by a cluster. The data must be written sequentially.
+// When the file is closed it is truncated to the amount written. If there isn't a large enough free block then we return false
+// and the file grows a cluster at a time as usual.
+bool FileStore::Preallocate(FilePosition size)
+{
+	if (usageMode != FileUseMode::readWrite || size == 0)
+	{
+		return false;
+	}
+	preallocated = (f_expand(&file, size) == FR_OK);
+	return preallocated;
+}
+
 // Return the file write time in milliseconds, and clear it
 float FileStore::GetAndClearLongestWriteTime()
 {
@@ -483,12 +593,12 @@ unsigned int FileStore::GetAndClearMaxRetryCount()
 	return DiskioGetAndClearMaxRetryCount();
 }
 
-#if 0	// not currently used
-
-// Provide a cluster map for fast seeking. Needs _USE_FASTSEEK defined as 1 in conf_fatfs to make any difference.
-// The first element of the table must be set to the total number of 32-bit entries in the table before calling this.
-bool FileStore::SetClusterMap(uint32_t tbl[])
+// Use a cluster map for fast seeking, so that seeking in a large file doesn't need to follow the FAT chain from the start of the file.
+// Needs _USE_FASTSEEK defined as 1 in conf_fatfs. FatFs can't extend a file in fast seek mode, so we only do this for files opened for reading.
+// Return false if no cluster map is available or the file has too many fragments to fit in one, in which case seeking works as before.
+bool FileStore::EnableFastSeek()
 {
+#if _USE_FASTSEEK
 	switch (usageMode)
 	{
 	case FileUseMode::free:
@@ -496,20 +606,44 @@ bool FileStore::SetClusterMap(uint32_t tbl[])
 		return false;
 
 	case FileUseMode::readOnly:
-	case FileUseMode::readWrite:
+		if (clusterMap == nullptr)
 		{
-			file.cltbl = tbl;
+			clusterMap = reprap.GetPlatform().GetMassStorage()->AllocateClusterMap();
+			if (clusterMap == nullptr)
+			{
+				return false;
+			}
+
+			file.cltbl = clusterMap->Table();
 			const FRESULT ret = f_lseek(&file, CREATE_LINKMAP);
-//			debugPrintf("ret %d need %u\n", (int)ret, tbl[0]);
-			return ret == FR_OK;
+			if (ret != FR_OK)
+			{
+				// Most likely the file is too fragmented for the map. Creating the map doesn't move the file pointer, so we can carry on without it.
+				ReleaseClusterMap();
+				return false;
+			}
 		}
+		return true;
 
+	case FileUseMode::readWrite:
+	case FileUseMode::cached:
 	case FileUseMode::invalidated:
 	default:
 		return false;
 	}
+#else
+	return false;
+#endif
 }
 
-#endif
+void FileStore::ReleaseClusterMap()
+{
+	if (clusterMap != nullptr)
+	{
+		file.cltbl = nullptr;
+		reprap.GetPlatform().GetMassStorage()->ReleaseClusterMap(clusterMap);
+		clusterMap = nullptr;
+	}
+}
 
 // End
@@ -6,9 +6,12 @@
 #include "Core.h"
 #include "Libraries/Fatfs/ff.h"
 #include "CRC32.h"
+#include "Libraries/General/PoolStats.h"
 
 class Platform;
 class FileWriteBuffer;
+class ClusterMap;
+class FileCache;
 
 enum class OpenMode : uint8_t
 {
@@ -22,7 +25,8 @@ enum class FileUseMode : uint8_t
 	free,			// file object is free
 	readOnly,		// file object is in use for reading only
 	readWrite,		// file object is in use for reading and writing
-	invalidated		// file object is in use but file system has been invalidated
+	invalidated,	// file object is in use but file system has been invalidated
+	cached			// file object is in use for reading a file held in a file cache
 };
 
 class FileStore
@@ -52,30 +56,47 @@ public:
 	void Duplicate();								// Create a second reference to this file
 	bool Flush();									// Write remaining buffer data
 	bool Truncate();								// Truncate file at current file pointer
+	bool Preallocate(FilePosition size);			// Allocate contiguous space for an empty file that is about to be written sequentially
 	bool Invalidate(const FATFS *fs, bool doClose);	// Invalidate the file if it uses the specified FATFS object
 	bool IsOpenOn(const FATFS *fs) const;			// Return true if the file is open on the specified file system
 	uint32_t GetCRC32() const;
 
-#if 0	// not currently used
-	bool SetClusterMap(uint32_t[]);					// Provide a cluster map for fast seeking
-#endif
+	// While another task is reading ahead in this file on behalf of its owner, Position() returns the position at which the read started
+	void BeginReadAhead() { readAheadPosition = Position(); readingAhead = true; }
+	void EndReadAhead() { readingAhead = false; }
+
+	bool EnableFastSeek();							// Use a cluster map for fast seeking if one is available, returning true if successful
+	bool IsFastSeekEnabled() const { return clusterMap != nullptr; }
 	static float GetAndClearLongestWriteTime();		// Return the longest time it took to write a block to a file, in milliseconds
+	static uint32_t GetLongestWriteClocks() { return longestWriteTime; }	// Return the longest write time in step clocks without clearing it
 	static unsigned int GetAndClearMaxRetryCount();	// Return the highest SD card retry count that resulted in a successful transfer
 	friend class MassStorage;
 
 private:
 	void Init();
+	void SetFree();
+	void OpenCached(FileCache *p_cache, const char *data, size_t length);
+	void ReleaseClusterMap();
 	FRESULT Store(const char *s, size_t len, size_t *bytesWritten); // Write data to the non-volatile storage
 
     FIL file;
 	FileWriteBuffer *writeBuffer;
+	ClusterMap *clusterMap;							// The cluster map used for fast seeking, or nullptr
+	FileCache *cache;								// The cache that holds the file contents if usageMode is cached
+	const char *cachedData;							// The file contents if usageMode is cached
+	FilePosition cachedLength;
+	FilePosition cachedPosition;
+	FilePosition readAheadPosition;
 	volatile unsigned int openCount;
 	volatile bool closeRequested;
+	bool preallocated;								// True if we allocated the space for the file in advance, so we need to truncate it when we close it
+	volatile bool readingAhead;						// True if another task is reading the file, so Position() must return readAheadPosition
 	FileUseMode usageMode;
 
 	CRC32 crc;
 
 	static uint32_t longestWriteTime;
+	static PoolStats poolStats;						// usage of the FileStore objects that MassStorage owns
 };
 
 inline FileWriteBuffer *FileStore::GetWriteBuffer() const { return writeBuffer; }
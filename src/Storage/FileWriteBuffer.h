@@ -10,7 +10,12 @@
 
 #include "RepRapFirmware.h"
 
-#if SAM4E || SAM4S || SAME70
+// Each buffer is written to the card in one go when it is full. The buffers are a power of 2 long and files are written from the start,
+// so each write is a whole number of sectors on a sector boundary and doesn't straddle a cluster, which lets FatFs pass it to the card as one multi-block write.
+#if SAME70
+const size_t NumFileWriteBuffers = 2;					// Number of write buffers
+const size_t FileWriteBufLen = 32768;					// Size of each write buffer. Larger writes give better SD card write throughput, and we have plenty of RAM.
+#elif SAM4E || SAM4S
 const size_t NumFileWriteBuffers = 2;					// Number of write buffers
 const size_t FileWriteBufLen = 8192;					// Size of each write buffer
 #else
@@ -33,6 +38,7 @@ public:
 	const char *Data() const { return reinterpret_cast<const char *>(data32); }
 	const size_t BytesStored() const { return index; }
 	const size_t BytesLeft() const { return FileWriteBufLen - index; }
+	bool IsEmpty() const { return index == 0; }
 
 	size_t Store(const char *data, size_t length);			// Stores some data and returns how much could be stored
 	void DataTaken() { index = 0; }							// Called to indicate that the buffer has been written to the SD card
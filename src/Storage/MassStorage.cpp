@@ -3,6 +3,8 @@
 #include "RepRap.h"
 #include "sd_mmc.h"
 #include "RTOSIface.h"
+#include "StorageService.h"
+#include "Tasks.h"
 
 // A note on using mutexes:
 // Each SD card volume has its own mutex. There is also one for the file table, and one for the find first/find next buffer.
@@ -11,6 +13,7 @@
 // Any function that needs to acquire both the find buffer mutex and a volume mutex MUST take the find buffer mutex first, to avoid deadlocks.
 // No function should need to take both the file table mutex and the find buffer mutex.
 // No function in here should be called when the caller already owns the shared SPI mutex.
+// The recent files list has its own mutex, which may be taken while owning the file table mutex. It is held while the list is built using the find buffer.
 
 // Static helper functions - not declared as class members to avoid having to include sd_mmc.h everywhere
 static const char* TranslateCardType(card_type_t ct)
@@ -57,7 +60,13 @@ static const char* TranslateCardError(sd_mmc_err_t err)
 }
 
 // Mass Storage class
-MassStorage::MassStorage(Platform* p) : freeWriteBuffers(nullptr)
+MassStorage::MassStorage(Platform* p) : freeWriteBuffers(nullptr), freeClusterMaps(nullptr), writeBufferStats("file write buffers"), clusterMapStats("cluster maps")
+#if SUPPORT_MACRO_CACHE
+	, macroCache("Macro")
+#endif
+#if SUPPORT_WEB_FILE_CACHE
+	, webFileCache("Web file")
+#endif
 {
 }
 
@@ -70,10 +79,25 @@ void MassStorage::Init()
 	fsMutex.Create("FileSystem");
 	dirMutex.Create("DirSearch");
 
+	directoryChanges = 0;
+	extraFiles = nullptr;
+	numFiles = MAX_FILES;
+	for (ListingCursor& cursor : listingCursors)
+	{
+		cursor.index = 0;
+	}
+
 	for (size_t i = 0; i < NumFileWriteBuffers; ++i)
 	{
 		freeWriteBuffers = new FileWriteBuffer(freeWriteBuffers);
 	}
+	writeBufferStats.Created(NumFileWriteBuffers);
+
+	for (size_t i = 0; i < NumClusterMaps; ++i)
+	{
+		freeClusterMaps = new ClusterMap(freeClusterMaps);
+	}
+	clusterMapStats.Created(NumClusterMaps);
 
 	for (size_t card = 0; card < NumSdCards; ++card)
 	{
@@ -85,8 +109,19 @@ void MassStorage::Init()
 		inf.volMutex.Create(VolMutexNames[card]);
 	}
 
+#if SUPPORT_FILE_INFO_INDEX
+	uploadScannerInUse = false;
+#endif
+#if SUPPORT_MACRO_CACHE
+	macroCache.Allocate(MacroCacheSize, MaxCachedMacros, MaxCachedMacroSize);
+#endif
+
 	sd_mmc_init(SdWriteProtectPins, SdSpiCSPins);		// initialize SD MMC stack
 
+#if SUPPORT_STORAGE_TASK
+	StorageService::Init();
+#endif
+
 	// We no longer mount the SD card here because it may take a long time if it fails
 }
 
@@ -95,12 +130,14 @@ FileWriteBuffer *MassStorage::AllocateWriteBuffer()
 	MutexLocker lock(fsMutex);
 	if (freeWriteBuffers == nullptr)
 	{
+		writeBufferStats.Failed();
 		return nullptr;
 	}
 
 	FileWriteBuffer * const buffer = freeWriteBuffers;
 	freeWriteBuffers = buffer->Next();
 	buffer->SetNext(nullptr);
+	writeBufferStats.Allocated();
 	return buffer;
 }
 
@@ -109,20 +146,150 @@ void MassStorage::ReleaseWriteBuffer(FileWriteBuffer *buffer)
 	MutexLocker lock(fsMutex);
 	buffer->SetNext(freeWriteBuffers);
 	freeWriteBuffers = buffer;
+	writeBufferStats.Released();
+}
+
+ClusterMap *MassStorage::AllocateClusterMap()
+{
+	MutexLocker lock(fsMutex);
+	ClusterMap * const map = freeClusterMaps;
+	if (map != nullptr)
+	{
+		freeClusterMaps = map->Next();
+		map->SetNext(nullptr);
+		clusterMapStats.Allocated();
+	}
+	else
+	{
+		clusterMapStats.Failed();
+	}
+	return map;
+}
+
+void MassStorage::ReleaseClusterMap(ClusterMap *map)
+{
+	MutexLocker lock(fsMutex);
+	map->SetNext(freeClusterMaps);
+	freeClusterMaps = map;
+	clusterMapStats.Released();
+}
+
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+
+// Skip the volume specifier if it is the default volume
+static inline const char *SkipDefaultVolume(const char *path)
+{
+	return (path[0] == '0' && path[1] == ':') ? path + 2 : path;
 }
 
-FileStore* MassStorage::OpenFile(const char* directory, const char* fileName, OpenMode mode)
+// Return the cache that should hold the specified file, or nullptr if it isn't cacheable. Called with the mutex owned.
+FileCache *MassStorage::GetCache(const char *location)
+{
+#if SUPPORT_WEB_FILE_CACHE
+	if (StringStartsWith(SkipDefaultVolume(location), SkipDefaultVolume(reprap.GetPlatform().GetWebDir())))
+	{
+		return (webFileCache.IsAllocated()) ? &webFileCache : nullptr;		// don't let web files push macros out of the macro cache
+	}
+#endif
+#if SUPPORT_MACRO_CACHE
+	return &macroCache;
+#else
+	return nullptr;
+#endif
+}
+
+// Forget a file in any cache that may hold it because it is being changed or deleted. Called with the mutex owned.
+void MassStorage::InvalidateCaches(const char *location)
+{
+#if SUPPORT_MACRO_CACHE
+	macroCache.Invalidate(location);
+#endif
+#if SUPPORT_WEB_FILE_CACHE
+	webFileCache.Invalidate(location);
+#endif
+}
+
+// Forget all cached files. Called with the mutex owned.
+void MassStorage::InvalidateAllCaches()
+{
+#if SUPPORT_MACRO_CACHE
+	macroCache.InvalidateAll();
+#endif
+#if SUPPORT_WEB_FILE_CACHE
+	webFileCache.InvalidateAll();
+#endif
+}
+
+#endif
+
+// Open a file. If 'useCache' is true and we are opening the file for reading, the file may be read from the macro or web file cache instead of the SD card.
+FileStore* MassStorage::OpenFile(const char* directory, const char* fileName, OpenMode mode, bool useCache)
 {
 	{
 		MutexLocker lock(fsMutex);
-		for (size_t i = 0; i < MAX_FILES; i++)
+		for (size_t i = 0; i < numFiles; i++)
 		{
-			if (files[i].usageMode == FileUseMode::free)
+			FileStore& fil = GetFile(i);
+			if (fil.usageMode == FileUseMode::free)
 			{
-				return (files[i].Open(directory, fileName, mode)) ? &files[i]: nullptr;
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE || SUPPORT_WEB_FILE_TABLE || SUPPORT_RECENT_FILES
+				String<MaxFilenameLength> location;
+				CombineName(location.GetRef(), directory, fileName);
+#endif
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+				FileCache * const cache = (useCache && mode == OpenMode::read) ? GetCache(location.c_str()) : nullptr;
+				if (mode != OpenMode::read)
+				{
+					InvalidateCaches(location.c_str());
+				}
+				else if (cache != nullptr)
+				{
+					size_t length;
+					const char * const data = cache->Find(location.c_str(), length);
+					if (data != nullptr)
+					{
+						fil.OpenCached(cache, data, length);
+						cache->AddReader();
+						return &fil;
+					}
+				}
+#endif
+				if (mode != OpenMode::read)
+				{
+					DirectoryChanged();						// we may be creating a file
+#if SUPPORT_WEB_FILE_TABLE
+					webFileTable.FileChanged(location.c_str());
+#endif
+				}
+				if (!fil.Open(directory, fileName, mode))
+				{
+					return nullptr;
+				}
+#if SUPPORT_RECENT_FILES
+				if (mode != OpenMode::read)
+				{
+					recentFiles.FileWritten(location.c_str());
+				}
+#endif
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+				if (cache != nullptr && fil.Length() <= cache->GetMaxFileSize())
+				{
+					// Web clients use the timestamp to check whether their copy of the file is up to date, so we keep it with the cached copy
+					time_t lastModified = 0;
+# if SUPPORT_WEB_FILE_CACHE
+					if (cache == &webFileCache)
+					{
+						lastModified = GetLastModifiedTime(nullptr, location.c_str());
+					}
+# endif
+					cache->Add(location.c_str(), &fil, lastModified);
+				}
+#endif
+				return &fil;
 			}
 		}
 	}
+	FileStore::poolStats.Failed();
 	reprap.GetPlatform().Message(ErrorMessage, "Max open file count exceeded.\n");
 	return nullptr;
 }
@@ -131,8 +298,9 @@ FileStore* MassStorage::OpenFile(const char* directory, const char* fileName, Op
 void MassStorage::CloseAllFiles()
 {
 	MutexLocker lock(fsMutex);
-	for (FileStore& f : files)
+	for (size_t i = 0; i < numFiles; ++i)
 	{
+		FileStore& f = GetFile(i);
 		while (f.usageMode != FileUseMode::free)
 		{
 			f.Close();
@@ -208,6 +376,8 @@ bool MassStorage::FindFirst(const char *directory, FileInfo &file_info)
 	FRESULT res = f_opendir(&findDir, loc.c_str());
 	if (res == FR_OK)
 	{
+		findDirectory.copy(loc.c_str());
+		findDirBefore = findDir;
 		FILINFO entry;
 		entry.lfname = file_info.fileName;
 		entry.lfsize = ARRAY_SIZE(file_info.fileName);
@@ -224,6 +394,9 @@ bool MassStorage::FindFirst(const char *directory, FileInfo &file_info)
 			{
 				SafeStrncpy(file_info.fileName, entry.fname, ARRAY_SIZE(file_info.fileName));
 			}
+#if SUPPORT_FILE_INFO_INDEX
+			if (StringEquals(file_info.fileName, FILE_INFO_INDEX_FILE)) continue;		// don't list our index of G-code file information
+#endif
 
 			file_info.size = entry.fsize;
 			file_info.lastModified = ConvertTimeStamp(entry.fdate, entry.ftime);
@@ -250,21 +423,29 @@ bool MassStorage::FindNext(FileInfo &file_info)
 	entry.lfsize = ARRAY_SIZE(file_info.fileName);
 
 	findDir.lfn = nullptr;
-	if (f_readdir(&findDir, &entry) != FR_OK || entry.fname[0] == 0)
+	findDirBefore = findDir;
+	for (;;)
 	{
-		//f_closedir(findDir);
-		dirMutex.Release();
-		return false;
+		if (f_readdir(&findDir, &entry) != FR_OK || entry.fname[0] == 0)
+		{
+			//f_closedir(findDir);
+			dirMutex.Release();
+			return false;
+		}
+
+		if (file_info.fileName[0] == 0)
+		{
+			SafeStrncpy(file_info.fileName, entry.fname, ARRAY_SIZE(file_info.fileName));
+		}
+#if SUPPORT_FILE_INFO_INDEX
+		if (StringEquals(file_info.fileName, FILE_INFO_INDEX_FILE)) continue;		// don't list our index of G-code file information
+#endif
+		break;
 	}
 
 	file_info.isDirectory = (entry.fattrib & AM_DIR);
 	file_info.size = entry.fsize;
 
-	if (file_info.fileName[0] == 0)
-	{
-		SafeStrncpy(file_info.fileName, entry.fname, ARRAY_SIZE(file_info.fileName));
-	}
-
 	file_info.lastModified = ConvertTimeStamp(entry.fdate, entry.ftime);
 	return true;
 }
@@ -278,6 +459,69 @@ void MassStorage::AbandonFindNext()
 	}
 }
 
+// Quit searching for files, but save the position of the entry that FindFirst or FindNext last returned as entry 'index' of the listing,
+// so that a request for the next page of the listing can start from it by calling ResumeListing.
+void MassStorage::SaveListingPosition(unsigned int index)
+{
+	if (dirMutex.GetHolder() == RTOSIface::GetCurrentTask())
+	{
+		// Replace the saved position for this directory if there is one, else the oldest one
+		ListingCursor *cursor = &listingCursors[0];
+		for (ListingCursor& c : listingCursors)
+		{
+			if (c.index != 0 && StringEquals(c.directory.c_str(), findDirectory.c_str()))
+			{
+				cursor = &c;
+				break;
+			}
+			if (c.index == 0 || (cursor->index != 0 && c.whenSaved < cursor->whenSaved))
+			{
+				cursor = &c;
+			}
+		}
+
+		cursor->directory.copy(findDirectory.c_str());
+		cursor->position = findDirBefore;
+		cursor->directoryChanges = directoryChanges;
+		cursor->whenSaved = millis();
+		cursor->index = index;
+		dirMutex.Release();
+	}
+}
+
+// Start listing a directory at entry number 'index', which must be nonzero. This works only if we saved the position of that entry
+// when an earlier listing of the same directory stopped there, and nothing has changed the directory since.
+// If we return true then we have read the entry and we hold the mutex, just as if FindFirst and FindNext had been called to get to it.
+bool MassStorage::ResumeListing(const char *directory, unsigned int index, FileInfo &file_info)
+{
+	String<MaxFilenameLength> loc;
+	loc.copy(directory);
+	const size_t len = loc.strlen();
+	if (len != 0 && (loc[len - 1] == '/' || loc[len - 1] == '\\'))
+	{
+		loc.Truncate(len - 1);
+	}
+
+	if (!dirMutex.Take(10000))
+	{
+		return false;
+	}
+
+	for (ListingCursor& cursor : listingCursors)
+	{
+		if (cursor.index == index && index != 0 && cursor.directoryChanges == directoryChanges && StringEquals(cursor.directory.c_str(), loc.c_str()))
+		{
+			cursor.index = 0;							// each saved position is only used once, because the next page saves a new one
+			findDirectory.copy(loc.c_str());
+			findDir = cursor.position;
+			return FindNext(file_info);					// this releases the mutex if it fails, e.g. because the card has been remounted
+		}
+	}
+
+	dirMutex.Release();
+	return false;
+}
+
 // Month names. The first entry is used for invalid month numbers.
 static const char *monthNames[13] = { "???", "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
 
@@ -304,8 +548,9 @@ bool MassStorage::Delete(const char* directory, const char* fileName, bool silen
 		const FRESULT openReturn = f_open(&file, location.c_str(), FA_OPEN_EXISTING | FA_READ);
 		if (openReturn == FR_OK)
 		{
-			for (const FileStore& fil : files)
+			for (size_t i = 0; i < numFiles; ++i)
 			{
+				const FileStore& fil = GetFile(i);
 				if (fil.file.fs == file.fs && fil.file.dir_sect == file.dir_sect && fil.file.dir_ptr == file.dir_ptr )
 				{
 					reprap.GetPlatform().MessageF(ErrorMessage, "Cannot delete file %s because it is open\n", location.c_str());
@@ -317,6 +562,13 @@ bool MassStorage::Delete(const char* directory, const char* fileName, bool silen
 		}
 
 		unlinkReturn = f_unlink(location.c_str());
+		DirectoryChanged();
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+		InvalidateCaches(location.c_str());
+#endif
+#if SUPPORT_WEB_FILE_TABLE
+		webFileTable.FileChanged(location.c_str());
+#endif
 	}
 
 	if (unlinkReturn != FR_OK)
@@ -327,14 +579,85 @@ bool MassStorage::Delete(const char* directory, const char* fileName, bool silen
 		}
 		return false;
 	}
+#if SUPPORT_RECENT_FILES
+	recentFiles.FileRemoved(location.c_str());
+#endif
 	return true;
 }
 
+#if SUPPORT_WEB_FILE_TABLE
+
+// Return which versions of a file in the web directory exist, as a combination of WebFileTable::PlainFileExists and WebFileTable::GzipFileExists.
+// If we don't already know, read the directory once to look for both versions.
+unsigned int MassStorage::FindWebFile(const char *fileName)
+{
+	String<MaxFilenameLength> location;
+	CombineName(location.GetRef(), reprap.GetPlatform().GetWebDir(), fileName);
+	uint32_t changesBefore;
+	{
+		MutexLocker lock(fsMutex);
+		unsigned int variants;
+		if (webFileTable.Find(location.c_str(), variants))
+		{
+			return variants;
+		}
+		changesBefore = directoryChanges;
+	}
+
+	const char * const lastSlash = strrchr(location.c_str(), '/');
+	if (lastSlash == nullptr || lastSlash[1] == 0)
+	{
+		return 0;
+	}
+	String<MaxFilenameLength> gzName;
+	gzName.copy(lastSlash + 1);
+	gzName.cat(".gz");
+	String<MaxFilenameLength> dir;
+	dir.copy(location.c_str());
+	dir.Truncate(lastSlash - location.c_str());
+
+	unsigned int variants = 0;
+	DIR searchDir;
+	searchDir.lfn = nullptr;
+	if (f_opendir(&searchDir, dir.c_str()) == FR_OK)
+	{
+		char longName[MaxFilenameLength];
+		FILINFO entry;
+		entry.lfname = longName;
+		entry.lfsize = ARRAY_SIZE(longName);
+		while (f_readdir(&searchDir, &entry) == FR_OK && entry.fname[0] != 0)
+		{
+			if ((entry.fattrib & AM_DIR) == 0)
+			{
+				const char * const name = (longName[0] != 0) ? longName : entry.fname;
+				if (StringEquals(name, lastSlash + 1))
+				{
+					variants |= WebFileTable::PlainFileExists;
+				}
+				else if (StringEquals(name, gzName.c_str()))
+				{
+					variants |= WebFileTable::GzipFileExists;
+				}
+			}
+		}
+	}
+
+	MutexLocker lock(fsMutex);
+	if (directoryChanges == changesBefore)					// if a file was created, deleted or renamed while we were reading the directory then our result may be stale
+	{
+		webFileTable.Add(location.c_str(), variants);
+	}
+	return variants;
+}
+
+#endif
+
 // Create a new directory
 bool MassStorage::MakeDirectory(const char *parentDir, const char *dirName)
 {
 	String<MaxFilenameLength> location;
 	CombineName(location.GetRef(), parentDir, dirName);
+	DirectoryChanged();
 	if (f_mkdir(location.c_str()) != FR_OK)
 	{
 		reprap.GetPlatform().MessageF(ErrorMessage, "Failed to create directory %s\n", location.c_str());
@@ -345,6 +668,7 @@ bool MassStorage::MakeDirectory(const char *parentDir, const char *dirName)
 
 bool MassStorage::MakeDirectory(const char *directory)
 {
+	DirectoryChanged();
 	if (f_mkdir(directory) != FR_OK)
 	{
 		reprap.GetPlatform().MessageF(ErrorMessage, "Failed to create directory %s\n", directory);
@@ -363,11 +687,30 @@ bool MassStorage::Rename(const char *oldFilename, const char *newFilename)
 		// We are assuming that the user isn't really trying to rename across volumes. This is a safe assumption when the client is DWC.
 		newFilename += 2;
 	}
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE || SUPPORT_WEB_FILE_TABLE
+	{
+		MutexLocker lock(fsMutex);
+# if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+		InvalidateAllCaches();					// a directory may have been renamed, so we can't just invalidate the old and new names
+# endif
+# if SUPPORT_WEB_FILE_TABLE
+		webFileTable.Invalidate();
+# endif
+	}
+#endif
+	DirectoryChanged();
 	if (f_rename(oldFilename, newFilename) != FR_OK)
 	{
 		reprap.GetPlatform().MessageF(ErrorMessage, "Failed to rename file or directory %s to %s\n", oldFilename, newFilename);
 		return false;
 	}
+#if SUPPORT_RECENT_FILES
+	recentFiles.FileRemoved(oldFilename);
+	if (!DirectoryExists(newFilename))
+	{
+		recentFiles.FileChanged(newFilename, GetLastModifiedTime(nullptr, newFilename));
+	}
+#endif
 	return true;
 }
 
@@ -423,6 +766,13 @@ time_t MassStorage::GetLastModifiedTime(const char* directory, const char *fileN
 {
 	String<MaxFilenameLength> location;
 	CombineName(location.GetRef(), directory, fileName);
+#if SUPPORT_WEB_FILE_CACHE
+	time_t cachedTime;
+	if (webFileCache.GetLastModifiedTime(location.c_str(), cachedTime))
+	{
+		return cachedTime;						// saves reading the directory when a web client checks whether its copy of a file is up to date
+	}
+#endif
 	FILINFO fil;
 	fil.lfname = nullptr;
 	if (f_stat(location.c_str(), &fil) == FR_OK)
@@ -440,11 +790,23 @@ bool MassStorage::SetLastModifiedTime(const char* directory, const char *fileNam
 	FILINFO fno;
     fno.fdate = (WORD)(((timeInfo->tm_year - 80) * 512U) | (timeInfo->tm_mon + 1) * 32U | timeInfo->tm_mday);
     fno.ftime = (WORD)(timeInfo->tm_hour * 2048U | timeInfo->tm_min * 32U | timeInfo->tm_sec / 2U);
+#if SUPPORT_WEB_FILE_CACHE
+	{
+		MutexLocker lock(fsMutex);
+		webFileCache.Invalidate(location.c_str());			// the cached copy holds the old timestamp
+	}
+#endif
     const bool ok = (f_utime(location.c_str(), &fno) == FR_OK);
     if (!ok)
 	{
 		reprap.GetPlatform().MessageF(ErrorMessage, "Failed to set last modified time for file '%s'\n", location.c_str());
 	}
+#if SUPPORT_RECENT_FILES
+    else
+    {
+        recentFiles.FileChanged(location.c_str(), time);
+    }
+#endif
     return ok;
 }
 
@@ -568,9 +930,9 @@ bool MassStorage::CheckDriveMounted(const char* path)
 bool MassStorage::AnyFileOpen(const FATFS *fs) const
 {
 	MutexLocker lock(fsMutex);
-	for (const FileStore & fil : files)
+	for (size_t i = 0; i < numFiles; ++i)
 	{
-		if (fil.IsOpenOn(fs))
+		if (GetFile(i).IsOpenOn(fs))
 		{
 			return true;
 		}
@@ -583,9 +945,9 @@ unsigned int MassStorage::InvalidateFiles(const FATFS *fs, bool doClose)
 {
 	unsigned int invalidated = 0;
 	MutexLocker lock(fsMutex);
-	for (FileStore & fil : files)
+	for (size_t i = 0; i < numFiles; ++i)
 	{
-		if (fil.Invalidate(fs, doClose))
+		if (GetFile(i).Invalidate(fs, doClose))
 		{
 			++invalidated;
 		}
@@ -620,6 +982,16 @@ unsigned int MassStorage::InternalUnmount(size_t card, bool doClose)
 	MutexLocker lock1(fsMutex);
 	MutexLocker lock2(inf.volMutex);
 	const unsigned int invalidated = InvalidateFiles(&inf.fileSystem, doClose);
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+	InvalidateAllCaches();
+#endif
+#if SUPPORT_WEB_FILE_TABLE
+	webFileTable.Invalidate();
+#endif
+#if SUPPORT_RECENT_FILES
+	recentFiles.Invalidate();
+#endif
+	DirectoryChanged();
 	f_mount(card, nullptr);
 	memset(&inf.fileSystem, 0, sizeof(inf.fileSystem));
 	sd_mmc_unmount(card);
@@ -627,13 +999,80 @@ unsigned int MassStorage::InternalUnmount(size_t card, bool doClose)
 	return invalidated;
 }
 
+// Increase the number of files that can be open at once. Files that are already open may be in use, so we can't move them to a larger table.
+// Instead we allocate the additional files separately. We only allow this to be done once, normally in config.g, and the extra files are never freed.
+GCodeResult MassStorage::SetNumFiles(size_t newNumFiles, const StringRef& reply)
+{
+	constexpr uint32_t MinRamToLeaveFree = 8 * 1024;			// a margin for network buffers and task stacks that are allocated later
+
+	if (newNumFiles == numFiles)
+	{
+		return GCodeResult::ok;
+	}
+	if (newNumFiles < numFiles)
+	{
+		reply.copy("The number of files can only be increased");
+		return GCodeResult::error;
+	}
+	if (extraFiles != nullptr)
+	{
+		reply.copy("The number of files has already been increased");
+		return GCodeResult::error;
+	}
+
+	const uint32_t ramNeeded = (newNumFiles - MAX_FILES) * sizeof(FileStore);
+	if (ramNeeded + MinRamToLeaveFree > Tasks::GetNeverUsedRam())
+	{
+		reply.printf("Not enough free RAM, %" PRIu32 " bytes needed", ramNeeded + MinRamToLeaveFree);
+		return GCodeResult::error;
+	}
+
+	FileStore * const newFiles = new FileStore[newNumFiles - MAX_FILES];
+	MutexLocker lock(fsMutex);
+	extraFiles = newFiles;
+	numFiles = newNumFiles;
+	return GCodeResult::ok;
+}
+
+#if SUPPORT_WEB_FILE_CACHE
+
+// Allocate the web file cache. Like the extra file objects, the memory is never freed, so this can only be done once.
+GCodeResult MassStorage::AllocateWebFileCache(size_t size, size_t maxFiles, size_t maxFileSize, const StringRef& reply)
+{
+	constexpr uint32_t MinRamToLeaveFree = 8 * 1024;			// a margin for network buffers and task stacks that are allocated later
+
+	if (webFileCache.IsAllocated())
+	{
+		reply.copy("The web file cache has already been allocated");
+		return GCodeResult::error;
+	}
+	if (size == 0 || maxFiles == 0)
+	{
+		reply.copy("Invalid web file cache size");
+		return GCodeResult::error;
+	}
+
+	const uint32_t ramNeeded = FileCache::RamNeeded(size, maxFiles);
+	if (ramNeeded + MinRamToLeaveFree > Tasks::GetNeverUsedRam())
+	{
+		reply.printf("Not enough free RAM, %" PRIu32 " bytes needed", ramNeeded + MinRamToLeaveFree);
+		return GCodeResult::error;
+	}
+
+	MutexLocker lock(fsMutex);
+	webFileCache.Allocate(size, maxFiles, maxFileSize);
+	return GCodeResult::ok;
+}
+
+#endif
+
 unsigned int MassStorage::GetNumFreeFiles() const
 {
 	unsigned int numFreeFiles = 0;
 	MutexLocker lock(fsMutex);
-	for (const FileStore & fil : files)
+	for (size_t i = 0; i < numFiles; ++i)
 	{
-		if (fil.usageMode == FileUseMode::free)
+		if (GetFile(i).usageMode == FileUseMode::free)
 		{
 			++numFreeFiles;
 		}
@@ -703,8 +1142,9 @@ void MassStorage::Spin()
 	// Check if any files are supposed to be closed
 	{
 		MutexLocker lock(fsMutex);
-		for (FileStore & fil : files)
+		for (size_t i = 0; i < numFiles; ++i)
 		{
+			FileStore& fil = GetFile(i);
 			if (fil.closeRequested)
 			{
 				// We cannot do this in ISRs, so do it here
@@ -715,6 +1155,48 @@ void MassStorage::Spin()
 }
 
 // Append the simulated printing time to the end of the file
+#if SUPPORT_FILE_INFO_INDEX
+
+// Get the parser for a file being uploaded. We only have one, so if more than one G-code file is being uploaded at the same time, the others get parsed later when asked for.
+FileInfoParser *MassStorage::ClaimUploadScanner()
+{
+	TaskCriticalSectionLocker lock;
+	if (uploadScannerInUse)
+	{
+		return nullptr;
+	}
+	uploadScannerInUse = true;
+	return &uploadScanner;
+}
+
+#endif
+
+#if SUPPORT_RECENT_FILES
+
+// Get the details of the index'th most recently modified file in the G-code files directory, returning false if there aren't that many files
+bool MassStorage::GetRecentFile(size_t index, FileInfo& file_info)
+{
+	String<MaxFilenameLength> fileName, location;
+	for (size_t attempts = 0; attempts < RecentFiles::MaxFiles && recentFiles.GetFileName(index, fileName.GetRef()); ++attempts)
+	{
+		CombineName(location.GetRef(), reprap.GetPlatform().GetGCodeDir(), fileName.c_str());
+		FILINFO fil;
+		fil.lfname = nullptr;
+		if (f_stat(location.c_str(), &fil) == FR_OK)
+		{
+			file_info.isDirectory = false;
+			SafeStrncpy(file_info.fileName, fileName.c_str(), ARRAY_SIZE(file_info.fileName));
+			file_info.size = fil.fsize;
+			file_info.lastModified = ConvertTimeStamp(fil.fdate, fil.ftime);
+			return true;
+		}
+		recentFiles.FileRemoved(location.c_str());						// the file has gone without us knowing, so forget it and try again
+	}
+	return false;
+}
+
+#endif
+
 void MassStorage::RecordSimulationTime(const char *printingFilename, uint32_t simSeconds)
 {
 	const char * const GCodeDir = reprap.GetPlatform().GetGCodeDir();
@@ -760,6 +1242,9 @@ void MassStorage::RecordSimulationTime(const char *printingFilename, uint32_t si
 		{
 			ok = SetLastModifiedTime(GCodeDir, printingFilename, lastModtime);
 		}
+#if SUPPORT_FILE_INFO_INDEX
+		fileInfoIndex.Invalidate(GCodeDir, printingFilename);				// the file may have the same size and modification time as before, so its index entry may look up to date
+#endif
 	}
 
 	if (!ok)
@@ -4,10 +4,15 @@
 #include "RepRapFirmware.h"
 #include "Pins.h"
 #include "FileWriteBuffer.h"
+#include "ClusterMap.h"
 #include "Libraries/Fatfs/ff.h"
 #include "GCodes/GCodeResult.h"
 #include "FileStore.h"
 #include "FileInfoParser.h"
+#include "FileCache.h"
+#include "WebFileTable.h"
+#include "FileInfoIndex.h"
+#include "RecentFiles.h"
 
 #include <ctime>
 
@@ -25,10 +30,12 @@ struct FileInfo
 class MassStorage
 {
 public:
-	FileStore* OpenFile(const char* directory, const char* fileName, OpenMode mode);
+	FileStore* OpenFile(const char* directory, const char* fileName, OpenMode mode, bool useCache = false);
 	bool FindFirst(const char *directory, FileInfo &file_info);
 	bool FindNext(FileInfo &file_info);
 	void AbandonFindNext();
+	bool ResumeListing(const char *directory, unsigned int index, FileInfo &file_info);	// Like FindFirst, but start at an entry whose position we saved
+	void SaveListingPosition(unsigned int index);										// Like AbandonFindNext, but save the position of the entry just found
 	const char* GetMonthName(const uint8_t month);
 	static void CombineName(const StringRef& out, const char* directory, const char* fileName);
 	bool Delete(const char* directory, const char* fileName, bool silent = false);
@@ -51,10 +58,30 @@ public:
 	bool AnyFileOpen(const FATFS *fs) const;										// Return true if any files are open on the file system
 	void CloseAllFiles();
 	unsigned int GetNumFreeFiles() const;
+	size_t GetNumFiles() const { return numFiles; }
+	GCodeResult SetNumFiles(size_t newNumFiles, const StringRef& reply);			// Increase the number of files that can be open at once
 	void Spin();
 	const Mutex& GetVolumeMutex(size_t vol) const { return info[vol].volMutex; }
 	bool GetFileInfo(const char *directory, const char *fileName, GCodeFileInfo& info, bool quitEarly) { return infoParser.GetFileInfo(directory, fileName, info, quitEarly); }
 	void RecordSimulationTime(const char *printingFilename, uint32_t simSeconds);	// Append the simulated printing time to the end of the file
+#if SUPPORT_MACRO_CACHE
+	FileCache& GetMacroCache() { return macroCache; }
+#endif
+#if SUPPORT_WEB_FILE_CACHE
+	FileCache& GetWebFileCache() { return webFileCache; }
+	GCodeResult AllocateWebFileCache(size_t size, size_t maxFiles, size_t maxFileSize, const StringRef& reply);	// Start caching web interface files
+#endif
+#if SUPPORT_WEB_FILE_TABLE
+	unsigned int FindWebFile(const char *fileName);								// Return which versions of a web interface file exist
+#endif
+#if SUPPORT_FILE_INFO_INDEX
+	FileInfoIndex& GetFileInfoIndex() { return fileInfoIndex; }
+	FileInfoParser *ClaimUploadScanner();									// Get the parser for a file being uploaded, or nullptr if another upload is using it
+	void ReleaseUploadScanner() { uploadScannerInUse = false; }
+#endif
+#if SUPPORT_RECENT_FILES
+	bool GetRecentFile(size_t index, FileInfo& file_info);						// Get the details of the index'th most recently modified G-code file
+#endif
 
 	enum class InfoResult : uint8_t
 	{
@@ -74,6 +101,8 @@ protected:
 
 	FileWriteBuffer *AllocateWriteBuffer();
 	void ReleaseWriteBuffer(FileWriteBuffer *buffer);
+	ClusterMap *AllocateClusterMap();
+	void ReleaseClusterMap(ClusterMap *map);
 
 private:
 	enum class CardDetectState : uint8_t
@@ -96,8 +125,28 @@ private:
 		CardDetectState cardState;
 	};
 
+	// A saved position in a directory listing, so that a client fetching a long listing a page at a time doesn't make us read the directory from the start for each page
+	struct ListingCursor
+	{
+		String<MaxFilenameLength> directory;
+		DIR position;									// the directory object positioned just before the entry
+		uint32_t directoryChanges;						// the value of directoryChanges when we saved the position
+		uint32_t whenSaved;								// when we saved it, in milliseconds
+		unsigned int index;								// the position of the entry in the listing, or zero if this cursor is not in use
+	};
+
+	static constexpr size_t NumListingCursors = 2;		// enough for a web client and PanelDue to be listing files at the same time
+
 	unsigned int InternalUnmount(size_t card, bool doClose);
 	static time_t ConvertTimeStamp(uint16_t fdate, uint16_t ftime);
+#if SUPPORT_MACRO_CACHE || SUPPORT_WEB_FILE_CACHE
+	FileCache *GetCache(const char *location);
+	void InvalidateCaches(const char *location);
+	void InvalidateAllCaches();
+#endif
+	void DirectoryChanged() { ++directoryChanges; }
+	FileStore& GetFile(size_t i) { return (i < MAX_FILES) ? files[i] : extraFiles[i - MAX_FILES]; }
+	const FileStore& GetFile(size_t i) const { return (i < MAX_FILES) ? files[i] : extraFiles[i - MAX_FILES]; }
 
 	SdCardInfo info[NumSdCards];
 
@@ -105,8 +154,33 @@ private:
 
 	FileInfoParser infoParser;
 	DIR findDir;
+	DIR findDirBefore;									// findDir before we read the entry that FindFirst or FindNext last returned
+	String<MaxFilenameLength> findDirectory;			// the directory that we are searching
+	ListingCursor listingCursors[NumListingCursors];
+	uint32_t directoryChanges;							// incremented whenever we may have changed a directory, so that we know when the saved positions are stale
 	FileWriteBuffer *freeWriteBuffers;
+	ClusterMap *freeClusterMaps;
+	PoolStats writeBufferStats, clusterMapStats;
 	FileStore files[MAX_FILES];
+	FileStore *extraFiles;								// the file objects added by M939, or nullptr
+	size_t numFiles;									// the total number of file objects
+#if SUPPORT_MACRO_CACHE
+	FileCache macroCache;
+#endif
+#if SUPPORT_WEB_FILE_CACHE
+	FileCache webFileCache;								// copies of web interface files, allocated by M940
+#endif
+#if SUPPORT_WEB_FILE_TABLE
+	WebFileTable webFileTable;
+#endif
+#if SUPPORT_FILE_INFO_INDEX
+	FileInfoIndex fileInfoIndex;
+	FileInfoParser uploadScanner;						// parses G-code files as they are uploaded
+	bool uploadScannerInUse;
+#endif
+#if SUPPORT_RECENT_FILES
+	RecentFiles recentFiles;
+#endif
 };
 
 #endif
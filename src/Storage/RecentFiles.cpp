@@ -0,0 +1,201 @@
+/*
+ * RecentFiles.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "RecentFiles.h"
+
+#if SUPPORT_RECENT_FILES
+
+#include "MassStorage.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+RecentFiles::RecentFiles() : numEntries(0), valid(false), complete(false)
+{
+	listMutex.Create("RecentFiles");
+}
+
+// Get the name of the index'th most recently modified file, reading the directory first if we need to
+bool RecentFiles::GetFileName(size_t index, const StringRef& fileName)
+{
+	MutexLocker lock(listMutex);
+	if (!valid)
+	{
+		Build();
+	}
+	if (index < numEntries)
+	{
+		fileName.copy(entries[index].fileName);
+		return true;
+	}
+	return false;
+}
+
+// A file has been opened for writing, so it is now the newest file. We don't use its timestamp because FatFs doesn't update it until the file is closed.
+void RecentFiles::FileWritten(const char *path)
+{
+	String<MaxFilenameLength> leafName;
+	if (GetLeafName(path, leafName))
+	{
+		MutexLocker lock(listMutex);
+		if (valid)
+		{
+			Platform& platform = reprap.GetPlatform();
+			time_t now = (platform.IsDateTimeSet()) ? platform.GetDateTime() : 0;
+			if (numEntries != 0 && entries[0].lastModified > now)
+			{
+				now = entries[0].lastModified;
+			}
+			Remove(leafName.c_str());
+			if (valid)
+			{
+				Insert(leafName.c_str(), now);
+			}
+		}
+	}
+}
+
+// A file has appeared in the directory because it was renamed, or its timestamp has been set
+void RecentFiles::FileChanged(const char *path, time_t lastModified)
+{
+	String<MaxFilenameLength> leafName;
+	if (GetLeafName(path, leafName))
+	{
+		MutexLocker lock(listMutex);
+		if (valid)
+		{
+			Remove(leafName.c_str());
+			if (valid)								// removing the file may have made the list invalid
+			{
+				Insert(leafName.c_str(), lastModified);
+			}
+		}
+	}
+}
+
+// A file has been deleted or renamed
+void RecentFiles::FileRemoved(const char *path)
+{
+	String<MaxFilenameLength> leafName;
+	if (GetLeafName(path, leafName))
+	{
+		MutexLocker lock(listMutex);
+		if (valid)
+		{
+			Remove(leafName.c_str());
+		}
+	}
+}
+
+void RecentFiles::Invalidate()
+{
+	MutexLocker lock(listMutex);
+	valid = false;
+}
+
+// If the path is a file in the G-code files directory, return true with the name of the file within that directory
+/*static*/ bool RecentFiles::GetLeafName(const char *path, String<MaxFilenameLength>& leafName)
+{
+	String<MaxFilenameLength> dir;
+	dir.copy(path);
+	const char * const lastSlash = strrchr(dir.c_str(), '/');
+	if (lastSlash == nullptr || lastSlash[1] == 0 || lastSlash[1] == '.')		// ignore hidden files, including our file information index
+	{
+		return false;
+	}
+	leafName.copy(lastSlash + 1);
+	dir.Truncate(lastSlash + 1 - dir.c_str());
+
+	// Paths may or may not start with a volume specifier. We only keep a list for the directory on volume 0.
+	const char *gcodeDir = reprap.GetPlatform().GetGCodeDir();
+	if (gcodeDir[0] == '0' && gcodeDir[1] == ':')
+	{
+		gcodeDir += 2;
+	}
+	const char *d = dir.c_str();
+	if (isdigit(d[0]) && d[1] == ':')
+	{
+		if (d[0] != '0')
+		{
+			return false;
+		}
+		d += 2;
+	}
+	return StringEquals(d, gcodeDir);
+}
+
+// Read the directory and keep the newest files. Called with the mutex owned.
+void RecentFiles::Build()
+{
+	numEntries = 0;
+	complete = true;
+	MassStorage * const massStorage = reprap.GetPlatform().GetMassStorage();
+	FileInfo fileInfo;
+	if (massStorage->FindFirst(reprap.GetPlatform().GetGCodeDir(), fileInfo))
+	{
+		do
+		{
+			if (!fileInfo.isDirectory && fileInfo.fileName[0] != '.')
+			{
+				Insert(fileInfo.fileName, fileInfo.lastModified);
+			}
+		} while (massStorage->FindNext(fileInfo));
+		valid = true;
+	}
+}
+
+// Add a file to the list in order of modification time, newest first. Called with the mutex owned.
+void RecentFiles::Insert(const char *fileName, time_t lastModified)
+{
+	size_t pos = 0;
+	while (pos < numEntries && entries[pos].lastModified > lastModified)
+	{
+		++pos;
+	}
+
+	if (pos == MaxFiles)
+	{
+		complete = false;							// the file is older than all the files we hold
+		return;
+	}
+	if (pos == numEntries && !complete)
+	{
+		return;										// there may be files that we don't hold that are newer than this one
+	}
+
+	if (numEntries == MaxFiles)
+	{
+		complete = false;							// we are dropping the oldest file
+	}
+	else
+	{
+		++numEntries;
+	}
+	memmove(&entries[pos + 1], &entries[pos], (numEntries - 1 - pos) * sizeof(Entry));
+	SafeStrncpy(entries[pos].fileName, fileName, ARRAY_SIZE(entries[pos].fileName));
+	entries[pos].lastModified = lastModified;
+}
+
+// Remove a file from the list if we hold it. If the list doesn't hold every file then it is no longer valid. Called with the mutex owned.
+void RecentFiles::Remove(const char *fileName)
+{
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		if (StringEquals(entries[i].fileName, fileName))
+		{
+			--numEntries;
+			memmove(&entries[i], &entries[i + 1], (numEntries - i) * sizeof(Entry));
+			if (!complete)
+			{
+				valid = false;
+			}
+			break;
+		}
+	}
+}
+
+#endif
+
+// End
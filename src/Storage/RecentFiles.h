@@ -0,0 +1,57 @@
+/*
+ * RecentFiles.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  A list of the most recently modified files in the G-code files directory, newest first, so that a client can show the latest jobs
+ *  without us reading the whole directory each time. The list is built by reading the directory once and is then kept up to date as
+ *  MassStorage writes, renames and deletes files in that directory. If a file that we hold is deleted while the directory contains more
+ *  files than we hold, we don't know which file should take its place, so the list is built again the next time it is wanted.
+ */
+
+#ifndef SRC_STORAGE_RECENTFILES_H_
+#define SRC_STORAGE_RECENTFILES_H_
+
+#include "RepRapFirmware.h"
+#include "RTOSIface.h"
+
+#include <ctime>
+
+#if SUPPORT_RECENT_FILES
+
+class RecentFiles
+{
+public:
+	static constexpr size_t MaxFiles = 10;				// the number of files we keep in the list
+
+	RecentFiles();
+
+	bool GetFileName(size_t index, const StringRef& fileName);		// Get the name of the index'th newest file, returning false if there aren't that many files
+	void FileWritten(const char *path);								// A file has been opened for writing
+	void FileChanged(const char *path, time_t lastModified);			// A file has been created by renaming, or its timestamp has been changed
+	void FileRemoved(const char *path);								// A file has been deleted or renamed
+	void Invalidate();												// Read the directory again next time the list is wanted
+
+private:
+	struct Entry
+	{
+		char fileName[MaxFilenameLength];				// the name of the file within the G-code files directory
+		time_t lastModified;
+	};
+
+	static bool GetLeafName(const char *path, String<MaxFilenameLength>& leafName);
+
+	void Build();
+	void Insert(const char *fileName, time_t lastModified);
+	void Remove(const char *fileName);
+
+	Mutex listMutex;
+	Entry entries[MaxFiles];
+	size_t numEntries;
+	bool valid;											// true if we have read the directory since the list was last invalidated
+	bool complete;										// true if the list holds every file in the directory
+};
+
+#endif
+
+#endif /* SRC_STORAGE_RECENTFILES_H_ */
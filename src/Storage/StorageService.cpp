@@ -0,0 +1,148 @@
+/*
+ * StorageService.cpp
+ *
+ *  Created on: 14 Oct 2026
+ */
+
+#include "StorageService.h"
+
+#if SUPPORT_STORAGE_TASK
+
+#include "FileStore.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+constexpr unsigned int StorageTaskStackWords = 300;		// FatFs and the HSMCI driver don't need much, because FatFs keeps its sector buffers in the file system objects
+static Task<StorageTaskStackWords> storageTask;
+
+StorageRequest * volatile StorageService::requestQueue = nullptr;
+uint32_t StorageService::numRequests = 0;
+uint32_t StorageService::longestRequestTime = 0;
+
+/*static*/ void StorageService::Init()
+{
+	storageTask.Create(TaskLoop, "STORAGE", nullptr, TaskBase::StoragePriority);
+}
+
+// Queue a request to read from the current position in a file. The request must not already be busy.
+/*static*/ void StorageService::Read(StorageRequest& req, FileStore *f, char *buf, size_t len, StorageRequestPriority prio)
+{
+	req.file = f;
+	req.buffer = buf;
+	req.length = len;
+	req.priority = prio;
+	req.waitingTask = nullptr;
+	req.whenQueued = millis();
+
+	{
+		TaskCriticalSectionLocker lock;
+
+		// Insert the request after any others of the same or higher priority
+		StorageRequest * volatile *pp = &requestQueue;
+		while (*pp != nullptr && (*pp)->priority <= prio)
+		{
+			pp = &((*pp)->next);
+		}
+		req.next = *pp;
+		*pp = &req;
+		req.state = StorageRequest::State::queued;
+	}
+	storageTask.Give();
+}
+
+// Return the result of a request that has finished and make the request idle
+/*static*/ int StorageService::Collect(StorageRequest& req)
+{
+	req.state = StorageRequest::State::idle;
+	return req.result;
+}
+
+// Withdraw a request. If the storage task has already started it, wait for it to finish.
+// On return the request is idle, and the caller can't tell how much of the file was read, so it must set the file position again.
+/*static*/ void StorageService::Cancel(StorageRequest& req)
+{
+	for (;;)
+	{
+		{
+			TaskCriticalSectionLocker lock;
+			if (req.state == StorageRequest::State::queued)
+			{
+				StorageRequest * volatile *pp = &requestQueue;
+				while (*pp != &req)
+				{
+					pp = &((*pp)->next);
+				}
+				*pp = req.next;
+				req.state = StorageRequest::State::idle;
+			}
+			if (req.state != StorageRequest::State::active)
+			{
+				req.state = StorageRequest::State::idle;
+				return;
+			}
+			req.waitingTask = xTaskGetCurrentTaskHandle();
+		}
+		(void)TaskBase::Take(CancelWaitTicks);
+	}
+}
+
+// Remove the highest priority request from the queue and mark it active, or return nullptr if there are no requests
+/*static*/ StorageRequest *StorageService::TakeNextRequest()
+{
+	TaskCriticalSectionLocker lock;
+	StorageRequest * const req = requestQueue;
+	if (req != nullptr)
+	{
+		requestQueue = req->next;
+		req->state = StorageRequest::State::active;
+	}
+	return req;
+}
+
+/*static*/ void StorageService::Complete(StorageRequest& req)
+{
+	const uint32_t requestTime = millis() - req.whenQueued;
+	if (requestTime > longestRequestTime)
+	{
+		longestRequestTime = requestTime;
+	}
+	++numRequests;
+
+	TaskHandle_t waitingTask;
+	{
+		TaskCriticalSectionLocker lock;
+		waitingTask = req.waitingTask;
+		req.state = StorageRequest::State::done;
+	}
+	if (waitingTask != nullptr)
+	{
+		xTaskNotifyGive(waitingTask);
+	}
+}
+
+/*static*/ void StorageService::TaskLoop(void *)
+{
+	for (;;)
+	{
+		StorageRequest * const req = TakeNextRequest();
+		if (req == nullptr)
+		{
+			(void)TaskBase::Take(portMAX_DELAY);				// wait until a request is queued
+		}
+		else
+		{
+			req->result = req->file->Read(req->buffer, req->length);
+			Complete(*req);
+		}
+	}
+}
+
+/*static*/ void StorageService::Diagnostics(MessageType mtype)
+{
+	reprap.GetPlatform().MessageF(mtype, "Storage task requests: %" PRIu32 ", longest %" PRIu32 "ms\n", numRequests, longestRequestTime);
+	numRequests = longestRequestTime = 0;
+}
+
+#endif
+
+// End
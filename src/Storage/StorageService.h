@@ -0,0 +1,79 @@
+/*
+ * StorageService.h
+ *
+ *  Created on: 14 Oct 2026
+ *
+ *  A task that reads files on behalf of other tasks, so that they can get on with something else while the SD card transfer takes place.
+ *  Requests are queued in priority order. The task runs at a higher priority than the main and network tasks, so when it contends with them
+ *  for a volume mutex it gets it first, and priority inheritance limits how long it waits for one that is held by a long directory scan.
+ */
+
+#ifndef SRC_STORAGE_STORAGESERVICE_H_
+#define SRC_STORAGE_STORAGESERVICE_H_
+
+#include "RepRapFirmware.h"
+#include "MessageType.h"
+#include "RTOSIface.h"
+
+#if SUPPORT_STORAGE_TASK
+
+class FileStore;
+
+enum class StorageRequestPriority : uint8_t
+{
+	readAhead = 0,			// reading ahead in a file that is being printed
+	normal,
+	background				// e.g. metadata scans
+};
+
+// A request to read from a file. The requester owns the request object and the buffer, and must not touch the file while the request is busy.
+class StorageRequest
+{
+public:
+	friend class StorageService;
+
+	StorageRequest() : next(nullptr), waitingTask(nullptr), file(nullptr), buffer(nullptr), length(0), result(0), whenQueued(0), priority(StorageRequestPriority::normal), state(State::idle) { }
+
+	bool IsBusy() const { return state == State::queued || state == State::active; }
+	bool IsDone() const { return state == State::done; }
+
+private:
+	enum class State : uint8_t { idle, queued, active, done };
+
+	StorageRequest *next;
+	TaskHandle_t waitingTask;
+	FileStore *file;
+	char *buffer;
+	size_t length;
+	int result;
+	uint32_t whenQueued;
+	StorageRequestPriority priority;
+	volatile State state;
+};
+
+class StorageService
+{
+public:
+	static void Init();
+	static void Read(StorageRequest& req, FileStore *f, char *buf, size_t len, StorageRequestPriority prio);	// queue a request to read from the current position in a file
+	static int Collect(StorageRequest& req);			// return the result of a request that has finished, i.e. the number of bytes read or -1 if there was an error
+	static void Cancel(StorageRequest& req);			// withdraw a request, waiting for it to finish if it has already been started
+	static void Diagnostics(MessageType mtype);
+	static uint32_t GetNumRequests() { return numRequests; }				// these are cleared by Diagnostics
+	static uint32_t GetLongestRequestTime() { return longestRequestTime; }
+
+private:
+	static void TaskLoop(void *);
+	static StorageRequest *TakeNextRequest();
+	static void Complete(StorageRequest& req);
+
+	static constexpr uint32_t CancelWaitTicks = 100;	// how long we wait for a request that is in progress before checking it again
+
+	static StorageRequest * volatile requestQueue;		// the requests waiting to be started, highest priority first
+	static uint32_t numRequests;
+	static uint32_t longestRequestTime;
+};
+
+#endif
+
+#endif /* SRC_STORAGE_STORAGESERVICE_H_ */
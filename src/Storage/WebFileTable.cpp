@@ -0,0 +1,82 @@
+/*
+ * WebFileTable.cpp
+ *
+ *  Created on: 15 Oct 2026
+ */
+
+#include "WebFileTable.h"
+
+#if SUPPORT_WEB_FILE_TABLE
+
+// Hash a path name, ignoring the default volume specifier. FAT file names are not case sensitive, so neither is the hash.
+/*static*/ uint32_t WebFileTable::Hash(const char *path, size_t length)
+{
+	if (length >= 2 && path[0] == '0' && path[1] == ':')
+	{
+		path += 2;
+		length -= 2;
+	}
+
+	uint32_t hash = 2166136261u;					// FNV-1a
+	while (length != 0)
+	{
+		hash = (hash ^ (uint8_t)tolower(*path++)) * 16777619u;
+		--length;
+	}
+	return hash;
+}
+
+// Return the hash of the path of the uncompressed version of a file
+/*static*/ uint32_t WebFileTable::PlainHash(const char *path)
+{
+	const size_t length = strlen(path);
+	return Hash(path, (StringEndsWith(path, ".gz")) ? length - 3 : length);
+}
+
+bool WebFileTable::Find(const char *path, unsigned int& variants) const
+{
+	const uint32_t hash = Hash(path, strlen(path));
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		if (entries[i].hash == hash)
+		{
+			variants = entries[i].variants;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WebFileTable::Add(const char *path, unsigned int variants)
+{
+	size_t i;
+	if (numEntries < MaxWebFileTableEntries)
+	{
+		i = numEntries++;
+	}
+	else
+	{
+		i = nextEntryToReplace;
+		nextEntryToReplace = (nextEntryToReplace + 1) % MaxWebFileTableEntries;
+	}
+	entries[i].hash = Hash(path, strlen(path));
+	entries[i].variants = variants;
+}
+
+void WebFileTable::FileChanged(const char *path)
+{
+	const uint32_t hash = PlainHash(path);
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		if (entries[i].hash == hash)
+		{
+			--numEntries;
+			entries[i] = entries[numEntries];
+			break;
+		}
+	}
+}
+
+#endif
+
+// End
@@ -0,0 +1,49 @@
+/*
+ * WebFileTable.h
+ *
+ *  Created on: 15 Oct 2026
+ *
+ *  A record of which web interface files exist on the SD card, and whether each one has a gzipped version, so that the web server
+ *  can open the right version of a file at the first attempt and reject requests for missing files without reading the card.
+ *  Each file that is looked up costs one scan of its directory, which finds both versions. Entries are keyed on a hash of the path name
+ *  of the uncompressed version and are discarded when either version is written, deleted or renamed, or when the card is unmounted.
+ */
+
+#ifndef SRC_STORAGE_WEBFILETABLE_H_
+#define SRC_STORAGE_WEBFILETABLE_H_
+
+#include "RepRapFirmware.h"
+
+#if SUPPORT_WEB_FILE_TABLE
+
+class WebFileTable
+{
+public:
+	static constexpr unsigned int PlainFileExists = 1;
+	static constexpr unsigned int GzipFileExists = 2;
+
+	WebFileTable() : numEntries(0), nextEntryToReplace(0) { }
+
+	bool Find(const char *path, unsigned int& variants) const;	// Look up which versions of a file exist, returning false if we don't know
+	void Add(const char *path, unsigned int variants);			// Record which versions of a file exist
+	void FileChanged(const char *path);							// Forget a file because it or its gzipped version has been changed
+	void Invalidate() { numEntries = 0; }						// Forget all files
+
+private:
+	struct Entry
+	{
+		uint32_t hash;
+		unsigned int variants;
+	};
+
+	static uint32_t Hash(const char *path, size_t length);
+	static uint32_t PlainHash(const char *path);
+
+	Entry entries[MaxWebFileTableEntries];
+	size_t numEntries;
+	size_t nextEntryToReplace;
+};
+
+#endif
+
+#endif /* SRC_STORAGE_WEBFILETABLE_H_ */
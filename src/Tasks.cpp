@@ -8,6 +8,9 @@
 #include "Tasks.h"
 #include "RepRap.h"
 #include "Platform.h"
+#include "Movement/StageTimer.h"
+#include "Libraries/General/FreelistManager.h"
+#include "Libraries/General/PoolStats.h"
 #include <malloc.h>
 
 #ifdef RTOS
@@ -173,7 +176,7 @@ namespace Tasks
 			p.MessageF(mtype, "Static ram: %d\n", &_end - ramstart);
 
 			const struct mallinfo mi = mallinfo();
-			p.MessageF(mtype, "Dynamic ram: %d of which %d recycled\n", mi.uordblks, mi.fordblks);
+			p.MessageF(mtype, "Dynamic ram: %d of which %d recycled in %d fragments\n", mi.uordblks, mi.fordblks, mi.ordblks);
 
 			uint32_t maxStack, neverUsed;
 #ifdef RTOS
@@ -185,6 +188,34 @@ namespace Tasks
 			p.MessageF(mtype, "Stack ram used: %" PRIu32 " current, %" PRIu32 " maximum\n", currentStack, maxStack);
 #endif
 			p.MessageF(mtype, "Never used ram: %" PRIu32 "\n", neverUsed);
+
+			// Print the free list statistics as size:in use/free/maximum in use/heap allocations
+			const FreelistStats *fs = FreelistManagerBase::GetStatsList();
+			if (fs != nullptr)
+			{
+				p.Message(mtype, "Free lists:");
+				do
+				{
+					p.MessageF(mtype, " %u:%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32,
+								fs->objectSize, fs->numInUse, fs->numFree, fs->maxInUse, fs->numHeapAllocations);
+					fs = fs->next;
+				} while (fs != nullptr);
+				p.Message(mtype, "\n");
+			}
+
+			// Print the fixed pool statistics as name in use/maximum in use/capacity/allocation failures
+			const PoolStats *ps = PoolStats::GetStatsList();
+			if (ps != nullptr)
+			{
+				p.Message(mtype, "Pools:");
+				do
+				{
+					p.MessageF(mtype, " %s %" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32,
+								ps->GetName(), ps->GetNumInUse(), ps->GetMaxInUse(), ps->GetCapacity(), ps->GetNumFailures());
+					ps = ps->GetNext();
+				} while (ps != nullptr);
+				p.Message(mtype, "\n");
+			}
 		}
 
 #ifdef RTOS
@@ -201,6 +232,17 @@ namespace Tasks
 			p.MessageF(mtype, " %s(%s,%u)",
 				taskDetails.pcTaskName, stateText, (unsigned int)(taskDetails.usStackHighWaterMark * sizeof(StackType_t)));
 		}
+
+		TaskCpuUsage usage[MaxReportedTasks];
+		const size_t numTasks = GetCpuUsage(usage);
+		if (numTasks != 0)
+		{
+			p.Message(mtype, "\nTask CPU use:");
+			for (size_t i = 0; i < numTasks; ++i)
+			{
+				p.MessageF(mtype, " %s %.1f%%", usage[i].name, (double)usage[i].percent);
+			}
+		}
 		p.Message(mtype, "\nOwned mutexes:");
 
 		for (const Mutex *m = Mutex::GetMutexList(); m != nullptr; m = m->GetNext())
@@ -223,6 +265,14 @@ namespace Tasks
 		return nullptr;
 #endif
 	}
+
+#if !defined(RTOS) || !configGENERATE_RUN_TIME_STATS
+	// We can only measure the CPU time used by each task if FreeRTOS collects run time statistics
+	size_t GetCpuUsage(TaskCpuUsage usage[MaxReportedTasks])
+	{
+		return 0;
+	}
+#endif
 }
 
 #ifdef RTOS
@@ -261,6 +311,100 @@ extern "C" void vApplicationGetTimerTaskMemory( StaticTask_t **ppxTimerTaskTCBBu
     *pulTimerTaskStackSize = ARRAY_SIZE(uxTimerTaskStack);
 }
 
+# if configGENERATE_RUN_TIME_STATS
+
+// FreeRTOSConfig.h must define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() to call vConfigureTimerForRunTimeStats() and portGET_RUN_TIME_COUNTER_VALUE() to call ulGetRunTimeCounterValue().
+// We count CPU cycles, extended to 64 bits so that we don't lose any when the cycle counter wraps, and scale them down so that the 32-bit run time counter takes hours to wrap.
+constexpr unsigned int RunTimeCounterShift = 8;
+
+static uint32_t lastCycleCount = 0;
+static uint32_t cycleCountWraps = 0;
+
+extern "C" void vConfigureTimerForRunTimeStats()
+{
+	StageTimer::EnableCycleCounter();
+	lastCycleCount = StageTimer::GetCycles();
+}
+
+// This is called by the scheduler on every context switch, which happens at least once per tick, so we never miss a wrap of the cycle counter
+extern "C" uint32_t ulGetRunTimeCounterValue()
+{
+	const irqflags_t flags = cpu_irq_save();
+	const uint32_t now = StageTimer::GetCycles();
+	if (now < lastCycleCount)
+	{
+		++cycleCountWraps;
+	}
+	lastCycleCount = now;
+	const uint64_t cycles = ((uint64_t)cycleCountWraps << 32) | now;
+	cpu_irq_restore(flags);
+	return (uint32_t)(cycles >> RunTimeCounterShift);
+}
+
+static TaskHandle_t reportedTasks[Tasks::MaxReportedTasks];
+static uint32_t lastTaskRunTimes[Tasks::MaxReportedTasks];
+static uint32_t lastCpuUsageTime = 0;
+
+// Get the percentage of the time since the last report that a task has run, and remember its run time for next time. Return false if we have no room to track the task.
+// The time that interrupts take is charged to whichever task they interrupted.
+static bool GetTaskCpuUsage(TaskHandle_t handle, uint32_t elapsed, Tasks::TaskCpuUsage& usage)
+{
+	size_t slot = 0;
+	while (reportedTasks[slot] != handle)
+	{
+		if (reportedTasks[slot] == nullptr)
+		{
+			reportedTasks[slot] = handle;
+			lastTaskRunTimes[slot] = 0;
+			break;
+		}
+		++slot;
+		if (slot == Tasks::MaxReportedTasks)
+		{
+			return false;
+		}
+	}
+
+	TaskStatus_t taskDetails;
+	vTaskGetInfo(handle, &taskDetails, pdFALSE, eInvalid);
+	const uint32_t ran = taskDetails.ulRunTimeCounter - lastTaskRunTimes[slot];
+	lastTaskRunTimes[slot] = taskDetails.ulRunTimeCounter;
+	usage.name = taskDetails.pcTaskName;
+	usage.percent = (elapsed == 0) ? 0.0 : 100.0 * (float)ran/(float)elapsed;
+	return true;
+}
+
+size_t Tasks::GetCpuUsage(TaskCpuUsage usage[MaxReportedTasks])
+{
+	const uint32_t now = ulGetRunTimeCounterValue();
+	const uint32_t elapsed = now - lastCpuUsageTime;
+	lastCpuUsageTime = now;
+
+	size_t numTasks = 0;
+	for (const TaskBase *t = TaskBase::GetTaskList(); t != nullptr && numTasks < MaxReportedTasks; t = t->GetNext())
+	{
+		if (GetTaskCpuUsage(t->GetHandle(), elapsed, usage[numTasks]))
+		{
+			++numTasks;
+		}
+	}
+
+	// The idle and timer tasks were created statically by FreeRTOS using our storage, so their handles are the addresses of their task control blocks
+#  if configUSE_TIMERS
+	if (numTasks < MaxReportedTasks && GetTaskCpuUsage(reinterpret_cast<TaskHandle_t>(&xTimerTaskTCB), elapsed, usage[numTasks]))
+	{
+		++numTasks;
+	}
+#  endif
+	if (numTasks < MaxReportedTasks && GetTaskCpuUsage(reinterpret_cast<TaskHandle_t>(&xIdleTaskTCB), elapsed, usage[numTasks]))
+	{
+		++numTasks;
+	}
+	return numTasks;
+}
+
+# endif
+
 #endif
 
 // Exception handlers
@@ -14,7 +14,16 @@
 
 namespace Tasks
 {
+	constexpr size_t MaxReportedTasks = 10;
+
+	struct TaskCpuUsage
+	{
+		const char *name;
+		float percent;
+	};
+
 	void Diagnostics(MessageType mtype);
+	size_t GetCpuUsage(TaskCpuUsage usage[MaxReportedTasks]);	// get the percentage of CPU time used by each task since we last asked
 	uint32_t GetNeverUsedRam();
 	const Mutex *GetSpiMutex();
 }
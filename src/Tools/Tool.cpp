@@ -34,7 +34,7 @@
 Tool * Tool::freelist = nullptr;
 
 // Create a new tool and return a pointer to it. If an error occurs, put an error message in 'reply' and return nullptr.
-/*static*/ Tool *Tool::Create(int toolNumber, const char *name, long d[], size_t dCount, long h[], size_t hCount, AxesBitmap xMap, AxesBitmap yMap, FansBitmap fanMap, const StringRef& reply)
+/*static*/ Tool *Tool::Create(int toolNumber, const char *name, long d[], size_t dCount, long h[], size_t hCount, AxesBitmap xMap, AxesBitmap yMap, AxesBitmap mirrorMap, FansBitmap fanMap, const StringRef& reply)
 {
 	const size_t numExtruders = reprap.GetGCodes().GetNumExtruders();
 	if (dCount > ARRAY_SIZE(Tool::drives))
@@ -112,10 +112,12 @@ Tool * Tool::freelist = nullptr;
 	t->heaterCount = hCount;
 	t->xMapping = xMap;
 	t->yMapping = yMap;
+	t->mirroredXAxes = mirrorMap & xMap;
 	t->fanMapping = fanMap;
 	t->heaterFault = false;
 	t->axisOffsetsProbed = 0;
 	t->displayColdExtrudeWarning = false;
+	t->maxVolumetricFlow = t->filamentDiameter = t->maxExtrusionRate = 0.0;
 
 	for (size_t axis = 0; axis < MaxAxes; axis++)
 	{
@@ -192,6 +194,20 @@ void Tool::Print(const StringRef& reply) const
 		}
 	}
 
+	if (mirroredXAxes != 0)
+	{
+		reply.cat("; mirrored:");
+		sep = ' ';
+		for (size_t xi = 0; xi < MaxAxes; ++xi)
+		{
+			if ((mirroredXAxes & (1u << xi)) != 0)
+			{
+				reply.catf("%c%c", sep, reprap.GetGCodes().GetAxisLetters()[xi]);
+				sep = ',';
+			}
+		}
+	}
+
 	reply.cat("; ymap:");
 	sep = ' ';
 	for (size_t yi = 0; yi < MaxAxes; ++yi)
@@ -217,6 +233,14 @@ void Tool::Print(const StringRef& reply) const
 	reply.catf("; status: %s", (state == ToolState::active) ? "selected" : (state == ToolState::standby) ? "standby" : "off");
 }
 
+// Set the maximum volumetric flow in mm^3/sec and the diameter of the filament it is fed with. A flow of zero removes the limit.
+void Tool::SetMaxVolumetricFlow(float flow, float diameter)
+{
+	maxVolumetricFlow = flow;
+	filamentDiameter = diameter;
+	maxExtrusionRate = (flow > 0.0 && diameter > 0.0) ? flow/(fsquare(diameter) * (Pi/4.0)) : 0.0;
+}
+
 float Tool::MaxFeedrate() const
 {
 	if (driveCount <= 0)
@@ -45,7 +45,7 @@ class Tool
 {
 public:
 
-	static Tool *Create(int toolNumber, const char *name, long d[], size_t dCount, long h[], size_t hCount, AxesBitmap xMap, AxesBitmap yMap, FansBitmap fanMap, const StringRef& reply);
+	static Tool *Create(int toolNumber, const char *name, long d[], size_t dCount, long h[], size_t hCount, AxesBitmap xMap, AxesBitmap yMap, AxesBitmap mirrorMap, FansBitmap fanMap, const StringRef& reply);
 	static void Delete(Tool *t);
 
 	float GetOffset(size_t axis) const pre(axis < MaxAxes);
@@ -61,9 +61,14 @@ public:
 	void DefineMix(const float m[]);
 	const float* GetMix() const;
 	float MaxFeedrate() const;
+	float GetMaxVolumetricFlow() const { return maxVolumetricFlow; }
+	float GetFilamentDiameter() const { return filamentDiameter; }
+	float GetMaxExtrusionRate() const { return maxExtrusionRate; }		// get the filament feed rate limit in mm/sec, or zero if there isn't one
+	void SetMaxVolumetricFlow(float flow, float diameter);
 	void Print(const StringRef& reply) const;
 	AxesBitmap GetXAxisMap() const { return xMapping; }
 	AxesBitmap GetYAxisMap() const { return yMapping; }
+	AxesBitmap GetMirroredXAxes() const { return mirroredXAxes; }	// the X axes that move in the opposite direction to X, for mirrored printing
 	FansBitmap GetFanMapping() const { return fanMapping; }
 	Filament *GetFilament() const { return filament; }
 	Tool *Next() const { return next; }
@@ -101,10 +106,14 @@ private:
 	float mix[MaxExtruders];
 	float activeTemperatures[Heaters];
 	float standbyTemperatures[Heaters];
+	float maxVolumetricFlow;							// the maximum volumetric flow in mm^3/sec, or zero if there is no limit
+	float filamentDiameter;								// the filament diameter used to convert the volumetric flow limit to a filament feed rate
+	float maxExtrusionRate;								// the maximum filament feed rate in mm/sec, or zero if there is no limit
 	size_t driveCount;
 	size_t heaterCount;
 	int myNumber;
 	AxesBitmap xMapping, yMapping;
+	AxesBitmap mirroredXAxes;
 	AxesBitmap axisOffsetsProbed;
 	FansBitmap fanMapping;
 	uint8_t drives[MaxExtruders];
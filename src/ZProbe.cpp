@@ -22,8 +22,9 @@ void ZProbe::Init(float h)
 	travelSpeed = DefaultZProbeTravelSpeed;
 	recoveryTime = 0.0;
 	tolerance = DefaultZProbeTolerance;
+	maxStdDev = 0.0;
 	maxTaps = DefaultZProbeTaps;
-	invertReading = turnHeatersOff = false;
+	invertReading = turnHeatersOff = interpolateTrigger = false;
 }
 
 float ZProbe::GetStopHeight(float temperature) const
@@ -39,9 +39,11 @@ public:
 	float travelSpeed;				// the speed at which we travel to the probe point
 	float recoveryTime;				// Z probe recovery time
 	float tolerance;				// maximum difference between probe heights when doing >1 taps
+	float maxStdDev;				// if nonzero, stop tapping when the standard deviation of the readings is within this, and reject outliers
 	uint8_t maxTaps;				// maximum probes at each point
 	bool invertReading;				// true if we need to invert the reading
 	bool turnHeatersOff;			// true to turn heaters off while probing
+	bool interpolateTrigger;		// true to correct the stopped height using the time at which the unfiltered reading crossed the threshold
 
 	void Init(float h);
 	float GetStopHeight(float temperature) const;